@@ -25,7 +25,7 @@ LIBARCH_SOURCES := \
 
 
 ifeq ($(ARCH),x86_64)
-LIBARCH_SOURCES += simd_vector_avx.cc
+LIBARCH_SOURCES += simd_vector_avx.cc simd_vector_avx2.cc simd_vector_avx512.cc
 endif
 
 LIBARCH_LINK := \
@@ -51,6 +51,12 @@ $(eval $(call library,gc,$(LIBGC_SOURCES),$(LIBGC_LINK)))
 # shared library loading if it's not here.
 $(eval $(call set_single_compile_option,simd_vector_avx.cc,-mavx))
 
+# The wide kernels must not contract multiplies and adds, so that their
+# element-wise results match the generic versions.  gcc warns about its
+# own _mm512_undefined_* intrinsics.
+$(eval $(call set_single_compile_option,simd_vector_avx2.cc,-mavx2 -mfma -ffp-contract=off))
+$(eval $(call set_single_compile_option,simd_vector_avx512.cc,-mavx512f -ffp-contract=off $(if $(findstring gcc,$(toolchain)),-Wno-uninitialized -Wno-maybe-uninitialized)))
+
 $(eval $(call library,exception_hook,exception_hook.cc,arch dl))
 
 $(eval $(call library,node_exception_tracing,node_exception_tracing.cc,exception_hook arch dl))
@@ -181,6 +181,13 @@ struct Regs {
 
 Regs cpuid(uint32_t request, uint32_t ecx = 0);
 
+/** Read the given extended control register.  XCR0 says which register
+    state the OS saves on a context switch, and so which of the vector
+    extensions reported by cpuid can actually be used.  Only valid when
+    cpu_info().osxsave is set.
+*/
+uint64_t xgetbv(uint32_t xcr = 0);
+
 #endif // __i686__
 
 } // namespace MLDB
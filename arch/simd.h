@@ -50,7 +50,23 @@ MLDB_ALWAYS_INLINE bool has_avx()
 
 MLDB_ALWAYS_INLINE bool has_avx2()
 {
-    return cpuid(7, 0).ebx & (1 << 5);
+    return has_avx() && (cpuid(7, 0).ebx & (1 << 5));
+}
+
+MLDB_ALWAYS_INLINE bool has_fma()
+{
+    return has_avx() && cpu_info().fma;
+}
+
+/** AVX-512 foundation instructions.  As well as the cpuid bit, the OS needs
+    to save the opmask and upper zmm registers (bits 5-7 of XCR0) along
+    with the xmm and ymm state (bits 1-2).
+*/
+MLDB_ALWAYS_INLINE bool has_avx512f()
+{
+    return has_avx2()
+        && (cpuid(7, 0).ebx & (1 << 16))
+        && (xgetbv(0) & 0xe6) == 0xe6;
 }
 
 #endif // __i686__
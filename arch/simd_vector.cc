@@ -10,11 +10,13 @@
 #include "mldb/arch/arch.h"
 #include "mldb/compiler/compiler.h"
 #include "exception.h"
+#include "simd_vector.h"
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 #if MLDB_INTEL_ISA
-# include "simd_vector.h"
 # include "simd_vector_avx.h"
+# include "simd_vector_wide.h"
 # include "sse2.h"
 # include <immintrin.h>
 #endif
@@ -24,6 +26,75 @@ using namespace std;
 
 namespace MLDB {
 namespace SIMD {
+
+
+/*****************************************************************************/
+/* INSTRUCTION SET SELECTION                                                 */
+/*****************************************************************************/
+
+namespace {
+
+VecIsa detectVecIsa()
+{
+#if MLDB_INTEL_ISA
+    if (has_avx512f())
+        return VEC_ISA_AVX512;
+    if (has_avx2() && has_fma())
+        return VEC_ISA_AVX2;
+#endif
+    return VEC_ISA_GENERIC;
+}
+
+// Chosen once, when the library is loaded.  Until then it's zero (ie
+// VEC_ISA_GENERIC), so vec_* functions called from other static
+// constructors are still safe.
+VecIsa currentVecIsa = detectVecIsa();
+
+} // file scope
+
+VecIsa vec_isa()
+{
+    return currentVecIsa;
+}
+
+VecIsa best_vec_isa()
+{
+    static const VecIsa result = detectVecIsa();
+    return result;
+}
+
+void set_vec_isa(VecIsa isa)
+{
+    if (isa < VEC_ISA_GENERIC || isa > best_vec_isa())
+        throw Exception("set_vec_isa(): instruction set %s is not supported "
+                        "by this CPU", vec_isa_name(isa));
+    currentVecIsa = isa;
+}
+
+const char * vec_isa_name(VecIsa isa)
+{
+    switch (isa) {
+    case VEC_ISA_GENERIC: return "generic";
+    case VEC_ISA_AVX2:    return "avx2";
+    case VEC_ISA_AVX512:  return "avx512";
+    }
+    return "unknown";
+}
+
+// Hand the call over to the wide version for the selected instruction set,
+// if there is one.
+#if MLDB_INTEL_ISA
+# define MLDB_SIMD_DISPATCH(call)                          \
+    switch (currentVecIsa) {                               \
+    case VEC_ISA_AVX512: return Avx512::call;              \
+    case VEC_ISA_AVX2:   return Avx2::call;                \
+    default:             break;                            \
+    }
+#else
+# define MLDB_SIMD_DISPATCH(call)
+#endif
+
+
 namespace Generic {
 
 template<typename X>
@@ -35,6 +106,8 @@ constexpr int ptr_align(const X * p)
 
 void vec_scale(const float * x, float k, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_scale(x, k, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -71,6 +144,8 @@ void vec_scale(const float * x, float k, float * r, size_t n)
 
 void vec_add(const float * x, const float * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, y, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -112,6 +187,8 @@ void vec_add(const float * x, const float * y, float * r, size_t n)
 
 void vec_prod(const float * x, const float * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_prod(x, y, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -153,6 +230,8 @@ void vec_prod(const float * x, const float * y, float * r, size_t n)
 
 void vec_prod(const float * x, const double * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_prod(x, y, r, n));
+
     size_t i = 0;
 
 #if 0 // TODO: do
@@ -201,12 +280,16 @@ void vec_prod(const float * x, const double * y, float * r, size_t n)
 
 void vec_prod(const double * x, const double * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_prod(x, y, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = x[i] * y[i];
 }
 
 void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
     //bool alignment_unimportant = true;  // nehalem?
@@ -302,6 +385,8 @@ void vec_add(const float * x, float k, const float * y, float * r, size_t n)
 void vec_add(const float * x, const float * k, const float * y, float * r,
              size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -349,6 +434,8 @@ void vec_add(const float * x, const float * k, const float * y, float * r,
 
 void vec_add(const float * x, float k, const double * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     for (size_t i = 0; i < n;  ++i) r[i] = x[i] + k * y[i];
 }
 
@@ -367,11 +454,15 @@ float vec_dotprod_sse2(const float * x, const float * y, size_t n)
 
 float vec_dotprod(const float * x, const float * y, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_dotprod(x, y, n));
+
     return vec_dotprod_generic(x, y, n);
 }
 
 void vec_scale(const double * x, double k, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_scale(x, k, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -409,6 +500,8 @@ void vec_scale(const double * x, double k, double * r, size_t n)
 void vec_add(const double * x, double k, const double * y, double * r,
              size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -457,6 +550,8 @@ void vec_add(const double * x, double k, const double * y, double * r,
 void vec_add(const double * x, const double * k, const double * y,
              double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -631,6 +726,8 @@ double vec_dotprod(const double * x, const double * y, size_t n)
 #else
 double vec_dotprod(const double * x, const double * y, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_dotprod(x, y, n));
+
     // Interrogate the cpuid flags directly to decide which one to use
         if (false)
         ;
@@ -652,6 +749,8 @@ double vec_dotprod(const double * x, const double * y, size_t n)
 
 void vec_minus(const float * x, const float * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_minus(x, y, r, n));
+
     // Interrogate the cpuid flags directly to decide which one to use
     if (false)
         ;
@@ -670,6 +769,8 @@ void vec_minus(const float * x, const float * y, float * r, size_t n)
 
 double vec_euclid(const float * x, const float * y, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_euclid(x, y, n));
+
     // Interrogate the cpuid flags directly to decide which one to use
         if (false)
         ;
@@ -697,6 +798,8 @@ double vec_euclid(const float * x, const float * y, size_t n)
 double vec_accum_prod3(const float * x, const float * y, const float * z,
                        size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_accum_prod3(x, y, z, n));
+
     double res = 0.0;
     size_t i = 0;
 
@@ -778,6 +881,8 @@ double vec_accum_prod3(const float * x, const float * y, const float * z,
 double vec_accum_prod3(const float * x, const float * y, const double * z,
                        size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_accum_prod3(x, y, z, n));
+
     double res = 0.0;
     size_t i = 0;
 
@@ -817,12 +922,16 @@ double vec_accum_prod3(const float * x, const float * y, const double * z,
 
 void vec_minus(const double * x, const double * y, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_minus(x, y, r, n));
+
     for (size_t i = 0;  i < n;  ++i) r[i] = x[i] - y[i];
 }
 
 double vec_accum_prod3(const double * x, const double * y, const double * z,
                       size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_accum_prod3(x, y, z, n));
+
     size_t i = 0;
     double result = 0.0;
 
@@ -884,6 +993,8 @@ double vec_accum_prod3(const double * x, const double * y, const double * z,
 double vec_accum_prod3(const double * x, const double * y, const float * z,
                       size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_accum_prod3(x, y, z, n));
+
     size_t i = 0;
     double result = 0.0;
 
@@ -925,6 +1036,8 @@ double vec_accum_prod3(const double * x, const double * y, const float * z,
 
 double vec_sum(const double * x, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_sum(x, n));
+
     double res = 0.0;
     for (size_t i = 0;  i < n;  ++i)
         res += x[i];
@@ -1004,6 +1117,8 @@ double vec_dotprod_dp_sse2(const float * x, const float * y, size_t n)
 
 double vec_dotprod_dp(const double * x, const float * y, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_dotprod_dp(x, y, n));
+
     double res = 0.0;
 
     size_t i = 0;
@@ -1068,6 +1183,8 @@ double vec_dotprod_dp(const double * x, const float * y, size_t n)
 
 double vec_dotprod_dp(const float * x, const float * y, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_dotprod_dp(x, y, n));
+
     // Interrogate the cpuid flags directly to decide which one to use
         if (false)
         ;
@@ -1089,6 +1206,8 @@ double vec_dotprod_dp(const float * x, const float * y, size_t n)
 
 double vec_sum_dp(const float * x, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_sum_dp(x, n));
+
     double res = 0.0;
     for (size_t i = 0;  i < n;  ++i)
         res += x[i];
@@ -1097,6 +1216,8 @@ double vec_sum_dp(const float * x, size_t n)
 
 void vec_add(const double * x, const double * y, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, y, r, n));
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -1136,6 +1257,8 @@ void vec_add(const double * x, const double * y, double * r, size_t n)
 
 void vec_add(const double * x, double k, const float * y, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1198,11 +1321,15 @@ void vec_add(const double * x, double k, const float * y, double * r, size_t n)
 
 void vec_add(const double * x, const float * y, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, y, r, n));
+
     for (size_t i = 0;  i < n;  ++i) r[i] = x[i] + y[i];
 }
 
 void vec_prod(const double * x, const double * y, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_prod(x, y, r, n));
+
     size_t i = 0;
 #if MLDB_INTEL_ISA
     if (true) {
@@ -1241,6 +1368,8 @@ void vec_prod(const double * x, const double * y, double * r, size_t n)
 
 void vec_prod(const double * x, const float * y, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_prod(x, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1297,6 +1426,8 @@ void vec_k1_x_plus_k2_y_z(double k1, const double * x,
                           double k2, const double * y, const double * z,
                           double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_k1_x_plus_k2_y_z(k1, x, k2, y, z, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1362,6 +1493,8 @@ void vec_k1_x_plus_k2_y_z(float k1, const float * x,
                           float k2, const float * y, const float * z,
                           float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_k1_x_plus_k2_y_z(k1, x, k2, y, z, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1425,6 +1558,8 @@ void vec_k1_x_plus_k2_y_z(float k1, const float * x,
 
 void vec_add_sqr(const float * x, float k, const float * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add_sqr(x, k, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1475,6 +1610,8 @@ void vec_add_sqr(const float * x, float k, const float * y, float * r, size_t n)
 void vec_add_sqr(const double * x, double k, const double * y, double * r,
                  size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add_sqr(x, k, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1527,12 +1664,16 @@ void vec_add_sqr(const double * x, double k, const double * y, double * r,
 
 void vec_add_sqr(const float * x, float k, const double * y, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add_sqr(x, k, y, r, n));
+
     for (size_t i = 0; i < n;  ++i) r[i] = x[i] + k * (y[i] * y[i]);
 }
 
 void vec_add_sqr(const double * x, double k, const float * y, double * r,
                  size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add_sqr(x, k, y, r, n));
+
     size_t i = 0;
 
 #if MLDB_INTEL_ISA
@@ -1598,6 +1739,8 @@ void vec_add_sqr(const double * x, double k, const float * y, double * r,
 void vec_add(const float * x, const double * k, const double * y, float * r,
              size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -1634,6 +1777,8 @@ void vec_add(const float * x, const double * k, const double * y, float * r,
 void vec_add(const float * x, const float * k, const double * y, float * r,
              size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -1672,6 +1817,8 @@ void vec_add(const float * x, const float * k, const double * y, float * r,
 void vec_add(const double * x, const float * k, const float * y, double * r,
              size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -1705,6 +1852,8 @@ void vec_add(const double * x, const float * k, const float * y, double * r,
 void vec_add(const double * x, const float * k, const double * y, double * r,
              size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_add(x, k, y, r, n));
+
     size_t i = 0;
 
         if (false)
@@ -1742,42 +1891,56 @@ void vec_add(const double * x, const float * k, const double * y, double * r,
 
 void vec_exp(const float * x, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_exp(x, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)x[i]);
 }
 
 void vec_exp(const float * x, float k, float * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_exp(x, k, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)(k * x[i]));
 }
 
 void vec_exp(const float * x, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_exp(x, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)x[i]);
 }
 
 void vec_exp(const float * x, double k, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_exp(x, k, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)(k * x[i]));
 }
 
 void vec_exp(const double * x, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_exp(x, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)x[i]);
 }
 
 void vec_exp(const double * x, double k, double * r, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_exp(x, k, r, n));
+
     size_t i = 0;
     for (; i < n;  ++i) r[i] = exp((double)(k * x[i]));
 }
 
 float vec_twonorm_sqr(const float * x, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_twonorm_sqr(x, n));
+
     size_t i = 0;
     float result = 0.0;
     for (; i < n;  ++i) result += x[i] * x[i];
@@ -1786,6 +1949,8 @@ float vec_twonorm_sqr(const float * x, size_t n)
 
 double vec_twonorm_sqr_dp(const float * x, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_twonorm_sqr_dp(x, n));
+
     size_t i = 0;
     double result = 0.0;
     for (; i < n;  ++i) {
@@ -1797,6 +1962,8 @@ double vec_twonorm_sqr_dp(const float * x, size_t n)
 
 double vec_twonorm_sqr(const double * x, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_twonorm_sqr(x, n));
+
     size_t i = 0;
     double result = 0.0;
     for (; i < n;  ++i) result += x[i] * x[i];
@@ -1805,6 +1972,8 @@ double vec_twonorm_sqr(const double * x, size_t n)
 
 double vec_kl(const float * p, const float * q, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_kl(p, q, n));
+
     size_t i = 0;
 
     double total = 0.0;
@@ -1814,8 +1983,66 @@ double vec_kl(const float * p, const float * q, size_t n)
     return total;
 }
 
+void vec_max(const float * x, const float * y, float * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_max(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y[i]);
+}
+
+void vec_max(const float * x, float y, float * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_max(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y);
+}
+
+void vec_max(const double * x, const double * y, double * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_max(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y[i]);
+}
+
+void vec_max(const double * x, double y, double * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_max(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::max(x[i], y);
+}
+
+void vec_min(const float * x, const float * y, float * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_min(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y[i]);
+}
+
+void vec_min(const float * x, float y, float * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_min(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y);
+}
+
+void vec_min(const double * x, const double * y, double * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_min(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y[i]);
+}
+
+void vec_min(const double * x, double y, double * r, size_t n)
+{
+    MLDB_SIMD_DISPATCH(vec_min(x, y, r, n));
+
+    for (size_t i = 0;  i < n;  ++i) r[i] = std::min(x[i], y);
+}
+
 void vec_min_max_el(const float * x, float * mins, float * maxs, size_t n)
 {
+    MLDB_SIMD_DISPATCH(vec_min_max_el(x, mins, maxs, n));
+
     size_t i = 0;
 
         if (false)
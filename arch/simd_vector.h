@@ -172,6 +172,30 @@ double vec_euclid(const float * p, const float * q, size_t n);
 
 } // namespace Generic
 
+/** Instruction sets that the vec_* functions can use.  The best one that
+    the CPU supports is chosen when the library is loaded.
+*/
+enum VecIsa {
+    VEC_ISA_GENERIC,   ///< SSE2 on x86, plain C++ elsewhere
+    VEC_ISA_AVX2,      ///< AVX2 and FMA; 256 bit registers
+    VEC_ISA_AVX512     ///< AVX-512F; 512 bit registers
+};
+
+/// Instruction set that the vec_* functions are using
+VecIsa vec_isa();
+
+/// Best instruction set that this CPU supports
+VecIsa best_vec_isa();
+
+/** Make the vec_* functions use the given instruction set, for example to
+    compare them.  Throws if the CPU doesn't support it.  Not thread safe
+    with respect to calls of the vec_* functions.
+*/
+void set_vec_isa(VecIsa isa);
+
+/// Name of the instruction set, for logging ("generic", "avx2", "avx512")
+const char * vec_isa_name(VecIsa isa);
+
 #if MLDB_USE_SSE1
 
 namespace SSE1 {
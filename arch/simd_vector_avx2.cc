@@ -0,0 +1,107 @@
+/** simd_vector_avx2.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX2 and FMA versions.  Compiled with
+    -mavx2 -mfma -ffp-contract=off.
+*/
+
+#include "simd_vector_wide_impl.h"
+#include <immintrin.h>
+
+
+namespace MLDB {
+namespace SIMD {
+
+struct Avx2Isa {
+    typedef __m256 vf;
+    typedef __m256d vd;
+
+    static constexpr size_t NF = 8;
+    static constexpr size_t ND = 4;
+
+    static vf loadf(const float * p) { return _mm256_loadu_ps(p); }
+    static void storef(float * p, vf x) { _mm256_storeu_ps(p, x); }
+    static vd loadd(const double * p) { return _mm256_loadu_pd(p); }
+    static void stored(double * p, vd x) { _mm256_storeu_pd(p, x); }
+
+    static vd loadfd(const float * p)
+    {
+        return _mm256_cvtps_pd(_mm_loadu_ps(p));
+    }
+
+    static void storedf(float * p, vd x)
+    {
+        _mm_storeu_ps(p, _mm256_cvtpd_ps(x));
+    }
+
+    static vd loaddifffd(const float * x, const float * y)
+    {
+        return _mm256_cvtps_pd(_mm_sub_ps(_mm_loadu_ps(x), _mm_loadu_ps(y)));
+    }
+
+    static vf splatf(float x) { return _mm256_set1_ps(x); }
+    static vd splatd(double x) { return _mm256_set1_pd(x); }
+
+    static vd fmad(vd a, vd b, vd c) { return _mm256_fmadd_pd(a, b, c); }
+
+    static vf maxf(vf a, vf b) { return _mm256_max_ps(a, b); }
+    static vf minf(vf a, vf b) { return _mm256_min_ps(a, b); }
+    static vd maxd(vd a, vd b) { return _mm256_max_pd(a, b); }
+    static vd mind(vd a, vd b) { return _mm256_min_pd(a, b); }
+
+    static vd narrow(vd x) { return _mm256_cvtps_pd(_mm256_cvtpd_ps(x)); }
+
+    static vd rint(vd x)
+    {
+        return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    }
+
+    static vd pow2(vd n)
+    {
+        // Adding 1.5 * 2^52 puts the integer n + 1023 in the low bits of
+        // the mantissa, from where it can be shifted into the exponent.
+        __m256i bits = _mm256_castpd_si256(n + splatd(0x1.8p52 + 1023));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+    }
+
+    static vd exponent(vd x)
+    {
+        // The biased exponent is a small integer; or-ing it into the
+        // mantissa of 2^52 and subtracting 2^52 converts it to double.
+        __m256i e = _mm256_srli_epi64(_mm256_castpd_si256(x), 52);
+        e = _mm256_or_si256(e, _mm256_castpd_si256(splatd(0x1p52)));
+        return _mm256_castsi256_pd(e) - splatd(0x1p52 + 1023);
+    }
+
+    static vd mantissa(vd x)
+    {
+        __m256i m = _mm256_and_si256(_mm256_castpd_si256(x),
+                                     _mm256_set1_epi64x(0x000fffffffffffffLL));
+        m = _mm256_or_si256(m, _mm256_castpd_si256(splatd(1.0)));
+        return _mm256_castsi256_pd(m);
+    }
+
+    static vd selectGreater(vd x, vd t, vd a, vd b)
+    {
+        return _mm256_blendv_pd(b, a, _mm256_cmp_pd(x, t, _CMP_GT_OQ));
+    }
+
+    static bool allWithin(vd x, double lo, double hi)
+    {
+        vd in = _mm256_and_pd(_mm256_cmp_pd(x, splatd(lo), _CMP_GE_OQ),
+                              _mm256_cmp_pd(x, splatd(hi), _CMP_LE_OQ));
+        return _mm256_movemask_pd(in) == 0xf;
+    }
+
+    static double sumd(vd x)
+    {
+        double vals[ND];
+        stored(vals, x);
+        return (vals[0] + vals[1]) + (vals[2] + vals[3]);
+    }
+};
+
+template struct Wide<Avx2Isa>;
+
+} // namespace SIMD
+} // namespace MLDB
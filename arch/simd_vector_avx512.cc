@@ -0,0 +1,88 @@
+/** simd_vector_avx512.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations; AVX-512 versions.  Compiled with -mavx512f
+    -ffp-contract=off.
+*/
+
+#include "simd_vector_wide_impl.h"
+#include <immintrin.h>
+
+
+namespace MLDB {
+namespace SIMD {
+
+struct Avx512Isa {
+    typedef __m512 vf;
+    typedef __m512d vd;
+
+    static constexpr size_t NF = 16;
+    static constexpr size_t ND = 8;
+
+    static vf loadf(const float * p) { return _mm512_loadu_ps(p); }
+    static void storef(float * p, vf x) { _mm512_storeu_ps(p, x); }
+    static vd loadd(const double * p) { return _mm512_loadu_pd(p); }
+    static void stored(double * p, vd x) { _mm512_storeu_pd(p, x); }
+
+    static vd loadfd(const float * p)
+    {
+        return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+    }
+
+    static void storedf(float * p, vd x)
+    {
+        _mm256_storeu_ps(p, _mm512_cvtpd_ps(x));
+    }
+
+    static vd loaddifffd(const float * x, const float * y)
+    {
+        return _mm512_cvtps_pd(_mm256_sub_ps(_mm256_loadu_ps(x),
+                                             _mm256_loadu_ps(y)));
+    }
+
+    static vf splatf(float x) { return _mm512_set1_ps(x); }
+    static vd splatd(double x) { return _mm512_set1_pd(x); }
+
+    static vd fmad(vd a, vd b, vd c) { return _mm512_fmadd_pd(a, b, c); }
+
+    static vf maxf(vf a, vf b) { return _mm512_max_ps(a, b); }
+    static vf minf(vf a, vf b) { return _mm512_min_ps(a, b); }
+    static vd maxd(vd a, vd b) { return _mm512_max_pd(a, b); }
+    static vd mind(vd a, vd b) { return _mm512_min_pd(a, b); }
+
+    static vd narrow(vd x) { return _mm512_cvtps_pd(_mm512_cvtpd_ps(x)); }
+
+    static vd rint(vd x)
+    {
+        return _mm512_roundscale_pd(x, _MM_FROUND_TO_NEAREST_INT
+                                       | _MM_FROUND_NO_EXC);
+    }
+
+    static vd pow2(vd n) { return _mm512_scalef_pd(splatd(1.0), n); }
+
+    static vd exponent(vd x) { return _mm512_getexp_pd(x); }
+
+    static vd mantissa(vd x)
+    {
+        return _mm512_getmant_pd(x, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero);
+    }
+
+    static vd selectGreater(vd x, vd t, vd a, vd b)
+    {
+        return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, t, _CMP_GT_OQ), b, a);
+    }
+
+    static bool allWithin(vd x, double lo, double hi)
+    {
+        __mmask8 in = _mm512_cmp_pd_mask(x, splatd(lo), _CMP_GE_OQ)
+                    & _mm512_cmp_pd_mask(x, splatd(hi), _CMP_LE_OQ);
+        return in == 0xff;
+    }
+
+    static double sumd(vd x) { return _mm512_reduce_add_pd(x); }
+};
+
+template struct Wide<Avx512Isa>;
+
+} // namespace SIMD
+} // namespace MLDB
@@ -0,0 +1,146 @@
+/** simd_vector_wide.h                                             -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    SIMD vector operations for 256 bit (AVX2 + FMA) and 512 bit (AVX-512)
+    registers.
+
+    The kernels are written once in simd_vector_wide_impl.h against the
+    operations of an instruction set (load, store, fma, ...), and compiled
+    in their own translation unit for each instruction set with the right
+    -m flags.  Nothing here should be called directly without checking the
+    CPU first; SIMD::vec_* in simd_vector.h dispatches to the best version
+    that the CPU supports.
+
+    Element-wise functions give the same results, bit for bit, as the
+    generic versions.  Reductions (dot products, sums, norms) accumulate in
+    double precision with fused multiply-adds over several registers, so
+    they can differ from the generic versions in the last bits.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace MLDB {
+namespace SIMD {
+
+struct Avx2Isa;
+struct Avx512Isa;
+
+template<typename Isa>
+struct Wide {
+    /* Float versions */
+    static void vec_scale(const float * x, float k, float * r, size_t n);
+    static void vec_add(const float * x, const float * y, float * r, size_t n);
+    static void vec_add(const float * x, float k, const float * y, float * r,
+                        size_t n);
+    static void vec_add_sqr(const float * x, float k, const float * y,
+                            float * r, size_t n);
+    static void vec_add(const float * x, const float * k, const float * y,
+                        float * r, size_t n);
+    static void vec_add(const float * x, const double * k, const double * y,
+                        float * r, size_t n);
+    static void vec_add(const float * x, const float * k, const double * y,
+                        float * r, size_t n);
+    static void vec_prod(const float * x, const float * y, float * r,
+                         size_t n);
+    static float vec_dotprod(const float * x, const float * y, size_t n);
+    static void vec_minus(const float * x, const float * y, float * r,
+                          size_t n);
+    static double vec_accum_prod3(const float * x, const float * y,
+                                  const float * z, size_t n);
+    static double vec_accum_prod3(const float * x, const float * y,
+                                  const double * z, size_t n);
+    static void vec_k1_x_plus_k2_y_z(float k1, const float * x,
+                                     float k2, const float * y,
+                                     const float * z, float * r, size_t n);
+
+    /* Double versions */
+    static void vec_scale(const double * x, double k, double * r, size_t n);
+    static void vec_add(const double * x, const double * y, double * r,
+                        size_t n);
+    static void vec_add(const double * x, double k, const double * y,
+                        double * r, size_t n);
+    static void vec_add_sqr(const double * x, double k, const double * y,
+                            double * r, size_t n);
+    static void vec_add(const double * x, const double * k, const double * y,
+                        double * r, size_t n);
+    static void vec_add(const double * x, const float * k, const float * y,
+                        double * r, size_t n);
+    static void vec_add(const double * x, const float * k, const double * y,
+                        double * r, size_t n);
+    static void vec_prod(const double * x, const double * y, double * r,
+                         size_t n);
+    static double vec_dotprod(const double * x, const double * y, size_t n);
+    static void vec_minus(const double * x, const double * y, double * r,
+                          size_t n);
+    static double vec_accum_prod3(const double * x, const double * y,
+                                  const double * z, size_t n);
+    static double vec_accum_prod3(const double * x, const double * y,
+                                  const float * z, size_t n);
+    static void vec_k1_x_plus_k2_y_z(double k1, const double * x,
+                                     double k2, const double * y,
+                                     const double * z, double * r, size_t n);
+    static double vec_sum(const double * x, size_t n);
+
+    /* Mixed versions */
+    static void vec_add(const float * x, float k, const double * y, float * r,
+                        size_t n);
+    static void vec_add_sqr(const float * x, float k, const double * y,
+                            float * r, size_t n);
+    static double vec_dotprod_dp(const double * x, const float * y, size_t n);
+    static void vec_prod(const double * x, const float * y, double * r,
+                         size_t n);
+    static void vec_prod(const float * x, const double * y, float * r,
+                         size_t n);
+    static void vec_prod(const double * x, const double * y, float * r,
+                         size_t n);
+    static void vec_add(const double * x, const float * y, double * r,
+                        size_t n);
+    static double vec_dotprod_dp(const float * x, const float * y, size_t n);
+    static double vec_sum_dp(const float * x, size_t n);
+    static void vec_add(const double * x, double k, const float * y,
+                        double * r, size_t n);
+    static void vec_add_sqr(const double * x, double k, const float * y,
+                            double * r, size_t n);
+
+    static void vec_exp(const float * x, float * r, size_t n);
+    static void vec_exp(const float * x, float k, float * r, size_t n);
+    static void vec_exp(const float * x, double * r, size_t n);
+    static void vec_exp(const float * x, double k, double * r, size_t n);
+    static void vec_exp(const double * x, double * r, size_t n);
+    static void vec_exp(const double * x, double k, double * r, size_t n);
+
+    static void vec_max(const float * x, const float * y, float * r, size_t n);
+    static void vec_max(const float * x, float y, float * r, size_t n);
+    static void vec_max(const double * x, const double * y, double * r,
+                        size_t n);
+    static void vec_max(const double * x, double y, double * r, size_t n);
+
+    static void vec_min(const float * x, const float * y, float * r, size_t n);
+    static void vec_min(const float * x, float y, float * r, size_t n);
+    static void vec_min(const double * x, const double * y, double * r,
+                        size_t n);
+    static void vec_min(const double * x, double y, double * r, size_t n);
+
+    static float vec_twonorm_sqr(const float * x, size_t n);
+    static double vec_twonorm_sqr_dp(const float * x, size_t n);
+    static double vec_twonorm_sqr(const double * x, size_t n);
+
+    static double vec_kl(const float * p, const float * q, size_t n);
+    static void vec_min_max_el(const float * x, float * mins, float * maxs,
+                               size_t n);
+    static double vec_euclid(const float * p, const float * q, size_t n);
+};
+
+extern template struct Wide<Avx2Isa>;
+extern template struct Wide<Avx512Isa>;
+
+/// 256 bit versions; need AVX2 and FMA
+typedef Wide<Avx2Isa> Avx2;
+
+/// 512 bit versions; need AVX-512F
+typedef Wide<Avx512Isa> Avx512;
+
+} // namespace SIMD
+} // namespace MLDB
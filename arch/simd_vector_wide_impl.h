@@ -0,0 +1,1011 @@
+/** simd_vector_wide_impl.h                                        -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Implementation of the wide SIMD vector operations, for inclusion in
+    the translation unit of each instruction set only.
+
+    The Isa parameter provides:
+    - vf and vd, the float and double vector types, with NF and ND lanes;
+    - loadf, storef, loadd, stored, unaligned loads and stores;
+    - loadfd and storedf, to load ND floats as doubles and store ND doubles
+      as floats;
+    - loaddifffd(x, y), to load ND floats from each of x and y and return
+      x - y, subtracted in float precision, as doubles;
+    - splatf and splatd, to broadcast a scalar;
+    - fmad(a, b, c), a * b + c with a single rounding;
+    - maxf, minf, maxd, mind, with the semantics of maxps(a, b), ie
+      a > b ? a : b;
+    - narrow, to round doubles to the nearest float;
+    - rint, to round to the nearest integer;
+    - pow2(n), 2^n for integral n with a normal result;
+    - exponent and mantissa, with x = mantissa(x) * 2^exponent(x) and
+      the mantissa in [1, 2), for positive normal x;
+    - selectGreater(x, t, a, b), x > t ? a : b per lane;
+    - allWithin(x, lo, hi), true if every lane is in [lo, hi] (and so
+      not NaN);
+    - sumd, the sum of the lanes.
+
+    Everything here must depend on Isa.  These files are compiled with
+    flags for instructions that not every CPU has, and any ordinary inline
+    function emitted here could be the copy that the linker keeps for the
+    whole program.  That also means calling ::exp rather than std::exp,
+    and no std::min or std::max.
+
+    These files must be compiled with -ffp-contract=off, so that the
+    element-wise operations round each operation like the generic versions
+    do; fused multiply-adds are only used where fmad is called explicitly.
+*/
+
+#pragma once
+
+#include "simd_vector_wide.h"
+#include <cfloat>
+#include <math.h>
+
+
+namespace MLDB {
+namespace SIMD {
+namespace WideImpl {
+
+/// r[i] = vec(i) for NF floats at a time, scalar(i) for the rest
+template<typename Isa, typename Vec, typename Scalar>
+inline void mapFloat(float * r, size_t n, const Vec & vec,
+                     const Scalar & scalar)
+{
+    size_t i = 0;
+    for (; i + Isa::NF <= n;  i += Isa::NF)
+        Isa::storef(r + i, vec(i));
+    for (; i < n;  ++i)
+        r[i] = scalar(i);
+}
+
+/// r[i] = vec(i) for ND doubles at a time, scalar(i) for the rest
+template<typename Isa, typename Vec, typename Scalar>
+inline void mapDouble(double * r, size_t n, const Vec & vec,
+                      const Scalar & scalar)
+{
+    size_t i = 0;
+    for (; i + Isa::ND <= n;  i += Isa::ND)
+        Isa::stored(r + i, vec(i));
+    for (; i < n;  ++i)
+        r[i] = scalar(i);
+}
+
+/// Float results calculated in double precision, ND at a time
+template<typename Isa, typename Vec, typename Scalar>
+inline void mapNarrow(float * r, size_t n, const Vec & vec,
+                      const Scalar & scalar)
+{
+    size_t i = 0;
+    for (; i + Isa::ND <= n;  i += Isa::ND)
+        Isa::storedf(r + i, vec(i));
+    for (; i < n;  ++i)
+        r[i] = scalar(i);
+}
+
+/** Sum in double precision.  accum(i, acc) adds the contribution of the
+    ND elements starting at i to acc; scalar(i) gives that of element i
+    for the remainder.  Four accumulators keep the fmas independent.
+*/
+template<typename Isa, typename Accum, typename Scalar>
+inline double reduce(size_t n, const Accum & accum, const Scalar & scalar)
+{
+    typedef typename Isa::vd vd;
+    const size_t N = Isa::ND;
+
+    vd acc0 = Isa::splatd(0.0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+    size_t i = 0;
+    for (; i + 4 * N <= n;  i += 4 * N) {
+        acc0 = accum(i, acc0);
+        acc1 = accum(i + N, acc1);
+        acc2 = accum(i + 2 * N, acc2);
+        acc3 = accum(i + 3 * N, acc3);
+    }
+    for (; i + N <= n;  i += N)
+        acc0 = accum(i, acc0);
+
+    double result = Isa::sumd((acc0 + acc1) + (acc2 + acc3));
+
+    for (; i < n;  ++i)
+        result += scalar(i);
+
+    return result;
+}
+
+/** exp(x) in double precision, to within a couple of ulps.  Lanes that
+    would overflow or underflow (or are NaN) go to the scalar exp for the
+    whole vector.
+*/
+template<typename Isa>
+inline typename Isa::vd exp(typename Isa::vd x)
+{
+    typedef typename Isa::vd vd;
+
+    if (!Isa::allWithin(x, -708.0, 709.0)) {
+        double vals[Isa::ND];
+        Isa::stored(vals, x);
+        for (auto & v: vals)
+            v = ::exp(v);
+        return Isa::loadd(vals);
+    }
+
+    // x = n ln 2 + r, with |r| <= ln(2) / 2.  The high part of ln 2 has
+    // enough trailing zeros that n * ln2Hi is exact.
+    static constexpr double log2e = 1.4426950408889634;
+    static constexpr double ln2Hi = 6.93147180369123816490e-01;
+    static constexpr double ln2Lo = 1.90821492927058770002e-10;
+
+    vd n = Isa::rint(x * Isa::splatd(log2e));
+    vd r = Isa::fmad(n, Isa::splatd(-ln2Hi), x);
+    r = Isa::fmad(n, Isa::splatd(-ln2Lo), r);
+
+    // Taylor series of exp(r); the first term left out is below 1e-17
+    static constexpr double coeffs[14] = {
+        1.0, 1.0, 0.5, 0.16666666666666666, 0.041666666666666664,
+        0.008333333333333333, 0.001388888888888889, 0.0001984126984126984,
+        2.48015873015873e-05, 2.7557319223985893e-06, 2.755731922398589e-07,
+        2.505210838544172e-08, 2.08767569878681e-09, 1.6059043836821613e-10
+    };
+
+    vd p = Isa::splatd(coeffs[13]);
+    for (int k = 12;  k >= 0;  --k)
+        p = Isa::fmad(p, r, Isa::splatd(coeffs[k]));
+
+    return p * Isa::pow2(n);
+}
+
+/** log(x) in double precision, to within a couple of ulps.  Lanes that
+    aren't positive normal numbers go to the scalar log for the whole
+    vector.
+*/
+template<typename Isa>
+inline typename Isa::vd log(typename Isa::vd x)
+{
+    typedef typename Isa::vd vd;
+
+    if (!Isa::allWithin(x, DBL_MIN, DBL_MAX)) {
+        double vals[Isa::ND];
+        Isa::stored(vals, x);
+        for (auto & v: vals)
+            v = ::log(v);
+        return Isa::loadd(vals);
+    }
+
+    static constexpr double ln2Hi = 6.93147180369123816490e-01;
+    static constexpr double ln2Lo = 1.90821492927058770002e-10;
+
+    // x = m 2^e with m in [sqrt(1/2), sqrt(2))
+    vd e = Isa::exponent(x);
+    vd m = Isa::mantissa(x);
+    vd sqrt2 = Isa::splatd(M_SQRT2);
+    e = Isa::selectGreater(m, sqrt2, e + Isa::splatd(1.0), e);
+    m = Isa::selectGreater(m, sqrt2, m * Isa::splatd(0.5), m);
+
+    // log(m) = 2 atanh(s) = s (2 + 2/3 s^2 + 2/5 s^4 + ...), where
+    // s = (m - 1) / (m + 1) and so |s| < 0.172
+    vd s = (m - Isa::splatd(1.0)) / (m + Isa::splatd(1.0));
+    vd z = s * s;
+
+    static constexpr double coeffs[11] = {
+        2.0, 0.6666666666666666, 0.4, 0.2857142857142857, 0.2222222222222222,
+        0.18181818181818182, 0.15384615384615385, 0.13333333333333333,
+        0.11764705882352941, 0.10526315789473684, 0.09523809523809523
+    };
+
+    vd p = Isa::splatd(coeffs[10]);
+    for (int k = 9;  k >= 0;  --k)
+        p = Isa::fmad(p, z, Isa::splatd(coeffs[k]));
+
+    vd logm = s * p;
+    return Isa::fmad(e, Isa::splatd(ln2Hi),
+                     Isa::fmad(e, Isa::splatd(ln2Lo), logm));
+}
+
+} // namespace WideImpl
+
+
+/*****************************************************************************/
+/* FLOAT VERSIONS                                                            */
+/*****************************************************************************/
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_scale(const float * x, float k, float * r, size_t n)
+{
+    auto kk = Isa::splatf(k);
+    WideImpl::mapFloat<Isa>(r, n,
+                            [&] (size_t i) { return kk * Isa::loadf(x + i); },
+                            [&] (size_t i) { return k * x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const float * x, const float * y, float * r, size_t n)
+{
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadf(x + i) + Isa::loadf(y + i); },
+         [&] (size_t i) { return x[i] + y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const float * x, float k, const float * y, float * r, size_t n)
+{
+    auto kk = Isa::splatf(k);
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadf(x + i) + kk * Isa::loadf(y + i); },
+         [&] (size_t i) { return x[i] + k * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add_sqr(const float * x, float k, const float * y, float * r, size_t n)
+{
+    auto kk = Isa::splatf(k);
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             auto yy = Isa::loadf(y + i);
+             return Isa::loadf(x + i) + kk * (yy * yy);
+         },
+         [&] (size_t i) { return x[i] + k * (y[i] * y[i]); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const float * x, const float * k, const float * y, float * r,
+        size_t n)
+{
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return Isa::loadf(x + i) + Isa::loadf(k + i) * Isa::loadf(y + i);
+         },
+         [&] (size_t i) { return x[i] + k[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const float * x, const double * k, const double * y, float * r,
+        size_t n)
+{
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return Isa::loadfd(x + i) + Isa::loadd(k + i) * Isa::loadd(y + i);
+         },
+         [&] (size_t i) { return x[i] + k[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const float * x, const float * k, const double * y, float * r,
+        size_t n)
+{
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return Isa::loadfd(x + i) + Isa::loadfd(k + i) * Isa::loadd(y + i);
+         },
+         [&] (size_t i) { return x[i] + k[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_prod(const float * x, const float * y, float * r, size_t n)
+{
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadf(x + i) * Isa::loadf(y + i); },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+float
+Wide<Isa>::
+vec_dotprod(const float * x, const float * y, size_t n)
+{
+    return vec_dotprod_dp(x, y, n);
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_minus(const float * x, const float * y, float * r, size_t n)
+{
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadf(x + i) - Isa::loadf(y + i); },
+         [&] (size_t i) { return x[i] - y[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_accum_prod3(const float * x, const float * y, const float * z, size_t n)
+{
+    // The product of two floats is exact in double precision
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadfd(x + i) * Isa::loadfd(y + i),
+                              Isa::loadfd(z + i), acc);
+         },
+         [&] (size_t i) { return double(x[i]) * y[i] * z[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_accum_prod3(const float * x, const float * y, const double * z, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadfd(x + i) * Isa::loadfd(y + i),
+                              Isa::loadd(z + i), acc);
+         },
+         [&] (size_t i) { return double(x[i]) * y[i] * z[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_k1_x_plus_k2_y_z(float k1, const float * x,
+                     float k2, const float * y, const float * z,
+                     float * r, size_t n)
+{
+    auto kk1 = Isa::splatf(k1), kk2 = Isa::splatf(k2);
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return kk1 * Isa::loadf(x + i)
+                 + kk2 * Isa::loadf(y + i) * Isa::loadf(z + i);
+         },
+         [&] (size_t i) { return k1 * x[i] + k2 * y[i] * z[i]; });
+}
+
+
+/*****************************************************************************/
+/* DOUBLE VERSIONS                                                           */
+/*****************************************************************************/
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_scale(const double * x, double k, double * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>(r, n,
+                             [&] (size_t i) { return kk * Isa::loadd(x + i); },
+                             [&] (size_t i) { return k * x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, const double * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) + Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] + y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, double k, const double * y, double * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) + kk * Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] + k * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add_sqr(const double * x, double k, const double * y, double * r,
+            size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             auto yy = Isa::loadd(y + i);
+             return Isa::loadd(x + i) + kk * (yy * yy);
+         },
+         [&] (size_t i) { return x[i] + k * (y[i] * y[i]); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, const double * k, const double * y, double * r,
+        size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return Isa::loadd(x + i) + Isa::loadd(k + i) * Isa::loadd(y + i);
+         },
+         [&] (size_t i) { return x[i] + k[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, const float * k, const float * y, double * r,
+        size_t n)
+{
+    // k[i] * y[i] is a float product, which narrow() gives exactly
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return Isa::loadd(x + i)
+                 + Isa::narrow(Isa::loadfd(k + i) * Isa::loadfd(y + i));
+         },
+         [&] (size_t i) { return x[i] + k[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, const float * k, const double * y, double * r,
+        size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return Isa::loadd(x + i) + Isa::loadfd(k + i) * Isa::loadd(y + i);
+         },
+         [&] (size_t i) { return x[i] + k[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_prod(const double * x, const double * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) * Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_dotprod(const double * x, const double * y, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadd(x + i), Isa::loadd(y + i), acc);
+         },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_minus(const double * x, const double * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) - Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] - y[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_accum_prod3(const double * x, const double * y, const double * z,
+                size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadd(x + i) * Isa::loadd(y + i),
+                              Isa::loadd(z + i), acc);
+         },
+         [&] (size_t i) { return x[i] * y[i] * z[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_accum_prod3(const double * x, const double * y, const float * z,
+                size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadd(x + i) * Isa::loadd(y + i),
+                              Isa::loadfd(z + i), acc);
+         },
+         [&] (size_t i) { return x[i] * y[i] * z[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_k1_x_plus_k2_y_z(double k1, const double * x,
+                     double k2, const double * y, const double * z,
+                     double * r, size_t n)
+{
+    auto kk1 = Isa::splatd(k1), kk2 = Isa::splatd(k2);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return kk1 * Isa::loadd(x + i)
+                 + kk2 * Isa::loadd(y + i) * Isa::loadd(z + i);
+         },
+         [&] (size_t i) { return k1 * x[i] + k2 * y[i] * z[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_sum(const double * x, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc) { return acc + Isa::loadd(x + i); },
+         [&] (size_t i) { return x[i]; });
+}
+
+
+/*****************************************************************************/
+/* MIXED VERSIONS                                                            */
+/*****************************************************************************/
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const float * x, float k, const double * y, float * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadfd(x + i) + kk * Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] + k * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add_sqr(const float * x, float k, const double * y, float * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             auto yy = Isa::loadd(y + i);
+             return Isa::loadfd(x + i) + kk * (yy * yy);
+         },
+         [&] (size_t i) { return x[i] + k * (y[i] * y[i]); });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_dotprod_dp(const double * x, const float * y, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadd(x + i), Isa::loadfd(y + i), acc);
+         },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_prod(const double * x, const float * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) * Isa::loadfd(y + i); },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_prod(const float * x, const double * y, float * r, size_t n)
+{
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadfd(x + i) * Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_prod(const double * x, const double * y, float * r, size_t n)
+{
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) * Isa::loadd(y + i); },
+         [&] (size_t i) { return x[i] * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, const float * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) + Isa::loadfd(y + i); },
+         [&] (size_t i) { return x[i] + y[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_dotprod_dp(const float * x, const float * y, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             return Isa::fmad(Isa::loadfd(x + i), Isa::loadfd(y + i), acc);
+         },
+         [&] (size_t i) { return double(x[i]) * y[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_sum_dp(const float * x, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc) { return acc + Isa::loadfd(x + i); },
+         [&] (size_t i) { return x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add(const double * x, double k, const float * y, double * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::loadd(x + i) + kk * Isa::loadfd(y + i); },
+         [&] (size_t i) { return x[i] + k * y[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_add_sqr(const double * x, double k, const float * y, double * r,
+            size_t n)
+{
+    // y[i] * y[i] is a float product
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             auto yy = Isa::loadfd(y + i);
+             return Isa::loadd(x + i) + kk * Isa::narrow(yy * yy);
+         },
+         [&] (size_t i) { return x[i] + k * (y[i] * y[i]); });
+}
+
+
+/*****************************************************************************/
+/* EXPONENTIAL                                                               */
+/*****************************************************************************/
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_exp(const float * x, float * r, size_t n)
+{
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i) { return WideImpl::exp<Isa>(Isa::loadfd(x + i)); },
+         [&] (size_t i) { return ::exp((double)x[i]); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_exp(const float * x, float k, float * r, size_t n)
+{
+    // k * x[i] is a float product
+    auto kk = Isa::splatd(k);
+    WideImpl::mapNarrow<Isa>
+        (r, n,
+         [&] (size_t i)
+         {
+             return WideImpl::exp<Isa>(Isa::narrow(kk * Isa::loadfd(x + i)));
+         },
+         [&] (size_t i) { return ::exp((double)(k * x[i])); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_exp(const float * x, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return WideImpl::exp<Isa>(Isa::loadfd(x + i)); },
+         [&] (size_t i) { return ::exp((double)x[i]); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_exp(const float * x, double k, double * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return WideImpl::exp<Isa>(kk * Isa::loadfd(x + i)); },
+         [&] (size_t i) { return ::exp((double)(k * x[i])); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_exp(const double * x, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return WideImpl::exp<Isa>(Isa::loadd(x + i)); },
+         [&] (size_t i) { return ::exp(x[i]); });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_exp(const double * x, double k, double * r, size_t n)
+{
+    auto kk = Isa::splatd(k);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return WideImpl::exp<Isa>(kk * Isa::loadd(x + i)); },
+         [&] (size_t i) { return ::exp(k * x[i]); });
+}
+
+
+/*****************************************************************************/
+/* MINIMUM AND MAXIMUM                                                       */
+/*****************************************************************************/
+
+// maxps(y, x) is y > x ? y : x, which is std::max(x, y) including for NaNs
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_max(const float * x, const float * y, float * r, size_t n)
+{
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::maxf(Isa::loadf(y + i), Isa::loadf(x + i)); },
+         [&] (size_t i) { return x[i] < y[i] ? y[i] : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_max(const float * x, float y, float * r, size_t n)
+{
+    auto yy = Isa::splatf(y);
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::maxf(yy, Isa::loadf(x + i)); },
+         [&] (size_t i) { return x[i] < y ? y : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_max(const double * x, const double * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::maxd(Isa::loadd(y + i), Isa::loadd(x + i)); },
+         [&] (size_t i) { return x[i] < y[i] ? y[i] : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_max(const double * x, double y, double * r, size_t n)
+{
+    auto yy = Isa::splatd(y);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::maxd(yy, Isa::loadd(x + i)); },
+         [&] (size_t i) { return x[i] < y ? y : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_min(const float * x, const float * y, float * r, size_t n)
+{
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::minf(Isa::loadf(y + i), Isa::loadf(x + i)); },
+         [&] (size_t i) { return y[i] < x[i] ? y[i] : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_min(const float * x, float y, float * r, size_t n)
+{
+    auto yy = Isa::splatf(y);
+    WideImpl::mapFloat<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::minf(yy, Isa::loadf(x + i)); },
+         [&] (size_t i) { return y < x[i] ? y : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_min(const double * x, const double * y, double * r, size_t n)
+{
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::mind(Isa::loadd(y + i), Isa::loadd(x + i)); },
+         [&] (size_t i) { return y[i] < x[i] ? y[i] : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_min(const double * x, double y, double * r, size_t n)
+{
+    auto yy = Isa::splatd(y);
+    WideImpl::mapDouble<Isa>
+        (r, n,
+         [&] (size_t i) { return Isa::mind(yy, Isa::loadd(x + i)); },
+         [&] (size_t i) { return y < x[i] ? y : x[i]; });
+}
+
+template<typename Isa>
+void
+Wide<Isa>::
+vec_min_max_el(const float * x, float * mins, float * maxs, size_t n)
+{
+    size_t i = 0;
+    for (; i + Isa::NF <= n;  i += Isa::NF) {
+        auto xx = Isa::loadf(x + i);
+        Isa::storef(mins + i, Isa::minf(xx, Isa::loadf(mins + i)));
+        Isa::storef(maxs + i, Isa::maxf(xx, Isa::loadf(maxs + i)));
+    }
+
+    for (; i < n;  ++i) {
+        mins[i] = x[i] < mins[i] ? x[i] : mins[i];
+        maxs[i] = maxs[i] < x[i] ? x[i] : maxs[i];
+    }
+}
+
+
+/*****************************************************************************/
+/* NORMS AND DISTANCES                                                       */
+/*****************************************************************************/
+
+template<typename Isa>
+float
+Wide<Isa>::
+vec_twonorm_sqr(const float * x, size_t n)
+{
+    return vec_twonorm_sqr_dp(x, n);
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_twonorm_sqr_dp(const float * x, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             auto xx = Isa::loadfd(x + i);
+             return Isa::fmad(xx, xx, acc);
+         },
+         [&] (size_t i) { return double(x[i]) * x[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_twonorm_sqr(const double * x, size_t n)
+{
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             auto xx = Isa::loadd(x + i);
+             return Isa::fmad(xx, xx, acc);
+         },
+         [&] (size_t i) { return x[i] * x[i]; });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_kl(const float * p, const float * q, size_t n)
+{
+    // Each term is calculated in float precision, as p[i] * logf(p[i] /
+    // q[i]).  Dividing or multiplying two floats in double precision and
+    // narrowing the result gives the same answer as doing it in float.
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             auto pp = Isa::loadfd(p + i);
+             auto ratio = Isa::narrow(pp / Isa::loadfd(q + i));
+             auto logRatio = Isa::narrow(WideImpl::log<Isa>(ratio));
+             return acc + Isa::narrow(pp * logRatio);
+         },
+         [&] (size_t i) { return p[i] * logf(p[i] / q[i]); });
+}
+
+template<typename Isa>
+double
+Wide<Isa>::
+vec_euclid(const float * x, const float * y, size_t n)
+{
+    // The difference is taken in float precision, like the generic version
+    return WideImpl::reduce<Isa>
+        (n,
+         [&] (size_t i, typename Isa::vd acc)
+         {
+             auto d = Isa::loaddifffd(x + i, y + i);
+             return Isa::fmad(d, d, acc);
+         },
+         [&] (size_t i)
+         {
+             float d = x[i] - y[i];
+             return double(d) * d;
+         });
+}
+
+} // namespace SIMD
+} // namespace MLDB
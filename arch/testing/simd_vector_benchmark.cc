@@ -21,6 +21,7 @@
 #include <set>
 #include <iostream>
 #include <cmath>
+#include <functional>
 
 
 using namespace MLDB;
@@ -93,3 +94,76 @@ BOOST_AUTO_TEST_CASE( benchmark )
              << endl;
     }
 }
+
+/** Time a vec_* function under each of the instruction sets supported by
+    the CPU, printing the minimum number of cycles per element for each.
+*/
+void benchmarkIsas(const std::string & name, int nvals,
+                   const std::function<void ()> & fn)
+{
+    SIMD::VecIsa oldIsa = SIMD::vec_isa();
+
+    cerr << name << " nvals = " << nvals << " cycles/op:";
+
+    for (int isa = SIMD::VEC_ISA_GENERIC;  isa <= SIMD::best_vec_isa();
+         ++isa) {
+        SIMD::set_vec_isa((SIMD::VecIsa)isa);
+        double best = INFINITY;
+        for (unsigned i = 0;  i < 100;  ++i) {
+            uint64_t t0 = ticks();
+            fn();
+            uint64_t t1 = ticks();
+            best = std::min<double>(best, t1 - t0);
+        }
+        cerr << " " << SIMD::vec_isa_name((SIMD::VecIsa)isa) << " "
+             << best / nvals;
+    }
+
+    cerr << endl;
+
+    SIMD::set_vec_isa(oldIsa);
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_isas )
+{
+    for (int nvals: { 16, 256, 4096, 65536 }) {
+        vector<float> xf(nvals), yf(nvals), zf(nvals), rf(nvals);
+        vector<double> xd(nvals), yd(nvals), rd(nvals);
+
+        for (unsigned i = 0; i < nvals;  ++i) {
+            xf[i] = xd[i] = rand() / (double)RAND_MAX;
+            yf[i] = yd[i] = rand() / (double)RAND_MAX;
+            zf[i] = rand() / (double)RAND_MAX;
+        }
+
+        // Keep the reductions from being optimized away
+        volatile double sink = 0.0;
+
+        benchmarkIsas("vec_dotprod float", nvals,
+                      [&] () { sink = SIMD::vec_dotprod(&xf[0], &yf[0], nvals); });
+        benchmarkIsas("vec_dotprod double", nvals,
+                      [&] () { sink = SIMD::vec_dotprod(&xd[0], &yd[0], nvals); });
+        benchmarkIsas("vec_dotprod_dp", nvals,
+                      [&] () { sink = SIMD::vec_dotprod_dp(&xf[0], &yf[0], nvals); });
+        benchmarkIsas("vec_accum_prod3", nvals,
+                      [&] () { sink = SIMD::vec_accum_prod3(&xf[0], &yf[0], &zf[0], nvals); });
+        benchmarkIsas("vec_twonorm_sqr", nvals,
+                      [&] () { sink = SIMD::vec_twonorm_sqr(&xf[0], nvals); });
+        benchmarkIsas("vec_euclid", nvals,
+                      [&] () { sink = SIMD::vec_euclid(&xf[0], &yf[0], nvals); });
+        benchmarkIsas("vec_kl", nvals,
+                      [&] () { sink = SIMD::vec_kl(&xf[0], &yf[0], nvals); });
+        benchmarkIsas("vec_add float", nvals,
+                      [&] () { SIMD::vec_add(&xf[0], 0.5f, &yf[0], &rf[0], nvals); });
+        benchmarkIsas("vec_add double", nvals,
+                      [&] () { SIMD::vec_add(&xd[0], 0.5, &yd[0], &rd[0], nvals); });
+        benchmarkIsas("vec_prod float", nvals,
+                      [&] () { SIMD::vec_prod(&xf[0], &yf[0], &rf[0], nvals); });
+        benchmarkIsas("vec_exp float", nvals,
+                      [&] () { SIMD::vec_exp(&xf[0], &rf[0], nvals); });
+        benchmarkIsas("vec_exp double", nvals,
+                      [&] () { SIMD::vec_exp(&xd[0], &rd[0], nvals); });
+
+        (void)sink;
+    }
+}
@@ -0,0 +1,321 @@
+/* simd_vector_isa_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the vec_* functions give the same results with each of the
+   instruction sets that the CPU supports.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/arch/simd_vector.h"
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+
+using namespace MLDB;
+using namespace std;
+
+
+namespace {
+
+// Sizes that exercise the vector loops and the scalar remainders
+const vector<size_t> sizes = { 0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33,
+                               64, 100, 1000 };
+
+template<typename Float>
+vector<Float> randomVector(size_t n, std::mt19937 & rng,
+                           double lo = -100, double hi = 100)
+{
+    std::uniform_real_distribution<double> dist(lo, hi);
+    vector<Float> result(n);
+    for (auto & v: result)
+        v = dist(rng);
+    return result;
+}
+
+struct IsaGuard {
+    IsaGuard()
+        : old(SIMD::vec_isa())
+    {
+    }
+
+    ~IsaGuard()
+    {
+        SIMD::set_vec_isa(old);
+    }
+
+    SIMD::VecIsa old;
+};
+
+/** Run fn under each of the supported instruction sets, returning the
+    results.  The first is always the generic one.
+*/
+template<typename Result>
+vector<Result> underEachIsa(const std::function<Result ()> & fn)
+{
+    IsaGuard guard;
+    vector<Result> results;
+    for (int isa = SIMD::VEC_ISA_GENERIC;  isa <= SIMD::best_vec_isa();
+         ++isa) {
+        SIMD::set_vec_isa((SIMD::VecIsa)isa);
+        results.push_back(fn());
+    }
+    return results;
+}
+
+/// Element-wise functions must give identical results
+template<typename Float>
+void checkIdentical(const char * what,
+                    const std::function<vector<Float> ()> & fn)
+{
+    auto results = underEachIsa(fn);
+    for (size_t i = 1;  i < results.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(results[i].size(), results[0].size());
+        size_t numDifferent = 0;
+        for (size_t j = 0;  j < results[0].size();  ++j) {
+            // NaN compares unequal to itself
+            if (results[i][j] != results[0][j]
+                && !(std::isnan(results[i][j]) && std::isnan(results[0][j])))
+                ++numDifferent;
+        }
+        if (numDifferent)
+            cerr << what << " " << SIMD::vec_isa_name((SIMD::VecIsa)i)
+                 << " differs on " << numDifferent << " of "
+                 << results[0].size() << endl;
+        BOOST_CHECK_EQUAL(numDifferent, 0);
+    }
+}
+
+/// Reductions must agree to within a relative error of eps
+void checkClose(const char * what, const std::function<double ()> & fn,
+                double eps)
+{
+    auto results = underEachIsa(fn);
+    for (size_t i = 1;  i < results.size();  ++i) {
+        double scale = std::max(fabs(results[0]), fabs(results[i]));
+        double error = scale == 0.0 ? 0.0 : fabs(results[0] - results[i]) / scale;
+        if (error >= eps)
+            cerr << what << " " << SIMD::vec_isa_name((SIMD::VecIsa)i)
+                 << " gave " << results[i] << " vs " << results[0] << endl;
+        BOOST_CHECK_LT(error, eps);
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_isa_selection )
+{
+    cerr << "best instruction set is "
+         << SIMD::vec_isa_name(SIMD::best_vec_isa()) << endl;
+    BOOST_CHECK_EQUAL(SIMD::vec_isa(), SIMD::best_vec_isa());
+
+    IsaGuard guard;
+    SIMD::set_vec_isa(SIMD::VEC_ISA_GENERIC);
+    BOOST_CHECK_EQUAL(SIMD::vec_isa(), SIMD::VEC_ISA_GENERIC);
+
+    if (SIMD::best_vec_isa() < SIMD::VEC_ISA_AVX512) {
+        BOOST_CHECK_THROW(SIMD::set_vec_isa(SIMD::VEC_ISA_AVX512),
+                          std::exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_elementwise_float )
+{
+    std::mt19937 rng(1);
+
+    for (size_t n: sizes) {
+        auto x = randomVector<float>(n, rng);
+        auto y = randomVector<float>(n, rng);
+        auto z = randomVector<float>(n, rng);
+        auto yd = randomVector<double>(n, rng);
+        auto kd = randomVector<double>(n, rng);
+        float k = 1.2345f;
+
+        typedef vector<float> V;
+
+        checkIdentical<float>("vec_scale", [&] () { V r(n); SIMD::vec_scale(x.data(), k, r.data(), n); return r; });
+        checkIdentical<float>("vec_add", [&] () { V r(n); SIMD::vec_add(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add k", [&] () { V r(n); SIMD::vec_add(x.data(), k, y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add_sqr", [&] () { V r(n); SIMD::vec_add_sqr(x.data(), k, y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add k[]", [&] () { V r(n); SIMD::vec_add(x.data(), z.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add dk[] dy", [&] () { V r(n); SIMD::vec_add(x.data(), kd.data(), yd.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add k[] dy", [&] () { V r(n); SIMD::vec_add(x.data(), z.data(), yd.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add k dy", [&] () { V r(n); SIMD::vec_add(x.data(), k, yd.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_add_sqr dy", [&] () { V r(n); SIMD::vec_add_sqr(x.data(), k, yd.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_prod", [&] () { V r(n); SIMD::vec_prod(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_prod dy", [&] () { V r(n); SIMD::vec_prod(x.data(), yd.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_prod dx dy", [&] () { V r(n); SIMD::vec_prod(kd.data(), yd.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_minus", [&] () { V r(n); SIMD::vec_minus(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_k1_x_plus_k2_y_z", [&] () { V r(n); SIMD::vec_k1_x_plus_k2_y_z(k, x.data(), 3.3f, y.data(), z.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_max", [&] () { V r(n); SIMD::vec_max(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_max k", [&] () { V r(n); SIMD::vec_max(x.data(), k, r.data(), n); return r; });
+        checkIdentical<float>("vec_min", [&] () { V r(n); SIMD::vec_min(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<float>("vec_min k", [&] () { V r(n); SIMD::vec_min(x.data(), k, r.data(), n); return r; });
+        checkIdentical<float>("vec_min_max_el", [&] ()
+            {
+                V mins = y, maxs = z;
+                SIMD::vec_min_max_el(x.data(), mins.data(), maxs.data(), n);
+                mins.insert(mins.end(), maxs.begin(), maxs.end());
+                return mins;
+            });
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_elementwise_double )
+{
+    std::mt19937 rng(2);
+
+    for (size_t n: sizes) {
+        auto x = randomVector<double>(n, rng);
+        auto y = randomVector<double>(n, rng);
+        auto z = randomVector<double>(n, rng);
+        auto yf = randomVector<float>(n, rng);
+        auto kf = randomVector<float>(n, rng);
+        double k = 1.2345;
+
+        typedef vector<double> V;
+
+        checkIdentical<double>("vec_scale", [&] () { V r(n); SIMD::vec_scale(x.data(), k, r.data(), n); return r; });
+        checkIdentical<double>("vec_add", [&] () { V r(n); SIMD::vec_add(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add k", [&] () { V r(n); SIMD::vec_add(x.data(), k, y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add_sqr", [&] () { V r(n); SIMD::vec_add_sqr(x.data(), k, y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add k[]", [&] () { V r(n); SIMD::vec_add(x.data(), z.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add fk[] fy", [&] () { V r(n); SIMD::vec_add(x.data(), kf.data(), yf.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add fk[] y", [&] () { V r(n); SIMD::vec_add(x.data(), kf.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add fy", [&] () { V r(n); SIMD::vec_add(x.data(), yf.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add k fy", [&] () { V r(n); SIMD::vec_add(x.data(), k, yf.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_add_sqr fy", [&] () { V r(n); SIMD::vec_add_sqr(x.data(), k, yf.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_prod", [&] () { V r(n); SIMD::vec_prod(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_prod fy", [&] () { V r(n); SIMD::vec_prod(x.data(), yf.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_minus", [&] () { V r(n); SIMD::vec_minus(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_k1_x_plus_k2_y_z", [&] () { V r(n); SIMD::vec_k1_x_plus_k2_y_z(k, x.data(), 3.3, y.data(), z.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_max", [&] () { V r(n); SIMD::vec_max(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_max k", [&] () { V r(n); SIMD::vec_max(x.data(), k, r.data(), n); return r; });
+        checkIdentical<double>("vec_min", [&] () { V r(n); SIMD::vec_min(x.data(), y.data(), r.data(), n); return r; });
+        checkIdentical<double>("vec_min k", [&] () { V r(n); SIMD::vec_min(x.data(), k, r.data(), n); return r; });
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_reductions )
+{
+    std::mt19937 rng(3);
+
+    for (size_t n: sizes) {
+        auto x = randomVector<float>(n, rng, 0, 10);
+        auto y = randomVector<float>(n, rng, 0, 10);
+        auto z = randomVector<float>(n, rng, 0, 10);
+        auto xd = randomVector<double>(n, rng, 0, 10);
+        auto yd = randomVector<double>(n, rng, 0, 10);
+        auto zd = randomVector<double>(n, rng, 0, 10);
+
+        // All terms are positive, so the sums are well conditioned
+        checkClose("vec_dotprod", [&] () { return SIMD::vec_dotprod(x.data(), y.data(), n); }, 1e-6);
+        checkClose("vec_dotprod_dp", [&] () { return SIMD::vec_dotprod_dp(x.data(), y.data(), n); }, 1e-7);
+        checkClose("vec_dotprod_dp mixed", [&] () { return SIMD::vec_dotprod_dp(xd.data(), y.data(), n); }, 1e-14);
+        checkClose("vec_dotprod double", [&] () { return SIMD::vec_dotprod(xd.data(), yd.data(), n); }, 1e-14);
+        checkClose("vec_accum_prod3", [&] () { return SIMD::vec_accum_prod3(x.data(), y.data(), z.data(), n); }, 1e-7);
+        checkClose("vec_accum_prod3 dz", [&] () { return SIMD::vec_accum_prod3(x.data(), y.data(), zd.data(), n); }, 1e-7);
+        checkClose("vec_accum_prod3 double", [&] () { return SIMD::vec_accum_prod3(xd.data(), yd.data(), zd.data(), n); }, 1e-14);
+        checkClose("vec_accum_prod3 fz", [&] () { return SIMD::vec_accum_prod3(xd.data(), yd.data(), z.data(), n); }, 1e-14);
+        checkClose("vec_sum", [&] () { return SIMD::vec_sum(xd.data(), n); }, 1e-14);
+        checkClose("vec_sum_dp", [&] () { return SIMD::vec_sum_dp(x.data(), n); }, 1e-14);
+        checkClose("vec_twonorm_sqr", [&] () { return SIMD::vec_twonorm_sqr(x.data(), n); }, 1e-6);
+        checkClose("vec_twonorm_sqr_dp", [&] () { return SIMD::vec_twonorm_sqr_dp(x.data(), n); }, 1e-14);
+        checkClose("vec_twonorm_sqr double", [&] () { return SIMD::vec_twonorm_sqr(xd.data(), n); }, 1e-14);
+        checkClose("vec_euclid", [&] () { return SIMD::vec_euclid(x.data(), y.data(), n); }, 1e-7);
+
+        // Probabilities for the KL divergence
+        auto p = randomVector<float>(n, rng, 0.001, 1);
+        auto q = randomVector<float>(n, rng, 0.001, 1);
+        checkClose("vec_kl", [&] () { return SIMD::vec_kl(p.data(), q.data(), n); }, 1e-6);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_exp )
+{
+    std::mt19937 rng(4);
+
+    for (size_t n: sizes) {
+        auto x = randomVector<float>(n, rng, -80, 80);
+        auto xd = randomVector<double>(n, rng, -700, 700);
+
+        // Results in double precision should be within a couple of ulps of
+        // the libm exp; those in float precision should almost always be
+        // identical, since they are rounded from double precision.
+        auto checkExp = [&] (const char * what,
+                             const std::function<vector<double> ()> & fn,
+                             double eps)
+            {
+                auto results = underEachIsa(fn);
+                for (size_t i = 1;  i < results.size();  ++i) {
+                    for (size_t j = 0;  j < n;  ++j) {
+                        double error = fabs(results[i][j] - results[0][j])
+                            / results[0][j];
+                        if (error > eps)
+                            cerr << what << " " << j << " "
+                                 << results[i][j] << " vs "
+                                 << results[0][j] << endl;
+                        BOOST_CHECK_LE(error, eps);
+                    }
+                }
+            };
+
+        const double ulp = std::numeric_limits<double>::epsilon();
+        const double ulpf = std::numeric_limits<float>::epsilon();
+
+        checkExp("float", [&] ()
+                 {
+                     vector<float> r(n);
+                     SIMD::vec_exp(x.data(), r.data(), n);
+                     return vector<double>(r.begin(), r.end());
+                 }, ulpf);
+        checkExp("float k", [&] ()
+                 {
+                     vector<float> r(n);
+                     SIMD::vec_exp(x.data(), 0.5f, r.data(), n);
+                     return vector<double>(r.begin(), r.end());
+                 }, ulpf);
+        checkExp("float to double", [&] ()
+                 {
+                     vector<double> r(n);
+                     SIMD::vec_exp(x.data(), r.data(), n);
+                     return r;
+                 }, 4 * ulp);
+        checkExp("float to double k", [&] ()
+                 {
+                     vector<double> r(n);
+                     SIMD::vec_exp(x.data(), 0.5, r.data(), n);
+                     return r;
+                 }, 4 * ulp);
+        checkExp("double", [&] ()
+                 {
+                     vector<double> r(n);
+                     SIMD::vec_exp(xd.data(), r.data(), n);
+                     return r;
+                 }, 4 * ulp);
+        checkExp("double k", [&] ()
+                 {
+                     vector<double> r(n);
+                     SIMD::vec_exp(xd.data(), 0.5, r.data(), n);
+                     return r;
+                 }, 4 * ulp);
+    }
+
+    // Values that overflow, underflow or aren't numbers go through libm
+    vector<double> special = { 0.0, -0.0, 710, 1000, -750, -1000,
+                               INFINITY, -INFINITY, 1.0, 2.0, NAN, 700,
+                               -700, 1e-300, 88.8, -103.0 };
+    checkIdentical<double>("exp special", [&] ()
+        {
+            vector<double> r(special.size());
+            SIMD::vec_exp(special.data(), r.data(), special.size());
+            return r;
+        });
+}
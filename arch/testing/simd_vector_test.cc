@@ -805,7 +805,8 @@ void vec_twonorm_sqr_test_case(int nvals)
     
     T r = SIMD::vec_twonorm_sqr(x, nvals);
 
-    BOOST_CHECK_EQUAL(r, r2);
+    // The wide versions sum in a different order
+    BOOST_CHECK_LT(fabs(r - r2) / max(fabs(r), fabs(r2)), get_eps(T()));
 }
 
 BOOST_AUTO_TEST_CASE( vec_twonorm_sqr_test )
@@ -832,7 +833,7 @@ void vec_twonorm_sqr_dp_test_case(int nvals)
     
     double r = SIMD::vec_twonorm_sqr_dp(x, nvals);
 
-    BOOST_CHECK_EQUAL(r, r2);
+    BOOST_CHECK_LT(fabs(r - r2) / max(fabs(r), fabs(r2)), get_eps(0.0));
 }
 
 BOOST_AUTO_TEST_CASE( vec_twonorm_sqr_dp_test )
@@ -7,6 +7,7 @@ LIBBASE_SOURCES := \
 	parallel.cc \
 	optimized_path.cc \
 	hex_dump.cc \
+	scratch_arena.cc \
 
 
 LIBBASE_LINK :=	\
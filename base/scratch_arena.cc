@@ -0,0 +1,162 @@
+/** scratch_arena.cc
+    Per-thread bump allocator for query evaluation.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "mldb/base/scratch_arena.h"
+#include "mldb/utils/environment.h"
+#include "mldb/base/exc_assert.h"
+#include <cstdint>
+#include <cstdlib>
+
+
+namespace MLDB {
+
+static EnvOption<bool> SCRATCH_ARENA("MLDB_SCRATCH_ARENA", true);
+
+
+/*****************************************************************************/
+/* SCRATCH ARENA                                                             */
+/*****************************************************************************/
+
+/** Header at the start of each block.  Blocks are aligned on their size,
+    so the block holding any allocation is found by masking its address.
+*/
+struct ScratchArena::Block {
+    /// Number of live allocations, plus one while an arena allocates
+    /// from the block
+    std::atomic<size_t> refs;
+};
+
+static constexpr size_t HEADER_SIZE
+    = (sizeof(ScratchArena::Block) + ScratchArena::ALIGNMENT - 1)
+    / ScratchArena::ALIGNMENT * ScratchArena::ALIGNMENT;
+
+static_assert((ScratchArena::BLOCK_SIZE & (ScratchArena::BLOCK_SIZE - 1)) == 0,
+              "Scratch arena block size must be a power of two");
+static_assert(ScratchArena::MAX_ALLOCATION + HEADER_SIZE
+              <= ScratchArena::BLOCK_SIZE,
+              "Scratch arena allocations must fit in a block");
+
+thread_local ScratchArena * ScratchArena::current_ = nullptr;
+thread_local int ScratchArena::depth_ = 0;
+thread_local bool ScratchArena::forValues_ = false;
+
+ScratchArena::
+ScratchArena()
+    : block(nullptr), pos(nullptr), end(nullptr)
+{
+}
+
+ScratchArena::
+~ScratchArena()
+{
+    if (block)
+        release(block);
+}
+
+void
+ScratchArena::
+newBlock()
+{
+    void * mem = std::aligned_alloc(BLOCK_SIZE, BLOCK_SIZE);
+    if (!mem)
+        throw std::bad_alloc();
+
+    if (block)
+        release(block);
+
+    block = new (mem) Block();
+    block->refs = 1;
+    pos = (char *)mem + HEADER_SIZE;
+    end = (char *)mem + BLOCK_SIZE;
+}
+
+void
+ScratchArena::
+rewind()
+{
+    // Only our own reference is left, and nobody else can take one
+    if (block && block->refs.load(std::memory_order_acquire) == 1)
+        pos = (char *)block + HEADER_SIZE;
+}
+
+void *
+ScratchArena::
+allocate(size_t bytes)
+{
+    ExcAssertLessEqual(bytes, MAX_ALLOCATION);
+    bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    if (end - pos < (ssize_t)bytes) {
+        rewind();
+        if (end - pos < (ssize_t)bytes)
+            newBlock();
+    }
+
+    void * result = pos;
+    pos += bytes;
+    block->refs.fetch_add(1, std::memory_order_relaxed);
+    return result;
+}
+
+static ScratchArena & threadArena()
+{
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+void *
+ScratchArena::
+allocateDetached(size_t bytes)
+{
+    // Share the thread's arena with any scope that opens later, so that
+    // detached allocations are packed together instead of each taking a
+    // block of its own
+    return threadArena().allocate(bytes);
+}
+
+void
+ScratchArena::
+deallocate(void * mem) noexcept
+{
+    release((Block *)((uintptr_t)mem & ~(uintptr_t)(BLOCK_SIZE - 1)));
+}
+
+void
+ScratchArena::
+release(Block * block) noexcept
+{
+    if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        block->~Block();
+        std::free(block);
+    }
+}
+
+
+/*****************************************************************************/
+/* SCRATCH ARENA SCOPE                                                       */
+/*****************************************************************************/
+
+ScratchArenaScope::
+ScratchArenaScope(bool forValues)
+    : oldForValues(ScratchArena::forValues_)
+{
+    static const bool enabled = SCRATCH_ARENA;
+    if (ScratchArena::depth_++ == 0 && enabled)
+        ScratchArena::current_ = &threadArena();
+    ScratchArena::forValues_ = forValues;
+}
+
+ScratchArenaScope::
+~ScratchArenaScope()
+{
+    ScratchArena::forValues_ = oldForValues;
+    if (--ScratchArena::depth_ == 0 && ScratchArena::current_) {
+        ScratchArena::current_->rewind();
+        ScratchArena::current_ = nullptr;
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,274 @@
+/** scratch_arena.h                                                -*- C++ -*-
+    Per-thread bump allocator for the short-lived values that are created
+    while a query is evaluated.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SCRATCH ARENA                                                             */
+/*****************************************************************************/
+
+/** Bump allocator that hands out memory from large blocks owned by a
+    single thread, so that allocating never takes a lock or touches
+    memory shared with other threads.
+
+    Each block counts the allocations that are still alive within it,
+    and is returned to the heap in one go once they have all been freed
+    and the arena has moved on to another block.  Memory may be freed
+    from any thread, and values that outlive the arena simply keep their
+    block alive; nothing is ever freed from under a live value.
+
+    When the block being allocated from has no live allocations left,
+    which is normally the case once a row or batch has been processed,
+    the arena starts again from its beginning rather than asking the heap
+    for a new block.
+
+    Each thread has one arena, which is used while a ScratchArenaScope is
+    active on it.  Allocators that were created under a scope but outlive
+    it keep allocating from the same arena, so they share its blocks
+    rather than each taking a block of their own.
+
+    As a block is only freed once everything in it has been, a value
+    that is kept keeps its whole block alive.  So the storage of values
+    that are commonly kept by whoever receives them (strings, paths and
+    the elements of rows and embeddings) only comes from the arena under
+    a scope that was opened for values, where nothing built in the scope
+    is kept once it ends.
+*/
+
+struct ScratchArena {
+    /// Size (and alignment) of each block.  Must be a power of two.
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    /// Allocations larger than this come from the heap
+    static constexpr size_t MAX_ALLOCATION = 1024;
+
+    /// Alignment of each allocation
+    static constexpr size_t ALIGNMENT = 16;
+
+    /// Header at the start of each block
+    struct Block;
+
+    ScratchArena();
+    ~ScratchArena();
+
+    ScratchArena(const ScratchArena &) = delete;
+    void operator = (const ScratchArena &) = delete;
+
+    /** Allocate the given number of bytes, which must be no more than
+        MAX_ALLOCATION.
+    */
+    void * allocate(size_t bytes);
+
+    /** Allocate the given number of bytes, which must be no more than
+        MAX_ALLOCATION, from the current thread's arena even though no
+        scope is active on it.  This is for when arena memory is needed
+        (because it will be freed with deallocate()) but the scope it was
+        needed for has gone.
+    */
+    static void * allocateDetached(size_t bytes);
+
+    /** Allocate the given number of bytes for the storage of a value
+        from the current thread's arena if a scope for values is active
+        and they are no more than MAX_ALLOCATION, or return a null pointer
+        so that the caller can use the heap instead.  Memory returned must
+        be freed with deallocate().
+    */
+    static void * tryAllocate(size_t bytes)
+    {
+        ScratchArena * arena = current_;
+        if (!arena || !forValues_ || bytes > MAX_ALLOCATION)
+            return nullptr;
+        return arena->allocate(bytes);
+    }
+
+    /** Free memory that was returned by allocate() on any arena. */
+    static void deallocate(void * mem) noexcept;
+
+    /** If nothing allocated from the current block is still alive, start
+        allocating from its beginning again.
+    */
+    void rewind();
+
+    /** Return the arena of the current thread, or a null pointer if
+        there is no ScratchArenaScope active on it (or scratch arenas
+        are turned off).
+    */
+    static ScratchArena * current()
+    {
+        return current_;
+    }
+
+    /** Return the arena of the current thread if the innermost scope
+        active on it was opened for values, or a null pointer otherwise.
+    */
+    static ScratchArena * currentForValues()
+    {
+        return forValues_ ? current_ : nullptr;
+    }
+
+private:
+    friend struct ScratchArenaScope;
+
+    void newBlock();
+    static void release(Block * block) noexcept;
+
+    Block * block;     ///< Block currently being allocated from
+    char * pos;        ///< Next free byte in the current block
+    char * end;        ///< End of the current block
+
+    static thread_local ScratchArena * current_;
+    static thread_local int depth_;
+    static thread_local bool forValues_;
+};
+
+
+/*****************************************************************************/
+/* SCRATCH ARENA SCOPE                                                       */
+/*****************************************************************************/
+
+/** While an object of this type exists, allocations made through a
+    ScratchAllocator on this thread come from the thread's scratch arena.
+    Scopes can be nested.  When the outermost one ends, the arena is
+    rewound so that the next scope reuses its memory if everything
+    allocated in it has been freed.
+
+    Scopes are cheap enough to open once per row.
+
+    A scope opened with forValues set to true also puts the storage of
+    values in the arena (see ScratchArena::tryAllocate() and
+    ScratchValueAllocator).  It must only be used where none of the values
+    built in it are kept once it ends.  The innermost scope decides.
+
+    The MLDB_SCRATCH_ARENA environment variable can be set to 0 to turn
+    scratch arenas off, in which case everything comes from the heap.
+*/
+
+struct ScratchArenaScope {
+    explicit ScratchArenaScope(bool forValues = false);
+    ~ScratchArenaScope();
+
+    ScratchArenaScope(const ScratchArenaScope &) = delete;
+    void operator = (const ScratchArenaScope &) = delete;
+
+private:
+    bool oldForValues;
+};
+
+
+/*****************************************************************************/
+/* SCRATCH ALLOCATOR                                                         */
+/*****************************************************************************/
+
+/** Standard allocator that allocates from the current thread's scratch
+    arena if there was one when it was created, and from the heap
+    otherwise.  It works with std::allocate_shared, which keeps a copy of
+    the allocator alongside the object, and with containers, which take
+    their allocator with them when they are moved, swapped or assigned,
+    so that memory is always freed to wherever it came from whichever
+    thread releases it.
+*/
+
+template<typename T>
+struct ScratchAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ScratchAllocator() noexcept
+        : fromArena(ScratchArena::current() != nullptr)
+    {
+    }
+
+    explicit ScratchAllocator(bool fromArena) noexcept
+        : fromArena(fromArena)
+    {
+    }
+
+    template<typename U>
+    ScratchAllocator(const ScratchAllocator<U> & other) noexcept
+        : fromArena(other.fromArena)
+    {
+    }
+
+    T * allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if (fromArena && bytes <= ScratchArena::MAX_ALLOCATION
+            && alignof(T) <= ScratchArena::ALIGNMENT) {
+            // The arena may have gone since this allocator was created,
+            // but deallocate() still needs to find a block
+            ScratchArena * arena = ScratchArena::current();
+            if (arena)
+                return (T *)arena->allocate(bytes);
+            return (T *)ScratchArena::allocateDetached(bytes);
+        }
+        return (T *)::operator new(bytes);
+    }
+
+    void deallocate(T * p, size_t n) noexcept
+    {
+        if (fromArena && n * sizeof(T) <= ScratchArena::MAX_ALLOCATION
+            && alignof(T) <= ScratchArena::ALIGNMENT)
+            ScratchArena::deallocate(p);
+        else ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator == (const ScratchAllocator<U> & other) const
+    {
+        return fromArena == other.fromArena;
+    }
+
+    template<typename U>
+    bool operator != (const ScratchAllocator<U> & other) const
+    {
+        return !operator == (other);
+    }
+
+    /// Was this allocator created while a scratch arena was active?
+    bool fromArena;
+};
+
+
+/*****************************************************************************/
+/* SCRATCH VALUE ALLOCATOR                                                   */
+/*****************************************************************************/
+
+/** ScratchAllocator for the storage of values, which only allocates from
+    the arena if it was created under a scope for values.
+*/
+
+template<typename T>
+struct ScratchValueAllocator: public ScratchAllocator<T> {
+    template<typename U>
+    struct rebind {
+        typedef ScratchValueAllocator<U> other;
+    };
+
+    ScratchValueAllocator() noexcept
+        : ScratchAllocator<T>(ScratchArena::currentForValues() != nullptr)
+    {
+    }
+
+    template<typename U>
+    ScratchValueAllocator(const ScratchValueAllocator<U> & other) noexcept
+        : ScratchAllocator<T>(other.fromArena)
+    {
+    }
+};
+
+} // namespace MLDB
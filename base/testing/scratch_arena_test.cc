@@ -0,0 +1,195 @@
+/* scratch_arena_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test for the scratch arena allocator.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/base/scratch_arena.h"
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_no_scope_uses_heap )
+{
+    BOOST_CHECK(!ScratchArena::current());
+    ScratchAllocator<int> alloc;
+    BOOST_CHECK(!alloc.fromArena);
+    auto p = std::allocate_shared<int>(alloc, 3);
+    BOOST_CHECK_EQUAL(*p, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_nested_scopes )
+{
+    {
+        ScratchArenaScope scope1;
+        ScratchArena * arena = ScratchArena::current();
+        BOOST_REQUIRE(arena);
+        {
+            ScratchArenaScope scope2;
+            BOOST_CHECK_EQUAL(ScratchArena::current(), arena);
+        }
+        BOOST_CHECK_EQUAL(ScratchArena::current(), arena);
+    }
+    BOOST_CHECK(!ScratchArena::current());
+}
+
+BOOST_AUTO_TEST_CASE( test_rewind_reuses_memory )
+{
+    const void * first = nullptr;
+    for (unsigned i = 0;  i < 10;  ++i) {
+        ScratchArenaScope scope;
+        auto p = std::allocate_shared<std::string>
+            (ScratchAllocator<std::string>(), "hello");
+        BOOST_CHECK_EQUAL(*p, "hello");
+        if (i == 0)
+            first = p.get();
+        // Everything was freed at the end of the last scope, so the same
+        // memory is handed out again
+        else BOOST_CHECK_EQUAL(first, p.get());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_values_outlive_scope )
+{
+    // Values that escape the scope, including to another thread, keep
+    // their memory until they are freed.
+    std::vector<std::shared_ptr<std::vector<int> > > escaped;
+    {
+        ScratchArenaScope scope;
+        for (int i = 0;  i < 10000;  ++i) {
+            escaped.emplace_back
+                (std::allocate_shared<std::vector<int> >
+                 (ScratchAllocator<std::vector<int> >(), 4, i));
+        }
+    }
+
+    {
+        // Allocate a lot more in a new scope; it mustn't overwrite them
+        ScratchArenaScope scope;
+        for (int i = 0;  i < 10000;  ++i) {
+            auto p = std::allocate_shared<std::vector<int> >
+                (ScratchAllocator<std::vector<int> >(), 4, -1);
+        }
+    }
+
+    std::thread t([&] ()
+                  {
+                      for (int i = 0;  i < 10000;  ++i) {
+                          BOOST_CHECK_EQUAL((*escaped[i])[3], i);
+                      }
+                      escaped.clear();
+                  });
+    t.join();
+}
+
+BOOST_AUTO_TEST_CASE( test_large_allocations_use_heap )
+{
+    ScratchArenaScope scope;
+    ScratchAllocator<char> alloc;
+    BOOST_CHECK(alloc.fromArena);
+    char * p = alloc.allocate(ScratchArena::MAX_ALLOCATION * 4);
+    std::fill(p, p + ScratchArena::MAX_ALLOCATION * 4, 'x');
+    alloc.deallocate(p, ScratchArena::MAX_ALLOCATION * 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_detached_allocations_share_blocks )
+{
+    ScratchAllocator<char> alloc;
+    {
+        ScratchArenaScope scope;
+        alloc = ScratchAllocator<char>();
+    }
+    BOOST_CHECK(alloc.fromArena);
+    BOOST_CHECK(!ScratchArena::current());
+
+    // Once the scope has gone, allocations are still packed together
+    // rather than each one taking a block
+    char * p1 = alloc.allocate(16);
+    char * p2 = alloc.allocate(16);
+    BOOST_CHECK_EQUAL((uintptr_t)p1 / ScratchArena::BLOCK_SIZE,
+                      (uintptr_t)p2 / ScratchArena::BLOCK_SIZE);
+    BOOST_CHECK_EQUAL(p2 - p1, 16);
+    alloc.deallocate(p1, 16);
+    alloc.deallocate(p2, 16);
+}
+
+BOOST_AUTO_TEST_CASE( test_containers_keep_their_allocator )
+{
+    typedef std::vector<int, ScratchAllocator<int> > Vec;
+
+    Vec fromHeap(4, 1);
+    BOOST_CHECK(!fromHeap.get_allocator().fromArena);
+
+    {
+        ScratchArenaScope scope;
+        Vec fromArena(4, 2);
+        BOOST_CHECK(fromArena.get_allocator().fromArena);
+
+        // Each vector must free its memory where it came from after
+        // they are swapped or assigned
+        fromArena.swap(fromHeap);
+        BOOST_CHECK(fromHeap.get_allocator().fromArena);
+        BOOST_CHECK(!fromArena.get_allocator().fromArena);
+        BOOST_CHECK_EQUAL(fromHeap[0], 2);
+
+        Vec other(4, 3);
+        other = std::move(fromArena);
+        BOOST_CHECK(!other.get_allocator().fromArena);
+        BOOST_CHECK_EQUAL(other[0], 1);
+    }
+
+    // Still valid after the scope
+    BOOST_CHECK_EQUAL(fromHeap[3], 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_try_allocate )
+{
+    BOOST_CHECK(!ScratchArena::tryAllocate(16));
+
+    // Values only come from the arena under a scope for values
+    ScratchArenaScope scope;
+    BOOST_CHECK(!ScratchArena::tryAllocate(16));
+
+    {
+        ScratchArenaScope valuesScope(true /* forValues */);
+        void * p = ScratchArena::tryAllocate(16);
+        BOOST_CHECK(p);
+        BOOST_CHECK(!ScratchArena::tryAllocate(ScratchArena::MAX_ALLOCATION + 1));
+        ScratchArena::deallocate(p);
+
+        // The innermost scope decides
+        ScratchArenaScope nested;
+        BOOST_CHECK(!ScratchArena::tryAllocate(16));
+    }
+
+    BOOST_CHECK(!ScratchArena::tryAllocate(16));
+}
+
+BOOST_AUTO_TEST_CASE( test_value_allocator )
+{
+    typedef std::vector<int, ScratchValueAllocator<int> > Vec;
+
+    ScratchArenaScope scope;
+    Vec fromHeap(4, 1);
+    BOOST_CHECK(!fromHeap.get_allocator().fromArena);
+
+    {
+        ScratchArenaScope valuesScope(true /* forValues */);
+        Vec fromArena(4, 2);
+        BOOST_CHECK(fromArena.get_allocator().fromArena);
+        fromArena.swap(fromHeap);
+    }
+
+    BOOST_CHECK(fromHeap.get_allocator().fromArena);
+    BOOST_CHECK_EQUAL(fromHeap[3], 2);
+}
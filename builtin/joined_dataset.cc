@@ -8,6 +8,7 @@
 #include "joined_dataset.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/base/parallel_merge_sort.h"
+#include "mldb/base/parallel.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/sql/execution_pipeline_impl.h"
@@ -17,11 +18,13 @@
 #include "mldb/types/any_impl.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/vector_description.h"
+#include "mldb/types/enum_description.h"
 #include "mldb/types/annotated_exception.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/utils/compact_vector.h"
 #include "mldb/engine/dataset_utils.h"
 #include <functional>
+#include <atomic>
 
 using namespace std;
 using namespace std::placeholders;
@@ -34,6 +37,21 @@ namespace MLDB {
 /* JOINED DATASET CONFIG                                                     */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(JoinStrategy);
+
+JoinStrategyDescription::
+JoinStrategyDescription()
+{
+    addValue("auto", JOIN_STRATEGY_AUTO,
+             "Use a hash join when one side is much smaller than the other, "
+             "and a merge join otherwise");
+    addValue("merge", JOIN_STRATEGY_MERGE,
+             "Sort both sides on the join key and merge them");
+    addValue("hash", JOIN_STRATEGY_HASH,
+             "Build a hash table on the join key of the smaller side, and "
+             "probe it in parallel with the rows of the larger side");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(JoinedDatasetConfig);
 
 JoinedDatasetConfigDescription::
@@ -49,8 +67,24 @@ JoinedDatasetConfigDescription()
              "Field to join on");
     addField("qualification", &JoinedDatasetConfig::qualification,
              "Type of join");
+    addField("strategy", &JoinedDatasetConfig::strategy,
+             "Algorithm used to evaluate a join on `x = y`.  The default "
+             "chooses from the number of rows on each side; the others "
+             "force the given algorithm.  The rows of the join are the same "
+             "whatever the strategy, but may be in a different order.",
+             JOIN_STRATEGY_AUTO);
 }
 
+/// In auto mode, we use a hash join when the larger side has at least
+/// this many rows...
+static constexpr size_t HASH_JOIN_MIN_ROWS = 10000;
+
+/// ... and the smaller side has at most this fraction of its rows
+static constexpr size_t HASH_JOIN_SIZE_RATIO = 10;
+
+/// Number of probe side rows handled by each task of a hash join
+static constexpr size_t HASH_JOIN_CHUNK_SIZE = 4096;
+
 struct JoinedDataset::Itl
     : public MatrixView, public ColumnIndex {
 
@@ -147,7 +181,8 @@ struct JoinedDataset::Itl
         std::shared_ptr<TableExpression> rightExpr,
         BoundTableExpression right,
         std::shared_ptr<SqlExpression> on,
-        JoinQualification qualification)
+        JoinQualification qualification,
+        JoinStrategy strategy)
     {
         bool debug = false;
 
@@ -238,7 +273,7 @@ struct JoinedDataset::Itl
             // We can use a fast path, since we have simple non-filtered
             // equijoin
             makeJoinConstantWhere(condition, scope, left, right,
-                                  qualification);            
+                                  qualification, strategy);
 
         } else {
 
@@ -382,12 +417,122 @@ struct JoinedDataset::Itl
         rightRowIndex[rightHash].push_back(rowName);
     };
 
+    /// Value of the join key, and name and hash of the row, for one side
+    typedef std::tuple<ExpressionValue, RowPath, RowHash> JoinSideRow;
+
+    /** Hash for a join key that is consistent with the equality of the
+        merge join.  Atoms hash their value; anything else compares
+        equal in ways the hash can't follow, so they share one bucket.
+    */
+    struct JoinKeyHash {
+        size_t operator () (const ExpressionValue & key) const
+        {
+            return key.isAtom() ? key.getAtom().hash().hash() : 0;
+        }
+    };
+
+    struct JoinKeyEqual {
+        bool operator () (const ExpressionValue & key1,
+                          const ExpressionValue & key2) const
+        {
+            return !(key1 < key2) && !(key2 < key1);
+        }
+    };
+
+    /** Hash join of the two sides on the join key.  The hash table is
+        built on the smaller side and shared by all of the threads that
+        probe it with the rows of the larger side, so only the smaller
+        side is ever hashed and neither side is sorted.  Rows are
+        recorded in the order of the probe side.
+    */
+    void hashJoin(const std::vector<JoinSideRow> & leftRows,
+                  const std::vector<JoinSideRow> & rightRows,
+                  bool outerLeft,
+                  bool outerRight)
+    {
+        bool buildLeft = leftRows.size() <= rightRows.size();
+        const std::vector<JoinSideRow> & buildRows
+            = buildLeft ? leftRows : rightRows;
+        const std::vector<JoinSideRow> & probeRows
+            = buildLeft ? rightRows : leftRows;
+        bool outerBuild = buildLeft ? outerLeft : outerRight;
+        bool outerProbe = buildLeft ? outerRight : outerLeft;
+
+        // Null keys never join, so they aren't put in the table
+        std::unordered_map<ExpressionValue, std::vector<size_t>,
+                           JoinKeyHash, JoinKeyEqual> table;
+        table.reserve(buildRows.size());
+        for (size_t i = 0;  i < buildRows.size();  ++i) {
+            const ExpressionValue & key = std::get<0>(buildRows[i]);
+            if (!key.empty())
+                table[key].push_back(i);
+        }
+
+        std::vector<std::atomic<bool> > matched(outerBuild ? buildRows.size() : 0);
+
+        // Pairs of (build row, probe row) that join; a build row of -1
+        // means that the probe row joined with nothing.
+        typedef std::pair<ssize_t, size_t> Match;
+        size_t numChunks
+            = (probeRows.size() + HASH_JOIN_CHUNK_SIZE - 1) / HASH_JOIN_CHUNK_SIZE;
+        std::vector<std::vector<Match> > chunkMatches(numChunks);
+
+        auto probeChunk = [&] (size_t chunk)
+            {
+                auto & matches = chunkMatches[chunk];
+                size_t end = std::min(probeRows.size(),
+                                      (chunk + 1) * HASH_JOIN_CHUNK_SIZE);
+
+                for (size_t i = chunk * HASH_JOIN_CHUNK_SIZE;  i < end;  ++i) {
+                    const ExpressionValue & key = std::get<0>(probeRows[i]);
+                    auto it = key.empty() ? table.end() : table.find(key);
+                    if (it == table.end()) {
+                        if (outerProbe)
+                            matches.emplace_back(-1, i);
+                        continue;
+                    }
+
+                    for (size_t b: it->second) {
+                        matches.emplace_back(b, i);
+                        if (outerBuild)
+                            matched[b] = true;
+                    }
+                }
+            };
+
+        parallelMap(0, numChunks, probeChunk);
+
+        auto record = [&] (const JoinSideRow * buildRow,
+                           const JoinSideRow * probeRow)
+            {
+                const JoinSideRow * leftRow = buildLeft ? buildRow : probeRow;
+                const JoinSideRow * rightRow = buildLeft ? probeRow : buildRow;
+                recordJoinRow(leftRow ? std::get<1>(*leftRow) : RowPath(),
+                              leftRow ? std::get<2>(*leftRow) : RowHash(),
+                              rightRow ? std::get<1>(*rightRow) : RowPath(),
+                              rightRow ? std::get<2>(*rightRow) : RowHash());
+            };
+
+        for (auto & matches: chunkMatches) {
+            for (auto & m: matches) {
+                record(m.first == -1 ? nullptr : &buildRows[m.first],
+                       &probeRows[m.second]);
+            }
+        }
+
+        for (size_t i = 0;  outerBuild && i < buildRows.size();  ++i) {
+            if (!matched[i])
+                record(&buildRows[i], nullptr);
+        }
+    }
+
     //Easiest case with constant Where
     void makeJoinConstantWhere(AnnotatedJoinCondition& condition,
                                SqlBindingScope& scope,
                                BoundTableExpression& left,
                                BoundTableExpression& right,
-                               JoinQualification qualification)
+                               JoinQualification qualification,
+                               JoinStrategy strategy)
     {
         bool debug = false;
         bool outerLeft = qualification == JOIN_LEFT || qualification == JOIN_FULL;
@@ -400,7 +545,7 @@ struct JoinedDataset::Itl
                             const std::function<void (const RowPath&,
                                                       const RowHash& )>
                                 & recordOuterRow)
-            -> std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
+            -> std::vector<JoinSideRow>
             {
                 auto sideCondition = side.where;
 
@@ -457,7 +602,7 @@ struct JoinedDataset::Itl
                     cerr << "got rows " << jsonEncode(rows) << endl;
 
                 // Now we extract all values 
-                std::vector<std::tuple<ExpressionValue, RowPath, RowHash> > sorted;
+                std::vector<JoinSideRow> sorted;
                 std::vector<std::tuple<RowPath, RowHash> > outerRows;
 
                 for (auto & r: rows) {
@@ -481,7 +626,7 @@ struct JoinedDataset::Itl
                     sorted.emplace_back(value, r.rowName, r.rowHash);
                 }
 
-                parallelQuickSortRecursive(sorted);
+                // The values are sorted by the merge join if need be
                 parallelQuickSortRecursive(outerRows);
 
                 for (auto & r: outerRows) {
@@ -501,8 +646,7 @@ struct JoinedDataset::Itl
             recordJoinRow( RowPath(), RowHash(), rowPath, rowHash);
         };
 
-        std::vector<std::tuple<ExpressionValue, RowPath, RowHash> >
-            leftRows, rightRows;
+        std::vector<JoinSideRow> leftRows, rightRows;
 
         leftRows = runSide(condition.left, *left.dataset, outerLeft,
                            recordOuterLeft);
@@ -533,6 +677,35 @@ struct JoinedDataset::Itl
                                       "condition", condition);
         }
 
+        bool useHashJoin = false;
+        if (condition.style == AnnotatedJoinCondition::EQUIJOIN) {
+            size_t smaller = std::min(leftRows.size(), rightRows.size());
+            size_t larger = std::max(leftRows.size(), rightRows.size());
+
+            switch (strategy) {
+            case JOIN_STRATEGY_AUTO:
+                useHashJoin = larger >= HASH_JOIN_MIN_ROWS
+                    && smaller * HASH_JOIN_SIZE_RATIO <= larger;
+                break;
+            case JOIN_STRATEGY_MERGE:
+                break;
+            case JOIN_STRATEGY_HASH:
+                useHashJoin = true;
+                break;
+            }
+        }
+
+        if (useHashJoin) {
+            if (debug)
+                cerr << "hash join of " << leftRows.size() << " and "
+                     << rightRows.size() << " rows" << endl;
+            hashJoin(leftRows, rightRows, outerLeft, outerRight);
+            return;
+        }
+
+        parallelQuickSortRecursive(leftRows);
+        parallelQuickSortRecursive(rightRows);
+
         // Finally, perform the join
         // We keep a list of the row hashes of those that join up
         auto it1 = leftRows.begin(), end1 = leftRows.end();
@@ -1020,7 +1193,8 @@ JoinedDataset(MldbEngine * owner,
     itl.reset(new Itl(scope,
                       joinConfig.left, std::move(left),
                       joinConfig.right, std::move(right),
-                      joinConfig.on, joinConfig.qualification));
+                      joinConfig.on, joinConfig.qualification,
+                      joinConfig.strategy));
 }
 
 JoinedDataset::
@@ -1046,7 +1220,7 @@ JoinedDataset(SqlBindingScope & scope,
     itl.reset(new Itl(scope,
                       leftExpr, std::move(left),
                       rightExpr, std::move(right),
-                      on, qualification));
+                      on, qualification, config.strategy));
 }
 
 JoinedDataset::
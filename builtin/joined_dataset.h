@@ -21,11 +21,21 @@ namespace MLDB {
 /* JOINED DATASET CONFIG                                                     */
 /*****************************************************************************/
 
+/** Algorithm used to evaluate an equijoin. */
+enum JoinStrategy {
+    JOIN_STRATEGY_AUTO,   ///< Choose from the number of rows on each side
+    JOIN_STRATEGY_MERGE,  ///< Sort both sides on the join key and merge them
+    JOIN_STRATEGY_HASH    ///< Hash the smaller side and probe with the larger
+};
+
+DECLARE_ENUM_DESCRIPTION(JoinStrategy);
+
 struct JoinedDatasetConfig {
     std::shared_ptr<TableExpression> left;
     std::shared_ptr<TableExpression> right;
     std::shared_ptr<SqlExpression> on;
     JoinQualification qualification;
+    JoinStrategy strategy = JOIN_STRATEGY_AUTO;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(JoinedDatasetConfig);
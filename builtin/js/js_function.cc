@@ -192,7 +192,7 @@ run(const std::vector<ExpressionValue> & args,
     else if (result->IsObject()) {
         std::map<Utf8String, CellValue> cols = JS::fromJS(result);
 
-        std::vector<std::tuple<PathElement, ExpressionValue> > row;
+        StructValue row;
         row.reserve(cols.size());
         for (auto & c: cols) {
             row.emplace_back(c.first, ExpressionValue(std::move(c.second),
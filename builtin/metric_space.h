@@ -44,6 +44,11 @@ struct DistanceMetric {
                        const distribution<float> & coords1,
                        const distribution<float> & coords2) const = 0;
 
+    /** Return a copy of the metric, including what it has cached about
+        each row.
+    */
+    virtual DistanceMetric * clone() const = 0;
+
     /** Factor for distance metric objects. */
     static DistanceMetric * create(MetricSpace space);
 };
@@ -57,6 +62,11 @@ struct EuclideanDistanceMetric: public DistanceMetric {
 
     void addRow(int rowNum, const distribution<float> & coords);
 
+    DistanceMetric * clone() const
+    {
+        return new EuclideanDistanceMetric(*this);
+    }
+
     float dist(int rowNum1, int rowNum2,
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
@@ -79,6 +89,11 @@ struct CosineDistanceMetric: public DistanceMetric {
 
     void addRow(int rowNum, const distribution<float> & coords);
 
+    DistanceMetric * clone() const
+    {
+        return new CosineDistanceMetric(*this);
+    }
+
     float dist(int rowNum1, int rowNum2,
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
@@ -106,7 +106,7 @@ apply(const FunctionApplier & applier,
 
     Json::Value result = Json::parse(connection->response())["result"];
     
-    vector<tuple<PathElement, ExpressionValue>> vals;
+    StructValue vals;
     if(!result.isArray()) {
         throw MLDB::Exception("Function should return array of arrays.");
     }
@@ -13,6 +13,7 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/base/parallel.h"
 #include "mldb/engine/bound_queries.h"
+#include "mldb/engine/query_spill.h"
 #include "mldb/sql/table_expression_operations.h"
 #include "mldb/sql/join_utils.h"
 #include "mldb/sql/execution_pipeline.h"
@@ -195,7 +196,7 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
             return result;
         }
         case NAMED_COLUMNS:
-            std::vector<std::tuple<PathElement, ExpressionValue> > row;
+            StructValue row;
 
             ssize_t limit = function->functionConfig.query.stm->limit;
             ssize_t offset = function->functionConfig.query.stm->offset;
@@ -623,7 +624,7 @@ regSqlExpressionFunction(builtinPackage(),
 
 TransformDatasetConfig::
 TransformDatasetConfig()
-    : skipEmptyRows(false)
+    : skipEmptyRows(false), memoryBudget(0)
 {
     outputDataset.withType("sparse.mutable");
 }
@@ -645,6 +646,12 @@ TransformDatasetConfigDescription()
     addField("skipEmptyRows", &TransformDatasetConfig::skipEmptyRows,
              "Skip rows from the input dataset where no values are selected",
              false);
+    addField("memoryBudget", &TransformDatasetConfig::memoryBudget,
+             "Approximate number of bytes of rows or groups that an "
+             "`ORDER BY` or `GROUP BY` in the input query may hold in "
+             "memory before writing the excess to temporary files.  The "
+             "default of 0 uses the `MLDB_QUERY_MEMORY_BUDGET` setting of "
+             "the server.", (uint64_t)0);
     addParent<ProcedureConfig>();
 }
 
@@ -671,6 +678,8 @@ run(const ProcedureRunConfig & run,
     // Get the input dataset
     SqlExpressionMldbScope context(engine);
 
+    QueryMemoryBudgetScope budgetScope(runProcConf.memoryBudget);
+
     bool emptyGroupBy = runProcConf.inputData.stm->groupBy.clauses.empty();
 
     std::vector< std::shared_ptr<SqlExpression> > aggregators = 
@@ -135,6 +135,10 @@ struct TransformDatasetConfig : ProcedureConfig {
 
     /// Skip rows with no columns
     bool skipEmptyRows;
+
+    /// Bytes that the query may hold in memory before spilling; 0 for
+    /// the server default
+    uint64_t memoryBudget;
 };
 
 
@@ -1,6 +1,7 @@
 LIBMLDB_CORE_SOURCES:= \
 	plugin.cc \
 	dataset.cc \
+	secondary_index.cc \
 	procedure.cc \
 	recorder.cc \
 	function.cc \
@@ -30,6 +30,7 @@
 #include "mldb/rest/rest_request_router.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/rest/cancellation_exception.h"
+#include "mldb/core/secondary_index.h"
 #include <mutex>
 
 
@@ -179,6 +180,17 @@ extractNumbers(size_t numValues,
         output[i] = tmpOutput[i].toDouble();
     }
 }
+
+bool
+RowStream::
+extractCodes(size_t numValues,
+             const std::vector<ColumnPath> & columnNames,
+             const std::vector<const ColumnDictionary *> & dictionaries,
+             uint32_t * codes,
+             Date * timestamps)
+{
+    return false;
+}
     
 
 
@@ -297,6 +309,46 @@ getRowColumnCount(const RowPath & row) const
 }
 
 
+/*****************************************************************************/
+/* COLUMN DICTIONARY                                                         */
+/*****************************************************************************/
+
+ColumnDictionary::
+ColumnDictionary(std::vector<CellValue> values_)
+    : values(std::move(values_))
+{
+    ExcAssertLess(values.size(), NO_CODE);
+
+    // At most half full, and a power of two so we can mask the hash
+    size_t numSlots = 16;
+    while (numSlots < values.size() * 2)
+        numSlots *= 2;
+    slots.resize(numSlots, 0);
+
+    for (uint32_t code = 0;  code < values.size();  ++code) {
+        ExcAssert(code == 0 || values[code - 1] < values[code]);
+        size_t slot = values[code].hash() & (numSlots - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (numSlots - 1);
+        slots[slot] = code + 1;
+    }
+}
+
+uint32_t
+ColumnDictionary::
+getCode(const CellValue & value) const
+{
+    size_t mask = slots.size() - 1;
+    for (size_t slot = value.hash() & mask;  slots[slot] != 0;
+         slot = (slot + 1) & mask) {
+        uint32_t code = slots[slot] - 1;
+        if (values[code] == value)
+            return code;
+    }
+    return NO_CODE;
+}
+
+
 /*****************************************************************************/
 /* COLUMN INDEX                                                              */
 /*****************************************************************************/
@@ -433,6 +485,20 @@ getColumnDistinctValues(const ColumnPath & column) const
     return vals;
 }
 
+std::shared_ptr<const ColumnDictionary>
+ColumnIndex::
+getColumnDictionary(const ColumnPath & column, size_t maxValues) const
+{
+    return nullptr;
+}
+
+std::vector<std::shared_ptr<const ColumnSecondaryIndex> >
+ColumnIndex::
+getColumnSecondaryIndexes(const std::vector<ColumnPath> & columns) const
+{
+    return {};
+}
+
 std::tuple<BucketList, BucketDescriptions>
 ColumnIndex::
 getColumnBuckets(const ColumnPath & column,
@@ -961,7 +1027,9 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
                            ssize_t offset,
                            ssize_t limit,
                            Utf8String alias,
-                           const ProgressFunc & onProgress) const
+                           const ProgressFunc & onProgress,
+                           bool processInParallel,
+                           const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo) const
 {
     if (!having->isConstantTrue() && groupBy.clauses.empty())
         throw AnnotatedException
@@ -986,12 +1054,11 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
                 return onRow(path, row);
             };
 
-        iterateDatasetExpr(select, *this, alias, when, where,
+        return iterateDatasetExpr(select, *this, alias, when, where,
                                   { rowName->shallowCopy() },
-                                  { processor, true /*processInParallel*/ },
+                                  { processor, processInParallel },
                                   orderBy, offset, limit,
-                                  onProgress);
-        return true;
+                                  onProgress, onInfo).first;
     }
     else {
 
@@ -1010,13 +1077,11 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
             };
 
          //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
-        iterateDatasetGrouped(select, *this, alias, when, where,
+        return iterateDatasetGrouped(select, *this, alias, when, where,
                                      groupBy, aggregators, *having, *rowName,
-                                     {processor, true/*processInParallel*/},
+                                     {processor, processInParallel},
                                      orderBy, offset, limit,
-                                     onProgress);
-
-        return true;
+                                     onProgress, onInfo).first;
     }
 }
 
@@ -1131,6 +1196,189 @@ generateVariableIsNotNull(const Dataset & dataset,
          + "' is not null");
 }
 
+namespace {
+
+/** Plan to answer a WHERE clause from secondary column indexes.  The
+    leaves are predicates on a single column, which are answered with the
+    row bitmap from its index, and the inner nodes are ANDs and ORs,
+    which are answered by intersecting or uniting their children's
+    bitmaps.  No row is looked at until the final bitmap is known.
+*/
+struct IndexedWherePlan {
+    enum Kind {
+        PREDICATE,
+        AND,
+        OR
+    } kind = PREDICATE;
+
+    /// For a PREDICATE, which of the plan's columns it reads
+    int columnNum = -1;
+
+    /// For a PREDICATE, what it does to the column
+    ColumnSecondaryIndex::Op op = ColumnSecondaryIndex::NOT_NULL;
+    CellValue value;
+
+    /// For AND or OR, the two sides
+    std::shared_ptr<const IndexedWherePlan> lhs, rhs;
+
+    RowBitmap
+    execute(const std::vector<std::shared_ptr<const ColumnSecondaryIndex> >
+                & indexes) const
+    {
+        switch (kind) {
+        case PREDICATE:
+            return indexes.at(columnNum)->getRows(op, value);
+        case AND: {
+            RowBitmap lhsRows = lhs->execute(indexes);
+            if (lhsRows.empty())
+                return lhsRows;
+            return lhsRows & rhs->execute(indexes);
+        }
+        case OR:
+            return lhs->execute(indexes) | rhs->execute(indexes);
+        }
+        throw AnnotatedException(500, "Logic error in secondary index plan");
+    }
+};
+
+/** Extract a plan from the WHERE clause, adding the columns that it
+    reads to columns.  Handles comparisons of a column with a constant,
+    IS NOT NULL, IS TRUE and a bare column, and AND and OR of those.
+    Returns a null pointer if the clause can't be planned.
+*/
+std::shared_ptr<const IndexedWherePlan>
+getIndexedWherePlan(const Utf8String & alias,
+                    const SqlExpression & where,
+                    std::vector<ColumnPath> & columns)
+{
+    auto getVariable = [] (const SqlExpression & expression)
+        {
+            return dynamic_cast<const ReadColumnExpression *>(&expression);
+        };
+
+    auto getConstant = [] (const SqlExpression & expression)
+        {
+            return dynamic_cast<const ConstantExpression *>(&expression);
+        };
+
+    auto predicate = [&] (const ReadColumnExpression & variable,
+                          ColumnSecondaryIndex::Op op,
+                          CellValue value)
+        {
+            ColumnPath columnName = removeTableName(alias, variable.columnName);
+            auto result = std::make_shared<IndexedWherePlan>();
+            auto it = std::find(columns.begin(), columns.end(), columnName);
+            result->columnNum = it - columns.begin();
+            if (it == columns.end())
+                columns.emplace_back(std::move(columnName));
+            result->op = op;
+            result->value = std::move(value);
+            return result;
+        };
+
+    if (auto comparison = dynamic_cast<const ComparisonExpression *>(&where)) {
+        auto vlhs = getVariable(*comparison->lhs);
+        auto vrhs = getVariable(*comparison->rhs);
+        auto clhs = getConstant(*comparison->lhs);
+        auto crhs = getConstant(*comparison->rhs);
+
+        const ReadColumnExpression * variable = vlhs && crhs ? vlhs : vrhs;
+        const ConstantExpression * constant = vlhs && crhs ? crhs : clhs;
+
+        // Comparisons with null are never true, so leave them alone
+        ColumnSecondaryIndex::Op op;
+        if (variable && constant
+            && constant->constant.isAtom()
+            && !constant->constant.empty()
+            && ColumnSecondaryIndex::parseOp(comparison->op,
+                                             variable == vrhs, op)) {
+            return predicate(*variable, op, constant->constant.getAtom());
+        }
+        return nullptr;
+    }
+
+    if (auto isType = dynamic_cast<const IsTypeExpression *>(&where)) {
+        auto variable = getVariable(*isType->expr);
+        if (variable && isType->type == "null" && isType->notType)
+            return predicate(*variable, ColumnSecondaryIndex::NOT_NULL, {});
+        if (variable && isType->type == "true" && !isType->notType)
+            return predicate(*variable, ColumnSecondaryIndex::IS_TRUE, {});
+        return nullptr;
+    }
+
+    if (auto variable = getVariable(where))
+        return predicate(*variable, ColumnSecondaryIndex::IS_TRUE, {});
+
+    if (auto boolean = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+        if (boolean->op != "AND" && boolean->op != "OR")
+            return nullptr;
+
+        auto lhs = getIndexedWherePlan(alias, *boolean->lhs, columns);
+        if (!lhs)
+            return nullptr;
+        auto rhs = getIndexedWherePlan(alias, *boolean->rhs, columns);
+        if (!rhs)
+            return nullptr;
+
+        auto result = std::make_shared<IndexedWherePlan>();
+        result->kind = boolean->op == "AND"
+            ? IndexedWherePlan::AND : IndexedWherePlan::OR;
+        result->lhs = std::move(lhs);
+        result->rhs = std::move(rhs);
+        return result;
+    }
+
+    return nullptr;
+}
+
+} // file scope
+
+/** Generate the rows matching the WHERE clause from the secondary
+    indexes of the dataset, if all of the columns that it reads are
+    indexed.  Otherwise returns a null function.
+*/
+static GenerateRowsWhereFunction
+generateIndexedRowsWhere(const Dataset & dataset,
+                         const Utf8String & alias,
+                         const SqlExpression & where)
+{
+    std::vector<ColumnPath> columns;
+    auto plan = getIndexedWherePlan(alias, where, columns);
+    if (!plan)
+        return {};
+
+    auto columnIndex = dataset.getColumnIndex();
+    if (!columnIndex
+        || columnIndex->getColumnSecondaryIndexes(columns).empty())
+        return {};
+
+    return {[=] (ssize_t numToGenerate, Any token,
+                 const BoundParameters & params,
+                 const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                // Get the indexes again rather than binding them, since
+                // they are rebuilt when the dataset is written to
+                auto indexes = columnIndex->getColumnSecondaryIndexes(columns);
+                ExcAssertEqual(indexes.size(), columns.size());
+
+                RowBitmap rows = plan->execute(indexes);
+                const std::vector<RowPath> & rowPaths = *indexes[0]->rowPaths;
+
+                std::vector<RowPath> result;
+                result.reserve(rows.size());
+                rows.forEach([&] (uint32_t row)
+                             {
+                                 result.push_back(rowPaths[row]);
+                                 return true;
+                             });
+
+                return { std::move(result), Any() };
+            },
+            "secondary index bitmaps for " + where.print().rawString(),
+            GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+}
+
 static GenerateRowsWhereFunction
 generateRowNameIsConstant(const Dataset & dataset,
                           const ConstantExpression & rowNameExpr)
@@ -1388,6 +1636,13 @@ generateRowsWhere(const SqlBindingScope & scope,
         return blhs ? : brhs;
     };
 
+    // Answer the whole clause from the secondary indexes if the dataset
+    // has them for all of the columns that it reads
+    GenerateRowsWhereFunction indexed
+        = generateIndexedRowsWhere(*this, alias, where);
+    if (indexed)
+        return indexed;
+
     auto boolean = getBoolean(where);
 
     if (boolean) {
@@ -41,6 +41,7 @@ struct RowValueInfo;
 struct ExpressionValue;
 struct BucketList;
 struct BucketDescriptions;
+struct ColumnSecondaryIndex;
 
 typedef EntityType<Dataset> DatasetType;
 
@@ -147,6 +148,57 @@ struct ColumnStats {
     uint64_t rowCount_;
 };
 
+/*****************************************************************************/
+/* COLUMN DICTIONARY                                                         */
+/*****************************************************************************/
+
+/** Dictionary encoding of a string column with few distinct values, like a
+    country or device name.  Each distinct non-null value of the column has
+    an integer code, which is its position in the sorted list of values, so
+    that codes compare in the same order as the values they stand for.
+    Query operators can then group, hash and compare the codes instead of
+    the strings.
+
+    A dictionary is immutable, and shared by everything that reads the
+    column.
+*/
+
+struct ColumnDictionary {
+    /// Code returned by getCode() for a value that is not in the dictionary
+    static constexpr uint32_t NO_CODE = (uint32_t)-1;
+
+    /** Construct from the distinct non-null values of the column, which
+        must be sorted and unique.
+    */
+    ColumnDictionary(std::vector<CellValue> values);
+
+    /// Distinct non-null values of the column, indexed by their code
+    std::vector<CellValue> values;
+
+    /// Number of codes in the dictionary
+    size_t size() const
+    {
+        return values.size();
+    }
+
+    /// Return the value with the given code
+    const CellValue & getValue(uint32_t code) const
+    {
+        return values.at(code);
+    }
+
+    /** Return the code of the given value, or NO_CODE if it is not in
+        the dictionary.
+    */
+    uint32_t getCode(const CellValue & value) const;
+
+private:
+    /// Open addressed hash table from the hash of each value to its code
+    /// plus one, with zero marking an empty slot
+    std::vector<uint32_t> slots;
+};
+
+
 /*****************************************************************************/
 /* COLUMN INDEX                                                              */
 /*****************************************************************************/
@@ -181,6 +233,18 @@ struct ColumnIndex {
     virtual std::vector<CellValue>
     getColumnDistinctValues(const ColumnPath & column) const;
 
+    /** Return a dictionary encoding of the column, or a null pointer if
+        the column has values that aren't strings or more than maxValues
+        distinct values, or if the dataset can't build one without
+        reading the whole column.
+
+        Default returns a null pointer.  Datasets that store their columns
+        as a table of distinct values should override it.
+    */
+    virtual std::shared_ptr<const ColumnDictionary>
+    getColumnDictionary(const ColumnPath & column,
+                        size_t maxValues = 65536) const;
+
     /** Return a bucketed dense column, with one value for every row in the same
         order as rowNames().  Numerical values will be split into a maximum of
         maxNumBuckets buckets, with split points as described in the
@@ -200,6 +264,17 @@ struct ColumnIndex {
     getColumnValues(const ColumnPath & column,
                     const std::function<bool (const CellValue &)> & filter = nullptr) const;
 
+    /** Return the secondary indexes of the given columns, which number
+        their rows in the same way so that the row sets that they return
+        can be combined with each other.  Returns an empty vector if any
+        of the columns isn't indexed.
+
+        Default returns an empty vector.  Datasets that can be configured
+        to index their columns should override it.
+    */
+    virtual std::vector<std::shared_ptr<const ColumnSecondaryIndex> >
+    getColumnSecondaryIndexes(const std::vector<ColumnPath> & columns) const;
+
     /** Is this column known? */
     virtual bool knownColumn(const ColumnPath & column) const = 0;
 
@@ -335,7 +410,29 @@ struct RowStream {
     extractNumbers(size_t numRows,
                    const std::vector<ColumnPath> & columnNames,
                    double * output);
-    
+
+    /** Extract the codes in the given dictionaries of the given set of
+        columns for numRows rows, read from the way that the dataset
+        stores the columns rather than by looking up each value.  This
+        will fill in numRows x columnNames.size() matrices pointed to by
+        codes with the codes and by timestamps with the timestamps of
+        the values.
+
+        Any value that is null or not in its dictionary will fill in
+        ColumnDictionary::NO_CODE, with its timestamp left alone.
+
+        It will also advance the rowStream by numRows rows, and return
+        true.  If the stream can't read codes, it will return false and
+        do nothing else.
+
+        Default returns false.
+    */
+    virtual bool
+    extractCodes(size_t numRows,
+                 const std::vector<ColumnPath> & columnNames,
+                 const std::vector<const ColumnDictionary *> & dictionaries,
+                 uint32_t * codes,
+                 Date * timestamps);
 };
 
 
@@ -559,7 +656,16 @@ struct Dataset: public MldbEntity {
                         Utf8String alias = "",
                         const ProgressFunc & onProgress = nullptr) const;
 
-    /** Select from the database. */
+    /** Select from the database, calling onRow with each output row as
+        it is produced rather than returning them all at the end.  The
+        rows are the same as those returned by queryStructured().  If
+        processInParallel is true, onRow may be called from several
+        threads at once and in any order; if it's false, the rows come in
+        the same order as from queryStructured(), from one thread at a
+        time.  If onInfo is set, it's called with what is known about
+        the output rows before onRow is first called.  Returns false if
+        onRow returned false to stop the query.
+    */
     virtual bool
     queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
                                const SelectExpression & select,
@@ -572,7 +678,9 @@ struct Dataset: public MldbEntity {
                                ssize_t offset,
                                ssize_t limit,
                                Utf8String alias = "",
-                               const ProgressFunc & onProgress = nullptr) const;
+                               const ProgressFunc & onProgress = nullptr,
+                               bool processInParallel = true,
+                               const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo = nullptr) const;
 
     /** Select from the database. */
     virtual std::vector<MatrixNamedRow>
@@ -119,6 +119,14 @@ apply(const ExpressionValue & input) const
     return function->apply(*this, input);
 }
 
+std::vector<ExpressionValue>
+FunctionApplier::
+applyBatch(const std::vector<ExpressionValue> & inputs) const
+{
+    ExcAssert(function);
+    return function->applyBatch(*this, inputs);
+}
+
 
 /*****************************************************************************/
 /* FUNCTION                                                                  */
@@ -166,6 +174,18 @@ bind(SqlBindingScope & outerContext,
     return result;
 }
 
+std::vector<ExpressionValue>
+Function::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+    for (auto & input: inputs)
+        result.emplace_back(apply(applier, input));
+    return result;
+}
+
 FunctionInfo
 Function::
 getFunctionInfo() const
@@ -116,6 +116,13 @@ struct FunctionApplier {
 
     /// Apply the function to the given context
     ExpressionValue apply(const ExpressionValue & input) const;
+
+    /** Apply the function to each of a batch of inputs, returning one
+        output per input in the same order.  This allows functions to
+        amortize per-call work over many rows.
+    */
+    std::vector<ExpressionValue>
+    applyBatch(const std::vector<ExpressionValue> & inputs) const;
 };
 
 
@@ -206,6 +213,14 @@ struct Function: public MldbEntity {
     virtual ExpressionValue apply(const FunctionApplier & applier,
                                   const ExpressionValue & context) const = 0;
 
+    /** Used by the FunctionApplier to apply the function to a batch of
+        inputs.  Default calls apply() on each one in turn; functions that
+        can do better over many rows at once should override.
+    */
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
     friend class FunctionApplier;
 };
 
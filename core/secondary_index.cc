@@ -0,0 +1,240 @@
+/** secondary_index.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Secondary indexes over the values of dataset columns.
+*/
+
+#include "mldb/core/secondary_index.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMN SECONDARY INDEX                                                    */
+/*****************************************************************************/
+
+bool
+ColumnSecondaryIndex::
+parseOp(const std::string & sqlOp, bool reversed, Op & op)
+{
+    if (sqlOp == "=" || sqlOp == "==")
+        op = EQ;
+    else if (sqlOp == "!=")
+        op = NE;
+    else if (sqlOp == "<")
+        op = reversed ? GT : LT;
+    else if (sqlOp == "<=")
+        op = reversed ? GE : LE;
+    else if (sqlOp == ">")
+        op = reversed ? LT : GT;
+    else if (sqlOp == ">=")
+        op = reversed ? LE : GE;
+    else return false;
+    return true;
+}
+
+ColumnSecondaryIndex::
+ColumnSecondaryIndex(const ColumnIndex & index,
+                     const ColumnPath & column,
+                     std::shared_ptr<const std::vector<RowPath> > rowPaths_,
+                     const std::unordered_map<uint64_t, uint32_t> & rowNumbers)
+    : column(column), rowPaths(std::move(rowPaths_))
+{
+    // A WHERE clause only sees the latest value of each row (with ties
+    // broken towards the smallest value, as GET_LATEST does), so only
+    // that value is indexed.  A null latest value hides older ones.
+    auto col = index.getColumn(column);
+
+    static constexpr size_t NONE = -1;
+    std::vector<size_t> latest(rowPaths->size(), NONE);
+    for (size_t i = 0;  i < col.rows.size();  ++i) {
+        auto it = rowNumbers.find(RowHash(std::get<0>(col.rows[i])).hash());
+        if (it == rowNumbers.end())
+            continue;
+        size_t & current = latest[it->second];
+        if (current != NONE) {
+            const CellValue & val = std::get<1>(col.rows[i]);
+            Date ts = std::get<2>(col.rows[i]);
+            const CellValue & curVal = std::get<1>(col.rows[current]);
+            Date curTs = std::get<2>(col.rows[current]);
+            if (ts < curTs || (ts == curTs && !(val < curVal)))
+                continue;
+        }
+        current = i;
+    }
+
+    std::vector<std::pair<CellValue, uint32_t> > entries;
+    for (uint32_t r = 0;  r < latest.size();  ++r) {
+        if (latest[r] == NONE)
+            continue;
+        CellValue & val = std::get<1>(col.rows[latest[r]]);
+        if (val.empty())
+            continue;
+        entries.emplace_back(std::move(val), r);
+    }
+    col.rows.clear();
+
+    // Sorting by value then by row number gives each value's rows in the
+    // increasing order that the bitmaps are built in
+    std::sort(entries.begin(), entries.end());
+
+    std::vector<uint32_t> rows;
+    for (size_t i = 0;  i < entries.size();  /* no inc */) {
+        size_t j = i;
+        rows.clear();
+        for (; j < entries.size() && entries[j].first == entries[i].first;
+             ++j)
+            rows.push_back(entries[j].second);
+        values.emplace_back(std::move(entries[i].first));
+        valueRows.emplace_back(rows);
+        i = j;
+    }
+
+    notNullRows = getValueRange(0, values.size());
+}
+
+RowBitmap
+ColumnSecondaryIndex::
+getValueRange(size_t begin, size_t end) const
+{
+    if (begin >= end)
+        return RowBitmap();
+    if (end == begin + 1)
+        return valueRows[begin];
+
+    std::vector<const RowBitmap *> sets;
+    sets.reserve(end - begin);
+    for (size_t i = begin;  i < end;  ++i)
+        sets.push_back(&valueRows[i]);
+    return RowBitmap::unionOf(sets);
+}
+
+RowBitmap
+ColumnSecondaryIndex::
+getRows(Op op, const CellValue & value) const
+{
+    // The values that compare less than value, and those equal to it
+    size_t lower = std::lower_bound(values.begin(), values.end(), value)
+        - values.begin();
+    size_t upper = std::upper_bound(values.begin(), values.end(), value)
+        - values.begin();
+
+    switch (op) {
+    case NOT_NULL:
+        return notNullRows;
+    case IS_TRUE: {
+        std::vector<const RowBitmap *> sets;
+        for (size_t i = 0;  i < values.size();  ++i) {
+            if (values[i].isTrue())
+                sets.push_back(&valueRows[i]);
+        }
+        return RowBitmap::unionOf(sets);
+    }
+    case EQ:
+        return getValueRange(lower, upper);
+    case NE:
+        return getValueRange(0, lower) | getValueRange(upper, values.size());
+    case LT:
+        return getValueRange(0, lower);
+    case LE:
+        return getValueRange(0, upper);
+    case GT:
+        return getValueRange(upper, values.size());
+    case GE:
+        return getValueRange(lower, values.size());
+    }
+
+    throw MLDB::Exception("Unknown secondary index operation");
+}
+
+size_t
+ColumnSecondaryIndex::
+memusage() const
+{
+    size_t result = sizeof(*this) + notNullRows.memusage()
+        + values.capacity() * sizeof(CellValue);
+    for (auto & r: valueRows)
+        result += r.memusage();
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SECONDARY INDEX CACHE                                                     */
+/*****************************************************************************/
+
+SecondaryIndexCache::
+SecondaryIndexCache(std::vector<ColumnPath> indexedColumns)
+{
+    setIndexedColumns(std::move(indexedColumns));
+}
+
+void
+SecondaryIndexCache::
+setIndexedColumns(std::vector<ColumnPath> columns)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    indexedColumns.clear();
+    indexedColumns.insert(columns.begin(), columns.end());
+    indexes.clear();
+    rowPaths.reset();
+    rowNumbers.clear();
+}
+
+std::vector<std::shared_ptr<const ColumnSecondaryIndex> >
+SecondaryIndexCache::
+get(const ColumnIndex & index,
+    const std::vector<ColumnPath> & columns) const
+{
+    std::vector<std::shared_ptr<const ColumnSecondaryIndex> > result;
+
+    std::unique_lock<std::mutex> guard(mutex);
+
+    for (auto & c: columns) {
+        if (!indexedColumns.count(c))
+            return {};
+    }
+
+    // Number the rows once for all of the indexes, so that they can be
+    // combined with each other
+    if (!rowPaths) {
+        auto paths = std::make_shared<std::vector<RowPath> >
+            (index.getRowPaths());
+        ExcAssertLess(paths->size(), (size_t)std::numeric_limits<uint32_t>::max());
+        rowNumbers.clear();
+        rowNumbers.reserve(paths->size());
+        for (uint32_t i = 0;  i < paths->size();  ++i)
+            rowNumbers[RowHash((*paths)[i]).hash()] = i;
+        rowPaths = std::move(paths);
+    }
+
+    for (auto & c: columns) {
+        auto & entry = indexes[c];
+        if (!entry) {
+            entry = std::make_shared<ColumnSecondaryIndex>
+                (index, c, rowPaths, rowNumbers);
+        }
+        result.push_back(entry);
+    }
+
+    return result;
+}
+
+void
+SecondaryIndexCache::
+invalidate()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    indexes.clear();
+    rowPaths.reset();
+    rowNumbers.clear();
+}
+
+} // namespace MLDB
@@ -0,0 +1,142 @@
+/** secondary_index.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Secondary indexes over the values of dataset columns.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/utils/row_bitmap.h"
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* COLUMN SECONDARY INDEX                                                    */
+/*****************************************************************************/
+
+/** Inverted index over the values of one column of a dataset: the sorted
+    distinct values of the column, each with the bitmap of the rows that
+    have it.
+
+    Rows are numbered by their position in rowPaths, which is shared by
+    all of the indexes of a dataset that were built together, so that
+    their row sets can be intersected and united directly.
+
+    Only the latest value of each row is indexed, as that is the value
+    that a WHERE clause compares, so the rows returned are exactly those
+    for which the comparison would be true.
+*/
+
+struct ColumnSecondaryIndex {
+
+    enum Op {
+        NOT_NULL,   ///< Any non-null value
+        IS_TRUE,    ///< Value that is true
+        EQ,         ///< Equal to value
+        NE,         ///< Not equal to value
+        LT,         ///< Less than value
+        LE,         ///< Less than or equal to value
+        GT,         ///< Greater than value
+        GE          ///< Greater than or equal to value
+    };
+
+    /** Convert a SQL comparison operator into an Op, swapping the sense
+        if reversed (ie the column is on the right hand side).  Returns
+        false if the operator is not one that can be indexed.
+    */
+    static bool parseOp(const std::string & sqlOp, bool reversed, Op & op);
+
+    /** Index the given column.  rowNumbers gives the position of each row
+        hash in rowPaths; rows not in it are ignored.
+    */
+    ColumnSecondaryIndex(const ColumnIndex & index,
+                         const ColumnPath & column,
+                         std::shared_ptr<const std::vector<RowPath> > rowPaths,
+                         const std::unordered_map<uint64_t, uint32_t> & rowNumbers);
+
+    /** Return the rows with a value that matches.  As the values are
+        sorted, comparisons use a binary search followed by a union of the
+        bitmaps of the matching values.
+    */
+    RowBitmap getRows(Op op, const CellValue & value = CellValue()) const;
+
+    /// Column that is indexed
+    ColumnPath column;
+
+    /// Name of each row number
+    std::shared_ptr<const std::vector<RowPath> > rowPaths;
+
+    /// Distinct non-null values of the column, sorted
+    std::vector<CellValue> values;
+
+    /// Rows that have each value
+    std::vector<RowBitmap> valueRows;
+
+    /// Rows that have any value
+    RowBitmap notNullRows;
+
+    /// Number of bytes of memory used by the index
+    size_t memusage() const;
+
+private:
+    /// Union of the rows of the values in the range [begin, end)
+    RowBitmap getValueRange(size_t begin, size_t end) const;
+};
+
+
+/*****************************************************************************/
+/* SECONDARY INDEX CACHE                                                     */
+/*****************************************************************************/
+
+/** Secondary indexes over the columns of a dataset that were configured
+    to be indexed.  Each index is built the first time that a query needs
+    it, and kept until invalidate() is called.
+
+    Datasets that support secondary indexes hold one of these, return
+    the result of get() from ColumnIndex::getColumnSecondaryIndexes(),
+    and call invalidate() once each write has become visible.
+*/
+
+struct SecondaryIndexCache {
+    SecondaryIndexCache(std::vector<ColumnPath> indexedColumns = {});
+
+    /// Set which columns are indexed, discarding any indexes already built
+    void setIndexedColumns(std::vector<ColumnPath> indexedColumns);
+
+    /** Return the indexes of the given columns, building any that aren't
+        there yet over the current contents of index.  Returns an empty
+        vector if any of the columns is not indexed.
+    */
+    std::vector<std::shared_ptr<const ColumnSecondaryIndex> >
+    get(const ColumnIndex & index,
+        const std::vector<ColumnPath> & columns) const;
+
+    /// Discard all of the indexes, as the data has changed
+    void invalidate();
+
+private:
+    /// Protects everything below, and serializes building the indexes
+    mutable std::mutex mutex;
+
+    /// Columns that should be indexed
+    std::set<ColumnPath> indexedColumns;
+
+    /// Rows of the indexed dataset, shared by all of the indexes
+    mutable std::shared_ptr<const std::vector<RowPath> > rowPaths;
+
+    /// Row number of each row hash in rowPaths
+    mutable std::unordered_map<uint64_t, uint32_t> rowNumbers;
+
+    /// Indexes that have been built
+    mutable std::map<ColumnPath, std::shared_ptr<const ColumnSecondaryIndex> >
+        indexes;
+};
+
+} // namespace MLDB
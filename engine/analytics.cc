@@ -68,10 +68,14 @@ iterateDatasetExpr(const SelectExpression & select,
                         const OrderByExpression & orderBy,
                         ssize_t offset,
                         ssize_t limit,
-                        const ProgressFunc & onProgress)
+                        const ProgressFunc & onProgress,
+                        const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo)
 {
     BoundSelectQuery query(select, from, alias, when, where, orderBy, calc);
 
+    if (onInfo)
+        onInfo(query.selectInfo);
+
     bool success = query.executeExpr(processor, offset, limit, onProgress);
 
     return {success, query.selectInfo};
@@ -92,12 +96,13 @@ iterateDatasetGrouped(const SelectExpression & select,
                            const OrderByExpression & orderBy,
                            ssize_t offset,
                            ssize_t limit,
-                           const ProgressFunc & onProgress)
+                           const ProgressFunc & onProgress,
+                           const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo)
 {
     BoundGroupByQuery query(select, from, alias, when, where, groupBy,
                              aggregators, having, rowName, orderBy);
 
-    return query.execute(processor, offset, limit, onProgress);
+    return query.execute(processor, offset, limit, onProgress, onInfo);
 
 }
 
@@ -510,7 +515,9 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
                    const SelectStatement & stm,
                    SqlBindingScope & scope,
                    BoundParameters params,
-                   const ProgressFunc & onProgress)
+                   const ProgressFunc & onProgress,
+                   bool processInParallel,
+                   const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo)
 {
     BoundTableExpression table = stm.from->bind(scope, onProgress);
     
@@ -523,7 +530,9 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
              stm.rowName,
              stm.offset, stm.limit, 
              table.asName,
-             onProgress);
+             onProgress,
+             processInParallel,
+             onInfo);
     }
     else if (table.table.runQuery && stm.from) {
 
@@ -545,8 +554,9 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
         auto boundPipeline = pipeline->bind();
 
         auto executor = boundPipeline->start(params);
-        
-        std::vector<MatrixNamedRow> rows;
+
+        if (onInfo)
+            onInfo(std::make_shared<UnknownRowValueInfo>());
 
         ssize_t limit = stm.limit;
         ssize_t offset = stm.offset;
@@ -577,8 +587,10 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
     }
     else {
         // No from at all
-        auto rows = queryWithoutDataset(stm, scope);
-        for (auto & r: rows) {
+        auto output = queryWithoutDatasetExpr(stm, scope);
+        if (onInfo)
+            onInfo(std::get<1>(output));
+        for (auto & r: std::get<0>(output)) {
             ExpressionValue val(std::move(r.columns));
             if (!onRow(r.rowName, val))
                 return false;
@@ -84,7 +84,8 @@ iterateDataset(const SelectExpression & select,
                     const ProgressFunc & onProgress);
 
 /** Equivalent to SELECT (select) FROM (dataset) WHEN (when) WHERE (where), and each matching
-    row is passed to the aggregator.
+    row is passed to the aggregator.  If onInfo is set, it's called with
+    the info of the output rows before any row is processed.
 */
 std::pair<bool, std::shared_ptr<ExpressionValueInfo> >
 iterateDatasetExpr(const SelectExpression & select,
@@ -97,7 +98,8 @@ iterateDatasetExpr(const SelectExpression & select,
                         const OrderByExpression & orderBy,
                         ssize_t offset,
                         ssize_t limit,
-                        const ProgressFunc & onProgress);
+                        const ProgressFunc & onProgress,
+                        const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo = nullptr);
 
 /** Equivalent to SELECT (select) FROM (dataset) WHEN (when) WHERE (where), and each matching
     row is passed to the aggregator.
@@ -115,7 +117,9 @@ iterateDataset(const SelectExpression & select,
                     ssize_t limit = -1 /* all */,
                     const ProgressFunc & onProgress = nullptr);
 
-/** Full select function, with grouping. */
+/** Full select function, with grouping.  If onInfo is set, it's called
+    with the info of the output rows before any row is processed.
+*/
 std::pair<bool, std::shared_ptr<ExpressionValueInfo> >
 iterateDatasetGrouped(const SelectExpression & select,
                            const Dataset & from,
@@ -130,7 +134,8 @@ iterateDatasetGrouped(const SelectExpression & select,
                            const OrderByExpression & orderBy = ORDER_BY_NOTHING,
                            ssize_t offset = 0 /* start at start */,
                            ssize_t limit = -1 /* all */,
-                           const ProgressFunc & onProgress = nullptr);
+                           const ProgressFunc & onProgress = nullptr,
+                           const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo = nullptr);
 
 
 /** Create an embedding matrix, one embedding per row.  Returns both the embedding
@@ -198,14 +203,20 @@ queryFromStatementExpr(const SelectStatement & stm,
 
     Will return the results one by one, and will stop when the
     onRow function returns false.  Returns false if one of the
-    onRow calls returned false, or true otherwise.
+    onRow calls returned false, or true otherwise.  If processInParallel
+    is false, onRow is called from one thread at a time with the rows in
+    the order of the query, as when streaming them to a client.  If
+    onInfo is set, it's called with what is known about the output rows
+    before onRow is first called.
 */
 bool
 queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
                    const SelectStatement & stm,
                    SqlBindingScope & scope,
                    BoundParameters params = nullptr,
-                   const ProgressFunc & onProgress = nullptr);
+                   const ProgressFunc & onProgress = nullptr,
+                   bool processInParallel = true,
+                   const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo = nullptr);
 
 /** Build a RowPath from an expression value and throw if
     it is not valid (row, empty, etc)
@@ -0,0 +1,891 @@
+/** arrow_ipc.cc
+    Encoding of query output as an Apache Arrow IPC stream.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    The Arrow metadata is made of flatbuffers, which are written directly
+    here from the Arrow schema (Schema.fbs and Message.fbs) rather than
+    bringing in the flatbuffers and Arrow libraries.
+*/
+
+#include "mldb/engine/arrow_ipc.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/base/exc_assert.h"
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+
+/*****************************************************************************/
+/* FLATBUFFER BUILDER                                                        */
+/*****************************************************************************/
+
+/** Just enough of a flatbuffer builder to write the Arrow metadata.  As
+    with the real one, the buffer is built from the back towards the
+    front, so that everything is written before anything that refers to
+    it, and objects are identified by their distance from the back.
+*/
+
+struct FlatBufferBuilder {
+    typedef uint32_t Offset;
+
+    FlatBufferBuilder()
+        : buf(1024), head(buf.size()), minAlign(1), tableStart(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return buf.size() - head;
+    }
+
+    Offset createString(const std::string & str)
+    {
+        align(4, str.size() + 1);
+        pad(1);
+        prependBytes(str.data(), str.size());
+        prepend<uint32_t>(str.size());
+        return size();
+    }
+
+    Offset createOffsetVector(const std::vector<Offset> & offsets)
+    {
+        align(4, offsets.size() * 4);
+        for (auto it = offsets.rbegin();  it != offsets.rend();  ++it)
+            prependOffset(*it);
+        prepend<uint32_t>(offsets.size());
+        return size();
+    }
+
+    /// Create a vector of structs made of 64 bit fields
+    template<typename Struct>
+    Offset createStructVector(const std::vector<Struct> & structs)
+    {
+        static_assert(alignof(Struct) == 8, "structs must have 8 byte alignment");
+        align(8, structs.size() * sizeof(Struct));
+        prependBytes(structs.data(), structs.size() * sizeof(Struct));
+        prepend<uint32_t>(structs.size());
+        return size();
+    }
+
+    void startTable()
+    {
+        fields.clear();
+        tableStart = size();
+    }
+
+    template<typename T>
+    void addField(int slot, T val)
+    {
+        prepend<T>(val);
+        fields.emplace_back(slot, size());
+    }
+
+    void addOffsetField(int slot, Offset target)
+    {
+        prependOffset(target);
+        fields.emplace_back(slot, size());
+    }
+
+    Offset endTable()
+    {
+        // Placeholder for the offset to the vtable, filled in below
+        prepend<int32_t>(0);
+        Offset table = size();
+
+        int numSlots = 0;
+        for (auto & f: fields)
+            numSlots = std::max(numSlots, f.first + 1);
+
+        std::vector<uint16_t> vtable(numSlots + 2, 0);
+        vtable[0] = vtable.size() * sizeof(uint16_t);
+        vtable[1] = table - tableStart;
+        for (auto & f: fields)
+            vtable[f.first + 2] = table - f.second;
+        for (auto it = vtable.rbegin();  it != vtable.rend();  ++it)
+            prepend<uint16_t>(*it);
+
+        // The vtable is before the table
+        int32_t toVtable = size() - table;
+        std::memcpy(&buf[buf.size() - table], &toVtable, sizeof(toVtable));
+        return table;
+    }
+
+    std::string finish(Offset root)
+    {
+        align(std::max<size_t>(minAlign, 4), 4);
+        prependOffset(root);
+        return std::string(buf.begin() + head, buf.end());
+    }
+
+private:
+    void reserve(size_t bytes)
+    {
+        if (head >= bytes)
+            return;
+        size_t used = size();
+        std::vector<char> newBuf(std::max(buf.size() * 2, used + bytes));
+        std::copy(buf.begin() + head, buf.end(), newBuf.end() - used);
+        buf.swap(newBuf);
+        head = buf.size() - used;
+    }
+
+    void pad(size_t bytes)
+    {
+        reserve(bytes);
+        head -= bytes;
+        std::memset(&buf[head], 0, bytes);
+    }
+
+    /// Pad so that after extra more bytes, we're aligned on alignment
+    void align(size_t alignment, size_t extra = 0)
+    {
+        minAlign = std::max(minAlign, alignment);
+        pad((alignment - (size() + extra) % alignment) % alignment);
+    }
+
+    void prependBytes(const void * data, size_t len)
+    {
+        reserve(len);
+        head -= len;
+        std::memcpy(&buf[head], data, len);
+    }
+
+    template<typename T>
+    void prepend(T val)
+    {
+        align(sizeof(T));
+        prependBytes(&val, sizeof(T));
+    }
+
+    void prependOffset(Offset target)
+    {
+        align(4);
+        prepend<uint32_t>(size() + 4 - target);
+    }
+
+    std::vector<char> buf;
+    size_t head;
+    size_t minAlign;
+    size_t tableStart;
+    std::vector<std::pair<int, Offset> > fields;
+};
+
+
+/*****************************************************************************/
+/* ARROW MESSAGES                                                            */
+/*****************************************************************************/
+
+typedef FlatBufferBuilder::Offset Offset;
+
+// Values of the MessageHeader union in Message.fbs
+enum ArrowMessageHeader: uint8_t {
+    HEADER_SCHEMA = 1,
+    HEADER_RECORD_BATCH = 3
+};
+
+// Values of the Type union in Schema.fbs
+enum ArrowTypeId: uint8_t {
+    TYPE_NULL = 1,
+    TYPE_INT = 2,
+    TYPE_FLOATING_POINT = 3,
+    TYPE_BINARY = 4,
+    TYPE_UTF8 = 5,
+    TYPE_BOOL = 6,
+    TYPE_TIMESTAMP = 10
+};
+
+/// Type of an output column
+enum ArrowColumnType {
+    COL_NULL,
+    COL_BOOL,
+    COL_INT64,
+    COL_UINT64,
+    COL_FLOAT64,
+    COL_TIMESTAMP,
+    COL_UTF8,
+    COL_BINARY
+};
+
+struct FieldNode {
+    int64_t length;
+    int64_t nullCount;
+};
+
+struct BufferSpec {
+    int64_t offset;
+    int64_t length;
+};
+
+/** Write a Type table for the given column type, returning the union
+    value and the table.
+*/
+std::pair<ArrowTypeId, Offset>
+encodeType(FlatBufferBuilder & fbb, ArrowColumnType type)
+{
+    Offset timezone = 0;
+    if (type == COL_TIMESTAMP)
+        timezone = fbb.createString("UTC");
+
+    fbb.startTable();
+
+    ArrowTypeId id;
+    switch (type) {
+    case COL_NULL:
+        id = TYPE_NULL;
+        break;
+    case COL_BOOL:
+        id = TYPE_BOOL;
+        break;
+    case COL_INT64:
+    case COL_UINT64:
+        id = TYPE_INT;
+        fbb.addField<int32_t>(0, 64 /* bitWidth */);
+        fbb.addField<uint8_t>(1, type == COL_INT64 /* is_signed */);
+        break;
+    case COL_FLOAT64:
+        id = TYPE_FLOATING_POINT;
+        fbb.addField<int16_t>(0, 2 /* precision = DOUBLE */);
+        break;
+    case COL_TIMESTAMP:
+        id = TYPE_TIMESTAMP;
+        fbb.addOffsetField(1, timezone);
+        fbb.addField<int16_t>(0, 2 /* unit = MICROSECOND */);
+        break;
+    case COL_UTF8:
+        id = TYPE_UTF8;
+        break;
+    case COL_BINARY:
+        id = TYPE_BINARY;
+        break;
+    default:
+        throw AnnotatedException(500, "Unknown Arrow column type");
+    }
+
+    return { id, fbb.endTable() };
+}
+
+/** Finish the metadata of a message with the given header, and frame it
+    with its body as an encapsulated message.
+*/
+std::string
+encodeMessage(FlatBufferBuilder & fbb,
+              ArrowMessageHeader headerType, Offset header,
+              const std::string & body)
+{
+    fbb.startTable();
+    fbb.addField<int64_t>(3, body.size() /* bodyLength */);
+    fbb.addOffsetField(2, header);
+    fbb.addField<int16_t>(0, 4 /* version = V5 */);
+    fbb.addField<uint8_t>(1, headerType);
+    std::string metadata = fbb.finish(fbb.endTable());
+
+    // Continuation marker and length, then the metadata padded so that
+    // the body starts on an 8 byte boundary
+    uint32_t continuation = 0xffffffff;
+    int32_t length = (metadata.size() + 7) / 8 * 8;
+
+    std::string result;
+    result.reserve(8 + length + body.size());
+    result.append((const char *)&continuation, 4);
+    result.append((const char *)&length, 4);
+    result += metadata;
+    result.append(length - metadata.size(), '\0');
+    result += body;
+    return result;
+}
+
+struct ArrowColumn {
+    ArrowColumn(Utf8String name, ArrowColumnType type = COL_NULL)
+        : name(std::move(name)), type(type)
+    {
+    }
+
+    Utf8String name;
+    ArrowColumnType type;
+
+    size_t numValues = 0;
+    bool hasIntegers = false;
+    bool hasNegative = false;
+    bool hasLargeUnsigned = false;
+    bool hasNonBoolean = false;
+    bool hasFloats = false;
+    bool hasTimestamps = false;
+    bool hasBlobs = false;
+    bool hasStrings = false;
+
+    void observe(const CellValue & val)
+    {
+        switch (val.cellType()) {
+        case CellValue::EMPTY:
+            return;
+        case CellValue::INTEGER:
+            hasIntegers = true;
+            if (val.isInt64()) {
+                int64_t i = val.toInt();
+                hasNegative = hasNegative || i < 0;
+                hasNonBoolean = hasNonBoolean || (i != 0 && i != 1);
+            }
+            else {
+                hasLargeUnsigned = true;
+                hasNonBoolean = true;
+            }
+            break;
+        case CellValue::FLOAT:
+            hasFloats = true;
+            break;
+        case CellValue::TIMESTAMP:
+            hasTimestamps = true;
+            break;
+        case CellValue::BLOB:
+            hasBlobs = true;
+            break;
+        default:
+            // Strings, paths and intervals are all output as strings
+            hasStrings = true;
+        }
+        ++numValues;
+    }
+
+    /** Choose the type of the column, once all values have been
+        observed.  The hint is what is known about the column from the
+        query, and may be null.  If more values will come after those
+        observed, then moreToCome is set, and a column with no values so
+        far is given a type that any value but a blob will fit.
+    */
+    void setType(const ExpressionValueInfo * hint, bool moreToCome)
+    {
+        ArrowColumnType hinted = hintedType(hint);
+
+        if (numValues == 0) {
+            type = hinted == COL_NULL && moreToCome ? COL_UTF8 : hinted;
+            return;
+        }
+
+        int numKinds = (hasIntegers || hasFloats) + hasTimestamps
+            + hasBlobs + hasStrings;
+
+        if (hasBlobs)
+            type = COL_BINARY;
+        else if (numKinds > 1 || hasStrings)
+            type = COL_UTF8;
+        else if (hasTimestamps)
+            type = COL_TIMESTAMP;
+        else if (hasFloats || hinted == COL_FLOAT64)
+            type = COL_FLOAT64;
+        else if (!hasNonBoolean && hinted == COL_BOOL)
+            type = COL_BOOL;
+        else if (hasLargeUnsigned)
+            type = hasNegative ? COL_FLOAT64 : COL_UINT64;
+        else type = COL_INT64;
+    }
+
+    /// Can the value be encoded in a column of the given type?
+    static bool fits(ArrowColumnType type, const CellValue & val)
+    {
+        if (val.empty())
+            return true;
+
+        switch (type) {
+        case COL_NULL:
+            return false;
+        case COL_BOOL:
+            return val.isInteger() && val.isInt64()
+                && (val.toInt() == 0 || val.toInt() == 1);
+        case COL_INT64:
+            return val.isInteger() && val.isInt64();
+        case COL_UINT64:
+            return val.isInteger() && val.isUInt64();
+        case COL_FLOAT64:
+            return val.isNumber();
+        case COL_TIMESTAMP:
+            return val.isTimestamp();
+        case COL_UTF8:
+            return !val.isBlob();
+        case COL_BINARY:
+            return true;
+        }
+        return false;
+    }
+
+    static ArrowColumnType hintedType(const ExpressionValueInfo * hint)
+    {
+        if (dynamic_cast<const BooleanValueInfo *>(hint))
+            return COL_BOOL;
+        if (dynamic_cast<const IntegerValueInfo *>(hint))
+            return COL_INT64;
+        if (dynamic_cast<const Uint64ValueInfo *>(hint))
+            return COL_UINT64;
+        if (dynamic_cast<const Float64ValueInfo *>(hint)
+            || dynamic_cast<const Float32ValueInfo *>(hint)
+            || dynamic_cast<const NumericValueInfo *>(hint))
+            return COL_FLOAT64;
+        if (dynamic_cast<const TimestampValueInfo *>(hint))
+            return COL_TIMESTAMP;
+        if (dynamic_cast<const StringValueInfo *>(hint)
+            || dynamic_cast<const Utf8StringValueInfo *>(hint))
+            return COL_UTF8;
+        if (dynamic_cast<const BlobValueInfo *>(hint))
+            return COL_BINARY;
+        return COL_NULL;
+    }
+};
+
+std::string encodeSchema(const std::vector<ArrowColumn> & columns)
+{
+    FlatBufferBuilder fbb;
+
+    std::vector<Offset> fields;
+    for (auto & c: columns) {
+        Offset name = fbb.createString(c.name.rawString());
+        Offset children = fbb.createOffsetVector({});
+        auto type = encodeType(fbb, c.type);
+        fbb.startTable();
+        fbb.addOffsetField(0, name);
+        fbb.addOffsetField(3, type.second);
+        fbb.addOffsetField(5, children);
+        fbb.addField<uint8_t>(1, true /* nullable */);
+        fbb.addField<uint8_t>(2, type.first);
+        fields.push_back(fbb.endTable());
+    }
+
+    Offset fieldsVector = fbb.createOffsetVector(fields);
+    fbb.startTable();
+    fbb.addOffsetField(1, fieldsVector);
+    fbb.addField<int16_t>(0, 0 /* endianness = Little */);
+    Offset schema = fbb.endTable();
+
+    return encodeMessage(fbb, HEADER_SCHEMA, schema, std::string());
+}
+
+
+/*****************************************************************************/
+/* RECORD BATCH                                                              */
+/*****************************************************************************/
+
+/** Body of a record batch, being built a column at a time. */
+struct RecordBatchBody {
+    std::string body;
+    std::vector<FieldNode> nodes;
+    std::vector<BufferSpec> buffers;
+
+    void addBuffer(const void * data, size_t len)
+    {
+        buffers.push_back({ (int64_t)body.size(), (int64_t)len });
+        body.append((const char *)data, len);
+        body.append((8 - body.size() % 8) % 8, '\0');
+    }
+
+    void addBuffer(const std::string & data)
+    {
+        addBuffer(data.data(), data.size());
+    }
+
+    /** Add the node and validity bitmap of a column with numRows rows.
+        present is called with each row that isn't null, in order.
+    */
+    template<typename ForEachPresent>
+    void addValidity(size_t numRows, size_t numPresent,
+                     const ForEachPresent & forEachPresent)
+    {
+        nodes.push_back({ (int64_t)numRows, (int64_t)(numRows - numPresent) });
+
+        // The validity bitmap may be left out if there are no nulls
+        if (numPresent == numRows) {
+            addBuffer(nullptr, 0);
+            return;
+        }
+
+        std::string bits((numRows + 7) / 8, '\0');
+        forEachPresent([&] (size_t row) { bits[row / 8] |= 1 << (row % 8); });
+        addBuffer(bits);
+    }
+
+    /** Add the offsets and data of a utf8 or binary column.
+        appendValue(row, data) is called with each row in order, and
+        appends the row's value (if any) to data.
+    */
+    template<typename AppendValue>
+    void addVariableLength(size_t numRows, const AppendValue & appendValue)
+    {
+        std::vector<int32_t> offsets(numRows + 1, 0);
+        std::string data;
+        for (size_t i = 0;  i < numRows;  ++i) {
+            appendValue(i, data);
+            if (data.size() > (size_t)std::numeric_limits<int32_t>::max()) {
+                throw AnnotatedException
+                    (400, "Column values are too large for the arrow format");
+            }
+            offsets[i + 1] = data.size();
+        }
+        addBuffer(offsets.data(), offsets.size() * sizeof(int32_t));
+        addBuffer(data);
+    }
+
+    std::string encode(size_t numRows) const
+    {
+        FlatBufferBuilder fbb;
+        Offset buffersVector = fbb.createStructVector(buffers);
+        Offset nodesVector = fbb.createStructVector(nodes);
+        fbb.startTable();
+        fbb.addField<int64_t>(0, numRows /* length */);
+        fbb.addOffsetField(1, nodesVector);
+        fbb.addOffsetField(2, buffersVector);
+        Offset batch = fbb.endTable();
+
+        return encodeMessage(fbb, HEADER_RECORD_BATCH, batch, body);
+    }
+};
+
+typedef std::tuple<ColumnPath, CellValue, Date> Cell;
+
+/// Values of a column within a batch, as (row within batch, cell)
+typedef std::vector<std::pair<uint32_t, const Cell *> > ColumnEntries;
+
+void appendBytes(const CellValue & val, std::string & data)
+{
+    if (val.isString())
+        data.append(val.stringChars(), val.toStringLength());
+    else if (val.isBlob())
+        data.append((const char *)val.blobData(), val.blobLength());
+    else if (val.isPath())
+        data += val.coerceToPath().toUtf8String().rawString();
+    else data += val.toUtf8String().rawString();
+}
+
+template<typename T, typename GetValue>
+void addFixedWidth(RecordBatchBody & batch, size_t numRows,
+                   const ColumnEntries & entries, const GetValue & getValue)
+{
+    std::vector<T> values(numRows, 0);
+    for (auto & e: entries)
+        values[e.first] = getValue(std::get<1>(*e.second));
+    batch.addBuffer(values.data(), values.size() * sizeof(T));
+}
+
+void addColumn(RecordBatchBody & batch, ArrowColumnType type,
+               size_t numRows, const ColumnEntries & entries)
+{
+    if (type == COL_NULL) {
+        // Null columns have no buffers at all
+        batch.nodes.push_back({ (int64_t)numRows, (int64_t)numRows });
+        return;
+    }
+
+    auto forEachPresent = [&] (const std::function<void (size_t)> & onRow)
+        {
+            for (auto & e: entries)
+                onRow(e.first);
+        };
+    batch.addValidity(numRows, entries.size(), forEachPresent);
+
+    switch (type) {
+    case COL_BOOL: {
+        std::string bits((numRows + 7) / 8, '\0');
+        for (auto & e: entries) {
+            if (std::get<1>(*e.second).isTrue())
+                bits[e.first / 8] |= 1 << (e.first % 8);
+        }
+        batch.addBuffer(bits);
+        break;
+    }
+    case COL_INT64:
+        addFixedWidth<int64_t>(batch, numRows, entries,
+                               [] (const CellValue & v) { return v.toInt(); });
+        break;
+    case COL_UINT64:
+        addFixedWidth<uint64_t>(batch, numRows, entries,
+                                [] (const CellValue & v) { return v.toUInt(); });
+        break;
+    case COL_FLOAT64:
+        addFixedWidth<double>(batch, numRows, entries,
+                              [] (const CellValue & v) { return v.toDouble(); });
+        break;
+    case COL_TIMESTAMP:
+        addFixedWidth<int64_t>
+            (batch, numRows, entries,
+             [] (const CellValue & v) -> int64_t
+             {
+                 return std::llround(v.toTimestamp().secondsSinceEpoch()
+                                     * 1000000.0);
+             });
+        break;
+    case COL_UTF8:
+    case COL_BINARY: {
+        auto it = entries.begin();
+        auto appendValue = [&] (size_t row, std::string & data)
+            {
+                if (it != entries.end() && it->first == row) {
+                    appendBytes(std::get<1>(*it->second), data);
+                    ++it;
+                }
+            };
+        batch.addVariableLength(numRows, appendValue);
+        break;
+    }
+    default:
+        throw AnnotatedException(500, "Unknown Arrow column type");
+    }
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ARROW STREAM ENCODER                                                      */
+/*****************************************************************************/
+
+struct ArrowStreamEncoder::Itl {
+    Itl(bool rowNames, bool rowHashes, bool sortColumns,
+        std::function<bool (std::string)> onMessage)
+        : rowNames(rowNames), rowHashes(rowHashes), sortColumns(sortColumns),
+          onMessage(std::move(onMessage))
+    {
+    }
+
+    bool rowNames;
+    bool rowHashes;
+    bool sortColumns;
+    std::function<bool (std::string)> onMessage;
+    std::shared_ptr<const ExpressionValueInfo> info;
+
+    /// Rows of the batch being built
+    std::vector<MatrixNamedRow> rows;
+
+    /// Output columns (not including _rowName and _rowHash) and where to
+    /// find them.  Set once the schema is sent.
+    std::vector<ArrowColumn> columns;
+    std::unordered_map<ColumnPath, int> columnIndex;
+
+    bool schemaSent = false;
+    bool stopped = false;
+
+    bool send(std::string message)
+    {
+        if (!onMessage(std::move(message)))
+            stopped = true;
+        return !stopped;
+    }
+
+    /** Work out the columns and their types from the rows of the first
+        batch, and send the schema.  If moreToCome is set, there will be
+        more batches, whose values must fit the same schema.
+    */
+    bool sendSchema(bool moreToCome)
+    {
+        for (auto & row: rows) {
+            for (auto & c: row.columns) {
+                const ColumnPath & name = std::get<0>(c);
+                auto it = columnIndex.find(name);
+                if (it == columnIndex.end()) {
+                    it = columnIndex.emplace(name, columns.size()).first;
+                    columns.emplace_back(name.toUtf8String());
+                }
+                columns[it->second].observe(std::get<1>(c));
+            }
+        }
+
+        std::unordered_map<ColumnPath, std::shared_ptr<ExpressionValueInfo> > hints;
+        if (info && info->isRow()) {
+            for (auto & k: info->getKnownAtoms()) {
+                hints[k.columnName] = k.valueInfo;
+                // Columns that may only appear in later batches
+                if (moreToCome
+                    && columnIndex.emplace(k.columnName, columns.size()).second)
+                    columns.emplace_back(k.columnName.toUtf8String());
+            }
+        }
+
+        if (sortColumns) {
+            std::vector<std::pair<ColumnPath, int> >
+                sorted(columnIndex.begin(), columnIndex.end());
+            std::sort(sorted.begin(), sorted.end());
+            std::vector<ArrowColumn> sortedColumns;
+            sortedColumns.reserve(columns.size());
+            for (auto & s: sorted) {
+                columnIndex[s.first] = sortedColumns.size();
+                sortedColumns.emplace_back(std::move(columns[s.second]));
+            }
+            columns.swap(sortedColumns);
+        }
+
+        for (auto & c: columnIndex) {
+            auto it = hints.find(c.first);
+            columns[c.second].setType(it == hints.end()
+                                      ? nullptr : it->second.get(),
+                                      moreToCome);
+        }
+
+        std::vector<ArrowColumn> schema;
+        if (rowNames)
+            schema.emplace_back(Utf8String("_rowName"), COL_UTF8);
+        if (rowHashes)
+            schema.emplace_back(Utf8String("_rowHash"), COL_UTF8);
+        schema.insert(schema.end(), columns.begin(), columns.end());
+
+        schemaSent = true;
+        return send(encodeSchema(schema));
+    }
+
+    /// Encode the rows of the current batch as a record batch
+    bool sendBatch()
+    {
+        size_t numRows = rows.size();
+        std::vector<ColumnEntries> entries(columns.size());
+
+        for (size_t i = 0;  i < numRows;  ++i) {
+            for (auto & c: rows[i].columns) {
+                const CellValue & val = std::get<1>(c);
+                if (val.empty())
+                    continue;
+                auto it = columnIndex.find(std::get<0>(c));
+                if (it == columnIndex.end()) {
+                    throw AnnotatedException
+                        (400, "Column '" + std::get<0>(c).toUtf8String()
+                         + "' first appears after the first "
+                         + std::to_string(ARROW_BATCH_ROWS)
+                         + " rows, once the Arrow schema has been sent");
+                }
+                if (!ArrowColumn::fits(columns[it->second].type, val)) {
+                    throw AnnotatedException
+                        (400, "Value '" + val.toUtf8String()
+                         + "' of column '" + std::get<0>(c).toUtf8String()
+                         + "' doesn't fit the Arrow type of the column, "
+                         "which was fixed by the first "
+                         + std::to_string(ARROW_BATCH_ROWS)
+                         + " rows; use CAST to give the column a type");
+                }
+                ColumnEntries & e = entries[it->second];
+                if (!e.empty() && e.back().first == i) {
+                    // Several values in this row; keep the latest
+                    if (std::get<2>(c) >= std::get<2>(*e.back().second))
+                        e.back().second = &c;
+                }
+                else e.emplace_back(i, &c);
+            }
+        }
+
+        RecordBatchBody batch;
+
+        auto allPresent = [&] (const std::function<void (size_t)> &) {};
+        if (rowNames) {
+            batch.addValidity(numRows, numRows, allPresent);
+            batch.addVariableLength
+                (numRows,
+                 [&] (size_t row, std::string & data)
+                 {
+                     data += rows[row].rowName.toUtf8String().rawString();
+                 });
+        }
+        if (rowHashes) {
+            batch.addValidity(numRows, numRows, allPresent);
+            batch.addVariableLength
+                (numRows,
+                 [&] (size_t row, std::string & data)
+                 {
+                     data += rows[row].rowHash.toString();
+                 });
+        }
+
+        for (size_t i = 0;  i < columns.size();  ++i)
+            addColumn(batch, columns[i].type, numRows, entries[i]);
+
+        rows.clear();
+        return send(batch.encode(numRows));
+    }
+};
+
+ArrowStreamEncoder::
+ArrowStreamEncoder(bool rowNames,
+                   bool rowHashes,
+                   bool sortColumns,
+                   std::function<bool (std::string)> onMessage)
+    : itl(new Itl(rowNames, rowHashes, sortColumns, std::move(onMessage)))
+{
+}
+
+ArrowStreamEncoder::
+~ArrowStreamEncoder()
+{
+}
+
+void
+ArrowStreamEncoder::
+setInfo(std::shared_ptr<const ExpressionValueInfo> info)
+{
+    itl->info = std::move(info);
+}
+
+bool
+ArrowStreamEncoder::
+add(MatrixNamedRow row)
+{
+    if (itl->stopped)
+        return false;
+
+    itl->rows.emplace_back(std::move(row));
+    if (itl->rows.size() < ARROW_BATCH_ROWS)
+        return true;
+
+    if (!itl->schemaSent && !itl->sendSchema(true /* moreToCome */))
+        return false;
+    return itl->sendBatch();
+}
+
+bool
+ArrowStreamEncoder::
+finish()
+{
+    if (itl->stopped)
+        return false;
+    if (!itl->schemaSent && !itl->sendSchema(false /* moreToCome */))
+        return false;
+    if (!itl->rows.empty() && !itl->sendBatch())
+        return false;
+
+    // End of stream marker: a continuation with a zero length
+    static const char endOfStream[8] = { '\xff', '\xff', '\xff', '\xff', 0, 0, 0, 0 };
+    return itl->send(std::string(endOfStream, 8));
+}
+
+bool
+ArrowStreamEncoder::
+started() const
+{
+    return itl->schemaSent;
+}
+
+
+/*****************************************************************************/
+/* ARROW IPC                                                                 */
+/*****************************************************************************/
+
+bool encodeArrowStream(const std::vector<MatrixNamedRow> & rows,
+                       const ExpressionValueInfo * info,
+                       bool rowNames,
+                       bool rowHashes,
+                       bool sortColumns,
+                       const std::function<bool (std::string)> & onMessage)
+{
+    ArrowStreamEncoder encoder(rowNames, rowHashes, sortColumns, onMessage);
+    // Not owned; the info outlives the encoder
+    encoder.setInfo(std::shared_ptr<const ExpressionValueInfo>
+                    (std::shared_ptr<void>(), info));
+    for (auto & row: rows) {
+        if (!encoder.add(row))
+            return false;
+    }
+    return encoder.finish();
+}
+
+} // namespace MLDB
@@ -0,0 +1,97 @@
+/** arrow_ipc.h                                                    -*- C++ -*-
+    Encoding of query output as an Apache Arrow IPC stream.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include "mldb/sql/expression_value.h"
+#include <functional>
+#include <memory>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ARROW IPC                                                                 */
+/*****************************************************************************/
+
+/// Maximum number of rows in each record batch of an Arrow stream
+constexpr size_t ARROW_BATCH_ROWS = 65536;
+
+/** Encodes query output as an Apache Arrow IPC stream (the "streaming
+    format", version 5 metadata) as the rows are produced, so that the
+    output is never held in memory.  There is one column per column of
+    the output, preceded by _rowName and _rowHash string columns if
+    rowNames and rowHashes are set.  Columns are in the order in which
+    they first appear, or sorted if sortColumns is set.
+
+    Each column's type is worked out from the values it contains:
+    integers become int64 (or uint64 if they don't fit), numbers float64,
+    timestamps UTC timestamps in microseconds, blobs binary and anything
+    else (including columns that mix several types) utf8 strings.  The
+    info, if known, is used to make boolean columns into Arrow booleans,
+    integer columns of numeric expressions into float64 and to give a
+    type to columns with only nulls.  Where a column has several values
+    in a row, the latest one is used.
+
+    Rows are encoded a record batch of ARROW_BATCH_ROWS rows at a time.
+    The schema has to be sent before the first batch, and so is worked
+    out from the first batch only.  If there are more rows, the schema
+    also has the columns of the info, and columns with only nulls so far
+    are utf8; a later row with a column that isn't in the schema or a
+    value that doesn't fit its column's type (for example a float in an
+    integer column) is an error, which can be avoided with a CAST in the
+    query.
+
+    onMessage is called with each message of the stream in turn: the
+    schema, the record batches and the end-of-stream marker.
+    Concatenated, they are the stream.  Encoding stops if onMessage
+    returns false.
+*/
+struct ArrowStreamEncoder {
+    ArrowStreamEncoder(bool rowNames,
+                       bool rowHashes,
+                       bool sortColumns,
+                       std::function<bool (std::string)> onMessage);
+
+    ~ArrowStreamEncoder();
+
+    /** Set what is known about the output rows.  Only has an effect
+        before the schema is sent.
+    */
+    void setInfo(std::shared_ptr<const ExpressionValueInfo> info);
+
+    /** Add the next row of output.  Returns false if onMessage returned
+        false, in which case there is no point in adding any more.
+    */
+    bool add(MatrixNamedRow row);
+
+    /** Encode what is left of the output and the end of the stream.
+        Returns false if onMessage returned false.
+    */
+    bool finish();
+
+    /** Has the schema (and so the start of the stream) been sent? */
+    bool started() const;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+/** Encode the given query output as an Apache Arrow IPC stream, as
+    described for ArrowStreamEncoder.  Returns false if onMessage
+    returned false.
+*/
+bool encodeArrowStream(const std::vector<MatrixNamedRow> & rows,
+                       const ExpressionValueInfo * info,
+                       bool rowNames,
+                       bool rowHashes,
+                       bool sortColumns,
+                       const std::function<bool (std::string)> & onMessage);
+
+} // namespace MLDB
@@ -9,6 +9,8 @@
 #include "mldb/engine/bound_queries.h"
 #include "mldb/core/dataset.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/engine/query_spill.h"
+#include "mldb/base/scratch_arena.h"
 #include "mldb/base/parallel.h"
 #include "mldb/base/per_thread_accumulator.h"
 #include "mldb/base/parallel_merge_sort.h"
@@ -38,6 +40,15 @@ namespace MLDB {
 
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
+const int GROUP_BY_PARTITIONS = 64;
+const int TOP_K_MAX_ROWS = 10000;
+const int SEQUENTIAL_BLOCK_ROWS = 8192;
+const int SELECT_BATCH_ROWS = 64;
+const size_t MAX_SPILL_MERGE_RUNS = 64;  // files open at once in a merge
+const size_t GROUP_BY_SPILL_FANOUT = 16;  // files a spilled partition splits into
+const int MAX_GROUP_BY_SPILL_DEPTH = 8;
+const size_t GROUP_BY_FINALIZE_BATCH = 1024;  // groups finalized at once without ORDER BY
+const size_t MAX_CODED_KEYS = 64;  // group by clauses that can use codes
 
 __thread int QueryThreadTracker::depth = 0;
 
@@ -107,6 +118,22 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
     int numBuckets;
     std::shared_ptr<spdlog::logger> logger;
 
+    /// Which of boundCalc can take a code read from the row stream
+    /// instead of being evaluated, with their columns and dictionaries
+    std::vector<int> codedCalc;
+    std::vector<ColumnPath> codedColumns;
+    std::vector<const ColumnDictionary *> codedDictionaries;
+    std::vector<std::shared_ptr<const ColumnDictionary> > dictionaries;
+
+    /// Does calcd have an extra last element with the bitmap of codes?
+    bool hasCodedBitmap;
+
+    /// Codes of codedColumns read for a block of rows, row by row
+    struct BlockCodes {
+        std::vector<uint32_t> codes;
+        std::vector<Date> timestamps;
+    };
+
 
     typedef std::function<bool (NamedRowValue & output,
                                              std::vector<ExpressionValue> & calcd,
@@ -120,7 +147,9 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                       std::vector<BoundSqlExpression> boundCalc,
                       OrderByExpression newOrderBy,
                       int numBuckets,
-                      std::shared_ptr<spdlog::logger> logger)
+                      std::shared_ptr<spdlog::logger> logger,
+                      std::vector<BoundSelectQuery::CalcDictionary>
+                          calcDictionaries)
         : dataset(dataset),
           whereGenerator(std::move(whereGenerator)),
           context(context),
@@ -130,6 +159,17 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
           numBuckets(numBuckets),
           logger(logger)
     {
+        for (size_t i = 0;  i < calcDictionaries.size();  ++i) {
+            auto & d = calcDictionaries[i];
+            if (!d.dictionary)
+                continue;
+            ExcAssertLess(i, MAX_CODED_KEYS);
+            codedCalc.push_back(i);
+            codedColumns.push_back(d.column);
+            codedDictionaries.push_back(d.dictionary.get());
+            dictionaries.push_back(d.dictionary);
+        }
+        hasCodedBitmap = !calcDictionaries.empty();
     }
 
     virtual bool executeExpr(std::function<bool (Path & rowName,
@@ -188,6 +228,10 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         ProgressState progress(numRows);
         auto doRow = [&] (size_t rowNum) -> bool
             {
+                // Values built while processing the row come from the
+                // thread's scratch arena
+                ScratchArenaScope arenaScope;
+
                 ++rowCount;
 
                 if (rowCount % PROGRESS_RATE == 0) {
@@ -219,14 +263,45 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
             ExcAssertEqual(limit, -1);
             ExcAssertEqual(offset, 0);
 
+            // Within a bucket, the rows are processed a block at a time so
+            // that the select can be run over the whole block at once
+            auto doBlock = [&] (size_t blockStart, size_t n,
+                                int bucketNumber) -> bool
+                {
+                    ScratchArenaScope arenaScope;
+
+                    size_t before = rowCount.fetch_add(n);
+                    if (onProgress
+                        && (before + n) / PROGRESS_RATE != before / PROGRESS_RATE) {
+                        progress = before + n;
+                        if (!onProgress(progress)) {
+                            DEBUG_MSG(logger) << "dataset iteration was cancelled";
+                            return false;
+                        }
+                    }
+
+                    auto onOutput = [&] (OutputRow & outputRow)
+                        {
+                            return processor(std::get<0>(outputRow),
+                                             std::get<1>(outputRow),
+                                             std::get<2>(outputRow),
+                                             bucketNumber);
+                        };
+
+                    return processRowBlock(&rows[blockStart], n, selectStar,
+                                           onOutput);
+                };
+
             auto doBucket = [&] (int bucketNumber) -> bool
                 {
                     size_t it = bucketNumber * numPerBucket;
-                    int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
-                    for (; it < stopIt; ++it)
-                    {
-                        if (!doRow(it))
+                    size_t stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
+                    while (it < stopIt) {
+                        size_t n = std::min<size_t>(stopIt - it,
+                                                    SELECT_BATCH_ROWS);
+                        if (!doBlock(it, n, bucketNumber))
                             return false;
+                        it += n;
                     }
 
                     return true;
@@ -246,15 +321,18 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     return parallelMapHaltable(offset, upper, doRow);
                 }
                 else {
-                    // TODO: to reduce memory usage, we should fill blocks of
-                    // output on worker threads
-                    // in order as much as possible
-                    // while calling the aggregator on the caller thread.
+                    // Fill blocks of output on worker threads, and pass
+                    // each block in order to the processor on this thread
+                    // before starting the next one.  That way only one
+                    // block of output is held in memory, and the processor
+                    // sees the first rows without waiting for the rest.
                     ExcAssert(offset >= 0 && offset <= upper);
                     std::vector<std::tuple<Path, ExpressionValue, std::vector<ExpressionValue> > >
-                        output(upper-offset);
+                        output(std::min<size_t>(upper - offset,
+                                                SEQUENTIAL_BLOCK_ROWS));
                 
                     ProgressState progress(upper-offset);
+                    size_t blockStart = offset;
                     auto copyRow = [&] (int rowNum) -> bool
                         {
                             if (rowNum % PROGRESS_RATE == 0) {
@@ -269,19 +347,26 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                             auto row = dataset.getRowExpr(rows[rowNum]);
                             auto outputRow = processRow(rows[rowNum], row, rowNum,
                                                         numPerBucket, selectStar);
-                            output[rowNum-offset] = std::move(outputRow);
+                            output[rowNum - blockStart] = std::move(outputRow);
                             return true;
                         };
 
                     DEBUG_MSG(logger) << "iterating rows sequentially";
-                    if (!parallelMapHaltable(offset, upper, copyRow))
-                        return false;
-
-                    for (size_t i = offset; i < upper; ++i) {
-                        auto& outputRow = output[i-offset];
-                        if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
-                                       std::get<2>(outputRow), -1))
+                    for (; blockStart < upper;
+                         blockStart += SEQUENTIAL_BLOCK_ROWS) {
+                        size_t blockEnd
+                            = std::min<size_t>(upper,
+                                               blockStart + SEQUENTIAL_BLOCK_ROWS);
+                        if (!parallelMapHaltable(blockStart, blockEnd, copyRow))
                             return false;
+
+                        for (size_t i = blockStart; i < blockEnd; ++i) {
+                            auto& outputRow = output[i - blockStart];
+                            if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
+                                           std::get<2>(outputRow), -1))
+                                return false;
+                            outputRow = {};
+                        }
                     }
                 }
             }
@@ -330,23 +415,59 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         ProgressState progress(effectiveNumBucket);
         auto doBucket = [&] (int bucketNumber) -> bool
             {
+                ScratchArenaScope arenaScope;
+
                 size_t it = bucketNumber * numPerBucket;
-                int stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
+                size_t stopIt = bucketNumber == numBuckets - 1 ? numRows : it + numPerBucket;
                 auto stream = whereGenerator.rowStream->clone();
                 stream->initAt(it);
-                for (;  it < stopIt; ++it) {
-                    RowPath rowName = stream->next();
-                    auto row = dataset.getRowExpr(rowName);
+                std::vector<RowPath> rowNames;
+
+                // The codes are read alongside the row names, from a
+                // second stream over the same rows
+                std::shared_ptr<RowStream> codesStream;
+                BlockCodes blockCodes;
+                if (!codedCalc.empty()
+                    && whereGenerator.rowStream->supportsExtendedInterface()) {
+                    codesStream = whereGenerator.rowStream->clone();
+                    codesStream->initAt(it);
+                }
+
+                while (it < stopIt) {
+                    size_t n = std::min<size_t>(stopIt - it, SELECT_BATCH_ROWS);
+                    rowNames.clear();
+                    for (size_t i = 0;  i < n;  ++i)
+                        rowNames.emplace_back(stream->next());
+
+                    const BlockCodes * codes = nullptr;
+                    if (codesStream) {
+                        blockCodes.codes.resize(n * codedCalc.size());
+                        blockCodes.timestamps.resize(n * codedCalc.size());
+                        if (codesStream->extractCodes
+                            (n, codedColumns, codedDictionaries,
+                             blockCodes.codes.data(),
+                             blockCodes.timestamps.data()))
+                            codes = &blockCodes;
+                        else codesStream.reset();
+                    }
 
-                    auto output = processRow(rowName, row, it, numPerBucket, selectStar);
                     int bucketNumber
                         = numBuckets > 0 ? std::min((size_t)(it/numPerBucket),
                                                     (size_t)(numBuckets-1)) : -1;
 
                     /* Finally, pass to the terminator to continue. */
-                    if (!processor(std::get<0>(output), std::get<1>(output),
-                                   std::get<2>(output), bucketNumber))
+                    auto onOutput = [&] (OutputRow & outputRow)
+                        {
+                            return processor(std::get<0>(outputRow),
+                                             std::get<1>(outputRow),
+                                             std::get<2>(outputRow),
+                                             bucketNumber);
+                        };
+
+                    if (!processRowBlock(rowNames.data(), n, selectStar,
+                                         onOutput, codes))
                         return false;
+                    it += n;
                 }
                 if (onProgress) {
                     progress = ++bucketCount;
@@ -359,12 +480,48 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         return parallelMapHaltable(0, effectiveNumBucket, doBucket);
     }
 
+    /** Run the extra calculations for a row.  Those of codedCalc that
+        have a code for the row, which is row rowInBlock of codes, take
+        the code instead of being evaluated.
+    */
+    void calculate(const SqlRowScope & rowScope,
+                   std::vector<ExpressionValue> & calcd,
+                   const BlockCodes * codes,
+                   size_t rowInBlock)
+    {
+        calcd.resize(boundCalc.size() + hasCodedBitmap);
+
+        uint64_t coded = 0;
+        if (codes) {
+            for (size_t i = 0;  i < codedCalc.size();  ++i) {
+                size_t pos = rowInBlock * codedCalc.size() + i;
+                uint32_t code = codes->codes[pos];
+                if (code == ColumnDictionary::NO_CODE)
+                    continue;
+                calcd[codedCalc[i]]
+                    = ExpressionValue(code, codes->timestamps[pos]);
+                coded |= uint64_t(1) << codedCalc[i];
+            }
+        }
+
+        for (unsigned i = 0;  i < boundCalc.size();  ++i) {
+            if (i < MAX_CODED_KEYS && (coded & (uint64_t(1) << i)))
+                continue;
+            calcd[i] = boundCalc[i](rowScope, GET_LATEST);
+        }
+
+        if (hasCodedBitmap)
+            calcd.back() = ExpressionValue(coded, Date::notADate());
+    }
+
     std::tuple<RowPath, ExpressionValue, std::vector<ExpressionValue> >
     processRow(const RowPath & rowName,
                ExpressionValue & row,
                int rowNum,
                int numPerBucket,
-               bool selectStar)
+               bool selectStar,
+               const BlockCodes * codes = nullptr,
+               size_t rowInBlock = 0)
     {
         auto rowContext = context.getRowScope(rowName, row);
 
@@ -376,14 +533,9 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
 
         auto selectRowScope = context.getRowScope(rowName, row);
 
-        vector<ExpressionValue>& calcd = std::get<2>(output);
-        calcd.resize(boundCalc.size());
-
         // Run the extra calculations before the select, as the select may
         // destroy the input if it's a select star.
-        for (unsigned i = 0;  i < boundCalc.size();  ++i) {
-            calcd[i] = boundCalc[i](selectRowScope, GET_LATEST);
-        }
+        calculate(selectRowScope, std::get<2>(output), codes, rowInBlock);
 
         if (selectStar) {
             // Move into place, since we know we're selecting *
@@ -397,12 +549,106 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
         return output;
     }
 
+    typedef std::tuple<RowPath, ExpressionValue, std::vector<ExpressionValue> >
+        OutputRow;
+
+    /** Process a block of consecutive rows, passing each output row in
+        turn to onOutput and stopping (returning false) as soon as it
+        returns false.  This does the same as calling processRow on each
+        of them, except that the select expression is run over the whole
+        block at once, which allows functions that support it to apply
+        themselves to the block as a batch.  If a row fails, the rows
+        before it are output first and then its error is thrown, exactly
+        as it would have been row by row; no row is evaluated twice.
+        If codes isn't null, it holds the codes of the rows for
+        codedCalc.
+    */
+    template<typename OnOutput>
+    bool processRowBlock(const RowPath * rowNames, size_t n, bool selectStar,
+                         OnOutput && onOutput,
+                         const BlockCodes * codes = nullptr)
+    {
+        std::vector<ExpressionValue> rows(n);
+        for (size_t i = 0;  i < n;  ++i)
+            rows[i] = dataset.getRowExpr(rowNames[i]);
+
+        if (selectStar || !boundSelect.batchExec) {
+            for (size_t i = 0;  i < n;  ++i) {
+                auto output = processRow(rowNames[i], rows[i],
+                                         -1 /* rowNum */,
+                                         -1 /* numPerBucket */, selectStar,
+                                         codes, i);
+                if (!onOutput(output))
+                    return false;
+            }
+            return true;
+        }
+
+        std::vector<OutputRow> output(n);
+
+        // The scopes point into rows, which doesn't move from here on
+        std::vector<SqlExpressionDatasetScope::RowScope> scopes;
+        scopes.reserve(n);
+        std::vector<const SqlRowScope *> scopePtrs;
+        scopePtrs.reserve(n);
+
+        // Only the rows before one whose extra calculations fail go
+        // into the batch; its error is thrown once they are output
+        std::exception_ptr calcError;
+        for (size_t i = 0;  i < n && !calcError;  ++i) {
+            scopes.emplace_back(context.getRowScope(rowNames[i], rows[i]));
+            try {
+                whenBound.filterInPlace(rows[i], scopes[i]);
+
+                std::get<0>(output[i]) = rowNames[i];
+                calculate(scopes[i], std::get<2>(output[i]), codes, i);
+                scopePtrs.push_back(&scopes[i]);
+            } catch (...) {
+                calcError = std::current_exception();
+            }
+        }
+
+        ExpressionBatch selected;
+        selected.evaluate(boundSelect, scopePtrs, GET_ALL);
+
+        for (size_t i = 0;  i < selected.size();  ++i) {
+            std::get<1>(output[i]) = selected.take(i);
+            if (!onOutput(output[i]))
+                return false;
+        }
+
+        if (calcError)
+            std::rethrow_exception(calcError);
+
+        return true;
+    }
+
     virtual std::shared_ptr<ExpressionValueInfo> getOutputInfo() const
     {
         return boundSelect.info;
     }
 };
 
+/** Order by scope that records which columns the ORDER BY reads, so
+    that we can tell whether it depends upon the output of the SELECT.
+*/
+struct RecordingOrderByScope: public SqlExpressionOrderByScope {
+
+    RecordingOrderByScope(SqlBindingScope & outer)
+        : SqlExpressionOrderByScope(outer)
+    {
+    }
+
+    virtual ColumnGetter doGetColumn(const Utf8String & tableName,
+                                     const ColumnPath & columnName)
+    {
+        columnsRead.push_back(columnName);
+        return SqlExpressionOrderByScope::doGetColumn(tableName, columnName);
+    }
+
+    std::vector<ColumnPath> columnsRead;
+};
+
 struct OrderedExecutor: public BoundSelectQuery::Executor {
 
     const Dataset & dataset;
@@ -452,10 +698,19 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         // cerr << "doing " << rows.size() << " rows with order by" << endl;
         // We have a defined order, so we need to sort here
 
-        SqlExpressionOrderByScope orderByContext(context);
+        RecordingOrderByScope orderByContext(context);
 
         auto boundOrderBy = newOrderBy.bindAll(orderByContext);
 
+        // With a small limit we only need to keep the best rows
+        if (limit != -1 && numDistinctOnClauses_ == 0
+            && offset + limit <= TOP_K_MAX_ROWS) {
+            bool deferSelect = !orderByReadsOutput(orderByContext.columnsRead);
+            return executeTopK(processor, rows, boundOrderBy,
+                               orderByContext, deferSelect,
+                               offset, limit, onProgress);
+        }
+
         // Two phases:
         // 1.  Generate rows that match the where expression, in the correct order
         // 2.  Select over those rows to get our result
@@ -471,6 +726,41 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         std::atomic<int64_t> rowsAdded(0);
         ProgressState progress(rows.size());
 
+        // Compare two rows according to the sort criteria
+        auto compareRows = [&] (const SortedRow & row1,
+                                const SortedRow & row2) -> bool
+            {
+                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
+            };
+
+        // Once the rows held in memory go over the query's memory budget,
+        // each thread sorts what it holds and writes it out as a run,
+        // which is merged back in when the output is produced.
+        QueryMemoryBudget budget;
+        PerThreadAccumulator<size_t> accumBytes;
+        std::mutex runsLock;
+        std::vector<std::shared_ptr<SpillFile> > runs;
+
+        auto spillRun = [&] (SortedRows & sortedRows, size_t & bytes)
+            {
+                std::sort(sortedRows.begin(), sortedRows.end(), compareRows);
+
+                auto run = std::make_shared<SpillFile>();
+                for (auto & r: sortedRows) {
+                    run->write(std::get<0>(r));
+                    run->write(std::get<1>(r));
+                    run->write(std::get<2>(r));
+                }
+                run->finishWriting();
+
+                SortedRows().swap(sortedRows);
+                budget.release(bytes);
+                bytes = 0;
+
+                std::unique_lock<std::mutex> guard(runsLock);
+                runs.emplace_back(std::move(run));
+            };
+
         auto doWhere = [&] (int rowNum) -> bool
             {
                 QueryThreadTracker childTracker = parentTracker.child();
@@ -522,6 +812,18 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
                                          std::move(outputRow),
                                          std::move(calcd));
 
+                if (budget.limited()) {
+                    const SortedRow & added = sortedRows->back();
+                    size_t rowBytes
+                        = approximateMemusage(std::get<0>(added))
+                        + approximateMemusage(std::get<1>(added))
+                        + approximateMemusage(std::get<2>(added));
+                    size_t & bytes = accumBytes.get();
+                    bytes += rowBytes;
+                    if (budget.add(rowBytes))
+                        spillRun(*sortedRows, bytes);
+                }
+
                 ++rowsAdded;
                 return true;
             };
@@ -535,87 +837,349 @@ struct OrderedExecutor: public BoundSelectQuery::Executor {
         //cerr << "map took " << timer.elapsed() << endl;
         timer.restart();
         
-        // Compare two rows according to the sort criteria
-        auto compareRows = [&] (const SortedRow & row1,
-                                const SortedRow & row2) -> bool
-            {
-                return boundOrderBy.less(std::get<0>(row1), std::get<0>(row2));
-            };
-            
         auto rowsSorted = parallelMergeSort(accum.threads, compareRows);
 
         //cerr << "shuffle took " << timer.elapsed() << endl;
         timer.restart(); 
 
-        // Now select only the required subset of sorted rows
-        if (limit == -1)
-            limit = rowsSorted.size();
-
         ExcAssertGreaterEqual(offset, 0);
 
-        if (numDistinctOnClauses_ > 0) {
-
-            std::vector<ExpressionValue> reference;
-            reference.resize(numDistinctOnClauses_);
-            ssize_t count = 0;
+        // Now select only the required subset of sorted rows
+        std::vector<ExpressionValue> reference;
+        reference.resize(numDistinctOnClauses_);
+        ssize_t count = 0;
+        size_t rowNum = 0;
+        bool processorOk = true;
 
-            for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
+        auto onSortedRow = [&] (SortedRow & sortedRow) -> bool
+            {
+                size_t i = rowNum++;
 
-                std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+                if (numDistinctOnClauses_ > 0) {
+                    std::vector<ExpressionValue> & mark = std::get<0>(sortedRow);
 
-                if (i == 0) {
-                    std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
-                }
-                else {
+                    if (i == 0) {
+                        std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
+                    }
+                    else {
 
-                    bool same = true;
-                    for (int i = 0; i < numDistinctOnClauses_; ++i){
-                        if (reference[i] != mark[i]) {
-                            same = false;
-                            break;
+                        bool same = true;
+                        for (int i = 0; i < numDistinctOnClauses_; ++i){
+                            if (reference[i] != mark[i]) {
+                                same = false;
+                                break;
+                            }
                         }
-                    }
 
-                    if (!same)
-                        std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
-                    else
-                        continue; //skip duplicates
+                        if (!same)
+                            std::copy_n(mark.begin(), numDistinctOnClauses_, reference.begin());
+                        else
+                            return true; //skip duplicates
+                    }
                 }
 
                 ++count;
 
                 if (count <= offset)
-                    continue;
+                    return true;
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+                if (limit != -1 && count - offset > limit)
+                    return false;
+
+                auto & row = std::get<1>(sortedRow);
+                auto & calcd = std::get<2>(sortedRow);
 
                 /* Finally, pass to the terminator to continue. */
-                if (!processor(row, calcd, i))
+                if (!processor(row, calcd, i)) {
+                    processorOk = false;
                     return false;
+                }
 
-                if (count - offset == limit)
-                    break;
+                return limit == -1 || count - offset < limit;
+            };
+
+        // k-way merge of the given runs and, if inMemory isn't null, the
+        // rows that stayed in memory.  Each run is opened for the merge
+        // and removed once it has been read.
+        auto mergeRuns = [&] (std::vector<std::shared_ptr<SpillFile> > sources,
+                              SortedRows * inMemory,
+                              const std::function<bool (SortedRow &)> & onRow)
+            {
+                // Source sources.size() is the in-memory rows
+                size_t memSrc = sources.size();
+                size_t memPos = 0;
+                std::vector<SortedRow> heads(sources.size());
+
+                auto readHead = [&] (size_t src) -> bool
+                    {
+                        if (!sources[src]->hasMore()) {
+                            sources[src].reset();
+                            return false;
+                        }
+                        sources[src]->read(std::get<0>(heads[src]));
+                        sources[src]->read(std::get<1>(heads[src]));
+                        sources[src]->read(std::get<2>(heads[src]));
+                        return true;
+                    };
+
+                auto headOf = [&] (size_t src) -> SortedRow &
+                    {
+                        return src == memSrc ? (*inMemory)[memPos] : heads[src];
+                    };
+
+                // Min-heap on the head row of each source
+                auto compareSources = [&] (size_t src1, size_t src2)
+                    {
+                        return compareRows(headOf(src2), headOf(src1));
+                    };
+
+                std::vector<size_t> heap;
+                for (size_t src = 0;  src < sources.size();  ++src) {
+                    sources[src]->startReading();
+                    if (readHead(src))
+                        heap.push_back(src);
+                }
+                if (inMemory && !inMemory->empty())
+                    heap.push_back(memSrc);
+                std::make_heap(heap.begin(), heap.end(), compareSources);
+
+                while (!heap.empty()) {
+                    std::pop_heap(heap.begin(), heap.end(), compareSources);
+                    size_t src = heap.back();
+                    SortedRow sortedRow = std::move(headOf(src));
+
+                    bool more = src == memSrc
+                        ? ++memPos < inMemory->size()
+                        : readHead(src);
+                    if (more)
+                        std::push_heap(heap.begin(), heap.end(), compareSources);
+                    else heap.pop_back();
+
+                    if (!onRow(sortedRow))
+                        break;
+                }
+            };
+
+        // Every run that is merged at once holds a file open, so with
+        // many runs they are merged into longer runs in several passes
+        // first.
+        while (runs.size() > MAX_SPILL_MERGE_RUNS) {
+            std::vector<std::shared_ptr<SpillFile> > merged;
+            for (size_t i = 0;  i < runs.size();  i += MAX_SPILL_MERGE_RUNS) {
+                size_t end = std::min(runs.size(), i + MAX_SPILL_MERGE_RUNS);
+                std::vector<std::shared_ptr<SpillFile> >
+                    sources(runs.begin() + i, runs.begin() + end);
+                std::fill(runs.begin() + i, runs.begin() + end, nullptr);
+                if (sources.size() == 1) {
+                    merged.emplace_back(std::move(sources[0]));
+                    continue;
+                }
+
+                auto run = std::make_shared<SpillFile>();
+                auto writeRow = [&] (SortedRow & sortedRow)
+                    {
+                        run->write(std::get<0>(sortedRow));
+                        run->write(std::get<1>(sortedRow));
+                        run->write(std::get<2>(sortedRow));
+                        return true;
+                    };
+                mergeRuns(std::move(sources), nullptr, writeRow);
+                run->finishWriting();
+                merged.emplace_back(std::move(run));
             }
+            runs.swap(merged);
+        }
 
+        if (runs.empty()) {
+            for (auto & sortedRow: rowsSorted) {
+                if (!onSortedRow(sortedRow))
+                    break;
+            }
         }
-        else {
-            ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-            ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
-            for (unsigned i = begin;  i < end;  ++i) {
+        else mergeRuns(std::move(runs), &rowsSorted, onSortedRow);
 
-                auto & row = std::get<1>(rowsSorted[i]);
-                auto & calcd = std::get<2>(rowsSorted[i]);
+        if (!processorOk)
+            return false;
 
-                /* Finally, pass to the terminator to continue. */
-                if (!processor(row, calcd, i))
-                    return false;
+        cerr << "reduce took " << timer.elapsed() << endl;
+
+        return true;
+    }
+
+    /** Can the ORDER BY, which read the given columns, see the output
+        of the SELECT?  If not, it only depends upon the input row and
+        the SELECT doesn't need to be evaluated to sort.
+    */
+    bool orderByReadsOutput(const std::vector<ColumnPath> & columnsRead) const
+    {
+        if (columnsRead.empty() || boundSelect.expr->isIdentitySelect(context))
+            return false;
+
+        auto & info = *boundSelect.info;
+        if (info.getSchemaCompleteness() != SCHEMA_CLOSED)
+            return true;
+
+        // The order by scope looks up the first element of the column
+        // name in the output first
+        for (auto & known: info.getKnownColumns()) {
+            if (known.columnName.empty())
+                return true;
+            for (auto & c: columnsRead) {
+                if (c.empty() || known.columnName.front() == c.front())
+                    return true;
             }
         }
 
-     
+        return false;
+    }
 
-        cerr << "reduce took " << timer.elapsed() << endl;
+    /** Execute an ORDER BY with a small LIMIT by keeping the best
+        offset + limit rows seen by each thread in a bounded heap, and
+        merging the heaps at the end.  When deferSelect is true, the
+        SELECT and calculated expressions are only evaluated for the rows
+        that are output.
+
+        Rows that sort equally are ordered by their position in rows,
+        which is what a single threaded sort of few rows gives.
+    */
+    bool executeTopK(std::function<bool (NamedRowValue & output,
+                                         std::vector<ExpressionValue> & calcd,
+                                         int rowNum)> processor,
+                     const std::vector<RowPath> & rows,
+                     const BoundOrderByExpression & boundOrderBy,
+                     SqlExpressionOrderByScope & orderByContext,
+                     bool deferSelect,
+                     ssize_t offset,
+                     ssize_t limit,
+                     const ProgressFunc & onProgress)
+    {
+        QueryThreadTracker parentTracker;
+
+        ExcAssertGreaterEqual(offset, 0);
+        size_t numNeeded = offset + limit;
+        if (numNeeded == 0 || limit == 0)
+            return true;
+
+        struct TopKRow {
+            std::vector<ExpressionValue> sortFields;
+            size_t rowNum;
+            NamedRowValue output;   ///< Empty until selected if deferSelect
+            std::vector<ExpressionValue> calcd;
+        };
+
+        auto compareRows = [&] (const TopKRow & row1,
+                                const TopKRow & row2) -> bool
+            {
+                int cmp = boundOrderBy.compare(row1.sortFields, row2.sortFields);
+                if (cmp != 0)
+                    return cmp < 0;
+                return row1.rowNum < row2.rowNum;
+            };
+
+        // Each thread keeps a max-heap of its best rows; the front is
+        // the worst of them, which is the one to replace.
+        typedef std::vector<TopKRow> TopKHeap;
+        PerThreadAccumulator<TopKHeap> accum;
+
+        std::atomic<int64_t> rowsAdded(0);
+        ProgressState progress(rows.size());
+
+        auto doSelect = [&] (const SqlRowScope & selectRowScope,
+                             TopKRow & result)
+            {
+                ExpressionValue selectOutput
+                    = boundSelect(selectRowScope, GET_ALL);
+                selectOutput.mergeToRowDestructive(result.output.columns);
+
+                result.calcd.resize(boundCalc.size());
+                for (unsigned i = 0;  i < boundCalc.size();  ++i) {
+                    result.calcd[i] = boundCalc[i](selectRowScope, GET_LATEST);
+                }
+            };
+
+        auto doWhere = [&] (int rowNum) -> bool
+            {
+                QueryThreadTracker childTracker = parentTracker.child();
+
+                auto row = dataset.getRowExpr(rows[rowNum]);
+
+                if (onProgress && rowsAdded % PROGRESS_RATE == 0) {
+                    progress = rowsAdded;
+                    if (!onProgress(progress))
+                        return false;
+                }
+
+                auto rowContext = context.getRowScope(rows[rowNum], row);
+
+                whenBound.filterInPlace(row, rowContext);
+
+                TopKRow result;
+                result.rowNum = rowNum;
+                result.output.rowName = rows[rowNum];
+                result.output.rowHash = rows[rowNum];
+
+                if (!deferSelect) {
+                    auto selectRowScope = context.getRowScope(rows[rowNum], row);
+                    doSelect(selectRowScope, result);
+                }
+
+                auto orderByRowScope
+                    = orderByContext.getRowScope(rowContext, result.output);
+                result.sortFields = boundOrderBy.apply(orderByRowScope);
+
+                TopKHeap & heap = accum.get();
+                if (heap.size() < numNeeded) {
+                    heap.emplace_back(std::move(result));
+                    std::push_heap(heap.begin(), heap.end(), compareRows);
+                }
+                else if (compareRows(result, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), compareRows);
+                    heap.back() = std::move(result);
+                    std::push_heap(heap.begin(), heap.end(), compareRows);
+                }
+
+                ++rowsAdded;
+                return true;
+            };
+
+        if (!parallelMapHaltable(0, rows.size(), doWhere)) {
+            return false;  // the processing has been cancelled
+        }
+
+        TopKHeap best;
+        for (auto & heap: accum.threads) {
+            best.insert(best.end(),
+                        std::make_move_iterator(heap->begin()),
+                        std::make_move_iterator(heap->end()));
+        }
+
+        std::sort(best.begin(), best.end(), compareRows);
+        if (best.size() > numNeeded)
+            best.resize(numNeeded);
+
+        if (deferSelect) {
+            auto selectRow = [&] (size_t i)
+                {
+                    QueryThreadTracker childTracker = parentTracker.child();
+
+                    TopKRow & result = best[i];
+                    const RowPath & rowName = rows[result.rowNum];
+                    auto row = dataset.getRowExpr(rowName);
+                    auto rowContext = context.getRowScope(rowName, row);
+                    whenBound.filterInPlace(row, rowContext);
+                    auto selectRowScope = context.getRowScope(rowName, row);
+                    doSelect(selectRowScope, result);
+                };
+
+            if (offset < best.size())
+                parallelMap(offset, best.size(), selectRow);
+        }
+
+        for (size_t i = offset;  i < best.size();  ++i) {
+            /* Finally, pass to the terminator to continue. */
+            if (!processor(best[i].output, best[i].calcd, i))
+                return false;
+        }
 
         return true;
     }
@@ -1088,7 +1652,8 @@ BoundSelectQuery(const SelectExpression & select,
                  const SqlExpression & where,
                  const OrderByExpression & orderBy,
                  std::vector<std::shared_ptr<SqlExpression> > calc,
-                 int numBuckets)
+                 int numBuckets,
+                 std::vector<CalcDictionary> calcDictionaries)
     : select(select), from(from), when(when), where(where), calc(calc),
       orderBy(orderBy), context(new SqlExpressionDatasetScope(from, std::move(alias))),
       logger(getMldbLog<BoundSelectQuery>())
@@ -1143,6 +1708,7 @@ BoundSelectQuery(const SelectExpression & select,
  
         if (orderByRowHash) {
             ExcAssert(numBuckets < 0);
+            ExcAssert(calcDictionaries.empty());
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(RowHashOrderedExecutor));
             executor.reset(new RowHashOrderedExecutor(from,
                                                       std::move(whereGenerator),
@@ -1156,6 +1722,7 @@ BoundSelectQuery(const SelectExpression & select,
         }
         else if (!newOrderBy.clauses.empty()) {
             ExcAssert(numBuckets < 0);
+            ExcAssert(calcDictionaries.empty());
             DEBUG_MSG(logger) << "executing with " << demangle(typeid(OrderedExecutor));
             executor.reset(new OrderedExecutor(from,
                                                std::move(whereGenerator),
@@ -1175,7 +1742,8 @@ BoundSelectQuery(const SelectExpression & select,
                                                  boundCalc,
                                                  std::move(newOrderBy),
                                                  numBuckets,
-                                                 logger));
+                                                 logger,
+                                                 std::move(calcDictionaries)));
         }
 
     } MLDB_CATCH_ALL {
@@ -1322,13 +1890,20 @@ struct GroupContext: public SqlExpressionDatasetScope {
 
     struct RowScope: public SqlRowScope {
         RowScope(NamedRowValue & output,
-                 const std::vector<ExpressionValue> & currentGroupKey)
-            : output(output), currentGroupKey(currentGroupKey)
+                 const std::vector<ExpressionValue> & currentGroupKey,
+                 const GroupMapValue & aggData)
+            : output(output), currentGroupKey(currentGroupKey),
+              aggData(aggData)
         {
         }
 
         NamedRowValue & output;
         const std::vector<ExpressionValue> & currentGroupKey;
+
+        /// Aggregator state for the group.  It lives in the row scope
+        /// rather than the context so that groups can be finalized in
+        /// parallel.
+        const GroupMapValue & aggData;
     };
 
     virtual BoundFunction doGetFunction(const Utf8String & tableName,
@@ -1420,8 +1995,9 @@ struct GroupContext: public SqlExpressionDatasetScope {
             return {[&,aggIndex] (const std::vector<ExpressionValue> & args,
                                   const SqlRowScope & context)
                     {
+                        auto & row = context.as<RowScope>();
                         return outputAgg[aggIndex]
-                            .aggregate.extract(aggData[aggIndex].get());
+                            .aggregate.extract(row.aggData[aggIndex].get());
                     },
                     // TODO: get it from the value info for the group keys...
                     std::make_shared<AnyValueInfo>()};
@@ -1523,9 +2099,10 @@ struct GroupContext: public SqlExpressionDatasetScope {
 
     RowScope
     getRowScope(NamedRowValue & output,
-                  const std::vector<ExpressionValue> & currentGroupKey) const
+                const std::vector<ExpressionValue> & currentGroupKey,
+                const GroupMapValue & aggData) const
     {
-        return RowScope(output, currentGroupKey);
+        return RowScope(output, currentGroupKey, aggData);
     }
 
     // Represents a clause that is output by the program TODO: Rename this
@@ -1575,7 +2152,6 @@ struct GroupContext: public SqlExpressionDatasetScope {
              
     std::vector<std::shared_ptr<ExpressionValueInfo> > groupInfo;
     std::vector<OutputAggregator> outputAgg;    
-    std::vector<std::shared_ptr<void> > aggData;  //working buffers for the above
     int argCounter;
     int argOffset;
     bool evaluateEmptyGroups;
@@ -1626,6 +2202,24 @@ replaceGroupByKey(const std::shared_ptr<SqlExpression> p, const std::vector<Utf8
     return result;
 }
 
+/** Hash of a group key, used to choose the partition that the group is
+    merged and finalized in.  Only atoms contribute; keys that compare
+    equal must land in the same partition, and the hash of a structured
+    value depends on the order of its columns whereas its comparison
+    doesn't.
+*/
+static uint64_t
+hashGroupKey(const std::vector<ExpressionValue> & key)
+{
+    uint64_t result = key.size();
+    for (auto & k: key) {
+        uint64_t h = k.isAtom() ? (uint64_t)k.getAtom().hash() : 0;
+        result = result * 0x9e3779b97f4a7c15ULL + h;
+        result ^= result >> 29;
+    }
+    return result;
+}
+
 BoundGroupByQuery::
 BoundGroupByQuery(const SelectExpression & select,
                   const Dataset & from,
@@ -1648,10 +2242,39 @@ BoundGroupByQuery(const SelectExpression & select,
       numBuckets(1),
       logger(getMldbLog<BoundGroupByQuery>())
 {
+    // Group by clauses that simply read a column with a dictionary
+    // encoding are grouped on the codes, which are much cheaper to hash
+    // and compare than the strings they stand for.  The codes are read
+    // from the column alongside the rows, and which clauses of a key hold
+    // codes is recorded in a bitmap, so only the first MAX_CODED_KEYS can
+    // be encoded.  A WHEN clause could hide the value, so none are
+    // encoded with one.
+    std::vector<BoundSelectQuery::CalcDictionary> calcDictionaries;
+    auto columnIndex = from.getColumnIndex();
+    bool canEncode = columnIndex && when.when->isConstantTrue();
     for (auto & g: groupBy.clauses) {
         calc.push_back(g);
+
+        BoundSelectQuery::CalcDictionary calcDictionary;
+        auto read = dynamic_cast<const ReadColumnExpression *>(g.get());
+        if (read && canEncode && keyDictionaries.size() < MAX_CODED_KEYS) {
+            ColumnPath column = read->columnName;
+            if (!alias.empty() && column.size() > 1
+                && column[0] == PathElement(alias))
+                column = column.removePrefix();
+            calcDictionary.dictionary = columnIndex->getColumnDictionary(column);
+            calcDictionary.column = std::move(column);
+        }
+        keyDictionaries.emplace_back(calcDictionary.dictionary);
+        calcDictionaries.emplace_back(std::move(calcDictionary));
     }
 
+    bool anyKeyCodes = false;
+    for (auto & d: keyDictionaries)
+        anyKeyCodes = anyKeyCodes || d;
+    if (!anyKeyCodes)
+        calcDictionaries.clear();
+
     // Convert the select clauses to a list
     for (auto & expr : aggregatorsExpr)
     {
@@ -1670,7 +2293,7 @@ BoundGroupByQuery(const SelectExpression & select,
 
     // bind the subselect
     //false means no implicit sort by rowhash, we want unsorted
-    subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets));
+    subSelect.reset(new BoundSelectQuery(subSelectExpr, from, alias, when, where, subOrderBy, calc, numBuckets, calcDictionaries));
 
     std::vector<std::shared_ptr<ExpressionValueInfo> > groupInfo;
     for (size_t c = 0; c < groupBy.clauses.size(); ++c) {
@@ -1707,21 +2330,22 @@ BoundGroupByQuery::
 execute(RowProcessor processor,
         ssize_t offset,
         ssize_t limit,
-        const ProgressFunc & onProgress)
+        const ProgressFunc & onProgress,
+        const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo)
 {
     //STACK_PROFILE(BoundGroupByQuery);
 
-    typedef std::tuple<std::vector<ExpressionValue>,
-                       NamedRowValue,
-                       std::vector<ExpressionValue> >
-        SortedRow;
-
-    std::vector<SortedRow> rowsSorted;
     std::atomic<ssize_t> groupsDone(0);
 
     typedef std::vector<ExpressionValue> RowKey;
     typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
+
+    // Each bucket keeps its groups radix-partitioned by the hash of the
+    // group key, so that each partition can be merged and finalized
+    // independently of the others.
+    size_t numPartitions = numBuckets > 1 ? GROUP_BY_PARTITIONS : 1;
+    std::vector<std::vector<GroupByMapType> >
+        accum(numBuckets, std::vector<GroupByMapType>(numPartitions));
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1733,6 +2357,8 @@ execute(RowProcessor processor,
     //bind the selectexpression, this will create the bound aggregators (which we wont use, ah!)
     auto boundSelect = select.bind(*groupContext);
     auto selectInfo = boundSelect.info;
+    if (onInfo)
+        onInfo(selectInfo);
 
     //bind the having expression. Must be bound after the select because
     //we placed the having aggregators after the select aggregator in the list
@@ -1746,15 +2372,117 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    // The values of dictionary encoded key columns are replaced by their
+    // codes, read from the column as the rows are read, and turned back
+    // again here.  A key with any encoded columns has an extra last
+    // element with the bitmap of which of its values are codes, so that a
+    // code is never mistaken for an integer value.  Codes sort in the
+    // same order as their values, and the other values of those columns
+    // are normally nulls, which sort first either way, so the groups come
+    // out in the same order as without codes.
+    bool anyKeyCodes = false;
+    for (auto & d: keyDictionaries)
+        anyKeyCodes = anyKeyCodes || d;
+
+    auto decodeKey = [&] (RowKey & rowKey)
+        {
+            if (!anyKeyCodes)
+                return;
+            uint64_t coded = rowKey.back().getAtom().toUInt();
+            rowKey.pop_back();
+            for (size_t i = 0;  i < keyDictionaries.size();  ++i) {
+                if (!(coded & (uint64_t(1) << i)))
+                    continue;
+                rowKey[i] = ExpressionValue
+                    (keyDictionaries[i]->getValue(rowKey[i].getAtom().toUInt()),
+                     rowKey[i].getEffectiveTimestamp());
+            }
+        };
+
+    auto getPartition = [&] (const RowKey & rowKey) -> size_t
+        {
+            if (numPartitions == 1)
+                return 0;
+            return hashGroupKey(rowKey) % numPartitions;
+        };
+
+    // Once the groups held in memory go over the query's memory budget,
+    // rows for groups that aren't already in memory are written to a
+    // spill file for their partition instead, and aggregated when the
+    // partition is finalized.
+    QueryMemoryBudget budget;
+    std::mutex spillLock;
+    std::vector<std::shared_ptr<SpillFile> > spilled(numPartitions);
+
+    // Rows are buffered per thread and partition, and written a block at
+    // a time so that threads rarely contend on the file's mutex.
+    typedef std::vector<std::vector<std::vector<ExpressionValue> > >
+        SpillBuffers;
+    PerThreadAccumulator<SpillBuffers> spillBuffers;
+    static constexpr size_t SPILL_BUFFER_ROWS = 256;
+
+    auto flushSpilled = [&] (size_t partition,
+                             std::vector<std::vector<ExpressionValue> > & rows)
+    {
+        if (rows.empty())
+            return;
+
+        std::shared_ptr<SpillFile> file;
+        {
+            std::unique_lock<std::mutex> guard(spillLock);
+            if (!spilled[partition])
+                spilled[partition] = std::make_shared<SpillFile>();
+            file = spilled[partition];
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(file->mutex);
+            for (auto & calc: rows)
+                file->write(calc);
+        }
+        rows.clear();
+    };
+
+    auto spillRow = [&] (size_t partition,
+                         const std::vector<ExpressionValue> & calc)
+    {
+        SpillBuffers & buffers = spillBuffers.get();
+        if (buffers.empty())
+            buffers.resize(numPartitions);
+        auto & rows = buffers[partition];
+        rows.push_back(calc);
+        if (rows.size() >= SPILL_BUFFER_ROWS)
+            flushSpilled(partition, rows);
+    };
+
+    // Approximate; the aggregator state can grow past this
+    auto groupBytes = [&] (const RowKey & rowKey) -> size_t
+        {
+            return approximateMemusage(rowKey)
+                + groupContext->outputAgg.size() * 64;
+        };
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
                       int groupNum)
     {
-       GroupByMapType & map = accum[groupNum];
        RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
+       if (anyKeyCodes)
+           rowKey.emplace_back(calc.back());
+       size_t partition = getPartition(rowKey);
+       GroupByMapType & map = accum[groupNum][partition];
+
+       if (budget.limited() && !map.count(rowKey)) {
+           size_t bytes = groupBytes(rowKey);
+           if (budget.add(bytes)) {
+               budget.release(bytes);
+               spillRow(partition, calc);
+               return true;
+           }
+       }
 
-       auto pair = map.insert({rowKey, GroupMapValue()});
+       auto pair = map.insert({std::move(rowKey), GroupMapValue()});
        auto & iter = pair.first;
        if (pair.second)
        {
@@ -1768,164 +2496,495 @@ execute(RowProcessor processor,
     };  
             
     subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
-  
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
-    {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
-        {
-            for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
-            {
-                auto pair = destMap.insert({it->first, GroupMapValue()});
-                auto destiter = pair.first;
-                if (pair.second)
-                {
-                    //initialize aggregator data
-                    groupContext->initializePerThreadAggregators(destiter->second);
-                }
 
-                groupContext->mergeThreadMap(destiter->second, it->second);
-            }
+    spillBuffers.forEach([&] (SpillBuffers * buffers)
+                         {
+                             for (size_t i = 0;  i < buffers->size();  ++i)
+                                 flushSpilled(i, (*buffers)[i]);
+                         });
+
+    if (groupContext->evaluateEmptyGroups && groupBy.clauses.empty()) {
+        bool anyGroup = false;
+        for (auto & file: spilled)
+            anyGroup = anyGroup || file;
+        for (auto & bucket: accum)
+            for (auto & map: bucket)
+                anyGroup = anyGroup || !map.empty();
+
+        if (!anyGroup) {
+            RowKey emptyKey;
+            auto & map = accum[0][getPartition(emptyKey)];
+            if (budget.limited())
+                budget.add(groupBytes(emptyKey));
+            auto pair = map.emplace(emptyKey, GroupMapValue());
+            groupContext->initializePerThreadAggregators(pair.first->second);
         }
     }
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
-        && groupBy.clauses.empty())
-    {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
-        groupContext->initializePerThreadAggregators(pair.first->second);
-    }
+    // Merge the buckets of each partition in fixed order.  Partitions are
+    // independent of each other.
+    std::vector<GroupByMapType> merged(numPartitions);
 
-    //output rows
-    //each entry in the final map should be an output row for us   
-    for (auto it = destMap.begin(); it != destMap.end(); ++it)
-    {
-        RowKey rowKey = it->first;
-        groupContext->aggData = it->second;
+    auto mergePartition = [&] (size_t partition)
+        {
+            GroupByMapType & destMap = merged[partition];
+            for (auto & bucket: accum) {
+                GroupByMapType & srcMap = bucket[partition];
+                for (auto it = srcMap.begin(); it != srcMap.end(); ++it) {
+                    auto pair = destMap.insert({it->first, GroupMapValue()});
+                    auto destiter = pair.first;
+                    if (pair.second) {
+                        //initialize aggregator data
+                        groupContext->initializePerThreadAggregators(destiter->second);
+                    }
+                    else if (budget.limited()) {
+                        // Each bucket counted the group against the budget
+                        budget.release(groupBytes(it->first));
+                    }
 
-         // Create the context to evaluate the row name and order by
-        NamedRowValue outputRow;
+                    groupContext->mergeThreadMap(destiter->second, it->second);
+                }
+                srcMap.clear();
+            }
+        };
 
-        auto rowContext = groupContext->getRowScope(outputRow, rowKey);
+    if (numPartitions == 1)
+        mergePartition(0);
+    else parallelMap(0, numPartitions, mergePartition);
 
-        //Evaluate the HAVING expression
-        ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
+    struct FinalizedGroup {
+        RowKey key;  ///< As held in the group map, so still encoded
+        std::vector<ExpressionValue> sortFields;
+        NamedRowValue row;
+    };
 
-        if (!havingResult.isTrue())
-            continue;
+    // Evaluate HAVING, the row name, SELECT and ORDER BY for a group.
+    // Returns false if HAVING rejects the group.
+    auto finalizeGroup = [&] (const RowKey & key,
+                              const GroupMapValue & aggData,
+                              FinalizedGroup & group) -> bool
+        {
+            RowKey rowKey = key;
+            decodeKey(rowKey);
 
-        outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
-        outputRow.rowHash = outputRow.rowName;        
+            // Create the context to evaluate the row name and order by
+            auto rowContext = groupContext->getRowScope(group.row, rowKey,
+                                                        aggData);
 
-        //Evaluating the whole bound select expression
-        ExpressionValue result = boundSelect(rowContext, GET_ALL);
-        result.mergeToRowDestructive(outputRow.columns);
+            //Evaluate the HAVING expression
+            ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
 
-        //In case of no output ordering, we can early exit
-        if (boundOrderBy.empty()) {
-            ssize_t n = groupsDone.fetch_add(1);
-            if (limit != -1 && n >= limit)
-               break;
+            if (!havingResult.isTrue())
+                return false;
 
-            processor(outputRow);
-        }
-        else
-        {
-             //Else we add the result to the output rows
-            std::vector<ExpressionValue> sortFields
-            = boundOrderBy.apply(rowContext);
+            group.key = key;
+            group.row.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
+            group.row.rowHash = group.row.rowName;
 
-            std::vector<ExpressionValue> calcd;
-                
-            rowsSorted.emplace_back(std::move(sortFields),
-                                    std::move(outputRow),
-                                    std::move(calcd));
-        }           
-    }
+            //Evaluating the whole bound select expression
+            ExpressionValue result = boundSelect(rowContext, GET_ALL);
+            result.mergeToRowDestructive(group.row.columns);
+
+            if (!boundOrderBy.empty())
+                group.sortFields = boundOrderBy.apply(rowContext);
 
-    if (boundOrderBy.empty())
-        return {true, selectInfo};
+            return true;
+        };
 
-    // Compare two rows according to the sort criteria
-    auto compareRows = [&] (const SortedRow & row1,
-                            const SortedRow & row2)
+    // Groups are output in ORDER BY order if there is one, and otherwise
+    // (or to break ties) in the order of their keys, which is the order
+    // of the group maps.
+    auto groupLess = [&] (const FinalizedGroup & group1,
+                          const FinalizedGroup & group2)
         {
-            return boundOrderBy.less(std::get<0>(row1),
-                                     std::get<0>(row2));
+            if (!boundOrderBy.empty()) {
+                if (boundOrderBy.less(group1.sortFields, group2.sortFields))
+                    return true;
+                if (boundOrderBy.less(group2.sortFields, group1.sortFields))
+                    return false;
+            }
+            return group1.key < group2.key;
         };
 
-    // Sort our output rows
-    std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+    // Output groups in order, applying DISTINCT ON, OFFSET and LIMIT.
+    // Returns false once no more groups are wanted.
+    ExcAssertGreaterEqual(offset, 0);
+    size_t numDistinctOnClauses = select.distinctExpr.size();
+    std::vector<ExpressionValue> reference;
+    ssize_t count = 0;
+    bool processorOk = true;
 
-    // Now select only the required subset of sorted rows
-    if (limit == -1)
-        limit = rowsSorted.size();
+    auto outputGroup = [&] (FinalizedGroup & group) -> bool
+        {
+            //In case of no output ordering, we can early exit
+            if (boundOrderBy.empty()) {
+                ssize_t n = groupsDone.fetch_add(1);
+                if (limit != -1 && n >= limit)
+                    return false;
 
-    ExcAssertGreaterEqual(offset, 0);
+                processor(group.row);
+                return true;
+            }
 
-    if (select.distinctExpr.size() > 0) {
+            if (numDistinctOnClauses > 0) {
+                std::vector<ExpressionValue> & mark = group.sortFields;
 
-        std::vector<ExpressionValue> reference;
-        size_t numDistinctOnClauses = select.distinctExpr.size();
-        reference.resize(numDistinctOnClauses);
-        ssize_t count = 0;
+                if (count > 0
+                    && std::equal(mark.begin(),
+                                  mark.begin() + numDistinctOnClauses,
+                                  reference.begin())) {
+                    return true; //skip duplicates
+                }
 
-        for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
+                reference.assign(mark.begin(),
+                                 mark.begin() + numDistinctOnClauses);
+            }
+            ++count;
 
-            std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+            if (count <= offset)
+                return true;
 
-            if (i == 0) {
-                std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
+            /* Finally, pass to the terminator to continue. */
+            if (!processor(group.row)) {
+                processorOk = false;  //early exit on processor error
+                return false;
             }
-            else {
 
-                bool same = true;
-                for (int i = 0; i < numDistinctOnClauses; ++i){
-                    if (reference[i] != mark[i]) {
-                        same = false;
-                        break;
+            return limit == -1 || count - offset < limit;
+        };
+
+    // k-way merge of sorted sources of groups.  Each source reads its
+    // next group and returns true, or returns false once it has no more.
+    // Returns false if onGroup asked to stop.
+    typedef std::function<bool (FinalizedGroup &)> GroupSource;
+
+    auto mergeGroups = [&] (std::vector<GroupSource> sources,
+                            const std::function<bool (FinalizedGroup &)> & onGroup)
+        {
+            std::vector<FinalizedGroup> heads(sources.size());
+
+            // Min-heap on the head group of each source
+            auto compareSources = [&] (size_t src1, size_t src2)
+                {
+                    return groupLess(heads[src2], heads[src1]);
+                };
+
+            std::vector<size_t> heap;
+            for (size_t src = 0;  src < sources.size();  ++src) {
+                if (sources[src](heads[src]))
+                    heap.push_back(src);
+            }
+            std::make_heap(heap.begin(), heap.end(), compareSources);
+
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), compareSources);
+                size_t src = heap.back();
+                FinalizedGroup group = std::move(heads[src]);
+
+                if (sources[src](heads[src]))
+                    std::push_heap(heap.begin(), heap.end(), compareSources);
+                else heap.pop_back();
+
+                if (!onGroup(group))
+                    return false;
+            }
+
+            return true;
+        };
+
+    bool anySpilled = false;
+    for (auto & file: spilled)
+        anySpilled = anySpilled || file;
+
+    if (anySpilled) {
+        // Every group is written out to a sorted run, which frees its
+        // memory, and the runs are merged to produce the output.
+        std::vector<std::shared_ptr<SpillFile> > runs;
+
+        auto writeGroup = [] (SpillFile & run, const FinalizedGroup & group)
+            {
+                run.write(group.key);
+                run.write(group.sortFields);
+                run.write(group.row);
+            };
+
+        auto spillGroups = [&] (GroupByMapType & map)
+            {
+                auto run = std::make_shared<SpillFile>();
+                size_t bytes = 0;
+                std::vector<FinalizedGroup> groups;
+
+                for (auto & entry: map) {
+                    bytes += groupBytes(entry.first);
+                    FinalizedGroup group;
+                    if (!finalizeGroup(entry.first, entry.second, group))
+                        continue;
+                    // The map is in key order already
+                    if (boundOrderBy.empty())
+                        writeGroup(*run, group);
+                    else groups.emplace_back(std::move(group));
+                }
+
+                std::sort(groups.begin(), groups.end(), groupLess);
+                for (auto & group: groups)
+                    writeGroup(*run, group);
+                run->finishWriting();
+
+                GroupByMapType().swap(map);
+                budget.release(bytes);
+
+                std::unique_lock<std::mutex> guard(spillLock);
+                runs.emplace_back(std::move(run));
+            };
+
+        // Aggregate the rows that were spilled for the groups of a map,
+        // adding groups to it while they fit within the budget.  Rows
+        // for the groups that don't fit are re-partitioned into smaller
+        // files on the bits of their key hash that the levels above
+        // didn't use, which are aggregated in turn once the map has been
+        // written out.  Past the maximum depth (many keys that hash the
+        // same), the groups are kept whatever the budget.
+        std::function<void (GroupByMapType &, SpillFile &, int)> replaySpilled
+            = [&] (GroupByMapType & map, SpillFile & file, int depth)
+            {
+                std::vector<std::shared_ptr<SpillFile> > subFiles;
+                bool full = false;
+
+                file.startReading();
+                std::vector<ExpressionValue> calc;
+                while (file.hasMore()) {
+                    file.read(calc);
+                    RowKey rowKey(calc.begin(),
+                                  calc.begin() + groupBy.clauses.size());
+                    if (anyKeyCodes)
+                        rowKey.emplace_back(calc.back());
+
+                    auto it = map.find(rowKey);
+                    if (it == map.end()) {
+                        size_t bytes = groupBytes(rowKey);
+                        if (!full && budget.add(bytes) && !map.empty()
+                            && depth < MAX_GROUP_BY_SPILL_DEPTH) {
+                            budget.release(bytes);
+                            full = true;
+                        }
+
+                        if (full) {
+                            uint64_t hash = hashGroupKey(rowKey) / numPartitions;
+                            for (int i = 0;  i < depth;  ++i)
+                                hash /= GROUP_BY_SPILL_FANOUT;
+                            if (subFiles.empty())
+                                subFiles.resize(GROUP_BY_SPILL_FANOUT);
+                            auto & subFile = subFiles[hash % GROUP_BY_SPILL_FANOUT];
+                            if (!subFile)
+                                subFile = std::make_shared<SpillFile>();
+                            subFile->write(calc);
+                            continue;
+                        }
+
+                        it = map.insert({std::move(rowKey), GroupMapValue()}).first;
+                        //initialize aggregator data
+                        groupContext->initializePerThreadAggregators(it->second);
                     }
+
+                    groupContext->aggregateRow(it->second, calc);
                 }
 
-                if (!same)
-                    std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
-                else
-                    continue; //skip duplicates
-            }
-            ++count;
+                spillGroups(map);
 
-            if (count <= offset)
+                // Close the files, as they're read one at a time
+                for (auto & subFile: subFiles) {
+                    if (subFile)
+                        subFile->finishWriting();
+                }
+
+                for (auto & subFile: subFiles) {
+                    if (!subFile)
+                        continue;
+                    GroupByMapType subMap;
+                    replaySpilled(subMap, *subFile, depth + 1);
+                    subFile.reset();
+                }
+            };
+
+        // Partitions that didn't spill free their memory first, then the
+        // others are aggregated one at a time so that each one can use
+        // the whole budget.
+        auto spillPartition = [&] (size_t partition)
+            {
+                if (!spilled[partition])
+                    spillGroups(merged[partition]);
+            };
+
+        if (numPartitions == 1)
+            spillPartition(0);
+        else parallelMap(0, numPartitions, spillPartition);
+
+        for (size_t partition = 0;  partition < numPartitions;  ++partition) {
+            if (!spilled[partition])
                 continue;
+            replaySpilled(merged[partition], *spilled[partition], 0);
+            spilled[partition].reset();
+        }
+
+        // Source reading a run, which is removed once it's been read
+        auto runSource = [] (std::shared_ptr<SpillFile> run) -> GroupSource
+            {
+                run->startReading();
+                return [run] (FinalizedGroup & group) mutable
+                    {
+                        if (!run)
+                            return false;
+                        if (!run->hasMore()) {
+                            run.reset();
+                            return false;
+                        }
+                        run->read(group.key);
+                        run->read(group.sortFields);
+                        run->read(group.row);
+                        return true;
+                    };
+            };
 
-            auto & row = std::get<1>(rowsSorted[i]);
+        // Every run that is merged at once holds a file open, so with
+        // many runs they are merged into longer runs in several passes
+        // first.
+        while (runs.size() > MAX_SPILL_MERGE_RUNS) {
+            std::vector<std::shared_ptr<SpillFile> > mergedRuns;
+            for (size_t i = 0;  i < runs.size();  i += MAX_SPILL_MERGE_RUNS) {
+                size_t end = std::min(runs.size(), i + MAX_SPILL_MERGE_RUNS);
+                if (end - i == 1) {
+                    mergedRuns.emplace_back(std::move(runs[i]));
+                    continue;
+                }
 
-            /* Finally, pass to the terminator to continue. */
-            if (!processor(row))
-                return {false, selectInfo}; //early exis on processor error
+                std::vector<GroupSource> sources;
+                for (size_t j = i;  j < end;  ++j)
+                    sources.emplace_back(runSource(std::move(runs[j])));
 
-            if (count - offset == limit)
-                break;
+                auto run = std::make_shared<SpillFile>();
+                auto onGroup = [&] (FinalizedGroup & group)
+                    {
+                        writeGroup(*run, group);
+                        return true;
+                    };
+                mergeGroups(std::move(sources), onGroup);
+                run->finishWriting();
+                mergedRuns.emplace_back(std::move(run));
+            }
+            runs.swap(mergedRuns);
         }
 
+        std::vector<GroupSource> sources;
+        for (auto & run: runs)
+            sources.emplace_back(runSource(std::move(run)));
+        mergeGroups(std::move(sources), outputGroup);
+
+        return {processorOk, selectInfo};
     }
-    else {
 
-        ssize_t begin = std::min<ssize_t>(offset, rowsSorted.size());
-        ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
+    if (boundOrderBy.empty()) {
+        // Without an ORDER BY, the groups are output in key order as the
+        // maps of the partitions are merged.  They are finalized a batch
+        // at a time in parallel, and no more of them than the LIMIT
+        // needs.
+        typedef GroupByMapType::iterator GroupIterator;
+        std::vector<std::pair<GroupIterator, GroupIterator> >
+            cursors(numPartitions);
+
+        // Min-heap on the key under the cursor of each partition
+        auto compareCursors = [&] (size_t p1, size_t p2)
+            {
+                return cursors[p2].first->first < cursors[p1].first->first;
+            };
+
+        std::vector<size_t> heap;
+        for (size_t partition = 0;  partition < numPartitions;  ++partition) {
+            cursors[partition] = { merged[partition].begin(),
+                                   merged[partition].end() };
+            if (!merged[partition].empty())
+                heap.push_back(partition);
+        }
+        std::make_heap(heap.begin(), heap.end(), compareCursors);
 
-        for (unsigned i = begin;  i < end;  ++i) {
-            auto & row = std::get<1>(rowsSorted[i]);
+        std::vector<GroupByMapType::value_type *> batch;
+        bool more = true;
 
-            /* Finally, pass to the terminator to continue. */
-            if (!processor(row))
-                return {false, selectInfo}; //early exis on processor error
-        } 
-    }  
+        while (more && !heap.empty()) {
+            size_t batchSize = GROUP_BY_FINALIZE_BATCH;
+            if (limit != -1)
+                batchSize = std::min<size_t>(batchSize, limit - groupsDone);
+
+            batch.clear();
+            while (batch.size() < batchSize && !heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), compareCursors);
+                auto & cursor = cursors[heap.back()];
+                batch.push_back(&*cursor.first);
+                if (++cursor.first != cursor.second)
+                    std::push_heap(heap.begin(), heap.end(), compareCursors);
+                else heap.pop_back();
+            }
+
+            std::vector<FinalizedGroup> groups(batch.size());
+            std::vector<char> kept(batch.size());
+
+            auto doGroup = [&] (size_t i)
+                {
+                    kept[i] = finalizeGroup(batch[i]->first, batch[i]->second,
+                                            groups[i]);
+                };
+
+            if (batch.size() == 1)
+                doGroup(0);
+            else parallelMap(0, batch.size(), doGroup);
+
+            for (size_t i = 0;  i < batch.size() && more;  ++i) {
+                if (kept[i])
+                    more = outputGroup(groups[i]);
+            }
+        }
+
+        return {processorOk, selectInfo};
+    }
+
+    // With an ORDER BY, each partition finalizes and sorts its groups in
+    // parallel, and the sorted partitions are merged as they're output.
+    std::vector<std::vector<FinalizedGroup> > finalized(numPartitions);
+
+    auto doPartition = [&] (size_t partition)
+        {
+            GroupByMapType & destMap = merged[partition];
+            auto & output = finalized[partition];
+
+            //each entry in the final map should be an output row for us
+            for (auto it = destMap.begin(); it != destMap.end(); ++it) {
+                FinalizedGroup group;
+                if (finalizeGroup(it->first, it->second, group))
+                    output.emplace_back(std::move(group));
+            }
+
+            GroupByMapType().swap(destMap);
+            std::sort(output.begin(), output.end(), groupLess);
+        };
+
+    if (numPartitions == 1)
+        doPartition(0);
+    else parallelMap(0, numPartitions, doPartition);
+
+    std::vector<GroupSource> sources;
+    for (auto & groups: finalized) {
+        auto source = [&groups, pos = size_t(0)] (FinalizedGroup & group) mutable
+            {
+                if (pos == groups.size())
+                    return false;
+                group = std::move(groups[pos++]);
+                return true;
+            };
+        sources.emplace_back(std::move(source));
+    }
+
+    mergeGroups(std::move(sources), outputGroup);
 
-    return {true, selectInfo};
+    return {processorOk, selectInfo};
 }
 
 } // namespace MLDB
@@ -17,6 +17,7 @@ namespace MLDB {
 
 struct GroupContext;
 struct SqlExpressionDatasetScope;
+struct ColumnDictionary;
 
 
 /** This object is designed to track whether a thread is executing a
@@ -87,6 +88,12 @@ struct BoundSelectQuery {
     std::shared_ptr<SqlExpressionDatasetScope> context;
     std::shared_ptr<ExpressionValueInfo> selectInfo;
     std::shared_ptr<spdlog::logger> logger;
+
+    /// A column that one of calc simply reads, and its dictionary encoding
+    struct CalcDictionary {
+        ColumnPath column;
+        std::shared_ptr<const ColumnDictionary> dictionary;
+    };
     
 
     /** Note on the ordering of rows
@@ -96,6 +103,15 @@ struct BoundSelectQuery {
      *  by setting the implicitOrderByRowHash parameter.  Note that this
      *  field only control part of the logic since a user might have passed
      *  an orderBy clause.  The orderBy clause is applied before any rowHash ordering.
+     *
+     *  calcDictionaries, if not empty, has an entry for each of calc,
+     *  with a null dictionary for those that aren't encoded (only the
+     *  first 64 can be).  When the rows come from a row stream that can
+     *  read the codes of the columns, calc is not evaluated for a row
+     *  with a code; the code, as an unsigned integer, is passed in its
+     *  place.  calcd then has an extra last element with the bitmap of
+     *  which of its values are codes.  This is only supported without
+     *  an orderBy.
      **/
     BoundSelectQuery(const SelectExpression & select,
                      const Dataset & from,
@@ -104,7 +120,8 @@ struct BoundSelectQuery {
                      const SqlExpression & where,
                      const OrderByExpression & orderBy,
                      std::vector<std::shared_ptr<SqlExpression> > calc,
-                     int numBuckets = -1);
+                     int numBuckets = -1,
+                     std::vector<CalcDictionary> calcDictionaries = {});
 
     bool execute(RowProcessorEx processor,
                  ssize_t offset,
@@ -154,9 +171,14 @@ struct BoundGroupByQuery {
                      const SqlExpression & rowName,
                      const OrderByExpression & orderBy);
 
+    /** Run the query.  If onInfo is set, it's called with the info of
+        the output rows once the select is bound, before any row is
+        processed.
+    */
     std::pair<bool, std::shared_ptr<ExpressionValueInfo> > execute(RowProcessor processor,  
                      ssize_t offset, ssize_t limit,
-                     const ProgressFunc & onProgress);
+                     const ProgressFunc & onProgress,
+                     const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo = nullptr);
 
     const Dataset & from;
     WhenExpression when;
@@ -167,6 +189,10 @@ struct BoundGroupByQuery {
 
     std::vector<std::shared_ptr<SqlExpression> > calc;
 
+    /// For each group by clause that reads a dictionary encoded column,
+    /// the dictionary; groups are keyed on its codes.  Null for others.
+    std::vector<std::shared_ptr<const ColumnDictionary> > keyDictionaries;
+
     // Bind in the order by expression
     BoundOrderByExpression boundOrderBy;
 
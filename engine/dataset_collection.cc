@@ -7,11 +7,13 @@
 
 */
 #include "mldb/engine/dataset_collection.h"
+#include "mldb/engine/arrow_ipc.h"
 #include "mldb/rest/poly_collection_impl.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/utils/string_functions.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/utils/lightweight_hash.h"
+#include "mldb/utils/log.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/map_description.h"
 #include "mldb/types/vector_description.h"
@@ -50,6 +52,253 @@ registerDatasetType(const Package & package,
                                            docRoute, customRoute, config, registryFlags);
 }
 
+namespace {
+
+/** Sends a JSON array as the response on an HTTP connection, one element
+    at a time.  Elements are buffered and sent in chunks of about
+    CHUNK_SIZE bytes using chunked transfer encoding, so that the client
+    starts receiving them straight away and the whole array is never held
+    in memory.  An array that fits in a single chunk is sent as a normal
+    response instead.
+*/
+struct JsonArrayResponse {
+    static constexpr size_t CHUNK_SIZE = 65536;
+
+    JsonArrayResponse(RestConnection & connection)
+        : connection(connection), buffer("["), numElements(0),
+          headerSent(false)
+    {
+    }
+
+    /** Add an element, already encoded as JSON.  Returns false if the
+        client has gone away, in which case there is no point in
+        producing any more.
+    */
+    bool add(const std::string & element)
+    {
+        if (numElements++ != 0)
+            buffer += ',';
+        buffer += element;
+        if (buffer.size() < CHUNK_SIZE)
+            return true;
+        sendChunk();
+        return connection.isConnected();
+    }
+
+    /** Finish the array and the response. */
+    void finish()
+    {
+        buffer += ']';
+        if (!headerSent) {
+            connection.sendResponse(200, std::move(buffer),
+                                    "application/json");
+            return;
+        }
+        if (connection.isConnected())
+            sendChunk();
+        connection.finishResponse();
+    }
+
+    /** Has any of the response been sent yet?  Once it has, errors can
+        no longer be reported with an error response.
+    */
+    bool started() const
+    {
+        return headerSent;
+    }
+
+    /** End a response that has been started but can't be completed.  The
+        client sees a truncated array.
+    */
+    void abort()
+    {
+        ExcAssert(headerSent);
+        connection.finishResponse();
+    }
+
+private:
+    void sendChunk()
+    {
+        if (!headerSent) {
+            connection.sendHttpResponseHeader
+                (200, "application/json", RestConnection::CHUNKED_ENCODING);
+            headerSent = true;
+        }
+        connection.sendPayload(std::move(buffer));
+        buffer.clear();
+    }
+
+    RestConnection & connection;
+    std::string buffer;
+    size_t numElements;
+    bool headerSent;
+};
+
+std::vector<std::pair<ColumnPath, CellValue> >
+getSparseRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::vector<std::pair<ColumnPath, CellValue> > rowOut;
+    rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+
+    if (rowNames)
+        rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
+    if (rowHashes)
+        rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
+
+    for (auto & c: row.columns) {
+        rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
+    }
+
+    std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
+
+    return rowOut;
+}
+
+std::map<ColumnPath, CellValue>
+getAosRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::map<ColumnPath, CellValue> rowOut;
+
+    if (rowNames)
+        rowOut[ColumnPath("_rowName")] = row.rowName.toUtf8String();
+    if (rowHashes)
+        rowOut[ColumnPath("_rowHash")] = row.rowHash.toString();
+
+    for (auto & c: row.columns) {
+        const ColumnPath & col = std::get<0>(c);
+        const CellValue & val = std::get<1>(c);
+        rowOut[col] = val;
+    }
+
+    return rowOut;
+}
+
+/** Encode the given row in the given format.  Only for the formats where
+    each row can be encoded on its own.
+*/
+std::string
+encodeRow(const std::string & format, MatrixNamedRow & row,
+          bool rowNames, bool rowHashes, bool sortColumns)
+{
+    if (sortColumns)
+        std::sort(row.columns.begin(), row.columns.end());
+
+    if (format == "full" || format == "")
+        return jsonEncodeStr(row);
+    else if (format == "sparse")
+        return jsonEncodeStr(getSparseRow(row, rowNames, rowHashes));
+    else if (format == "aos")
+        return jsonEncodeStr(getAosRow(row, rowNames, rowHashes));
+    throw AnnotatedException(500, "Format '" + format + "' can't be streamed");
+}
+
+/** Returns a function that sends each message of an Arrow stream on the
+    connection, after the response header (for chunked transfer encoding)
+    with the first one.
+*/
+std::function<bool (std::string)>
+arrowMessageSender(RestConnection & connection)
+{
+    bool headerSent = false;
+    return [&connection, headerSent] (std::string message) mutable
+        {
+            if (!headerSent) {
+                connection.sendHttpResponseHeader
+                    (200, "application/vnd.apache.arrow.stream",
+                     RestConnection::CHUNKED_ENCODING);
+                headerSent = true;
+            }
+            connection.sendPayload(std::move(message));
+            return connection.isConnected();
+        };
+}
+
+/** Returns the header row of the table format, for the given columns. */
+std::string
+encodeTableHeader(const std::vector<ColumnPath> & columns,
+                  bool rowNames, bool rowHashes)
+{
+    std::vector<CellValue> headers;
+    if (rowNames)
+        headers.push_back("_rowName");
+    if (rowHashes)
+        headers.push_back("_rowHash");
+
+    for (auto & c: columns) {
+        headers.push_back(c.toUtf8String());
+    }
+    return jsonEncodeStr(headers);
+}
+
+/** Encode the row for the table format, with each value in the place of
+    its column in columnIndex, after the row name and hash.  A column
+    that isn't in columnIndex is an error.  The row is freed once it's
+    encoded.
+*/
+std::string
+encodeTableRow(MatrixNamedRow & row,
+               const LightweightHash<ColumnHash, int> & columnIndex,
+               size_t numColumns,
+               bool rowNames, bool rowHashes)
+{
+    std::vector<CellValue> rowOut(numColumns + rowNames + rowHashes);
+    if (rowNames)
+        rowOut[0] = row.rowName.toUtf8String();
+    if (rowHashes)
+        rowOut[rowNames] = row.rowHash.toString();
+
+    for (auto & c: row.columns) {
+        const ColumnPath & columnName = std::get<0>(c);
+        CellValue cellValue = std::get<1>(c);
+
+        //Special output options for table format
+        if (cellValue.isTimestamp())
+        {
+            //in table format print dates as epoch
+            cellValue = cellValue.coerceToString();
+        }
+        else if (cellValue.isTimeinterval())
+        {
+            //in table format print time intervals as string
+            cellValue = cellValue.coerceToString();
+        }
+        else if (cellValue.isDouble())
+        {
+            //in table format print 'special' floats as string
+            double value = cellValue.toDouble();
+            if (std::isnan(value))
+            {
+                std::string stringVal = std::signbit(value) ? "-NaN" : "NaN";
+                cellValue = CellValue(stringVal);
+            }
+            else if (std::isinf(value))
+            {
+                std::string stringVal = std::signbit(value) ? "-Inf" : "Inf";
+                cellValue = CellValue(stringVal);
+            }
+        }
+        else if (cellValue.isPath()) {
+            cellValue = CellValue(cellValue.coerceToPath().toUtf8String());
+        }
+
+        auto it = columnIndex.find(columnName);
+        if (it == columnIndex.end()) {
+            throw AnnotatedException
+                (500, "Column '" + columnName.toUtf8String()
+                 + "' isn't in the header of the table, which was sent "
+                 "before the first row");
+        }
+        rowOut[it->second + rowHashes + rowNames] = std::move(cellValue);
+    }
+
+    // Free each row as it's encoded
+    row = MatrixNamedRow();
+
+    return jsonEncodeStr(rowOut);
+}
+
+} // file scope
+
 void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   RestConnection & connection,
                   const std::string & format,
@@ -60,43 +309,25 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
 {
     std::vector<MatrixNamedRow> sparseOutput = runQuery();
 
+    if (format == "full" || format == "" || format == "sparse"
+        || format == "aos") {
+        JsonArrayResponse response(connection);
+        for (auto & row: sparseOutput) {
+            if (!response.add(encodeRow(format, row, rowNames, rowHashes,
+                                        sortColumns)))
+                break;
+        }
+        response.finish();
+        return;
+    }
+
     if (sortColumns) {
         for (auto & r: sparseOutput) {
             std::sort(r.columns.begin(), r.columns.end());
         }
     }
 
-    if (format == "full" || format == "") {
-        connection.sendResponse(200, jsonEncodeStr(sparseOutput),
-                                "application/json");
-    }
-    else if (format == "sparse") {
-        std::vector<std::vector<std::pair<ColumnPath, CellValue> > > output;
-        output.reserve(sparseOutput.size());
-
-        for (auto & row: sparseOutput) {
-
-            std::vector<std::pair<ColumnPath, CellValue> > rowOut;
-            rowOut.reserve(row.columns.size() + rowNames + rowHashes);
-
-            if (rowNames)
-                rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
-            if (rowHashes)
-                rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
-
-            for (auto & c: row.columns) {
-                rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
-            }
-
-            std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
-
-            output.emplace_back(std::move(rowOut));
-        }
-
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
-    else if (format == "soa") {
+    if (format == "soa") {
         // Structure of arrays; one array per column
         std::map<ColumnPath, std::vector<CellValue> > output;
         for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
@@ -120,29 +351,6 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(output),
                                 "application/json");
     }
-    else if (format == "aos") {
-        // Array of structures; one structure per row
-        std::vector<std::map<ColumnPath, CellValue> > output;
-        for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-
-            std::map<ColumnPath, CellValue> row;
-
-            if (rowNames)
-                row[ColumnPath("_rowName")] = sparseOutput[i].rowName.toUtf8String();
-            if (rowHashes)
-                row[ColumnPath("_rowHash")] = sparseOutput[i].rowHash.toString();
-
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnPath & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-                row[col] = val;
-            }
-
-            output.emplace_back(std::move(row));
-        }
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
-    }
     else if (format == "table") {
         // TODO: the SQL knows what columns could be created... this could
         // be greatly optimized.
@@ -167,72 +375,18 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         }
 
         // Now, send them back
-        std::vector<std::vector<CellValue> > output;
-        output.reserve(sparseOutput.size() + createHeaders);
+        JsonArrayResponse response(connection);
 
-        if (createHeaders) {
-
-            std::vector<CellValue> headers;
-            if (rowNames)
-                headers.push_back("_rowName");
-            if (rowHashes)
-                headers.push_back("_rowHash");
-
-            for (auto & c: columns) {
-                headers.push_back(c.toUtf8String());
-            }
-            output.push_back(headers);
-        }
+        if (createHeaders)
+            response.add(encodeTableHeader(columns, rowNames, rowHashes));
 
         for (auto & row: sparseOutput) {
-            std::vector<CellValue> rowOut(columns.size() + rowNames + rowHashes);
-            if (rowNames)
-                rowOut[0] = row.rowName.toUtf8String();
-            if (rowHashes)
-                rowOut[rowNames] = row.rowHash.toString();
-
-            for (auto & c: row.columns) {
-                const ColumnPath & columnName = std::get<0>(c);
-                CellValue cellValue = std::get<1>(c);
-
-                //Special output options for table format
-                if (cellValue.isTimestamp())
-                {
-                    //in table format print dates as epoch
-                    cellValue = cellValue.coerceToString();
-                }
-                else if (cellValue.isTimeinterval())
-                {
-                    //in table format print time intervals as string
-                    cellValue = cellValue.coerceToString();
-                }
-                else if (cellValue.isDouble())
-                {
-                    //in table format print 'special' floats as string
-                    double value = cellValue.toDouble();
-                    if (std::isnan(value))
-                    {
-                        std::string stringVal = std::signbit(value) ? "-NaN" : "NaN";
-                        cellValue = CellValue(stringVal);
-                    }
-                    else if (std::isinf(value))
-                    {
-                        std::string stringVal = std::signbit(value) ? "-Inf" : "Inf";
-                        cellValue = CellValue(stringVal);
-                    }
-                }
-                else if (cellValue.isPath()) {
-                    cellValue = CellValue(cellValue.coerceToPath().toUtf8String());
-                }
-
-                rowOut[columnIndex[columnName] + rowHashes + rowNames] = std::move(cellValue);
-            }
-
-            output.push_back(rowOut);
+            if (!response.add(encodeTableRow(row, columnIndex, columns.size(),
+                                             rowNames, rowHashes)))
+                break;
         }
 
-        connection.sendResponse(200, jsonEncodeStr(output),
-                                "application/json");
+        response.finish();
     }
     else if (format == "atom") {
         if (sparseOutput.size() > 1) {
@@ -262,11 +416,193 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(val),
                                 "application/json"); 
     }
+    else if (format == "arrow") {
+        ArrowStreamEncoder encoder(rowNames, rowHashes, sortColumns,
+                                   arrowMessageSender(connection));
+        for (auto & row: sparseOutput) {
+            if (!encoder.add(std::move(row)))
+                break;
+        }
+        encoder.finish();
+        connection.finishResponse();
+    }
     else {
         connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
     }
 }
 
+void runHttpQueryIncremental(std::function<bool (std::function<bool (Path &, ExpressionValue &)> &, const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> &)> runQuery,
+                             RestConnection & connection,
+                             const std::string & format,
+                             bool createHeaders,
+                             bool rowNames,
+                             bool rowHashes,
+                             bool sortColumns,
+                             const std::shared_ptr<spdlog::logger> & logger)
+{
+    std::vector<MatrixNamedRow> sparseOutput;
+
+    if (format == "arrow") {
+        ArrowStreamEncoder encoder(rowNames, rowHashes, sortColumns,
+                                   arrowMessageSender(connection));
+
+        std::function<bool (Path &, ExpressionValue &)> onRow
+            = [&] (Path & rowName, ExpressionValue & val)
+            {
+                NamedRowValue row;
+                row.rowName = std::move(rowName);
+                row.rowHash = row.rowName;
+                val.mergeToRowDestructive(row.columns);
+                return encoder.add(row.flattenDestructive());
+            };
+
+        auto onInfo = [&] (const std::shared_ptr<ExpressionValueInfo> & info)
+            {
+                encoder.setInfo(info);
+            };
+
+        try {
+            if (runQuery(onRow, onInfo))
+                encoder.finish();
+        } MLDB_CATCH_ALL {
+            if (!encoder.started())
+                throw;
+
+            // Too late to send an error response; the client will see the
+            // stream end without its end-of-stream marker
+            ERROR_MSG(logger) << "error after query response was started: "
+                              << getExceptionString();
+        }
+
+        connection.finishResponse();
+        return;
+    }
+
+    if (format == "table") {
+        // When the schema of the output is closed, its columns make the
+        // header and the rows can be sent as they come.  Otherwise, the
+        // columns are only known once all rows have been seen.
+        std::unique_ptr<JsonArrayResponse> response;
+        std::vector<ColumnPath> columns;
+        LightweightHash<ColumnHash, int> columnIndex;
+
+        auto onInfo = [&] (const std::shared_ptr<ExpressionValueInfo> & info)
+            {
+                if (!info
+                    || info->getSchemaCompletenessRecursive() != SCHEMA_CLOSED)
+                    return;
+                for (auto & k: info->getKnownAtoms())
+                    columns.push_back(k.columnName);
+                if (sortColumns)
+                    std::sort(columns.begin(), columns.end());
+                for (size_t i = 0;  i < columns.size();  ++i)
+                    columnIndex[columns[i]] = i;
+
+                response.reset(new JsonArrayResponse(connection));
+                if (createHeaders)
+                    response->add(encodeTableHeader(columns, rowNames,
+                                                    rowHashes));
+            };
+
+        std::function<bool (Path &, ExpressionValue &)> onRow
+            = [&] (Path & rowName, ExpressionValue & val)
+            {
+                NamedRowValue row;
+                row.rowName = std::move(rowName);
+                row.rowHash = row.rowName;
+                val.mergeToRowDestructive(row.columns);
+                MatrixNamedRow flattened = row.flattenDestructive();
+                if (!response) {
+                    sparseOutput.emplace_back(std::move(flattened));
+                    return true;
+                }
+                if (sortColumns)
+                    std::sort(flattened.columns.begin(),
+                              flattened.columns.end());
+                return response->add(encodeTableRow(flattened, columnIndex,
+                                                    columns.size(),
+                                                    rowNames, rowHashes));
+            };
+
+        try {
+            runQuery(onRow, onInfo);
+        } MLDB_CATCH_ALL {
+            if (!response || !response->started())
+                throw;
+
+            // Too late to send an error response; the client will see the
+            // array cut short
+            ERROR_MSG(logger) << "error after query response was started: "
+                              << getExceptionString();
+            response->abort();
+            return;
+        }
+
+        if (response) {
+            response->finish();
+            return;
+        }
+
+        auto getOutput = [&] () { return std::move(sparseOutput); };
+        runHttpQuery(getOutput, connection, format, createHeaders,
+                     rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    if (format != "full" && format != "" && format != "sparse"
+        && format != "aos") {
+        // soa and atom need to see all rows before they can output any
+        // of them
+        std::function<bool (Path &, ExpressionValue &)> onRow
+            = [&] (Path & rowName, ExpressionValue & val)
+            {
+                NamedRowValue row;
+                row.rowName = std::move(rowName);
+                row.rowHash = row.rowName;
+                val.mergeToRowDestructive(row.columns);
+                sparseOutput.emplace_back(row.flattenDestructive());
+                return true;
+            };
+
+        runQuery(onRow, nullptr /* onInfo */);
+
+        auto getOutput = [&] () { return std::move(sparseOutput); };
+        runHttpQuery(getOutput, connection, format, createHeaders,
+                     rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    JsonArrayResponse response(connection);
+
+    std::function<bool (Path &, ExpressionValue &)> onRow
+        = [&] (Path & rowName, ExpressionValue & val)
+        {
+            NamedRowValue row;
+            row.rowName = std::move(rowName);
+            row.rowHash = row.rowName;
+            val.mergeToRowDestructive(row.columns);
+            MatrixNamedRow flattened = row.flattenDestructive();
+            return response.add(encodeRow(format, flattened, rowNames,
+                                          rowHashes, sortColumns));
+        };
+
+    try {
+        runQuery(onRow, nullptr /* onInfo */);
+    } MLDB_CATCH_ALL {
+        if (!response.started())
+            throw;
+
+        // Too late to send an error response; the client will see the
+        // array cut short
+        ERROR_MSG(logger) << "error after query response was started: "
+                          << getExceptionString();
+        response.abort();
+        return;
+    }
+
+    response.finish();
+}
+
 
 /*****************************************************************************/
 /* DATASET COLLECTION                                                        */
@@ -578,14 +914,18 @@ queryStructured(const Dataset * dataset,
     //cerr << "limit = " << limit << endl;
     //cerr << "offset = " << offset << endl;
 
-    auto runQuery = [&] ()
+    auto runQuery = [&] (std::function<bool (Path &, ExpressionValue &)> & onRow,
+                         const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo)
         {
-            return dataset->queryStructured
-                (selectParsed, whenParsed, *whereParsed, orderByParsed,
-                 groupByParsed,havingParsed, rowNameParsed, offset, limit);
+            return dataset->queryStructuredIncremental
+                (onRow, selectParsed, whenParsed, *whereParsed, orderByParsed,
+                 groupByParsed,havingParsed, rowNameParsed, offset, limit,
+                 "" /*alias*/, nullptr /*onProgress*/,
+                 false /*processInParallel*/, onInfo);
         };
 
-    runHttpQuery(runQuery, connection, format, createHeaders,rowNames, rowHashes, sortColumns);
+    runHttpQueryIncremental(runQuery, connection, format, createHeaders,
+                            rowNames, rowHashes, sortColumns, dataset->logger);
 }
 
 template class PolyCollection<Dataset>;
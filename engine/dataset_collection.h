@@ -34,6 +34,27 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool rowNames,
                   bool rowHashes,
                   bool sortColumns);
+
+/** Same as runHttpQuery, but the query is run incrementally: runQuery
+    must call the function it is passed with each output row in order,
+    stopping if it returns false.  The full, sparse and aos formats are
+    encoded and sent (with chunked transfer encoding once the output is
+    large enough) as the rows are produced, so the result is never held
+    in memory, as is the arrow format, a record batch at a time; runQuery
+    must pass what is known about the output rows to the onInfo function
+    it is passed (which may be null) before the first row, for the arrow
+    column types.  Other formats need all of the rows before they can
+    send any of them.  An error once the response has started can't be
+    sent to the client, so it is logged to logger instead.
+*/
+void runHttpQueryIncremental(std::function<bool (std::function<bool (Path &, ExpressionValue &)> &, const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> &)> runQuery,
+                             RestConnection & connection,
+                             const std::string & format,
+                             bool createHeaders,
+                             bool rowNames,
+                             bool rowHashes,
+                             bool sortColumns,
+                             const std::shared_ptr<spdlog::logger> & logger);
                       
 
 /*****************************************************************************/
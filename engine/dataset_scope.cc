@@ -75,10 +75,44 @@ doGetFunction(const Utf8String & tableName,
                     }
                 };
 
+            // Batches of rows are passed to the function in one call, so
+            // that it can amortize its per-call work
+            auto batchExec = [=] (std::vector<ExpressionValue> * args,
+                                  size_t numRows,
+                                  ExpressionValue * output,
+                                  std::exception_ptr & error) -> size_t
+                {
+                    std::vector<ExpressionValue> inputs(numRows);
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        if (!args[i].empty())
+                            inputs[i] = std::move(args[i][0]);
+                    }
+
+                    try {
+                        std::vector<ExpressionValue> outputs
+                            = applier->applyBatch(inputs);
+                        ExcAssertEqual(outputs.size(), numRows);
+                        std::move(outputs.begin(), outputs.end(), output);
+                        return numRows;
+                    } catch (...) {
+                        // The batch doesn't say which row failed, and none
+                        // of them has a value, so apply them one at a
+                        // time to find it
+                    }
+
+                    auto onRow = [&] (size_t i)
+                        {
+                            output[i] = applier->apply(inputs[i]);
+                        };
+                    return forEachBatchRow(numRows, error, onRow);
+                };
+
             bool isConst = constantArgs && applier->info.deterministic;
             auto outputInfo = applier->info.output->getConst(isConst);
 
-            return BoundFunction(exec, outputInfo);
+            BoundFunction result(exec, outputInfo);
+            result.batchExec = batchExec;
+            return result;
         }
     }
 
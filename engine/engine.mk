@@ -3,6 +3,8 @@ LIBMLDB_ENGINE_SOURCES:= \
 	analytics.cc \
 	dataset_scope.cc \
 	bound_queries.cc \
+	query_spill.cc \
+	arrow_ipc.cc \
 	forwarded_dataset.cc \
 	column_scope.cc \
 	bucket.cc \
@@ -0,0 +1,408 @@
+/** query_spill.cc
+    Memory budget for query execution, and spill files.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "mldb/engine/query_spill.h"
+#include "mldb/utils/environment.h"
+#include "mldb/types/annotated_exception.h"
+#include "mldb/arch/exception.h"
+#include "mldb/compiler/filesystem.h"
+#include <unistd.h>
+#include <stdlib.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+static EnvOption<size_t>
+QUERY_MEMORY_BUDGET("MLDB_QUERY_MEMORY_BUDGET", 0);
+
+static EnvOption<std::string>
+QUERY_SPILL_DIR("MLDB_QUERY_SPILL_DIR", "");
+
+static EnvOption<std::string>
+QUERY_SPILL_COMPRESSION("MLDB_QUERY_SPILL_COMPRESSION", "lz4");
+
+
+/*****************************************************************************/
+/* QUERY MEMORY BUDGET                                                       */
+/*****************************************************************************/
+
+namespace {
+
+/// Budget of the innermost QueryMemoryBudgetScope, or -1 if there is none
+thread_local ssize_t scopeBudget = -1;
+
+} // file scope
+
+QueryMemoryBudget::
+QueryMemoryBudget()
+    : budget(scopeBudget == -1 ? (size_t)QUERY_MEMORY_BUDGET : scopeBudget),
+      used(0)
+{
+}
+
+QueryMemoryBudgetScope::
+QueryMemoryBudgetScope(size_t budget)
+    : oldBudget(scopeBudget)
+{
+    if (budget != 0)
+        scopeBudget = budget;
+}
+
+QueryMemoryBudgetScope::
+~QueryMemoryBudgetScope()
+{
+    scopeBudget = oldBudget;
+}
+
+size_t approximateMemusage(const ExpressionValue & val)
+{
+    size_t result = sizeof(ExpressionValue);
+
+    if (val.empty()) {
+    }
+    else if (val.isAtom()) {
+        result += val.getAtom().memusage();
+    }
+    else if (val.isSuperposition()) {
+        auto onValue = [&] (const ExpressionValue & v)
+            {
+                result += approximateMemusage(v);
+                return true;
+            };
+        val.forEachSuperposedValue(onValue);
+    }
+    else if (val.isEmbedding()) {
+        size_t n = 1;
+        for (auto & d: val.getEmbeddingShape())
+            n *= d;
+        result += n * sizeof(CellValue);
+    }
+    else {
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & v)
+            {
+                result += sizeof(PathElement) + approximateMemusage(v);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+
+    return result;
+}
+
+size_t approximateMemusage(const std::vector<ExpressionValue> & vals)
+{
+    size_t result = sizeof(vals);
+    for (auto & v: vals)
+        result += approximateMemusage(v);
+    return result;
+}
+
+size_t approximateMemusage(const NamedRowValue & row)
+{
+    size_t result = sizeof(row) + row.rowName.memusage();
+    for (auto & c: row.columns) {
+        result += sizeof(PathElement) + approximateMemusage(std::get<1>(c));
+    }
+    return result;
+}
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+namespace {
+
+enum SpilledValueType: uint8_t {
+    SPILLED_NONE = 0,
+    SPILLED_ATOM = 1,
+    SPILLED_STRUCTURED = 2,
+    SPILLED_EMBEDDING = 3,
+    SPILLED_SUPERPOSITION = 4
+};
+
+void writeRaw(std::ostream & stream, const void * data, size_t len)
+{
+    stream.write((const char *)data, len);
+}
+
+template<typename T>
+void writePod(std::ostream & stream, const T & val)
+{
+    writeRaw(stream, &val, sizeof(val));
+}
+
+void readRaw(std::istream & stream, void * data, size_t len)
+{
+    stream.read((char *)data, len);
+    if (stream.gcount() != len)
+        throw AnnotatedException(500, "Spill file is truncated");
+}
+
+template<typename T>
+T readPod(std::istream & stream)
+{
+    T result;
+    readRaw(stream, &result, sizeof(result));
+    return result;
+}
+
+void writeString(std::ostream & stream, const std::string & str)
+{
+    writePod<uint64_t>(stream, str.size());
+    writeRaw(stream, str.data(), str.size());
+}
+
+std::string readString(std::istream & stream)
+{
+    std::string result(readPod<uint64_t>(stream), '\0');
+    readRaw(stream, &result[0], result.size());
+    return result;
+}
+
+void writeDate(std::ostream & stream, Date ts)
+{
+    writePod<double>(stream, ts.secondsSinceEpoch());
+}
+
+Date readDate(std::istream & stream)
+{
+    return Date::fromSecondsSinceEpoch(readPod<double>(stream));
+}
+
+void writeCell(std::ostream & stream, const CellValue & cell)
+{
+    uint64_t len = cell.serializedBytes(true /* exact */);
+    std::string buf(len, '\0');
+    cell.serialize(&buf[0], len, true /* exact */);
+    writeString(stream, buf);
+}
+
+CellValue readCell(std::istream & stream)
+{
+    static const uint8_t format = CellValue::serializationFormat(true);
+    std::string buf = readString(stream);
+    return CellValue::reconstitute(buf.data(), buf.size(), format,
+                                   true /* exact */).first;
+}
+
+void writeValue(std::ostream & stream, const ExpressionValue & val)
+{
+    if (val.empty()) {
+        writePod<uint8_t>(stream, SPILLED_NONE);
+        writeDate(stream, val.getEffectiveTimestamp());
+    }
+    else if (val.isAtom()) {
+        writePod<uint8_t>(stream, SPILLED_ATOM);
+        writeDate(stream, val.getEffectiveTimestamp());
+        writeCell(stream, val.getAtom());
+    }
+    else if (val.isSuperposition()) {
+        writePod<uint8_t>(stream, SPILLED_SUPERPOSITION);
+        std::vector<const ExpressionValue *> values;
+        auto onValue = [&] (const ExpressionValue & v)
+            {
+                values.push_back(&v);
+                return true;
+            };
+        val.forEachSuperposedValue(onValue);
+        writePod<uint64_t>(stream, values.size());
+        for (auto v: values)
+            writeValue(stream, *v);
+    }
+    else if (val.isEmbedding()) {
+        // Embeddings are written as cells; the storage type is not kept
+        writePod<uint8_t>(stream, SPILLED_EMBEDDING);
+        writeDate(stream, val.getEffectiveTimestamp());
+        auto shape = val.getEmbeddingShape();
+        writePod<uint64_t>(stream, shape.size());
+        for (auto & d: shape)
+            writePod<uint64_t>(stream, d);
+        auto cells = val.getEmbeddingCell();
+        writePod<uint64_t>(stream, cells.size());
+        for (auto & c: cells)
+            writeCell(stream, c);
+    }
+    else {
+        writePod<uint8_t>(stream, SPILLED_STRUCTURED);
+        writePod<uint64_t>(stream, val.rowLength());
+        auto onColumn = [&] (const PathElement & columnName,
+                             const ExpressionValue & v)
+            {
+                writeString(stream, columnName.toUtf8String().rawString());
+                writeValue(stream, v);
+                return true;
+            };
+        val.forEachColumn(onColumn);
+    }
+}
+
+ExpressionValue readValue(std::istream & stream)
+{
+    uint8_t type = readPod<uint8_t>(stream);
+
+    switch (type) {
+    case SPILLED_NONE:
+        return ExpressionValue::null(readDate(stream));
+    case SPILLED_ATOM: {
+        Date ts = readDate(stream);
+        return ExpressionValue(readCell(stream), ts);
+    }
+    case SPILLED_SUPERPOSITION: {
+        std::vector<ExpressionValue> values(readPod<uint64_t>(stream));
+        for (auto & v: values)
+            v = readValue(stream);
+        return ExpressionValue::superpose(std::move(values));
+    }
+    case SPILLED_EMBEDDING: {
+        Date ts = readDate(stream);
+        DimsVector shape(readPod<uint64_t>(stream));
+        for (auto & d: shape)
+            d = readPod<uint64_t>(stream);
+        std::vector<CellValue> cells(readPod<uint64_t>(stream));
+        for (auto & c: cells)
+            c = readCell(stream);
+        return ExpressionValue(std::move(cells), ts, std::move(shape));
+    }
+    case SPILLED_STRUCTURED: {
+        StructValue columns(readPod<uint64_t>(stream));
+        for (auto & c: columns) {
+            std::get<0>(c) = PathElement(readString(stream));
+            std::get<1>(c) = readValue(stream);
+        }
+        return ExpressionValue(std::move(columns));
+    }
+    default:
+        throw AnnotatedException(500, "Unknown value type in spill file");
+    }
+}
+
+} // file scope
+
+SpillFile::
+SpillFile()
+    : writing(true)
+{
+    std::string compression = QUERY_SPILL_COMPRESSION;
+    std::string extension;
+    if (compression == "lz4")
+        extension = ".lz4";
+    else if (compression == "zstd")
+        extension = ".zst";
+    else if (compression != "none") {
+        throw AnnotatedException
+            (500, "Unknown MLDB_QUERY_SPILL_COMPRESSION '" + compression
+             + "': must be one of lz4, zstd or none");
+    }
+
+    std::string dir = QUERY_SPILL_DIR;
+    if (dir.empty())
+        dir = std::filesystem::temp_directory_path();
+
+    std::string pattern = dir + "/mldb-query-spill-XXXXXX" + extension;
+    int fd = ::mkstemps(&pattern[0], extension.size());
+    if (fd == -1)
+        throw Exception(errno, "creating query spill file in " + dir);
+    ::close(fd);
+    path = pattern;
+
+    out.open(path);
+}
+
+SpillFile::
+~SpillFile()
+{
+    ::unlink(path.c_str());
+}
+
+void
+SpillFile::
+write(const ExpressionValue & val)
+{
+    writeValue(out, val);
+}
+
+void
+SpillFile::
+write(const std::vector<ExpressionValue> & vals)
+{
+    writePod<uint64_t>(out, vals.size());
+    for (auto & v: vals)
+        writeValue(out, v);
+}
+
+void
+SpillFile::
+write(const NamedRowValue & row)
+{
+    writeCell(out, CellValue(row.rowName));
+    writePod<uint64_t>(out, row.rowHash.hash());
+    writePod<uint64_t>(out, row.columns.size());
+    for (auto & c: row.columns) {
+        writeString(out, std::get<0>(c).toUtf8String().rawString());
+        writeValue(out, std::get<1>(c));
+    }
+}
+
+void
+SpillFile::
+finishWriting()
+{
+    if (!writing)
+        return;
+    out.close();
+    writing = false;
+}
+
+void
+SpillFile::
+startReading()
+{
+    finishWriting();
+    in.open(path);
+}
+
+bool
+SpillFile::
+hasMore()
+{
+    return in.peek() != std::char_traits<char>::eof();
+}
+
+void
+SpillFile::
+read(ExpressionValue & val)
+{
+    val = readValue(in);
+}
+
+void
+SpillFile::
+read(std::vector<ExpressionValue> & vals)
+{
+    vals.resize(readPod<uint64_t>(in));
+    for (auto & v: vals)
+        v = readValue(in);
+}
+
+void
+SpillFile::
+read(NamedRowValue & row)
+{
+    row.rowName = readCell(in).coerceToPath();
+    row.rowHash = RowHash(readPod<uint64_t>(in));
+    row.columns.resize(readPod<uint64_t>(in));
+    for (auto & c: row.columns) {
+        std::get<0>(c) = PathElement(readString(in));
+        std::get<1>(c) = readValue(in);
+    }
+}
+
+} // namespace MLDB
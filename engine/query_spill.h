@@ -0,0 +1,130 @@
+/** query_spill.h                                                  -*- C++ -*-
+    Memory budget for query execution, and temporary files that sorted
+    runs and aggregation inputs are spilled to once it is exceeded.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include "mldb/vfs/filter_streams.h"
+#include <atomic>
+#include <mutex>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* QUERY MEMORY BUDGET                                                       */
+/*****************************************************************************/
+
+/** Tracks the approximate number of bytes of rows or groups that a query
+    holds in memory, against the budget of the innermost
+    QueryMemoryBudgetScope active on the thread that executes the query,
+    or otherwise the one set by the MLDB_QUERY_MEMORY_BUDGET environment
+    variable.  A budget of zero (the default) means that the query is
+    never asked to spill.
+*/
+
+struct QueryMemoryBudget {
+    QueryMemoryBudget();
+
+    /// Is there a budget at all?  If not, nothing needs to be tracked.
+    bool limited() const { return budget != 0; }
+
+    /// Record that bytes more are held in memory.  Returns true if the
+    /// query is now over budget and the caller should spill.
+    bool add(size_t bytes)
+    {
+        return (used += bytes) > budget;
+    }
+
+    /// Record that bytes have been released (normally by spilling them)
+    void release(size_t bytes)
+    {
+        used -= bytes;
+    }
+
+    size_t budget;
+    std::atomic<size_t> used;
+};
+
+/** Sets the memory budget of the queries that are executed by the
+    current thread while it is alive, which is how the memoryBudget
+    option of a query or procedure is applied.  A budget of zero leaves
+    the budget as it was.
+*/
+
+struct QueryMemoryBudgetScope {
+    QueryMemoryBudgetScope(size_t budget);
+    ~QueryMemoryBudgetScope();
+
+    QueryMemoryBudgetScope(const QueryMemoryBudgetScope &) = delete;
+    void operator = (const QueryMemoryBudgetScope &) = delete;
+
+private:
+    ssize_t oldBudget;
+};
+
+/** Approximate number of bytes of memory used by the given value,
+    including the value itself.
+*/
+size_t approximateMemusage(const ExpressionValue & val);
+size_t approximateMemusage(const std::vector<ExpressionValue> & vals);
+size_t approximateMemusage(const NamedRowValue & row);
+
+
+/*****************************************************************************/
+/* SPILL FILE                                                                */
+/*****************************************************************************/
+
+/** A compressed temporary file holding a sequence of records, which are
+    written in one pass and then read back in one pass in the same order.
+    The file lives in the directory given by MLDB_QUERY_SPILL_DIR (by
+    default the system temporary directory), is compressed according to
+    MLDB_QUERY_SPILL_COMPRESSION ("lz4", "zstd" or "none"; default "lz4")
+    and is removed when the object is destroyed.
+
+    The encoding is private to a single query execution; it is not a
+    persistent format.
+*/
+
+struct SpillFile {
+    SpillFile();
+    ~SpillFile();
+
+    SpillFile(const SpillFile &) = delete;
+    void operator = (const SpillFile &) = delete;
+
+    void write(const ExpressionValue & val);
+    void write(const std::vector<ExpressionValue> & vals);
+    void write(const NamedRowValue & row);
+
+    /// Finish writing and close the file, so that it doesn't hold a
+    /// file descriptor until it is read.
+    void finishWriting();
+
+    /// Finish writing if needed, and open the file at its first record.
+    /// Must be called once, before anything is read.
+    void startReading();
+
+    /// Is there another record to read?
+    bool hasMore();
+
+    void read(ExpressionValue & val);
+    void read(std::vector<ExpressionValue> & vals);
+    void read(NamedRowValue & row);
+
+    /// Mutex available to callers that write from more than one thread
+    std::mutex mutex;
+
+private:
+    std::string path;
+    bool writing;
+    filter_ostream out;
+    filter_istream in;
+};
+
+} // namespace MLDB
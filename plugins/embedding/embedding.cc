@@ -9,6 +9,8 @@
 
 #include "embedding.h"
 #include "mldb/utils/vantage_point_tree.h"
+#include "mldb/utils/hnsw_index.h"
+#include "mldb/utils/vector_quantizer.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
@@ -25,6 +27,7 @@
 #include "mldb/types/jml_serialization.h"
 #include "mldb/types/hash_wrapper_description.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
 #include "mldb/arch/timers.h"
 #include "mldb/engine/dataset_scope.h"
 #include "mldb/engine/bucket.h"
@@ -32,6 +35,10 @@
 #include "mldb/engine/dataset_utils.h"
 #include <boost/algorithm/clamp.hpp>
 #include "mldb/utils/log.h"
+#include "mldb/compiler/filesystem.h"
+#include <chrono>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -58,6 +65,38 @@ operator >> (MLDB::DB::Store_Reader & store, Path & coords);
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+EmbeddingIndexTypeDescription::
+EmbeddingIndexTypeDescription()
+{
+    addValue("vptree", EMBEDDING_INDEX_VPTREE,
+             "Vantage point tree, rebuilt from scratch on each commit.  "
+             "Neighbor queries are exact, but become slow for embeddings "
+             "with many dimensions.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Hierarchical navigable small world graph, which is added to "
+             "as each row is recorded.  Neighbor queries are approximate, "
+             "and stay fast for large embeddings with many dimensions.");
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingQuantization);
+
+EmbeddingQuantizationDescription::
+EmbeddingQuantizationDescription()
+{
+    addValue("none", EMBEDDING_QUANTIZATION_NONE,
+             "Rows are not quantized; neighbor queries use the index.");
+    addValue("int8", EMBEDDING_QUANTIZATION_INT8,
+             "Each dimension is quantized to one byte, spread between its "
+             "minimum and maximum value.  Scans touch 4 times less memory "
+             "than the float coordinates.");
+    addValue("pq", EMBEDDING_QUANTIZATION_PQ,
+             "Product quantization: the dimensions are split into "
+             "`pqSubspaces` groups, and each group is encoded in one byte "
+             "as the nearest of 256 centroids learnt by k-means.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 EmbeddingDatasetConfigDescription::
@@ -71,25 +110,216 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index used for nearest neighbors queries.  Options are "
+             "'vptree' (exact) and 'hnsw' (approximate, but much faster "
+             "for large embeddings).", EMBEDDING_INDEX_VPTREE);
+    addField("M", &EmbeddingDatasetConfig::M,
+             "For the 'hnsw' index, the number of neighbors each row is "
+             "linked to (twice as many on the bottom level of the graph).  "
+             "Higher values give better recall at the expense of memory "
+             "and recording speed.", 16);
+    addField("efConstruction", &EmbeddingDatasetConfig::efConstruction,
+             "For the 'hnsw' index, the number of candidates considered "
+             "when choosing the neighbors of a newly recorded row.  Higher "
+             "values give a better graph at the expense of recording "
+             "speed.", 200);
+    addField("efSearch", &EmbeddingDatasetConfig::efSearch,
+             "For the 'hnsw' index, the number of candidates considered by "
+             "a neighbors query (never less than the number of neighbors "
+             "asked for).  Higher values give better recall at the expense "
+             "of query speed.", 64);
+    addField("recallSamples", &EmbeddingDatasetConfig::recallSamples,
+             "For the 'hnsw' index, the number of rows whose neighbors are "
+             "compared against an exact search on each commit, to estimate "
+             "the recall shown in the dataset's status.  Each sample "
+             "requires a scan of the whole dataset; set to 0 to disable.",
+             10);
+    addField("quantization", &EmbeddingDatasetConfig::quantization,
+             "Compact encoding of the rows used to answer nearest neighbors "
+             "queries.  If set, queries scan the encoded rows (instead of "
+             "using the index, which must be 'vptree' and isn't built) "
+             "and re-rank the best candidates using the exact distance.",
+             EMBEDDING_QUANTIZATION_NONE);
+    addField("pqSubspaces", &EmbeddingDatasetConfig::pqSubspaces,
+             "For 'pq' quantization, the number of groups the dimensions "
+             "are split into, which is the number of bytes per row.  The "
+             "default of 0 uses one group per 8 dimensions.", 0);
+    addField("rerank", &EmbeddingDatasetConfig::rerank,
+             "For quantized rows, the number of candidates whose exact "
+             "distance is calculated for each neighbor asked for.  Higher "
+             "values give better recall at the expense of query speed.", 4);
+    addField("dataFileUrl", &EmbeddingDatasetConfig::dataFileUrl,
+             "URL of a file in which to persist the dataset, including its "
+             "index.  If the file exists, the dataset is loaded from it "
+             "when created; the file is rewritten on each commit.");
+    onPostValidate = [] (EmbeddingDatasetConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->M < 2)
+                throw MLDB::Exception("M must be >= 2");
+            if (config->efConstruction < 1)
+                throw MLDB::Exception("efConstruction must be >= 1");
+            if (config->efSearch < 1)
+                throw MLDB::Exception("efSearch must be >= 1");
+            if (config->pqSubspaces < 0)
+                throw MLDB::Exception("pqSubspaces must be >= 0");
+            if (config->rerank < 1)
+                throw MLDB::Exception("rerank must be >= 1");
+            if (config->quantization != EMBEDDING_QUANTIZATION_NONE
+                && config->index == EMBEDDING_INDEX_HNSW)
+                throw MLDB::Exception("quantization can't be used with the "
+                                      "hnsw index");
+        };
+}
+
+
+/*****************************************************************************/
+/* EMBEDDING DATASET STATUS                                                  */
+/*****************************************************************************/
+
+DEFINE_STRUCTURE_DESCRIPTION(EmbeddingDatasetStatus);
+
+EmbeddingDatasetStatusDescription::
+EmbeddingDatasetStatusDescription()
+{
+    addField("rowCount", &EmbeddingDatasetStatus::rowCount,
+             "Number of rows in the committed dataset");
+    addField("columnCount", &EmbeddingDatasetStatus::columnCount,
+             "Number of dimensions of the embedding");
+    addField("index", &EmbeddingDatasetStatus::index,
+             "Index used for nearest neighbors queries");
+    addField("quantization", &EmbeddingDatasetStatus::quantization,
+             "Encoding of the rows scanned by nearest neighbors queries");
+    addField("bytesPerRow", &EmbeddingDatasetStatus::bytesPerRow,
+             "Size of the encoding of each row scanned by nearest neighbors "
+             "queries; 0 if the rows are not quantized");
+    addField("numLevels", &EmbeddingDatasetStatus::numLevels,
+             "Number of levels of the HNSW graph");
+    addField("meanDegree", &EmbeddingDatasetStatus::meanDegree,
+             "Average number of neighbors of each row on the bottom level "
+             "of the HNSW graph");
+    addField("memoryUsage", &EmbeddingDatasetStatus::memoryUsage,
+             "Approximate memory used by the index and quantized rows, "
+             "in bytes");
+    addField("estimatedRecall", &EmbeddingDatasetStatus::estimatedRecall,
+             "Proportion of the true nearest neighbors returned by queries, "
+             "estimated at the last commit.  Always 1 for the exact index; "
+             "null if not estimated.");
+    addField("numQueries", &EmbeddingDatasetStatus::numQueries,
+             "Number of nearest neighbors queries answered");
+    addField("meanQueryMs", &EmbeddingDatasetStatus::meanQueryMs,
+             "Average time taken by a nearest neighbors query, in "
+             "milliseconds");
+    addField("meanDistancesPerQuery",
+             &EmbeddingDatasetStatus::meanDistancesPerQuery,
+             "Average number of distance calculations done by a nearest "
+             "neighbors query");
 }
 
 
+/*****************************************************************************/
+/* EXACT VECTORS                                                             */
+/*****************************************************************************/
+
+/** The exact coordinates of a run of rows that have been quantized.  They
+    are only needed to re-rank the candidates of each query (and to read
+    the rows back), so they are kept in a memory mapped temporary file
+    rather than on the heap, and the operating system can leave most of
+    them on disk.  The file is unlinked as soon as it is mapped, so that
+    it goes away with the mapping.
+*/
+
+struct ExactVectors {
+    /** Store the numRows rows starting at firstRow, whose numDims
+        coordinates are returned by getRow(row).
+    */
+    ExactVectors(size_t firstRow, size_t numRows, size_t numDims,
+                 const std::function<const float * (size_t)> & getRow)
+        : firstRow(firstRow), numRows(numRows), numDims(numDims),
+          bytes(numRows * numDims * sizeof(float)), mem(nullptr)
+    {
+        ExcAssertGreater(bytes, 0);
+
+        std::string pattern = std::filesystem::temp_directory_path().string()
+            + "/mldb-embedding-XXXXXX";
+        int fd = ::mkstemp(&pattern[0]);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "creating embedding vector file");
+        ::unlink(pattern.c_str());
+
+        if (::ftruncate(fd, bytes) == -1) {
+            int err = errno;
+            ::close(fd);
+            throw MLDB::Exception(err, "sizing embedding vector file");
+        }
+
+        mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+        int err = errno;
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            mem = nullptr;
+            throw MLDB::Exception(err, "mapping embedding vector file");
+        }
+
+        float * out = (float *)mem;
+        for (size_t i = 0;  i < numRows;  ++i) {
+            std::copy_n(getRow(firstRow + i), numDims, out + i * numDims);
+        }
+
+        ::mprotect(mem, bytes, PROT_READ);
+    }
+
+    ~ExactVectors()
+    {
+        if (mem)
+            ::munmap(mem, bytes);
+    }
+
+    ExactVectors(const ExactVectors &) = delete;
+    void operator = (const ExactVectors &) = delete;
+
+    /// Coordinates of the given row, which must be in the run
+    const float * row(size_t row) const
+    {
+        ExcAssertGreaterEqual(row, firstRow);
+        ExcAssertLess(row, firstRow + numRows);
+        return (const float *)mem + (row - firstRow) * numDims;
+    }
+
+    size_t firstRow;
+    size_t numRows;
+    size_t numDims;
+    size_t bytes;
+    void * mem;
+};
+
+
 /*****************************************************************************/
 /* EMBEDDING INTERNAL REPRESENTATION                                         */
 /*****************************************************************************/
 
 struct EmbeddingDatasetRepr {
-    EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new MLDB::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+    EmbeddingDatasetRepr(const EmbeddingDatasetConfig & config)
+        : metric(config.metric),
+          vpTree(new MLDB::VantagePointTreeT<int>()),
+          hnsw(createHnsw(config)),
+          distance(DistanceMetric::create(metric)),
+          quantization(config.quantization),
+          pqSubspaces(config.pqSubspaces)
     {
     }
 
     EmbeddingDatasetRepr(std::vector<ColumnPath> columnNames,
-                         MetricSpace metric)
+                         const EmbeddingDatasetConfig & config)
         : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
+          metric(config.metric),
           vpTree(new MLDB::VantagePointTreeT<int>()),
-          distance(DistanceMetric::create(metric))
+          hnsw(createHnsw(config)),
+          distance(DistanceMetric::create(metric)),
+          quantization(config.quantization),
+          pqSubspaces(config.pqSubspaces)
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
             columnIndex[this->columnNames[i]] = i;
@@ -102,10 +332,29 @@ struct EmbeddingDatasetRepr {
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(MLDB::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          metric(other.metric),
+          vpTree(MLDB::VantagePointTreeT<int>::deepCopy(other.vpTree.get())),
+          hnsw(other.hnsw ? new HnswIndex(*other.hnsw) : nullptr),
+          // The distance metric caches per-row values, which need to be
+          // there for the rows that will be added to the copy
+          distance(other.distance->clone()),
+          estimatedRecall(other.estimatedRecall),
+          quantization(other.quantization),
+          pqSubspaces(other.pqSubspaces),
+          quantizer(other.quantizer),
+          trainedRows(other.trainedRows),
+          codes(other.codes),
+          exactVectors(other.exactVectors)
     {
     }
 
+    static HnswIndex * createHnsw(const EmbeddingDatasetConfig & config)
+    {
+        if (config.index != EMBEDDING_INDEX_HNSW)
+            return nullptr;
+        return new HnswIndex(config.M, config.efConstruction);
+    }
+
     // Unfortunately, both '0' and 'null' hash to the same thing.  To
     // allow loading with both of these present, we rehash those into
     // different identifiers.
@@ -142,13 +391,24 @@ struct EmbeddingDatasetRepr {
         }
 
         RowPath rowName;
-        distribution<float> coords;
+        distribution<float> coords;  ///< Empty once in exactVectors
         Date timestamp;
 
-        void serialize(MLDB::DB::Store_Writer & store) const
+        /// Serialize, with the given coordinates (see getCoords())
+        void serialize(MLDB::DB::Store_Writer & store,
+                       const distribution<float> & coords) const
         {
             store << rowName.toUtf8String() << coords << timestamp;
         }
+
+        static Row reconstitute(MLDB::DB::Store_Reader & store)
+        {
+            Utf8String rowName;
+            distribution<float> coords;
+            Date timestamp;
+            store >> rowName >> coords >> timestamp;
+            return Row(RowPath::parse(rowName), std::move(coords), timestamp);
+        }
     };
 
     float dist(unsigned row1, unsigned row2) const
@@ -159,9 +419,10 @@ struct EmbeddingDatasetRepr {
         if (row1 == row2)
             return 0.0f;
         
+        distribution<float> storage1, storage2;
         float result = distance->dist(row1, row2,
-                                      rows[row1].coords,
-                                      rows[row2].coords);
+                                      getCoords(row1, storage1),
+                                      getCoords(row2, storage2));
         
         ExcAssert(isfinite(result));
         return result;
@@ -172,8 +433,9 @@ struct EmbeddingDatasetRepr {
         ExcAssertLess(row1, rows.size());
         ExcAssertEqual(row2.size(), columns.size());
         
+        distribution<float> storage;
         float result = distance->dist(row1, -1,
-                                      rows[row1].coords,
+                                      getCoords(row1, storage),
                                       row2);
         ExcAssert(isfinite(result));
         return result;
@@ -207,9 +469,149 @@ struct EmbeddingDatasetRepr {
     std::vector<Row> rows;
     LightweightHash<uint64_t, int> rowIndex;
     
+    MetricSpace metric;
     std::unique_ptr<MLDB::VantagePointTreeT<int> > vpTree;
+    std::unique_ptr<HnswIndex> hnsw;  ///< Null unless the index is hnsw
     std::unique_ptr<DistanceMetric> distance;
 
+    /// Recall of approximate queries estimated at the last commit
+    double estimatedRecall = std::numeric_limits<double>::quiet_NaN();
+
+    EmbeddingQuantization quantization;
+    int pqSubspaces;
+
+    /// Quantizer for the rows; see quantize() for when it's retrained
+    std::shared_ptr<const VectorQuantizer> quantizer;
+
+    /// Number of rows there were when the quantizer was trained
+    size_t trainedRows = 0;
+
+    /// Codes of the quantized rows, quantizer->codeSize() bytes per row
+    std::vector<uint8_t> codes;
+
+    /** Exact coordinates of the quantized rows, in runs of consecutive
+        rows.  Runs are immutable, and so are shared between copies.
+    */
+    std::vector<std::shared_ptr<const ExactVectors> > exactVectors;
+
+    /// Number of rows (from the first) whose coordinates are in exactVectors
+    size_t numExactRows() const
+    {
+        if (exactVectors.empty())
+            return 0;
+        return exactVectors.back()->firstRow + exactVectors.back()->numRows;
+    }
+
+    /** Return the coordinates of the given row.  If they need to be read
+        from exactVectors, they are copied into storage.
+    */
+    const distribution<float> &
+    getCoords(size_t row, distribution<float> & storage) const
+    {
+        ExcAssertLess(row, rows.size());
+        if (row >= numExactRows())
+            return rows[row].coords;
+
+        auto it = std::upper_bound
+            (exactVectors.begin(), exactVectors.end(), row,
+             [] (size_t row, const std::shared_ptr<const ExactVectors> & v)
+             {
+                 return row < v->firstRow;
+             });
+        const ExactVectors & vectors = **std::prev(it);
+        const float * coords = vectors.row(row);
+        storage.assign(coords, coords + vectors.numDims);
+        return storage;
+    }
+
+    /** Move the coordinates of the rows that have been quantized since
+        the last call into exactVectors, freeing them from the heap.
+    */
+    void storeExactVectors();
+
+    /** Write the vector that is quantized for the given coordinates to
+        out.  Vectors are normalized for the cosine metric, so that the
+        (euclidean) quantized distances rank rows in the same order.
+    */
+    void quantizedVector(const distribution<float> & coords, float * out) const
+    {
+        std::copy(coords.begin(), coords.end(), out);
+        if (metric != METRIC_COSINE)
+            return;
+        float norm = coords.two_norm();
+        if (norm > 0) {
+            for (size_t i = 0;  i < coords.size();  ++i)
+                out[i] /= norm;
+        }
+    }
+
+    /** Encode the rows that haven't been yet, training the quantizer on
+        a sample of the rows first if necessary, and then move their exact
+        coordinates out of the heap.
+
+        The quantizer is retrained, and all rows encoded again, once the
+        number of rows has doubled since it was trained.  The int8 ranges
+        are also widened as soon as a row falls outside of them.
+    */
+    void quantize();
+
+    /// Nearest neighbors found by scanning the quantized rows
+    std::vector<std::pair<float, int> >
+    searchQuantized(const distribution<float> & query,
+                    const std::function<float (int)> & dist,
+                    int numNeighbors, double maxDistance, int rerank,
+                    size_t & numDistances) const;
+
+    /// Is the result of search() approximate?
+    bool isApproximate() const
+    {
+        return hnsw || quantizer;
+    }
+
+    /** Add the given row, which must be the last one, to the hnsw index.
+        Does nothing for the vantage point tree, which is built on commit.
+    */
+    void indexRow(int row)
+    {
+        if (!hnsw)
+            return;
+        hnsw->insert(row, [&] (int row1, int row2) { return dist(row1, row2); });
+    }
+
+    /// Build the vantage point tree over all rows
+    void buildVpTree();
+
+    /** Return the nearest neighbors of a point, as (distance, row) pairs.
+        dist(i) gives the distance between the point (whose coordinates
+        are query) and row i.  Adds the number of distances calculated to
+        numDistances.
+    */
+    std::vector<std::pair<float, int> >
+    search(const distribution<float> & query,
+           const std::function<float (int)> & dist,
+           int numNeighbors, double maxDistance,
+           const EmbeddingDatasetConfig & config,
+           size_t & numDistances) const
+    {
+        if (quantizer) {
+            return searchQuantized(query, dist, numNeighbors, maxDistance,
+                                   config.rerank, numDistances);
+        }
+
+        if (hnsw) {
+            return hnsw->search(dist, numNeighbors, config.efSearch,
+                                maxDistance, &numDistances);
+        }
+
+        auto countedDist = [&] (int item)
+            {
+                ++numDistances;
+                return dist(item);
+            };
+
+        return vpTree->search(countedDist, numNeighbors, maxDistance);
+    }
+
     void save(const std::string & filename)
     {
         filter_ostream stream(filename);
@@ -220,16 +622,240 @@ struct EmbeddingDatasetRepr {
         // Make sure that we saved properly
         stream.close();
     }
+
+    void load(const std::string & filename)
+    {
+        filter_istream stream(filename);
+        MLDB::DB::Store_Reader store(stream);
+        reconstitute(store);
+    }
+
     void serialize(MLDB::DB::Store_Writer & store) const;
+    void reconstitute(MLDB::DB::Store_Reader & store);
 };
 
 const RowHash EmbeddingDatasetRepr::nullHashIn(RowPath("null"));
 
-MLDB::DB::Store_Writer &
-operator << (MLDB::DB::Store_Writer & store, const EmbeddingDatasetRepr::Row & row)
+void
+EmbeddingDatasetRepr::
+buildVpTree()
 {
-    row.serialize(store);
-    return store;
+    std::vector<int> items;
+    for (unsigned i = 0;  i < rows.size();  ++i) {
+        items.push_back(i);
+    }
+
+    // Function used to build the VP tree, that scans all of the items in
+    // parallel.
+    auto dist = [&] (int item, const std::vector<int> & items, int depth)
+        -> distribution<float>
+        {
+            ExcAssertLessEqual(depth, 100);  // 2^100 items is enough
+
+            distribution<float> result(items.size());
+
+            auto doItem = [&] (int n)
+            {
+                int i = items[n];
+
+                result[n] = this->dist(item, i);
+
+                if (item == i)
+                    ExcAssertEqual(result[n], 0.0);
+
+                ExcAssert(isfinite(result[n]));
+            };
+
+            if (items.size() < 10000 || depth > 2) {
+                for (unsigned n = 0;  n < items.size();  ++n)
+                    doItem(n);
+            }
+            else parallelMap(0, items.size(), doItem);
+
+            return result;
+        };
+
+    // Create the VP tree for indexed lookups on distance
+    vpTree.reset(MLDB::VantagePointTreeT<int>::createParallel(items, dist));
+}
+
+void
+EmbeddingDatasetRepr::
+quantize()
+{
+    if (quantization == EMBEDDING_QUANTIZATION_NONE || rows.empty())
+        return;
+
+    size_t numDims = columnNames.size();
+    size_t numEncoded = quantizer ? codes.size() / quantizer->codeSize() : 0;
+
+    // Once the rows have doubled, the sample that the quantizer was
+    // trained on no longer represents them well, so it's retrained
+    if (quantizer && rows.size() >= 2 * trainedRows)
+        quantizer.reset();
+
+    if (!quantizer) {
+        // Train on an evenly spaced sample of the rows, rather than a copy
+        // of all of them
+        static constexpr size_t MAX_TRAINING_ROWS = 65536;
+        size_t numTraining = std::min(rows.size(), MAX_TRAINING_ROWS);
+        std::vector<float> training(numTraining * numDims);
+        distribution<float> storage;
+        for (size_t i = 0;  i < numTraining;  ++i) {
+            quantizedVector(getCoords(i * rows.size() / numTraining, storage),
+                            &training[i * numDims]);
+        }
+
+        if (quantization == EMBEDDING_QUANTIZATION_INT8) {
+            quantizer = std::make_shared<ScalarQuantizer>
+                (training.data(), numTraining, numDims);
+        }
+        else {
+            int numSubspaces = pqSubspaces;
+            if (numSubspaces == 0)
+                numSubspaces = std::max<int>(1, numDims / 8);
+            numSubspaces = std::min<int>(numSubspaces, numDims);
+            quantizer = std::make_shared<ProductQuantizer>
+                (training.data(), numTraining, numDims, numSubspaces);
+        }
+
+        trainedRows = rows.size();
+        codes.clear();
+    }
+    else if (quantization == EMBEDDING_QUANTIZATION_INT8) {
+        // Widen the ranges to take in new rows that fall outside of them,
+        // rather than clamping those rows
+        const ScalarQuantizer & current
+            = dynamic_cast<const ScalarQuantizer &>(*quantizer);
+        std::shared_ptr<ScalarQuantizer> widened;
+        PossiblyDynamicBuffer<float> vec(numDims);
+        for (size_t i = numEncoded;  i < rows.size();  ++i) {
+            quantizedVector(rows[i].coords, vec.data());
+            if ((widened ? *widened : current).inRange(vec.data()))
+                continue;
+            if (!widened)
+                widened = std::make_shared<ScalarQuantizer>(current);
+            widened->widen(vec.data());
+        }
+
+        if (widened) {
+            quantizer = std::move(widened);
+            codes.clear();
+        }
+    }
+
+    // Rows recorded since the last commit are encoded with the existing
+    // quantizer, or all of them if it's new
+    size_t codeSize = quantizer->codeSize();
+    numEncoded = codes.size() / codeSize;
+    codes.resize(rows.size() * codeSize);
+
+    auto encodeRow = [&] (size_t i)
+        {
+            distribution<float> storage;
+            PossiblyDynamicBuffer<float> vec(numDims);
+            quantizedVector(getCoords(i, storage), vec.data());
+            quantizer->encode(vec.data(), &codes[i * codeSize]);
+        };
+
+    parallelMap(numEncoded, rows.size(), encodeRow);
+
+    storeExactVectors();
+}
+
+void
+EmbeddingDatasetRepr::
+storeExactVectors()
+{
+    size_t start = numExactRows();
+    size_t numDims = columnNames.size();
+    if (start == rows.size() || numDims == 0)
+        return;
+
+    exactVectors.emplace_back
+        (std::make_shared<ExactVectors>
+         (start, rows.size() - start, numDims,
+          [&] (size_t i)
+          {
+              ExcAssertEqual(rows[i].coords.size(), numDims);
+              return rows[i].coords.data();
+          }));
+
+    for (size_t i = start;  i < rows.size();  ++i)
+        distribution<float>().swap(rows[i].coords);
+}
+
+std::vector<std::pair<float, int> >
+EmbeddingDatasetRepr::
+searchQuantized(const distribution<float> & query,
+                const std::function<float (int)> & dist,
+                int numNeighbors, double maxDistance, int rerank,
+                size_t & numDistances) const
+{
+    size_t codeSize = quantizer->codeSize();
+    size_t numRows = codes.size() / codeSize;
+    size_t numCandidates
+        = std::min<size_t>(numRows, (size_t)numNeighbors * rerank);
+    if (numCandidates == 0)
+        return {};
+
+    PossiblyDynamicBuffer<float> queryVec(query.size());
+    quantizedVector(query, queryVec.data());
+
+    // What the distances need from the query (the lookup table for
+    // product quantization) is calculated once, not once per chunk
+    std::vector<float> prepared = quantizer->prepareQuery(queryVec.data());
+
+    // Scan the codes in chunks, keeping the best candidates of each
+    static constexpr size_t CHUNK_SIZE = 16384;
+    std::vector<std::pair<float, int> > candidates;
+    std::mutex candidatesMutex;
+
+    auto scanChunk = [&] (size_t start, size_t end)
+        {
+            std::vector<float> distances(end - start);
+            quantizer->squaredDistances(prepared,
+                                        &codes[start * codeSize],
+                                        end - start, distances.data());
+
+            std::vector<std::pair<float, int> > best;
+            best.reserve(distances.size());
+            for (size_t i = 0;  i < distances.size();  ++i)
+                best.emplace_back(distances[i], start + i);
+            if (best.size() > numCandidates) {
+                std::nth_element(best.begin(), best.begin() + numCandidates,
+                                 best.end());
+                best.resize(numCandidates);
+            }
+
+            std::unique_lock<std::mutex> guard(candidatesMutex);
+            candidates.insert(candidates.end(), best.begin(), best.end());
+        };
+
+    parallelMapChunked(0, numRows, CHUNK_SIZE, scanChunk);
+
+    if (candidates.size() > numCandidates) {
+        std::nth_element(candidates.begin(),
+                         candidates.begin() + numCandidates,
+                         candidates.end());
+        candidates.resize(numCandidates);
+    }
+
+    // Re-rank the candidates using their exact distance
+    for (auto & c: candidates)
+        c.first = dist(c.second);
+    std::sort(candidates.begin(), candidates.end());
+
+    numDistances += numRows + candidates.size();
+
+    std::vector<std::pair<float, int> > result;
+    for (auto & c: candidates) {
+        if (result.size() == numNeighbors || c.first > maxDistance)
+            break;
+        result.push_back(c);
+    }
+
+    return result;
 }
 
 void
@@ -237,24 +863,141 @@ EmbeddingDatasetRepr::
 serialize(MLDB::DB::Store_Writer & store) const
 {
     store << string("EMBEDDING_DATASET")
-          << MLDB::DB::compact_size_t(1);  // version
-    store << columnNames << columns << rows;
-    vpTree->serialize(store);
+          << MLDB::DB::compact_size_t(3);  // version
+    store << columnNames << columns
+          << MLDB::DB::compact_size_t(rows.size());
+    distribution<float> storage;
+    for (size_t i = 0;  i < rows.size();  ++i)
+        rows[i].serialize(store, getCoords(i, storage));
+    if (hnsw) {
+        store << MLDB::DB::compact_size_t(EMBEDDING_INDEX_HNSW);
+        hnsw->serialize(store);
+    }
+    else {
+        store << MLDB::DB::compact_size_t(EMBEDDING_INDEX_VPTREE);
+        vpTree->serialize(store);
+    }
+    if (quantizer) {
+        store << MLDB::DB::compact_size_t(1);
+        quantizer->serialize(store);
+        store << codes;
+    }
+    else {
+        store << MLDB::DB::compact_size_t(0);
+    }
+}
+
+void
+EmbeddingDatasetRepr::
+reconstitute(MLDB::DB::Store_Reader & store)
+{
+    string magic;
+    store >> magic;
+    if (magic != "EMBEDDING_DATASET")
+        throw AnnotatedException(400, "File is not a saved embedding dataset");
+    MLDB::DB::compact_size_t version(store);
+    if (version < 1 || version > 3)
+        throw AnnotatedException(400, "Unknown embedding dataset version "
+                                 + std::to_string(version));
+
+    store >> columnNames >> columns;
+
+    MLDB::DB::compact_size_t numRows(store);
+    rows.clear();
+    exactVectors.clear();
+    rows.reserve(numRows);
+    for (size_t i = 0;  i < numRows;  ++i)
+        rows.emplace_back(Row::reconstitute(store));
+
+    columnIndex.clear();
+    for (unsigned i = 0;  i < columnNames.size();  ++i)
+        columnIndex[columnNames[i]] = i;
+
+    rowIndex.clear();
+    distance.reset(DistanceMetric::create(metric));
+    for (unsigned i = 0;  i < rows.size();  ++i) {
+        rowIndex[getRowHashForIndex(rows[i].rowName)] = i;
+        distance->addRow(i, rows[i].coords);
+    }
+
+    // Version 1 only had a vantage point tree
+    int indexType = EMBEDDING_INDEX_VPTREE;
+    if (version >= 2)
+        indexType = MLDB::DB::compact_size_t(store);
+
+    bool wantHnsw = hnsw != nullptr;
+    bool haveIndex = false;
+
+    if (indexType == EMBEDDING_INDEX_HNSW) {
+        std::unique_ptr<HnswIndex> loaded(new HnswIndex());
+        loaded->reconstitute(store);
+        if (wantHnsw) {
+            hnsw = std::move(loaded);
+            haveIndex = true;
+        }
+    }
+    else {
+        vpTree->reconstitute(store);
+        haveIndex = !wantHnsw;
+    }
+
+    // Version 3 added quantized rows
+    std::shared_ptr<VectorQuantizer> loadedQuantizer;
+    std::vector<uint8_t> loadedCodes;
+    if (version >= 3 && MLDB::DB::compact_size_t(store)) {
+        loadedQuantizer = VectorQuantizer::reconstitute(store);
+        store >> loadedCodes;
+    }
+
+    // The vantage point tree isn't built for quantized datasets
+    if (loadedQuantizer && indexType == EMBEDDING_INDEX_VPTREE)
+        haveIndex = false;
+
+    bool sameQuantization
+        = loadedQuantizer
+        && ((quantization == EMBEDDING_QUANTIZATION_INT8
+             && dynamic_cast<ScalarQuantizer *>(loadedQuantizer.get()))
+            || (quantization == EMBEDDING_QUANTIZATION_PQ
+                && dynamic_cast<ProductQuantizer *>(loadedQuantizer.get())));
+
+    if (sameQuantization) {
+        quantizer = std::move(loadedQuantizer);
+        codes = std::move(loadedCodes);
+        trainedRows = rows.size();
+        storeExactVectors();
+    }
+    else quantize();
+
+    // If the saved index isn't the one we were asked for, build it
+    if (haveIndex || quantizer)
+        return;
+
+    if (wantHnsw) {
+        for (unsigned i = 0;  i < rows.size();  ++i)
+            indexRow(i);
+    }
+    else buildVpTree();
 }
 
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr),
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), committed(lock, config), uncommitted(nullptr),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
-    }
+        if (config.dataFileUrl.empty())
+            return;
 
-    // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address),
-          logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
-    {
+        address = config.dataFileUrl.toDecodedString();
+
+        if (!tryGetUriObjectInfo(address).exists)
+            return;
+
+        INFO_MSG(logger) << "loading embedding from " << address;
+        std::unique_ptr<EmbeddingDatasetRepr> loaded
+            (new EmbeddingDatasetRepr(config));
+        loaded->load(address);
+        committed.replace(loaded.release());
     }
 
     ~Itl()
@@ -262,7 +1005,7 @@ struct EmbeddingDataset::Itl
         delete uncommitted.load();
     }
 
-    MetricSpace metric;
+    EmbeddingDatasetConfig config;
 
     GcLock lock;
     RcuProtected<EmbeddingDatasetRepr> committed;
@@ -277,6 +1020,11 @@ struct EmbeddingDataset::Itl
 
     shared_ptr<spdlog::logger> logger;
 
+    // Statistics on nearest neighbor queries
+    std::atomic<uint64_t> numQueries{0};
+    std::atomic<uint64_t> queryNanoseconds{0};
+    std::atomic<uint64_t> queryDistances{0};
+
     virtual std::vector<RowPath>
     getRowPaths(ssize_t start = 0, ssize_t limit = -1) const override
     {
@@ -385,12 +1133,16 @@ struct EmbeddingDataset::Itl
         if (row.rowName != rowName)
             return MatrixNamedRow();
 
+        distribution<float> storage;
+        const distribution<float> & coords
+            = repr->getCoords(it->second, storage);
+
         MatrixNamedRow result;
         result.rowHash = result.rowName = rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -408,13 +1160,17 @@ struct EmbeddingDataset::Itl
         
         const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
 
+        distribution<float> storage;
+        const distribution<float> & coords
+            = repr->getCoords(it->second, storage);
+
         MatrixRow result;
         result.rowHash = rowHash;
         result.rowName = row.rowName;
-        result.columns.reserve(row.coords.size());
+        result.columns.reserve(coords.size());
 
-        for (unsigned i = 0;  i < row.coords.size();  ++i) {
-            result.columns.emplace_back(repr->columnNames[i], row.coords[i],
+        for (unsigned i = 0;  i < coords.size();  ++i) {
+            result.columns.emplace_back(repr->columnNames[i], coords[i],
                                         row.timestamp);
         }
         return result;
@@ -672,7 +1428,7 @@ struct EmbeddingDataset::Itl
         if (!uncommitted) {
             if (!repr->initialized()) {
                 // First commit; we just learnt the column names
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -729,6 +1485,7 @@ struct EmbeddingDataset::Itl
                                                  ts);
                 (*uncommitted).distance->addRow(numRowsBefore,
                                                 (*uncommitted).rows.back().coords);
+                (*uncommitted).indexRow(numRowsBefore);
             } catch (const std::exception & exc) {
                 // If there is an exception, keep the data structure consistent
                 (*uncommitted).rowIndex[rowHash] = -1;
@@ -791,7 +1548,7 @@ struct EmbeddingDataset::Itl
                 
                 //DEBUG_MSG(logger) << "columnNames = " << columnNames;
                 
-                uncommitted = new EmbeddingDatasetRepr(columnNames, metric);
+                uncommitted = new EmbeddingDatasetRepr(columnNames, config);
             }
             else {
                 uncommitted = new EmbeddingDatasetRepr(*repr);
@@ -858,6 +1615,7 @@ struct EmbeddingDataset::Itl
                                              latestDate);
             (*uncommitted).distance->addRow(numRowsBefore,
                                             (*uncommitted).rows.back().coords);
+            (*uncommitted).indexRow(numRowsBefore);
         } catch (const std::exception & exc) {
             // If there is an exception, keep the data structure consistent
             (*uncommitted).rowIndex[rowHash] = -1;
@@ -876,6 +1634,11 @@ struct EmbeddingDataset::Itl
         if (!uncommitted)
             return;
 
+        // Rows from earlier commits are already in the column index (and
+        // their coordinates may no longer be in memory)
+        size_t numIndexed = (*uncommitted).columns.empty()
+            ? 0 : (*uncommitted).columns[0].size();
+
         for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
             (*uncommitted).columns[j].resize((*uncommitted).rows.size());
 
@@ -886,63 +1649,137 @@ struct EmbeddingDataset::Itl
                     (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
             };
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+        parallelMap(numIndexed, (*uncommitted).rows.size(), indexRow);
 
-        // Create the vantage point tree
-        INFO_MSG(logger) << "creating vantage point tree";
         Timer timer;
+
+        if (config.quantization != EMBEDDING_QUANTIZATION_NONE) {
+            INFO_MSG(logger) << "quantizing embedding";
+            (*uncommitted).quantize();
+            INFO_MSG(logger) << "quantized in " << timer.elapsed();
+        }
+        else if ((*uncommitted).hnsw) {
+            // The graph was built as the rows were recorded
+        }
+        else {
+            // Create the vantage point tree
+            INFO_MSG(logger) << "creating vantage point tree";
+            (*uncommitted).buildVpTree();
+            INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
+        }
+
+        if ((*uncommitted).isApproximate()) {
+            Timer recallTimer;
+            (*uncommitted).estimatedRecall = estimateRecall(*uncommitted);
+            INFO_MSG(logger) << "recall " << (*uncommitted).estimatedRecall
+                             << " estimated in " << recallTimer.elapsed();
+        }
         
-        std::vector<int> items;
-        for (unsigned i = 0;  i < (*uncommitted).rows.size();  ++i) {
-            items.push_back(i);
+        committed.replace(uncommitted);
+        uncommitted = nullptr;
+
+        if (!address.empty()) {
+            INFO_MSG(logger) << "saving embedding";
+            makeUriDirectory(address);
+            committed()->save(address);
         }
+    }
 
-        // Function used to build the VP tree, that scans all of the items in
-        // parallel.
-        auto dist = [&] (int item, const std::vector<int> & items, int depth)
-            -> distribution<float>
+    /** Estimate the recall of approximate queries by comparing the
+        neighbors of a sample of rows against those found by looking at
+        every row.
+        Neighbors found that are no further away than the true kth
+        nearest neighbor count as correct, so that ties don't matter.
+    */
+    double estimateRecall(const EmbeddingDatasetRepr & repr) const
+    {
+        static constexpr int numNeighbors = 10;
+
+        size_t numRows = repr.rows.size();
+        size_t numSamples = std::min<size_t>(std::max(config.recallSamples, 0),
+                                             numRows);
+        if (numSamples == 0)
+            return std::numeric_limits<double>::quiet_NaN();
+
+        size_t k = std::min<size_t>(numNeighbors, numRows);
+        std::atomic<size_t> numFound(0);
+
+        auto doSample = [&] (size_t n)
             {
-                ExcAssertLessEqual(depth, 100);  // 2^100 items is enough
+                int row = n * numRows / numSamples;
+
+                std::vector<float> exact(numRows);
+                for (size_t i = 0;  i < numRows;  ++i)
+                    exact[i] = repr.dist(row, i);
+                std::nth_element(exact.begin(), exact.begin() + k - 1,
+                                 exact.end());
+                float kthDistance = exact[k - 1];
+
+                size_t numDistances = 0;
+                distribution<float> storage;
+                auto found = repr.search(repr.getCoords(row, storage),
+                                         [&] (int i) { return repr.dist(row, i); },
+                                         k, INFINITY, config, numDistances);
+                for (auto & f: found) {
+                    if (f.first <= kthDistance)
+                        ++numFound;
+                }
+            };
 
-                distribution<float> result(items.size());
+        parallelMap(0, numSamples, doSample);
 
-                auto doItem = [&] (int n)
-                {
-                    int i = items[n];
+        return 1.0 * numFound / (numSamples * k);
+    }
 
-                    result[n] = (*uncommitted).dist(item, i);
+    /// Record the time taken and distances calculated by a query
+    void recordQuery(std::chrono::steady_clock::time_point start,
+                     size_t numDistances)
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        numQueries += 1;
+        queryNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>
+            (elapsed).count();
+        queryDistances += numDistances;
+    }
 
-                    if (item == i)
-                        ExcAssertEqual(result[n], 0.0);
+    EmbeddingDatasetStatus getStatus() const
+    {
+        EmbeddingDatasetStatus result;
 
-                    if (!isfinite(result[n])) {
-                        INFO_MSG(logger) << "dist between " << i << " and " << item << " is "
-                             << result.back();
-                    }
-                    ExcAssert(isfinite(result[n]));
-                };
+        auto repr = committed();
+        if (repr->initialized()) {
+            result.rowCount = repr->rows.size();
+            result.columnCount = repr->columnNames.size();
+        }
 
-                if (items.size() < 10000 || depth > 2) {
-                    for (unsigned n = 0;  n < items.size();  ++n)
-                        doItem(n);
-                }
-                else parallelMap(0, items.size(), doItem);
-                
-                return result;
-            };
-        
-        // Create the VP tree for indexed lookups on distance
-        (*uncommitted).vpTree.reset(MLDB::VantagePointTreeT<int>::createParallel(items, dist));
+        if (repr->hnsw) {
+            result.index = EMBEDDING_INDEX_HNSW;
+            result.numLevels = repr->hnsw->numLevels();
+            result.meanDegree = repr->hnsw->meanDegree();
+            result.memoryUsage = repr->hnsw->memusage();
+        }
+        else {
+            result.index = EMBEDDING_INDEX_VPTREE;
+            result.memoryUsage = repr->vpTree->memusage();
+        }
 
-        INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
-        
-        committed.replace(uncommitted);
-        uncommitted = nullptr;
+        if (repr->quantizer) {
+            result.quantization = repr->quantization;
+            result.bytesPerRow = repr->quantizer->codeSize();
+            result.memoryUsage += repr->codes.capacity();
+        }
 
-        if (!address.empty()) {
-            INFO_MSG(logger) << "saving embedding";
-            committed()->save(address);
+        result.estimatedRecall
+            = repr->isApproximate() ? repr->estimatedRecall : 1.0;
+
+        result.numQueries = numQueries;
+        if (result.numQueries > 0) {
+            result.meanQueryMs = queryNanoseconds / 1000000.0 / result.numQueries;
+            result.meanDistancesPerQuery
+                = 1.0 * queryDistances / result.numQueries;
         }
+
+        return result;
     }
 
     vector<tuple<RowPath, RowHash, float> >
@@ -961,11 +1798,13 @@ struct EmbeddingDataset::Itl
             return result;
         };
 
-        //Timer timer;
+        auto start = std::chrono::steady_clock::now();
+        size_t numDistances = 0;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto neighbors = repr->search(coord, dist, numNeighbors, maxDistance,
+                                      config, numDistances);
 
-        //DEBUG_MSG(logger) << "neighbors took " << timer.elapsed();
+        recordQuery(start, numDistances);
 
         DEBUG_MSG(logger) << "neighbors = " << jsonEncode(neighbors);
         
@@ -1003,7 +1842,16 @@ struct EmbeddingDataset::Itl
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        auto start = std::chrono::steady_clock::now();
+        size_t numDistances = 0;
+
+        distribution<float> storage;
+        auto neighbors = repr->search(repr->getCoords(it->second, storage),
+                                      dist,
+                                      numNeighbors, maxDistance, config,
+                                      numDistances);
+
+        recordQuery(start, numDistances);
 
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -1037,17 +1885,7 @@ EmbeddingDataset(MldbEngine * owner,
     : Dataset(owner)
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
-#if 1
-    itl.reset(new Itl(datasetConfig.metric));
-#else // once persistence is done
-
-    if (!config.address.empty()) {
-        itl.reset(new Itl(config.address));
-    }
-    else {
-        itl.reset(new Itl());
-    }
-#endif
+    itl.reset(new Itl(datasetConfig));
 }
     
 EmbeddingDataset::
@@ -1059,7 +1897,7 @@ Any
 EmbeddingDataset::
 getStatus() const
 {
-    return Any();
+    return itl->getStatus();
 }
 
 void
@@ -22,18 +22,80 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+/** Index used to find nearest neighbours in an embedding dataset. */
+enum EmbeddingIndexType {
+    EMBEDDING_INDEX_VPTREE,   ///< Exact; vantage point tree built on commit
+    EMBEDDING_INDEX_HNSW      ///< Approximate; HNSW graph built on record
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+/** Compact encoding of the rows of an embedding dataset, used to scan
+    them for nearest neighbors.
+*/
+enum EmbeddingQuantization {
+    EMBEDDING_QUANTIZATION_NONE,   ///< No encoding; use the index
+    EMBEDDING_QUANTIZATION_INT8,   ///< One byte per dimension
+    EMBEDDING_QUANTIZATION_PQ      ///< Product quantization
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingQuantization);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN), index(EMBEDDING_INDEX_VPTREE),
+          M(16), efConstruction(200), efSearch(64), recallSamples(10),
+          quantization(EMBEDDING_QUANTIZATION_NONE), pqSubspaces(0),
+          rerank(4)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndexType index;
+    int M;
+    int efConstruction;
+    int efSearch;
+    int recallSamples;
+    EmbeddingQuantization quantization;
+    int pqSubspaces;
+    int rerank;
+    Url dataFileUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
 
 
+/*****************************************************************************/
+/* EMBEDDING DATASET STATUS                                                  */
+/*****************************************************************************/
+
+struct EmbeddingDatasetStatus {
+    EmbeddingDatasetStatus()
+        : rowCount(0), columnCount(0), index(EMBEDDING_INDEX_VPTREE),
+          quantization(EMBEDDING_QUANTIZATION_NONE), bytesPerRow(0),
+          numLevels(0), meanDegree(0), memoryUsage(0),
+          estimatedRecall(std::numeric_limits<double>::quiet_NaN()),
+          numQueries(0), meanQueryMs(0), meanDistancesPerQuery(0)
+    {
+    }
+
+    size_t rowCount;
+    size_t columnCount;
+    EmbeddingIndexType index;
+    EmbeddingQuantization quantization;
+    size_t bytesPerRow;
+    int numLevels;
+    double meanDegree;
+    size_t memoryUsage;
+    double estimatedRecall;
+    uint64_t numQueries;
+    double meanQueryMs;
+    double meanDistancesPerQuery;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetStatus);
+
+
 /*****************************************************************************/
 /* EMBEDDING                                                                 */
 /*****************************************************************************/
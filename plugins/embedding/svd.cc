@@ -34,6 +34,8 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/utils/progress.h"
 #include "mldb/utils/log.h"
+#include <numeric>
+#include <random>
 #include <sstream>
 
 using namespace std;
@@ -55,6 +57,25 @@ T jsonDecodeFile(const std::string & filename, T * = 0)
     return result;
 }
 
+DEFINE_ENUM_DESCRIPTION(SvdAlgorithm);
+
+SvdAlgorithmDescription::
+SvdAlgorithmDescription()
+{
+    addValue("lanczos", SVD_LANCZOS,
+             "Lanczos iteration.  This is accurate for all of the singular "
+             "values, but runs in a single thread and is slow for large "
+             "numbers of dense basis vectors.");
+    addValue("randomized", SVD_RANDOMIZED,
+             "Randomized range finder (Halko, Martinsson and Tropp) with "
+             "power iterations.  The products with the correlation matrix "
+             "run in parallel, which makes it much faster for large "
+             "numbers of dense basis vectors.  The leading singular values "
+             "are as accurate as with Lanczos; those towards the end of "
+             "the spectrum are less so, which can be improved by raising "
+             "`numOversamples` or `numPowerIterations`.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(SvdConfig);
 
 SvdConfigDescription::
@@ -88,6 +109,18 @@ SvdConfigDescription()
              "The runtime goes up with the square of this parameter, "
              "in other words 10 times as many is 100 times as long to run.",
              2000);
+    addField("algorithm", &SvdConfig::algorithm,
+             "Algorithm used to calculate the singular vectors of the "
+             "dense basis vectors", SVD_LANCZOS);
+    addField("numPowerIterations", &SvdConfig::numPowerIterations,
+             "Number of power iterations for the `randomized` algorithm.  "
+             "Each one multiplies twice more by the correlation matrix, "
+             "which sharpens the separation between the leading singular "
+             "values and the rest.", 2);
+    addField("numOversamples", &SvdConfig::numOversamples,
+             "Number of extra random vectors, over `numSingularValues`, "
+             "used to sample the range of the correlation matrix in the "
+             "`randomized` algorithm.", 10);
     addField("outputColumn", &SvdConfig::outputColumn,
              "Base name of the column that will be written by the SVD.  "
              "It will be an embedding with numSingularValues elements.",
@@ -163,22 +196,21 @@ rightSingularVector(const ColumnIndexEntries & basisColumns,
     return result;
 }
 
-distribution<float>
+int
 SvdBasis::
-rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
-                             int maxValues,
-                             bool acceptUnknownValues,
-                             shared_ptr<spdlog::logger> logger) const
+findBasisColumn(ColumnHash col, const CellValue & value,
+                bool acceptUnknownValues,
+                double & factor,
+                shared_ptr<spdlog::logger> logger) const
 {
-    if (maxValues < 0 || maxValues > singularValues.size())
-        maxValues = singularValues.size();
+    factor = 1.0;
 
     // 1.  Find the columns involved with the index
     auto it = columnIndex.find(col);
     if (it == columnIndex.end()) {
         TRACE_MSG(logger) << "column " << col << " not found in "
                           << columnIndex.size() << " entries";
-        return distribution<float>();
+        return -1;
     }
 
     // 2.  Look up the value of the cell
@@ -204,8 +236,6 @@ rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
                     continue;
                 int columnNum = e.second;
                 auto & col = columns[columnNum];
-                distribution<float> result = col.singularVector;
-                result.resize(maxValues);
 
                 double oldd = d;
 
@@ -214,8 +244,8 @@ rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
 
                 TRACE_MSG(logger) << "value " << oldd << " transformed to " << d;
 
-                result *= d;
-                return result;
+                factor = d;
+                return columnNum;
             }
 
             if (columnEntry.values.size() == 1) {
@@ -225,10 +255,8 @@ rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
                 // feature.  Take the output for the one and only value
                 // seen in training.
 
-                auto & col = columns[columnEntry.values.begin()->second];
-
-                distribution<float> result = col.singularVector;
-                result.resize(maxValues);
+                int columnNum = columnEntry.values.begin()->second;
+                auto & col = columns[columnNum];
 
                 double oldd = d;
 
@@ -237,15 +265,15 @@ rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
 
                 TRACE_MSG(logger) << "value " << oldd << " transformed to " << d;
 
-                result *= d;
-                return result;
+                factor = d;
+                return columnNum;
             }
 
         }
 
         if (acceptUnknownValues) {
             DEBUG_MSG(logger) << "Numeric value not found";
-            return distribution<float>();
+            return -1;
         }
 
         Json::Value details;
@@ -298,8 +326,28 @@ rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
         throw AnnotatedException(400, message, details);
     }
 
-    distribution<float> result = columns[it2->second].singularVector;
+    return it2->second;
+}
+
+distribution<float>
+SvdBasis::
+rightSingularVectorForColumn(ColumnHash col, const CellValue & value,
+                             int maxValues,
+                             bool acceptUnknownValues,
+                             shared_ptr<spdlog::logger> logger) const
+{
+    if (maxValues < 0 || maxValues > singularValues.size())
+        maxValues = singularValues.size();
+
+    double factor;
+    int columnNum = findBasisColumn(col, value, acceptUnknownValues, factor,
+                                    logger);
+    if (columnNum < 0)
+        return distribution<float>();
+
+    distribution<float> result = columns[columnNum].singularVector;
     result.resize(maxValues);
+    result *= factor;
     return result;
 }
 
@@ -344,13 +392,20 @@ doLeftSingularVector(const std::vector<Tuple> & row,
 
         std::tie(column, value, columnTs) = v;
 
-        const distribution<float> & rsv
-            = rightSingularVectorForColumn(column, value, maxValues, acceptUnknownValues, logger);
+        // Accumulate the scaled singular vector directly, rather than
+        // materializing it for each cell
+        double factor;
+        int columnNum = findBasisColumn(column, value, acceptUnknownValues,
+                                        factor, logger);
 
-        // If it was excluded, it will have an empty vector calculated
-        if (rsv.empty())
+        // If it was excluded, it doesn't contribute
+        if (columnNum < 0 || maxValues == 0)
             continue;
-        result += rsv;
+
+        const distribution<float> & sv = columns[columnNum].singularVector;
+        size_t n = std::min<size_t>(sv.size(), maxValues);
+        for (size_t i = 0;  i < n;  ++i)
+            result[i] += (float)(sv[i] * factor);
         ts.setMax(columnTs);
     }
 
@@ -392,6 +447,20 @@ struct SvdTrainer {
                                  int numSingularValues,
                                  shared_ptr<spdlog::logger> logger);
 
+    static SvdBasis calcSvdBasisRandomized(const ColumnCorrelations & correlations,
+                                           int numSingularValues,
+                                           int numOversamples,
+                                           int numPowerIterations,
+                                           shared_ptr<spdlog::logger> logger);
+
+    /** Build the basis from the singular values and a function giving
+        element dim of singular vector sv.
+    */
+    static SvdBasis makeBasis(const ColumnCorrelations & correlations,
+                              const distribution<float> & singularValues,
+                              const std::function<float (int sv, int dim)> & singularVector,
+                              shared_ptr<spdlog::logger> logger);
+
     static SvdBasis calcRightSingular(const ClassifiedColumns & columns,
                                       const ColumnIndexEntries & columnIndex,
                                       const SvdBasis & svd,
@@ -481,11 +550,266 @@ calcSvdBasis(const ColumnCorrelations & correlations,
     TRACE_MSG(logger) << "Vt rows " << svdResult->Vt->rows;
     TRACE_MSG(logger) << "Vt cols " << svdResult->Vt->cols;
 
+    distribution<float> singularValues(svdResult->S,
+                                       svdResult->S + numSingularValues);
+
+    return makeBasis(correlations, singularValues,
+                     [&] (int sv, int dim) { return svdResult->Vt->value[sv][dim]; },
+                     logger);
+}
+
+namespace {
+
+/// Set of dense vectors, each of which has an entry per dense basis column
+typedef std::vector<distribution<double> > DenseVectors;
+
+/** Return B x for each of the vectors x, where B is the correlation matrix.
+    This is done in parallel over blocks of rows of B, so that each row is
+    read from memory once for all of the vectors.
+*/
+DenseVectors
+multiplyCorrelations(const ColumnCorrelations & correlations,
+                     const DenseVectors & x)
+{
+    size_t ndims = correlations.columnCount();
+    DenseVectors result(x.size(), distribution<double>(ndims));
+
+    static constexpr size_t ROWS_PER_BLOCK = 32;
+
+    auto doBlock = [&] (size_t block)
+        {
+            size_t end = std::min(ndims, (block + 1) * ROWS_PER_BLOCK);
+            for (size_t i = block * ROWS_PER_BLOCK;  i < end;  ++i) {
+                const float * row = &correlations.correlations[i][0];
+                for (size_t j = 0;  j < x.size();  ++j)
+                    result[j][i] = SIMD::vec_dotprod_dp(&x[j][0], row, ndims);
+            }
+        };
+
+    parallelMap(0, (ndims + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK, doBlock);
+
+    return result;
+}
+
+/** Make the vectors orthonormal, in place, using two passes of modified
+    Gram-Schmidt for numerical stability.  Vectors that are within the span
+    of the previous ones are set to zero; they then give a zero singular
+    value, which is trimmed along with the other degenerate ones.
+*/
+void orthonormalize(DenseVectors & vecs)
+{
+    for (size_t j = 0;  j < vecs.size();  ++j) {
+        size_t n = vecs[j].size();
+        double * v = &vecs[j][0];
+        double norm0 = sqrt(SIMD::vec_dotprod(v, v, n));
+
+        for (unsigned pass = 0;  pass < 2;  ++pass) {
+            for (size_t i = 0;  i < j;  ++i) {
+                const double * u = &vecs[i][0];
+                double overlap = SIMD::vec_dotprod(u, v, n);
+                SIMD::vec_add(v, -overlap, u, v, n);
+            }
+        }
+
+        double norm = sqrt(SIMD::vec_dotprod(v, v, n));
+        if (norm <= 1e-9 * norm0)
+            std::fill(v, v + n, 0.0);
+        else SIMD::vec_scale(v, 1.0 / norm, v, n);
+    }
+}
+
+/** Eigen-decomposition of the symmetric matrix a using cyclic Jacobi
+    rotations.  On return, the diagonal of a holds the eigenvalues and the
+    columns of v the corresponding eigenvectors.  The matrix is small (the
+    number of singular values plus the oversamples), so there is no need
+    for anything cleverer.
+*/
+void symmetricEigen(boost::multi_array<double, 2> & a,
+                    boost::multi_array<double, 2> & v)
+{
+    int n = a.shape()[0];
+
+    v.resize(boost::extents[n][n]);
+    for (int i = 0;  i < n;  ++i)
+        for (int j = 0;  j < n;  ++j)
+            v[i][j] = (i == j);
+
+    for (unsigned sweep = 0;  sweep < 100;  ++sweep) {
+        double offDiagonal = 0.0, total = 0.0;
+        for (int i = 0;  i < n;  ++i) {
+            for (int j = 0;  j < n;  ++j) {
+                double sqr = a[i][j] * a[i][j];
+                total += sqr;
+                if (i != j)
+                    offDiagonal += sqr;
+            }
+        }
+
+        if (offDiagonal <= 1e-30 * total)
+            return;
+
+        for (int p = 0;  p < n;  ++p) {
+            for (int q = p + 1;  q < n;  ++q) {
+                if (a[p][q] == 0.0)
+                    continue;
+
+                // Rotation that zeros a[p][q]
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = fabs(theta) > 1e150
+                    ? 0.5 / theta
+                    : (theta >= 0.0 ? 1.0 : -1.0)
+                      / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+
+                for (int k = 0;  k < n;  ++k) {
+                    double akp = a[k][p], akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0;  k < n;  ++k) {
+                    double apk = a[p][k], aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0;  k < n;  ++k) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+} // file scope
+
+SvdBasis
+SvdTrainer::
+calcSvdBasisRandomized(const ColumnCorrelations & correlations,
+                       int numSingularValues,
+                       int numOversamples,
+                       int numPowerIterations,
+                       shared_ptr<spdlog::logger> logger)
+{
+    int ndims = correlations.columnCount();
+
+    Timer timer;
+
+    // The correlation matrix B is symmetric and its eigenvectors are the
+    // right singular vectors; its eigenvalues are the squares of the
+    // singular values (this is the A'A that svdlibc works with).
+    //
+    // We sample the range of B by multiplying it with a set of random
+    // vectors, sharpen the sample with power iterations, and then solve the
+    // small eigenproblem of B projected onto an orthonormal basis Q of the
+    // sample (Halko, Martinsson and Tropp, "Finding structure with
+    // randomness", 2011).
+    int numVectors = std::min(ndims, numSingularValues + std::max(0, numOversamples));
+
+    // Fixed seed, so that training is repeatable
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gaussian;
+
+    DenseVectors q(numVectors, distribution<double>(ndims));
+    for (auto & v: q)
+        for (auto & x: v)
+            x = gaussian(rng);
+
+    q = multiplyCorrelations(correlations, q);
+
+    for (int i = 0;  i < numPowerIterations;  ++i) {
+        // Orthonormalizing between each multiplication stops the vectors
+        // all collapsing onto the leading singular vector.  Since B is
+        // symmetric, B stands in for both B and B' in (B B')^i B.
+        orthonormalize(q);
+        q = multiplyCorrelations(correlations, q);
+        orthonormalize(q);
+        q = multiplyCorrelations(correlations, q);
+    }
+
+    orthonormalize(q);
+
+    // Project B onto the basis: T = Q' B Q
+    DenseVectors bq = multiplyCorrelations(correlations, q);
+
+    boost::multi_array<double, 2> t(boost::extents[numVectors][numVectors]);
+
+    auto doRow = [&] (int i)
+        {
+            for (unsigned j = 0;  j < numVectors;  ++j)
+                t[i][j] = SIMD::vec_dotprod(&q[i][0], &bq[j][0], ndims);
+        };
+
+    parallelMap(0, numVectors, doRow);
+
+    // Remove the rounding asymmetry before the decomposition
+    for (unsigned i = 0;  i < numVectors;  ++i) {
+        for (unsigned j = 0;  j < i;  ++j) {
+            double avg = 0.5 * (t[i][j] + t[j][i]);
+            t[i][j] = t[j][i] = avg;
+        }
+    }
+
+    boost::multi_array<double, 2> w;
+    symmetricEigen(t, w);
+
+    vector<int> order(numVectors);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&] (int i, int j) { return t[i][i] > t[j][j]; });
+
+    DEBUG_MSG(logger) << "randomized decomposition of " << ndims
+                      << " dimensions with " << numVectors << " vectors in "
+                      << timer.elapsed();
+
+    // Trim in the same way as for Lanczos
+    int numWanted = std::min(numSingularValues, numVectors);
+    distribution<float> singularValues;
+    for (int i = 0;  i < numWanted;  ++i) {
+        double eigenvalue = t[order[i]][order[i]];
+        double sv = sqrt(std::max(0.0, eigenvalue));
+        if (!isfinite(sv)
+            || (i > 0 && sv / singularValues[0] <= 1e-9)
+            || sv == 0.0)
+            break;
+        singularValues.push_back(sv);
+    }
+
+    INFO_MSG(logger) << "skipped " << numWanted - singularValues.size()
+                     << " bad singular values";
+    INFO_MSG(logger) << "done randomized SVD " << timer.elapsed();
+
+    // Singular vectors are Q times the eigenvectors of T
+    DenseVectors vecs(singularValues.size(), distribution<double>(ndims));
+
+    auto doVector = [&] (int i)
+        {
+            for (unsigned j = 0;  j < numVectors;  ++j)
+                SIMD::vec_add(&vecs[i][0], w[j][order[i]], &q[j][0],
+                              &vecs[i][0], ndims);
+        };
+
+    parallelMap(0, singularValues.size(), doVector);
+
+    return makeBasis(correlations, singularValues,
+                     [&] (int sv, int dim) { return vecs[sv][dim]; },
+                     logger);
+}
+
+SvdBasis
+SvdTrainer::
+makeBasis(const ColumnCorrelations & correlations,
+          const distribution<float> & singularValues,
+          const std::function<float (int sv, int dim)> & singularVector,
+          shared_ptr<spdlog::logger> logger)
+{
+    int ndims = correlations.columnCount();
+    int numSingularValues = singularValues.size();
+
     SvdBasis result;
     result.modelTs = correlations.modelTs;
-    result.singularValues.resize(numSingularValues);
-    std::copy(svdResult->S, svdResult->S + numSingularValues,
-              result.singularValues.begin());
+    result.singularValues = singularValues;
 
     INFO_MSG(logger) << "svalues = " << result.singularValues;
 
@@ -500,7 +824,7 @@ calcSvdBasis(const ColumnCorrelations & correlations,
         distribution<float> & d = result.columns[i].singularVector;
         d.resize(numSingularValues);
         for (unsigned j = 0;  j < numSingularValues;  ++j)
-            d[j] = svdResult->Vt->value[j][i];
+            d[j] = singularVector(j, i);
 
         ColumnPath columnName = result.columns[i].columnName;
         CellValue cellValue = result.columns[i].cellValue;
@@ -683,6 +1007,13 @@ run(const ProcedureRunConfig & run,
         checkWritability(runProcConf.modelFileUrl.toDecodedString(), "modelFileUrl");
     }
 
+    if (runProcConf.numPowerIterations < 0 || runProcConf.numOversamples < 0) {
+        throw AnnotatedException
+            (400, "SVD training procedure requires non-negative "
+             "numPowerIterations and numOversamples",
+             "config", runProcConf);
+    }
+
     int numBasisVectors = runProcConf.numDenseBasisVectors;
     
     SqlExpressionMldbScope context(engine);
@@ -747,9 +1078,15 @@ run(const ProcedureRunConfig & run,
     ColumnIndexEntries columnIndex = invertFeatures(columns, extractedFeatures, logger, convertProgressToJson);
 
     ColumnCorrelations correlations = calculateCorrelations(columnIndex, numBasisVectors, logger);
-    SvdBasis svd = SvdTrainer::calcSvdBasis(correlations,
-                                            runProcConf.numSingularValues,
-                                            logger);
+    SvdBasis svd = runProcConf.algorithm == SVD_RANDOMIZED
+        ? SvdTrainer::calcSvdBasisRandomized(correlations,
+                                             runProcConf.numSingularValues,
+                                             runProcConf.numOversamples,
+                                             runProcConf.numPowerIterations,
+                                             logger)
+        : SvdTrainer::calcSvdBasis(correlations,
+                                   runProcConf.numSingularValues,
+                                   logger);
 
     auto outputSvdColumns = [](const SvdBasis & basis) {
         stringstream output;
@@ -995,6 +1332,29 @@ SvdEmbedRow::
 call(SvdInput input) const
 {
     RowValue row;
+    return embed(input, row);
+}
+
+std::vector<SvdOutput>
+SvdEmbedRow::
+applyBatchT(const ApplierT & applier,
+            std::vector<SvdInput> inputs) const
+{
+    // The row buffer is reused between rows of the batch, so that only the
+    // first row pays for its allocation
+    std::vector<SvdOutput> result;
+    result.reserve(inputs.size());
+    RowValue row;
+    for (auto & input: inputs)
+        result.emplace_back(embed(input, row));
+    return result;
+}
+
+SvdOutput
+SvdEmbedRow::
+embed(SvdInput & input, RowValue & row) const
+{
+    row.clear();
     input.row.mergeToRowDestructive(row);
     
     distribution<float> embedding;
@@ -24,13 +24,26 @@ namespace MLDB {
 struct SelectExpression;
 struct SqlExpression;
 
+/** Algorithm used to decompose the correlations between the dense basis
+    columns.
+*/
+enum SvdAlgorithm {
+    SVD_LANCZOS,      ///< Lanczos iteration (svdlibc); single threaded
+    SVD_RANDOMIZED    ///< Randomized range finder with power iterations
+};
+
+DECLARE_ENUM_DESCRIPTION(SvdAlgorithm);
+
 struct SvdConfig : ProcedureConfig {
     static constexpr char const * name = "svd.train";
 
     SvdConfig()
         : outputColumn("embedding"),
           numSingularValues(100),
-          numDenseBasisVectors(1000)
+          numDenseBasisVectors(1000),
+          algorithm(SVD_LANCZOS),
+          numPowerIterations(2),
+          numOversamples(10)
     {
     }
 
@@ -43,6 +56,9 @@ struct SvdConfig : ProcedureConfig {
     PathElement outputColumn;
     int numSingularValues;
     int numDenseBasisVectors;
+    SvdAlgorithm algorithm;
+    int numPowerIterations;
+    int numOversamples;
     Utf8String functionName;
 };
 
@@ -82,6 +98,17 @@ struct SvdBasis {
                         const ColumnIndexEntry & column,
                         std::shared_ptr<spdlog::logger> logger) const;
 
+    /** Given a particular column and its value, find the index of the
+        basis column that it maps onto, and the factor by which that
+        column's singular vector is scaled.  Returns -1 if the column
+        doesn't contribute (it's unknown, or its value is unknown and
+        acceptUnknownValues is set).
+    */
+    int findBasisColumn(ColumnHash col, const CellValue & value,
+                        bool acceptUnknownValues,
+                        double & factor,
+                        std::shared_ptr<spdlog::logger> logger) const;
+
     /** Given a particular column and its value, calculate the right
         singular value for that column.
     */
@@ -191,6 +218,13 @@ struct SvdEmbedRow: public ValueFunctionT<SvdInput, SvdOutput> {
                 const std::function<bool (const Json::Value &)> & onProgress);
     
     virtual SvdOutput call(SvdInput input) const;
+
+    virtual std::vector<SvdOutput>
+    applyBatchT(const ApplierT & applier,
+                std::vector<SvdInput> inputs) const;
+
+    /** Embed a single row, using row as scratch space. */
+    SvdOutput embed(SvdInput & input, RowValue & row) const;
     
     SvdBasis svd;
     SvdEmbedConfig functionConfig;
@@ -1199,7 +1199,7 @@ apply(const FunctionApplier & applier_,
                 = itl->classifier.impl->predict(dense, applier.optInfo);
             ExcAssertEqual(scores.size(), labelCount);
 
-            vector<tuple<PathElement, ExpressionValue> > row;
+            StructValue row;
             for (unsigned i = 0;  i < labelCount;  ++i) {
                 row.emplace_back(PathElement(cat->print(i)),
                                  ExpressionValue(scores[i], ts));
@@ -1230,7 +1230,7 @@ apply(const FunctionApplier & applier_,
             auto scores = itl->classifier.predict(*fset);
             ExcAssertEqual(scores.size(), labelCount);
 
-            vector<tuple<PathElement, ExpressionValue> > row;
+            StructValue row;
 
             for (unsigned i = 0;  i < labelCount;  ++i) {
                 row.emplace_back(PathElement(cat->print(i)),
@@ -1253,6 +1253,81 @@ apply(const FunctionApplier & applier_,
     return std::move(result);
 }
 
+std::vector<ExpressionValue>
+ClassifyFunction::
+applyBatch(const FunctionApplier & applier_,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    auto & applier = (ClassifyFunctionApplier &)applier_;
+
+    if (!applier.optInfo)
+        return Function::applyBatch(applier_, inputs);
+
+    std::vector<ExpressionValue> result(inputs.size());
+
+    int labelCount = itl->classifier.label_count();
+
+    // Extract the dense features for all rows; those that can't be made
+    // dense are done one by one via apply()
+    std::vector<std::vector<float> > dense(inputs.size());
+    std::vector<Date> timestamps(inputs.size());
+    std::vector<size_t> denseRows;
+    std::vector<const float *> denseFeatures;
+
+    for (size_t i = 0;  i < inputs.size();  ++i) {
+        std::shared_ptr<ML::Mutable_Feature_Set> fset;
+        std::tie(dense[i], fset, timestamps[i])
+            = getFeatureSet(inputs[i], true /* try to optimize */);
+        if (dense[i].empty()) {
+            result[i] = apply(applier_, inputs[i]);
+            continue;
+        }
+        denseRows.push_back(i);
+        denseFeatures.push_back(dense[i].data());
+    }
+
+    if (denseRows.empty())
+        return result;
+
+    std::vector<double> scores(denseRows.size() * labelCount);
+    itl->classifier.impl->predict_batch(denseFeatures.data(), denseRows.size(),
+                                        applier.optInfo, scores.data());
+
+    auto cat = itl->labelInfo.categorical();
+
+    for (size_t n = 0;  n < denseRows.size();  ++n) {
+        size_t i = denseRows[n];
+        Date ts = timestamps[i];
+        const double * rowScores = scores.data() + n * labelCount;
+
+        StructValue output;
+        output.reserve(1);
+
+        if (cat) {
+            StructValue row;
+            for (unsigned j = 0;  j < labelCount;  ++j) {
+                row.emplace_back(PathElement(cat->print(j)),
+                                 ExpressionValue((float)rowScores[j], ts));
+            }
+            output.emplace_back("scores", std::move(row));
+        }
+        else if (itl->labelInfo.type() == ML::REAL) {
+            ExcAssertEqual(labelCount, 1);
+            output.emplace_back("score",
+                                ExpressionValue((float)rowScores[0], ts));
+        }
+        else {
+            ExcAssertEqual(labelCount, 2);
+            output.emplace_back("score",
+                                ExpressionValue((float)rowScores[1], ts));
+        }
+
+        result[i] = std::move(output);
+    }
+
+    return result;
+}
+
 FunctionInfo
 ClassifyFunction::
 getFunctionInfo() const
@@ -1416,6 +1491,14 @@ apply(const FunctionApplier & applier,
     return std::move(output);
 }
 
+std::vector<ExpressionValue>
+ExplainFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    return Function::applyBatch(applier, inputs);
+}
+
 FunctionInfo
 ExplainFunction::
 getFunctionInfo() const
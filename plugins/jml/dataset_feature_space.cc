@@ -603,6 +603,78 @@ std::ostream & operator << (std::ostream & stream,
 }
 
 
+
+/*****************************************************************************/
+/* TRAINING LABELS                                                           */
+/*****************************************************************************/
+
+TrainingLabels::
+TrainingLabels(std::vector<std::vector<CellValue> > labelsWhereWeight,
+               ClassifierMode mode)
+    : labels(std::move(labelsWhereWeight.at(0))),
+      wheres(std::move(labelsWhereWeight.at(1))),
+      weights(std::move(labelsWhereWeight.at(2))),
+      mode(mode),
+      numLabels(2),
+      numRowsKept(0)
+{
+    for (size_t i = 0;  i < labels.size();  ++i) {
+        if (keepRow(i))
+            ++numRowsKept;
+    }
+
+    switch (mode) {
+    case CM_REGRESSION:
+        labelInfo = ML::Mutable_Feature_Info(ML::REAL);
+        numLabels = 1;
+        break;
+    case CM_BOOLEAN:
+        labelInfo = ML::Mutable_Feature_Info(ML::BOOLEAN);
+        break;
+    case CM_CATEGORICAL: {
+        for (size_t i = 0;  i < labels.size();  ++i) {
+            if (keepRow(i))
+                labelNumbers[labels[i].toUtf8String()] = -1;
+        }
+        auto categorical = std::make_shared<ML::Mutable_Categorical_Info>();
+        for (auto & l: labelNumbers)
+            l.second = categorical->parse_or_add(l.first.rawString());
+        labelInfo = ML::Feature_Info(categorical);
+        numLabels = labelNumbers.size();
+        break;
+    }
+    default:
+        throw AnnotatedException(400, "Training labels are only supported "
+                                 "for the boolean, categorical and "
+                                 "regression modes");
+    }
+
+    labelInfo.set_biased(true);
+}
+
+bool
+TrainingLabels::
+keepRow(size_t i) const
+{
+    return wheres[i].isTrue() && !labels[i].empty()
+        && !weights[i].empty() && weights[i].toDouble() > 0.0;
+}
+
+float
+TrainingLabels::
+getLabel(size_t i) const
+{
+    switch (mode) {
+    case CM_REGRESSION:
+        return labels[i].toDouble();
+    case CM_CATEGORICAL:
+        return labelNumbers.at(labels[i].toUtf8String());
+    default:
+        return labels[i].isTrue();
+    }
+}
+
+
 static ML::Register_Factory<ML::Feature_Space, DatasetFeatureSpace>
 DFS_REG("MLDB::DatasetFeatureSpace");
 
@@ -15,6 +15,7 @@
 #include "mldb/core/dataset.h"
 #include "mldb/engine/bucket.h"
 #include "mldb/plugins/jml/jml/label.h"
+#include "mldb/plugins/jml/classifier.h"
 #include "mldb/utils/log_fwd.h"
 
 
@@ -189,6 +190,58 @@ std::ostream & operator << (std::ostream & stream,
                             const DatasetFeatureSpace::ColumnInfo & columnInfo);
 
 
+/*****************************************************************************/
+/* TRAINING LABELS                                                           */
+/*****************************************************************************/
+
+/** The label, filter and weight of each row of a training set, and how the
+    labels are encoded for the classifier mode.  Used by the procedures that
+    train directly on the buckets of a DatasetFeatureSpace.
+*/
+
+struct TrainingLabels {
+    /** Takes the label, where and weight columns in that order, as
+        returned by ColumnScope::run().  Only the regression, boolean and
+        categorical modes are supported.
+    */
+    TrainingLabels(std::vector<std::vector<CellValue> > labelsWhereWeight,
+                   ClassifierMode mode);
+
+    std::vector<CellValue> labels;
+    std::vector<CellValue> wheres;
+    std::vector<CellValue> weights;
+
+    ClassifierMode mode;
+
+    /// Info for the label feature; categorical labels are numbered in
+    /// sorted order, for determinism
+    ML::Mutable_Feature_Info labelInfo;
+
+    /// Number of each categorical label, in sorted order
+    std::map<Utf8String, int> labelNumbers;
+
+    /// Number of distinct labels, or 1 for regression
+    int numLabels;
+
+    /// Number of rows for which keepRow() is true
+    size_t numRowsKept;
+
+    /** Is the given row trained on?  It needs to match the where clause
+        and have a label and a positive weight.
+    */
+    bool keepRow(size_t i) const;
+
+    /// Label of the given row, encoded as a number for the mode
+    float getLabel(size_t i) const;
+
+    /// Weight of the given row
+    double getWeight(size_t i) const
+    {
+        return weights[i].toDouble();
+    }
+};
+
+
 } // namespace MLDB
 
 
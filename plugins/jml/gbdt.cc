@@ -0,0 +1,593 @@
+/** gbdt.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Histogram based gradient boosted decision trees.
+*/
+
+#include "gbdt.h"
+#include "mldb/utils/log.h"
+#include "mldb/arch/timers.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/annotated_exception.h"
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Number of examples under which a histogram is built on a single thread
+constexpr size_t PARALLEL_HISTOGRAM_MIN_EXAMPLES = 4096;
+
+/// Number of examples per task when updating gradients and predictions
+constexpr size_t EXAMPLE_CHUNK_SIZE = 8192;
+
+/// Smallest hessian of an example, to keep the leaf values finite
+constexpr double MIN_HESSIAN = 1e-16;
+
+
+/*****************************************************************************/
+/* GRADIENT STATS                                                            */
+/*****************************************************************************/
+
+/** Sums of gradients, hessians and number of examples for a set of
+    examples (a bucket of a histogram, or a node).
+*/
+struct GradientStats {
+    double g = 0;
+    double h = 0;
+    size_t n = 0;
+
+    GradientStats & operator += (const GradientStats & other)
+    {
+        g += other.g;
+        h += other.h;
+        n += other.n;
+        return *this;
+    }
+
+    GradientStats & operator -= (const GradientStats & other)
+    {
+        g -= other.g;
+        h -= other.h;
+        n -= other.n;
+        return *this;
+    }
+
+    GradientStats operator - (const GradientStats & other) const
+    {
+        GradientStats result = *this;
+        result -= other;
+        return result;
+    }
+};
+
+
+/*****************************************************************************/
+/* GBDT TREE TRAINER                                                         */
+/*****************************************************************************/
+
+/** Grows a single regression tree over the gradients of the current
+    iteration.
+*/
+struct GbdtTreeTrainer {
+
+    /// A node of the tree being grown
+    struct Node {
+        size_t begin = 0, end = 0;  ///< Range of examples in the order
+        int depth = 0;
+        GradientStats total;
+        std::vector<GradientStats> hist;  ///< Over all feature buckets
+
+        // Best split of the node, found once its histogram is known
+        double gain = -INFINITY;
+        int feature = -1;
+        int bucket = -1;
+        GradientStats splitTrue;  ///< Stats on the child_true side
+
+        int child[2] = { -1, -1 };  ///< false and true children, if split
+        double value = 0;           ///< Output of the node
+    };
+
+    GbdtTreeTrainer(const PartitionData & data,
+                    const std::vector<uint32_t> & exampleNums,
+                    const std::vector<size_t> & offsets,
+                    size_t totalBuckets,
+                    const GbdtParams & params)
+        : data(data), exampleNums(exampleNums), offsets(offsets),
+          totalBuckets(totalBuckets), params(params)
+    {
+    }
+
+    const PartitionData & data;
+    const std::vector<uint32_t> & exampleNums;
+    const std::vector<size_t> & offsets;
+    size_t totalBuckets;
+    const GbdtParams & params;
+
+    /// Features that the tree may split on
+    std::vector<int> features;
+
+    /// Gradient and hessian of each row for this tree
+    const float * grad = nullptr;
+    const float * hess = nullptr;
+
+    std::vector<Node> nodes;
+
+    /** Does the given row go to child_true of the given (split) node? */
+    bool goesTrue(const Node & node, uint32_t row) const
+    {
+        uint32_t bucket
+            = data.features[node.feature].buckets[exampleNums[row]];
+        return data.features[node.feature].ordinal
+            ? bucket <= node.bucket : bucket == node.bucket;
+    }
+
+    /** Return the index of the leaf that the given row ends up in. */
+    int findLeaf(uint32_t row) const
+    {
+        int i = 0;
+        while (nodes[i].child[0] != -1)
+            i = nodes[i].child[goesTrue(nodes[i], row)];
+        return i;
+    }
+
+    /** Accumulate the gradients of the given rows into the per-bucket
+        histograms of each feature.  Each feature is independent, so for
+        large enough nodes they are done in parallel.
+    */
+    void buildHistogram(const uint32_t * rows, size_t n,
+                        GradientStats * hist) const
+    {
+        auto doFeature = [&] (size_t i)
+            {
+                int f = features[i];
+                const BucketList & buckets = data.features[f].buckets;
+                GradientStats * fhist = hist + offsets[f];
+                for (size_t j = 0;  j < n;  ++j) {
+                    uint32_t row = rows[j];
+                    GradientStats & s = fhist[buckets[exampleNums[row]]];
+                    s.g += grad[row];
+                    s.h += hess[row];
+                    s.n += 1;
+                }
+            };
+
+        if (n < PARALLEL_HISTOGRAM_MIN_EXAMPLES) {
+            for (size_t i = 0;  i < features.size();  ++i)
+                doFeature(i);
+        }
+        else {
+            parallelMap(0, features.size(), doFeature);
+        }
+    }
+
+    double score(const GradientStats & s) const
+    {
+        return s.g * s.g / (s.h + params.lambda);
+    }
+
+    double leafValue(const GradientStats & s) const
+    {
+        return -s.g / (s.h + params.lambda) * params.learningRate;
+    }
+
+    /** Find the split of the node that most reduces the loss, if any
+        satisfies the constraints.
+    */
+    void findBestSplit(Node & node) const
+    {
+        if (node.depth >= params.maxDepth
+            || node.total.n < 2 * params.minExamplesPerLeaf)
+            return;
+
+        double parentScore = score(node.total);
+
+        for (int f: features) {
+            const GradientStats * fhist = node.hist.data() + offsets[f];
+            int numBuckets = data.features[f].buckets.numBuckets;
+
+            auto consider = [&] (const GradientStats & sTrue, int bucket)
+                {
+                    GradientStats sFalse = node.total - sTrue;
+                    if (sTrue.n < params.minExamplesPerLeaf
+                        || sFalse.n < params.minExamplesPerLeaf
+                        || sTrue.h < params.minChildWeight
+                        || sFalse.h < params.minChildWeight)
+                        return;
+                    double gain
+                        = 0.5 * (score(sTrue) + score(sFalse) - parentScore);
+                    if (gain > node.gain) {
+                        node.gain = gain;
+                        node.feature = f;
+                        node.bucket = bucket;
+                        node.splitTrue = sTrue;
+                    }
+                };
+
+            if (data.features[f].ordinal) {
+                // Buckets up to and including j go to child_true
+                GradientStats sTrue;
+                for (int j = 0;  j < numBuckets - 1;  ++j) {
+                    if (fhist[j].n == 0)
+                        continue;
+                    sTrue += fhist[j];
+                    consider(sTrue, j);
+                }
+            }
+            else {
+                // Bucket j goes to child_true, the rest to child_false
+                for (int j = 0;  j < numBuckets;  ++j) {
+                    if (fhist[j].n == 0)
+                        continue;
+                    consider(fhist[j], j);
+                }
+            }
+        }
+    }
+
+    /** Split the given node, which must have a split.  The histogram is
+        only built for the smaller child; the larger one gets the parent's
+        histogram minus the smaller one's.
+    */
+    void splitNode(int nodeNum, std::vector<uint32_t> & order)
+    {
+        size_t mid;
+        {
+            const Node & node = nodes[nodeNum];
+            mid = std::stable_partition(order.begin() + node.begin,
+                                        order.begin() + node.end,
+                                        [&] (uint32_t row)
+                                        {
+                                            return goesTrue(node, row);
+                                        })
+                - order.begin();
+        }
+
+        int childTrue = nodes.size();
+        int childFalse = childTrue + 1;
+        nodes.emplace_back();
+        nodes.emplace_back();
+
+        Node & node = nodes[nodeNum];
+        Node & t = nodes[childTrue];
+        Node & f = nodes[childFalse];
+
+        t.begin = node.begin;  t.end = mid;
+        f.begin = mid;  f.end = node.end;
+        t.depth = f.depth = node.depth + 1;
+        t.total = node.splitTrue;
+        f.total = node.total - node.splitTrue;
+        ExcAssertEqual(t.total.n, t.end - t.begin);
+
+        Node & smaller = t.total.n <= f.total.n ? t : f;
+        Node & larger = t.total.n <= f.total.n ? f : t;
+
+        smaller.hist.resize(totalBuckets);
+        buildHistogram(order.data() + smaller.begin,
+                       smaller.end - smaller.begin,
+                       smaller.hist.data());
+
+        larger.hist = std::move(node.hist);
+        for (int feature: features) {
+            size_t begin = offsets[feature];
+            size_t end = begin + data.features[feature].buckets.numBuckets;
+            for (size_t i = begin;  i < end;  ++i)
+                larger.hist[i] -= smaller.hist[i];
+        }
+
+        node.hist.clear();
+        node.hist.shrink_to_fit();
+        node.child[false] = childFalse;
+        node.child[true] = childTrue;
+
+        findBestSplit(t);
+        findBestSplit(f);
+    }
+
+    /** Grow a tree over the rows in order, leaf-wise: the leaf with the
+        best split is always the next to be split, until there are
+        maxLeaves leaves or no leaf has a split with enough gain.
+    */
+    void grow(std::vector<uint32_t> & order)
+    {
+        nodes.clear();
+        nodes.reserve(2 * params.maxLeaves);
+        nodes.emplace_back();
+
+        Node & root = nodes[0];
+        root.begin = 0;
+        root.end = order.size();
+        for (uint32_t row: order) {
+            root.total.g += grad[row];
+            root.total.h += hess[row];
+        }
+        root.total.n = order.size();
+        root.hist.resize(totalBuckets);
+        buildHistogram(order.data(), order.size(), root.hist.data());
+        findBestSplit(root);
+
+        for (int numLeaves = 1;  numLeaves < params.maxLeaves;  ++numLeaves) {
+            int best = -1;
+            for (unsigned i = 0;  i < nodes.size();  ++i) {
+                const Node & node = nodes[i];
+                if (node.child[0] != -1 || node.feature == -1
+                    || node.gain <= params.minSplitGain)
+                    continue;
+                if (best == -1 || node.gain > nodes[best].gain)
+                    best = i;
+            }
+            if (best == -1)
+                break;
+            splitNode(best, order);
+        }
+
+        for (auto & node: nodes) {
+            node.value = leafValue(node.total);
+            node.hist.clear();
+            node.hist.shrink_to_fit();
+        }
+    }
+
+    /** Convert the grown tree into an ML::Tree, with makePred turning
+        the value of a node into its prediction.
+    */
+    ML::Tree::Ptr
+    toTree(ML::Tree & tree, int nodeNum,
+           const std::function<distribution<float> (float)> & makePred) const
+    {
+        const Node & node = nodes[nodeNum];
+
+        if (node.child[0] == -1)
+            return tree.new_leaf(makePred(node.value), node.total.n);
+
+        ML::Tree::Node * result = tree.new_node();
+        result->split = data.makeSplit(node.feature, node.bucket);
+        result->child_true = toTree(tree, node.child[true], makePred);
+        result->child_false = toTree(tree, node.child[false], makePred);
+        // Missing values weren't seen in training; use the node's output
+        result->child_missing = tree.new_leaf(makePred(node.value), 0);
+        result->z = node.gain;
+        result->pred = makePred(node.value);
+        result->examples = node.total.n;
+        return result;
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* TRAIN GBDT                                                                */
+/*****************************************************************************/
+
+std::shared_ptr<ML::Committee>
+trainGbdt(const PartitionData & data,
+          const std::vector<float> & targets,
+          GbdtLoss loss,
+          int numLabels,
+          const GbdtParams & params,
+          const std::shared_ptr<spdlog::logger> & logger)
+{
+    Timer timer;
+
+    size_t numRows = data.rows.size();
+    ExcAssertEqual(targets.size(), numRows);
+    if (numRows == 0)
+        throw AnnotatedException(400, "No examples to train gbdt on");
+
+    // Number of trees per iteration, each of which produces one score
+    int numScores = loss == GBDT_SOFTMAX ? numLabels : 1;
+    ExcAssertEqual(numLabels, (loss == GBDT_SQUARED ? 1
+                               : loss == GBDT_LOGISTIC ? 2 : numLabels));
+
+    std::vector<uint32_t> exampleNums(numRows);
+    double totalWeight = 0;
+    for (size_t i = 0;  i < numRows;  ++i) {
+        exampleNums[i] = data.rows[i].exampleNum;
+        totalWeight += data.rows[i].weight;
+    }
+
+    // Lay out the histogram buckets of all of the features that can be
+    // split on contiguously
+    std::vector<int> activeFeatures;
+    std::vector<size_t> offsets(data.features.size(), 0);
+    size_t totalBuckets = 0;
+    for (unsigned i = 0;  i < data.features.size();  ++i) {
+        if (!data.features[i].active)
+            continue;
+        activeFeatures.push_back(i);
+        offsets[i] = totalBuckets;
+        totalBuckets += data.features[i].buckets.numBuckets;
+    }
+
+    // Initial scores are the best constant prediction
+    std::vector<float> bias(numScores);
+    if (loss == GBDT_SQUARED) {
+        double total = 0;
+        for (size_t i = 0;  i < numRows;  ++i)
+            total += data.rows[i].weight * targets[i];
+        bias[0] = total / totalWeight;
+    }
+    else {
+        std::vector<double> labelWeights(numLabels);
+        for (size_t i = 0;  i < numRows;  ++i)
+            labelWeights.at((int)targets[i]) += data.rows[i].weight;
+        for (int l = 0;  l < numLabels;  ++l) {
+            double p = std::min(std::max(labelWeights[l] / totalWeight, 1e-6),
+                                1.0 - 1e-6);
+            if (loss == GBDT_LOGISTIC)
+                bias[0] = log(p / (1 - p));
+            else bias[l] = log(p);
+        }
+    }
+
+    std::vector<double> scores(numRows * numScores);
+    for (size_t i = 0;  i < numRows;  ++i)
+        std::copy(bias.begin(), bias.end(), scores.begin() + i * numScores);
+
+    // Gradients and hessians, one block of numRows per score
+    std::vector<float> grad(numRows * numScores);
+    std::vector<float> hess(numRows * numScores);
+
+    size_t numChunks = (numRows + EXAMPLE_CHUNK_SIZE - 1) / EXAMPLE_CHUNK_SIZE;
+    std::vector<double> chunkLosses(numChunks);
+
+    auto updateGradients = [&] (size_t chunk)
+        {
+            size_t begin = chunk * EXAMPLE_CHUNK_SIZE;
+            size_t end = std::min(numRows, begin + EXAMPLE_CHUNK_SIZE);
+            double chunkLoss = 0;
+            std::vector<double> probs(numScores);
+
+            for (size_t i = begin;  i < end;  ++i) {
+                float w = data.rows[i].weight;
+                const double * s = &scores[i * numScores];
+
+                switch (loss) {
+                case GBDT_SQUARED: {
+                    double err = s[0] - targets[i];
+                    grad[i] = w * err;
+                    hess[i] = w;
+                    chunkLoss += 0.5 * w * err * err;
+                    break;
+                }
+                case GBDT_LOGISTIC: {
+                    double p = 1.0 / (1.0 + exp(-s[0]));
+                    double y = targets[i];
+                    grad[i] = w * (p - y);
+                    hess[i] = w * std::max(p * (1 - p), MIN_HESSIAN);
+                    chunkLoss -= w * log(std::max(y ? p : 1 - p, 1e-15));
+                    break;
+                }
+                case GBDT_SOFTMAX: {
+                    double maxScore = *std::max_element(s, s + numScores);
+                    double total = 0;
+                    for (int k = 0;  k < numScores;  ++k)
+                        total += probs[k] = exp(s[k] - maxScore);
+                    int label = targets[i];
+                    for (int k = 0;  k < numScores;  ++k) {
+                        double p = probs[k] / total;
+                        grad[k * numRows + i] = w * (p - (k == label));
+                        hess[k * numRows + i]
+                            = w * std::max(p * (1 - p), MIN_HESSIAN);
+                    }
+                    chunkLoss -= w * log(std::max(probs[label] / total, 1e-15));
+                    break;
+                }
+                }
+            }
+
+            chunkLosses[chunk] = chunkLoss;
+        };
+
+    GbdtTreeTrainer trainer(data, exampleNums, offsets, totalBuckets, params);
+
+    auto result = std::make_shared<ML::Committee>(data.fs, labelFeature);
+    if (loss != GBDT_SQUARED)
+        result->encoding = ML::OE_PM_INF;
+
+    std::vector<uint32_t> order;
+    order.reserve(numRows);
+
+    for (int iter = 0;  iter < params.numTrees;  ++iter) {
+        parallelMap(0, numChunks, updateGradients);
+
+        double totalLoss = 0;
+        for (double l: chunkLosses)
+            totalLoss += l;
+
+        if (params.verbosity)
+            INFO_MSG(logger) << "gbdt iteration " << iter << " training loss "
+                             << totalLoss / totalWeight;
+
+        mt19937 rng(93 + iter);
+        uniform_real_distribution<> uniform01(0, 1);
+
+        // Sample the examples for this iteration
+        order.clear();
+        for (size_t i = 0;  i < numRows;  ++i) {
+            if (params.exampleSamplingProp >= 1.0
+                || uniform01(rng) < params.exampleSamplingProp)
+                order.push_back(i);
+        }
+        if (order.empty())
+            continue;
+
+        for (int k = 0;  k < numScores;  ++k) {
+            // Sample the features for this tree
+            trainer.features.clear();
+            for (int f: activeFeatures) {
+                if (params.featureSamplingProp >= 1.0
+                    || uniform01(rng) < params.featureSamplingProp)
+                    trainer.features.push_back(f);
+            }
+            if (trainer.features.empty() && !activeFeatures.empty())
+                trainer.features.push_back
+                    (activeFeatures[rng() % activeFeatures.size()]);
+
+            trainer.grad = grad.data() + k * numRows;
+            trainer.hess = hess.data() + k * numRows;
+
+            // The stable partition when splitting keeps the rows of each
+            // node in order, so sort them back before growing
+            std::sort(order.begin(), order.end());
+            trainer.grow(order);
+
+            auto makePred = [&] (float value) -> distribution<float>
+                {
+                    distribution<float> pred(numLabels, 0.0f);
+                    switch (loss) {
+                    case GBDT_SQUARED:  pred[0] = value;  break;
+                    case GBDT_LOGISTIC: pred[0] = -value;  pred[1] = value;  break;
+                    case GBDT_SOFTMAX:  pred[k] = value;  break;
+                    }
+                    return pred;
+                };
+
+            auto tree = std::make_shared<ML::Decision_Tree>(data.fs,
+                                                            labelFeature);
+            tree->tree.root = trainer.toTree(tree->tree, 0, makePred);
+            if (loss != GBDT_SQUARED)
+                tree->encoding = ML::OE_PM_INF;
+            result->add(tree, 1.0);
+
+            // Update the scores of all rows, including those not sampled
+            auto updateScores = [&] (size_t chunk)
+                {
+                    size_t begin = chunk * EXAMPLE_CHUNK_SIZE;
+                    size_t end = std::min(numRows, begin + EXAMPLE_CHUNK_SIZE);
+                    for (size_t i = begin;  i < end;  ++i)
+                        scores[i * numScores + k]
+                            += trainer.nodes[trainer.findLeaf(i)].value;
+                };
+
+            parallelMap(0, numChunks, updateScores);
+
+            if (params.verbosity)
+                INFO_MSG(logger) << "gbdt tree " << iter << "/" << k << " has "
+                                 << (trainer.nodes.size() + 1) / 2
+                                 << " leaves";
+        }
+    }
+
+    if (result->classifiers.empty())
+        throw AnnotatedException(400, "gbdt didn't train any trees");
+
+    // Committee::add() resets the bias
+    if (loss == GBDT_LOGISTIC)
+        result->bias = { -bias[0], bias[0] };
+    else result->bias = distribution<float>(bias.begin(), bias.end());
+
+    INFO_MSG(logger) << "gbdt trained " << result->classifiers.size()
+                     << " trees in " << timer.elapsed();
+
+    return result;
+}
+
+} // namespace MLDB
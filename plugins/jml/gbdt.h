@@ -0,0 +1,80 @@
+/** gbdt.h                                                         -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Histogram based gradient boosted decision trees, trained over the
+    bucketized features of a PartitionData.
+*/
+
+#pragma once
+
+#include "mldb/plugins/jml/randomforest.h"
+#include "mldb/utils/log_fwd.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GBDT LOSS                                                                 */
+/*****************************************************************************/
+
+/** Loss function that the boosting minimizes. */
+enum GbdtLoss {
+    GBDT_SQUARED,     ///< Squared error, for regression
+    GBDT_LOGISTIC,    ///< Logistic loss, for binary classification
+    GBDT_SOFTMAX      ///< Softmax cross entropy, for multiclass
+};
+
+
+/*****************************************************************************/
+/* GBDT PARAMS                                                               */
+/*****************************************************************************/
+
+struct GbdtParams {
+    int numTrees = 100;             ///< Number of boosting iterations
+    float learningRate = 0.1;       ///< Shrinkage applied to each tree
+    int maxLeaves = 31;             ///< Maximum leaves per tree
+    int maxDepth = 12;              ///< Maximum depth of any leaf
+    int minExamplesPerLeaf = 20;    ///< Minimum examples in each leaf
+    double minChildWeight = 1e-3;   ///< Minimum hessian sum in each leaf
+    double lambda = 1.0;            ///< L2 regularization of leaf values
+    double minSplitGain = 0.0;      ///< Minimum loss reduction of a split
+    float featureSamplingProp = 1.0;  ///< Features sampled for each tree
+    float exampleSamplingProp = 1.0;  ///< Examples sampled each iteration
+    bool verbosity = false;
+};
+
+
+/*****************************************************************************/
+/* TRAIN GBDT                                                                */
+/*****************************************************************************/
+
+/** Train a gradient boosted committee of decision trees.
+
+    The features and the examples come from data: each row gives the
+    example number (used to look up the feature buckets) and the weight
+    of the example.  The label of each row is taken from targets instead
+    of the row: the value to predict for GBDT_SQUARED, 0 or 1 for
+    GBDT_LOGISTIC, and the label number for GBDT_SOFTMAX.
+
+    Trees are grown leaf-wise, always splitting the leaf whose best split
+    most reduces the loss, using the first and second derivatives of the
+    loss.  Split points are found from per-bucket gradient histograms,
+    which are built over the features in parallel for the smaller child
+    of each split only; the histogram of the larger child is obtained by
+    subtracting it from the parent's.
+
+    The result predicts labelFeature with numLabels labels, as expected
+    by the classifier function: the margin is in label 1 (and its
+    negation in label 0) for GBDT_LOGISTIC, and there is one tree per
+    label and iteration for GBDT_SOFTMAX.
+*/
+std::shared_ptr<ML::Committee>
+trainGbdt(const PartitionData & data,
+          const std::vector<float> & targets,
+          GbdtLoss loss,
+          int numLabels,
+          const GbdtParams & params,
+          const std::shared_ptr<spdlog::logger> & logger);
+
+} // namespace MLDB
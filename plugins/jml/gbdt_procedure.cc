@@ -0,0 +1,288 @@
+/** gbdt_procedure.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Procedure to train gradient boosted decision trees.
+*/
+
+#include "gbdt_procedure.h"
+#include "mldb/plugins/jml/gbdt.h"
+#include "mldb/plugins/jml/dataset_feature_space.h"
+#include "mldb/plugins/jml/value_descriptions.h"
+#include "mldb/plugins/jml/jml/feature_info.h"
+#include "mldb/builtin/sql_expression_extractors.h"
+#include "mldb/builtin/sql_config_validator.h"
+#include "mldb/engine/column_scope.h"
+#include "mldb/core/mldb_engine.h"
+#include "mldb/arch/timers.h"
+#include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/utils/log.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+DEFINE_STRUCTURE_DESCRIPTION(GbdtProcedureConfig);
+
+GbdtProcedureConfigDescription::
+GbdtProcedureConfigDescription()
+{
+    addField("trainingData", &GbdtProcedureConfig::trainingData,
+             "Specification of the data for input to the procedure. "
+             "The select expression must contain these two sub-expressions: "
+             "one row expression to identify the features on which to train "
+             "and one scalar expression to identify the label.  An optional "
+             "'weight' expression gives the weight of each example.  "
+             "Labels with a null value will have their row skipped. "
+             "The select statement does not support groupby and having clauses. "
+             "Also, unlike most select expressions, this one can only select "
+             "whole columns, not expressions involving columns. So X will "
+             "work, but not X + 1.");
+    addField("modelFileUrl", &GbdtProcedureConfig::modelFileUrl,
+             "URL where the model file (with extension '.cls') should be saved. "
+             "This file can be loaded by the ![](%%doclink classifier function). ");
+    addField("mode", &GbdtProcedureConfig::mode,
+             "Model mode: `boolean` (logistic loss), `categorical` "
+             "(softmax loss, with one tree per label for each iteration) "
+             "or `regression` (squared loss).  `multilabel` is not supported.",
+             CM_BOOLEAN);
+    addField("numTrees", &GbdtProcedureConfig::numTrees,
+             "Number of boosting iterations.", 100);
+    addField("learningRate", &GbdtProcedureConfig::learningRate,
+             "Shrinkage applied to the output of each tree.  Smaller values "
+             "need more trees but generalize better.", 0.1f);
+    addField("maxLeaves", &GbdtProcedureConfig::maxLeaves,
+             "Maximum number of leaves of each tree.  Trees are grown "
+             "leaf-wise, splitting the leaf that most reduces the loss "
+             "first.", 31);
+    addField("maxDepth", &GbdtProcedureConfig::maxDepth,
+             "Maximum depth of each tree.", 12);
+    addField("minExamplesPerLeaf", &GbdtProcedureConfig::minExamplesPerLeaf,
+             "Minimum number of examples in each leaf.", 20);
+    addField("minChildWeight", &GbdtProcedureConfig::minChildWeight,
+             "Minimum sum of the second derivatives of the loss (the "
+             "hessians) in each leaf.", 1e-3);
+    addField("lambda", &GbdtProcedureConfig::lambda,
+             "L2 regularization of the leaf values.", 1.0);
+    addField("minSplitGain", &GbdtProcedureConfig::minSplitGain,
+             "Minimum reduction of the loss for a leaf to be split.", 0.0);
+    addField("featureSamplingProp", &GbdtProcedureConfig::featureSamplingProp,
+             "Proportion of features that each tree may split on.", 1.0f);
+    addField("exampleSamplingProp", &GbdtProcedureConfig::exampleSamplingProp,
+             "Proportion of examples used to train the trees of each "
+             "iteration.", 1.0f);
+    addField("functionName", &GbdtProcedureConfig::functionName,
+             "If specified, an instance of the ![](%%doclink classifier function) of this name will be created using "
+             "the trained model. Note that to use this parameter, the `modelFileUrl` must "
+             "also be provided.");
+    addField("verbosity", &GbdtProcedureConfig::verbosity,
+             "Should the procedure be verbose for debugging and tuning purposes", false);
+    addParent<ProcedureConfig>();
+
+    onPostValidate = chain(validateQuery(&GbdtProcedureConfig::trainingData,
+                                         NoGroupByHaving(),
+                                         PlainColumnSelect(),
+                                         MustContainFrom(),
+                                         FeaturesLabelSelect()),
+                           validateFunction<GbdtProcedureConfig>());
+}
+
+
+/*****************************************************************************/
+/* GBDT PROCEDURE                                                            */
+/*****************************************************************************/
+
+GbdtProcedure::
+GbdtProcedure(MldbEngine * owner,
+              PolyConfig config,
+              const std::function<bool (const Json::Value &)> & onProgress)
+    : Procedure(owner)
+{
+    this->procedureConfig = config.params.convert<GbdtProcedureConfig>();
+}
+
+Any
+GbdtProcedure::
+getStatus() const
+{
+    return Any();
+}
+
+RunOutput
+GbdtProcedure::
+run(const ProcedureRunConfig & run,
+    const std::function<bool (const Json::Value &)> & onProgress) const
+{
+    GbdtProcedureConfig runProcConf =
+        applyRunConfOverProcConf(procedureConfig, run);
+
+    Timer timer;
+
+    // this includes being empty
+    if(!runProcConf.modelFileUrl.valid()) {
+         throw MLDB::Exception("modelFileUrl is not valid");
+    }
+
+    if (runProcConf.numTrees < 1
+        || runProcConf.maxLeaves < 2
+        || runProcConf.maxDepth < 1
+        || runProcConf.minExamplesPerLeaf < 1
+        || !(runProcConf.learningRate > 0)
+        || !(runProcConf.lambda >= 0)
+        || !(runProcConf.featureSamplingProp > 0
+             && runProcConf.featureSamplingProp <= 1)
+        || !(runProcConf.exampleSamplingProp > 0
+             && runProcConf.exampleSamplingProp <= 1)) {
+        throw AnnotatedException
+            (400, "gbdt.train requires numTrees, maxDepth and "
+             "minExamplesPerLeaf to be positive, maxLeaves to be at least 2, "
+             "learningRate to be positive, lambda non-negative and the "
+             "sampling proportions to be in (0, 1]",
+             "config", runProcConf);
+    }
+
+    GbdtLoss loss;
+    switch (runProcConf.mode) {
+    case CM_REGRESSION:  loss = GBDT_SQUARED;  break;
+    case CM_BOOLEAN:     loss = GBDT_LOGISTIC;  break;
+    case CM_CATEGORICAL: loss = GBDT_SOFTMAX;  break;
+    default:
+        throw AnnotatedException(400, "gbdt.train only supports the boolean, "
+                                 "categorical and regression modes");
+    }
+
+    checkWritability(runProcConf.modelFileUrl.toDecodedString(),
+                     "modelFileUrl");
+
+    // 1.  Get the input dataset
+    SqlExpressionMldbScope context(engine);
+
+    ConvertProgressToJson convertProgressToJson(onProgress);
+    auto boundDataset = runProcConf.trainingData.stm->from->bind(context, convertProgressToJson);
+
+    auto labelVal = extractNamedSubSelect("label", runProcConf.trainingData.stm->select);
+    auto featuresVal = extractNamedSubSelect("features", runProcConf.trainingData.stm->select);
+    if (!labelVal || !featuresVal) {
+        throw AnnotatedException(400, "trainingData must return a 'features' row and a 'label'");
+    }
+
+    auto weightVal = extractNamedSubSelect("weight", runProcConf.trainingData.stm->select);
+    auto weight = weightVal ? weightVal->expression : SqlExpression::ONE;
+
+    auto withinExpression
+        = std::dynamic_pointer_cast<const SelectWithinExpression>
+        (featuresVal->expression);
+    if (!withinExpression) {
+        throw AnnotatedException(400, "trainingData must return a 'features' row");
+    }
+    shared_ptr<SqlRowExpression> subSelect = withinExpression->select;
+
+    // 2.  Get the labels, weights and filter for each row
+    ColumnScope colScope(engine, boundDataset.dataset);
+    auto boundLabel = labelVal->expression->bind(colScope);
+    auto boundWhere = runProcConf.trainingData.stm->where->bind(colScope);
+    auto boundWeight = weight->bind(colScope);
+
+    TrainingLabels trainingLabels
+        (colScope.run({boundLabel, boundWhere, boundWeight}),
+         runProcConf.mode);
+
+    if (loss == GBDT_SOFTMAX && trainingLabels.numLabels < 2)
+        throw AnnotatedException(400, "gbdt.train in categorical mode "
+                                 "needs at least two distinct labels");
+
+    // 3.  Bucketize the features
+    SelectExpression select({subSelect});
+
+    std::set<ColumnPath> knownInputColumns;
+    {
+        SqlExpressionDatasetScope scope(boundDataset);
+        auto selectBound = select.bind(scope);
+        for (auto & c : selectBound.info->getKnownColumns()) {
+            knownInputColumns.insert(c.columnName);
+        }
+    }
+
+    auto featureSpace = std::make_shared<DatasetFeatureSpace>
+        (boundDataset.dataset, trainingLabels.labelInfo, knownInputColumns,
+         true /* bucketize */);
+
+    INFO_MSG(logger) << "feature space construction took " << timer.elapsed();
+    timer.restart();
+
+    // The feature buckets are indexed by the row number in the dataset,
+    // which is thus the example number of each row.
+    PartitionData data(featureSpace);
+    std::vector<float> targets;
+    targets.reserve(trainingLabels.numRowsKept);
+    for (size_t i = 0;  i < trainingLabels.labels.size();  ++i) {
+        if (!trainingLabels.keepRow(i))
+            continue;
+
+        data.addRow(false /* label is in targets */,
+                    trainingLabels.getWeight(i), i);
+        targets.push_back(trainingLabels.getLabel(i));
+    }
+
+    INFO_MSG(logger) << "training gbdt on " << targets.size() << " of "
+                     << trainingLabels.labels.size() << " rows with "
+                     << knownInputColumns.size() << " features";
+
+    GbdtParams params;
+    params.numTrees = runProcConf.numTrees;
+    params.learningRate = runProcConf.learningRate;
+    params.maxLeaves = runProcConf.maxLeaves;
+    params.maxDepth = runProcConf.maxDepth;
+    params.minExamplesPerLeaf = runProcConf.minExamplesPerLeaf;
+    params.minChildWeight = runProcConf.minChildWeight;
+    params.lambda = runProcConf.lambda;
+    params.minSplitGain = runProcConf.minSplitGain;
+    params.featureSamplingProp = runProcConf.featureSamplingProp;
+    params.exampleSamplingProp = runProcConf.exampleSamplingProp;
+    params.verbosity = runProcConf.verbosity;
+
+    auto result = trainGbdt(data, targets, loss, trainingLabels.numLabels,
+                            params, logger);
+
+    INFO_MSG(logger) << "gbdt training took " << timer.elapsed();
+
+    ML::Classifier classifier(result);
+
+    //Save the model, create the function
+
+    bool saved = true;
+    try {
+        makeUriDirectory(
+            runProcConf.modelFileUrl.toDecodedString());
+        classifier.save(runProcConf.modelFileUrl.toString());
+    }
+    catch (const std::exception & exc) {
+        saved = false;
+        INFO_MSG(logger) << "Error saving classifier: " << exc.what();
+    }
+
+    if(saved && !runProcConf.functionName.empty()) {
+        PolyConfig clsFuncPC;
+        clsFuncPC.type = "classifier";
+        clsFuncPC.id = runProcConf.functionName;
+        clsFuncPC.params = ClassifyFunctionConfig(runProcConf.modelFileUrl);
+
+        obtainFunction(engine, clsFuncPC, onProgress);
+    }
+
+    return RunOutput();
+}
+
+namespace {
+
+static RegisterProcedureType<GbdtProcedure, GbdtProcedureConfig>
+regGbdt(builtinPackage(),
+        "Train gradient boosted decision trees",
+        "procedures/Gbdt.md.html");
+
+} // file scope
+
+} // namespace MLDB
@@ -0,0 +1,90 @@
+/** gbdt_procedure.h                                               -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Procedure to train gradient boosted decision trees.
+*/
+
+#pragma once
+
+#include "mldb/core/dataset.h"
+#include "mldb/core/procedure.h"
+#include "mldb/core/function.h"
+#include "mldb/types/value_description_fwd.h"
+#include "mldb/plugins/jml/classifier.h"
+
+
+namespace MLDB {
+
+
+struct GbdtProcedureConfig : public ProcedureConfig {
+    static constexpr const char * name = "gbdt.train";
+
+    /// Query to select the training data
+    InputQuery trainingData;
+
+    /// Where to save the classifier to
+    Url modelFileUrl;
+
+    /// What mode to run in
+    ClassifierMode mode = CM_BOOLEAN;
+
+    /// Number of boosting iterations
+    int numTrees = 100;
+
+    /// Shrinkage applied to the output of each tree
+    float learningRate = 0.1;
+
+    /// Maximum number of leaves in each tree
+    int maxLeaves = 31;
+
+    /// Maximum depth of each tree
+    int maxDepth = 12;
+
+    /// Minimum number of examples in a leaf
+    int minExamplesPerLeaf = 20;
+
+    /// Minimum sum of hessians in a leaf
+    double minChildWeight = 1e-3;
+
+    /// L2 regularization of the leaf values
+    double lambda = 1.0;
+
+    /// Minimum reduction of the loss for a split to be made
+    double minSplitGain = 0.0;
+
+    /// Proportion of features to sample for each tree
+    float featureSamplingProp = 1.0;
+
+    /// Proportion of examples to sample for each iteration
+    float exampleSamplingProp = 1.0;
+
+    // Debug Verbosity
+    bool verbosity = false;
+
+    // Function name
+    Utf8String functionName;
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(GbdtProcedureConfig);
+
+
+/*****************************************************************************/
+/* GBDT PROCEDURE                                                            */
+/*****************************************************************************/
+
+struct GbdtProcedure: public Procedure {
+
+    GbdtProcedure(MldbEngine * owner,
+                  PolyConfig config,
+                  const std::function<bool (const Json::Value &)> & onProgress);
+
+    virtual RunOutput run(const ProcedureRunConfig & run,
+                          const std::function<bool (const Json::Value &)> & onProgress) const;
+
+    virtual Any getStatus() const;
+
+    GbdtProcedureConfig procedureConfig;
+};
+
+
+} // namespace MLDB
@@ -50,6 +50,8 @@ LIBMLDB_JML_PLUGIN_SOURCES:= \
 	accuracy.cc \
 	experiment_procedure.cc \
 	randomforest.cc \
+	gbdt.cc \
+	gbdt_procedure.cc \
 	dataset_feature_space.cc \
 	kmeans_interface.cc \
 	em_interface.cc \
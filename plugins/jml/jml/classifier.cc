@@ -543,6 +543,27 @@ predict(int label,
     return optimized_predict_impl(label, fv, info, context);
 }
 
+void
+Classifier_Impl::
+predict_batch(const float * const * features,
+              size_t n,
+              const Optimization_Info & info,
+              double * output,
+              PredictionContext * context) const
+{
+    int nl = label_count();
+    int nf = info.features_out();
+    vector<float> fv(n * nf);
+    vector<const float *> rows(n);
+    for (size_t i = 0;  i < n;  ++i) {
+        info.apply(features[i], &fv[i * nf]);
+        rows[i] = &fv[i * nf];
+    }
+
+    std::fill(output, output + n * nl, 0.0);
+    optimized_predict_batch_impl(rows.data(), n, info, output, 1.0, context);
+}
+
 bool
 Classifier_Impl::
 optimize_impl(Optimization_Info & info)
@@ -597,6 +618,21 @@ optimized_predict_impl(int label,
     return predict(label, fset, context);
 }
 
+void
+Classifier_Impl::
+optimized_predict_batch_impl(const float * const * features,
+                             size_t n,
+                             const Optimization_Info & info,
+                             double * accum,
+                             double weight,
+                             PredictionContext * context) const
+{
+    int nl = label_count();
+    for (size_t i = 0;  i < n;  ++i)
+        optimized_predict_impl(features[i], info, accum + i * nl, weight,
+                               context);
+}
+
 namespace {
 
 struct Accuracy_Job_Info {
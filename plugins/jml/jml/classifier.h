@@ -359,6 +359,18 @@ public:
                           const Optimization_Info & info,
                           PredictionContext * context = 0) const;
 
+    /** Predict all labels for each of the n given feature vectors, which
+        have the features passed to optimize().  The label_count() results
+        for example i are written into output + i * label_count().  The
+        whole batch is passed down to the classifier at once, which allows
+        tree ensembles to interleave their traversals.
+    */
+    virtual void predict_batch(const float * const * features,
+                               size_t n,
+                               const Optimization_Info & info,
+                               double * output,
+                               PredictionContext * context = 0) const;
+
     //protected:
 
     /** Function to override to perform the optimization.  Default will
@@ -390,6 +402,19 @@ public:
                            const float * features,
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
+
+    /** Optimized predict for a batch of n dense feature vectors, adding
+        weight times the predictions for example i into
+        accum + i * label_count().  The default calls the accumulating
+        optimized_predict_impl for each example in turn.
+    */
+    virtual void
+    optimized_predict_batch_impl(const float * const * features,
+                                 size_t n,
+                                 const Optimization_Info & info,
+                                 double * accum,
+                                 double weight = 1.0,
+                                 PredictionContext * context = 0) const;
     
 public:
     /** Run the classifier over the entire dataset, calling the predict
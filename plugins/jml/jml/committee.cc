@@ -179,6 +179,31 @@ optimized_predict_impl(int label,
     return result;
 }
 
+void
+Committee::
+optimized_predict_batch_impl(const float * const * features,
+                             size_t n,
+                             const Optimization_Info & info,
+                             double * accum,
+                             double weight,
+                             PredictionContext * context) const
+{
+    int nl = bias.size();
+
+    for (size_t i = 0;  i < n;  ++i)
+        for (unsigned j = 0;  j < nl;  ++j)
+            accum[i * nl + j] += weight * bias[j];
+
+    // Each member sees the whole batch, so that its nodes stay in cache
+    // while all of the examples go through it
+    for (unsigned i = 0;  i < classifiers.size();  ++i) {
+        if (weights[i] == 0.0) continue;
+        classifiers[i]
+            ->optimized_predict_batch_impl(features, n, info, accum,
+                                           weight * weights[i], context);
+    }
+}
+
 Explanation
 Committee::
 explain(const Feature_Set & feature_set,
@@ -103,6 +103,14 @@ public:
                            const Optimization_Info & info,
                            PredictionContext * context = 0) const;
 
+    virtual void
+    optimized_predict_batch_impl(const float * const * features,
+                                 size_t n,
+                                 const Optimization_Info & info,
+                                 double * accum,
+                                 double weight,
+                                 PredictionContext * context = 0) const;
+
     virtual Explanation explain(const Feature_Set & feature_set,
                                 const ML::Label & label,
                                 double weight = 1.0,
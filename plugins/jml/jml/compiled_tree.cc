@@ -0,0 +1,146 @@
+/* compiled_tree.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Flattened form of a decision tree, used for optimized prediction.
+*/
+
+#include "compiled_tree.h"
+#include "mldb/arch/exception.h"
+#include <deque>
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED_TREE                                                             */
+/*****************************************************************************/
+
+Compiled_Tree::
+Compiled_Tree()
+    : root(~0), nl(0)
+{
+}
+
+void
+Compiled_Tree::
+compile(const Tree & tree, int label_count)
+{
+    clear();
+    nl = label_count;
+
+    // Leaf 0 is the empty leaf, used for the children that don't exist
+    leaf_values.resize(nl, 0.0f);
+
+    auto addLeaf = [&] (const Tree::Leaf & leaf) -> int32_t
+        {
+            int32_t index = leaf_values.size() / nl;
+            size_t n = std::min<size_t>(leaf.pred.size(), nl);
+            leaf_values.insert(leaf_values.end(),
+                               leaf.pred.begin(), leaf.pred.begin() + n);
+            leaf_values.resize(leaf_values.size() + nl - n, 0.0f);
+            return ~index;
+        };
+
+    // Nodes are numbered in the order that they are pushed onto the queue,
+    // which gives a breadth first layout.
+    deque<const Tree::Node *> queue;
+
+    auto addChild = [&] (const Tree::Ptr & ptr) -> int32_t
+        {
+            if (!ptr)
+                return ~0;
+            if (!ptr.node())
+                return addLeaf(*ptr.leaf());
+            queue.push_back(ptr.node());
+            return nodes.size() + queue.size() - 1;
+        };
+
+    root = addChild(tree.root);
+
+    while (!queue.empty()) {
+        const Tree::Node & node = *queue.front();
+        queue.pop_front();
+
+        const Split & split = node.split;
+        if (!split.is_optimized())
+            throw Exception("Compiled_Tree::compile(): "
+                            "tree has not been optimized");
+        if (split.op() > Split::NOT_MISSING)
+            throw Exception("Compiled_Tree::compile(): invalid split op");
+
+        nodes.emplace_back();
+        Node & compiled = nodes.back();
+        compiled.feature = split.optimized_index();
+        compiled.split_val = split.split_val();
+        compiled.op_mask = 1 << split.op();
+
+        // Note that these may reallocate the nodes vector
+        int32_t child_false = addChild(node.child_false);
+        int32_t child_true = addChild(node.child_true);
+        int32_t child_missing = addChild(node.child_missing);
+
+        Node & compiled2 = nodes.back();
+        compiled2.child[false] = child_false;
+        compiled2.child[true] = child_true;
+        compiled2.child[MISSING] = child_missing;
+    }
+}
+
+void
+Compiled_Tree::
+clear()
+{
+    nodes.clear();
+    leaf_values.clear();
+    root = ~0;
+    nl = 0;
+}
+
+void
+Compiled_Tree::
+swap(Compiled_Tree & other)
+{
+    nodes.swap(other.nodes);
+    leaf_values.swap(other.leaf_values);
+    std::swap(root, other.root);
+    std::swap(nl, other.nl);
+}
+
+void
+Compiled_Tree::
+find_leaves(const float * const * features, size_t n,
+            int32_t * leaves) const
+{
+    std::fill(leaves, leaves + n, root);
+
+    for (bool active = root >= 0;  active;) {
+        active = false;
+        for (size_t i = 0;  i < n;  ++i) {
+            int32_t index = leaves[i];
+            if (index < 0) continue;
+            const Node & node = nodes[index];
+            index = node.child[node.branch(features[i][node.feature])];
+            leaves[i] = index;
+            active |= index >= 0;
+        }
+    }
+
+    for (size_t i = 0;  i < n;  ++i)
+        leaves[i] = ~leaves[i];
+}
+
+size_t
+Compiled_Tree::
+memusage() const
+{
+    return sizeof(*this)
+        + nodes.capacity() * sizeof(Node)
+        + leaf_values.capacity() * sizeof(float);
+}
+
+} // namespace ML
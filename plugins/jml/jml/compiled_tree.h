@@ -0,0 +1,102 @@
+/* compiled_tree.h                                                 -*- C++ -*-
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Flattened form of a decision tree, used for optimized prediction.
+*/
+
+#pragma once
+
+#include "tree.h"
+#include <vector>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED_TREE                                                             */
+/*****************************************************************************/
+
+/** A decision tree compiled into contiguous arrays, for prediction over
+    optimized (dense) feature vectors.
+
+    The nodes are stored breadth first in a single aligned array, so that
+    the top levels of the tree (which every example visits) share a handful
+    of cache lines.  Each node holds the index of its feature in the dense
+    vector and its three children indexed directly by the result of the
+    split (false, true or MISSING), so that the branch taken is computed
+    without any conditionals.  The leaf predictions are packed into a
+    single array of label_count values per leaf.
+
+    A child index >= 0 refers to a node; a negative index i refers to leaf
+    ~i.  Missing children of the tree are mapped onto a leaf that predicts
+    zero for all labels, which contributes nothing to the result.
+*/
+
+struct Compiled_Tree {
+    Compiled_Tree();
+
+    struct alignas(32) Node {
+        uint32_t feature;    ///< Index of feature in the optimized vector
+        float split_val;     ///< Value to test against
+        uint32_t op_mask;    ///< 1 << Split::Op
+        int32_t child[3];    ///< Child for false, true and MISSING
+
+        /** Return the branch to take (false, true or MISSING) for the given
+            feature value.  Same semantics as Split::apply(float).
+        */
+        MLDB_ALWAYS_INLINE int branch(float val) const
+        {
+            int not_missing = val == val;
+            int all = (val < split_val) | ((val == split_val) << 1)
+                | (not_missing << 2);
+            return ((op_mask & all) != 0) | ((not_missing ^ 1) << 1);
+        }
+    };
+
+    std::vector<Node> nodes;         ///< Nodes in breadth first order
+    std::vector<float> leaf_values;  ///< label_count values per leaf
+    int32_t root;                    ///< Index of the root node or leaf
+    int nl;                          ///< Number of labels per leaf
+
+    /** Compile the given tree, whose splits must already have been
+        optimized. */
+    void compile(const Tree & tree, int label_count);
+
+    void clear();
+
+    void swap(Compiled_Tree & other);
+
+    /** Return the index of the leaf reached by the given dense feature
+        vector. */
+    MLDB_ALWAYS_INLINE int32_t find_leaf(const float * features) const
+    {
+        int32_t i = root;
+        while (i >= 0) {
+            const Node & node = nodes[i];
+            i = node.child[node.branch(features[node.feature])];
+        }
+        return ~i;
+    }
+
+    /** Find the leaves reached by each of the n given feature vectors,
+        writing them into leaves.  The examples are advanced one level at a
+        time together, so that the memory accesses for the different
+        examples overlap rather than each walk waiting on the previous.
+    */
+    void find_leaves(const float * const * features, size_t n,
+                     int32_t * leaves) const;
+
+    /** Return the label_count predictions for the given leaf. */
+    MLDB_ALWAYS_INLINE const float * leaf(int32_t index) const
+    {
+        return &leaf_values[index * nl];
+    }
+
+    /* Estimate of the amount of allocated memory. */
+    size_t memusage() const;
+};
+
+
+} // namespace ML
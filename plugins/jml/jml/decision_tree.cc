@@ -66,6 +66,7 @@ swap(Decision_Tree & other)
     std::swap(tree, other.tree);
     std::swap(encoding, other.encoding);
     std::swap(optimized_, other.optimized_);
+    compiled_.swap(other.compiled_);
 }
 
 namespace {
@@ -84,46 +85,6 @@ struct StandardGetFeatures {
     }
 };
 
-struct OptimizedGetFeatures {
-    OptimizedGetFeatures(const float * features)
-        : features(features)
-    {
-    }
-
-    const float * features;
-
-    MLDB_ALWAYS_INLINE Split::Weights operator () (const Split & split) const
-    {
-        return split.apply(features);
-    }
-                      
-};
-
-struct AccumResults {
-    explicit AccumResults(double * accum, int nl, double weight)
-        : accum(accum), nl(nl), weight(weight)
-    {
-    }
-
-    double * accum;
-    int nl;
-    double weight;
-
-    MLDB_ALWAYS_INLINE
-    void operator () (const Label_Dist & dist, float weight1)
-    {
-        if (MLDB_LIKELY(nl == 2)) {
-            double factor = weight1 * weight;
-            accum[0] += dist[0] * factor;
-            accum[1] += dist[1] * factor;
-            return;
-        }
-
-        for (unsigned i = 0;  i < nl;  ++i)
-            accum[i] += dist[i] * weight1 * weight;
-    }
-};
-
 struct DistResults {
     explicit DistResults(double * accum, int nl)
         : accum(accum), nl(nl)
@@ -209,6 +170,7 @@ Decision_Tree::
 optimize_impl(Optimization_Info & info)
 {
     optimize_recursive(info, tree.root);
+    compiled_.compile(tree, label_count());
     optimized_ = true;
     return true;
 }
@@ -229,20 +191,22 @@ optimize_recursive(Optimization_Info & info,
     optimize_recursive(info, node.child_missing);
 }
 
+/* The optimized predict methods use the compiled form of the tree.  As
+   the optimized splits send all of the weight down a single branch, each
+   example reaches exactly one leaf, and the results are the same as those
+   of predict_recursive_impl. */
+
 Label_Dist
 Decision_Tree::
 optimized_predict_impl(const float * features,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-
-    int nl = label_count();
-    double accum[nl];
-    DistResults results(accum, nl);
+    if (!optimized_)
+        throw Exception("Decision_Tree: optimized predict on unoptimized tree");
 
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    const float * leaf = compiled_.leaf(compiled_.find_leaf(features));
+    return Label_Dist(leaf, leaf + compiled_.nl);
 }
 
 void
@@ -253,10 +217,12 @@ optimized_predict_impl(const float * features,
                        double weight,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    AccumResults results(accum, label_count(), weight);
+    if (!optimized_)
+        throw Exception("Decision_Tree: optimized predict on unoptimized tree");
 
-    predict_recursive_impl(get_features, results, tree.root);
+    const float * leaf = compiled_.leaf(compiled_.find_leaf(features));
+    for (unsigned i = 0;  i < compiled_.nl;  ++i)
+        accum[i] += leaf[i] * weight;
 }
 
 float
@@ -266,11 +232,41 @@ optimized_predict_impl(int label,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    LabelResults results(label);
+    if (!optimized_)
+        throw Exception("Decision_Tree: optimized predict on unoptimized tree");
 
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    return compiled_.leaf(compiled_.find_leaf(features))[label];
+}
+
+void
+Decision_Tree::
+optimized_predict_batch_impl(const float * const * features,
+                             size_t n,
+                             const Optimization_Info & info,
+                             double * accum,
+                             double weight,
+                             PredictionContext * context) const
+{
+    if (!optimized_)
+        throw Exception("Decision_Tree: optimized predict on unoptimized tree");
+
+    int nl = compiled_.nl;
+
+    // Process in chunks so that the leaf indexes stay on the stack
+    static constexpr size_t CHUNK = 256;
+    int32_t leaves[CHUNK];
+
+    for (size_t start = 0;  start < n;  start += CHUNK) {
+        size_t nchunk = std::min(n - start, CHUNK);
+        compiled_.find_leaves(features + start, nchunk, leaves);
+
+        for (size_t i = 0;  i < nchunk;  ++i) {
+            const float * leaf = compiled_.leaf(leaves[i]);
+            double * output = accum + (start + i) * nl;
+            for (unsigned j = 0;  j < nl;  ++j)
+                output[j] += leaf[j] * weight;
+        }
+    }
 }
 
 template<class GetFeatures, class Results>
@@ -649,6 +645,7 @@ reconstitute(DB::Store_Reader & store,
         throw Exception("Decision_Tree::reconstitute: read bad marker at end");
 
     optimized_ = false;
+    compiled_.clear();
 }
     
 std::string
@@ -54,6 +54,7 @@ LIBBOOSTING_SOURCES := \
         onevsall.cc \
         onevsall_generator.cc \
         tree.cc \
+        compiled_tree.cc \
         split.cc \
         training_index_iterators.cc \
         feature.cc \
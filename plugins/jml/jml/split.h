@@ -190,6 +190,11 @@ public:
     float split_val() const { return split_val_; }
     Op op() const { return (Op)op_; }
 
+    /** Has optimize() been called, and if so which index in the optimized
+        feature vector does our feature live at? */
+    bool is_optimized() const { return opt_; }
+    int optimized_index() const { return idx_; }
+
     std::string print(const Feature_Space & fs, int branch = true) const;
 
     void serialize(DB::Store_Writer & store,
@@ -0,0 +1,163 @@
+/* compiled_tree_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the compiled form of decision trees used by the optimized
+   predict gives the same results as walking the tree.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <iostream>
+
+#include "mldb/plugins/jml/jml/decision_tree_generator.h"
+#include "mldb/plugins/jml/jml/decision_tree.h"
+#include "mldb/plugins/jml/jml/committee.h"
+#include "mldb/plugins/jml/jml/training_data.h"
+#include "mldb/plugins/jml/jml/dense_features.h"
+#include "mldb/plugins/jml/jml/feature_info.h"
+#include "mldb/utils/smart_ptr_utils.h"
+
+using namespace ML;
+using namespace std;
+
+namespace {
+
+/* Random dataset where the label depends on all three features, and the
+   third feature is often missing so that the missing branches are used. */
+struct TestData {
+    TestData(int nfv, Feature_Type labelType)
+    {
+        fs.add_feature("LABEL", Feature_Info(labelType, false, true));
+        fs.add_feature("feature1", REAL);
+        fs.add_feature("feature2", REAL);
+        fs.add_feature("feature3", REAL);
+        fsp = make_unowned_sp(fs);
+        data.reset(new Training_Data(fsp));
+
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> uniform(0, 1);
+
+        for (unsigned i = 0;  i < nfv;  ++i) {
+            float f1 = uniform(rng), f2 = uniform(rng), f3 = uniform(rng);
+            if (uniform(rng) < 0.2)
+                f3 = NAN;
+            // Some exactly repeated values to exercise equality
+            if (uniform(rng) < 0.1)
+                f2 = 0.5;
+
+            float label = (f1 + f2 > 1.0) ^ (f3 < 0.3);
+            if (labelType == REAL)
+                label = f1 * 2 + f2 + (std::isnan(f3) ? -1 : f3);
+
+            distribution<float> features = { label, f1, f2, f3 };
+            examples.push_back(features);
+            data->add_example(fs.encode(features));
+        }
+
+        features = fs.features();
+        features.erase(features.begin());
+    }
+
+    std::shared_ptr<Decision_Tree> train(int max_depth) const
+    {
+        Configuration config;
+        config.parse_string("trace=0\nmax_depth=" + to_string(max_depth),
+                            "inbuilt config file");
+
+        Decision_Tree_Generator generator;
+        vector<string> unparsedKeys;
+        generator.configure(config, unparsedKeys);
+        generator.init(fsp, fs.features()[0]);
+
+        distribution<float> training_weights(data->example_count(), 1);
+        Thread_Context context;
+
+        auto result = generator.generate(context, *data, training_weights,
+                                         features);
+        return std::dynamic_pointer_cast<Decision_Tree>(result);
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    std::shared_ptr<Training_Data> data;
+    vector<distribution<float> > examples;
+    vector<Feature> features;
+};
+
+// Check the optimized (compiled) predictions against the unoptimized ones
+// for all of the examples
+void checkSame(const TestData & test, Classifier_Impl & classifier)
+{
+    Optimization_Info info = classifier.optimize(test.features);
+    BOOST_REQUIRE(classifier.predict_is_optimized());
+
+    int nl = classifier.label_count();
+    size_t n = test.examples.size();
+
+    vector<const float *> rows;
+    for (auto & ex: test.examples)
+        rows.push_back(&ex[1]);
+
+    vector<double> batch(n * nl);
+    classifier.predict_batch(rows.data(), n, info, batch.data());
+
+    for (unsigned i = 0;  i < n;  ++i) {
+        auto fset = test.fs.encode(test.examples[i]);
+        Label_Dist expected = classifier.predict(*fset);
+        Label_Dist optimized = classifier.predict(rows[i], info);
+
+        BOOST_REQUIRE_EQUAL(optimized.size(), nl);
+        for (unsigned j = 0;  j < nl;  ++j) {
+            BOOST_CHECK_CLOSE(optimized[j], expected[j], 1e-5);
+            BOOST_CHECK_EQUAL((float)batch[i * nl + j], optimized[j]);
+            BOOST_CHECK_CLOSE(classifier.predict(j, rows[i], info),
+                              optimized[j], 1e-5);
+        }
+    }
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_compiled_tree_classification )
+{
+    TestData test(2000, BOOLEAN);
+    auto tree = test.train(8);
+    BOOST_REQUIRE(tree);
+    BOOST_CHECK_GT(tree->compiled_.nodes.size(), 0);
+
+    checkSame(test, *tree);
+
+    // Nodes are laid out breadth first, so each child comes after its
+    // parent
+    auto & nodes = tree->compiled_.nodes;
+    for (unsigned i = 0;  i < nodes.size();  ++i)
+        for (unsigned j = 0;  j < 3;  ++j)
+            if (nodes[i].child[j] >= 0)
+                BOOST_CHECK_GT(nodes[i].child[j], i);
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_tree_regression )
+{
+    TestData test(2000, REAL);
+    auto tree = test.train(6);
+    BOOST_REQUIRE(tree);
+
+    checkSame(test, *tree);
+}
+
+BOOST_AUTO_TEST_CASE( test_compiled_tree_committee )
+{
+    TestData test(2000, BOOLEAN);
+
+    Committee committee(test.fsp, test.fs.features()[0]);
+    for (int depth: { 1, 3, 5, 8 })
+        committee.add(test.train(depth), 0.25 * depth);
+    committee.bias[1] = 0.5;
+
+    checkSame(test, committee);
+}
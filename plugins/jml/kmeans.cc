@@ -81,6 +81,31 @@ train(const std::vector<distribution<float>> & points,
     }
 
 
+    switch (algorithm) {
+    case KMEANS_LLOYD:
+        trainLloyd(points, in_cluster, maxIterations);
+        break;
+    case KMEANS_HAMERLY:
+        trainHamerly(points, in_cluster, maxIterations);
+        break;
+    case KMEANS_MINIBATCH:
+        trainMiniBatch(points, in_cluster, maxIterations, rng);
+        break;
+    default:
+        throw MLDB::Exception("unknown kmeans algorithm");
+    }
+}
+
+void
+KMeans::
+trainLloyd(const std::vector<distribution<float>> & points,
+           std::vector<int> & in_cluster,
+           int maxIterations)
+{
+    using namespace std;
+
+    int nbClusters = clusters.size();
+
     for (int iter = 0;  iter < maxIterations;  ++iter) {
 
         // How many have changed cluster?  Used to know when the cluster
@@ -132,7 +157,7 @@ train(const std::vector<distribution<float>> & points,
                              << cluster.centroid[1] << ","
                              << i << ",centroid\n";
             }
-            for (int i=0; i< npoints; ++i)
+            for (int i=0; i < points.size(); ++i)
                 stream << points[i][0] << ","
                               << points[i][1] << ","
                               << in_cluster[i] << ",point\n";
@@ -142,27 +167,7 @@ train(const std::vector<distribution<float>> & points,
 
         // std::cerr << "\niter " << iter << std::endl;
 
-        // Calculate means
-        for (auto & c : clusters)
-            // If no member, we want to leave it there
-            if (c.nbMembers > 0)
-                std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
-
-        std::vector<std::mutex> locks(clusters.size());
-
-        auto addToMeanForPoint = [&] (int i) {
-            int cluster = in_cluster[i];
-            auto point = points[i];
-
-            {
-                // cerr << "cluster du point i " << cluster << endl;
-                std::unique_lock<std::mutex> guard(locks[cluster]);
-                // cerr << "patate pour mich" << endl;
-                metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
-            }
-        };
-
-        MLDB::parallelMap(0, points.size(), addToMeanForPoint);
+        updateCentroids(points, in_cluster);
 
         // for (int i=0; i < clusters.size(); ++i) {
             // cerr << "cluster " << i << " had " << clusters[i].nbMembers
@@ -192,6 +197,232 @@ train(const std::vector<distribution<float>> & points,
     }
 }
 
+void
+KMeans::
+updateCentroids(const std::vector<distribution<float>> & points,
+                const std::vector<int> & in_cluster)
+{
+    // Calculate means
+    for (auto & c : clusters)
+        // If no member, we want to leave it there
+        if (c.nbMembers > 0)
+            std::fill(c.centroid.begin(), c.centroid.end(), 0.0);
+
+    std::vector<std::mutex> locks(clusters.size());
+
+    auto addToMeanForPoint = [&] (int i) {
+        int cluster = in_cluster[i];
+        auto point = points[i];
+
+        {
+            // cerr << "cluster du point i " << cluster << endl;
+            std::unique_lock<std::mutex> guard(locks[cluster]);
+            // cerr << "patate pour mich" << endl;
+            metric->contributeToAverage(clusters[cluster].centroid, point, 1. / (double) clusters[cluster].nbMembers);
+        }
+    };
+
+    MLDB::parallelMap(0, points.size(), addToMeanForPoint);
+}
+
+void
+KMeans::
+trainHamerly(const std::vector<distribution<float>> & points,
+             std::vector<int> & in_cluster,
+             int maxIterations)
+{
+    using namespace std;
+
+    int npoints = points.size();
+    int nbClusters = clusters.size();
+
+    // Hamerly's algorithm ("Making k-means even faster", 2010).  For each
+    // point we keep an upper bound on the distance to its own centroid and
+    // a lower bound on the distance to every other centroid.  As long as
+    // the first is below the second (or below half the distance from its
+    // centroid to the nearest other one), the assignment can't change and
+    // the point is skipped.  The assignments are the same as for Lloyd's
+    // algorithm.
+    vector<double> upper(npoints, INFINITY), lower(npoints, 0.0);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+
+        // Half the distance from each centroid to the closest other one
+        vector<double> halfNearest(nbClusters, INFINITY);
+
+        auto findNearestCentroid = [&] (int j) {
+            for (int j2 = 0;  j2 < nbClusters;  ++j2) {
+                if (j2 == j)
+                    continue;
+                double dist = metric->boundDistance(clusters[j].centroid,
+                                                    clusters[j2].centroid);
+                halfNearest[j] = std::min(halfNearest[j], 0.5 * dist);
+            }
+        };
+
+        MLDB::parallelMap(0, nbClusters, findNearestCentroid);
+
+        std::atomic<int> changes(0);
+
+        // Number of points for which we had to scan all centroids
+        std::atomic<int> numScanned(0);
+
+        auto findNewCluster = [&] (int i) {
+            int current = in_cluster[i];
+
+            if (current != -1) {
+                double bound = std::max(halfNearest[current], lower[i]);
+                if (upper[i] <= bound)
+                    return;
+
+                // Tighten the upper bound and try again
+                upper[i] = metric->boundDistance(points[i],
+                                                 clusters[current].centroid);
+                if (upper[i] <= bound)
+                    return;
+            }
+
+            ++numScanned;
+
+            double best = INFINITY, second = INFINITY;
+            int best_cluster = -1;
+
+            for (int j = 0;  j < nbClusters;  ++j) {
+                double dist = metric->boundDistance(points[i],
+                                                    clusters[j].centroid);
+                if (dist < best) {
+                    second = best;
+                    best = dist;
+                    best_cluster = j;
+                }
+                else if (dist < second) {
+                    second = dist;
+                }
+            }
+
+            // Infinite or nan distances; same as assign()
+            if (best_cluster == -1)
+                best_cluster = 0;
+
+            upper[i] = best;
+            lower[i] = second;
+
+            if (best_cluster != current) {
+                ++changes;
+                in_cluster[i] = best_cluster;
+            }
+        };
+
+        MLDB::parallelMap(0, npoints, findNewCluster);
+
+        for (auto & c : clusters)
+            c.nbMembers = 0;
+        for (int i = 0;  i < npoints;  ++i)
+            ++clusters[in_cluster[i]].nbMembers;
+
+        vector<distribution<float> > oldCentroids;
+        for (auto & c : clusters)
+            oldCentroids.push_back(c.centroid);
+
+        updateCentroids(points, in_cluster);
+
+        cerr << "done clustering iter " << iter
+             << ": " << changes << " changes, " << numScanned
+             << " of " << npoints << " points compared with all centroids"
+             << endl;
+
+        if (changes == 0)
+            break;
+
+        // Loosen the bounds by how far the centroids moved
+        vector<double> moved(nbClusters);
+        int mostMoved = 0;
+        for (int j = 0;  j < nbClusters;  ++j) {
+            moved[j] = metric->boundDistance(oldCentroids[j],
+                                             clusters[j].centroid);
+            if (moved[j] > moved[mostMoved])
+                mostMoved = j;
+        }
+
+        double secondMostMoved = 0.0;
+        for (int j = 0;  j < nbClusters;  ++j)
+            if (j != mostMoved)
+                secondMostMoved = std::max(secondMostMoved, moved[j]);
+
+        auto updateBounds = [&] (int i) {
+            int cluster = in_cluster[i];
+            upper[i] += moved[cluster];
+            lower[i] -= (cluster == mostMoved
+                         ? secondMostMoved : moved[mostMoved]);
+        };
+
+        MLDB::parallelMap(0, npoints, updateBounds);
+    }
+}
+
+void
+KMeans::
+trainMiniBatch(const std::vector<distribution<float>> & points,
+               std::vector<int> & in_cluster,
+               int maxIterations,
+               std::mt19937 & rng)
+{
+    using namespace std;
+
+    if (batchSize < 1)
+        throw MLDB::Exception("kmeans mini-batch size must be positive");
+
+    int npoints = points.size();
+    int nbClusters = clusters.size();
+
+    // Sculley's mini-batch k-means ("Web-scale k-means clustering", 2010).
+    // Each iteration assigns a random sample of points to the current
+    // centroids, and then moves each centroid towards its points with a
+    // learning rate of 1 / (number of points it has seen so far).
+    vector<double> numSeen(nbClusters, 0.0);
+    vector<int> batch(batchSize), batchCluster(batchSize);
+
+    for (int iter = 0;  iter < maxIterations;  ++iter) {
+        for (auto & i : batch)
+            i = rng() % npoints;
+
+        auto assignBatch = [&] (int i) {
+            batchCluster[i] = this->assign(points[batch[i]]);
+        };
+
+        MLDB::parallelMap(0, batchSize, assignBatch);
+
+        for (int i = 0;  i < batchSize;  ++i) {
+            int cluster = batchCluster[i];
+            double rate = 1.0 / (numSeen[cluster] += 1.0);
+            distribution<float> & centroid = clusters[cluster].centroid;
+            centroid *= 1.0 - rate;
+            metric->contributeToAverage(centroid, points[batch[i]], rate);
+        }
+    }
+
+    cerr << "done " << maxIterations << " mini-batch iterations of "
+         << batchSize << " points" << endl;
+
+    // Final assignment of all of the points
+    std::atomic<int> changes(0);
+
+    auto findNewCluster = [&] (int i) {
+        int best_cluster = this->assign(points[i]);
+        if (best_cluster != in_cluster[i]) {
+            ++changes;
+            in_cluster[i] = best_cluster;
+        }
+    };
+
+    MLDB::parallelMap(0, npoints, findNewCluster);
+
+    for (auto & c : clusters)
+        c.nbMembers = 0;
+    for (int i = 0;  i < npoints;  ++i)
+        ++clusters[in_cluster[i]].nbMembers;
+}
+
 distribution<float>
 KMeans::
 centroidDistances(const distribution<float> & point) const
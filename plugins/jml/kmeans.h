@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <mutex>
+#include <random>
 #include "mldb/utils/distribution.h"
 #include "mldb/types/db/persistent.h"
 #include "mldb/vfs/filter_streams.h"
@@ -45,6 +46,15 @@ public:
     virtual void contributeToAverage(distribution<float> & average,
                                      const distribution<float> & point, double weight) const = 0;
 
+    // A distance that obeys the triangle inequality and orders points in
+    // the same way as `distance`.  The accelerated k-means algorithms use
+    // it to rule out centroids without calculating the distance to them.
+    virtual double boundDistance(const distribution<float> & x,
+                                 const distribution<float> & y) const
+    {
+        return distance(x, y);
+    }
+
     // For serialization
     virtual std::string tag() const = 0;
 };
@@ -126,6 +136,14 @@ public:
             average += point/point.two_norm() * weight; 
     }
 
+    // Euclidean distance between the normalized points, with the zero
+    // point treated as being sqrt(6) away from all others.
+    double boundDistance(const distribution<float> & x,
+                         const distribution<float> & y) const
+    {
+        return sqrt(std::max(0.0, 2.0 + 2.0 * distance(x, y)));
+    }
+
     std::string tag() const { return "CosineMetric"; }
 };
 
@@ -134,10 +152,18 @@ public:
 /* KMEANS                                                                    */
 /*****************************************************************************/
 
+enum KMeansAlgorithm {
+    KMEANS_LLOYD,      ///< Compare every point with every centroid each pass
+    KMEANS_HAMERLY,    ///< Lloyd's, skipping centroids ruled out by bounds
+    KMEANS_MINIBATCH   ///< Move the centroids towards small random batches
+};
+
 struct KMeans {
 
     KMeans(KMeansMetric * metric = new KMeansEuclideanMetric())
-        : metric(metric)
+        : metric(metric),
+          algorithm(KMEANS_LLOYD),
+          batchSize(1000)
     {
     }
 
@@ -148,7 +174,17 @@ struct KMeans {
 
     std::vector<Cluster> clusters;
     std::shared_ptr<KMeansMetric> metric;
-    
+
+    /// Algorithm used by train()
+    KMeansAlgorithm algorithm;
+
+    /// Number of points sampled per iteration by KMEANS_MINIBATCH
+    int batchSize;
+
+    /** Train the clusters.  For KMEANS_MINIBATCH, maxIterations is the
+        number of batches, and in_cluster is filled in by a final pass over
+        all of the points.
+    */
     void train(const std::vector<distribution<float> > & points,
                std::vector<int> & in_cluster,
                int nclusters=100,
@@ -160,6 +196,22 @@ struct KMeans {
     // Find the closest cluster to `point` and returns its index
     int assign(const distribution<float> & point) const;
 
+    // Iterations of train() for each algorithm, from initialized centroids
+    void trainLloyd(const std::vector<distribution<float> > & points,
+                    std::vector<int> & in_cluster,
+                    int maxIterations);
+    void trainHamerly(const std::vector<distribution<float> > & points,
+                      std::vector<int> & in_cluster,
+                      int maxIterations);
+    void trainMiniBatch(const std::vector<distribution<float> > & points,
+                        std::vector<int> & in_cluster,
+                        int maxIterations,
+                        std::mt19937 & rng);
+
+    // Set each centroid to the average of its members
+    void updateCentroids(const std::vector<distribution<float> > & points,
+                         const std::vector<int> & in_cluster);
+
     void serialize(MLDB::DB::Store_Writer & store) const;
     void reconstitute(MLDB::DB::Store_Reader & store);
     void save(const std::string & filename) const;
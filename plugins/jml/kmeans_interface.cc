@@ -35,6 +35,26 @@ using namespace std;
 
 namespace MLDB {
 
+DEFINE_ENUM_DESCRIPTION_NAMED(KMeansAlgorithmDescription, ML::KMeansAlgorithm);
+
+KMeansAlgorithmDescription::
+KMeansAlgorithmDescription()
+{
+    addValue("lloyd", ML::KMEANS_LLOYD,
+             "Lloyd's algorithm, which calculates the distance from every "
+             "point to every centroid on each iteration.");
+    addValue("hamerly", ML::KMEANS_HAMERLY,
+             "Hamerly's algorithm, which gives the same clusters as Lloyd's "
+             "but uses the triangle inequality to skip most of the distance "
+             "calculations once the clusters start to settle.  It needs "
+             "two extra numbers of memory per row.");
+    addValue("minibatch", ML::KMEANS_MINIBATCH,
+             "Mini-batch k-means, which moves the centroids towards a "
+             "random sample of `batchSize` rows on each iteration.  It is "
+             "much faster for very large inputs, but the clusters are only "
+             "an approximation of those of Lloyd's algorithm.");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(KmeansConfig);
 
 
@@ -79,6 +99,15 @@ KmeansConfigDescription()
              "Normally this will be Cosine for an orthonormal basis, and "
              "Euclidian for another basis",
              METRIC_COSINE);
+    addField("algorithm", &KmeansConfig::algorithm,
+             "Algorithm used to train the clusters.  The default is Lloyd's "
+             "algorithm; Hamerly's gives the same result faster, and "
+             "mini-batch an approximate result much faster.",
+             ML::KMEANS_LLOYD);
+    addField("batchSize", &KmeansConfig::batchSize,
+             "Number of rows sampled on each iteration of the `minibatch` "
+             "algorithm.  With this algorithm, `maxIterations` is the "
+             "number of batches.", 1000);
     addField("modelFileUrl", &KmeansConfig::modelFileUrl,
              "URL where the model file (with extension '.kms') should be saved. "
              "This file can be loaded by the ![](%%doclink kmeans function). "
@@ -95,8 +124,6 @@ KmeansConfigDescription()
                            validateFunction<KmeansConfig>());
 }
 
-// TODO: see http://www.eecs.tufts.edu/~dsculley/papers/fastkmeans.pdf
-
 namespace {
 
 ML::KMeansMetric * makeMetric(MetricSpace metric)
@@ -190,8 +217,15 @@ run(const ProcedureRunConfig & run,
                                   "Make sure your dataset is not empty and that your WHERE expression "
                                   "does not filter all the rows");
 
+    if (runProcConf.batchSize < 1) {
+        throw AnnotatedException(400, "Kmeans batchSize must be positive",
+                                 "batchSize", runProcConf.batchSize);
+    }
+
     ML::KMeans kmeans;
     kmeans.metric.reset(makeMetric(runProcConf.metric));
+    kmeans.algorithm = runProcConf.algorithm;
+    kmeans.batchSize = runProcConf.batchSize;
 
     vector<int> inCluster;
 
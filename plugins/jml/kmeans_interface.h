@@ -17,6 +17,7 @@
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/types/optional.h"
 #include "builtin/metric_space.h"
+#include "mldb/plugins/jml/kmeans.h"
 
 
 namespace MLDB {
@@ -26,6 +27,8 @@ namespace MLDB {
 /* KMEANS CONFIG                                                             */
 /*****************************************************************************/
 
+DECLARE_ENUM_DESCRIPTION_NAMED(KMeansAlgorithmDescription, ML::KMeansAlgorithm);
+
 struct KmeansConfig : public ProcedureConfig {
     static constexpr const char * name = "kmeans.train";
 
@@ -33,7 +36,9 @@ struct KmeansConfig : public ProcedureConfig {
         : numInputDimensions(-1),
           numClusters(10),
           maxIterations(100),
-          metric(METRIC_COSINE)
+          metric(METRIC_COSINE),
+          algorithm(ML::KMEANS_LLOYD),
+          batchSize(1000)
     {
     }
 
@@ -47,6 +52,8 @@ struct KmeansConfig : public ProcedureConfig {
     int numClusters;
     int maxIterations;
     MetricSpace metric;
+    ML::KMeansAlgorithm algorithm;
+    int batchSize;
 
     Utf8String functionName;
 };
@@ -4,7 +4,8 @@
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Optimized random forest algorithm for dense data and binary classification
+    Optimized random forest algorithm for dense data and classification or
+    regression
 
 */
 
@@ -18,6 +19,7 @@
 #include "mldb/plugins/jml/jml/committee.h"
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
+#include "mldb/utils/compact_vector.h"
 #include "mldb/engine/column_scope.h"
 #include "mldb/engine/bucket.h"
 
@@ -27,12 +29,18 @@ namespace MLDB {
 struct PartitionData {
 
     PartitionData()
-        : fs(nullptr)
+        : fs(nullptr), numLabels(2), regression(false)
     {
     }
 
-    PartitionData(std::shared_ptr<const DatasetFeatureSpace> fs)
-        : fs(fs), features(fs->columnInfo.size())
+    /** Create the data for the given feature space.  For classification,
+        numLabels is the number of labels and the label of each row is its
+        label number; for regression the label is the value to predict.
+    */
+    PartitionData(std::shared_ptr<const DatasetFeatureSpace> fs,
+                  int numLabels = 2, bool regression = false)
+        : fs(fs), numLabels(numLabels), regression(regression),
+          features(fs->columnInfo.size())
     {
         for (auto & c: fs->columnInfo) {
             Feature & f = features.at(c.second.index);
@@ -54,6 +62,8 @@ struct PartitionData {
         PartitionData data;
         data.features = this->features;
         data.fs = this->fs;
+        data.numLabels = this->numLabels;
+        data.regression = this->regression;
         data.reserve(numNonZero);
 
         std::vector<WritableBucketList>
@@ -153,9 +163,12 @@ struct PartitionData {
 
     std::shared_ptr<const DatasetFeatureSpace> fs;
 
+    int numLabels;    ///< Number of labels, for classification
+    bool regression;  ///< If true, labels are values to predict
+
     /// Entry for an individual row
     struct Row {
-        bool label;                 ///< Label associated with
+        float label;                ///< Label number, or value to predict
         float weight;               ///< Weight of the example 
         int exampleNum;             ///< index into feature array
     };
@@ -192,60 +205,152 @@ struct PartitionData {
         rows.push_back(row);
     }
 
-    void addRow(bool label, float weight, int exampleNum)
+    void addRow(float label, float weight, int exampleNum)
     {
         rows.emplace_back(Row{label, weight, exampleNum});
     }
 
-    //This structure hold the weights (false and true) for any particular split
-    template<typename Float>
-    struct WT {
-        WT()
-            : v { 0, 0 }
+    /** Statistics of the labels over a set of examples, which is what
+        splits are scored on and leaves predict from.  For classification
+        it holds the weight of each label; for regression the weight, and
+        the weighted sum and sum of squares of the label.
+
+        The statistics are held inline for up to INLINE_STATS of them, so
+        that the copies made for each candidate split don't go to the heap.
+    */
+    struct W {
+        static constexpr size_t INLINE_STATS = 8;
+
+        W()
         {
         }
 
-        Float v[2];
+        explicit W(int numStats)
+            : v(numStats)
+        {
+        }
+
+        compact_vector<double, INLINE_STATS, uint32_t, false> v;
 
-        Float & operator [] (bool i)
+        double * data()
         {
-            return v[i];
+            return &v[0];
+        }
+
+        const double * data() const
+        {
+            return &v[0];
         }
 
-        const Float & operator [] (bool i) const
+        double & operator [] (int i)
         {
             return v[i];
         }
 
-        bool empty() const { return total() == 0; }
+        const double & operator [] (int i) const
+        {
+            return v[i];
+        }
 
-        Float total() const { return v[0] + v[1]; }
+        /// Add the statistics stored at the given address
+        W & operator += (const double * other)
+        {
+            for (size_t i = 0;  i < v.size();  ++i)
+                v[i] += other[i];
+            return *this;
+        }
 
-        WT & operator += (const WT & other)
+        W & operator -= (const double * other)
         {
-            v[0] += other.v[0];
-            v[1] += other.v[1];
+            for (size_t i = 0;  i < v.size();  ++i)
+                v[i] -= other[i];
             return *this;
         }
 
-        WT operator + (const WT & other) const
+        W & operator += (const W & other)
         {
-            WT result = *this;
-            result += other;
-            return result;
+            return *this += other.data();
         }
 
-        WT & operator -= (const WT & other)
+        W & operator -= (const W & other)
         {
-            v[0] -= other.v[0];
-            v[1] -= other.v[1];
-            return *this;
+            return *this -= other.data();
         }
 
-        typedef Float FloatType;
+        W operator + (const W & other) const
+        {
+            W result = *this;
+            result += other;
+            return result;
+        }
     };
 
-    typedef WT<ML::FixedPointAccum64> W;
+    /// Number of statistics kept in a W
+    int numStats() const
+    {
+        return regression ? 3 : numLabels;
+    }
+
+    /// Accumulate the given row into the statistics at stats
+    void addStats(double * stats, const Row & row) const
+    {
+        if (regression) {
+            stats[0] += row.weight;
+            stats[1] += row.weight * row.label;
+            stats[2] += row.weight * row.label * row.label;
+        }
+        else {
+            stats[(int)row.label] += row.weight;
+        }
+    }
+
+    /// Total weight of the examples in the given statistics
+    double totalWeight(const double * stats) const
+    {
+        if (regression)
+            return stats[0];
+        double result = 0;
+        for (int i = 0;  i < numLabels;  ++i)
+            result += stats[i];
+        return result;
+    }
+
+    double totalWeight(const W & w) const
+    {
+        return totalWeight(w.data());
+    }
+
+    /** Impurity of a set of examples; a split minimizes the sum over its
+        sides.  For classification this is sum over the labels of
+        sqrt(w[label] * w[other labels]), which for two labels is the Z
+        score of boosting; for regression, it's the weighted sum of the
+        squared errors from the mean.
+    */
+    double impurity(const W & w) const
+    {
+        if (regression) {
+            if (w[0] <= 0)
+                return 0;
+            return std::max(0.0, w[2] - w[1] * w[1] / w[0]);
+        }
+
+        double total = totalWeight(w);
+        double result = 0;
+        for (int i = 0;  i < numLabels;  ++i)
+            result += sqrt(std::max(0.0, w[i] * (total - w[i])));
+        return result;
+    }
+
+    /// Is there nothing to be gained by splitting the given examples?
+    bool isPure(const W & w) const
+    {
+        if (regression)
+            return impurity(w) <= 1e-12 * w[2];
+        int labelsWithWeight = 0;
+        for (int i = 0;  i < numLabels;  ++i)
+            labelsWithWeight += w[i] != 0;
+        return labelsWithWeight <= 1;
+    }
 
     /** Split the partition here. */
     std::pair<PartitionData, PartitionData>
@@ -260,8 +365,9 @@ struct PartitionData {
         PartitionData & left = sides[0];
         PartitionData & right = sides[1];
 
-        left.fs = fs;
-        right.fs = fs;
+        left.fs = right.fs = fs;
+        left.numLabels = right.numLabels = numLabels;
+        left.regression = right.regression = regression;
         left.features = features;
         right.features = features;
 
@@ -374,10 +480,11 @@ struct PartitionData {
         bool debug = false;
 
         int nf = features.size();
+        int ns = numStats();
 
-        // For each feature, for each bucket, for each label
-        // weight for each bucket and last valid bucket
-        std::vector< std::vector<W> > w(nf);
+        // For each feature, for each bucket, the statistics (ns values)
+        // of the examples in the bucket, laid out contiguously
+        std::vector< std::vector<double> > w(nf);
         std::vector< int > maxSplits(nf);
 
         size_t totalNumBuckets = 0;
@@ -387,7 +494,7 @@ struct PartitionData {
             if (!features[i].active)
                 continue;
             ++activeFeatures;
-            w[i].resize(features[i].buckets.numBuckets);
+            w[i].resize(features[i].buckets.numBuckets * ns);
             totalNumBuckets += features[i].buckets.numBuckets;
         }
 
@@ -397,7 +504,7 @@ struct PartitionData {
                  << std::endl;
         }
 
-        W wAll;
+        W wAll(ns);
 
         auto doFeature = [&] (int i)
             {
@@ -405,7 +512,7 @@ struct PartitionData {
 
                 if (i == nf) {
                     for (auto & r: rows) {
-                        wAll[r.label] += r.weight;
+                        addStats(wAll.data(), r);
                     }
                     return;
                 }
@@ -415,6 +522,8 @@ struct PartitionData {
                 bool twoBuckets = false;
                 int lastBucket = -1;
 
+                double * wi = w[i].data();
+
                 for (size_t j = 0;  j < rows.size();  ++j) {
                     auto & r = rows[j];
                     int bucket = features[i].buckets[r.exampleNum];
@@ -423,7 +532,7 @@ struct PartitionData {
                         || (lastBucket != -1 && bucket != lastBucket);
                     lastBucket = bucket;
 
-                    w[i][bucket][r.label] += r.weight;
+                    addStats(wi + bucket * ns, r);
                     maxBucket = std::max(maxBucket, bucket);
                 }
 
@@ -444,56 +553,46 @@ struct PartitionData {
         }
 
         // We have no impurity in our bucket.  Time to stop
-        if (wAll[0] == 0 || wAll[1] == 0)
-            return std::make_tuple(1.0, -1, -1, wAll, W(), wAll);
+        if (isPure(wAll))
+            return std::make_tuple(1.0, -1, -1, wAll, W(ns), wAll);
 
         double bestScore = INFINITY;
         int bestFeature = -1;
         int bestSplit = -1;
         
-        W bestLeft;
-        W bestRight;
+        W bestLeft(ns);
+        W bestRight(ns);
 
-        int bucketsEmpty = 0;
-        int bucketsOne = 0;
-        int bucketsBoth = 0;
+        auto score = [&] (const W & wFalse, const W & wTrue) -> double
+            {
+                return impurity(wFalse) + impurity(wTrue);
+            };
 
         // Score each feature
         for (unsigned i = 0;  i < nf;  ++i) {
             if (!features[i].active)
                 continue;
 
-            W wAll; // TODO: do we need this?
-            for (auto & wt: w[i]) {
-                wAll += wt;
-                bucketsEmpty += wt[0] == 0 && wt[1] == 0;
-                bucketsBoth += wt[0] != 0 && wt[1] != 0;
-                bucketsOne += (wt[0] == 0) ^ (wt[1] == 0);
-            }
+            const double * wi = w[i].data();
+            int maxBucket = maxSplits[i];
 
-            auto score = [] (const W & wFalse, const W & wTrue) -> double
+            auto bucketEmpty = [&] (int j)
                 {
-                    double score
-                    = 2.0 * (  sqrt(wFalse[0] * wFalse[1])
-                             + sqrt(wTrue[0] * wTrue[1]));
-                    return score;
+                    return totalWeight(wi + j * ns) == 0;
                 };
-            
+
             if (debug) {
                 std::cerr << "feature " << i << " " << features[i].info->columnName
                      << std::endl;
-                std::cerr << "    all: " << wAll[0] << " " << wAll[1] << std::endl;
             }
 
-            int maxBucket = maxSplits[i];
-
             if (features[i].ordinal) {
                 // Calculate best split point for ordered values
-                W wFalse = wAll, wTrue;
+                W wFalse = wAll, wTrue(ns);
 
                 // Now test split points one by one
                 for (unsigned j = 0;  j < maxBucket;  ++j) {
-                    if (w[i][j].empty())
+                    if (bucketEmpty(j))
                         continue;                   
 
                     double s = score(wFalse, wTrue);
@@ -502,8 +601,6 @@ struct PartitionData {
                         std::cerr << "  ord split " << j << " "
                              << features[i].info->bucketDescriptions.getValue(j)
                              << " had score " << s << std::endl;
-                        std::cerr << "    false: " << wFalse[0] << " " << wFalse[1] << std::endl;
-                        std::cerr << "    true:  " << wTrue[0] << " " << wTrue[1] << std::endl;
                     }
 
                     if (s < bestScore) {
@@ -514,8 +611,8 @@ struct PartitionData {
                         bestLeft = wTrue;
                     }
 
-                   wFalse -= w[i][j];
-                   wTrue += w[i][j];
+                   wFalse -= wi + j * ns;
+                   wTrue += wi + j * ns;
 
                 }
             }
@@ -523,22 +620,23 @@ struct PartitionData {
                 // Calculate best split point for non-ordered values
                 // Now test split points one by one
 
+                W wTrue(ns);
+
                 for (unsigned j = 0;  j <= maxBucket;  ++j) {
 
-                    if (w[i][j].empty())
+                    if (bucketEmpty(j))
                         continue;
 
+                    std::copy(wi + j * ns, wi + (j + 1) * ns, wTrue.v.begin());
                     W wFalse = wAll;
-                    wFalse -= w[i][j];                    
+                    wFalse -= wTrue;
 
-                    double s = score(wFalse, w[i][j]);
+                    double s = score(wFalse, wTrue);
 
                     if (debug) {
                         std::cerr << "  non ord split " << j << " "
                              << features[i].info->bucketDescriptions.getValue(j)
                              << " had score " << s << std::endl;
-                        std::cerr << "    false: " << wFalse[0] << " " << wFalse[1] << std::endl;
-                        std::cerr << "    true:  " << w[i][j][0] << " " << w[i][j][1] << std::endl;
                     }
              
                     if (s < bestScore) {
@@ -546,7 +644,7 @@ struct PartitionData {
                         bestFeature = i;
                         bestSplit = j;
                         bestRight = wFalse;
-                        bestLeft = w[i][j];
+                        bestLeft = wTrue;
                     }
                 }
 
@@ -554,8 +652,6 @@ struct PartitionData {
         }
         
         if (debug) {
-            std::cerr << "buckets: empty " << bucketsEmpty << " one " << bucketsOne
-                 << " both " << bucketsBoth << std::endl;
             std::cerr << "bestScore " << bestScore << std::endl;
             std::cerr << "bestFeature " << bestFeature << " "
                  << features[bestFeature].info->columnName << std::endl;
@@ -567,14 +663,42 @@ struct PartitionData {
         return std::make_tuple(bestScore, bestFeature, bestSplit, bestLeft, bestRight, wAll);
     }
 
-    static void fillinBase(ML::Tree::Base * node, const W & wAll)
+    /** Return the split that sends the examples on the left side of a
+        split of the given feature at the given bucket (the buckets up to
+        and including splitValue for an ordinal feature, or the bucket
+        equal to splitValue for a categorical one) to child_true.
+    */
+    ML::Split makeSplit(int featureToSplitOn, int splitValue) const
     {
+        const Feature & f = features.at(featureToSplitOn);
+        ML::Feature feature = fs->getFeature(f.info->columnName);
+        float splitVal = 0;
+        if (f.ordinal) {
+            auto splitCell = f.info->bucketDescriptions.getSplit(splitValue);
+            if (splitCell.isNumeric())
+                splitVal = splitCell.toDouble();
+            else splitVal = splitValue;
+        }
+        else {
+            splitVal = splitValue;
+        }
+
+        return ML::Split(feature, splitVal,
+                         f.ordinal ? ML::Split::LESS : ML::Split::EQUAL);
+    }
 
-        float total = float(wAll[0]) + float(wAll[1]);
+    void fillinBase(ML::Tree::Base * node, const W & wAll) const
+    {
+        float total = totalWeight(wAll);
         node->examples = total;
-        node->pred = {
-             float(wAll[0]) / total,
-             float(wAll[1]) / total };
+        if (regression) {
+            node->pred = { float(wAll[1] / wAll[0]) };
+        }
+        else {
+            node->pred.resize(numLabels);
+            for (int i = 0;  i < numLabels;  ++i)
+                node->pred[i] = float(wAll[i]) / total;
+        }
     }
 
     ML::Tree::Ptr getLeaf(ML::Tree & tree, const W& w)
@@ -586,12 +710,11 @@ struct PartitionData {
 
     ML::Tree::Ptr getLeaf(ML::Tree & tree)
     {
-        W wAll;
+        W wAll(numStats());
         for (auto & r: rows) {
-            int label = r.label;
-            ExcAssert(label >= 0 && label < 2);
+            ExcAssert(regression || (r.label >= 0 && r.label < numLabels));
             ExcAssert(r.weight > 0);
-            wAll[r.label] += r.weight;
+            addStats(wAll.data(), r);
         }
         
        return getLeaf(tree, wAll);
@@ -625,6 +748,9 @@ struct PartitionData {
             return leaf;
         }
 
+        // Make the split first, since split() clears our features
+        ML::Split nodeSplit = makeSplit(bestFeature, bestSplit);
+
         std::pair<PartitionData, PartitionData> splits
             = split(bestFeature, bestSplit, wLeft, wRight, wAll);
 
@@ -659,29 +785,10 @@ struct PartitionData {
 
         if (left && right) {
             ML::Tree::Node * node = tree.new_node();
-            ML::Feature feature = fs->getFeature(features[bestFeature].info->columnName);
-            float splitVal = 0;
-            if (features[bestFeature].ordinal) {
-                auto splitCell = features[bestFeature].info->bucketDescriptions
-                    .getSplit(bestSplit);
-                if (splitCell.isNumeric())
-                    splitVal = splitCell.toDouble();
-                else splitVal = bestSplit;
-            }
-            else {
-                splitVal = bestSplit;
-            }
-
-            ML::Split split(feature, splitVal,
-                            features[bestFeature].ordinal
-                            ? ML::Split::LESS : ML::Split::EQUAL);
-            
-            node->split = split;
+            node->split = nodeSplit;
             node->child_true = left;
             node->child_false = right;
-            W wMissing;
-            wMissing[0] = 0.0f;
-            wMissing[1] = 0.0f;
+            W wMissing(numStats());
             node->child_missing = getLeaf(tree, wMissing);
             node->z = bestScore;            
             fillinBase(node, wLeft + wRight);
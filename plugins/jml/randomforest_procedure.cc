@@ -4,7 +4,7 @@
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Procedure to train a random forest binary classifier.
+    Procedure to train a random forest classifier or regressor.
 */
 
 #include "randomforest_procedure.h"
@@ -16,6 +16,7 @@
 #include "mldb/plugins/jml/value_descriptions.h"
 #include "mldb/builtin/sql_expression_extractors.h"
 #include "mldb/plugins/jml/classifier.h"
+#include "mldb/plugins/jml/dataset_feature_space.h"
 #include "mldb/rest/in_process_rest_connection.h"
 #include "mldb/engine/bound_queries.h"
 #include "mldb/core/mldb_engine.h"
@@ -44,7 +45,8 @@ RandomForestProcedureConfigDescription()
              "Specification of the data for input to the classifier procedure. "
              "The select expression must contain these two sub-expressions: one row expression "
              "to identify the features on which to train and one scalar expression "
-             "to identify the label.  The type of the label expression must be a boolean (0 or 1)"
+             "to identify the label.  The type of the label expression must be a boolean (0 or 1) "
+             "in boolean mode, a category in categorical mode or a number in regression mode. "
              "Labels with a null value will have their row skipped. "
              "The select statement does not support groupby and having clauses. "
              "Also, unlike most select expressions, this one can only select whole columns, "
@@ -54,6 +56,9 @@ RandomForestProcedureConfigDescription()
     addField("modelFileUrl", &RandomForestProcedureConfig::modelFileUrl,
              "URL where the model file (with extension '.cls') should be saved. "
              "This file can be loaded by the ![](%%doclink classifier function). ");
+    addField("mode", &RandomForestProcedureConfig::mode,
+             "Model mode: `boolean`, `categorical` or `regression`.  "
+             "`multilabel` is not supported.", CM_BOOLEAN);
     addField("featureVectorSamplings", &RandomForestProcedureConfig::featureVectorSamplings,
              "Number of samplings of feature vectors. "
              "The total number of bags will be featureVectorSamplings*featureSamplings.", 5);
@@ -132,6 +137,16 @@ run(const ProcedureRunConfig & run,
 
     Timer timer;
 
+    switch (runProcConf.mode) {
+    case CM_REGRESSION:
+    case CM_BOOLEAN:
+    case CM_CATEGORICAL:
+        break;
+    default:
+        throw AnnotatedException(400, "randomforest.binary.train only supports "
+                                 "the boolean, categorical and regression modes");
+    }
+
     // this includes being empty
     if(!runProcConf.modelFileUrl.valid()) {
          throw MLDB::Exception("modelFileUrl is not valid");
@@ -146,9 +161,6 @@ run(const ProcedureRunConfig & run,
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.trainingData.stm->from->bind(context, convertProgressToJson);
 
-    ML::Mutable_Feature_Info labelInfo = ML::Mutable_Feature_Info(ML::BOOLEAN);
-    labelInfo.set_biased(true);
-
     auto extractWithinExpression = [](std::shared_ptr<SqlExpression> expr)
         -> std::shared_ptr<SqlRowExpression>
         {
@@ -185,23 +197,12 @@ run(const ProcedureRunConfig & run,
 
     Timer labelsTimer;
 
-    std::vector<std::vector<CellValue> > labelsWhereWeight
-        = colScope.run({boundLabel, boundWhere, boundWeight});
-
-    const std::vector<CellValue> & labels = labelsWhereWeight[0];
-    const std::vector<CellValue> & wheres = labelsWhereWeight[1];
-    const std::vector<CellValue> & weights = labelsWhereWeight[2];
+    TrainingLabels trainingLabels
+        (colScope.run({boundLabel, boundWhere, boundWeight}),
+         runProcConf.mode);
 
-    INFO_MSG(logger) << "got " << labels.size() << " labels in " << labelsTimer.elapsed();
-
-    size_t numRowsKept = 0;
-    for (size_t i = 0;  i < labels.size();  ++i) {
-        if (!weights[i].empty()
-            && weights[i].toDouble() > 0.0
-            && !labels[i].empty()
-            && wheres[i].isTrue())
-            ++numRowsKept;
-    }
+    INFO_MSG(logger) << "got " << trainingLabels.labels.size()
+                     << " labels in " << labelsTimer.elapsed();
 
     SelectExpression select({subSelect});
 
@@ -226,7 +227,8 @@ run(const ProcedureRunConfig & run,
         = getColumnsInExpression(select);
 
     auto featureSpace = std::make_shared<DatasetFeatureSpace>
-        (boundDataset.dataset, labelInfo, knownInputColumns, true /* bucketize */);
+        (boundDataset.dataset, trainingLabels.labelInfo, knownInputColumns,
+         true /* bucketize */);
 
     INFO_MSG(logger) << "feature space construction took " << timer.elapsed();
     timer.restart();
@@ -251,17 +253,22 @@ run(const ProcedureRunConfig & run,
     int numFeatures = knownInputColumns.size();
     INFO_MSG(logger) << "NUM FEATURES : " << numFeatures;
 
-    PartitionData allData(featureSpace);
+    PartitionData allData(featureSpace, trainingLabels.numLabels,
+                          runProcConf.mode == CM_REGRESSION);
 
-    allData.reserve(numRowsKept);
+    // The feature buckets are indexed by the row number in the dataset,
+    // which is thus the example number of each row.
+    allData.reserve(trainingLabels.numRowsKept);
     size_t numRows = 0;
-    for (size_t i = 0;  i < labels.size();  ++i) {
-        if (!wheres[i].isTrue() || labels[i].empty()
-            || weights[i].empty() || weights[i].toDouble() == 0)
+    for (size_t i = 0;  i < trainingLabels.labels.size();  ++i) {
+        if (!trainingLabels.keepRow(i))
             continue;
-        allData.addRow(labels[i].isTrue(), weights[i].toDouble(), numRows++);
+
+        allData.addRow(trainingLabels.getLabel(i),
+                       trainingLabels.getWeight(i), i);
+        ++numRows;
     }
-    ExcAssertEqual(numRows, numRowsKept);
+    ExcAssertEqual(numRows, trainingLabels.numRowsKept);
 
     const float trainprop = 1.0f;
     int totalResultCount = runProcConf.featureVectorSamplings*runProcConf.featureSamplings;
@@ -408,7 +415,7 @@ run(const ProcedureRunConfig & run,
 namespace{
 	static RegisterProcedureType<RandomForestProcedure, RandomForestProcedureConfig>
 	regPrototypeClassifier(builtinPackage(),
-	              "Train a supervised binary random forest",
+	              "Train a supervised random forest",
 	              "procedures/RandomForest.md.html");
 
 }
@@ -4,7 +4,7 @@
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Procedure to train a random forest binary classifier.
+    Procedure to train a random forest classifier or regressor.
 */
 
 #pragma once
@@ -15,6 +15,7 @@
 #include "mldb/builtin/matrix.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/plugins/jml/jml/feature_info.h"
+#include "mldb/plugins/jml/classifier.h"
 
 
 namespace MLDB {
@@ -38,6 +39,9 @@ struct RandomForestProcedureConfig : public ProcedureConfig {
     /// Where to save the classifier to
     Url modelFileUrl;
 
+    /// What mode to run in
+    ClassifierMode mode = CM_BOOLEAN;
+
     /// Number of samplings of feature vectors
     int featureVectorSamplings;
 
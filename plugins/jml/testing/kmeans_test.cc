@@ -15,6 +15,7 @@
 #include "mldb/utils/testing/fixtures.h"
 #include <iostream>
 #include <stdlib.h>
+#include <random>
 
 using namespace MLDB;
 using namespace ML;
@@ -103,3 +104,101 @@ BOOST_FIXTURE_TEST_CASE( test_kmeans, kmeans_test )
     test();
 
 }
+
+namespace {
+
+// Points scattered around nbCentres random centres
+vector<distribution<float> >
+makeBlobs(int nbCentres, int nbPerCentre, int dims, int seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gaussian;
+
+    vector<distribution<float> > result;
+    for (int c = 0;  c < nbCentres;  ++c) {
+        distribution<float> centre(dims);
+        for (auto & x: centre)
+            x = 10 * gaussian(rng);
+        for (int i = 0;  i < nbPerCentre;  ++i) {
+            distribution<float> point = centre;
+            for (auto & x: point)
+                x += gaussian(rng);
+            result.push_back(point);
+        }
+    }
+    return result;
+}
+
+// Sum of the squared distances from each point to its centroid
+double inertia(const KMeans & kmeans,
+               const vector<distribution<float> > & points,
+               const vector<int> & in_cluster)
+{
+    double result = 0.0;
+    for (unsigned i = 0;  i < points.size();  ++i) {
+        double d = kmeans.metric->distance(points[i],
+                                           kmeans.clusters[in_cluster[i]].centroid);
+        result += d * d;
+    }
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_kmeans_hamerly_same_as_lloyd )
+{
+    auto points = makeBlobs(20, 200, 8, 1);
+
+    for (bool cosine: { false, true }) {
+        KMeans lloyd(cosine ? (KMeansMetric *)new KMeansCosineMetric()
+                     : new KMeansEuclideanMetric());
+        KMeans hamerly(cosine ? (KMeansMetric *)new KMeansCosineMetric()
+                       : new KMeansEuclideanMetric());
+        hamerly.algorithm = KMEANS_HAMERLY;
+
+        vector<int> lloydClusters, hamerlyClusters;
+        lloyd.train(points, lloydClusters, 25, 100);
+        hamerly.train(points, hamerlyClusters, 25, 100);
+
+        BOOST_CHECK(lloydClusters == hamerlyClusters);
+
+        for (unsigned i = 0;  i < lloyd.clusters.size();  ++i) {
+            BOOST_CHECK_EQUAL(lloyd.clusters[i].nbMembers,
+                              hamerly.clusters[i].nbMembers);
+            auto diff = lloyd.clusters[i].centroid
+                - hamerly.clusters[i].centroid;
+            BOOST_CHECK_LT(diff.two_norm(), 1e-3);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_kmeans_minibatch )
+{
+    auto points = makeBlobs(20, 500, 8, 2);
+
+    KMeans lloyd;
+    vector<int> lloydClusters;
+    lloyd.train(points, lloydClusters, 20, 100);
+
+    KMeans minibatch;
+    minibatch.algorithm = KMEANS_MINIBATCH;
+    minibatch.batchSize = 500;
+    vector<int> minibatchClusters;
+    minibatch.train(points, minibatchClusters, 20, 50);
+
+    BOOST_REQUIRE_EQUAL(minibatchClusters.size(), points.size());
+
+    int total = 0;
+    for (auto & c: minibatch.clusters)
+        total += c.nbMembers;
+    BOOST_CHECK_EQUAL(total, points.size());
+
+    // Mini-batch is approximate, but should be close to the full version
+    double lloydInertia = inertia(lloyd, points, lloydClusters);
+    double minibatchInertia = inertia(minibatch, points, minibatchClusters);
+
+    cerr << "inertia: lloyd " << lloydInertia << " minibatch "
+         << minibatchInertia << endl;
+
+    BOOST_CHECK_LT(minibatchInertia, 1.1 * lloydInertia);
+}
@@ -324,18 +324,79 @@ getStatus() const
     return Any();
 }
 
+namespace {
+
+// the different possible TF scores
+double calcTf(TFType type, double frequency, uint64_t maxFrequency)
+{
+    switch (type) {
+    case TF_log:
+        return std::log(1.0f + frequency);
+    case TF_augmented:
+        return 0.5f + (0.5f * frequency) / maxFrequency;
+    default:
+        return frequency;
+    }
+}
+
+// the different possible IDF scores
+double calcIdf(IDFType type, double numberOfRelevantDoc,
+               uint64_t corpusSize, uint64_t maxNt)
+{
+    switch (type) {
+    case IDF_inverse:
+        return std::log(corpusSize / (1 + numberOfRelevantDoc));
+    case IDF_inverseSmooth:
+        return std::log(1 + (corpusSize / (1 + numberOfRelevantDoc)));
+    case IDF_inverseMax:
+        return std::log(1 + (maxNt) / (1 + numberOfRelevantDoc));
+    case IDF_probabilistic_inverse:
+        return std::log((corpusSize - numberOfRelevantDoc)
+                        / (1 + numberOfRelevantDoc));
+    default:
+        return 1.0f;
+    }
+}
+
+} // file scope
+
 ExpressionValue
 TfidfFunction::
 apply(const FunctionApplier & applier,
       const ExpressionValue & context) const
 {
-    ExpressionValue result;
+    std::vector<uint64_t> docFrequencies;
+    return applyRow(context, docFrequencies);
+}
+
+std::vector<ExpressionValue>
+TfidfFunction::
+applyBatch(const FunctionApplier & applier,
+           const std::vector<ExpressionValue> & inputs) const
+{
+    // The document frequency buffer is shared by all rows of the batch
+    std::vector<uint64_t> docFrequencies;
+    std::vector<ExpressionValue> result;
+    result.reserve(inputs.size());
+    for (auto & input: inputs)
+        result.emplace_back(applyRow(input, docFrequencies));
+    return result;
+}
 
+ExpressionValue
+TfidfFunction::
+applyRow(const ExpressionValue & context,
+         std::vector<uint64_t> & docFrequencies) const
+{
     ExpressionValue inputVal = context.getColumn(PathElement("input"));
     
     uint64_t maxFrequency = 0; // max term frequency for the current document
     uint64_t maxNt = 0;        // max document frequency for terms in the current doc
 
+    // Look up the document frequency of each term once; it's needed both
+    // here for maxNt and below for the idf
+    docFrequencies.clear();
+
     auto onColumn = [&] (const PathElement & name,
                          const ExpressionValue & val)
         {
@@ -343,95 +404,35 @@ apply(const FunctionApplier & applier,
             uint64_t value = val.getAtom().toUInt();
             maxFrequency = std::max(value, maxFrequency);
             const auto termFrequency = dfs.find(term);
-            if (termFrequency != dfs.end())
-                maxNt = std::max(maxNt, termFrequency->second); 
+            uint64_t docFrequency
+                = termFrequency != dfs.end() ? termFrequency->second : 0;
+            maxNt = std::max(maxNt, docFrequency);
+            docFrequencies.push_back(docFrequency);
             return true;
         };
 
     inputVal.forEachColumn(onColumn);
 
-    // the different possible TF scores
-    auto tf_raw = [=] (double frequency) {
-        return frequency;
-    };
-    auto tf_log = [=] (double frequency) {
-        return (std::log(1.0f + frequency));
-    };
-    auto tf_augmented = [=] (double frequency) {
-        return 0.5f + (0.5f * frequency) / maxFrequency;
-    };
-
-    std::function<double(double)> tf_fct = tf_raw;
-
-    switch (functionConfig.tf_type)
-    {
-        case TF_log:
-            tf_fct = tf_log;
-        break;
-        case TF_augmented:
-            tf_fct = tf_augmented;
-        break;
-        default:
-        break;
-    }
-
-    // the different possible IDF scores
-    auto idf_unary = [=] (double numberOfRelevantDoc) {
-        return 1.0f;
-    };
-
-    auto idf_inverse = [=] (double numberOfRelevantDoc) {
-        return std::log(corpusSize / (1 + numberOfRelevantDoc));
-    };
-    auto idf_inverseSmooth = [=] (double numberOfRelevantDoc) {
-        return std::log(1 + (corpusSize / (1 + numberOfRelevantDoc)));
-    };
-    auto idf_inverseMax = [=] (double numberOfRelevantDoc) {
-        return std::log(1 + (maxNt) / (1 + numberOfRelevantDoc));
-    };
-    auto idf_probabilistic_inverse = [=] (double numberOfRelevantDoc) {
-        return std::log((corpusSize - numberOfRelevantDoc) / (1 + numberOfRelevantDoc));
-    };
-
-    std::function<double(double)> idf_fct = idf_unary;
-
-    switch (functionConfig.idf_type)
-    {
-        case IDF_inverse:
-            idf_fct = idf_inverse;
-        break;
-        case IDF_inverseSmooth:
-            idf_fct = idf_inverseSmooth;
-        break;
-        case IDF_inverseMax:
-            idf_fct = idf_inverseMax;
-        break;
-        case IDF_probabilistic_inverse:
-            idf_fct = idf_probabilistic_inverse;
-        break;
-        default:
-        break;
-    }
-
     RowValue values;
+    values.reserve(docFrequencies.size());
     Date ts = inputVal.getEffectiveTimestamp();
 
     // Compute the score for every word in the input
     DEBUG_MSG(logger) << "corpus size: " << corpusSize;
 
+    size_t termNum = 0;
     auto onColumn2 = [&] (const PathElement & name,
                           const ExpressionValue & val)
         {
-            Utf8String term = name.toUtf8String();
             double frequency = val.getAtom().toDouble();
 
-            double tf = tf_fct(frequency);
-            const auto docFrequency = dfs.find(term);
-            uint64_t docFrequencyInt = docFrequency != dfs.end() ? docFrequency->second : 0;
-            double idf = idf_fct(docFrequencyInt);
+            double tf = calcTf(functionConfig.tf_type, frequency, maxFrequency);
+            uint64_t docFrequencyInt = docFrequencies[termNum++];
+            double idf = calcIdf(functionConfig.idf_type, docFrequencyInt,
+                                 corpusSize, maxNt);
 
             DEBUG_MSG(logger)
-                << "term: '" << term << "', df: "
+                << "term: '" << name << "', df: "
                 << docFrequencyInt << ", tf: " << tf << ", idf: " << idf;
 
             values.emplace_back(name, tf*idf, ts);
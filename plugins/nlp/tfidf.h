@@ -96,6 +96,14 @@ struct TfidfFunction: public Function {
     
     virtual ExpressionValue apply(const FunctionApplier & applier,
                               const ExpressionValue & context) const;
+
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const;
+
+    /** Apply to a single row, using docFrequencies as scratch space. */
+    ExpressionValue applyRow(const ExpressionValue & context,
+                             std::vector<uint64_t> & docFrequencies) const;
     
     /** Describe what the input and output is for this function. */
     virtual FunctionInfo getFunctionInfo() const;
@@ -10,6 +10,7 @@
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/types/compact_vector_description.h"
 #include "mldb/types/map_description.h"
+#include "mldb/types/vector_description.h"
 #include "sparse_matrix.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/annotated_exception.h"
@@ -20,6 +21,7 @@
 #include "mldb/utils/atomic_shared_ptr.h"
 #include "mldb/base/parallel_merge_sort.h"
 #include "mldb/engine/dataset_utils.h"
+#include "mldb/core/secondary_index.h"
 #include "mldb/utils/log.h"
 #include <mutex>
 
@@ -196,6 +198,9 @@ struct SparseMatrixDataset::Itl
     /// Default transaction when none was passed
     atomic_shared_ptr<ReadTransaction> defaultTransaction;
 
+    /// Indexes of the columns that were configured to be indexed
+    SecondaryIndexCache secondaryIndexes;
+
     /// Control the quantization of timestamp (default is quantize to second)
     double timeQuantumSeconds;
 
@@ -277,6 +282,9 @@ struct SparseMatrixDataset::Itl
         result->epoch = epoch;
 
         setDefaultTransaction(std::move(result));
+
+        // Now that the new data is visible, the indexes need rebuilding
+        secondaryIndexes.invalidate();
     }
 
     void optimize()
@@ -305,6 +313,9 @@ struct SparseMatrixDataset::Itl
         result->epoch = epoch;
 
         setDefaultTransaction(std::move(result));
+
+        // Now that the new data is visible, the indexes need rebuilding
+        secondaryIndexes.invalidate();
     }
 
     Date decodeTs(int64_t ts) const
@@ -797,6 +808,12 @@ struct SparseMatrixDataset::Itl
         auto trans = getReadTransaction();
         return getColumnTrans(column, *trans);
     }
+
+    virtual std::vector<std::shared_ptr<const ColumnSecondaryIndex> >
+    getColumnSecondaryIndexes(const std::vector<ColumnPath> & columns) const override
+    {
+        return secondaryIndexes.get(*this, columns);
+    }
     
     static void
     recordRowTrans(const RowPath & rowName,
@@ -1767,6 +1784,13 @@ MutableSparseMatrixDatasetConfigDescription()
              "Whether to favor reads or writes.  Only has effect for when "
              "`consistencyLevel` is set to `consistentAfterWrite`.",
              TF_FAVOR_READS);
+    addField("indexedColumns", &MutableSparseMatrixDatasetConfig::indexedColumns,
+             "Columns to keep a secondary index of their values for.  "
+             "WHERE clauses that only compare indexed columns with "
+             "constants, combined with AND and OR, are answered from "
+             "the indexes without scanning the dataset.  The indexes "
+             "are built the first time they are needed after each "
+             "write.");
 }
 
 /*****************************************************************************/
@@ -1894,6 +1918,7 @@ MutableSparseMatrixDataset(MldbEngine * owner,
     auto params = config.params.convert<MutableSparseMatrixDatasetConfig>();
     itl.reset(new Itl(owner, params.timeQuantumSeconds,
                       params.consistencyLevel, params.favor));
+    itl->secondaryIndexes.setIndexedColumns(params.indexedColumns);
 }
 
 Dataset::MultiChunkRecorder
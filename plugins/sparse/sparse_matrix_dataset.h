@@ -105,6 +105,9 @@ struct MutableSparseMatrixDatasetConfig
 
     /// Transaction favor.  When reads and writes are mixed, which do we favor?
     TransactionFavor favor;
+
+    /// Columns that have a secondary index of their values
+    std::vector<ColumnPath> indexedColumns;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(MutableSparseMatrixDatasetConfig);
@@ -18,6 +18,7 @@
 #include "mldb/arch/endian.h"
 #include "mldb/vfs/filter_streams.h"
 #include "frozen_tables.h"
+#include "mldb/core/dataset.h"
 #include <mutex>
 #include <string.h>
 #include <fcntl.h>
@@ -73,6 +74,12 @@ struct DirectFrozenColumn
         values = mutableValues.freeze(serializer);
     }
 
+    DirectFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<DirectFrozenColumnMetadata>(reconstituter, *this);
+        values.reconstitute(*reconstituter.getStructure("values"));
+    }
+
     virtual std::string format() const
     {
         return "d";
@@ -234,7 +241,7 @@ struct DirectFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new DirectFrozenColumn(reconstituter);
     }
 };
 
@@ -315,6 +322,13 @@ struct TableFrozenColumn
         indexes = mutableIndexes.freeze(serializer);
     }
 
+    TableFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<TableFrozenColumnMetadata>(reconstituter, *this);
+        indexes.reconstitute(*reconstituter.getStructure("index"));
+        table.reconstitute(*reconstituter.getStructure("table"));
+    }
+
     virtual std::string format() const
     {
         return "T";
@@ -354,6 +368,49 @@ struct TableFrozenColumn
         return forEachImpl(onRow, true /* keep nulls */);
     }
 
+    virtual bool forEachMatchingRow(const FrozenColumnFilter & filter,
+                                    const ForEachRowNumFn & onRow) const
+    {
+        // Evaluate the filter once per distinct value, and then only
+        // look at the indexes.  Index zero is null if there are nulls.
+        std::vector<bool> indexMatches(table.size() + hasNulls, false);
+        bool anyMatch = false;
+        for (size_t i = 0;  i < table.size();  ++i) {
+            if (filter.matches(table[i]))
+                anyMatch = indexMatches[i + hasNulls] = true;
+        }
+
+        if (!anyMatch)
+            return true;
+
+        auto onIndex = [&] (size_t i, uint64_t index)
+            {
+                return !indexMatches[index] || onRow(i + firstEntry);
+            };
+
+        return indexes.forEach(onIndex);
+    }
+
+    virtual std::function<uint32_t (uint32_t rowIndex)>
+    getCoder(const ColumnDictionary & dictionary) const
+    {
+        // Index zero is null if there are nulls
+        std::vector<uint32_t> indexCodes(table.size() + hasNulls,
+                                         ColumnDictionary::NO_CODE);
+        for (size_t i = 0;  i < table.size();  ++i)
+            indexCodes[i + hasNulls] = dictionary.getCode(table[i]);
+
+        return [this, indexCodes = std::move(indexCodes)] (uint32_t rowIndex)
+            {
+                if (rowIndex < firstEntry)
+                    return ColumnDictionary::NO_CODE;
+                rowIndex -= firstEntry;
+                if (rowIndex >= indexes.size())
+                    return ColumnDictionary::NO_CODE;
+                return indexCodes[indexes.get(rowIndex)];
+            };
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -472,7 +529,7 @@ struct TableFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new TableFrozenColumn(reconstituter);
     }
 };
 
@@ -551,6 +608,15 @@ struct SparseTableFrozenColumn
         }
     }
 
+    SparseTableFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<SparseTableFrozenColumnMetadata>
+            (reconstituter, *this);
+        table.reconstitute(*reconstituter.getStructure("table"));
+        rowNum.reconstitute(*reconstituter.getStructure("rn"));
+        index.reconstitute(*reconstituter.getStructure("idx"));
+    }
+
     virtual std::string format() const
     {
         return "ST";
@@ -595,6 +661,28 @@ struct SparseTableFrozenColumn
         return true;
     }
 
+    virtual bool forEachMatchingRow(const FrozenColumnFilter & filter,
+                                    const ForEachRowNumFn & onRow) const
+    {
+        std::vector<bool> indexMatches(table.size(), false);
+        bool anyMatch = false;
+        for (size_t i = 0;  i < table.size();  ++i) {
+            if (filter.matches(table[i]))
+                anyMatch = indexMatches[i] = true;
+        }
+
+        if (!anyMatch)
+            return true;
+
+        auto onIndex = [&] (size_t i, uint64_t index)
+            {
+                return !indexMatches[index]
+                    || onRow(this->rowNum.get(i) + firstEntry);
+            };
+
+        return index.forEach(onIndex);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -755,7 +843,7 @@ struct SparseTableFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new SparseTableFrozenColumn(reconstituter);
     }
 };
 
@@ -850,7 +938,7 @@ struct IntegerFrozenColumn
                     intVal = val.toInt() - offset + hasNulls;
                     ++numNonNullRows;
                 }
-                while (rowNumber < doneRows) {
+                while (doneRows < rowNumber) {
                     table.add(0);  // for the null
                     ++doneRows;
                 }
@@ -953,6 +1041,12 @@ struct IntegerFrozenColumn
         this->offset = info.offset;
         this->numNonNullRows = info.numNonNullRows;
     }
+
+    IntegerFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<IntegerFrozenColumnMetadata>(reconstituter, *this);
+        table.reconstitute(*reconstituter.getStructure("table"));
+    }
     
     CellValue decode(uint64_t val) const
     {
@@ -992,6 +1086,81 @@ struct IntegerFrozenColumn
         return forEachImpl(onRow, true /* keep nulls */);
     }
 
+    /** Return the range of values that are stored in the column, from the
+        column types recorded when it was frozen.
+    */
+    std::pair<int64_t, int64_t> getValueRange() const
+    {
+        int64_t minValue
+            = columnTypes.hasNegativeIntegers()
+            ? columnTypes.minNegativeInteger
+            : columnTypes.minPositiveInteger;
+        int64_t maxValue
+            = columnTypes.hasPositiveIntegers()
+            ? columnTypes.maxPositiveInteger
+            : columnTypes.maxNegativeInteger;
+        return { minValue, maxValue };
+    }
+
+    virtual bool forEachMatchingRow(const FrozenColumnFilter & filter,
+                                    const ForEachRowNumFn & onRow) const
+    {
+        if (!filter.isRange())
+            return FrozenColumn::forEachMatchingRow(filter, onRow);
+
+        // Matching values form a range of integers; find it by bisection
+        // over the values in the column, and skip the column entirely if
+        // it's empty.
+        int64_t lowest, highest;
+        std::tie(lowest, highest) = getValueRange();
+
+        if (lowest > highest
+            || !filter.passesLowerBound(highest)
+            || !filter.passesUpperBound(lowest))
+            return true;
+
+        auto midpoint = [] (int64_t lo, int64_t hi) -> int64_t
+            {
+                return lo + int64_t((uint64_t(hi) - uint64_t(lo)) / 2);
+            };
+
+        // Lowest value passing the lower bound
+        int64_t lo = lowest, hi = highest;
+        while (lo < hi) {
+            int64_t mid = midpoint(lo, hi);
+            if (filter.passesLowerBound(mid))
+                hi = mid;
+            else lo = mid + 1;
+        }
+        int64_t minMatch = lo;
+
+        // Highest value passing the upper bound
+        lo = lowest;  hi = highest;
+        while (lo < hi) {
+            int64_t mid = midpoint(lo, hi) + ((uint64_t(hi) - uint64_t(lo)) & 1);
+            if (filter.passesUpperBound(mid))
+                lo = mid;
+            else hi = mid - 1;
+        }
+        int64_t maxMatch = hi;
+
+        if (minMatch > maxMatch)
+            return true;
+
+        // Compare directly against the stored values, which are offset
+        // and have zero reserved for null if there are nulls.
+        uint64_t minStored = uint64_t(minMatch - offset) + hasNulls;
+        uint64_t maxStored = uint64_t(maxMatch - offset) + hasNulls;
+
+        auto onValue = [&] (size_t i, uint64_t val)
+            {
+                return val < minStored || val > maxStored
+                    || onRow(i + firstEntry);
+            };
+
+        return table.forEach(onValue);
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -1089,7 +1258,7 @@ struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new IntegerFrozenColumn(reconstituter);
     }
 };
 
@@ -1175,6 +1344,13 @@ struct DoubleFrozenColumn
         this->storage = mutableData.freeze();
     }
 
+    DoubleFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<DoubleFrozenColumnMetadata>(reconstituter, *this);
+        storage = reconstituter.getRegionT<Entry>("doubles");
+        ExcAssertEqual(storage.length(), numEntries);
+    }
+
     bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
     {
         for (size_t i = 0;  i < numEntries;  ++i) {
@@ -1198,6 +1374,20 @@ struct DoubleFrozenColumn
         return forEachImpl(onRow, true /* keep nulls */);
     }
 
+    virtual bool forEachMatchingRow(const FrozenColumnFilter & filter,
+                                    const ForEachRowNumFn & onRow) const
+    {
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            const Entry & entry = storage[i];
+            if (entry.isNull() || !filter.matches(entry.value()))
+                continue;
+            if (!onRow(i + firstEntry))
+                return false;
+        }
+
+        return true;
+    }
+
     virtual CellValue get(uint32_t rowIndex) const
     {
         CellValue result;
@@ -1336,7 +1526,7 @@ struct DoubleFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new DoubleFrozenColumn(reconstituter);
     }
 };
 
@@ -1384,6 +1574,14 @@ struct TimestampFrozenColumn
         unwrapped = column.freeze(serializer, params);
     }
 
+    TimestampFrozenColumn(StructuredReconstituter & reconstituter)
+    {
+        reconstituteMetadataT<TimestampFrozenColumnMetadata>
+            (reconstituter, *this);
+        unwrapped = FrozenColumn::reconstitute
+            (*reconstituter.getStructure("ul"));
+    }
+
     // Wrap a double (or null) into a timestamp (or null)
     static CellValue wrap(CellValue val)
     {
@@ -1449,9 +1647,11 @@ struct TimestampFrozenColumn
         return columnTypes;
     }
 
+    // Must match TimestampFrozenColumnFormat::format(), as it is used
+    // to find the format on reconstitution
     virtual std::string format() const
     {
-        return "T";
+        return "Timestamp";
     }
 
     virtual void serialize(StructuredSerializer & serializer) const
@@ -1501,7 +1701,7 @@ struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
     virtual FrozenColumn *
     reconstitute(StructuredReconstituter & reconstituter) const override
     {
-        throw AnnotatedException(600, "Tabular reconstitution not finished");
+        return new TimestampFrozenColumn(reconstituter);
     }
 };
 
@@ -1570,6 +1770,31 @@ registerFormat(std::shared_ptr<FrozenColumnFormat> format)
 }
 
 
+/*****************************************************************************/
+/* FROZEN COLUMN FILTER                                                      */
+/*****************************************************************************/
+
+bool
+FrozenColumnFilter::
+parseOp(const std::string & sqlOp, bool reversed, Op & op)
+{
+    if (sqlOp == "=" || sqlOp == "==")
+        op = EQ;
+    else if (sqlOp == "!=")
+        op = NE;
+    else if (sqlOp == "<")
+        op = reversed ? GT : LT;
+    else if (sqlOp == "<=")
+        op = reversed ? GE : LE;
+    else if (sqlOp == ">")
+        op = reversed ? LT : GT;
+    else if (sqlOp == ">=")
+        op = reversed ? LE : GE;
+    else return false;
+    return true;
+}
+
+
 /*****************************************************************************/
 /* FROZEN COLUMN                                                             */
 /*****************************************************************************/
@@ -1579,6 +1804,29 @@ FrozenColumn()
 {
 }
 
+bool
+FrozenColumn::
+forEachMatchingRow(const FrozenColumnFilter & filter,
+                   const ForEachRowNumFn & onRow) const
+{
+    auto onValue = [&] (size_t rowNum, const CellValue & val)
+        {
+            return !filter.matches(val) || onRow(rowNum);
+        };
+
+    return forEach(onValue);
+}
+
+std::function<uint32_t (uint32_t rowIndex)>
+FrozenColumn::
+getCoder(const ColumnDictionary & dictionary) const
+{
+    return [this, &dictionary] (uint32_t rowIndex)
+        {
+            return dictionary.getCode(get(rowIndex));
+        };
+}
+
 std::pair<ssize_t, std::function<std::shared_ptr<FrozenColumn>
                                  (TabularDatasetColumn & column,
                                   MappedSerializer & Serializer)> >
@@ -1694,6 +1942,59 @@ serializeMetadata(StructuredSerializer & serializer,
     serializeTo.freeze();
 }
 
+std::string
+FrozenColumn::
+reconstituteMetadata(StructuredReconstituter & reconstituter,
+                     void * md,
+                     const ValueDescription * desc)
+{
+    Json::Value val;
+    reconstituter.getObject("md.json", val);
+
+    std::string format = val["fmt"].asString();
+
+    if (md) {
+        ExcAssert(desc);
+        if (val["type"].asString() != desc->typeName) {
+            throw AnnotatedException
+                (500, "Frozen column metadata type mismatch: expected "
+                 + desc->typeName + " but got " + val["type"].asString()
+                 + " at " + reconstituter.getContext());
+        }
+        if (val["ver"].asInt() != desc->getVersion()) {
+            throw AnnotatedException
+                (500, "Frozen column metadata version mismatch at "
+                 + reconstituter.getContext(),
+                 "type", desc->typeName,
+                 "expectedVersion", desc->getVersion(),
+                 "version", val["ver"]);
+        }
+        StructuredJsonParsingContext context(val["data"]);
+        desc->parseJson(md, context);
+    }
+
+    return format;
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    std::string format
+        = reconstituteMetadata(reconstituter, nullptr, nullptr);
+
+    auto formats = getFormats().load();
+    auto it = formats->find(format);
+    if (it == formats->end()) {
+        throw AnnotatedException
+            (500, "Unknown frozen column format '" + format + "' at "
+             + reconstituter.getContext());
+    }
+
+    return std::shared_ptr<FrozenColumn>
+        (it->second->reconstitute(reconstituter));
+}
+
 
 } // namespace MLDB
 
@@ -9,12 +9,14 @@
 #pragma once
 
 #include "mldb/block/memory_region.h"
+#include "mldb/sql/cell_value.h"
 #include "column_types.h"
 #include <functional>
 
 namespace MLDB {
 
 struct TabularDatasetColumn;
+struct ColumnDictionary;
 
 /*****************************************************************************/
 /* COLUMN FREEZE PARAMETERS                                                  */
@@ -22,6 +24,105 @@ struct TabularDatasetColumn;
 
 /** Parameters used to control the freeze operation. */
 struct ColumnFreezeParameters {
+    /// Number of distinct string, blob or path values a column needs in
+    /// a chunk before a bloom filter is built for it
+    size_t bloomFilterMinValues = 64;
+
+    /// Size of the bloom filter per distinct value
+    double bloomFilterBitsPerValue = 10.0;
+};
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN FILTER                                                      */
+/*****************************************************************************/
+
+/** A simple predicate on the values of a column, as extracted from a WHERE
+    clause like "x > 10" or "x IS NOT NULL".  These can be pushed down into
+    the frozen columns, which can evaluate them directly against their
+    encoding.  As with SQL comparisons, a null value never matches.
+*/
+
+struct FrozenColumnFilter {
+    enum Op {
+        NOT_NULL,   ///< Any non-null value
+        EQ,         ///< Equal to value
+        NE,         ///< Not equal to value
+        LT,         ///< Less than value
+        LE,         ///< Less than or equal to value
+        GT,         ///< Greater than value
+        GE          ///< Greater than or equal to value
+    };
+
+    FrozenColumnFilter(Op op = NOT_NULL, CellValue value = CellValue())
+        : op(op), value(std::move(value))
+    {
+    }
+
+    Op op;
+    CellValue value;
+
+    /** Does the given value match?  This uses the same comparison
+        operators as ExpressionValue for atoms, so the result is the same
+        as evaluating the expression that the filter was extracted from.
+    */
+    bool matches(const CellValue & val) const
+    {
+        if (val.empty())
+            return false;
+        switch (op) {
+        case NOT_NULL:  return true;
+        case EQ:        return val == value;
+        case NE:        return val != value;
+        case LT:        return val < value;
+        case LE:        return val <= value;
+        case GT:        return val > value;
+        case GE:        return val >= value;
+        }
+        return false;
+    }
+
+    /** Does the value pass the lower bound of the filter?  Values that
+        pass form an upwards-closed range, so this can be used to bisect
+        an ordered domain.  Filters with no lower bound pass everything.
+    */
+    bool passesLowerBound(const CellValue & val) const
+    {
+        switch (op) {
+        case EQ:
+        case GE:        return val >= value;
+        case GT:        return val > value;
+        default:        return true;
+        }
+    }
+
+    /** Does the value pass the upper bound of the filter?  The counterpart
+        of passesLowerBound(), with values that pass forming a
+        downwards-closed range.
+    */
+    bool passesUpperBound(const CellValue & val) const
+    {
+        switch (op) {
+        case EQ:
+        case LE:        return val <= value;
+        case LT:        return val < value;
+        default:        return true;
+        }
+    }
+
+    /** Is the set of matching values a single range, bounded by
+        passesLowerBound() and passesUpperBound()?
+    */
+    bool isRange() const
+    {
+        return op != NE;
+    }
+
+    /** Parse the given SQL comparison operator.  If reversed is true, then
+        the operator is for "value op column" instead of "column op value".
+        Returns false if the operator isn't known.
+    */
+    static bool parseOp(const std::string & sqlOp, bool reversed, Op & op);
 };
 
 
@@ -51,10 +152,31 @@ struct FrozenColumn {
 
     virtual bool forEachDense(const ForEachRowFn & onRow) const = 0;
 
+    typedef std::function<bool (size_t rowNum)> ForEachRowNumFn;
+
+    /** Call onRow, in increasing order, with the row number of each row
+        whose value matches the filter.  The default implementation decodes
+        each non-null value; formats override it to evaluate the filter
+        against their encoding and to avoid touching rows at all when no
+        value can match.
+    */
+    virtual bool forEachMatchingRow(const FrozenColumnFilter & filter,
+                                    const ForEachRowNumFn & onRow) const;
+
     virtual bool
     forEachDistinctValue(std::function<bool (const CellValue &)> fn)
         const = 0;
 
+    /** Return a function that gives the code in dictionary of the value
+        of a row, or ColumnDictionary::NO_CODE if it's null or not in the
+        dictionary.  The dictionary must outlive the function.  The
+        default implementation decodes each value and looks it up; table
+        encoded formats look up each value of their table once and then
+        only read the index of each row.
+    */
+    virtual std::function<uint32_t (uint32_t rowIndex)>
+    getCoder(const ColumnDictionary & dictionary) const;
+
     virtual ColumnTypes getColumnTypes() const = 0;
 
     /** How many non-null rows are in this column? */
@@ -82,6 +204,33 @@ struct FrozenColumn {
     }
 
     virtual void serialize(StructuredSerializer & serializer) const = 0;
+
+    /** Reconstitute the metadata written by serializeMetadata(), parsing
+        the data member into md using desc (if non-null).  Returns the
+        name of the format that wrote the column.
+    */
+    static std::string
+    reconstituteMetadata(StructuredReconstituter & reconstituter,
+                         void * md,
+                         const ValueDescription * desc);
+
+    template<typename T>
+    static std::string
+    reconstituteMetadataT(StructuredReconstituter & reconstituter,
+                          T & md,
+                          const std::shared_ptr<const ValueDescriptionT<T> > & desc
+                          = getDefaultDescriptionSharedT<T>())
+    {
+        return reconstituteMetadata(reconstituter, &md, desc.get());
+    }
+
+    /** Reconstitute a column that was written with serialize().  The
+        storage is mapped directly from the reconstituter's regions, with
+        no copying or decoding.  The format is read from the metadata
+        and looked up in the registered FrozenColumnFormats.
+    */
+    static std::shared_ptr<FrozenColumn>
+    reconstitute(StructuredReconstituter & reconstituter);
 };
 
 
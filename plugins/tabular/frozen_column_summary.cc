@@ -0,0 +1,122 @@
+/** frozen_column_summary.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Per-chunk summaries of the values in a frozen column.
+*/
+
+#include "frozen_column_summary.h"
+#include "tabular_dataset_column.h"
+#include "mldb/types/basic_value_descriptions.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN SUMMARY                                                     */
+/*****************************************************************************/
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(FrozenColumnSummaryMetadata)
+{
+    setVersion(1);
+    addAuto("numNonNullValues",
+            &FrozenColumnSummaryMetadata::numNonNullValues, "");
+    addAuto("hasBloomFilter",
+            &FrozenColumnSummaryMetadata::hasBloomFilter, "");
+}
+
+FrozenColumnSummary
+FrozenColumnSummary::
+summarize(const TabularDatasetColumn & column,
+          MappedSerializer & serializer,
+          const ColumnFreezeParameters & params)
+{
+    FrozenColumnSummary result;
+    result.numNonNullValues = column.sparseIndexes.size();
+
+    if (result.numNonNullValues == 0)
+        return result;
+
+    // The distinct values are a superset of those actually stored, so
+    // the summary is conservative
+    auto minMax = std::minmax_element(column.indexedVals.begin(),
+                                      column.indexedVals.end());
+    result.minValue = *minMax.first;
+    result.maxValue = *minMax.second;
+
+    MutableCellValueTable range;
+    range.add(result.minValue);
+    range.add(result.maxValue);
+    result.range = range.freeze(serializer);
+
+    const ColumnTypes & types = column.columnTypes;
+    if (types.numStrings + types.numBlobs + types.numPaths > 0
+        && column.indexedVals.size() >= params.bloomFilterMinValues) {
+        MutableBloomFilter bloomFilter(column.indexedVals.size(),
+                                       params.bloomFilterBitsPerValue);
+        for (auto & v: column.indexedVals) {
+            bloomFilter.add(v.hash());
+        }
+        result.bloomFilter = bloomFilter.freeze(serializer);
+        result.hasBloomFilter = true;
+    }
+
+    return result;
+}
+
+bool
+FrozenColumnSummary::
+couldMatch(const FrozenColumnFilter & filter) const
+{
+    if (numNonNullValues == 0)
+        return false;  // nulls never match
+
+    switch (filter.op) {
+    case FrozenColumnFilter::NOT_NULL:
+        return true;
+    case FrozenColumnFilter::NE:
+        return !(minValue == maxValue && minValue == filter.value);
+    case FrozenColumnFilter::EQ:
+        if (hasBloomFilter && !bloomFilter.mayContain(filter.value.hash()))
+            return false;
+        // fall through
+    default:
+        return filter.passesLowerBound(maxValue)
+            && filter.passesUpperBound(minValue);
+    }
+}
+
+size_t
+FrozenColumnSummary::
+memusage() const
+{
+    return sizeof(*this) + range.memusage() + bloomFilter.memusage();
+}
+
+void
+FrozenColumnSummary::
+serialize(StructuredSerializer & serializer) const
+{
+    serializer.newObject<FrozenColumnSummaryMetadata>("md.json", *this);
+    if (numNonNullValues > 0)
+        range.serialize(*serializer.newStructure("range"));
+    if (hasBloomFilter)
+        bloomFilter.serialize(*serializer.newStructure("bloom"));
+}
+
+void
+FrozenColumnSummary::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject<FrozenColumnSummaryMetadata>("md.json", *this);
+    if (numNonNullValues > 0) {
+        range.reconstitute(*reconstituter.getStructure("range"));
+        ExcAssertEqual(range.size(), 2);
+        minValue = range[0];
+        maxValue = range[1];
+    }
+    if (hasBloomFilter)
+        bloomFilter.reconstitute(*reconstituter.getStructure("bloom"));
+}
+
+} // namespace MLDB
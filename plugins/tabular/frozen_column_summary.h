@@ -0,0 +1,66 @@
+/** frozen_column_summary.h                                        -*- C++ -*-
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Per-chunk summaries of the values in a frozen column, used to skip
+    chunks that can't match a filter.
+*/
+
+#pragma once
+
+#include "frozen_tables.h"
+
+
+namespace MLDB {
+
+struct TabularDatasetColumn;
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN SUMMARY                                                     */
+/*****************************************************************************/
+
+struct FrozenColumnSummaryMetadata {
+    uint64_t numNonNullValues = 0;
+    bool hasBloomFilter = false;
+};
+
+/** Summary of the values of one column within a chunk.  It holds the
+    range of the non-null values (a zone map) and, for columns with many
+    distinct strings, blobs or paths, a bloom filter over those values.
+    These can tell that no row of the chunk can match a filter without
+    looking at the column itself.
+*/
+
+struct FrozenColumnSummary: public FrozenColumnSummaryMetadata {
+
+    /** Summarize the given column, which must not yet have been frozen
+        as freezing consumes its values.
+    */
+    static FrozenColumnSummary
+    summarize(const TabularDatasetColumn & column,
+              MappedSerializer & serializer,
+              const ColumnFreezeParameters & params);
+
+    /** Return false if no value summarized can match the filter, or true
+        if one may.
+    */
+    bool couldMatch(const FrozenColumnFilter & filter) const;
+
+    size_t memusage() const;
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    void reconstitute(StructuredReconstituter & reconstituter);
+
+    /// Lowest and highest non-null values, by CellValue ordering
+    CellValue minValue, maxValue;
+
+    /// Serialized version of minValue and maxValue
+    FrozenCellValueTable range;
+
+    /// Bloom filter over the hashes of the distinct values, if
+    /// hasBloomFilter is true
+    FrozenBloomFilter bloomFilter;
+};
+
+} // namespace MLDB
@@ -70,6 +70,16 @@ serialize(StructuredSerializer & serializer) const
     serializer.addRegion(storage, "ints");
 }
 
+void
+FrozenIntegerTable::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject("md.json", md);
+    storage = reconstituter.getRegionT<uint64_t>("ints");
+    ExcAssertGreaterEqual(storage.length() * 64,
+                          md.numEntries * md.entryBits);
+}
+
 
 /*****************************************************************************/
 /* MUTABLE INTEGER TABLE                                                     */
@@ -215,6 +225,117 @@ freeze(MappedSerializer & serializer)
 }
 
 
+/*****************************************************************************/
+/* FROZEN BLOOM FILTER                                                       */
+/*****************************************************************************/
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(FrozenBloomFilterMetadata)
+{
+    setVersion(1);
+    addAuto("numBits", &FrozenBloomFilterMetadata::numBits, "");
+    addAuto("numHashes", &FrozenBloomFilterMetadata::numHashes, "");
+}
+
+/** Call onBit with each of the numHashes bit numbers for the given hash.
+    These are generated by double hashing from two halves of the hash,
+    which is good enough when the hash is of high quality.
+*/
+template<typename Fn>
+static void forEachBloomBit(uint64_t hash, uint64_t numBits,
+                            uint8_t numHashes, Fn && onBit)
+{
+    uint64_t h1 = hash;
+    uint64_t h2 = ((hash >> 32) | (hash << 32)) | 1;
+    for (unsigned i = 0;  i < numHashes;  ++i) {
+        onBit((h1 + i * h2) % numBits);
+    }
+}
+
+bool
+FrozenBloomFilter::
+mayContain(uint64_t hash) const
+{
+    if (empty())
+        return true;
+
+    const uint64_t * data = bits.data();
+    bool result = true;
+    forEachBloomBit(hash, md.numBits, md.numHashes,
+                    [&] (uint64_t bit)
+                    {
+                        result = result
+                            && (data[bit / 64] & (1ULL << (bit % 64)));
+                    });
+    return result;
+}
+
+size_t
+FrozenBloomFilter::
+memusage() const
+{
+    return bits.memusage();
+}
+
+void
+FrozenBloomFilter::
+serialize(StructuredSerializer & serializer) const
+{
+    serializer.newObject("md.json", md);
+    serializer.addRegion(bits, "bits");
+}
+
+void
+FrozenBloomFilter::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject("md.json", md);
+    bits = reconstituter.getRegionT<uint64_t>("bits");
+    ExcAssertGreaterEqual(bits.length() * 64, md.numBits);
+}
+
+
+/*****************************************************************************/
+/* MUTABLE BLOOM FILTER                                                      */
+/*****************************************************************************/
+
+MutableBloomFilter::
+MutableBloomFilter(size_t numValues, double bitsPerValue)
+{
+    size_t numWords = (numValues * bitsPerValue + 63) / 64;
+    numWords = std::max<size_t>(numWords, 1);
+    numBits = numWords * 64;
+    // Optimal number of hashes is ln 2 * bits per value
+    numHashes = std::max(1, std::min(16, int(bitsPerValue * 0.693 + 0.5)));
+    bits.resize(numWords);
+}
+
+void
+MutableBloomFilter::
+add(uint64_t hash)
+{
+    forEachBloomBit(hash, numBits, numHashes,
+                    [&] (uint64_t bit)
+                    {
+                        bits[bit / 64] |= (1ULL << (bit % 64));
+                    });
+}
+
+FrozenBloomFilter
+MutableBloomFilter::
+freeze(MappedSerializer & serializer)
+{
+    MutableMemoryRegionT<uint64_t> mutableBits
+        = serializer.allocateWritableT<uint64_t>(bits.size());
+    std::copy(bits.begin(), bits.end(), mutableBits.data());
+
+    FrozenBloomFilter result;
+    result.md.numBits = numBits;
+    result.md.numHashes = numHashes;
+    result.bits = mutableBits.freeze();
+    return result;
+}
+
+
 /*****************************************************************************/
 /* FROZEN BLOB TABLE                                                         */
 /*****************************************************************************/
@@ -400,6 +521,16 @@ serialize(StructuredSerializer & serializer) const
     offset.serialize(*serializer.newStructure("offsets"));
 }
 
+void
+FrozenBlobTable::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    reconstituter.getObject("md.json", md);
+    formatData = reconstituter.getRegion("fmt");
+    blobData = reconstituter.getRegion("blob");
+    offset.reconstitute(*reconstituter.getStructure("offsets"));
+}
+
 
 /*****************************************************************************/
 /* MUTABLE BLOB TABLE                                                        */
@@ -654,6 +785,26 @@ serialize(StructuredSerializer & serializer) const
     blobs.serialize(serializer);
 }
 
+void
+FrozenCellValueTable::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    blobs.reconstitute(reconstituter);
+}
+
+
+/*****************************************************************************/
+/* FROZEN CELL VALUE SET                                                     */
+/*****************************************************************************/
+
+void
+FrozenCellValueSet::
+reconstitute(StructuredReconstituter & reconstituter)
+{
+    offsets.reconstitute(reconstituter);
+    cells = reconstituter.getRegion("cells");
+}
+
 
 /*****************************************************************************/
 /* MUTABLE CELL VALUE TABLE                                                  */
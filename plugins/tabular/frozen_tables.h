@@ -91,6 +91,8 @@ struct FrozenIntegerTable {
     uint64_t get(size_t i) const;
 
     void serialize(StructuredSerializer & serializer) const;
+
+    void reconstitute(StructuredReconstituter & reconstituter);
 };
 
 struct MutableIntegerTable {
@@ -175,6 +177,57 @@ struct MutableDoubleTable {
 
 
 
+/*****************************************************************************/
+/* BLOOM FILTER                                                              */
+/*****************************************************************************/
+
+struct FrozenBloomFilterMetadata {
+    uint64_t numBits = 0;
+    uint8_t numHashes = 0;
+};
+
+/** Bloom filter over 64 bit hashes.  It can say that a hash was definitely
+    not added to the set, without needing to look at the set itself.
+*/
+
+struct FrozenBloomFilter {
+    FrozenBloomFilterMetadata md;
+    FrozenMemoryRegionT<uint64_t> bits;
+
+    bool empty() const
+    {
+        return md.numBits == 0;
+    }
+
+    /** Return false if the hash was definitely not added, or true if it
+        may have been.  An empty filter may contain anything.
+    */
+    bool mayContain(uint64_t hash) const;
+
+    size_t memusage() const;
+
+    void serialize(StructuredSerializer & serializer) const;
+
+    void reconstitute(StructuredReconstituter & reconstituter);
+};
+
+struct MutableBloomFilter {
+    /** Create a filter for the given number of values, with the given
+        number of bits per value.  Ten bits per value gives a false
+        positive rate of around 1%.
+    */
+    MutableBloomFilter(size_t numValues, double bitsPerValue);
+
+    void add(uint64_t hash);
+
+    std::vector<uint64_t> bits;
+    uint64_t numBits;
+    uint8_t numHashes;
+
+    FrozenBloomFilter freeze(MappedSerializer & serializer);
+};
+
+
 /*****************************************************************************/
 /* BLOB TABLES                                                               */
 /*****************************************************************************/
@@ -206,6 +259,7 @@ struct FrozenBlobTable {
     size_t memusage() const;
     size_t size() const;
     void serialize(StructuredSerializer & serializer) const;
+    void reconstitute(StructuredReconstituter & reconstituter);
 
     struct Itl;
     std::shared_ptr<Itl> itl;
@@ -316,6 +370,8 @@ struct FrozenCellValueTable {
 
     void serialize(StructuredSerializer & serializer) const;
 
+    void reconstitute(StructuredReconstituter & reconstituter);
+
     FrozenBlobTable blobs;
 };
 
@@ -398,6 +454,8 @@ struct FrozenCellValueSet {
         serializer.addRegion(cells, "cells");
     }
 
+    void reconstitute(StructuredReconstituter & reconstituter);
+
     FrozenIntegerTable offsets;
     FrozenMemoryRegion cells;
 };
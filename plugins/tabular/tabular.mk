@@ -5,6 +5,7 @@ LIBMLDB_TABULAR_PLUGIN_SOURCES:= \
 	tabular_dataset.cc \
 	frozen_column.cc \
 	frozen_tables.cc \
+	frozen_column_summary.cc \
 	string_frozen_column.cc \
 	column_types.cc \
 	tabular_dataset_column.cc \
@@ -26,6 +26,8 @@
 #include "mldb/utils/floating_point.h"
 #include "mldb/utils/log.h"
 #include "mldb/engine/dataset_utils.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/sql_utils.h"
 #include "mldb/arch/bit_range_ops.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/vfs/filter_streams.h"
@@ -322,6 +324,14 @@ struct PathIndexShard: public PathIndexMetadata {
         serializer.addRegion(storage, "rowindex");
     }
 
+    void reconstitute(StructuredReconstituter & reconstituter)
+    {
+        reconstituter.getObject<PathIndexMetadata>("md.json", *this);
+        storage = reconstituter.getRegionT<uint32_t>("rowindex");
+        ExcAssertGreaterEqual(storage.length() * 32,
+                              numEntries * (chunkBits + offsetBits));
+    }
+
     // Hash is implicit via position in the entry map (we take the top x bits)
     // It returns the chunk number that contains that hash portion
     // linear chaining
@@ -363,6 +373,13 @@ struct PathIndex {
         }
     }
 
+    void reconstitute(StructuredReconstituter & reconstituter)
+    {
+        for (size_t i = 0;  i < INDEX_SHARDS;  ++i) {
+            shards[i].reconstitute(*reconstituter.getStructure(i));
+        }
+    }
+
     // Hash is implicit via position in the entry map (we rescale the
     // hash range)
     // It returns the chunk number that contains that hash portion
@@ -402,6 +419,33 @@ freeze(MappedSerializer & serializer)
 }
 
 
+/*****************************************************************************/
+/* TABULAR DATA STORE METADATA                                               */
+/*****************************************************************************/
+
+/** Metadata written at the root of a saved tabular dataset.  It contains
+    everything that's needed to interpret the chunks and the row index.
+*/
+
+struct TabularDataStoreMetadata {
+    std::vector<ColumnPath> fixedColumns;
+    uint64_t numChunks = 0;
+    uint64_t rowCount = 0;
+    Date earliestTs = Date::positiveInfinity();
+    Date latestTs = Date::negativeInfinity();
+};
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(TabularDataStoreMetadata)
+{
+    setVersion(1);
+    addField("fixedColumns", &TabularDataStoreMetadata::fixedColumns, "");
+    addField("numChunks", &TabularDataStoreMetadata::numChunks, "");
+    addField("rowCount", &TabularDataStoreMetadata::rowCount, "");
+    addField("earliestTs", &TabularDataStoreMetadata::earliestTs, "");
+    addField("latestTs", &TabularDataStoreMetadata::latestTs, "");
+}
+
+
 /*****************************************************************************/
 /* TABULAR DATA STORE                                                        */
 /*****************************************************************************/
@@ -498,6 +542,21 @@ struct TabularDataset::TabularDataStore
         Date earliestTs = Date::positiveInfinity();
         Date  latestTs = Date::negativeInfinity();
 
+        /// Column dictionaries that have been asked for, by column index.
+        /// Each entry holds the largest maxValues that has been tried and
+        /// the dictionary, if there was one within that size.
+        struct DictionaryCache {
+            std::mutex mutex;
+            std::map<int, std::pair<size_t,
+                                    std::shared_ptr<const ColumnDictionary> > >
+                entries;
+        };
+
+        /// Cache of dictionaries.  It's replaced when the state is copied,
+        /// as the new state has different chunks.
+        std::shared_ptr<DictionaryCache> dictionaries
+            = std::make_shared<DictionaryCache>();
+
         virtual Any getStatus() const override
         {
             Json::Value status;
@@ -666,6 +725,65 @@ struct TabularDataset::TabularDataStore
             return std::make_tuple(std::move(buckets), std::move(desc));
         }
 
+        virtual std::shared_ptr<const ColumnDictionary>
+        getColumnDictionary(const ColumnPath & column,
+                            size_t maxValues) const override
+        {
+            auto it = columnIndex.find(column.oldHash());
+            if (it == columnIndex.end())
+                return nullptr;
+
+            const ColumnEntry & entry = columns[it->second];
+
+            std::unique_lock<std::mutex> guard(dictionaries->mutex);
+            auto & cached = dictionaries->entries[it->second];
+            if (cached.second) {
+                if (cached.second->size() <= maxValues)
+                    return cached.second;
+                return nullptr;
+            }
+            if (cached.first >= maxValues)
+                return nullptr;
+            cached.first = maxValues;
+
+            for (auto & c: entry.chunks) {
+                if (!c.second->getColumnTypes().onlyStringsAndNulls())
+                    return nullptr;
+            }
+
+            // Table encoded chunks only need to look at their table, so
+            // this is cheap for the columns it's worth doing for.  Others
+            // stop as soon as they have too many values.
+            std::vector<std::vector<CellValue> > values(entry.chunks.size());
+            std::atomic<bool> tooMany(false);
+
+            auto onChunk = [&] (size_t i)
+                {
+                    auto onValue = [&] (const CellValue & val)
+                    {
+                        if (!val.empty())
+                            values[i].push_back(val);
+                        return values[i].size() <= maxValues && !tooMany;
+                    };
+
+                    if (!entry.chunks[i].second->forEachDistinctValue(onValue))
+                        tooMany = true;
+                };
+
+            parallelMap(0, entry.chunks.size(), onChunk);
+
+            if (tooMany)
+                return nullptr;
+
+            auto sorted = parallelMergeSortUnique(values);
+            if (sorted.size() > maxValues)
+                return nullptr;
+
+            cached.second
+                = std::make_shared<ColumnDictionary>(std::move(sorted));
+            return cached.second;
+        }
+
         virtual uint64_t getColumnRowCount(const ColumnPath & column) const override
         {
             return rowCount;
@@ -921,6 +1039,155 @@ struct TabularDataset::TabularDataStore
             return { earliestTs, latestTs };
         }
 
+        /// Returns the sorted row numbers within the given chunk that
+        /// match a filter pushed down from a WHERE clause
+        typedef std::function<std::vector<uint32_t> (size_t chunkNum)>
+            ChunkRowFilter;
+
+        /** Extract a filter from the WHERE clause that can be evaluated
+            directly against the frozen columns of each chunk, rather than
+            by evaluating the expression row by row.  Handles comparisons
+            of a column with a constant, IS NOT NULL and AND or OR of
+            those.  Returns a null function if the expression can't be
+            pushed down.
+        */
+        ChunkRowFilter
+        getPushdownFilter(const Utf8String & alias,
+                          const SqlExpression & where) const
+        {
+            auto getVariable = [] (const SqlExpression & expression)
+                {
+                    return dynamic_cast<const ReadColumnExpression *>(&expression);
+                };
+
+            auto getConstant = [] (const SqlExpression & expression)
+                {
+                    return dynamic_cast<const ConstantExpression *>(&expression);
+                };
+
+            auto filterColumn = [&] (const ReadColumnExpression & variable,
+                                     FrozenColumnFilter filter)
+                -> ChunkRowFilter
+                {
+                    ColumnPath columnName
+                        = removeTableName(alias, variable.columnName);
+
+                    // Frozen column for each chunk, or null for chunks
+                    // where the column has no values or where its
+                    // summary says that no value can match
+                    std::vector<std::shared_ptr<const FrozenColumn> >
+                        chunkColumns(chunks.size());
+
+                    auto it = columnIndex.find(columnName.oldHash());
+                    if (it != columnIndex.end()) {
+                        for (auto & c: columns[it->second].chunks) {
+                            const FrozenColumnSummary * summary
+                                = chunks.at(c.first)
+                                ->maybeGetColumnSummary(it->second, columnName);
+                            if (summary && !summary->couldMatch(filter))
+                                continue;
+                            chunkColumns.at(c.first) = c.second;
+                        }
+                    }
+
+                    return [=] (size_t chunkNum)
+                        {
+                            std::vector<uint32_t> result;
+                            const auto & column = chunkColumns.at(chunkNum);
+                            if (!column)
+                                return result;
+
+                            auto onRow = [&] (size_t rowNum)
+                            {
+                                result.push_back(rowNum);
+                                return true;
+                            };
+
+                            column->forEachMatchingRow(filter, onRow);
+                            return result;
+                        };
+                };
+
+            if (auto comparison
+                = dynamic_cast<const ComparisonExpression *>(&where)) {
+                auto vlhs = getVariable(*comparison->lhs);
+                auto vrhs = getVariable(*comparison->rhs);
+                auto clhs = getConstant(*comparison->lhs);
+                auto crhs = getConstant(*comparison->rhs);
+
+                const ReadColumnExpression * variable = nullptr;
+                const ConstantExpression * constant = nullptr;
+                if (vlhs && crhs) {
+                    variable = vlhs;
+                    constant = crhs;
+                }
+                else if (vrhs && clhs) {
+                    variable = vrhs;
+                    constant = clhs;
+                }
+
+                FrozenColumnFilter::Op op;
+                if (variable
+                    && constant->constant.isAtom()
+                    && !constant->constant.empty()
+                    && FrozenColumnFilter::parseOp(comparison->op,
+                                                   variable == vrhs, op)) {
+                    return filterColumn(*variable,
+                                        { op, constant->constant.getAtom() });
+                }
+            }
+
+            if (auto isType = dynamic_cast<const IsTypeExpression *>(&where)) {
+                auto variable = getVariable(*isType->expr);
+                if (variable && isType->type == "null" && isType->notType) {
+                    return filterColumn(*variable,
+                                        FrozenColumnFilter::NOT_NULL);
+                }
+            }
+
+            if (auto boolean
+                = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+                if (boolean->op != "AND" && boolean->op != "OR")
+                    return nullptr;
+
+                ChunkRowFilter lhs = getPushdownFilter(alias, *boolean->lhs);
+                if (!lhs)
+                    return nullptr;
+                ChunkRowFilter rhs = getPushdownFilter(alias, *boolean->rhs);
+                if (!rhs)
+                    return nullptr;
+
+                if (boolean->op == "AND") {
+                    return [=] (size_t chunkNum)
+                        {
+                            std::vector<uint32_t> lhsRows = lhs(chunkNum);
+                            if (lhsRows.empty())
+                                return lhsRows;
+                            std::vector<uint32_t> rhsRows = rhs(chunkNum);
+                            std::vector<uint32_t> result;
+                            std::set_intersection(lhsRows.begin(), lhsRows.end(),
+                                                  rhsRows.begin(), rhsRows.end(),
+                                                  std::back_inserter(result));
+                            return result;
+                        };
+                }
+                else {
+                    return [=] (size_t chunkNum)
+                        {
+                            std::vector<uint32_t> lhsRows = lhs(chunkNum);
+                            std::vector<uint32_t> rhsRows = rhs(chunkNum);
+                            std::vector<uint32_t> result;
+                            std::set_union(lhsRows.begin(), lhsRows.end(),
+                                           rhsRows.begin(), rhsRows.end(),
+                                           std::back_inserter(result));
+                            return result;
+                        };
+                }
+            }
+
+            return nullptr;
+        }
+
         virtual GenerateRowsWhereFunction
         generateRowsWhere(const SqlBindingScope & context,
                           const Utf8String& alias,
@@ -929,6 +1196,50 @@ struct TabularDataset::TabularDataStore
                           ssize_t limit) const
         {
             GenerateRowsWhereFunction result;
+
+            ChunkRowFilter filter = getPushdownFilter(alias, where);
+            if (!filter)
+                return result;  // use the generic implementation
+
+            // Keep our state alive for as long as the generator is
+            auto thisPtr = this->shared_from_this();
+
+            result = {[=] (ssize_t numToGenerate, Any token,
+                           const BoundParameters & params,
+                           const ProgressFunc & onProgress)
+                      -> std::pair<std::vector<RowPath>, Any>
+                {
+                    const auto & chunks = thisPtr->chunks;
+                    std::vector<std::vector<RowPath> > chunkRows(chunks.size());
+
+                    auto onChunk = [&] (size_t i)
+                    {
+                        std::vector<uint32_t> rows = filter(i);
+                        chunkRows[i].reserve(rows.size());
+                        for (auto & r: rows) {
+                            chunkRows[i].emplace_back(chunks[i]->getRowPath(r));
+                        }
+                    };
+
+                    parallelMap(0, chunks.size(), onChunk);
+
+                    size_t totalRows = 0;
+                    for (auto & rows: chunkRows)
+                        totalRows += rows.size();
+
+                    std::vector<RowPath> rows;
+                    rows.reserve(totalRows);
+                    for (auto & r: chunkRows) {
+                        rows.insert(rows.end(),
+                                    std::make_move_iterator(r.begin()),
+                                    std::make_move_iterator(r.end()));
+                    }
+
+                    return { std::move(rows), Any() };
+                },
+                "filter tabular chunks on " + where.print().rawString(),
+                GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN};
+
             return result;
         }
 
@@ -953,15 +1264,14 @@ struct TabularDataset::TabularDataStore
 
             rowIndex.serialize(*serializer.newStructure("ri"));
 
-            {
-                auto colSerializer = serializer.newEntry("cs");
-                
-            }
+            TabularDataStoreMetadata md;
+            md.fixedColumns = owner->fixedColumns;
+            md.numChunks = chunks.size();
+            md.rowCount = rowCount;
+            md.earliestTs = earliestTs;
+            md.latestTs = latestTs;
 
-            {
-                auto mdSerializer = serializer.newStream("md");
-                mdSerializer << earliestTs << latestTs;
-            }
+            serializer.newObject("md.json", md);
         }
     };
 
@@ -1144,11 +1454,74 @@ struct TabularDataset::TabularDataStore
             return extractT<CellValue>(numValues, columnNames, output);
         }
 
+        virtual bool
+        extractCodes(size_t numValues,
+                     const std::vector<ColumnPath> & columnNames,
+                     const std::vector<const ColumnDictionary *> & dictionaries,
+                     uint32_t * codes,
+                     Date * timestamps) override
+        {
+            size_t numColumns = columnNames.size();
+            size_t n = 0;
+
+            while (n < numValues) {
+                // The coders of a chunk are kept for the following calls,
+                // which normally read the rest of the same chunk
+                const TabularDatasetChunk * chunk = chunkiter->get();
+                if (chunk != codersChunk || columnNames != codersColumns) {
+                    coders.clear();
+                    for (size_t i = 0;  i < numColumns;  ++i) {
+                        auto it = state->columnIndex.find
+                            (columnNames[i].oldHash());
+                        const FrozenColumn * column
+                            = it == state->columnIndex.end()
+                            ? nullptr
+                            : chunk->maybeGetColumn(it->second,
+                                                    columnNames[i]);
+                        if (column)
+                            coders.emplace_back
+                                (column->getCoder(*dictionaries[i]));
+                        else coders.emplace_back(nullptr);
+                    }
+                    codersChunk = chunk;
+                    codersColumns = columnNames;
+                }
+
+                for (; rowIndex < rowCount && n < numValues;) {
+                    Date ts = chunk->timestamps->get(rowIndex)
+                        .mustCoerceToTimestamp();
+                    for (size_t i = 0;  i < numColumns;  ++i) {
+                        size_t pos = n * numColumns + i;
+                        codes[pos] = coders[i]
+                            ? coders[i](rowIndex)
+                            : ColumnDictionary::NO_CODE;
+                        if (codes[pos] != ColumnDictionary::NO_CODE)
+                            timestamps[pos] = ts;
+                    }
+
+                    ++n;
+
+                    if (rowIndex == rowCount - 1) {
+                        advance();
+                        break;  // new chunk, so new coders
+                    }
+                    advance();
+                }
+            }
+
+            return true;
+        }
+
         std::shared_ptr<const CurrentState> state;
         std::vector<std::shared_ptr<const TabularDatasetChunk> >
             ::const_iterator chunkiter;
         size_t rowIndex;   ///< Number of row within this chunk
         size_t rowCount;   ///< Total number of rows within this chunk
+
+        /// Chunk and columns that coders were made for by extractCodes()
+        const TabularDatasetChunk * codersChunk = nullptr;
+        std::vector<ColumnPath> codersColumns;
+        std::vector<std::function<uint32_t (uint32_t)> > coders;
     };
 
     /** This structure handles a list of chunks that allows for them to be
@@ -1261,6 +1634,13 @@ struct TabularDataset::TabularDataStore
         return currentState.load()->getColumnBuckets(column, maxNumBuckets);
     }
 
+    virtual std::shared_ptr<const ColumnDictionary>
+    getColumnDictionary(const ColumnPath & column,
+                        size_t maxValues) const override
+    {
+        return currentState.load()->getColumnDictionary(column, maxValues);
+    }
+
     virtual uint64_t
     getColumnRowCount(const ColumnPath & column) const override
     {
@@ -1374,7 +1754,8 @@ struct TabularDataset::TabularDataStore
     /// chunks.
     std::shared_ptr<CurrentState>
     finalize(std::shared_ptr<const CurrentState> oldState,
-             std::vector<std::shared_ptr<TabularDatasetChunk> > & inputChunks)
+             std::vector<std::shared_ptr<TabularDatasetChunk> > & inputChunks,
+             bool reindexRows = true)
     {
         // NOTE: must be called with the lock held
 
@@ -1388,6 +1769,8 @@ struct TabularDataset::TabularDataStore
         }
 
         auto newState = std::make_shared<CurrentState>(*oldState);
+        newState->dictionaries
+            = std::make_shared<CurrentState::DictionaryCache>();
 
         newState->rowCount = totalRows;
         
@@ -1448,7 +1831,7 @@ struct TabularDataset::TabularDataStore
 
         
         // Recreate the index if a new chunk has been added
-        if (numChunksBefore != newState->chunks.size()) {
+        if (reindexRows && numChunksBefore != newState->chunks.size()) {
             MutablePathIndex index;
 
             // We create the row index in multiple chunks
@@ -1557,13 +1940,78 @@ struct TabularDataset::TabularDataStore
         PolyConfigT<Dataset> result;
         result.type = "tabular";
 
-        PersistentDatasetConfig params;
+        TabularDatasetConfig params = config;
         params.dataFileUrl = dataFileUrl;
         result.params = params;
 
         return result;
     }
 
+    /** Load the dataset from an artifact written by save().  The zip file
+        is memory mapped, and the frozen columns and row index point
+        directly into the mapping, so nothing is copied or decoded; pages
+        are faulted in as they are accessed.
+    */
+    void load(const Url & dataFileUrl)
+    {
+        Timer timer;
+
+        std::unique_lock<std::mutex> guard(datasetMutex);
+
+        // Regions hold a reference to the mapping, so the reconstituter
+        // itself only needs to live until the load is finished.
+        ZipStructuredReconstituter reconstituter(dataFileUrl);
+
+        TabularDataStoreMetadata md;
+        reconstituter.getObject("md.json", md);
+
+        initialize(std::move(md.fixedColumns));
+
+        std::vector<std::shared_ptr<TabularDatasetChunk> >
+            loadedChunks(md.numChunks);
+
+        auto chunkReconstituter = reconstituter.getStructure("ch");
+
+        auto loadChunk = [&] (size_t i)
+            {
+                loadedChunks[i] = std::make_shared<TabularDatasetChunk>
+                    (*chunkReconstituter->getStructure(to_string(i)));
+                ExcAssertEqual(loadedChunks[i]->fixedColumnCount(),
+                               fixedColumns.size());
+            };
+
+        parallelMap(0, md.numChunks, loadChunk);
+
+        auto newState = finalize(currentState.load(), loadedChunks,
+                                 false /* reindex rows */);
+        if (newState->rowCount != md.rowCount) {
+            throw AnnotatedException
+                (500, "Tabular dataset artifact is inconsistent: metadata "
+                 "has " + to_string(md.rowCount) + " rows but chunks have "
+                 + to_string(newState->rowCount),
+                 "dataFileUrl", dataFileUrl);
+        }
+
+        newState->rowIndex.reconstitute(*reconstituter.getStructure("ri"));
+        newState->earliestTs = md.earliestTs;
+        newState->latestTs = md.latestTs;
+
+        currentState.store(newState);
+
+        // Allow more rows to be recorded on top of those loaded
+        auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
+        for (auto & c: *newChunks) {
+            c.store(std::make_shared<MutableTabularDatasetChunk>
+                    (fixedColumns.size(),
+                     chunkSizeForNumColumns(fixedColumns.size())));
+        }
+        mutableChunks.store(std::move(newChunks));
+
+        INFO_MSG(logger) << "loaded " << md.rowCount << " rows in "
+                         << md.numChunks << " chunks from " << dataFileUrl
+                         << " in " << timer.elapsed();
+    }
+
     /** This is a recorder that allows parallel records from multiple
         threads. */
     struct BasicRecorder: public Recorder {
@@ -2122,10 +2570,14 @@ TabularDataset(MldbEngine * owner,
                const ProgressFunc & onProgress)
     : Dataset(owner)
 {
+    auto tabularConfig = config.params.convert<TabularDatasetConfig>();
+
     itl = make_shared<TabularDataStore>
-        (owner,
-         config.params.convert<TabularDatasetConfig>(),
-         MLDB::getMldbLog<TabularDataset>());
+        (owner, tabularConfig, MLDB::getMldbLog<TabularDataset>());
+
+    if (!tabularConfig.dataFileUrl.empty()) {
+        itl->load(tabularConfig.dataFileUrl);
+    }
 }
 
 TabularDataset::
@@ -2284,6 +2736,11 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of an artifact previously written by the dataset's "
+             "`saves` route.  If set, the dataset is loaded from the "
+             "artifact by memory mapping it, rather than being created "
+             "empty.");
 }
 
 namespace {
@@ -33,6 +33,7 @@ struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+    Url dataFileUrl;  ///< Artifact to load the dataset from, if any
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -7,9 +7,30 @@
 
 #include "tabular_dataset_chunk.h"
 #include "mldb/sql/expression_value.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/types/basic_value_descriptions.h"
 
 namespace MLDB {
 
+/// Metadata written alongside each chunk, so that it can be reconstituted
+struct TabularDatasetChunkMetadata {
+    uint32_t numFixedColumns = 0;
+    std::vector<ColumnPath> sparseColumns;
+    bool hasSummaries = false;
+};
+
+IMPLEMENT_STRUCTURE_DESCRIPTION(TabularDatasetChunkMetadata)
+{
+    setVersion(1);
+    addField("numFixedColumns",
+             &TabularDatasetChunkMetadata::numFixedColumns, "");
+    addField("sparseColumns",
+             &TabularDatasetChunkMetadata::sparseColumns, "");
+    addField("hasSummaries",
+             &TabularDatasetChunkMetadata::hasSummaries, "");
+}
+
+
 /*****************************************************************************/
 /* TABULAR DATASET CHUNK                                                     */
 /*****************************************************************************/
@@ -30,6 +51,11 @@ memusage() const
     for (auto & c: sparseColumns)
         result += c.first.memusage() + c.second->memusage();
 
+    for (auto & s: columnSummaries)
+        result += s.memusage();
+    for (auto & s: sparseColumnSummaries)
+        result += s.second.memusage();
+
     //cerr << sparseColumns.size() << " sparse columns took "
     //     << result - before << endl;
     before = result;
@@ -63,6 +89,23 @@ maybeGetColumn(size_t columnIndex, const PathElement & columnName) const
     }
 }
 
+const FrozenColumnSummary *
+TabularDatasetChunk::
+maybeGetColumnSummary(size_t columnIndex, const Path & columnName) const
+{
+    if (columnIndex < columns.size()) {
+        if (columnIndex < columnSummaries.size())
+            return &columnSummaries[columnIndex];
+        return nullptr;
+    }
+    else {
+        auto it = sparseColumnSummaries.find(columnName);
+        if (it == sparseColumnSummaries.end())
+            return nullptr;
+        return &it->second;
+    }
+}
+
 /// Return an owned version of the rowname
 RowPath
 TabularDatasetChunk::
@@ -181,6 +224,50 @@ addToColumn(int columnIndex,
     }
 }
 
+TabularDatasetChunk::
+TabularDatasetChunk(StructuredReconstituter & reconstituter)
+{
+    TabularDatasetChunkMetadata md;
+    reconstituter.getObject("md.json", md);
+
+    columns.reserve(md.numFixedColumns);
+    for (size_t i = 0;  i < md.numFixedColumns;  ++i) {
+        columns.emplace_back(FrozenColumn::reconstitute
+                             (*reconstituter.getStructure(to_string(i))));
+    }
+
+    if (md.hasSummaries) {
+        auto summaryReconstituter = reconstituter.getStructure("zm");
+        columnSummaries.resize(md.numFixedColumns);
+        for (size_t i = 0;  i < md.numFixedColumns;  ++i) {
+            columnSummaries[i].reconstitute
+                (*summaryReconstituter->getStructure(to_string(i)));
+        }
+    }
+
+    if (!md.sparseColumns.empty()) {
+        auto sparseReconstituter = reconstituter.getStructure("sp");
+        std::shared_ptr<StructuredReconstituter> sparseSummaryReconstituter;
+        if (md.hasSummaries)
+            sparseSummaryReconstituter = reconstituter.getStructure("spzm");
+
+        sparseColumns.reserve(md.sparseColumns.size());
+        for (size_t i = 0;  i < md.sparseColumns.size();  ++i) {
+            if (sparseSummaryReconstituter) {
+                sparseColumnSummaries[md.sparseColumns[i]].reconstitute
+                    (*sparseSummaryReconstituter->getStructure(to_string(i)));
+            }
+            sparseColumns.emplace
+                (std::move(md.sparseColumns[i]),
+                 FrozenColumn::reconstitute
+                     (*sparseReconstituter->getStructure(to_string(i))));
+        }
+    }
+
+    rowNames = FrozenColumn::reconstitute(*reconstituter.getStructure("rn"));
+    timestamps = FrozenColumn::reconstitute(*reconstituter.getStructure("ts"));
+}
+
 void
 TabularDatasetChunk::
 serialize(StructuredSerializer & serializer) const
@@ -190,19 +277,49 @@ serialize(StructuredSerializer & serializer) const
         {
             col.serialize(*serializer.newStructure(name));
         };
+
+    TabularDatasetChunkMetadata md;
+    md.numFixedColumns = columns.size();
     
     for (size_t i = 0;  i < columns.size();  ++i) {
         serializeAs(to_string(i), *columns[i]);
     }
 
+    // Summaries are only written if there is one for every column
+    md.hasSummaries = columnSummaries.size() == columns.size()
+        && sparseColumnSummaries.size() == sparseColumns.size();
+
+    if (md.hasSummaries) {
+        auto summarySerializer = serializer.newStructure("zm");
+        for (size_t i = 0;  i < columnSummaries.size();  ++i) {
+            columnSummaries[i].serialize
+                (*summarySerializer->newStructure(to_string(i)));
+        }
+        summarySerializer->commit();
+    }
+
+    // Sparse columns are written by number, as their names aren't
+    // necessarily valid entry names.  The names go in the metadata.
     if (!sparseColumns.empty()) {
         auto sparseSerializer = serializer.newStructure("sp");
+        std::shared_ptr<StructuredSerializer> sparseSummarySerializer;
+        if (md.hasSummaries)
+            sparseSummarySerializer = serializer.newStructure("spzm");
+
         for (auto & c: sparseColumns) {
-            c.second->serialize(*sparseSerializer->newStructure(c.first.toUtf8String()));
+            std::string name = to_string(md.sparseColumns.size());
+            c.second->serialize(*sparseSerializer->newStructure(name));
+            if (sparseSummarySerializer) {
+                sparseColumnSummaries.at(c.first).serialize
+                    (*sparseSummarySerializer->newStructure(name));
+            }
+            md.sparseColumns.push_back(c.first);
         }
     }
     serializeAs("rn", *rowNames);
     serializeAs("ts", *timestamps);
+
+    serializer.newObject("md.json", md);
 }
 
 
@@ -235,6 +352,17 @@ freeze(MappedSerializer & serializer,
     result.columns.resize(columns.size());
     result.sparseColumns.reserve(sparseColumns.size());
 
+    // Summaries first, as freezing consumes the values
+    result.columnSummaries.reserve(columns.size());
+    for (auto & c: columns) {
+        result.columnSummaries.emplace_back
+            (FrozenColumnSummary::summarize(c, serializer, params));
+    }
+    for (auto & c: sparseColumns) {
+        result.sparseColumnSummaries.emplace
+            (c.first, FrozenColumnSummary::summarize(c.second, serializer, params));
+    }
+
     for (unsigned i = 0;  i < columns.size();  ++i)
         result.columns[i] = columns[i].freeze(serializer, params);
     for (auto & c: sparseColumns)
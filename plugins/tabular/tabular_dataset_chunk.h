@@ -9,6 +9,7 @@
 
 #include <unordered_map>
 #include "frozen_column.h"
+#include "frozen_column_summary.h"
 #include "mldb/types/path.h"
 #include "mldb/types/date.h"
 #include "tabular_dataset_column.h"
@@ -38,6 +39,11 @@ struct TabularDatasetChunk {
     {
     }
 
+    /** Reconstitute a chunk that was written with serialize(), mapping
+        its columns directly from the reconstituter.
+    */
+    TabularDatasetChunk(StructuredReconstituter & reconstituter);
+
     TabularDatasetChunk(TabularDatasetChunk && other) noexcept
     {
         swap(other);
@@ -53,6 +59,8 @@ struct TabularDatasetChunk {
     {
         columns.swap(other.columns);
         sparseColumns.swap(other.sparseColumns);
+        columnSummaries.swap(other.columnSummaries);
+        sparseColumnSummaries.swap(other.sparseColumnSummaries);
         rowNames.swap(other.rowNames);
         std::swap(timestamps, other.timestamps);
     }
@@ -81,6 +89,12 @@ struct TabularDatasetChunk {
         return *columns.at(columnIndex);
     }
 
+    /** Return the summary of the values of the given column in this
+        chunk, or nullptr if there is none.
+    */
+    const FrozenColumnSummary *
+    maybeGetColumnSummary(size_t columnIndex, const Path & columnName) const;
+
     /// Get the row with the given index
     std::vector<std::tuple<ColumnPath, CellValue, Date> >
     getRow(size_t index, const std::vector<Path> & fixedColumnNames) const;
@@ -116,6 +130,11 @@ struct TabularDatasetChunk {
 private:
     std::vector<std::shared_ptr<FrozenColumn> > columns;
     std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher> sparseColumns;
+
+    /// Zone maps and bloom filters for the columns; these may be empty
+    /// if the chunk wasn't summarized
+    std::vector<FrozenColumnSummary> columnSummaries;
+    std::unordered_map<Path, FrozenColumnSummary, PathNewHasher> sparseColumnSummaries;
     std::shared_ptr<FrozenColumn> rowNames;
     std::shared_ptr<FrozenColumn> timestamps;
 
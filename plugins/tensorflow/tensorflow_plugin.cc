@@ -727,7 +727,44 @@ struct TensorflowGraphBase: public Function {
         shared_ptr<spdlog::logger> logger;
         BoundSqlExpression boundInputs, boundOutputs;
 
+        /// Names of the graph layers whose outputs are read
+        std::vector<std::string> getOutputLayers() const
+        {
+            vector<std::string> outputLayers;
+            for (const auto & l: graphScope.outputLayers) {
+                outputLayers.emplace_back(l.rawString());
+            }
+            return outputLayers;
+        }
+
         ExpressionValue apply(const ExpressionValue & inputData) const
+        {
+            return applyRow(inputData, getOutputLayers());
+        }
+
+        /** Apply over a batch of rows.  Each row needs its own run of the
+            graph, as the graph's inputs are not necessarily batchable,
+            but the setup is shared and the runs are done in parallel
+            (a session can run concurrently from multiple threads).
+        */
+        std::vector<ExpressionValue>
+        applyBatch(const std::vector<ExpressionValue> & inputs) const
+        {
+            vector<std::string> outputLayers = getOutputLayers();
+            std::vector<ExpressionValue> result(inputs.size());
+
+            auto doRow = [&] (size_t i)
+                {
+                    result[i] = applyRow(inputs[i], outputLayers);
+                };
+
+            parallelMap(0, inputs.size(), doRow);
+
+            return result;
+        }
+
+        ExpressionValue applyRow(const ExpressionValue & inputData,
+                                 const std::vector<std::string> & outputLayers) const
         {
             ExpressionValue result;
 
@@ -763,11 +800,6 @@ struct TensorflowGraphBase: public Function {
                 }
             }
 
-            vector<std::string> outputLayers;
-            for (const auto & l: graphScope.outputLayers) {
-                outputLayers.emplace_back(l.rawString());
-            }
-
             vector<Tensor> outputs;
 
             auto doRun = [&] (int i)
@@ -1471,6 +1503,14 @@ struct TensorflowGraphBase: public Function {
             .apply(context);
     }
 
+    virtual std::vector<ExpressionValue>
+    applyBatch(const FunctionApplier & applier,
+               const std::vector<ExpressionValue> & inputs) const override
+    {
+        return static_cast<const Applier &>(applier)
+            .applyBatch(inputs);
+    }
+
     virtual FunctionInfo
     getFunctionInfo() const override
     {
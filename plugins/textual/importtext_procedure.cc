@@ -12,6 +12,7 @@
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
 #include "mldb/utils/for_each_line.h"
+#include "mldb/utils/csv_scan.h"
 #include "mldb/core/mldb_engine.h"
 #include "mldb/base/per_thread_accumulator.h"
 #include "mldb/sql/sql_expression.h"
@@ -317,7 +318,120 @@ parseFixedWidthCsvRow(const char * & line,
             }
         };
 
-    while (colNum < numColumns) {
+    // Fast path: find the field boundaries 64 bytes at a time, and only
+    // look at the characters of each field when it needs to be unescaped.
+    // Anything unusual about the quoting (quotes in the middle of a field,
+    // garbage after a closing quote, an unclosed quote) sends us back to
+    // the character at a time parser below, which knows how to deal with
+    // (or report) it.
+    bool parsed = false;
+
+    if (!isTextLine) {
+        const char * rowStart = line;
+        CsvFieldScanner scanner(line, lineEnd, separator,
+                                hasQuoteChar ? (unsigned char)quote : -1);
+        parsed = true;
+
+        while (colNum < numColumns) {
+            if (line == lineEnd) {
+                // Empty column at the end
+                ++colNum;
+                break;
+            }
+
+            const char * start = line;
+            bool nonAscii, hasQuote;
+            const char * fieldEnd = scanner.fieldEnd(start, nonAscii, hasQuote);
+            line = fieldEnd == lineEnd ? lineEnd : fieldEnd + 1;
+            size_t len = fieldEnd - start;
+
+            if (len == 0) {
+                // null field
+                ++colNum;
+                continue;
+            }
+
+            const char c = *start;
+
+            if (hasQuote) {
+                // Only fields that are entirely quoted, with doubled quotes
+                // inside, are handled here
+                const char * q = start;
+                if (processExcelFormulas && c == '=' && len > 1)
+                    ++q;
+                if (*q != quote || fieldEnd - q < 2 || fieldEnd[-1] != quote) {
+                    parsed = false;
+                    break;
+                }
+
+                const char * innerStart = q + 1;
+                const char * innerEnd = fieldEnd - 1;
+                const char * firstQuote
+                    = (const char *)memchr(innerStart, quote,
+                                           innerEnd - innerStart);
+
+                if (!firstQuote) {
+                    values[colNum] = finishString(innerStart,
+                                                  innerEnd - innerStart,
+                                                  nonAscii);
+                    ++colNum;
+                    continue;
+                }
+
+                PossiblyDynamicBuffer<char> unescaped(innerEnd - innerStart);
+                char * s = unescaped.data();
+                size_t slen = firstQuote - innerStart;
+                std::copy(innerStart, firstQuote, s);
+
+                for (const char * p = firstQuote;  p < innerEnd;  ++p) {
+                    if (*p == quote) {
+                        if (p + 1 == innerEnd || p[1] != quote) {
+                            // quote that isn't doubled
+                            parsed = false;
+                            break;
+                        }
+                        ++p;
+                    }
+                    s[slen++] = *p;
+                }
+
+                if (!parsed)
+                    break;
+
+                values[colNum] = finishString(s, slen, nonAscii);
+                ++colNum;
+            }
+            else if (isdigit(c) || c == '-') {
+                // Same as below; integers that can't lose precision are
+                // parsed directly
+                bool isInt = len <= 18;
+                uint64_t num = isdigit(c) ? c - '0' : 0;
+                for (size_t i = 1;  isInt && i < len;  ++i) {
+                    if (!isdigit(start[i]))
+                        isInt = false;
+                    else num = 10 * num + (start[i] - '0');
+                }
+
+                if (isInt && c == '-')
+                    values[colNum++] = (int64_t)-num;
+                else if (isInt)
+                    values[colNum++] = num;
+                else values[colNum++] = finishString(start, len, nonAscii);
+            }
+            else {
+                values[colNum++] = finishString(start, len, nonAscii);
+            }
+        }
+
+        if (!parsed) {
+            line = rowStart;
+            colNum = 0;
+            for (size_t i = 0;  i < numColumns;  ++i)
+                values[i] = CellValue();
+        }
+    }
+
+    while (!parsed && colNum < numColumns) {
 
         ExcAssert(line <= lineEnd);
 
@@ -31,6 +31,7 @@
 #include "mldb/engine/sensor_collection.h"
 #include "mldb/engine/procedure_run_collection.h"
 #include "mldb/engine/dataset_scope.h"
+#include "mldb/engine/query_spill.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/engine/analytics.h"
@@ -222,7 +223,13 @@ initRoutes()
                                      false),
             HybridParamDefault<bool>("sortColumns",
                                      "Do we sort the column names",
-                                     false));
+                                     false),
+            HybridParamDefault<ssize_t>("memoryBudget",
+                                        "Bytes of rows or groups that the "
+                                        "query may hold in memory before "
+                                        "spilling to disk (0 for the "
+                                        "server default)",
+                                        0));
 
         addRouteAsync(
             versionNode, "/redirect/get", {"POST"}, "Redirect POST as GET with body. "
@@ -264,19 +271,29 @@ runHttpQuery(const Utf8String& query,
              bool createHeaders,
              bool rowNames,
              bool rowHashes,
-             bool sortColumns) const
+             bool sortColumns,
+             ssize_t memoryBudget) const
 {
+    if (memoryBudget < 0)
+        throw AnnotatedException(400, "memoryBudget must not be negative");
+    QueryMemoryBudgetScope budgetScope(memoryBudget);
+
     auto stm = SelectStatement::parse(query.rawString());
     SqlExpressionMldbScope mldbContext(this);
 
-    auto runQuery = [&] ()
+    auto runQuery = [&] (std::function<bool (Path &, ExpressionValue &)> & onRow,
+                         const std::function<void (const std::shared_ptr<ExpressionValueInfo> &)> & onInfo)
         {
-            return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+            // The rows are streamed in order, so only one thread at a
+            // time may produce them
+            return queryFromStatement(onRow, stm, mldbContext,
+                                      nullptr /*params*/, nullptr /*onProgress*/,
+                                      false /*processInParallel*/, onInfo);
         };
 
-    MLDB::runHttpQuery(runQuery,
-                       connection, format, createHeaders,
-                       rowNames, rowHashes, sortColumns);
+    MLDB::runHttpQueryIncremental(runQuery,
+                                  connection, format, createHeaders,
+                                  rowNames, rowHashes, sortColumns, logger);
 }
 
 void
@@ -123,7 +123,8 @@ struct MldbServer: public MldbEngine, public ServicePeer, public EventRecorder {
                       bool createHeaders,
                       bool rowNames,
                       bool rowHashes,
-                      bool sortColumns) const;
+                      bool sortColumns,
+                      ssize_t memoryBudget) const;
 
     /** Redirect POST request as a GET with body.  
         This is for client that do not support GET with body.
@@ -13,6 +13,7 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/base/optimized_path.h"
 #include <array>
+#include <cmath>
 #include <unordered_set>
 
 using namespace std;
@@ -856,6 +857,352 @@ struct DistinctAccum {
 
 static RegisterAggregatorT<DistinctAccum> registerDistinct("count_distinct");
 
+/** Approximate count of distinct values using HyperLogLog, with the
+    improvements of HyperLogLog++ (64 bit hashes, and an exact sparse
+    representation for small cardinalities).  Memory is bounded at
+    NUM_REGISTERS bytes per group, and the standard error of the estimate
+    is about 1.04 / sqrt(NUM_REGISTERS), or 0.8%.
+*/
+struct HyperLogLogAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+
+    /// Number of bits of the hash used to choose a register
+    static constexpr int PRECISION = 14;
+    static constexpr size_t NUM_REGISTERS = 1 << PRECISION;
+
+    /// Number of distinct hashes kept exactly before we switch to registers
+    static constexpr size_t MAX_SPARSE = NUM_REGISTERS / 16;
+
+    HyperLogLogAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        insert(val.getAtom().hash().hash());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    void insert(uint64_t hash)
+    {
+        if (registers.empty()) {
+            sparse.insert(hash);
+            if (sparse.size() > MAX_SPARSE)
+                toDense();
+        }
+        else insertDense(hash);
+    }
+
+    void insertDense(uint64_t hash)
+    {
+        size_t index = hash >> (64 - PRECISION);
+        // Position of the first set bit of the rest of the hash; the
+        // sentinel bit stops it going past the end
+        uint64_t rest = (hash << PRECISION) | (1ULL << (PRECISION - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        registers[index] = std::max(registers[index], rank);
+    }
+
+    void toDense()
+    {
+        registers.resize(NUM_REGISTERS, 0);
+        for (uint64_t hash: sparse)
+            insertDense(hash);
+        sparse.clear();
+    }
+
+    uint64_t estimate() const
+    {
+        if (registers.empty())
+            return sparse.size();
+
+        constexpr double m = NUM_REGISTERS;
+        constexpr double alpha = 0.7213 / (1.0 + 1.079 / m);
+
+        double sum = 0.0;
+        size_t zeros = 0;
+        for (uint8_t r: registers) {
+            sum += std::ldexp(1.0, -r);
+            zeros += r == 0;
+        }
+
+        // Linear counting is more accurate until about 3m distinct values,
+        // where the bias of the raw estimate has become smaller than the
+        // error of linear counting.  This replaces the empirical bias
+        // correction of HyperLogLog++.
+        if (zeros > 0) {
+            double linear = m * std::log(m / zeros);
+            if (linear <= 3 * m)
+                return std::llround(linear);
+        }
+
+        return std::llround(alpha * m * m / sum);
+    }
+
+    ExpressionValue extract()
+    {
+        return ExpressionValue(estimate(), ts);
+    }
+
+    void merge(HyperLogLogAccum* src)
+    {
+        ts.setMax(src->ts);
+
+        if (!src->registers.empty() && registers.empty()) {
+            std::swap(registers, src->registers);
+            std::swap(sparse, src->sparse);
+        }
+
+        if (registers.empty()) {
+            // Both sparse
+            sparse.insert(src->sparse.begin(), src->sparse.end());
+            if (sparse.size() > MAX_SPARSE)
+                toDense();
+        }
+        else if (src->registers.empty()) {
+            for (uint64_t hash: src->sparse)
+                insertDense(hash);
+        }
+        else {
+            for (size_t i = 0;  i < NUM_REGISTERS;  ++i)
+                registers[i] = std::max(registers[i], src->registers[i]);
+        }
+    }
+
+    std::unordered_set<uint64_t> sparse;  ///< Exact hashes, until too many
+    std::vector<uint8_t> registers;       ///< Registers, once in dense mode
+    Date ts;
+};
+
+static RegisterAggregatorT<HyperLogLogAccum>
+registerApproxDistinct("approx_count_distinct");
+
+/** Approximate quantiles using a merging t-digest (Dunning and Ertl).  The
+    values are summarized by at most about COMPRESSION weighted centroids,
+    which are small near the extremes so that tail quantiles (like the
+    99th percentile of a latency) stay accurate.  Digests merge by
+    combining their centroids, so memory is bounded whatever the number
+    of rows.
+*/
+struct TDigestAccum {
+    static constexpr int nargs = 2;
+    static constexpr int maxArgs = nargs;
+
+    static constexpr double COMPRESSION = 200;
+
+    /// Number of values buffered before they are merged into the digest
+    static constexpr size_t BUFFER_SIZE = 5 * COMPRESSION;
+
+    struct Centroid {
+        double mean;
+        double weight;
+
+        bool operator < (const Centroid & other) const
+        {
+            return mean < other.mean;
+        }
+    };
+
+    TDigestAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<Float64ValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 2);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        setQuantile(args[1]);
+        add(val.toDouble(), 1.0);
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    void setQuantile(const ExpressionValue & arg)
+    {
+        if (quantile >= 0)
+            return;
+        double q = arg.empty() ? -1 : arg.toDouble();
+        if (!(q >= 0.0 && q <= 1.0)) {
+            throw AnnotatedException(400, "approx_quantile requires a "
+                                     "quantile between 0 and 1");
+        }
+        quantile = q;
+    }
+
+    void add(double value, double weight)
+    {
+        if (std::isnan(value))
+            return;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        buffer.push_back({value, weight});
+        if (buffer.size() >= BUFFER_SIZE)
+            compress();
+    }
+
+    // Scale function k1 and its inverse: centroids can cover one unit
+    // of k, which gives small centroids near q = 0 and q = 1
+    static double k(double q)
+    {
+        return COMPRESSION / (2 * M_PI) * std::asin(2 * q - 1);
+    }
+
+    static double qOfK(double k)
+    {
+        if (k >= COMPRESSION / 4)
+            return 1.0;
+        return (std::sin(k * 2 * M_PI / COMPRESSION) + 1) / 2;
+    }
+
+    void compress()
+    {
+        if (buffer.empty())
+            return;
+
+        buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+        std::sort(buffer.begin(), buffer.end());
+
+        double total = 0;
+        for (auto & c: buffer)
+            total += c.weight;
+
+        centroids.clear();
+        Centroid current = buffer[0];
+        double weightBefore = 0;
+        double limit = total * qOfK(k(0) + 1);
+
+        for (size_t i = 1;  i < buffer.size();  ++i) {
+            const Centroid & next = buffer[i];
+            if (weightBefore + current.weight + next.weight <= limit) {
+                current.weight += next.weight;
+                current.mean += (next.mean - current.mean) * next.weight
+                    / current.weight;
+            }
+            else {
+                weightBefore += current.weight;
+                centroids.push_back(current);
+                limit = total * qOfK(k(weightBefore / total) + 1);
+                current = next;
+            }
+        }
+        centroids.push_back(current);
+        totalWeight = total;
+        buffer.clear();
+    }
+
+    double estimate(double q)
+    {
+        compress();
+
+        if (centroids.empty())
+            return std::nan("");
+        if (centroids.size() == 1)
+            return centroids[0].mean;
+
+        double target = q * totalWeight;
+
+        // Each centroid's mean is taken to be at the middle of its weight;
+        // interpolate linearly between them, and out to the min and max
+        const Centroid & first = centroids.front();
+        if (target <= first.weight / 2) {
+            return min + (first.mean - min) * target / (first.weight / 2);
+        }
+
+        double weightBefore = 0;
+        for (size_t i = 0;  i + 1 < centroids.size();  ++i) {
+            const Centroid & c = centroids[i];
+            const Centroid & n = centroids[i + 1];
+            double left = weightBefore + c.weight / 2;
+            double right = weightBefore + c.weight + n.weight / 2;
+            if (target <= right) {
+                return c.mean + (n.mean - c.mean) * (target - left)
+                    / (right - left);
+            }
+            weightBefore += c.weight;
+        }
+
+        const Centroid & last = centroids.back();
+        double remaining = totalWeight - target;
+        return max - (max - last.mean) * remaining / (last.weight / 2);
+    }
+
+    ExpressionValue extract()
+    {
+        return ExpressionValue(estimate(quantile < 0 ? 0.5 : quantile), ts);
+    }
+
+    void merge(TDigestAccum* src)
+    {
+        ts.setMax(src->ts);
+        if (quantile < 0)
+            quantile = src->quantile;
+        min = std::min(min, src->min);
+        max = std::max(max, src->max);
+        buffer.insert(buffer.end(), src->buffer.begin(), src->buffer.end());
+        buffer.insert(buffer.end(),
+                      src->centroids.begin(), src->centroids.end());
+        compress();
+    }
+
+    std::vector<Centroid> centroids;   ///< Merged centroids, sorted by mean
+    double totalWeight = 0;            ///< Weight of the centroids
+    std::vector<Centroid> buffer;      ///< Values not yet merged
+    double min = INFINITY;
+    double max = -INFINITY;
+    double quantile = -1;              ///< Quantile to extract
+    Date ts;
+};
+
+/// approx_median(x) is approx_quantile(x, 0.5)
+struct TDigestMedianAccum: public TDigestAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        quantile = 0.5;
+        add(val.toDouble(), 1.0);
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    void merge(TDigestMedianAccum* src)
+    {
+        TDigestAccum::merge(src);
+    }
+};
+
+static RegisterAggregatorT<TDigestAccum>
+registerApproxQuantile("approx_quantile");
+static RegisterAggregatorT<TDigestMedianAccum>
+registerApproxMedian("approx_median");
+
 struct LikelihoodRatioAccum {
     LikelihoodRatioAccum()
         : ts(Date::negativeInfinity())
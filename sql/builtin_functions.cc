@@ -3000,7 +3000,7 @@ BoundFunction clamp(const std::vector<BoundSqlExpression> & args)
                     return ExpressionValue(doAtom(args[0].getAtom()), std::max(args[0].getEffectiveTimestamp(), limitsTs));
                 }
                 else {
-                    std::vector<std::tuple<PathElement, ExpressionValue> > vals;
+                    StructValue vals;
                     auto exec = [&] (const PathElement & columnName,
                                      const ExpressionValue & val) {
 
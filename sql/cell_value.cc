@@ -25,6 +25,7 @@
 #include "mldb/utils/possibly_dynamic_buffer.h"
 #include "mldb/base/less.h"
 #include "mldb/base/hex_dump.h"
+#include "mldb/base/scratch_arena.h"
 
 
 using namespace std;
@@ -150,13 +151,9 @@ CellValue(const Path & path)
             type = ST_SHORT_PATH;
         }
         else {
-            // NOTE: once the malloc has succeeded, the rest is
+            // NOTE: once the allocation has succeeded, the rest is
             // noexcept.
-            void * mem = malloc(sizeof(StringRepr) + strLength);
-            if (!mem)
-                throw std::bad_alloc();
-
-            longString = new (mem) StringRepr;  // placement new noexcept
+            longString = newStringRepr(strLength);
             std::copy(p, p + strLength, longString->repr); // copy char noexcept
             type = ST_LONG_PATH;
         }
@@ -181,8 +178,7 @@ CellValue(const Path & path)
         type = ST_SHORT_PATH;
     }
     else {
-        void * mem = malloc(sizeof(StringRepr) + strLength);
-        longString = new (mem) StringRepr;
+        longString = newStringRepr(strLength);
         std::copy(u.rawData(), u.rawData() + strLength, longString->repr);
         type = ST_LONG_PATH;
     }
@@ -302,8 +298,7 @@ initString(const char * stringValue, size_t len, bool isUtf8, bool check)
         else {
             type = ST_ASCII_LONG_STRING;
         }
-        void * mem = malloc(sizeof(StringRepr) + strLength + 1);
-        longString = new (mem) StringRepr;
+        longString = newStringRepr(strLength + 1);
         std::copy(s, e, longString->repr);
         longString->repr[strLength + 1] = 0;
     }
@@ -319,8 +314,7 @@ initBlob(const char * data, size_t len)
         type = ST_SHORT_BLOB;
     }
     else {
-        void * mem = malloc(sizeof(StringRepr) + len);
-        longString = new (mem) StringRepr;
+        longString = newStringRepr(len);
         std::copy(data, data + len, longString->repr);
         type = ST_LONG_BLOB;
     }
@@ -334,8 +328,7 @@ CellValue(const CellValue & other)
         || other.type == ST_UTF8_LONG_STRING
         || other.type == ST_LONG_BLOB
         || other.type == ST_LONG_PATH) {
-        void * mem = malloc(sizeof(StringRepr) + other.strLength + 1);
-        longString = new (mem) StringRepr;
+        longString = newStringRepr(other.strLength + 1);
         std::copy(other.longString->repr, other.longString->repr + strLength,
                   longString->repr);
         longString->repr[strLength] = 0;
@@ -1297,13 +1290,33 @@ isExactDouble() const
     throw AnnotatedException(400, "unknown CellValue type");
 }
 
+CellValue::StringRepr *
+CellValue::
+newStringRepr(size_t length)
+{
+    size_t bytes = sizeof(StringRepr) + length;
+
+    // Strings made where a query's values are all short-lived come from
+    // its scratch arena, under a scope for values
+    if (void * mem = ScratchArena::tryAllocate(bytes))
+        return new (mem) StringRepr(true /* fromArena */);
+
+    void * mem = malloc(bytes);
+    if (!mem)
+        throw std::bad_alloc();
+    return new (mem) StringRepr(false /* fromArena */);
+}
+
 void
 CellValue::
 deleteString()
 {
     if (longString) {
+        bool fromArena = longString->fromArena;
         longString->~StringRepr();
-        free(longString);
+        if (fromArena)
+            ScratchArena::deallocate(longString);
+        else free(longString);
     }
     type = ST_EMPTY;
     longString = nullptr;
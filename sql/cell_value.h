@@ -475,6 +475,13 @@ private:
 
     void deleteString();
 
+    struct StringRepr;
+
+    /** Allocate the representation of a long string with room for the
+        given number of bytes.
+    */
+    static StringRepr * newStringRepr(size_t length);
+
     std::string printInterval() const;
 
     Utf8String trimmedExceptionString() const;
@@ -502,13 +509,14 @@ private:
     };
 
     struct StringRepr {
-        StringRepr() noexcept
-            : hash(0), ref(0)
+        StringRepr(bool fromArena) noexcept
+            : hash(0), ref(0), fromArena(fromArena)
         {
         }
 
         std::atomic<uint64_t> hash;
         std::atomic<int> ref;
+        bool fromArena;  ///< Allocated from a scratch arena, not malloc
         char repr[0];
     };
 
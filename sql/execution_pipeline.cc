@@ -386,13 +386,31 @@ bool
 ElementExecutor::
 takeAll(std::function<bool (std::shared_ptr<PipelineResults> &)> onResult)
 {
-    std::shared_ptr<PipelineResults> res;
-    while ((res = take()))
-        if (!onResult(res))
-            return false;
+    std::vector<std::shared_ptr<PipelineResults> > batch;
+    while (takeBatch(batch, PIPELINE_BATCH_SIZE)) {
+        for (auto & res: batch)
+            if (!onResult(res))
+                return false;
+        batch.clear();
+    }
     return true;
 }
 
+size_t
+ElementExecutor::
+takeBatch(std::vector<std::shared_ptr<PipelineResults> > & output,
+          size_t maxRows)
+{
+    size_t n = 0;
+    for (;  n < maxRows;  ++n) {
+        std::shared_ptr<PipelineResults> res = take();
+        if (!res)
+            break;
+        output.emplace_back(std::move(res));
+    }
+    return n;
+}
+
 /*****************************************************************************/
 /* PIPELINE ELEMENT                                                          */
 /*****************************************************************************/
@@ -217,6 +217,10 @@ private:
 /* ELEMENT EXECUTOR                                                          */
 /*****************************************************************************/
 
+/// Number of rows that executors which evaluate expressions take from
+/// their source and evaluate at once
+static constexpr size_t PIPELINE_BATCH_SIZE = 1024;
+
 struct ElementExecutor {
 
     virtual ~ElementExecutor()
@@ -226,6 +230,14 @@ struct ElementExecutor {
     /** Take one element from the pipeline. */
     virtual std::shared_ptr<PipelineResults> take() = 0;
 
+    /** Take up to maxRows elements from the pipeline, appending them to
+        output.  Returns the number of elements taken; zero means that the
+        pipeline is finished.  It may return fewer than maxRows before
+        the end.  The default implementation calls take() repeatedly.
+    */
+    virtual size_t takeBatch(std::vector<std::shared_ptr<PipelineResults> > & output,
+                             size_t maxRows);
+
     /** Take all elements from the pipeline.  inParallel describes whether
         the function can be called from multiple threads at once.
     */
@@ -18,6 +18,7 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/base/scope.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/scratch_arena.h"
 
 using namespace std;
 
@@ -1943,34 +1944,80 @@ bind() const
 /* FILTER WHERE EXECUTOR                                                     */
 /*****************************************************************************/
 
+static std::vector<const SqlRowScope *>
+getBatchRows(const std::vector<std::shared_ptr<PipelineResults> > & batch)
+{
+    std::vector<const SqlRowScope *> result;
+    result.reserve(batch.size());
+    for (auto & row: batch)
+        result.push_back(row.get());
+    return result;
+}
+
+bool
+FilterWhereElement::Executor::
+fillBatch()
+{
+    batch_.clear();
+    batchDone_ = 0;
+    if (!source_->takeBatch(batch_, PIPELINE_BATCH_SIZE))
+        return false;
+
+    // Temporaries of the batch come from the thread's scratch arena.  The
+    // results are only tested and then cleared with the batch, so the
+    // values built for them can come from it too.
+    ScratchArenaScope arenaScope(true /* forValues */);
+
+    batchWhere_.evaluate(parent_->where_, getBatchRows(batch_), GET_LATEST);
+
+    return true;
+}
+
 std::shared_ptr<PipelineResults>
 FilterWhereElement::Executor::
 take()
 {
-    while (true) {
-        std::shared_ptr<PipelineResults> input = source_->take();
+    std::vector<std::shared_ptr<PipelineResults> > result;
+    if (!takeBatch(result, 1))
+        return nullptr;
+    return std::move(result[0]);
+}
+
+size_t
+FilterWhereElement::Executor::
+takeBatch(std::vector<std::shared_ptr<PipelineResults> > & output,
+          size_t maxRows)
+{
+    size_t n = 0;
+
+    while (n < maxRows) {
+        if (batchDone_ == batch_.size() && !fillBatch())
+            break;
+
+        // The rows before one that failed are returned before its error
+        // is thrown
+        if (n > 0 && batchWhere_.failsAt(batchDone_))
+            break;
+
+        size_t i = batchDone_++;
 
-        // If nothing left to give, then return an empty vector
-        if (!input)
-            return input;
-                
-        // Evaluate the where expression...
-        ExpressionValue storage;
-        const ExpressionValue & pass = parent_->where_(*input, storage, GET_LATEST);
-                
         // If it doesn't evaluate to true, then on to the next row
-        if (!pass.isTrue())
+        if (!batchWhere_.take(i).isTrue())
             continue;
-
-        // Otherwise, we have our result
-        return input;
+        output.emplace_back(std::move(batch_[i]));
+        ++n;
     }
+
+    return n;
 }
 
 void
 FilterWhereElement::Executor::
 restart()
 {
+    batch_.clear();
+    batchWhere_.clear();
+    batchDone_ = 0;
     source_->restart();
 }
 
@@ -2044,30 +2091,66 @@ bind() const
 /* SELECT ELEMENT EXECUTOR                                                   */
 /*****************************************************************************/
 
+bool
+SelectElement::Executor::
+fillBatch()
+{
+    batch.clear();
+    batchDone = 0;
+    if (!source->takeBatch(batch, PIPELINE_BATCH_SIZE))
+        return false;
+
+    ScratchArenaScope arenaScope;
+
+    // Run the select expression in the context of each input
+    batchSelect.evaluate(parent->select_, getBatchRows(batch), GET_ALL);
+
+    return true;
+}
+
 std::shared_ptr<PipelineResults>
 SelectElement::Executor::
 take()
 {
-    while (true) {
-        std::shared_ptr<PipelineResults> input = source->take();
+    std::vector<std::shared_ptr<PipelineResults> > result;
+    if (!takeBatch(result, 1))
+        return nullptr;
+    return std::move(result[0]);
+}
 
-        // If nothing left to give, then return an empty vector
-        if (!input)
-            return input;
+size_t
+SelectElement::Executor::
+takeBatch(std::vector<std::shared_ptr<PipelineResults> > & output,
+          size_t maxRows)
+{
+    size_t n = 0;
 
-        // Run the select expression in this input's context
-        ExpressionValue selected = parent->select_(*input, GET_ALL);
+    while (n < maxRows) {
+        if (batchDone == batch.size() && !fillBatch())
+            break;
 
-        input->values.emplace_back(std::move(selected));
+        // The rows before one that failed are returned before its error
+        // is thrown
+        if (n > 0 && batchSelect.failsAt(batchDone))
+            break;
 
-        return input;
+        size_t i = batchDone++;
+        auto & input = batch[i];
+        input->values.emplace_back(batchSelect.take(i));
+        output.emplace_back(std::move(input));
+        ++n;
     }
+
+    return n;
 }
 
 void
 SelectElement::Executor::
 restart()
 {
+    batch.clear();
+    batchSelect.clear();
+    batchDone = 0;
     source->restart();
 }
 
@@ -561,14 +561,33 @@ struct FilterWhereElement: public PipelineElement {
 
     struct Bound;
 
+    /** The executor takes rows from its source a batch at a time, and
+        evaluates the where expression over the whole batch at once.  If
+        a row of the batch fails, the rows before it are returned before
+        its error is thrown.
+    */
     struct Executor: public ElementExecutor {
 
         const Bound * parent_;
         std::shared_ptr<ElementExecutor> source_;
         PipelineExpressionScope * context_;
 
+        /// Rows taken from the source that haven't been returned yet
+        std::vector<std::shared_ptr<PipelineResults> > batch_;
+
+        /// Value of the where expression for each row of the batch
+        ExpressionBatch batchWhere_;
+
+        /// Number of rows of the batch that have been dealt with
+        size_t batchDone_ = 0;
+
+        bool fillBatch();
+
         virtual std::shared_ptr<PipelineResults> take();
 
+        virtual size_t takeBatch(std::vector<std::shared_ptr<PipelineResults> > & output,
+                                 size_t maxRows);
+
         virtual void restart();
     };
 
@@ -617,12 +636,31 @@ struct SelectElement: public PipelineElement {
 
     struct Bound;
 
+    /** The executor takes rows from its source a batch at a time, and
+        evaluates the select expression over the whole batch at once.  If
+        a row of the batch fails, the rows before it are returned before
+        its error is thrown.
+    */
     struct Executor: public ElementExecutor {
         const Bound * parent;
         std::shared_ptr<ElementExecutor> source;
 
+        /// Rows taken from the source that haven't been returned yet
+        std::vector<std::shared_ptr<PipelineResults> > batch;
+
+        /// Value of the select expression for each row of the batch
+        ExpressionBatch batchSelect;
+
+        /// Number of rows of the batch that have been returned
+        size_t batchDone = 0;
+
+        bool fillBatch();
+
         virtual std::shared_ptr<PipelineResults> take();
 
+        virtual size_t takeBatch(std::vector<std::shared_ptr<PipelineResults> > & output,
+                                 size_t maxRows);
+
         virtual void restart();
     };
 
@@ -23,6 +23,7 @@
 #include "mldb/base/less.h"
 #include "mldb/utils/lightweight_hash.h"
 #include "mldb/utils/compact_vector.h"
+#include "mldb/base/scratch_arena.h"
 #include "mldb/base/optimized_path.h"
 #include "mldb/ext/highwayhash.h"
 
@@ -1533,7 +1534,7 @@ struct ExpressionValue::Superposition {
 
 
 static_assert(sizeof(CellValue) <= 24, "CellValue is too big to fit");
-static_assert(sizeof(ExpressionValue::Structured) <= 24, "Structured is too big to fit");
+static_assert(sizeof(ExpressionValue::Structured) <= 32, "Structured is too big to fit");
 
 ExpressionValue::
 ExpressionValue()
@@ -1994,16 +1995,32 @@ initEmbedding(std::vector<T> values,
               Date ts,
               DimsVector shape)
 {
-    // This avoids needing to reallocate... it essentially allows us to create
-    // a shared_ptr that owns the storage of a vector
-    auto movedVals = std::make_shared<std::vector<T> >(std::move(values));
-    std::shared_ptr<T> vals(movedVals, movedVals->data());
-    std::shared_ptr<Embedding> content(new Embedding());
+    size_t n = values.size();
+    std::shared_ptr<T> vals;
+    if (ScratchArena::currentForValues()
+        && n * sizeof(T) <= ScratchArena::MAX_ALLOCATION) {
+        // Short-lived values are moved into the query's scratch arena, so
+        // that the elements live alongside the rest of the row
+        typedef std::vector<T, ScratchValueAllocator<T> > ScratchVector;
+        auto scratchVals = std::allocate_shared<ScratchVector>
+            (ScratchAllocator<ScratchVector>(),
+             std::make_move_iterator(values.begin()),
+             std::make_move_iterator(values.end()));
+        vals = std::shared_ptr<T>(scratchVals, scratchVals->data());
+    }
+    else {
+        // This avoids needing to reallocate... it essentially allows us to
+        // create a shared_ptr that owns the storage of a vector
+        auto movedVals = std::allocate_shared<std::vector<T> >
+            (ScratchAllocator<std::vector<T> >(), std::move(values));
+        vals = std::shared_ptr<T>(movedVals, movedVals->data());
+    }
+    auto content = std::allocate_shared<Embedding>(ScratchAllocator<Embedding>());
     content->data_ = std::move(vals);
     content->storageType_ = GetStorageType<T>::val;
     content->dims_ = std::move(shape);
     if (content->dims_.empty())
-        content->dims_ = { movedVals->size() };
+        content->dims_ = { n };
 
     new (storage_) std::shared_ptr<const Embedding>(std::move(content));
     type_ = Type::EMBEDDING;
@@ -2142,7 +2159,8 @@ embedding(Date ts,
           DimsVector dims,
           std::shared_ptr<const EmbeddingMetadata> md)
 {
-    auto embeddingData = std::make_shared<Embedding>();
+    auto embeddingData
+        = std::allocate_shared<Embedding>(ScratchAllocator<Embedding>());
     embeddingData->data_ = std::move(data);
     embeddingData->storageType_ = storageType;
     embeddingData->dims_ = std::move(dims);
@@ -4320,7 +4338,9 @@ initStructured(Structured value, bool needsSorting, bool hasDuplicates) noexcept
         }
     }
 
-    initStructured(std::make_shared<Structured>(std::move(value)));
+    // Short-lived values come from the query's scratch arena, if any
+    initStructured(std::allocate_shared<Structured>
+                   (ScratchAllocator<Structured>(), std::move(value)));
 }
 
 void
@@ -15,6 +15,7 @@
 #include "mldb/arch/demangle.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/utils/compact_vector.h"
+#include "mldb/base/scratch_arena.h"
 #include "cell_value.h"
 #include <cstdint>
 #include <functional>
@@ -42,8 +43,12 @@ struct EmbeddingValueInfo;
 /** A row in an expression value is a set of (key, atom, timestamp) pairs. */
 typedef std::vector<std::tuple<Path, CellValue, Date> > RowValue;
 
-/** A struct in an expression value is a set of (key, value) pairs. */
-typedef std::vector<std::tuple<PathElement, ExpressionValue> > StructValue;
+/** A struct in an expression value is a set of (key, value) pairs.  Its
+    elements come from the query's scratch arena under a scope for values.
+*/
+typedef std::vector<std::tuple<PathElement, ExpressionValue>,
+                    ScratchValueAllocator<std::tuple<PathElement, ExpressionValue> > >
+StructValue;
 
 /** Return the ValueInfo that corresponds to the given
     ValueDescription.
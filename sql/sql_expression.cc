@@ -171,6 +171,43 @@ constantValue() const
     return this->exec(noRow, storage, GET_LATEST);
 }
 
+size_t
+BoundSqlExpression::
+execBatch(const SqlRowScope * const * rows,
+          size_t numRows,
+          ExpressionValue * output,
+          const VariableFilter & filter,
+          std::exception_ptr & error) const
+{
+    // Constant expressions have had their exec replaced by one that
+    // returns the constant, so they don't use the batch version
+    if (batchExec && !info->isConst())
+        return batchExec(rows, numRows, output, filter, error);
+
+    auto onRow = [&] (size_t i)
+        {
+            ExpressionValue storage;
+            const ExpressionValue & res = exec(*rows[i], storage, filter);
+            if (&res == &storage)
+                output[i] = std::move(storage);
+            else output[i] = res;
+        };
+
+    return forEachBatchRow(numRows, error, onRow);
+}
+
+void
+BoundSqlExpression::
+execBatch(const SqlRowScope * const * rows,
+          size_t numRows,
+          ExpressionValue * output,
+          const VariableFilter & filter) const
+{
+    std::exception_ptr error;
+    if (execBatch(rows, numRows, output, filter, error) < numRows)
+        std::rethrow_exception(error);
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
 
 BoundSqlExpressionDescription::
@@ -185,6 +222,57 @@ BoundSqlExpressionDescription()
 }
 
 
+/*****************************************************************************/
+/* EXPRESSION BATCH                                                          */
+/*****************************************************************************/
+
+void
+ExpressionBatch::
+evaluate(const BoundSqlExpression & expr,
+         std::vector<const SqlRowScope *> rows,
+         const VariableFilter & filter)
+{
+    this->expr = &expr;
+    this->filter = filter;
+    this->rows = std::move(rows);
+    values.clear();
+    values.resize(this->rows.size());
+    error = nullptr;
+    numEvaluated = expr.execBatch(this->rows.data(), this->rows.size(),
+                                  values.data(), filter, error);
+}
+
+ExpressionValue
+ExpressionBatch::
+take(size_t i)
+{
+    ExcAssertLess(i, rows.size());
+
+    if (i < numEvaluated)
+        return std::move(values[i]);
+
+    if (failsAt(i)) {
+        std::exception_ptr rowError = std::move(error);
+        error = nullptr;
+        std::rethrow_exception(rowError);
+    }
+
+    // After the row that failed; there is no value from the batch
+    return (*expr)(*rows[i], filter);
+}
+
+void
+ExpressionBatch::
+clear()
+{
+    expr = nullptr;
+    rows.clear();
+    values.clear();
+    numEvaluated = 0;
+    error = nullptr;
+}
+
+
 /*****************************************************************************/
 /* ROW EXPRESSION BINDING CONTEXT                                            */
 /*****************************************************************************/
@@ -3217,10 +3305,18 @@ bind(SqlBindingScope & context) const
                 return boundClauses[0](context, storage, filter);
             };
 
-        return BoundSqlExpression(exec, this, boundClauses[0].info,
+        BoundSqlExpression result(exec, this, boundClauses[0].info,
                                   std::move(decomposition));
+        result.batchExec = boundClauses[0].batchExec;
+        return result;
     }
 
+    // Only run the clauses a batch at a time if one of them can do
+    // better than running row by row
+    bool anyClauseBatches = false;
+    for (auto & c: boundClauses)
+        anyClauseBatches = anyClauseBatches || c.batchExec;
+
     std::vector<KnownColumn> outputColumns;
 
     bool hasUnknownColumns = false;
@@ -3333,6 +3429,13 @@ bind(SqlBindingScope & context) const
                     v.appendToRow(Path(), row);
                 }
 
+                merge(std::move(row), result);
+            }
+
+            /** Place the output of the clause, as a row, into the
+                result. */
+            void merge(StructValue row, StructValue & result) const
+            {
                 //cerr << "clause " << clauses[i]->surface
                 //     << " had result " << jsonEncodeStr(row) << endl;
 
@@ -3418,8 +3521,48 @@ bind(SqlBindingScope & context) const
                                                  ExpressionValue::NO_DUPLICATES);
             };
 
-        return BoundSqlExpression(exec, this, outputInfo,
+        BoundSqlExpression result(exec, this, outputInfo,
                                   std::move(decomposition));
+
+        if (anyClauseBatches) {
+            size_t numPrefixes = allPrefixes.size();
+            result.batchExec = [=] (const SqlRowScope * const * rows,
+                                    size_t numRows,
+                                    ExpressionValue * output,
+                                    const VariableFilter & filter,
+                                    std::exception_ptr & error)
+                {
+                    std::vector<StructValue> results(numRows);
+                    for (auto & r: results)
+                        r.resize(numPrefixes);
+
+                    // Once a clause fails on a row, the following rows
+                    // have no value and so the clauses after it don't
+                    // need to run on them
+                    std::vector<ExpressionValue> clauseValues(numRows);
+                    for (auto & c: instructions) {
+                        numRows = c.expr.execBatch(rows, numRows,
+                                                   clauseValues.data(),
+                                                   filter, error);
+                        for (size_t i = 0;  i < numRows;  ++i) {
+                            StructValue row;
+                            clauseValues[i].mergeToRowDestructive(row);
+                            c.merge(std::move(row), results[i]);
+                        }
+                    }
+
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        output[i] = ExpressionValue
+                            (std::move(results[i]),
+                             ExpressionValue::SORTED,
+                             ExpressionValue::NO_DUPLICATES);
+                    }
+
+                    return numRows;
+                };
+        }
+
+        return result;
     }
     else {
         // We don't know what our output columns are, so we don't bother
@@ -3446,8 +3589,34 @@ bind(SqlBindingScope & context) const
                 return storage = ExpressionValue(std::move(result));
             };
 
-        return BoundSqlExpression(exec, this, outputInfo,
+        BoundSqlExpression result(exec, this, outputInfo,
                                   std::move(decomposition));
+
+        if (anyClauseBatches) {
+            result.batchExec = [=] (const SqlRowScope * const * rows,
+                                    size_t numRows,
+                                    ExpressionValue * output,
+                                    const VariableFilter & filter,
+                                    std::exception_ptr & error)
+                {
+                    std::vector<StructValue> results(numRows);
+                    std::vector<ExpressionValue> clauseValues(numRows);
+                    for (auto & c: boundClauses) {
+                        numRows = c.execBatch(rows, numRows,
+                                              clauseValues.data(),
+                                              filter, error);
+                        for (size_t i = 0;  i < numRows;  ++i)
+                            clauseValues[i].mergeToRowDestructive(results[i]);
+                    }
+
+                    for (size_t i = 0;  i < numRows;  ++i)
+                        output[i] = ExpressionValue(std::move(results[i]));
+
+                    return numRows;
+                };
+        }
+
+        return result;
     }
 }
 
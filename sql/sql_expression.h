@@ -15,6 +15,7 @@
 #include "mldb/types/any.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/utils/progress.h"
+#include <exception>
 #include <memory>
 #include <set>
 
@@ -162,6 +163,24 @@ struct BoundSqlExpression {
                                                    ExpressionValue & storage,
                                                    const VariableFilter & filter)> ExecFunction;
 
+    /** Function type to execute the expression over a batch of rows at
+        once, writing one value per row into output.  This is optional;
+        expressions that provide it can evaluate their arguments a batch
+        at a time and run their operator over typed arrays rather than
+        dispatching once per row.
+
+        Returns the number of rows, from the start of the batch, that
+        have a value.  If it's less than numRows, evaluating the next
+        row threw and its exception has been put in error; the rows after
+        it may or may not have been evaluated.  This is the same as
+        execBatch().
+    */
+    typedef std::function<size_t (const SqlRowScope * const * rows,
+                                  size_t numRows,
+                                  ExpressionValue * output,
+                                  const VariableFilter & filter,
+                                  std::exception_ptr & error)> BatchExecFunction;
+
     BoundSqlExpression()
     {
     }
@@ -179,6 +198,7 @@ struct BoundSqlExpression {
     operator bool () const { return !!exec; };
 
     ExecFunction exec;
+    BatchExecFunction batchExec;
     std::shared_ptr<const SqlExpression> expr;
 
     /// What kind of value does this return?
@@ -208,6 +228,29 @@ struct BoundSqlExpression {
         return res;
     }
 
+    /** Execute the expression over a batch of rows, writing the value
+        for rows[i] into output[i].  Uses batchExec if the expression
+        provides it, and otherwise calls exec once per row.
+
+        Returns the number of rows from the start of the batch that have
+        a value.  If that's less than numRows, the exception thrown by
+        the first row without a value is put in error, so that the caller
+        can report it for that row without evaluating it again.
+    */
+    size_t execBatch(const SqlRowScope * const * rows,
+                     size_t numRows,
+                     ExpressionValue * output,
+                     const VariableFilter & filter,
+                     std::exception_ptr & error) const;
+
+    /** Execute the expression over a batch of rows, rethrowing the
+        exception of the first row that fails.
+    */
+    void execBatch(const SqlRowScope * const * rows,
+                   size_t numRows,
+                   ExpressionValue * output,
+                   const VariableFilter & filter) const;
+
     /** Independent clauses that need to run to be equivalent to calling
         exec; useful for code that needs to dig deeper (eg, can optimize
         by not running certain clauses).
@@ -229,6 +272,73 @@ struct BoundSqlExpression {
 
 DECLARE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
 
+/** Call fn(i) for each row i of a batch of numRows in order, stopping at
+    the first one that throws.  Returns the number of rows for which it
+    returned, and puts the exception (if any) into error.  This is how
+    batch implementations report the row that failed.
+*/
+template<typename Fn>
+size_t forEachBatchRow(size_t numRows, std::exception_ptr & error, Fn && fn)
+{
+    size_t i = 0;
+    try {
+        for (;  i < numRows;  ++i)
+            fn(i);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    return i;
+}
+
+
+/*****************************************************************************/
+/* EXPRESSION BATCH                                                          */
+/*****************************************************************************/
+
+/** Values of a bound expression over a batch of rows, which are evaluated
+    together with execBatch() and then taken one row at a time in order.
+
+    If the batch failed, the rows before the one that failed have their
+    values as usual.  Taking the row that failed rethrows its exception
+    without evaluating it again, and the rows after it are evaluated on
+    their own as they are taken.  The values and errors are thus the
+    same, in the same order, as when each row is evaluated separately,
+    and no row's value is evaluated twice.
+*/
+struct ExpressionBatch {
+    /** Evaluate expr over the given rows, which must stay valid until
+        they have all been taken.
+    */
+    void evaluate(const BoundSqlExpression & expr,
+                  std::vector<const SqlRowScope *> rows,
+                  const VariableFilter & filter);
+
+    /// Number of rows in the batch
+    size_t size() const
+    {
+        return rows.size();
+    }
+
+    /// Does taking row i throw?
+    bool failsAt(size_t i) const
+    {
+        return error && i == numEvaluated;
+    }
+
+    /// Take the value for row i.  Each row may only be taken once.
+    ExpressionValue take(size_t i);
+
+    void clear();
+
+private:
+    const BoundSqlExpression * expr = nullptr;
+    VariableFilter filter = GET_ALL;
+    std::vector<const SqlRowScope *> rows;
+    std::vector<ExpressionValue> values;
+    size_t numEvaluated = 0;      ///< Rows with a value in values
+    std::exception_ptr error;     ///< Error of row numEvaluated, if any
+};
+
 /*****************************************************************************/
 /* TABLE OPERATIONS                                                          */
 /*****************************************************************************/
@@ -341,6 +451,17 @@ struct BoundFunction {
                             std::vector<BoundSqlExpression>& boundArgs,
                             const SqlExpression * expr)> BindFunction;
 
+    /** Optional function to execute over a batch of rows at once.  args[i]
+        holds the evaluated arguments for row i (which may be moved from),
+        and the result for row i is written into output[i].  Returns the
+        number of rows with a result, putting the exception of the next
+        row into error, as for BoundSqlExpression::execBatch().
+    */
+    typedef std::function<size_t (std::vector<ExpressionValue> * args,
+                                  size_t numRows,
+                                  ExpressionValue * output,
+                                  std::exception_ptr & error)> BatchExec;
+
     BoundFunction()
         : filter(GET_LATEST)
     {
@@ -382,6 +503,9 @@ struct BoundFunction {
     /// If defined, overrides the default bindFunction call.
     BindFunction bindFunction;
 
+    /// If defined, used to execute the function over a batch of rows.
+    BatchExec batchExec;
+
     ExpressionValue operator () (const std::vector<ExpressionValue> & args,
                                  const SqlRowScope & context) const
     {
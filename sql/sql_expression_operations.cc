@@ -55,14 +55,113 @@ static Date calcTs(const ExpressionValue & v1,
                     v2.getEffectiveTimestamp());
 }
 
+/*****************************************************************************/
+/* BATCH KERNELS                                                             */
+/*****************************************************************************/
+
+/** Numbers on both sides of a binary operator over a batch of rows, as
+    typed arrays that the batch kernels can loop over.  Rows where either
+    side isn't a number that the kernel handles exactly are marked as not
+    numeric, and are evaluated one by one through the generic path.
+*/
+struct NumericBatch {
+
+    /** Extract the numbers from the given values.  If forComparison is
+        true, only numbers whose ordering and equality as doubles is the
+        same as that of the CellValues they come from are extracted.
+    */
+    NumericBatch(const ExpressionValue * lhsVals,
+                 const ExpressionValue * rhsVals,
+                 size_t numRows,
+                 bool forComparison)
+        : lhs(numRows), rhs(numRows), numeric(numRows), numNumeric(0)
+    {
+        for (size_t i = 0;  i < numRows;  ++i) {
+            numeric[i] = extract(lhsVals[i], lhs[i], forComparison)
+                && extract(rhsVals[i], rhs[i], forComparison);
+            numNumeric += numeric[i];
+        }
+    }
+
+    std::vector<double> lhs, rhs;
+    std::vector<unsigned char> numeric;
+    size_t numNumeric;
+
+private:
+    static bool extract(const ExpressionValue & val, double & d,
+                        bool forComparison)
+    {
+        if (!val.isAtom())
+            return false;
+        const CellValue & cell = val.getAtom();
+        if (!cell.isNumeric())
+            return false;
+        d = cell.toDouble();
+        if (!forComparison)
+            return true;
+
+        // Above 2^53, integers aren't exactly represented as doubles;
+        // NaN and signed zeros compare differently as CellValues.
+        static constexpr double MAX_EXACT = 9007199254740992.0;
+        return !std::isnan(d) && std::abs(d) < MAX_EXACT
+            && (cell.isInteger() || d != 0.0);
+    }
+};
+
+/** Evaluate a comparison over a batch of rows.  Where both sides are
+    numbers, the comparison runs over typed arrays; other rows use the
+    same ExpressionValue operator as the row-at-a-time path.  Returns
+    the number of rows evaluated, as for BoundSqlExpression::execBatch().
+*/
+template<typename NumericOp>
+size_t
+doComparisonBatch(const BoundSqlExpression & boundLhs,
+                  const BoundSqlExpression & boundRhs,
+                  bool (ExpressionValue::* op)(const ExpressionValue &) const,
+                  NumericOp numericOp,
+                  const SqlRowScope * const * rows,
+                  size_t numRows,
+                  ExpressionValue * output,
+                  std::exception_ptr & error)
+{
+    std::vector<ExpressionValue> lhs(numRows), rhs(numRows);
+    numRows = boundLhs.execBatch(rows, numRows, lhs.data(), GET_LATEST, error);
+    numRows = boundRhs.execBatch(rows, numRows, rhs.data(), GET_LATEST, error);
+
+    NumericBatch batch(lhs.data(), rhs.data(), numRows,
+                       true /* for comparison */);
+    std::vector<unsigned char> result(numRows);
+    if (batch.numNumeric > 0) {
+        const double * l = batch.lhs.data();
+        const double * r = batch.rhs.data();
+        for (size_t i = 0;  i < numRows;  ++i)
+            result[i] = numericOp(l[i], r[i]);
+    }
+
+    auto onRow = [&] (size_t i)
+        {
+            Date ts = calcTs(lhs[i], rhs[i]);
+            if (batch.numeric[i])
+                output[i] = ExpressionValue(bool(result[i]), ts);
+            else if (lhs[i].empty() || rhs[i].empty())
+                output[i] = ExpressionValue::null(ts);
+            else output[i] = ExpressionValue((lhs[i] .* op)(rhs[i]), ts);
+        };
+
+    return forEachBatchRow(numRows, error, onRow);
+}
+
+template<typename NumericOp>
 BoundSqlExpression
 doComparison(const SqlExpression * expr,
              const BoundSqlExpression & boundLhs,
              const BoundSqlExpression & boundRhs,
-             bool (ExpressionValue::* op)(const ExpressionValue &) const)
+             bool (ExpressionValue::* op)(const ExpressionValue &) const,
+             NumericOp numericOp)
 {
-    return {[=] (const SqlRowScope & row, ExpressionValue & storage,
-                 const VariableFilter & filter)
+    BoundSqlExpression result
+        {[=] (const SqlRowScope & row, ExpressionValue & storage,
+              const VariableFilter & filter)
             -> const ExpressionValue &
             {
                 ExpressionValue lstorage, rstorage;
@@ -77,6 +176,18 @@ doComparison(const SqlExpression * expr,
             },
             expr,
             std::make_shared<BooleanValueInfo>(boundLhs.info->isConst() && boundRhs.info->isConst())};
+
+    result.batchExec = [=] (const SqlRowScope * const * rows,
+                            size_t numRows,
+                            ExpressionValue * output,
+                            const VariableFilter & filter,
+                            std::exception_ptr & error)
+        {
+            return doComparisonBatch(boundLhs, boundRhs, op, numericOp,
+                                     rows, numRows, output, error);
+        };
+
+    return result;
 }
 
 BoundSqlExpression
@@ -88,27 +199,33 @@ bind(SqlBindingScope & scope) const
 
     if (op == "=" || op == "==") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator ==);
+                            &ExpressionValue::operator ==,
+                            std::equal_to<double>());
     }
     else if (op == "!=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator !=);
+                            &ExpressionValue::operator !=,
+                            std::not_equal_to<double>());
     }
     else if (op == ">") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator > );
+                            &ExpressionValue::operator >,
+                            std::greater<double>());
     }
     else if (op == "<") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator < );
+                            &ExpressionValue::operator <,
+                            std::less<double>());
     }
     else if (op == ">=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator >=);
+                            &ExpressionValue::operator >=,
+                            std::greater_equal<double>());
     }
     else if (op == "<=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator <=);
+                            &ExpressionValue::operator <=,
+                            std::less_equal<double>());
     }
     else throw AnnotatedException(400, "Unknown comparison op " + op);
 }
@@ -802,6 +919,51 @@ struct BinaryOpHelper {
         
         return lhsContext.applyLhs(rhsContext, lhs, rhs, storage);
     }
+
+    /** Apply the operator over a batch of rows.  Rows with numbers on
+        both sides go through the operator's kernel over typed arrays;
+        the others are applied one by one as in apply().
+    */
+    template<class LhsContext, class RhsContext>
+    static size_t
+    applyBatch(const LhsContext & lhsContext,
+               const RhsContext & rhsContext,
+               const SqlRowScope * const * rows,
+               size_t numRows,
+               ExpressionValue * output,
+               std::exception_ptr & error,
+               const VariableFilter & filter)
+    {
+        std::vector<ExpressionValue> lhs(numRows), rhs(numRows);
+        numRows = lhsContext.bound.execBatch(rows, numRows, lhs.data(),
+                                             filter, error);
+        numRows = rhsContext.bound.execBatch(rows, numRows, rhs.data(),
+                                             filter, error);
+
+        NumericBatch batch(lhs.data(), rhs.data(), numRows,
+                           false /* for comparison */);
+        std::vector<double> result(numRows);
+        bool useKernel = batch.numNumeric > 0
+            && Op::applyBatch(batch.lhs.data(), batch.rhs.data(),
+                              result.data(), numRows);
+
+        auto onRow = [&] (size_t i)
+            {
+                if (useKernel && batch.numeric[i]) {
+                    output[i] = ExpressionValue(CellValue(result[i]),
+                                                calcTs(lhs[i], rhs[i]));
+                    return;
+                }
+
+                const ExpressionValue & res
+                    = lhsContext.applyLhs(rhsContext, lhs[i], rhs[i],
+                                          output[i]);
+                if (&res != &output[i])
+                    output[i] = res;
+            };
+
+        return forEachBatchRow(numRows, error, onRow);
+    }
     
     template<class LhsContext, class RhsContext>
     static BoundSqlExpression
@@ -818,6 +980,14 @@ struct BinaryOpHelper {
                                 std::placeholders::_1,
                                 std::placeholders::_2,
                                 GET_LATEST);
+        result.batchExec = std::bind(applyBatch<LhsContext, RhsContext>,
+                                     lhsContext,
+                                     rhsContext,
+                                     std::placeholders::_1,
+                                     std::placeholders::_2,
+                                     std::placeholders::_3,
+                                     std::placeholders::_5,
+                                     GET_LATEST);
         result.expr = expr->shared_from_this();
         result.info = result.info->getConst(isConstant);
 
@@ -1189,6 +1359,14 @@ struct BinaryPlusOp {
     {
         return std::make_shared<AtomValueInfo>();
     }
+
+    static bool applyBatch(const double * l, const double * r,
+                           double * output, size_t n)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = l[i] + r[i];
+        return true;
+    }
 };
 
 struct BinaryMinusOp {
@@ -1206,6 +1384,14 @@ struct BinaryMinusOp {
     {
         return std::make_shared<AtomValueInfo>();
     }
+
+    static bool applyBatch(const double * l, const double * r,
+                           double * output, size_t n)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = l[i] - r[i];
+        return true;
+    }
 };
 
 struct BinaryMultiplicationOp {
@@ -1223,6 +1409,14 @@ struct BinaryMultiplicationOp {
     {
         return std::make_shared<AtomValueInfo>();
     }
+
+    static bool applyBatch(const double * l, const double * r,
+                           double * output, size_t n)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = l[i] * r[i];
+        return true;
+    }
 };
 
 struct BinaryDivisionOp {
@@ -1240,6 +1434,14 @@ struct BinaryDivisionOp {
     {
         return std::make_shared<AtomValueInfo>();
     }
+
+    static bool applyBatch(const double * l, const double * r,
+                           double * output, size_t n)
+    {
+        for (size_t i = 0;  i < n;  ++i)
+            output[i] = l[i] / r[i];
+        return true;
+    }
 };
 
 struct BinaryModulusOp {
@@ -1257,6 +1459,13 @@ struct BinaryModulusOp {
     {
         return std::make_shared<AtomValueInfo>();
     }
+
+    static bool applyBatch(const double * l, const double * r,
+                           double * output, size_t n)
+    {
+        // Integers have their own modulus, so there is no double kernel
+        return false;
+    }
 };
 
 BoundSqlExpression
@@ -1929,6 +2138,85 @@ BooleanOperatorExpression::
 {
 }
 
+/// Truth state of one side of AND or OR, ordered so that AND is the
+/// minimum and OR the maximum of the states of its two sides.
+enum BatchTruth: unsigned char {
+    BATCH_FALSE = 0,
+    BATCH_NULL = 1,
+    BATCH_TRUE = 2
+};
+
+/** Batch version of AND (isAnd is true) or OR.  The values of each side
+    are classified into truth states the same way as the row-at-a-time
+    version does, and then combined over typed arrays.
+*/
+static BoundSqlExpression::BatchExecFunction
+booleanBatch(const BoundSqlExpression & boundLhs,
+             const BoundSqlExpression & boundRhs,
+             bool isAnd)
+{
+    return [=] (const SqlRowScope * const * rows,
+                size_t numRows,
+                ExpressionValue * output,
+                const VariableFilter & filter,
+                std::exception_ptr & error)
+        {
+            std::vector<ExpressionValue> lhs(numRows), rhs(numRows);
+            numRows = boundLhs.execBatch(rows, numRows, lhs.data(), filter,
+                                         error);
+            numRows = boundRhs.execBatch(rows, numRows, rhs.data(), filter,
+                                         error);
+
+            // AND looks for false values, and OR for true ones; anything
+            // else that isn't null counts as the other one.
+            auto classify = [isAnd] (const ExpressionValue & val)
+                {
+                    if (isAnd ? val.isFalse() : val.isTrue())
+                        return isAnd ? BATCH_FALSE : BATCH_TRUE;
+                    if (val.empty())
+                        return BATCH_NULL;
+                    return isAnd ? BATCH_TRUE : BATCH_FALSE;
+                };
+
+            std::vector<unsigned char> l(numRows), r(numRows), res(numRows);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                l[i] = classify(lhs[i]);
+                r[i] = classify(rhs[i]);
+            }
+
+            if (isAnd) {
+                for (size_t i = 0;  i < numRows;  ++i)
+                    res[i] = std::min(l[i], r[i]);
+            }
+            else {
+                for (size_t i = 0;  i < numRows;  ++i)
+                    res[i] = std::max(l[i], r[i]);
+            }
+
+            for (size_t i = 0;  i < numRows;  ++i) {
+                Date lts = lhs[i].getEffectiveTimestamp();
+                Date rts = rhs[i].getEffectiveTimestamp();
+
+                // When the result comes from one side only, it takes its
+                // timestamp.  When both sides agree, a true result for
+                // AND (or any but a false one for OR) needs both of
+                // them and takes the latest; otherwise the earliest.
+                Date ts;
+                if (l[i] != r[i])
+                    ts = l[i] == res[i] ? lts : rts;
+                else if (isAnd ? res[i] == BATCH_TRUE : res[i] != BATCH_FALSE)
+                    ts = std::max(lts, rts);
+                else ts = std::min(lts, rts);
+
+                if (res[i] == BATCH_NULL)
+                    output[i] = ExpressionValue::null(ts);
+                else output[i] = ExpressionValue(res[i] == BATCH_TRUE, ts);
+            }
+
+            return numRows;
+        };
+}
+
 BoundSqlExpression
 BooleanOperatorExpression::
 bind(SqlBindingScope & scope) const
@@ -1977,7 +2265,8 @@ bind(SqlBindingScope & scope) const
 
         bool constant = (boundLhs.info->isConst() && boundRhs.info->isConst());
 
-        return {[=] (const SqlRowScope & row,
+        BoundSqlExpression result
+               {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
                 {
@@ -2010,6 +2299,8 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>(constant)};
+        result.batchExec = booleanBatch(boundLhs, boundRhs, true /* and */);
+        return result;
     }
     else if (op == "OR" && lhs) {
 
@@ -2026,7 +2317,8 @@ bind(SqlBindingScope & scope) const
 
         bool constant = (boundLhs.info->isConst() && boundRhs.info->isConst());
 
-        return {[=] (const SqlRowScope & row,
+        BoundSqlExpression result
+               {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter)
                 -> const ExpressionValue &
@@ -2062,6 +2354,8 @@ bind(SqlBindingScope & scope) const
                 },
                 this,
                 std::make_shared<BooleanValueInfo>(constant)};
+        result.batchExec = booleanBatch(boundLhs, boundRhs, false /* or */);
+        return result;
     }
     else if (op == "NOT" && !lhs) {
 
@@ -2361,9 +2655,10 @@ bindBuiltinFunction(SqlBindingScope & scope,
         };
     }
     else {
-        return {[=] (const SqlRowScope & row,
-                     ExpressionValue & storage,
-                     const VariableFilter & filter) -> const ExpressionValue &
+        BoundSqlExpression result
+            {[=] (const SqlRowScope & row,
+                  ExpressionValue & storage,
+                  const VariableFilter & filter) -> const ExpressionValue &
                 {
                     std::vector<ExpressionValue> evaluatedArgs;
                     evaluatedArgs.reserve(boundArgs.size());
@@ -2375,6 +2670,36 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 this,
                 fn.resultInfo
         };
+
+        if (fn.batchExec) {
+            // Evaluate each argument over the whole batch, then hand the
+            // batch to the function at once
+            result.batchExec = [=] (const SqlRowScope * const * rows,
+                                    size_t numRows,
+                                    ExpressionValue * output,
+                                    const VariableFilter & filter,
+                                    std::exception_ptr & error)
+                {
+                    std::vector<ExpressionValue> argValues(numRows);
+                    std::vector<std::vector<ExpressionValue> >
+                        evaluatedArgs(numRows);
+                    for (auto & a: evaluatedArgs)
+                        a.reserve(boundArgs.size());
+
+                    for (auto & a: boundArgs) {
+                        numRows = a.execBatch(rows, numRows, argValues.data(),
+                                              fn.filter, error);
+                        for (size_t i = 0;  i < numRows;  ++i)
+                            evaluatedArgs[i].emplace_back
+                                (std::move(argValues[i]));
+                    }
+
+                    return fn.batchExec(evaluatedArgs.data(), numRows, output,
+                                        error);
+                };
+        }
+
+        return result;
     }
 }
 
@@ -3862,6 +4187,29 @@ bind(SqlBindingScope & scope) const
         
         // This is a simple merge, so we take the decomposition unchanged
         BoundSqlExpression result(exec, this, info, exprBound.decomposition);
+
+        if (exprBound.batchExec) {
+            result.batchExec = [=] (const SqlRowScope * const * rows,
+                                    size_t numRows,
+                                    ExpressionValue * output,
+                                    const VariableFilter & filter,
+                                    std::exception_ptr & error)
+                {
+                    numRows = exprBound.execBatch(rows, numRows, output,
+                                                  filter, error);
+                    auto onRow = [&] (size_t i)
+                        {
+                            if (output[i].isAtom())
+                                throw AnnotatedException
+                                    (400, "Expression with AS * must return a row",
+                                     "valueReturned", output[i],
+                                     "ast", print(),
+                                     "surface", surface);
+                        };
+                    return forEachBatchRow(numRows, error, onRow);
+                };
+        }
+
         return result;
     }
 
@@ -3914,7 +4262,27 @@ bind(SqlBindingScope & scope) const
         auto info = std::make_shared<RowValueInfo>
             (knownColumns, SCHEMA_CLOSED, exprBound.info->isConst());
 
-        return BoundSqlExpression(exec, this, info, decomposition);
+        BoundSqlExpression result(exec, this, info, decomposition);
+
+        if (exprBound.batchExec) {
+            result.batchExec = [=] (const SqlRowScope * const * rows,
+                                    size_t numRows,
+                                    ExpressionValue * output,
+                                    const VariableFilter & filter,
+                                    std::exception_ptr & error)
+                {
+                    numRows = exprBound.execBatch(rows, numRows, output,
+                                                  filter, error);
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        StructValue row;
+                        row.emplace_back(alias0, std::move(output[i]));
+                        output[i] = std::move(row);
+                    }
+                    return numRows;
+                };
+        }
+
+        return result;
     }
     else {
         auto exec = [=] (const SqlRowScope & scope,
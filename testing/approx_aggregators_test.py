@@ -0,0 +1,82 @@
+#
+# approx_aggregators_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test the approx_count_distinct, approx_quantile and approx_median
+# aggregators.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_ROWS = 30000
+NUM_DISTINCT = 20000
+
+class ApproxAggregatorsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(NUM_ROWS):
+            rows.append(['row' + str(i), [['x', i, 0],
+                                          ['d', 'v' + str(i % NUM_DISTINCT), 0],
+                                          ['g', i % 3, 0]]])
+        ds.record_rows(rows)
+        ds.record_row('empty', [['g', 0, 0]])
+        ds.commit()
+
+    def query(self, q):
+        return mldb.get('/v1/query', q=q, format='aos', rowNames=0).json()
+
+    def test_count_distinct_small_is_exact(self):
+        res = self.query('SELECT approx_count_distinct(x % 100) AS c, '
+                         'count_distinct(x % 100) AS e FROM ds')
+        self.assertEqual(res, [{'c': 100, 'e': 100}])
+
+    def test_count_distinct(self):
+        res = self.query('SELECT approx_count_distinct(d) AS c FROM ds')
+        self.assertAlmostEqual(res[0]['c'], NUM_DISTINCT,
+                               delta=NUM_DISTINCT * 0.03)
+
+    def test_count_distinct_grouped(self):
+        res = self.query('SELECT g, approx_count_distinct(x) AS c FROM ds '
+                         'GROUP BY g')
+        self.assertEqual(len(res), 3)
+        for r in res:
+            self.assertAlmostEqual(r['c'], NUM_ROWS / 3,
+                                   delta=NUM_ROWS / 3 * 0.03)
+
+    def test_count_distinct_row(self):
+        res = self.query('SELECT approx_count_distinct({x % 10 AS a, '
+                         'x % 20 AS b}) AS c FROM ds')
+        self.assertEqual(res, [{'c.a': 10, 'c.b': 20}])
+
+    def test_quantiles(self):
+        res = self.query('SELECT approx_quantile(x, 0.0) AS q0, '
+                         'approx_quantile(x, 0.01) AS q1, '
+                         'approx_median(x) AS q50, '
+                         'approx_quantile(x, 0.99) AS q99, '
+                         'approx_quantile(x, 1.0) AS q100 FROM ds')[0]
+        self.assertEqual(res['q0'], 0)
+        self.assertEqual(res['q100'], NUM_ROWS - 1)
+        for q in [1, 50, 99]:
+            self.assertAlmostEqual(res['q' + str(q)], NUM_ROWS * q / 100,
+                                   delta=NUM_ROWS * 0.005)
+
+    def test_median_grouped(self):
+        res = self.query('SELECT g, approx_median(x) AS m FROM ds '
+                         'GROUP BY g ORDER BY g')
+        for r in res:
+            self.assertAlmostEqual(r['m'], NUM_ROWS / 2, delta=NUM_ROWS * 0.01)
+
+    def test_small_median(self):
+        res = self.query('SELECT approx_median(x) AS m FROM ds '
+                         'WHERE x IN (1, 2, 3)')
+        self.assertEqual(res, [{'m': 2}])
+
+    def test_bad_quantile(self):
+        with self.assertRaises(ResponseException):
+            self.query('SELECT approx_quantile(x, 2) FROM ds')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,122 @@
+#
+# arrow_format_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the arrow output format of queries is read by pyarrow as the
+# same result as the table format.
+#
+
+import unittest
+
+try:
+    import pyarrow
+except ImportError:
+    pyarrow = None
+
+from mldb import mldb, MldbUnitTest
+
+NUM_ROWS = 70000  # more than one record batch
+
+@unittest.skipIf(pyarrow is None, "skipping because pyarrow isn't installed")
+class ArrowFormatTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(10):
+            cols = [['i', i - 3, 0], ['f', i + 0.5, 0], ['s', 's' + str(i), 0],
+                    ['ts', {'ts': '2017-01-0{}T00:00:00Z'.format(i % 9 + 1)},
+                     0]]
+            if i % 3 == 0:
+                cols.append(['sparse', i, 0])
+            if i % 2 == 0:
+                cols.append(['mixed', i, 0])
+            else:
+                cols.append(['mixed', 'm' + str(i), 0])
+            ds.record_row('row' + str(i), cols)
+        ds.commit()
+
+        big = mldb.create_dataset({'id': 'big', 'type': 'sparse.mutable'})
+        big.record_rows([['r' + str(i), [['x', i, 0], ['y', i * 0.5, 0]]]
+                         for i in range(NUM_ROWS)])
+        big.commit()
+
+    def read_arrow(self, query, **kwargs):
+        res = mldb.get('/v1/query', q=query, format='arrow', **kwargs)
+        self.assertEqual(res.headers['content-type'],
+                         'application/vnd.apache.arrow.stream')
+        return pyarrow.ipc.open_stream(res.content).read_all()
+
+    def assert_same_as_table(self, query):
+        table = self.read_arrow(query, rowNames='true')
+        expected = mldb.get('/v1/query', q=query, format='table').json()
+        self.assertEqual(table.column_names, expected[0])
+        rows = [list(r) for r in zip(*[c.to_pylist() for c in table.columns])]
+        self.assertEqual(rows, expected[1:])
+        return table
+
+    def test_types(self):
+        table = self.read_arrow(
+            'SELECT i, f, s, ts, sparse, mixed, i > 0 AS b, NULL AS n '
+            'FROM ds ORDER BY rowName()', rowNames='false')
+        types = {f.name: str(f.type) for f in table.schema}
+        self.assertEqual(types, {
+            'i': 'int64',
+            'f': 'double',
+            's': 'string',
+            'ts': 'timestamp[us, tz=UTC]',
+            'sparse': 'int64',
+            'mixed': 'string',
+            'b': 'bool',
+            'n': 'null'
+        })
+        self.assertEqual(table.num_rows, 10)
+        self.assertEqual(table.column('i').to_pylist(),
+                         [i - 3 for i in range(10)])
+        self.assertEqual(table.column('b').to_pylist(),
+                         [i - 3 > 0 for i in range(10)])
+        self.assertEqual(table.column('sparse').to_pylist(),
+                         [i if i % 3 == 0 else None for i in range(10)])
+        self.assertEqual(table.column('mixed').to_pylist(),
+                         [str(i) if i % 2 == 0 else 'm' + str(i)
+                          for i in range(10)])
+
+    def test_same_as_table(self):
+        self.assert_same_as_table(
+            'SELECT i, f, s, sparse FROM ds ORDER BY rowName()')
+
+    def test_several_batches(self):
+        table = self.assert_same_as_table(
+            'SELECT x, y FROM big ORDER BY x')
+        self.assertEqual(table.num_rows, NUM_ROWS)
+        self.assertEqual(len(table.column('x').chunks), 2)
+        self.assertEqual(str(table.schema.field('x').type), 'int64')
+        self.assertEqual(str(table.schema.field('y').type), 'double')
+
+    def test_dataset_route(self):
+        res = mldb.get('/v1/datasets/big/query', select='x', orderBy='x',
+                       limit=100000, format='arrow', rowNames='false')
+        table = pyarrow.ipc.open_stream(res.content).read_all()
+        self.assertEqual(table.column('x').to_pylist(), list(range(NUM_ROWS)))
+
+    def test_value_not_fitting_schema(self):
+        # The schema is fixed by the first batch, so a float in the
+        # second batch can't be sent in an int64 column, and the stream
+        # stops after the first batch
+        query = 'SELECT CASE WHEN x < 65536 THEN x ELSE x + 0.5 END AS z ' \
+                'FROM big ORDER BY x'
+        try:
+            num_rows = self.read_arrow(query).num_rows
+        except Exception:
+            num_rows = 0
+        self.assertLess(num_rows, NUM_ROWS)
+
+        # With a type given by the query, it's fine
+        table = self.read_arrow(
+            'SELECT CAST (CASE WHEN x < 65536 THEN x ELSE x + 0.5 END '
+            'AS NUMBER) AS z FROM big ORDER BY x')
+        self.assertEqual(str(table.schema.field('z').type), 'double')
+        self.assertEqual(table.num_rows, NUM_ROWS)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,393 @@
+/* arrow_ipc_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that query output encoded as an Arrow IPC stream has the expected
+   schema and values.  The stream is read back with a minimal flatbuffer
+   reader, so that the test doesn't need the Arrow library; the stream is
+   checked against a real Arrow reader in arrow_format_test.py.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/engine/arrow_ipc.h"
+#include "mldb/types/annotated_exception.h"
+#include <cstring>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+
+namespace {
+
+template<typename T>
+T readAt(const std::string & buf, size_t pos)
+{
+    BOOST_REQUIRE_LE(pos + sizeof(T), buf.size());
+    T result;
+    std::memcpy(&result, buf.data() + pos, sizeof(T));
+    return result;
+}
+
+/// Table within a flatbuffer
+struct Table {
+    Table(const std::string & buf, size_t pos)
+        : buf(&buf), pos(pos),
+          vtable(pos - readAt<int32_t>(buf, pos))
+    {
+    }
+
+    const std::string * buf;
+    size_t pos;
+    size_t vtable;
+
+    size_t field(int slot) const
+    {
+        size_t entry = 4 + 2 * slot;
+        if (entry >= readAt<uint16_t>(*buf, vtable))
+            return 0;
+        return readAt<uint16_t>(*buf, vtable + entry);
+    }
+
+    template<typename T>
+    T scalar(int slot, T def = T()) const
+    {
+        size_t off = field(slot);
+        return off ? readAt<T>(*buf, pos + off) : def;
+    }
+
+    size_t ref(int slot) const
+    {
+        size_t off = field(slot);
+        BOOST_REQUIRE_NE(off, 0);
+        return pos + off + readAt<uint32_t>(*buf, pos + off);
+    }
+
+    Table table(int slot) const
+    {
+        return Table(*buf, ref(slot));
+    }
+
+    std::string string(int slot) const
+    {
+        size_t start = ref(slot);
+        return buf->substr(start + 4, readAt<uint32_t>(*buf, start));
+    }
+
+    std::vector<Table> tables(int slot) const
+    {
+        size_t start = ref(slot);
+        std::vector<Table> result;
+        for (uint32_t i = 0;  i < readAt<uint32_t>(*buf, start);  ++i) {
+            size_t elem = start + 4 + 4 * i;
+            result.emplace_back(*buf, elem + readAt<uint32_t>(*buf, elem));
+        }
+        return result;
+    }
+
+    std::vector<std::pair<int64_t, int64_t> > structs(int slot) const
+    {
+        size_t start = ref(slot);
+        BOOST_CHECK_EQUAL((start + 4) % 8, 0);
+        std::vector<std::pair<int64_t, int64_t> > result;
+        for (uint32_t i = 0;  i < readAt<uint32_t>(*buf, start);  ++i) {
+            result.emplace_back(readAt<int64_t>(*buf, start + 4 + 16 * i),
+                                readAt<int64_t>(*buf, start + 12 + 16 * i));
+        }
+        return result;
+    }
+};
+
+struct Message {
+    std::string metadata;
+    std::string body;
+
+    Table root() const
+    {
+        return Table(metadata, readAt<uint32_t>(metadata, 0));
+    }
+
+    Table header(uint8_t expectedType) const
+    {
+        Table message = root();
+        BOOST_CHECK_EQUAL(message.scalar<int16_t>(0), 4 /* V5 */);
+        BOOST_CHECK_EQUAL((int)message.scalar<uint8_t>(1), (int)expectedType);
+        BOOST_CHECK_EQUAL(message.scalar<int64_t>(3), body.size());
+        return message.table(2);
+    }
+};
+
+/// Split a stream into messages, checking the framing
+std::vector<Message> readStream(const std::string & stream)
+{
+    std::vector<Message> result;
+    size_t pos = 0;
+    for (;;) {
+        BOOST_REQUIRE_EQUAL(readAt<uint32_t>(stream, pos), 0xffffffff);
+        int32_t length = readAt<int32_t>(stream, pos + 4);
+        pos += 8;
+        if (length == 0)
+            break;
+        BOOST_REQUIRE_EQUAL(length % 8, 0);
+
+        Message message;
+        message.metadata = stream.substr(pos, length);
+        pos += length;
+        int64_t bodyLength = message.root().scalar<int64_t>(3);
+        BOOST_REQUIRE_EQUAL(bodyLength % 8, 0);
+        message.body = stream.substr(pos, bodyLength);
+        pos += bodyLength;
+        result.emplace_back(std::move(message));
+    }
+    BOOST_CHECK_EQUAL(pos, stream.size());
+    return result;
+}
+
+std::string encode(const std::vector<MatrixNamedRow> & rows,
+                   const ExpressionValueInfo * info,
+                   bool rowNames, bool sortColumns)
+{
+    std::string result;
+    auto onMessage = [&] (std::string message)
+        {
+            result += message;
+            return true;
+        };
+    BOOST_CHECK(encodeArrowStream(rows, info, rowNames, false /* rowHashes */,
+                                  sortColumns, onMessage));
+    return result;
+}
+
+MatrixNamedRow row(const std::string & name)
+{
+    MatrixNamedRow result;
+    result.rowName = PathElement(name);
+    result.rowHash = result.rowName;
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_arrow_types_and_values )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1000);
+    Date later = Date::fromSecondsSinceEpoch(2000);
+
+    std::vector<MatrixNamedRow> rows{ row("r0"), row("r1"), row("r2") };
+    rows[0].columns.emplace_back(ColumnPath("i"), -3, ts);
+    rows[0].columns.emplace_back(ColumnPath("f"), 1.5, ts);
+    rows[0].columns.emplace_back(ColumnPath("s"), "hello", ts);
+    rows[0].columns.emplace_back(ColumnPath("m"), 1, ts);
+    rows[1].columns.emplace_back(ColumnPath("f"), 2, ts);
+    rows[1].columns.emplace_back(ColumnPath("t"), CellValue(later), ts);
+    rows[1].columns.emplace_back(ColumnPath("m"), "x", ts);
+    rows[1].columns.emplace_back(ColumnPath("b"),
+                                 CellValue::blob(std::string("\0\1", 2)), ts);
+    rows[2].columns.emplace_back(ColumnPath("i"), 7, ts);
+    rows[2].columns.emplace_back(ColumnPath("i"), 8, later);
+    rows[2].columns.emplace_back(ColumnPath("i"), 6, ts);
+    rows[2].columns.emplace_back(ColumnPath("n"), CellValue(), ts);
+
+    auto messages = readStream(encode(rows, nullptr, true /* rowNames */,
+                                      false /* sortColumns */));
+    BOOST_REQUIRE_EQUAL(messages.size(), 2);
+
+    // Schema: _rowName then the columns in order of appearance
+    auto fields = messages[0].header(1 /* Schema */).tables(1);
+    std::vector<std::string> names;
+    std::vector<int> types;
+    for (auto & f: fields) {
+        names.push_back(f.string(0));
+        types.push_back(f.scalar<uint8_t>(2));
+    }
+    std::vector<std::string> expectedNames
+        { "_rowName", "i", "f", "s", "m", "t", "b", "n" };
+    BOOST_CHECK_EQUAL_COLLECTIONS(names.begin(), names.end(),
+                                  expectedNames.begin(), expectedNames.end());
+    std::vector<int> expectedTypes{ 5, 2, 3, 5, 5, 10, 4, 1 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(types.begin(), types.end(),
+                                  expectedTypes.begin(), expectedTypes.end());
+    BOOST_CHECK_EQUAL(fields[1].table(3).scalar<int32_t>(0), 64);
+    BOOST_CHECK_EQUAL((int)fields[1].table(3).scalar<uint8_t>(1), 1);
+    BOOST_CHECK_EQUAL(fields[2].table(3).scalar<int16_t>(0), 2);
+    BOOST_CHECK_EQUAL(fields[5].table(3).scalar<int16_t>(0), 2);
+    BOOST_CHECK_EQUAL(fields[5].table(3).string(1), "UTC");
+
+    // Record batch
+    Table batch = messages[1].header(3 /* RecordBatch */);
+    const std::string & body = messages[1].body;
+    BOOST_CHECK_EQUAL(batch.scalar<int64_t>(0), 3);
+    auto nodes = batch.structs(1);
+    auto buffers = batch.structs(2);
+    BOOST_REQUIRE_EQUAL(nodes.size(), 8);
+
+    // Two buffers for each fixed width column, three for variable length
+    // and none for null
+    BOOST_REQUIRE_EQUAL(buffers.size(), 3 + 2 + 2 + 3 + 3 + 2 + 3);
+    for (auto & b: buffers) {
+        BOOST_CHECK_EQUAL(b.first % 8, 0);
+        BOOST_CHECK_LE(b.first + b.second, body.size());
+    }
+
+    auto bufferString = [&] (int i)
+        {
+            return body.substr(buffers[i].first, buffers[i].second);
+        };
+
+    // _rowName
+    BOOST_CHECK_EQUAL(nodes[0].second, 0);
+    BOOST_CHECK_EQUAL(buffers[0].second, 0);
+    BOOST_CHECK_EQUAL(bufferString(2), "r0r1r2");
+
+    // i: null in the middle, and the latest of several values
+    BOOST_CHECK_EQUAL(nodes[1].second, 1);
+    BOOST_CHECK_EQUAL((int)bufferString(3)[0], 5);
+    BOOST_CHECK_EQUAL(readAt<int64_t>(body, buffers[4].first), -3);
+    BOOST_CHECK_EQUAL(readAt<int64_t>(body, buffers[4].first + 16), 8);
+
+    // f: integers and floats mixed give doubles
+    BOOST_CHECK_EQUAL(readAt<double>(body, buffers[6].first), 1.5);
+    BOOST_CHECK_EQUAL(readAt<double>(body, buffers[6].first + 8), 2.0);
+
+    // m: numbers and strings mixed give strings
+    BOOST_CHECK_EQUAL(bufferString(12), "1x");
+
+    // t: microseconds since the epoch
+    BOOST_CHECK_EQUAL(readAt<int64_t>(body, buffers[14].first + 8),
+                      2000000000);
+
+    // b: blob bytes
+    BOOST_CHECK_EQUAL(bufferString(17), std::string("\0\1", 2));
+
+    // n: all null
+    BOOST_CHECK_EQUAL(nodes[7].second, 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_arrow_boolean_hint_and_sorting )
+{
+    std::vector<MatrixNamedRow> rows{ row("r0"), row("r1") };
+    rows[0].columns.emplace_back(ColumnPath("z"), 1, Date());
+    rows[1].columns.emplace_back(ColumnPath("z"), 0, Date());
+    rows[1].columns.emplace_back(ColumnPath("a"), 3, Date());
+
+    std::vector<KnownColumn> known;
+    known.emplace_back(ColumnPath("z"), std::make_shared<BooleanValueInfo>(),
+                       COLUMN_IS_DENSE);
+    known.emplace_back(ColumnPath("y"), std::make_shared<Float64ValueInfo>(),
+                       COLUMN_IS_SPARSE);
+    RowValueInfo info(known);
+
+    auto messages = readStream(encode(rows, &info, false /* rowNames */,
+                                      true /* sortColumns */));
+    BOOST_REQUIRE_EQUAL(messages.size(), 2);
+
+    auto fields = messages[0].header(1 /* Schema */).tables(1);
+    BOOST_REQUIRE_EQUAL(fields.size(), 2);
+    BOOST_CHECK_EQUAL(fields[0].string(0), "a");
+    BOOST_CHECK_EQUAL((int)fields[0].scalar<uint8_t>(2), 2 /* Int */);
+    BOOST_CHECK_EQUAL(fields[1].string(0), "z");
+    BOOST_CHECK_EQUAL((int)fields[1].scalar<uint8_t>(2), 6 /* Bool */);
+
+    Table batch = messages[1].header(3 /* RecordBatch */);
+    auto buffers = batch.structs(2);
+    BOOST_REQUIRE_EQUAL(buffers.size(), 4);
+    BOOST_CHECK_EQUAL((int)messages[1].body[buffers[3].first], 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_arrow_batches )
+{
+    std::vector<MatrixNamedRow> rows;
+    for (size_t i = 0;  i < ARROW_BATCH_ROWS + 10;  ++i) {
+        rows.emplace_back(row("r" + std::to_string(i)));
+        rows.back().columns.emplace_back(ColumnPath("x"), i, Date());
+    }
+
+    auto messages = readStream(encode(rows, nullptr, false /* rowNames */,
+                                      false /* sortColumns */));
+    BOOST_REQUIRE_EQUAL(messages.size(), 3);
+
+    Table first = messages[1].header(3 /* RecordBatch */);
+    Table second = messages[2].header(3 /* RecordBatch */);
+    BOOST_CHECK_EQUAL(first.scalar<int64_t>(0), ARROW_BATCH_ROWS);
+    BOOST_CHECK_EQUAL(second.scalar<int64_t>(0), 10);
+    auto buffers = second.structs(2);
+    BOOST_CHECK_EQUAL(readAt<int64_t>(messages[2].body, buffers[1].first + 72),
+                      ARROW_BATCH_ROWS + 9);
+
+    // An empty result still has a schema
+    messages = readStream(encode({}, nullptr, true, false));
+    BOOST_REQUIRE_EQUAL(messages.size(), 1);
+    BOOST_CHECK_EQUAL(messages[0].header(1 /* Schema */).tables(1).size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_arrow_streaming_schema )
+{
+    // The schema is sent once the first batch is full, before the rest
+    // of the rows are seen
+    std::vector<KnownColumn> known;
+    known.emplace_back(ColumnPath("later"), std::make_shared<Float64ValueInfo>(),
+                       COLUMN_IS_SPARSE);
+    auto info = std::make_shared<RowValueInfo>(known);
+
+    std::string stream;
+    size_t numMessages = 0;
+    ArrowStreamEncoder encoder(false /* rowNames */, false /* rowHashes */,
+                               false /* sortColumns */,
+                               [&] (std::string message)
+                               {
+                                   stream += message;
+                                   ++numMessages;
+                                   return true;
+                               });
+    encoder.setInfo(info);
+
+    for (size_t i = 0;  i < ARROW_BATCH_ROWS;  ++i) {
+        MatrixNamedRow r = row("r" + std::to_string(i));
+        r.columns.emplace_back(ColumnPath("x"), i, Date());
+        r.columns.emplace_back(ColumnPath("n"), CellValue(), Date());
+        BOOST_CHECK(encoder.add(std::move(r)));
+    }
+    BOOST_CHECK(encoder.started());
+    BOOST_CHECK_EQUAL(numMessages, 2);
+
+    // Values of the later rows that fit the schema
+    MatrixNamedRow r = row("last");
+    r.columns.emplace_back(ColumnPath("n"), "now a string", Date());
+    r.columns.emplace_back(ColumnPath("later"), 2.5, Date());
+    BOOST_CHECK(encoder.add(std::move(r)));
+    BOOST_CHECK(encoder.finish());
+
+    auto messages = readStream(stream);
+    BOOST_REQUIRE_EQUAL(messages.size(), 3);
+    auto fields = messages[0].header(1 /* Schema */).tables(1);
+    BOOST_REQUIRE_EQUAL(fields.size(), 3);
+    BOOST_CHECK_EQUAL(fields[0].string(0), "x");
+    BOOST_CHECK_EQUAL((int)fields[0].scalar<uint8_t>(2), 2 /* Int */);
+    BOOST_CHECK_EQUAL(fields[1].string(0), "n");
+    BOOST_CHECK_EQUAL((int)fields[1].scalar<uint8_t>(2), 5 /* Utf8 */);
+    BOOST_CHECK_EQUAL(fields[2].string(0), "later");
+    BOOST_CHECK_EQUAL((int)fields[2].scalar<uint8_t>(2), 3 /* FloatingPoint */);
+
+    // Values that don't fit the schema are errors
+    auto encodeLater = [&] (const char * column, CellValue val)
+        {
+            ArrowStreamEncoder encoder(false, false, false,
+                                       [] (std::string) { return true; });
+            for (size_t i = 0;  i < ARROW_BATCH_ROWS;  ++i) {
+                MatrixNamedRow r = row("r" + std::to_string(i));
+                r.columns.emplace_back(ColumnPath("x"), i, Date());
+                encoder.add(std::move(r));
+            }
+            MatrixNamedRow r = row("last");
+            r.columns.emplace_back(ColumnPath(column), val, Date());
+            encoder.add(std::move(r));
+            encoder.finish();
+        };
+
+    BOOST_CHECK_THROW(encodeLater("x", 1.5), AnnotatedException);
+    BOOST_CHECK_THROW(encodeLater("y", 1), AnnotatedException);
+    BOOST_CHECK_NO_THROW(encodeLater("x", -1));
+}
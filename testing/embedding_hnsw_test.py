@@ -0,0 +1,152 @@
+#
+# embedding_hnsw_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test the hnsw index of the embedding dataset against the exact vptree
+# index, and its persistence.
+#
+
+import os
+import random
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_ROWS = 1000
+NUM_DIMS = 16
+
+class EmbeddingHnswTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        rng = random.Random(1)
+        cls.rows = []
+        for i in range(NUM_ROWS):
+            cls.rows.append(
+                ['row' + str(i),
+                 [['x' + str(d), rng.gauss(0, 1), 0] for d in range(NUM_DIMS)]])
+
+        for ds_id, config in [
+                ('exact', {}),
+                ('hnsw', {'index': 'hnsw', 'M': 8, 'efConstruction': 100,
+                          'efSearch': 50})]:
+            ds = mldb.create_dataset({'id': ds_id, 'type': 'embedding',
+                                      'params': config})
+            ds.record_rows(cls.rows)
+            ds.commit()
+
+            mldb.put('/v1/functions/nn_' + ds_id, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': ds_id, 'defaultNumNeighbors': 10}
+            })
+
+    def neighbors(self, fn, row):
+        res = mldb.get('/v1/query',
+                       q="select {}({{coords: '{}'}})[distances] as *"
+                         .format(fn, row),
+                       format='aos', rowNames=0).json()
+        return res[0]
+
+    def test_recall(self):
+        found = 0
+        for i in range(0, NUM_ROWS, 50):
+            exact = self.neighbors('nn_exact', 'row' + str(i))
+            approx = self.neighbors('nn_hnsw', 'row' + str(i))
+            self.assertEqual(len(approx), 10)
+            self.assertEqual(approx['row' + str(i)], 0)
+            found += len(set(exact.keys()) & set(approx.keys()))
+        self.assertGreater(found / (20 * 10.0), 0.9)
+
+    def test_coords(self):
+        coords = ', '.join('x{}: 0.1'.format(d) for d in range(NUM_DIMS))
+        q = ('select nn_{}({{coords: {{' + coords + '}}, numNeighbors: 3}})'
+             '[distances] as *')
+        exact = mldb.get('/v1/query', q=q.format('exact'), format='aos',
+                         rowNames=0).json()[0]
+        approx = mldb.get('/v1/query', q=q.format('hnsw'), format='aos',
+                          rowNames=0).json()[0]
+        self.assertEqual(len(approx), 3)
+        # The nearest neighbour is easy to find
+        self.assertEqual(min(approx, key=approx.get),
+                         min(exact, key=exact.get))
+
+    def test_status(self):
+        status = mldb.get('/v1/datasets/hnsw').json()['status']
+        self.assertEqual(status['index'], 'hnsw')
+        self.assertEqual(status['rowCount'], NUM_ROWS)
+        self.assertEqual(status['columnCount'], NUM_DIMS)
+        self.assertGreater(status['numLevels'], 1)
+        self.assertGreater(status['meanDegree'], 4)
+        self.assertGreater(status['estimatedRecall'], 0.9)
+
+        self.neighbors('nn_hnsw', 'row0')
+        status = mldb.get('/v1/datasets/hnsw').json()['status']
+        self.assertGreater(status['numQueries'], 0)
+        self.assertGreater(status['meanDistancesPerQuery'], 0)
+        self.assertLess(status['meanDistancesPerQuery'], NUM_ROWS)
+
+        status = mldb.get('/v1/datasets/exact').json()['status']
+        self.assertEqual(status['index'], 'vptree')
+        self.assertEqual(status['estimatedRecall'], 1)
+
+    def test_record_after_commit(self):
+        ds = mldb.create_dataset({'id': 'incremental', 'type': 'embedding',
+                                  'params': {'index': 'hnsw'}})
+        ds.record_rows(self.rows[:500])
+        ds.commit()
+        ds.record_rows(self.rows[500:])
+        ds.commit()
+
+        mldb.put('/v1/functions/nn_incremental', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'incremental'}
+        })
+
+        res = self.neighbors('nn_incremental', 'row999')
+        self.assertEqual(res['row999'], 0)
+        status = mldb.get('/v1/datasets/incremental').json()['status']
+        self.assertEqual(status['rowCount'], NUM_ROWS)
+
+    def test_persistence(self):
+        url = 'file://tmp/embedding_hnsw_test.bin'
+        if os.path.exists('tmp/embedding_hnsw_test.bin'):
+            os.remove('tmp/embedding_hnsw_test.bin')
+
+        ds = mldb.create_dataset({'id': 'saved', 'type': 'embedding',
+                                  'params': {'index': 'hnsw',
+                                             'dataFileUrl': url}})
+        ds.record_rows(self.rows)
+        ds.commit()
+
+        mldb.put('/v1/datasets/loaded', {
+            'type': 'embedding',
+            'params': {'index': 'hnsw', 'dataFileUrl': url}
+        })
+        status = mldb.get('/v1/datasets/loaded').json()['status']
+        self.assertEqual(status['rowCount'], NUM_ROWS)
+        self.assertEqual(status['index'], 'hnsw')
+
+        for ds_id in ['saved', 'loaded']:
+            mldb.put('/v1/functions/nn_' + ds_id, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': ds_id}
+            })
+
+        self.assertEqual(self.neighbors('nn_saved', 'row7'),
+                         self.neighbors('nn_loaded', 'row7'))
+
+        # Loading into a vptree builds that index instead
+        mldb.put('/v1/datasets/loaded_vptree', {
+            'type': 'embedding',
+            'params': {'dataFileUrl': url}
+        })
+        status = mldb.get('/v1/datasets/loaded_vptree').json()['status']
+        self.assertEqual(status['index'], 'vptree')
+        self.assertEqual(status['rowCount'], NUM_ROWS)
+
+    def test_bad_config(self):
+        with self.assertRaises(ResponseException):
+            mldb.create_dataset({'id': 'bad', 'type': 'embedding',
+                                 'params': {'index': 'hnsw', 'M': 1}})
+
+if __name__ == '__main__':
+    mldb.run_tests()
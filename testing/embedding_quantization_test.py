@@ -0,0 +1,193 @@
+#
+# embedding_quantization_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test nearest neighbor queries over int8 and product quantized embedding
+# datasets against the exact vptree index.
+#
+
+import os
+import random
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_ROWS = 2000
+NUM_DIMS = 32
+
+class EmbeddingQuantizationTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        rng = random.Random(1)
+        cls.rows = []
+        for i in range(NUM_ROWS):
+            cls.rows.append(
+                ['row' + str(i),
+                 [['x' + str(d), rng.gauss(0, 1), 0] for d in range(NUM_DIMS)]])
+
+        for ds_id, config in [
+                ('exact', {}),
+                ('int8', {'quantization': 'int8'}),
+                ('pq', {'quantization': 'pq', 'pqSubspaces': 8,
+                        'rerank': 10}),
+                ('pq_cosine', {'quantization': 'pq', 'metric': 'cosine',
+                               'rerank': 10}),
+                ('exact_cosine', {'metric': 'cosine'})]:
+            cls.create(ds_id, config, cls.rows)
+
+    @classmethod
+    def create(cls, ds_id, config, rows):
+        ds = mldb.create_dataset({'id': ds_id, 'type': 'embedding',
+                                  'params': config})
+        ds.record_rows(rows)
+        ds.commit()
+        mldb.put('/v1/functions/nn_' + ds_id, {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': ds_id, 'defaultNumNeighbors': 10}
+        })
+
+    def neighbors(self, ds_id, row):
+        res = mldb.get('/v1/query',
+                       q="select nn_{}({{coords: '{}'}})[distances] as *"
+                         .format(ds_id, row),
+                       format='aos', rowNames=0).json()
+        return res[0]
+
+    def assert_recall(self, ds_id, exact_id, row_names=None):
+        if row_names is None:
+            row_names = ['row' + str(i) for i in range(0, NUM_ROWS, 100)]
+        found = 0
+        for row_name in row_names:
+            exact = self.neighbors(exact_id, row_name)
+            approx = self.neighbors(ds_id, row_name)
+            self.assertEqual(len(approx), 10)
+            # Distances are exact, as they are re-ranked
+            for row, dist in approx.items():
+                if row in exact:
+                    self.assertAlmostEqual(dist, exact[row], places=4)
+            found += len(set(exact.keys()) & set(approx.keys()))
+        self.assertGreater(found / (len(row_names) * 10.0), 0.9)
+
+    def test_int8(self):
+        self.assert_recall('int8', 'exact')
+
+    def test_pq(self):
+        self.assert_recall('pq', 'exact')
+
+    def test_pq_cosine(self):
+        self.assert_recall('pq_cosine', 'exact_cosine')
+
+    def test_status(self):
+        status = mldb.get('/v1/datasets/int8').json()['status']
+        self.assertEqual(status['quantization'], 'int8')
+        self.assertEqual(status['bytesPerRow'], NUM_DIMS)
+
+        status = mldb.get('/v1/datasets/pq').json()['status']
+        self.assertEqual(status['quantization'], 'pq')
+        self.assertEqual(status['bytesPerRow'], 8)
+        self.assertGreater(status['estimatedRecall'], 0.8)
+
+        # Default of one subspace per 8 dimensions
+        status = mldb.get('/v1/datasets/pq_cosine').json()['status']
+        self.assertEqual(status['bytesPerRow'], NUM_DIMS / 8)
+
+        status = mldb.get('/v1/datasets/exact').json()['status']
+        self.assertEqual(status['quantization'], 'none')
+        self.assertEqual(status['bytesPerRow'], 0)
+
+    def test_record_after_commit(self):
+        ds = mldb.create_dataset({'id': 'incremental', 'type': 'embedding',
+                                  'params': {'quantization': 'int8'}})
+        ds.record_rows(self.rows[:1000])
+        ds.commit()
+        ds.record_rows(self.rows[1000:])
+        ds.commit()
+        mldb.put('/v1/functions/nn_incremental', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'incremental'}
+        })
+        res = self.neighbors('incremental', 'row1999')
+        self.assertEqual(res['row1999'], 0)
+
+    def test_rows_read_back_exactly(self):
+        # The exact coordinates are no longer held with the codes, but
+        # rows still read back exactly
+        query = "select * from {} where rowName() = 'row7'"
+        self.assertEqual(mldb.query(query.format('int8')),
+                         mldb.query(query.format('exact')))
+        self.assertEqual(mldb.query(query.format('pq')),
+                         mldb.query(query.format('exact')))
+
+    def test_later_commit_outside_range(self):
+        # Rows recorded after the first commit that fall far outside the
+        # range the int8 quantizer was trained on are not all clamped
+        # to the same codes
+        far = [[name + '_far', [[col, val * 50, ts] for col, val, ts in cols]]
+               for name, cols in self.rows[:200]]
+        for ds_id, config in [('widened_exact', {}),
+                              ('widened', {'quantization': 'int8'})]:
+            ds = mldb.create_dataset({'id': ds_id, 'type': 'embedding',
+                                      'params': config})
+            ds.record_rows(self.rows[:1000])
+            ds.commit()
+            ds.record_rows(far)
+            ds.commit()
+            mldb.put('/v1/functions/nn_' + ds_id, {
+                'type': 'embedding.neighbors',
+                'params': {'dataset': ds_id, 'defaultNumNeighbors': 10}
+            })
+
+        self.assert_recall('widened', 'widened_exact',
+                           ['row{}_far'.format(i) for i in range(0, 200, 10)])
+
+    def test_retrain_when_rows_double(self):
+        ds = mldb.create_dataset({'id': 'retrained', 'type': 'embedding',
+                                  'params': {'quantization': 'pq',
+                                             'pqSubspaces': 8,
+                                             'rerank': 10}})
+        ds.record_rows(self.rows[:300])
+        ds.commit()
+        ds.record_rows(self.rows[300:])
+        ds.commit()
+        mldb.put('/v1/functions/nn_retrained', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'retrained', 'defaultNumNeighbors': 10}
+        })
+        self.assert_recall('retrained', 'exact')
+
+    def test_persistence(self):
+        path = 'tmp/embedding_quantization_test.bin'
+        if os.path.exists(path):
+            os.remove(path)
+        config = {'quantization': 'pq', 'dataFileUrl': 'file://' + path}
+        self.create('saved', config, self.rows)
+
+        mldb.put('/v1/datasets/loaded', {'type': 'embedding',
+                                         'params': config})
+        mldb.put('/v1/functions/nn_loaded', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'loaded'}
+        })
+        self.assertEqual(self.neighbors('saved', 'row3'),
+                         self.neighbors('loaded', 'row3'))
+
+        # Loading without quantization builds the vptree instead
+        mldb.put('/v1/datasets/loaded_exact', {
+            'type': 'embedding',
+            'params': {'dataFileUrl': 'file://' + path}
+        })
+        mldb.put('/v1/functions/nn_loaded_exact', {
+            'type': 'embedding.neighbors',
+            'params': {'dataset': 'loaded_exact'}
+        })
+        self.assertEqual(self.neighbors('loaded_exact', 'row3'),
+                         self.neighbors('exact', 'row3'))
+
+    def test_bad_config(self):
+        with self.assertRaises(ResponseException):
+            mldb.create_dataset({'id': 'bad', 'type': 'embedding',
+                                 'params': {'index': 'hnsw',
+                                            'quantization': 'pq'}})
+
+if __name__ == '__main__':
+    mldb.run_tests()
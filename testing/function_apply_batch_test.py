@@ -0,0 +1,110 @@
+#
+# function_apply_batch_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that functions applied over a dataset scan, where they are called a
+# batch of rows at a time, give the same results as calling them on each
+# row on its own.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class FunctionApplyBatchTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.post('/v1/procedures', {
+            'type': 'import.text',
+            'params': {
+                'dataFileUrl': 'file://mldb/testing/dataset/iris.data',
+                'outputDataset': 'iris',
+                'headers': ['a', 'b', 'c', 'd', 'class'],
+                'runOnCreation': True
+            }
+        })
+
+        mldb.post('/v1/procedures', {
+            'type': 'classifier.train',
+            'params': {
+                'trainingData': """
+                    select {a, b, c, d} as features, class as label from iris
+                """,
+                'modelFileUrl': 'file://tmp/function_apply_batch.cls',
+                'algorithm': 'bbdt',
+                'mode': 'categorical',
+                'functionName': 'cls',
+                'runOnCreation': True
+            }
+        })
+
+        ds = mldb.create_dataset({'id': 'docs', 'type': 'sparse.mutable'})
+        words = ['peanut', 'butter', 'jelly', 'time', 'song', 'this']
+        for r in range(200):
+            cols = []
+            for i, w in enumerate(words):
+                if (r + i) % 3 != 0:
+                    cols.append([w, (r * (i + 1)) % 5 + 1, 0])
+            ds.record_row('doc' + str(r), cols)
+        ds.commit()
+
+        mldb.post('/v1/procedures', {
+            'type': 'tfidf.train',
+            'params': {
+                'trainingData': 'select * from docs',
+                'modelFileUrl': 'file://tmp/function_apply_batch.idf',
+                'functionName': 'tfidf',
+                'runOnCreation': True
+            }
+        })
+
+    @staticmethod
+    def as_dict(rows):
+        return {row['rowName']: {c[0]: c[1] for c in row['columns']}
+                for row in rows}
+
+    def assert_rows_close(self, expected, actual):
+        self.assertEqual(sorted(expected.keys()), sorted(actual.keys()))
+        for k, v in expected.items():
+            self.assertAlmostEqual(v, actual[k], places=5)
+
+    def test_classifier(self):
+        batched = self.as_dict(mldb.get('/v1/query', q="""
+            select cls({features: {a, b, c, d}}) as * from iris
+        """).json())
+        self.assertEqual(len(batched), 150)
+
+        for row in mldb.query('select a, b, c, d from iris limit 20')[1:]:
+            single = mldb.get('/v1/query', q="""
+                select cls({features: {%f as a, %f as b, %f as c, %f as d}})
+                as *
+            """ % tuple(row[1:])).json()
+            self.assert_rows_close(
+                {c[0]: c[1] for c in single[0]['columns']}, batched[row[0]])
+
+    def test_tfidf(self):
+        batched = self.as_dict(mldb.get('/v1/query', q="""
+            select tfidf({input: {*}}) as * from docs
+        """).json())
+        self.assertEqual(len(batched), 200)
+
+        for name in ['doc0', 'doc1', 'doc17', 'doc199']:
+            single = mldb.get('/v1/query', q="""
+                select tfidf({input: {*}}) as * from docs
+                where rowName() = '%s'
+            """ % name).json()
+            self.assert_rows_close(
+                {c[0]: c[1] for c in single[0]['columns']}, batched[name])
+
+    def test_error_in_batch(self):
+        # A row that fails makes the whole query fail, just as it does
+        # when the rows are applied one at a time
+        with self.assertRaises(ResponseException):
+            mldb.query("""
+                select cls({features: {a, b, c, d}}),
+                       case when rowName() = '75' then parse_json('x')
+                            else 1 end
+                from iris
+            """)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,100 @@
+#
+# gbdt_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the gbdt.train procedure.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class GbdtTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.post('/v1/procedures', {
+            'type': 'import.text',
+            'params': {
+                'dataFileUrl': 'file://mldb/testing/dataset/iris.data',
+                'outputDataset': 'iris',
+                'headers': ['a', 'b', 'c', 'd', 'class'],
+                'runOnCreation': True
+            }
+        })
+
+    def train(self, name, mode, label, features='{a, b, c, d}', **params):
+        config = {
+            'trainingData': """
+                select %s as features, %s as label from iris
+            """ % (features, label),
+            'mode': mode,
+            'numTrees': 50,
+            'minExamplesPerLeaf': 5,
+            'modelFileUrl': 'file://tmp/gbdt_%s.cls' % name,
+            'functionName': name,
+            'runOnCreation': True
+        }
+        config.update(params)
+        mldb.post('/v1/procedures', {'type': 'gbdt.train', 'params': config})
+
+    def test_boolean(self):
+        self.train('gbdt_bool', 'boolean', "class = 'Iris-versicolor'")
+        res = mldb.query("""
+            select sum((gbdt_bool({features: {a, b, c, d}})[score] > 0)
+                       = (class = 'Iris-versicolor')) as correct
+            from iris
+        """)
+        self.assertGreaterEqual(res[1][1], 140)
+
+    def test_categorical(self):
+        self.train('gbdt_cat', 'categorical', 'class',
+                   exampleSamplingProp=0.8, featureSamplingProp=0.75)
+        rows = mldb.query("""
+            select gbdt_cat({features: {a, b, c, d}}) as *, class from iris
+        """)
+        header = rows[0]
+        self.assertIn('scores."Iris-setosa"', header)
+        correct = 0
+        for row in rows[1:]:
+            scores = {header[i].split('"')[1]: row[i]
+                      for i in range(len(header))
+                      if header[i].startswith('scores.')}
+            best = max(scores, key=scores.get)
+            correct += best == row[header.index('class')]
+        self.assertGreaterEqual(correct, 140)
+
+    def test_regression(self):
+        self.train('gbdt_reg', 'regression', 'd', features='{a, b, c}',
+                   learningRate=0.2)
+        res = mldb.query("""
+            select avg(pow(gbdt_reg({features: {a, b, c}})[score] - d, 2))
+            from iris
+        """)
+        self.assertLess(res[1][1], 0.05)
+
+    def test_batch_matches_single_row(self):
+        self.train('gbdt_single', 'boolean', "class = 'Iris-virginica'")
+        batch = mldb.query("""
+            select gbdt_single({features: {a, b, c, d}})[score] as score
+            from iris order by rowName() limit 5
+        """)
+        for row in batch[1:]:
+            vals = mldb.query("""
+                select a, b, c, d from iris where rowName() = '%s'
+            """ % row[0])[1][1:]
+            single = mldb.query("""
+                select gbdt_single({features: {%f as a, %f as b,
+                                               %f as c, %f as d}})[score]
+            """ % tuple(vals))
+            self.assertAlmostEqual(single[1][1], row[1], places=5)
+
+    def test_bad_params(self):
+        with self.assertRaises(ResponseException):
+            self.train('gbdt_bad', 'boolean', "class = 'Iris-setosa'",
+                       maxLeaves=1)
+        with self.assertRaises(ResponseException):
+            self.train('gbdt_bad', 'multilabel', "class")
+        with self.assertRaises(ResponseException):
+            self.train('gbdt_bad', 'categorical', "'x'")
+
+if __name__ == '__main__':
+    mldb.run_tests()
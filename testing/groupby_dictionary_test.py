@@ -0,0 +1,128 @@
+#
+# groupby_dictionary_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that grouping on the dictionary encoded string columns of a tabular
+# dataset gives the same groups, in the same order, as grouping on the
+# strings themselves.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class GroupByDictionaryTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for ds_id, ds_type in [('tab', 'tabular'), ('ref', 'sparse.mutable')]:
+            ds = mldb.create_dataset({
+                'id': ds_id,
+                'type': ds_type,
+                'params': { 'unknownColumns': 'add' }
+                          if ds_type == 'tabular' else {}
+            })
+            # Several commits, so that each chunk has its own table of
+            # values and the dictionary has to merge them
+            for batch in range(3):
+                for i in range(batch * 1000, (batch + 1) * 1000):
+                    cols = [
+                        ['country', 'c' + str(i * 7919 % (13 + batch)), 0],
+                        ['device', ['phone', 'tablet', 'desktop'][i % 3], 0],
+                        ['x', i, 0],
+                        ['ident', 'u' + str(i), 0]
+                    ]
+                    if i % 4 != 0:
+                        cols.append(['campaign', 'camp\xe9' + str(i % 5), 0])
+                    if i % 10 == 0:
+                        cols.append(['mixed', i % 3, 0])
+                    else:
+                        cols.append(['mixed', 'm' + str(i % 3), 0])
+                    ds.record_row('row' + str(i), cols)
+                ds.commit()
+
+    def assert_same_groups(self, query):
+        self.assertEqual(
+            mldb.query(query.format('tab')),
+            mldb.query(query.format('ref')))
+
+    def test_single_key(self):
+        self.assert_same_groups(
+            'SELECT country, count(*) AS n, sum(x) AS s FROM {} '
+            'GROUP BY country')
+
+    def test_multiple_keys(self):
+        self.assert_same_groups(
+            'SELECT country, device, count(*) AS n FROM {} '
+            'GROUP BY country, device')
+
+    def test_nulls(self):
+        self.assert_same_groups(
+            'SELECT campaign, count(*) AS n FROM {} GROUP BY campaign')
+
+    def test_with_alias(self):
+        self.assert_same_groups(
+            'SELECT t.device, max(t.x) AS m FROM {} AS t GROUP BY t.device')
+
+    def test_mixed_types(self):
+        # Columns with numbers as well as strings aren't dictionary encoded
+        self.assert_same_groups(
+            'SELECT mixed, count(*) AS n FROM {} GROUP BY mixed')
+
+    def test_all_distinct(self):
+        self.assert_same_groups(
+            'SELECT ident, x FROM {} GROUP BY ident, x')
+
+    def test_expression_key(self):
+        # A key that is an expression of the column isn't encoded, but
+        # can be grouped alongside one that is
+        self.assert_same_groups(
+            'SELECT country, lower(device) AS d, count(*) AS n FROM {} '
+            'GROUP BY country, lower(device)')
+
+    def test_having_and_order_by(self):
+        self.assert_same_groups(
+            'SELECT device, country, avg(x) AS a FROM {} '
+            'GROUP BY device, country HAVING count(*) > 50 '
+            'ORDER BY avg(x) DESC, device, country')
+
+    def test_where(self):
+        self.assert_same_groups(
+            "SELECT country, count(*) AS n FROM {} WHERE device = 'phone' "
+            "GROUP BY country")
+
+    def test_integer_key_alongside_codes(self):
+        # Codes are small integers, like the values of this key; neither
+        # may be taken for the other
+        self.assert_same_groups(
+            'SELECT country, x % 13 AS k, count(*) AS n FROM {} '
+            'GROUP BY country, x % 13')
+        self.assert_same_groups(
+            'SELECT x % 3 AS k, device, count(*) AS n FROM {} '
+            'GROUP BY x % 3, device')
+
+    def test_limit_without_order_by(self):
+        # The first groups are the same whether or not some of the key
+        # is encoded
+        self.assert_same_groups(
+            'SELECT country, lower(device) AS d, count(*) AS n FROM {} '
+            'GROUP BY country, lower(device) LIMIT 5')
+        self.assert_same_groups(
+            'SELECT campaign, device, count(*) AS n FROM {} '
+            'GROUP BY campaign, device LIMIT 7')
+
+    def test_when(self):
+        # Values hidden by the WHEN clause are grouped as nulls
+        self.assert_same_groups(
+            "SELECT country, count(*) AS n FROM {} "
+            "WHEN value_timestamp() > '2100-01-01' GROUP BY country")
+
+    def test_spilled(self):
+        # Spilled rows keep their encoded keys, as the codes are read
+        # with the rows and not from the spill file
+        query = 'SELECT country, device, count(*) AS n, sum(x) AS s ' \
+                'FROM {} GROUP BY country, device'
+        spilled = mldb.get('/v1/query', q=query.format('tab'),
+                           format='table', memoryBudget=2000).json()
+        self.assertEqual(spilled, mldb.query(query.format('ref')))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,78 @@
+#
+# groupby_partitioned_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test GROUP BY over enough rows and distinct keys that the groups are
+# partitioned by hash and finalized in parallel.
+#
+
+from mldb import mldb, MldbUnitTest
+
+NUM_ROWS = 20000
+NUM_KEYS = 1500
+
+class GroupByPartitionedTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(NUM_ROWS):
+            rows.append(['row' + str(i), [['k', i % NUM_KEYS, 0],
+                                          ['s', 'key' + str(i % 13), 0],
+                                          ['x', i, 0]]])
+        ds.record_rows(rows)
+        ds.commit()
+
+        cls.counts = {}
+        cls.sums = {}
+        for i in range(NUM_ROWS):
+            k = i % NUM_KEYS
+            cls.counts[k] = cls.counts.get(k, 0) + 1
+            cls.sums[k] = cls.sums.get(k, 0) + i
+
+    def query(self, q):
+        return mldb.get('/v1/query', q=q, format='aos', rowNames=0).json()
+
+    def test_groups_in_key_order(self):
+        res = self.query('SELECT k, count(*) AS c, sum(x) AS s '
+                         'FROM ds GROUP BY k')
+        self.assertEqual([r['k'] for r in res], list(range(NUM_KEYS)))
+        for r in res:
+            self.assertEqual(r['c'], self.counts[r['k']])
+            self.assertEqual(r['s'], self.sums[r['k']])
+
+    def test_composite_key(self):
+        res = self.query('SELECT count(*) AS c FROM ds GROUP BY s, k % 2')
+        self.assertEqual(len(res), 26)
+        self.assertEqual(sum(r['c'] for r in res), NUM_ROWS)
+
+    def test_having(self):
+        res = self.query('SELECT k FROM ds GROUP BY k HAVING sum(x) > 140000')
+        expected = sorted(k for k, s in self.sums.items() if s > 140000)
+        self.assertEqual([r['k'] for r in res], expected)
+
+    def test_order_by_limit_offset(self):
+        res = self.query('SELECT k, sum(x) AS s FROM ds GROUP BY k '
+                         'ORDER BY sum(x) DESC, k LIMIT 10 OFFSET 5')
+        expected = sorted(self.sums.items(), key=lambda kv: (-kv[1], kv[0]))
+        self.assertEqual([[r['k'], r['s']] for r in res],
+                         [[k, s] for k, s in expected[5:15]])
+
+    def test_limit_without_order_by(self):
+        res = self.query('SELECT k FROM ds GROUP BY k LIMIT 7')
+        self.assertEqual([r['k'] for r in res], list(range(7)))
+
+    def test_having_limit_without_order_by(self):
+        # Only the groups that pass the HAVING count towards the limit
+        res = self.query('SELECT k FROM ds GROUP BY k '
+                         'HAVING sum(x) > 140000 LIMIT 5')
+        expected = sorted(k for k, s in self.sums.items() if s > 140000)
+        self.assertEqual([r['k'] for r in res], expected[:5])
+
+    def test_empty_group(self):
+        res = self.query('SELECT count(*) AS c FROM ds WHERE x < 0')
+        self.assertEqual(res, [{'c': 0}])
+
+if __name__ == '__main__':
+    mldb.run_tests()
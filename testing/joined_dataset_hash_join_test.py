@@ -0,0 +1,83 @@
+#
+# joined_dataset_hash_join_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the hash join strategy of the joined dataset gives the same
+# rows as the merge join.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class JoinedDatasetHashJoinTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        big = mldb.create_dataset({'id': 'big', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(20000):
+            cols = [['x', i, 0]]
+            if i % 7 != 0:
+                cols.append(['k', i % 150, 0])
+            rows.append(['b' + str(i), cols])
+        big.record_rows(rows)
+        big.commit()
+
+        # Keys 100 to 199; 100 to 149 match, and 120 is there twice
+        small = mldb.create_dataset({'id': 'small', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(100, 200):
+            rows.append(['s' + str(i), [['k', i, 0], ['y', 'v' + str(i), 0]]])
+        rows.append(['dup', [['k', 120, 0], ['y', 'dup', 0]]])
+        rows.append(['nokey', [['y', 'nokey', 0]]])
+        small.record_rows(rows)
+        small.commit()
+
+    def join_rows(self, left, right, qualification, strategy):
+        ds = 'j_{}_{}_{}_{}'.format(left, right, qualification, strategy)
+        mldb.put('/v1/datasets/' + ds, {
+            'type': 'joined',
+            'params': {
+                'left': left,
+                'right': right,
+                'on': '{}.k = {}.k'.format(left, right),
+                'qualification': qualification,
+                'strategy': strategy
+            }
+        })
+        res = mldb.get('/v1/query', q='SELECT * FROM ' + ds,
+                       format='aos').json()
+        return sorted(res, key=lambda r: r['_rowName'])
+
+    def assert_same_join(self, left, right, qualification):
+        merged = self.join_rows(left, right, qualification, 'merge')
+        hashed = self.join_rows(left, right, qualification, 'hash')
+        self.assertEqual(hashed, merged)
+        return hashed
+
+    def test_inner(self):
+        res = self.assert_same_join('big', 'small', 'JOIN_INNER')
+        self.assertEqual(
+            len(res),
+            sum(1 for i in range(20000) if i % 7 != 0 and i % 150 >= 100)
+            + sum(1 for i in range(20000) if i % 7 != 0 and i % 150 == 120))
+
+    def test_left(self):
+        self.assert_same_join('big', 'small', 'JOIN_LEFT')
+
+    def test_right(self):
+        self.assert_same_join('big', 'small', 'JOIN_RIGHT')
+
+    def test_full(self):
+        self.assert_same_join('big', 'small', 'JOIN_FULL')
+
+    def test_small_on_left(self):
+        # The hash table is built on the left side
+        self.assert_same_join('small', 'big', 'JOIN_LEFT')
+        self.assert_same_join('small', 'big', 'JOIN_FULL')
+
+    def test_auto(self):
+        self.assertEqual(self.join_rows('big', 'small', 'JOIN_LEFT', 'auto'),
+                         self.join_rows('big', 'small', 'JOIN_LEFT', 'merge'))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,72 @@
+#
+# orderby_topk_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that ORDER BY ... LIMIT queries, which only keep the best rows,
+# return the same rows as sorting everything.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class OrderByTopKTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(5000):
+            cols = [['score', (i * 7919) % 5003, 0], ['x', i, 0]]
+            if i % 3 == 0:
+                cols.append(['label', 'l' + str(i % 5), 0])
+            rows.append(['row' + str(i), cols])
+        ds.record_rows(rows)
+        ds.commit()
+
+    def query(self, q):
+        return mldb.get('/v1/query', q=q, format='aos').json()
+
+    def assert_limit_matches_sort(self, q, offset, limit):
+        everything = self.query(q)
+        self.assertEqual(
+            self.query(q + ' LIMIT {} OFFSET {}'.format(limit, offset)),
+            everything[offset:offset + limit])
+
+    def test_order_by_input_column(self):
+        q = 'SELECT x, x * 2 AS y FROM ds ORDER BY score DESC, rowName()'
+        self.assert_limit_matches_sort(q, 0, 100)
+        self.assert_limit_matches_sort(q, 37, 10)
+        self.assert_limit_matches_sort(q, 4990, 100)
+
+    def test_order_by_select_alias(self):
+        # The ORDER BY reads the output of the SELECT, so it can't be
+        # evaluated before it
+        q = 'SELECT score * -1 AS score, x FROM ds ORDER BY score, rowName()'
+        self.assert_limit_matches_sort(q, 0, 25)
+        res = self.query(q + ' LIMIT 1')
+        self.assertEqual(res[0]['score'],
+                         min(r['score'] for r in self.query(q)))
+
+    def test_select_star(self):
+        q = 'SELECT * FROM ds ORDER BY x DESC'
+        self.assert_limit_matches_sort(q, 0, 10)
+        self.assert_limit_matches_sort(q, 5, 5)
+
+    def test_where(self):
+        q = 'SELECT label, score FROM ds WHERE label IS NOT NULL ' \
+            'ORDER BY label, score, rowName()'
+        self.assert_limit_matches_sort(q, 0, 50)
+        self.assert_limit_matches_sort(q, 1000, 50)
+
+    def test_limit_past_end(self):
+        res = self.query('SELECT x FROM ds ORDER BY x LIMIT 10 OFFSET 4995')
+        self.assertEqual([r['x'] for r in res], list(range(4995, 5000)))
+
+    def test_nulls_sort_first(self):
+        # label is null for two rows in three, and nulls sort first
+        res = self.query('SELECT x FROM ds ORDER BY label LIMIT 5')
+        self.assertEqual(len(res), 5)
+        for r in res:
+            self.assertNotEqual(r['x'] % 3, 0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
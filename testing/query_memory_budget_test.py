@@ -0,0 +1,66 @@
+#
+# query_memory_budget_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that queries given a small memoryBudget spill to disk and still give
+# the same results as when everything stays in memory.
+#
+
+import random
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class QueryMemoryBudgetTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        for i in range(20000):
+            ds.record_row('r%d' % i,
+                          [['x', random.randint(0, 1000000), 0],
+                           ['g', random.randint(0, 5000), 0],
+                           ['s', 'v' * random.randint(10, 100), 0]])
+        ds.commit()
+
+    def query(self, q, **params):
+        return mldb.get('/v1/query', q=q, format='table', **params).json()
+
+    def test_order_by(self):
+        # A budget this small writes a run every few rows, so there are
+        # far more runs than are merged at once
+        q = 'SELECT x, s FROM ds ORDER BY x, rowName()'
+        expected = self.query(q)
+        self.assertEqual(len(expected), 20001)
+        self.assertEqual(self.query(q, memoryBudget=10000), expected)
+
+    def test_order_by_offset_limit(self):
+        q = 'SELECT x FROM ds ORDER BY x DESC, rowName() ' \
+            'OFFSET 15000 LIMIT 11000'
+        self.assertEqual(self.query(q, memoryBudget=10000), self.query(q))
+
+    def test_group_by(self):
+        q = 'SELECT count(*) AS n, max(x) AS m FROM ds GROUP BY g ORDER BY g'
+        self.assertEqual(self.query(q, memoryBudget=10000), self.query(q))
+
+    def test_transform(self):
+        for name, budget in [('in_memory', 0), ('spilled', 10000)]:
+            mldb.post('/v1/procedures', {
+                'type': 'transform',
+                'params': {
+                    'inputData': 'SELECT count(*) AS n FROM ds GROUP BY g',
+                    'outputDataset': name,
+                    'memoryBudget': budget,
+                    'runOnCreation': True
+                }
+            })
+        q = 'SELECT n FROM %s ORDER BY rowName()'
+        self.assertEqual(mldb.query(q % 'spilled'),
+                         mldb.query(q % 'in_memory'))
+
+    def test_negative_budget(self):
+        with self.assertRaises(ResponseException):
+            self.query('SELECT 1', memoryBudget=-1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
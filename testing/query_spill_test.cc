@@ -0,0 +1,90 @@
+/* query_spill_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that values written to a query spill file are read back the same.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "mldb/engine/query_spill.h"
+
+
+using namespace std;
+
+using namespace MLDB;
+
+
+BOOST_AUTO_TEST_CASE( test_spill_file_round_trip )
+{
+    Date ts = Date::fromSecondsSinceEpoch(1234567.5);
+
+    std::vector<ExpressionValue> values;
+    values.emplace_back(ExpressionValue::null(ts));
+    values.emplace_back(1, ts);
+    values.emplace_back(-3.25, ts);
+    values.emplace_back(Utf8String("h\xc3\xa9llo"), ts);
+    values.emplace_back(std::string(1000, 'x'), ts);
+    values.emplace_back(CellValue(Path::parse("a.b.c")), ts);
+    values.emplace_back(CellValue::blob(std::string("\0\1\2", 3)), ts);
+    values.emplace_back(CellValue(ts), ts);
+
+    StructValue structure;
+    structure.emplace_back(PathElement("x"), ExpressionValue(1, ts));
+    structure.emplace_back(PathElement("y"),
+                           ExpressionValue(Utf8String("z"), ts));
+    values.emplace_back(structure);
+
+    values.emplace_back(std::vector<CellValue>{1, 2, 3, 4}, ts,
+                        DimsVector{2, 2});
+
+    NamedRowValue row;
+    row.rowName = Path::parse("row.1");
+    row.rowHash = row.rowName;
+    row.columns = structure;
+
+    SpillFile file;
+    for (unsigned i = 0;  i < 100;  ++i) {
+        file.write(values);
+        file.write(row);
+    }
+    file.startReading();
+
+    for (unsigned i = 0;  i < 100;  ++i) {
+        BOOST_REQUIRE(file.hasMore());
+
+        std::vector<ExpressionValue> readValues;
+        file.read(readValues);
+        BOOST_REQUIRE_EQUAL(readValues.size(), values.size());
+        for (unsigned j = 0;  j < values.size();  ++j) {
+            BOOST_CHECK_EQUAL(readValues[j], values[j]);
+            BOOST_CHECK_EQUAL(readValues[j].getEffectiveTimestamp(),
+                              values[j].getEffectiveTimestamp());
+        }
+
+        NamedRowValue readRow;
+        file.read(readRow);
+        BOOST_CHECK_EQUAL(readRow.rowName, row.rowName);
+        BOOST_CHECK_EQUAL(readRow.rowHash, row.rowHash);
+        BOOST_REQUIRE_EQUAL(readRow.columns.size(), row.columns.size());
+        BOOST_CHECK_EQUAL(std::get<0>(readRow.columns[1]),
+                          std::get<0>(row.columns[1]));
+        BOOST_CHECK_EQUAL(std::get<1>(readRow.columns[1]),
+                          std::get<1>(row.columns[1]));
+    }
+
+    BOOST_CHECK(!file.hasMore());
+}
+
+BOOST_AUTO_TEST_CASE( test_approximate_memusage )
+{
+    ExpressionValue small(1, Date());
+    ExpressionValue large(std::string(10000, 'x'), Date());
+    BOOST_CHECK_GE(approximateMemusage(large),
+                   approximateMemusage(small) + 10000);
+
+    std::vector<ExpressionValue> both{small, large};
+    BOOST_CHECK_GE(approximateMemusage(both),
+                   approximateMemusage(small) + approximateMemusage(large));
+}
@@ -0,0 +1,113 @@
+#
+# query_streaming_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that query results that are large enough to be streamed back in
+# chunks are the same as when they are sent in one piece.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class QueryStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'ds', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(20000):
+            cols = [['x', i, 0], ['label', 'label' + str(i % 13), 0]]
+            if i % 7 == 0:
+                cols.append(['sparse', i * 0.5, 0])
+            rows.append(['row' + str(i), cols])
+        ds.record_rows(rows)
+        ds.commit()
+
+    def query(self, q, **kwargs):
+        return mldb.get('/v1/query', q=q, **kwargs).json()
+
+    def test_full(self):
+        res = self.query('SELECT x FROM ds ORDER BY x', format='full')
+        self.assertEqual(len(res), 20000)
+        self.assertEqual([r['columns'][0][1] for r in res],
+                         list(range(20000)))
+        self.assertEqual(res[5]['rowName'], 'row5')
+
+    def test_sparse(self):
+        res = self.query('SELECT x, sparse FROM ds ORDER BY x',
+                         format='sparse')
+        self.assertEqual(len(res), 20000)
+        self.assertEqual(res[7], [['_rowName', 'row7'], ['sparse', 3.5],
+                                  ['x', 7]])
+        self.assertEqual(res[8], [['_rowName', 'row8'], ['x', 8]])
+
+    def test_aos(self):
+        res = self.query('SELECT x, label FROM ds ORDER BY x', format='aos',
+                         rowNames='false')
+        self.assertEqual(len(res), 20000)
+        for i in [0, 1, 12345, 19999]:
+            self.assertEqual(res[i], {'x': i, 'label': 'label' + str(i % 13)})
+
+    def test_table(self):
+        res = self.query('SELECT x, sparse FROM ds ORDER BY x',
+                         format='table', sortColumns='true')
+        self.assertEqual(len(res), 20001)
+        self.assertEqual(res[0], ['_rowName', 'sparse', 'x'])
+        self.assertEqual(res[15], ['row14', 7, 14])
+        self.assertEqual(res[16], ['row15', None, 15])
+
+    def test_table_known_columns(self):
+        # All of the columns are known before the first row, so the header
+        # is taken from them and the rows are sent as they come
+        res = self.query('SELECT CAST (x AS INTEGER) AS x, '
+                         'CAST (label AS STRING) AS label, '
+                         'CAST (NULL AS INTEGER) AS nothing '
+                         'FROM ds ORDER BY x',
+                         format='table', rowNames='false')
+        self.assertEqual(len(res), 20001)
+        self.assertEqual(res[0], ['x', 'label', 'nothing'])
+        self.assertEqual(res[13], [12, 'label12', None])
+        self.assertEqual(res[20000], [19999, 'label' + str(19999 % 13), None])
+
+        res = self.query('SELECT CAST (x AS INTEGER) AS x, '
+                         'CAST (label AS STRING) AS label FROM ds '
+                         'ORDER BY x LIMIT 2',
+                         format='table', sortColumns='true',
+                         headers='false')
+        self.assertEqual(res, [['row0', 'label0', 0], ['row1', 'label1', 1]])
+
+    def test_soa(self):
+        res = self.query('SELECT x FROM ds ORDER BY x', format='soa')
+        self.assertEqual(res['x'], list(range(20000)))
+
+    def test_unordered(self):
+        # Without an ORDER BY, the rows still come back in the same order
+        # every time
+        q = 'SELECT x FROM ds WHERE x % 3 = 0'
+        res = self.query(q, format='aos')
+        self.assertEqual(len(res), 6667)
+        self.assertEqual(res, self.query(q, format='aos'))
+
+    def test_limit_and_group_by(self):
+        res = self.query('SELECT x FROM ds ORDER BY x LIMIT 10 OFFSET 100',
+                         format='aos', rowNames='false')
+        self.assertEqual(res, [{'x': i} for i in range(100, 110)])
+
+        res = self.query('SELECT count(*) AS n FROM ds GROUP BY label',
+                         format='aos', rowNames='false')
+        self.assertEqual(sum(r['n'] for r in res), 20000)
+
+    def test_dataset_route(self):
+        res = mldb.get('/v1/datasets/ds/query', select='x', orderBy='x',
+                       format='aos', rowNames='false').json()
+        self.assertEqual([r['x'] for r in res], list(range(20000)))
+
+    def test_without_dataset(self):
+        res = self.query('SELECT 1 AS one', format='aos', rowNames='false')
+        self.assertEqual(res, [{'one': 1}])
+
+    def test_empty(self):
+        res = self.query('SELECT x FROM ds WHERE x < 0', format='full')
+        self.assertEqual(res, [])
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,127 @@
+#
+# randomforest_modes_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test of the categorical and regression modes of randomforest.binary.train.
+#
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class RandomForestModesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.post('/v1/procedures', {
+            'type': 'import.text',
+            'params': {
+                'dataFileUrl': 'file://mldb/testing/dataset/iris.data',
+                'outputDataset': 'iris',
+                'headers': ['a', 'b', 'c', 'd', 'class'],
+                'runOnCreation': True
+            }
+        })
+
+    def train(self, name, mode, label, features='{a, b, c, d}',
+              dataset='iris', weight='1', **params):
+        config = {
+            'trainingData': """
+                select %s as features, %s as label, %s as weight from %s
+            """ % (features, label, weight, dataset),
+            'mode': mode,
+            'featureVectorSamplings': 3,
+            'featureSamplings': 10,
+            'maxDepth': 10,
+            'modelFileUrl': 'file://tmp/rf_modes_%s.cls' % name,
+            'functionName': name,
+            'runOnCreation': True
+        }
+        config.update(params)
+        mldb.post('/v1/procedures', {
+            'type': 'randomforest.binary.train',
+            'params': config
+        })
+
+    def test_boolean_is_default(self):
+        self.train('rf_bool', 'boolean', "class = 'Iris-versicolor'")
+        res = mldb.query("""
+            select sum((rf_bool({features: {a, b, c, d}})[score] > 0.5)
+                       = (class = 'Iris-versicolor')) as correct
+            from iris
+        """)
+        self.assertGreaterEqual(res[1][1], 140)
+
+    def test_categorical(self):
+        self.train('rf_cat', 'categorical', 'class')
+        rows = mldb.query("""
+            select rf_cat({features: {a, b, c, d}}) as *, class from iris
+        """)
+        header = rows[0]
+        self.assertIn('scores."Iris-virginica"', header)
+        correct = 0
+        for row in rows[1:]:
+            scores = {header[i].split('"')[1]: row[i]
+                      for i in range(len(header))
+                      if header[i].startswith('scores.')}
+            best = max(scores, key=scores.get)
+            correct += best == row[header.index('class')]
+        self.assertGreaterEqual(correct, 140)
+
+    def test_regression(self):
+        self.train('rf_reg', 'regression', 'd', features='{a, b, c}')
+        res = mldb.query("""
+            select avg(pow(rf_reg({features: {a, b, c}})[score] - d, 2))
+            from iris
+        """)
+        self.assertLess(res[1][1], 0.05)
+
+    def test_two_label_categorical_matches_boolean(self):
+        # Two labels are numbered in the same order as false and true, so
+        # the same trees are trained
+        label = "class = 'Iris-versicolor'"
+        self.train('rf_two_bool', 'boolean', label)
+        self.train('rf_two_cat', 'categorical',
+                   "CASE WHEN %s THEN 'yes' ELSE 'no' END" % label)
+        rows = mldb.query("""
+            select rf_two_bool({features: {a, b, c, d}})[score] as bool,
+                   rf_two_cat({features: {a, b, c, d}})[scores] as cat
+            from iris
+        """)
+        header = rows[0]
+        for row in rows[1:]:
+            self.assertAlmostEqual(row[header.index('cat.yes')],
+                                   row[header.index('bool')], places=5)
+            self.assertAlmostEqual(row[header.index('cat.no')],
+                                   1 - row[header.index('bool')], places=5)
+
+    def test_regression_leaf_is_weighted_mean(self):
+        # Each leaf holds the rows for one value of x, and predicts their
+        # weighted mean label: 1 for x = 0 and 18 for x = 1, where the
+        # unweighted means are 2 and 15
+        ds = mldb.create_dataset({'id': 'weighted', 'type': 'sparse.mutable'})
+        rows = []
+        for i in range(200):
+            for name, x, y, w in [('a', 0, 0, 3), ('b', 0, 4, 1),
+                                  ('c', 1, 10, 1), ('d', 1, 20, 4)]:
+                rows.append([name + str(i),
+                             [['x', x, 0], ['y', y, 0], ['w', w, 0]]])
+        ds.record_rows(rows)
+        ds.commit()
+
+        # Keep x in every tree, so that every tree splits on it
+        self.train('rf_weighted', 'regression', 'y', features='{x}',
+                   dataset='weighted', weight='w',
+                   featureVectorSamplingProp=1)
+        res = mldb.query("""
+            select rf_weighted({features: {0 as x}})[score] as x0,
+                   rf_weighted({features: {1 as x}})[score] as x1
+        """)
+        # Bagging resamples the rows, so the means are approximate
+        self.assertAlmostEqual(res[1][1], 1, delta=0.1)
+        self.assertAlmostEqual(res[1][2], 18, delta=0.5)
+
+    def test_multilabel_unsupported(self):
+        with self.assertRaises(ResponseException):
+            self.train('rf_bad', 'multilabel', 'class')
+
+if __name__ == '__main__':
+    mldb.run_tests()
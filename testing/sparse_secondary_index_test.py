@@ -0,0 +1,129 @@
+#
+# sparse_secondary_index_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that WHERE clauses answered from the secondary column indexes of a
+# sparse.mutable dataset give the same rows as a scan.
+#
+
+import random
+
+from mldb import mldb, MldbUnitTest
+
+class SparseSecondaryIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        rows = []
+        for i in range(2000):
+            row = []
+            if random.random() < 0.9:
+                row.append(['country', random.choice(['CA', 'US', 'FR']), 0])
+            if random.random() < 0.8:
+                row.append(['status', random.choice(['active', 'closed']), 0])
+            row.append(['age', random.randint(0, 100), 0])
+            if random.random() < 0.5:
+                row.append(['flag', random.randint(0, 1), 0])
+            rows.append(['r%d' % i, row])
+
+        for name, indexed in [('plain', []),
+                              ('indexed', ['country', 'status', 'age',
+                                           'flag'])]:
+            ds = mldb.create_dataset({
+                'id': name,
+                'type': 'sparse.mutable',
+                'params': {'indexedColumns': indexed}
+            })
+            for r in rows:
+                ds.record_row(r[0], r[1])
+            ds.commit()
+
+    def assertSameRows(self, where):
+        query = 'SELECT rowName() AS name FROM %s WHERE ' + where \
+                + ' ORDER BY rowName()'
+        expected = mldb.query(query % 'plain')
+        got = mldb.query(query % 'indexed')
+        self.assertEqual(got, expected, where)
+        return len(got) - 1
+
+    def test_predicates(self):
+        for where in ["country = 'CA'",
+                      "'CA' = country",
+                      "country != 'CA'",
+                      "age < 30",
+                      "30 > age",
+                      "age <= 30",
+                      "age > 90",
+                      "age >= 90",
+                      "age = 1000",
+                      "status IS NOT NULL",
+                      "flag IS TRUE",
+                      "flag"]:
+            self.assertSameRows(where)
+
+    def test_boolean_combinations(self):
+        n = self.assertSameRows(
+            "country = 'CA' AND (status = 'active' OR age >= 65)")
+        self.assertGreater(n, 0)
+        self.assertSameRows("country = 'CA' AND status = 'active' AND flag")
+        self.assertSameRows("country = 'US' OR country = 'FR' OR age < 5")
+        self.assertSameRows("(age > 10 AND age < 20) OR status = 'closed'")
+
+    def test_mixed_with_unindexed(self):
+        # Only part of the clause can use the indexes
+        self.assertSameRows("country = 'CA' AND age * 2 > 100")
+        self.assertSameRows("country = 'CA' AND rowName() != 'r10'")
+
+    def test_sees_writes(self):
+        query = "SELECT count(*) FROM %s WHERE country = 'NZ' AND age = 42"
+        self.assertEqual(mldb.query(query % 'indexed')[1][1], 0)
+
+        for name in ['plain', 'indexed']:
+            mldb.post('/v1/datasets/%s/rows' % name, {
+                'rowName': 'nz',
+                'columns': [['country', 'NZ', 0], ['age', 42, 0]]
+            })
+            mldb.post('/v1/datasets/%s/commit' % name)
+
+        self.assertEqual(mldb.query(query % 'indexed')[1][1], 1)
+        self.assertSameRows("country = 'NZ' AND age = 42")
+
+    def test_latest_value(self):
+        # Only the latest value of a column is seen by WHERE, so a row whose
+        # value has changed must only match on its new value
+        for name in ['plain', 'indexed']:
+            ds = mldb.create_dataset({
+                'id': name + '_history',
+                'type': 'sparse.mutable',
+                'params': {'indexedColumns': [] if name == 'plain'
+                                             else ['age', 'status']}
+            })
+            ds.record_row('changed', [['age', 20, '2015-01-01T00:00:00Z'],
+                                      ['age', 50, '2016-01-01T00:00:00Z'],
+                                      ['status', 'active',
+                                       '2015-01-01T00:00:00Z'],
+                                      ['status', 'closed',
+                                       '2016-01-01T00:00:00Z']])
+            ds.record_row('same', [['age', 20, '2016-01-01T00:00:00Z'],
+                                   ['status', 'active',
+                                    '2016-01-01T00:00:00Z']])
+            ds.commit()
+
+        query = 'SELECT rowName() AS name FROM %s_history WHERE ' \
+                '%s ORDER BY rowName()'
+        for where, expected in [("age < 30", ['same']),
+                                ("age = 20", ['same']),
+                                ("age != 50", ['same']),
+                                ("age >= 50", ['changed']),
+                                ("status = 'active' OR age > 40",
+                                 ['changed', 'same']),
+                                ("status = 'active' AND age > 40", []),
+                                ("status != 'closed'", ['same'])]:
+            plain = mldb.query(query % ('plain', where))
+            indexed = mldb.query(query % ('indexed', where))
+            self.assertEqual(indexed, plain, where)
+            self.assertEqual([r[1] for r in indexed[1:]], expected, where)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -78,7 +78,7 @@ struct TestBindingContext: public SqlBindingScope {
             {
                 const TestContext & testContext
                     = static_cast<const TestContext &>(context);
-                std::vector<std::tuple<PathElement, ExpressionValue> > result;
+                StructValue result;
 
                 for (auto & v: testContext.vars) {
                     ColumnPath name = keep(v.first);
@@ -253,7 +253,7 @@ BOOST_AUTO_TEST_CASE(test_simple_comparison)
         cerr << parsed->print() << endl;
         auto expr = parsed->bind(context);
         cerr << jsonEncode(expr) << endl;
-        vector<tuple<PathElement, ExpressionValue> > expected;
+        StructValue expected;
         expected.emplace_back(PathElement("x + 1"), ExpressionValue(11, Date()));
         BOOST_CHECK_EQUAL(expr(createRow({{"x", 10}, {"y", 3}, {"z", 2}}), GET_LATEST),
                           ExpressionValue(expected));
@@ -1288,3 +1288,97 @@ BOOST_AUTO_TEST_CASE(test_alignment)
 
     BOOST_CHECK_EQUAL(sizeof(ExpressionValue), 32);
 }
+
+BOOST_AUTO_TEST_CASE(test_batch_matches_row)
+{
+    // Evaluating expressions a batch at a time must give the same values
+    // and timestamps as evaluating them a row at a time, including on
+    // values that the batch kernels don't handle themselves, and stop at
+    // the first row that is an error.
+    TestBindingContext context;
+
+    std::vector<CellValue> vals = {
+        CellValue(), 0, 1, -3, 2.5, -0.75, 1e300,
+        std::numeric_limits<double>::quiet_NaN(),
+        int64_t(1) << 60, uint64_t(-1), "hello", "3",
+        CellValue(Date::fromSecondsSinceEpoch(1000))
+    };
+
+    std::vector<TestContext> rows;
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        for (size_t j = 0;  j < vals.size();  ++j) {
+            TestContext row;
+            row.vars[PathElement("x")]
+                = ExpressionValue(vals[i], Date::fromSecondsSinceEpoch(i));
+            row.vars[PathElement("y")]
+                = ExpressionValue(vals[j], Date::fromSecondsSinceEpoch(10 - j));
+            rows.emplace_back(std::move(row));
+        }
+    }
+
+    std::vector<const SqlRowScope *> rowPtrs;
+    for (auto & r: rows)
+        rowPtrs.push_back(&r);
+
+    for (std::string q: { "x = y", "x != y", "x < y", "x <= y", "x > y",
+                "x >= y", "x < 2", "x + y", "x - y", "x * y", "x / y",
+                "x * 2 + 1", "x > 0 AND y > 0", "x > 0 OR y > 0",
+                "x AND y", "x OR y", "NOT (x = y) AND x + y > 1" }) {
+        auto expr = SqlExpression::parse(q)->bind(context);
+
+        std::vector<ExpressionValue> batch(rows.size());
+        std::exception_ptr error;
+        size_t numDone = expr.execBatch(rowPtrs.data(), rowPtrs.size(),
+                                        batch.data(), GET_LATEST, error);
+        BOOST_CHECK_EQUAL(numDone < rows.size(), bool(error));
+
+        // Taking the rows of an ExpressionBatch one at a time must give
+        // the same values and errors as evaluating each row
+        ExpressionBatch taken;
+        taken.evaluate(expr, rowPtrs, GET_LATEST);
+
+        for (size_t i = 0;  i < rows.size();  ++i) {
+            ExpressionValue expected;
+            bool rowThrew = false;
+            try {
+                expected = expr(rows[i], GET_LATEST);
+            } catch (const std::exception & exc) {
+                rowThrew = true;
+            }
+
+            // The batch stops at the first row that is an error
+            if (i == numDone)
+                BOOST_CHECK_MESSAGE(rowThrew, q << " row " << i);
+
+            ExpressionValue fromTaken;
+            bool takenThrew = false;
+            try {
+                fromTaken = taken.take(i);
+            } catch (const std::exception & exc) {
+                takenThrew = true;
+            }
+            BOOST_CHECK_EQUAL(takenThrew, rowThrew);
+
+            if (rowThrew) {
+                BOOST_CHECK_MESSAGE(i >= numDone, q << " row " << i);
+                continue;
+            }
+
+            auto checkSame = [&] (const ExpressionValue & val)
+                {
+                    BOOST_CHECK_MESSAGE(val == expected
+                                        || (val.isAtom() && expected.isAtom()
+                                            && val.getAtom().isNaN()
+                                            && expected.getAtom().isNaN()),
+                                        q << " row " << i << ": " << val
+                                        << " != " << expected);
+                    BOOST_CHECK_EQUAL(val.getEffectiveTimestamp(),
+                                      expected.getEffectiveTimestamp());
+                };
+
+            checkSame(fromTaken);
+            if (i < numDone)
+                checkSame(batch[i]);
+        }
+    }
+}
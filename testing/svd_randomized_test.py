@@ -0,0 +1,99 @@
+#
+# svd_randomized_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that the randomized svd.train algorithm gives the same singular
+# values and vectors as the Lanczos one.
+#
+
+import json
+import random
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+NUM_ROWS = 500
+NUM_COLS = 40
+NUM_FACTORS = 5
+
+class SvdRandomizedTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # Low rank data plus a little noise, so that the leading singular
+        # values are well separated
+        rng = random.Random(1)
+        loadings = [[rng.gauss(0, 1) for f in range(NUM_FACTORS)]
+                    for c in range(NUM_COLS)]
+        ds = mldb.create_dataset({'id': 'svd_input', 'type': 'sparse.mutable'})
+        for r in range(NUM_ROWS):
+            factors = [rng.gauss(0, 5 - f) for f in range(NUM_FACTORS)]
+            cols = []
+            for c in range(NUM_COLS):
+                val = sum(l * f for l, f in zip(loadings[c], factors))
+                cols.append(['c' + str(c), val + rng.gauss(0, 0.1), 0])
+            ds.record_row('r' + str(r), cols)
+        ds.commit()
+
+        for algo in ['lanczos', 'randomized']:
+            mldb.post('/v1/procedures', {
+                'type': 'svd.train',
+                'params': {
+                    'trainingData': 'select * from svd_input',
+                    'algorithm': algo,
+                    'numSingularValues': NUM_FACTORS,
+                    'modelFileUrl': 'file://tmp/svd_{}.svd'.format(algo),
+                    'columnOutputDataset': 'svd_cols_' + algo,
+                    'runOnCreation': True
+                }
+            })
+
+    @staticmethod
+    def load_model(algo):
+        with open('tmp/svd_{}.svd'.format(algo)) as f:
+            return json.load(f)
+
+    def test_singular_values(self):
+        lanczos = self.load_model('lanczos')['singularValues']
+        randomized = self.load_model('randomized')['singularValues']
+        self.assertEqual(len(lanczos), NUM_FACTORS)
+        self.assertEqual(len(randomized), NUM_FACTORS)
+        for l, r in zip(lanczos, randomized):
+            self.assertAlmostEqual(l, r, delta=1e-4 * lanczos[0])
+
+    def test_singular_vectors(self):
+        # Singular vectors are only defined up to their sign
+        lanczos = self.load_model('lanczos')['columns']
+        randomized = self.load_model('randomized')['columns']
+        self.assertEqual(len(lanczos), len(randomized))
+        for i in range(NUM_FACTORS):
+            dot = sum(l['singularVector'][i] * r['singularVector'][i]
+                      for l, r in zip(lanczos, randomized))
+            self.assertAlmostEqual(abs(dot), 1.0, delta=1e-3)
+
+    def test_column_output(self):
+        res = mldb.query('select count(*) from svd_cols_randomized')
+        self.assertEqual(res[1][1], NUM_COLS)
+
+    def test_bad_params(self):
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/procedures', {
+                'type': 'svd.train',
+                'params': {
+                    'trainingData': 'select * from svd_input',
+                    'algorithm': 'randomized',
+                    'numPowerIterations': -1,
+                    'runOnCreation': True
+                }
+            })
+
+        with self.assertRaises(ResponseException):
+            mldb.post('/v1/procedures', {
+                'type': 'svd.train',
+                'params': {
+                    'trainingData': 'select * from svd_input',
+                    'algorithm': 'qr'
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
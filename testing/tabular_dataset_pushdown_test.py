@@ -0,0 +1,105 @@
+#
+# tabular_dataset_pushdown_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that WHERE clauses pushed down into the frozen columns of a tabular
+# dataset select the same rows as evaluating them row by row.
+#
+
+from mldb import mldb, MldbUnitTest
+
+class TabularDatasetPushdownTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        for ds_id, ds_type in [('tab', 'tabular'), ('ref', 'sparse.mutable')]:
+            ds = mldb.create_dataset({
+                'id': ds_id,
+                'type': ds_type,
+                'params': { 'unknownColumns': 'add' }
+                          if ds_type == 'tabular' else {}
+            })
+            for i in range(2000):
+                cols = [
+                    ['str', 'str' + str(i % 7), 0],
+                    ['double', i / 4.0, 0]
+                ]
+                # Integer column with a gap of nulls every fifth row
+                if i % 5 != 0:
+                    cols.append(['int', i - 1000, 0])
+                if i % 3 == 0:
+                    cols.append(['sparse', i % 11, 0])
+                ds.record_row('row' + str(i), cols)
+            ds.commit()
+
+        # Append-ordered events, committed in batches so that each batch
+        # is its own chunk with its own zone maps and bloom filters
+        for ds_id, ds_type in [('events', 'tabular'),
+                               ('events_ref', 'sparse.mutable')]:
+            ds = mldb.create_dataset({ 'id': ds_id, 'type': ds_type })
+            for batch in range(4):
+                for i in range(batch * 500, (batch + 1) * 500):
+                    ds.record_row('ev' + str(i), [
+                        ['seq', i, 0],
+                        ['user', 'user' + str(i * 7919 % 1000), 0]
+                    ])
+                ds.commit()
+
+    def assert_same_rows(self, where, tab='tab', ref='ref'):
+        query = 'SELECT rowName() AS name FROM {} WHERE ' + where \
+                + ' ORDER BY rowName()'
+        res = mldb.query(query.format(tab))
+        self.assertEqual(res, mldb.query(query.format(ref)))
+        return res
+
+    def test_integer_comparisons(self):
+        for where in ['int = 3', 'int = -1000', 'int = 5000', '3 = int',
+                      'int < -995', 'int <= -995', 'int > 990',
+                      'int >= 990', '-995 > int', 'int > 2.5',
+                      'int < 2.5', 'int != 4', "int < 'abc'",
+                      "int = 'abc'", 'int IS NOT NULL']:
+            self.assert_same_rows(where)
+
+    def test_integer_nulls(self):
+        res = self.assert_same_rows('int >= -1000 AND int <= -990')
+        # Rows 0, 5 and 10 have null for int
+        self.assertEqual(len(res), 1 + 8)
+
+    def test_double_comparisons(self):
+        for where in ['double = 2.5', 'double < 10', 'double >= 499.5',
+                      'double > 1000', 'double != 0.25',
+                      'double IS NOT NULL']:
+            self.assert_same_rows(where)
+
+    def test_string_comparisons(self):
+        for where in ["str = 'str3'", "str = 'nothing'", "str < 'str2'",
+                      "str >= 'str5'", "'str4' < str", 'str > 4',
+                      'str IS NOT NULL']:
+            self.assert_same_rows(where)
+
+    def test_sparse_column(self):
+        for where in ['sparse = 4', 'sparse > 8', 'sparse IS NOT NULL',
+                      'unknown = 4', 'unknown IS NOT NULL']:
+            self.assert_same_rows(where)
+
+    def test_and_or(self):
+        for where in ["str = 'str3' AND int > 0",
+                      "str = 'str3' AND sparse = 4",
+                      "int < -990 OR double > 495",
+                      "(str = 'str1' OR str = 'str2') AND double < 10",
+                      "str = 'str1' AND rowName() != 'row1'"]:
+            self.assert_same_rows(where)
+
+    def test_chunk_pruning(self):
+        for where in ['seq = 1234', 'seq >= 1990', 'seq < 3',
+                      'seq > 2000', 'seq != 7', "user = 'user123'",
+                      "user = 'nobody'", "user > 'user998'",
+                      "seq > 1500 AND user = 'user17'"]:
+            self.assert_same_rows(where, 'events', 'events_ref')
+
+        res = self.assert_same_rows('seq >= 499 AND seq <= 500',
+                                    'events', 'events_ref')
+        self.assertEqual(len(res), 3)
+
+if __name__ == '__main__':
+    mldb.run_tests()
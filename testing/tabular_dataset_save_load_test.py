@@ -0,0 +1,85 @@
+#
+# tabular_dataset_save_load_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Test that a tabular dataset can be saved and memory mapped back in.
+#
+
+import tempfile
+
+from mldb import mldb, MldbUnitTest, ResponseException
+
+class TabularDatasetSaveLoadTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({
+            'id': 'orig',
+            'type': 'tabular',
+            'params': { 'unknownColumns': 'add' }
+        })
+        for i in range(1000):
+            cols = [
+                ['int', i, 0],
+                ['double', i / 4.0, 0],
+                ['str', 'str' + str(i % 7), 0]
+            ]
+            if i % 3 == 0:
+                cols.append(['sparse.col', i * 2, 0])
+            ds.record_row('row' + str(i), cols)
+        ds.commit()
+
+        cls.tmp_file = tempfile.NamedTemporaryFile(dir='build/x86_64/tmp')
+        cls.saved_config = mldb.post('/v1/datasets/orig/routes/saves', {
+            'dataFileUrl': 'file://' + cls.tmp_file.name
+        }).json()
+
+    def test_saved_config(self):
+        self.assertEqual(self.saved_config['type'], 'tabular')
+        self.assertEqual(self.saved_config['params']['dataFileUrl'],
+                         'file://' + self.tmp_file.name)
+        self.assertEqual(self.saved_config['params']['unknownColumns'], 'add')
+
+    def test_load_gives_same_rows(self):
+        mldb.put('/v1/datasets/loaded', self.saved_config)
+
+        query = 'SELECT *, latest_timestamp({{*}}) AS ts FROM {} ' \
+                'ORDER BY rowName()'
+        self.assertEqual(mldb.query(query.format('orig')),
+                         mldb.query(query.format('loaded')))
+
+    def test_load_row_lookup(self):
+        mldb.put('/v1/datasets/loaded2', self.saved_config)
+
+        res = mldb.query("SELECT int, \"sparse.col\" FROM loaded2 "
+                         "WHERE rowName() = 'row999'")
+        self.assertTableResultEquals(res, [
+            ['_rowName', 'int', 'sparse.col'],
+            ['row999', 999, 1998]
+        ])
+
+    def test_record_after_load(self):
+        mldb.put('/v1/datasets/loaded3', self.saved_config)
+        mldb.post('/v1/datasets/loaded3/rows', {
+            'rowName': 'extra',
+            'columns': [['int', -1, 0]]
+        })
+        mldb.post('/v1/datasets/loaded3/commit')
+
+        res = mldb.query("SELECT count(*) FROM loaded3")
+        self.assertEqual(res[1][1], 1001)
+
+        res = mldb.query("SELECT int FROM loaded3 WHERE rowName() = 'extra'")
+        self.assertEqual(res[1][1], -1)
+
+    def test_load_missing_file(self):
+        with self.assertRaises(ResponseException):
+            mldb.put('/v1/datasets/missing', {
+                'type': 'tabular',
+                'params': {
+                    'dataFileUrl': 'file://build/x86_64/tmp/does_not_exist'
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
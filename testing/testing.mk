@@ -36,6 +36,8 @@ $(eval $(call test,expression_value_test,sql_expression,boost))
 # re-decouple them.
 $(eval $(call test,sql_expression_test,sql_expression,boost))
 $(eval $(call test,dataset_select_test,mldb,boost))
+$(eval $(call test,query_spill_test,mldb,boost))
+$(eval $(call test,arrow_ipc_test,mldb,boost))
 $(eval $(call test,embedding_dataset_test,mldb,boost))
 $(eval $(call test,procedure_run_test,mldb,boost))
 $(eval $(call test,python_procedure_test,mldb,boost manual)) #manual -- unclear why
@@ -479,6 +481,23 @@ $(eval $(call mldb_unit_test,MLDB-2025-st_contains.py))
 $(eval $(call mldb_unit_test,post_run_and_track_procedure_test.py))
 $(eval $(call mldb_unit_test,MLDB-2022-multiple-prediction-example.js))
 $(eval $(call mldb_unit_test,MLDB-2043_tabular_big_int.py))
+$(eval $(call mldb_unit_test,tabular_dataset_save_load_test.py))
+$(eval $(call mldb_unit_test,tabular_dataset_pushdown_test.py))
+$(eval $(call mldb_unit_test,groupby_partitioned_test.py))
+$(eval $(call mldb_unit_test,orderby_topk_test.py))
+$(eval $(call mldb_unit_test,joined_dataset_hash_join_test.py))
+$(eval $(call mldb_unit_test,groupby_dictionary_test.py))
+$(eval $(call mldb_unit_test,arrow_format_test.py))
+$(eval $(call mldb_unit_test,query_streaming_test.py))
+$(eval $(call mldb_unit_test,approx_aggregators_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_test.py))
+$(eval $(call mldb_unit_test,embedding_quantization_test.py))
+$(eval $(call mldb_unit_test,svd_randomized_test.py))
+$(eval $(call mldb_unit_test,function_apply_batch_test.py))
+$(eval $(call mldb_unit_test,gbdt_test.py))
+$(eval $(call mldb_unit_test,randomforest_modes_test.py))
+$(eval $(call mldb_unit_test,sparse_secondary_index_test.py))
+$(eval $(call mldb_unit_test,query_memory_budget_test.py))
 $(eval $(call mldb_unit_test,MLDB-2064_transform_proc_row_expr.py))
 $(eval $(call mldb_unit_test,MLDB-2065-transpose_rowdataset_segfaults.py))
 $(eval $(call mldb_unit_test,MLDB-2103-merge-row-dataset.py))
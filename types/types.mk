@@ -37,7 +37,7 @@ LIBTYPES_SOURCES := \
 	annotated_exception.cc \
 
 LIBTYPES_LINK := \
-	rt boost_regex boost_date_time jsoncpp googleurl cityhash value_description highwayhash re2 any
+	rt boost_regex boost_date_time jsoncpp googleurl cityhash value_description highwayhash re2 any base
 
 $(eval $(call set_compile_option,localdate.cc,-DLIB=\"$(LIB)\"))
 $(eval $(call set_compile_option,regex.cc,-I$(RE2_INCLUDE_PATH)))
@@ -0,0 +1,45 @@
+/** csv_scan.cc
+    Finding the structural characters of delimited text.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#include "mldb/utils/csv_scan.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* NEWLINES                                                                  */
+/*****************************************************************************/
+
+size_t countNewlines(const char * start, const char * end)
+{
+    size_t result = 0;
+    const char * p = start;
+    for (;  end - p >= (ssize_t)SCAN_BLOCK_SIZE;  p += SCAN_BLOCK_SIZE)
+        result += __builtin_popcountll(matchMask64(p, '\n'));
+    for (;  p < end;  ++p)
+        result += *p == '\n';
+    return result;
+}
+
+void findNewlines(const char * start, const char * end, const char * base,
+                  std::vector<size_t> & offsets)
+{
+    const char * p = start;
+    for (;  end - p >= (ssize_t)SCAN_BLOCK_SIZE;  p += SCAN_BLOCK_SIZE) {
+        uint64_t newlines = matchMask64(p, '\n');
+        while (newlines) {
+            offsets.push_back(p - base + __builtin_ctzll(newlines));
+            newlines &= newlines - 1;
+        }
+    }
+    for (;  p < end;  ++p) {
+        if (*p == '\n')
+            offsets.push_back(p - base);
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,237 @@
+/** csv_scan.h                                                     -*- C++ -*-
+    Finding the structural characters of delimited text (newlines,
+    separators and quotes) a 64 byte block at a time.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include "mldb/arch/arch.h"
+#include "mldb/compiler/compiler.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#if MLDB_INTEL_ISA
+# include <emmintrin.h>
+#endif
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* BLOCK MASKS                                                               */
+/*****************************************************************************/
+
+/// Number of bytes looked at in one go
+constexpr size_t SCAN_BLOCK_SIZE = 64;
+
+/** Return a mask with bit i set if byte i of the 64 bytes at p is equal
+    to c.
+*/
+MLDB_ALWAYS_INLINE uint64_t matchMask64(const char * p, char c)
+{
+#if MLDB_INTEL_ISA
+    __m128i v = _mm_set1_epi8(c);
+    uint64_t m0 = (uint32_t)_mm_movemask_epi8
+        (_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), v));
+    uint64_t m1 = (uint32_t)_mm_movemask_epi8
+        (_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), v));
+    uint64_t m2 = (uint32_t)_mm_movemask_epi8
+        (_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), v));
+    uint64_t m3 = (uint32_t)_mm_movemask_epi8
+        (_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), v));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+#else
+    uint64_t result = 0;
+    for (unsigned i = 0;  i < 64;  ++i)
+        result |= uint64_t(p[i] == c) << i;
+    return result;
+#endif
+}
+
+/** Return a mask with bit i set if byte i of the 64 bytes at p has its
+    top bit set (ie, isn't ASCII).
+*/
+MLDB_ALWAYS_INLINE uint64_t nonAsciiMask64(const char * p)
+{
+#if MLDB_INTEL_ISA
+    uint64_t m0 = (uint32_t)_mm_movemask_epi8
+        (_mm_loadu_si128((const __m128i *)p));
+    uint64_t m1 = (uint32_t)_mm_movemask_epi8
+        (_mm_loadu_si128((const __m128i *)(p + 16)));
+    uint64_t m2 = (uint32_t)_mm_movemask_epi8
+        (_mm_loadu_si128((const __m128i *)(p + 32)));
+    uint64_t m3 = (uint32_t)_mm_movemask_epi8
+        (_mm_loadu_si128((const __m128i *)(p + 48)));
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+#else
+    uint64_t result = 0;
+    for (unsigned i = 0;  i < 64;  ++i)
+        result |= uint64_t((unsigned char)p[i] >> 7) << i;
+    return result;
+#endif
+}
+
+/** Return a mask with bit i set if an odd number of bits at or below i
+    are set in x.  Applied to the mask of quote characters, it gives the
+    bytes that are within quotes (including the opening quote but not the
+    closing one).
+*/
+MLDB_ALWAYS_INLINE uint64_t prefixXor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/** Masks of the interesting characters of a block of up to 64 bytes of
+    delimited text.  Bit i of each mask is for byte i of the block; bits
+    past the end of the block are never set.
+*/
+struct CsvBlockMasks {
+    uint64_t separators = 0;
+    uint64_t quotes = 0;
+    uint64_t nonAscii = 0;
+
+    CsvBlockMasks() = default;
+
+    /** Scan the len bytes at p, which may be fewer than 64.  quote is the
+        quote character as an unsigned char, or -1 if quotes aren't
+        special.
+    */
+    CsvBlockMasks(const char * p, size_t len, char separator, int quote)
+    {
+        char buf[SCAN_BLOCK_SIZE];
+        uint64_t valid = ~0ULL;
+        if (MLDB_UNLIKELY(len < SCAN_BLOCK_SIZE)) {
+            // Don't read past the end of the text
+            std::memcpy(buf, p, len);
+            std::memset(buf + len, 0, SCAN_BLOCK_SIZE - len);
+            p = buf;
+            valid = (1ULL << len) - 1;
+        }
+
+        separators = matchMask64(p, separator) & valid;
+        if (quote != -1)
+            quotes = matchMask64(p, quote) & valid;
+        nonAscii = nonAsciiMask64(p);
+    }
+};
+
+
+/*****************************************************************************/
+/* CSV FIELD SCANNER                                                         */
+/*****************************************************************************/
+
+/** Splits a line of delimited text into fields, finding the separators
+    64 bytes at a time rather than one character at a time.
+
+    Separators within quotes don't end a field.  Which bytes are quoted is
+    worked out for a whole block at once from the prefix XOR of the quote
+    mask (as simdjson does), with each quote character opening or closing
+    a quoted region; a doubled quote closes the region and opens it again
+    straight away.  This is only the same as a character at a time CSV
+    parser when quotes are at the start and end of fields; the caller
+    must check that with the hasQuote flag from fieldEnd(), and fall back
+    on a character at a time parser when it's not the case.
+*/
+
+struct CsvFieldScanner {
+    CsvFieldScanner(const char * start, const char * end,
+                    char separator, int quote)
+        : end(end), separator(separator), quote(quote),
+          blockStart(start), blockLen(0), fieldSeparators(0), quoteCarry(0)
+    {
+    }
+
+    /** Return the end of the field starting at fieldStart: the separator
+        following it, or the end of the line.  Fields must be asked for in
+        order, each starting after the end of the one before.  Sets
+        nonAscii and hasQuote to whether the field has any non-ASCII or
+        quote characters in it.
+    */
+    const char * fieldEnd(const char * fieldStart,
+                          bool & nonAscii, bool & hasQuote)
+    {
+        nonAscii = false;
+        hasQuote = false;
+
+        const char * p = fieldStart;
+
+        while (p < end) {
+            while (p >= blockStart + blockLen)
+                loadBlock();
+
+            unsigned bit = p - blockStart;
+            uint64_t from = ~0ULL << bit;
+            uint64_t seps = fieldSeparators & from;
+            uint64_t before = seps ? (seps & -seps) - 1 : ~0ULL;
+            uint64_t field = from & before;
+
+            nonAscii = nonAscii || (masks.nonAscii & field);
+            hasQuote = hasQuote || (masks.quotes & field);
+
+            if (seps)
+                return blockStart + __builtin_ctzll(seps);
+
+            p = blockStart + blockLen;
+        }
+
+        return end;
+    }
+
+    /** Did the line finish within quotes?  Only valid once fieldEnd() has
+        returned the end of the line.
+    */
+    bool endsInQuote() const
+    {
+        return quoteCarry != 0;
+    }
+
+private:
+    void loadBlock()
+    {
+        blockStart += blockLen;
+        blockLen = std::min<size_t>(SCAN_BLOCK_SIZE, end - blockStart);
+        masks = CsvBlockMasks(blockStart, blockLen, separator, quote);
+
+        uint64_t quoted = prefixXor(masks.quotes) ^ quoteCarry;
+        fieldSeparators = masks.separators & ~quoted;
+        quoteCarry = (uint64_t)((int64_t)quoted >> 63);
+    }
+
+    const char * end;
+    char separator;
+    int quote;
+
+    const char * blockStart;    ///< Start of the block we're on
+    size_t blockLen;            ///< Length of the block we're on
+    CsvBlockMasks masks;        ///< Masks for the block we're on
+    uint64_t fieldSeparators;   ///< Separators that aren't within quotes
+    uint64_t quoteCarry;        ///< All ones if the next block starts quoted
+};
+
+
+/*****************************************************************************/
+/* NEWLINES                                                                  */
+/*****************************************************************************/
+
+/** Return the number of newline characters between start and end. */
+size_t countNewlines(const char * start, const char * end);
+
+/** Append the offset (from base) of each newline character between
+    start and end to offsets, in order.
+*/
+void findNewlines(const char * start, const char * end, const char * base,
+                  std::vector<size_t> & offsets);
+
+} // namespace MLDB
@@ -6,6 +6,7 @@
 */
 
 #include "for_each_line.h"
+#include "csv_scan.h"
 #include <atomic>
 #include <exception>
 #include <mutex>
@@ -294,7 +295,54 @@ void forEachLineBlock(std::istream & stream,
             
             try {
                 //MLDB-1426
-                if (mapped) {
+                if (mapped && maxLines == -1) {
+                    // We only need to know where our block ends and how
+                    // many lines are in it before the next block can be
+                    // started, so that's all that's done before handing
+                    // over.  Finding where each line starts happens
+                    // in parallel with the following blocks.
+                    const char * start = mapped + stream.tellg();
+                    const char * end = mapped + mappedSize;
+
+                    // Our block ends after the first newline once it's
+                    // BLOCK_SIZE long, or at the end of the data.  current
+                    // is null if the data ends without a newline.
+                    const char * current = end;
+                    if (start < end) {
+                        const char * searchFrom
+                            = start + std::min<int64_t>(BLOCK_SIZE - 1,
+                                                        end - start - 1);
+                        current = (const char *)
+                            memchr(searchFrom, '\n', end - searchFrom);
+                        if (current)
+                            ++current;
+                    }
+
+                    const char * blockEnd = current ? current : end;
+                    doneLines += countNewlines(start, blockEnd) + !current;
+
+                    if (current)
+                        stream.seekg(current - start, ios::cur);
+
+                    myChunkNumber = chunkNumber++;
+
+                    if (current && current < end) {
+                        // Ready for another chunk
+                        tp.add(doBlock);
+                    } else if (current == end) {
+                        lastBlock = true;
+                    }
+
+                    findNewlines(start, blockEnd, start, lineOffsets);
+                    if (!current) {
+                        // Last line has no newline
+                        lineOffsets.push_back(end - start);
+                    }
+
+                    blockOut = std::shared_ptr<const char>(start,
+                                                           [] (const char *) {});
+                }
+                else if (mapped) {
                     const char * start = mapped + stream.tellg();
                     const char * current = start;
                     const char * end = mapped + mappedSize;
@@ -0,0 +1,399 @@
+/** hnsw_index.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Hierarchical navigable small world graph.
+*/
+
+#include "hnsw_index.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/types/db/persistent.h"
+#include <algorithm>
+#include <queue>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+namespace {
+
+/** Set of items that have been looked at by a search.  Rather than
+    clearing it for each search, each search has a new tag, and an item
+    has been visited if it's marked with the current tag.  There is one
+    per thread so that searches can run in parallel.
+*/
+struct VisitedSet {
+    std::vector<uint32_t> tags;
+    uint32_t tag = 0;
+
+    void reset(size_t numItems)
+    {
+        if (tags.size() < numItems)
+            tags.resize(numItems, 0);
+        if (++tag == 0) {
+            std::fill(tags.begin(), tags.end(), 0);
+            tag = 1;
+        }
+    }
+
+    /// Mark item as visited, returning true if it wasn't already
+    bool visit(int item)
+    {
+        if (tags[item] == tag)
+            return false;
+        tags[item] = tag;
+        return true;
+    }
+};
+
+thread_local VisitedSet visitedSet;
+
+// Mix the bits of x (from splitmix64)
+uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+HnswIndex::
+HnswIndex(int M, int efConstruction, uint64_t seed)
+    : M(M), M0(2 * M), efConstruction(efConstruction), seed(seed),
+      levelMult(1.0 / std::log(std::max(M, 2))),
+      entryPoint(-1), maxLevel(-1)
+{
+    ExcAssertGreaterEqual(M, 2);
+    ExcAssertGreaterEqual(efConstruction, 1);
+}
+
+double
+HnswIndex::
+meanDegree() const
+{
+    if (levels.empty())
+        return 0.0;
+    size_t total = 0;
+    for (size_t i = 0;  i < levels.size();  ++i)
+        total += links0[i * (M0 + 1)];
+    return 1.0 * total / levels.size();
+}
+
+int
+HnswIndex::
+randomLevel(int item) const
+{
+    // Uniform in (0, 1]
+    double u = ((mix64(seed ^ mix64(item)) >> 11) + 1) * 0x1.0p-53;
+    double level = std::floor(-std::log(u) * levelMult);
+    return std::min<double>(level, 255);
+}
+
+int
+HnswIndex::
+numLinks(int item, int level) const
+{
+    if (level == 0)
+        return links0[item * (M0 + 1)];
+    return upperLinks.at(item)[level - 1].size();
+}
+
+const int *
+HnswIndex::
+getLinks(int item, int level) const
+{
+    if (level == 0)
+        return &links0[item * (M0 + 1) + 1];
+    return upperLinks.at(item)[level - 1].data();
+}
+
+void
+HnswIndex::
+setLinks(int item, int level, const std::vector<int> & links)
+{
+    if (level == 0) {
+        ExcAssertLessEqual(links.size(), M0);
+        int * p = &links0[item * (M0 + 1)];
+        p[0] = links.size();
+        std::copy(links.begin(), links.end(), p + 1);
+    }
+    else {
+        upperLinks[item][level - 1] = links;
+    }
+}
+
+std::vector<HnswIndex::Candidate>
+HnswIndex::
+searchLevel(const std::vector<Candidate> & entryPoints,
+            int ef, int level,
+            const std::function<float (int)> & dist,
+            size_t & numDistances) const
+{
+    // Closest unexpanded candidate first
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        std::greater<Candidate> > candidates;
+    // Furthest of the ef best found so far first
+    std::priority_queue<Candidate> found;
+
+    VisitedSet & visited = visitedSet;
+    visited.reset(levels.size());
+
+    for (auto & e: entryPoints) {
+        visited.visit(e.second);
+        candidates.push(e);
+        found.push(e);
+    }
+    while (found.size() > ef)
+        found.pop();
+
+    while (!candidates.empty()) {
+        Candidate current = candidates.top();
+        if (current.first > found.top().first && found.size() >= ef)
+            break;
+        candidates.pop();
+
+        const int * links = getLinks(current.second, level);
+        int n = numLinks(current.second, level);
+
+        for (int i = 0;  i < n;  ++i) {
+            int neighbor = links[i];
+            if (!visited.visit(neighbor))
+                continue;
+            float d = dist(neighbor);
+            ++numDistances;
+            if (found.size() < ef || d < found.top().first) {
+                candidates.emplace(d, neighbor);
+                found.emplace(d, neighbor);
+                if (found.size() > ef)
+                    found.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> result(found.size());
+    for (size_t i = result.size();  i > 0;  --i) {
+        result[i - 1] = found.top();
+        found.pop();
+    }
+    return result;
+}
+
+std::vector<int>
+HnswIndex::
+selectNeighbors(const std::vector<Candidate> & candidates,
+                int maxLinks,
+                const std::function<float (int, int)> & dist) const
+{
+    std::vector<int> result;
+    std::vector<int> discarded;
+
+    for (auto & c: candidates) {
+        if (result.size() >= maxLinks)
+            break;
+        bool keep = true;
+        for (int r: result) {
+            if (dist(c.second, r) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep)
+            result.push_back(c.second);
+        else discarded.push_back(c.second);
+    }
+
+    // Keep the pruned connections to fill up the links, so that items in
+    // tight clusters stay well connected
+    for (size_t i = 0;  i < discarded.size() && result.size() < maxLinks;  ++i)
+        result.push_back(discarded[i]);
+
+    return result;
+}
+
+void
+HnswIndex::
+insert(int item, const std::function<float (int, int)> & dist)
+{
+    ExcAssertEqual(item, levels.size());
+
+    int level = randomLevel(item);
+
+    if (maxLevel == -1) {
+        levels.push_back(level);
+        links0.resize(M0 + 1, 0);
+        if (level > 0)
+            upperLinks[item].resize(level);
+        entryPoint = item;
+        maxLevel = level;
+        return;
+    }
+
+    // First, work out the new links without touching the graph, so that
+    // an exception from dist leaves the index as it was.
+
+    auto distToItem = [&] (int other) { return dist(item, other); };
+    size_t numDistances = 0;
+
+    std::vector<Candidate> entryPoints
+        = { { distToItem(entryPoint), entryPoint } };
+
+    // Greedy descent through the levels above that of the new item
+    for (int l = maxLevel;  l > level;  --l) {
+        entryPoints = searchLevel(entryPoints, 1, l, distToItem,
+                                  numDistances);
+    }
+
+    int topLevel = std::min(level, maxLevel);
+
+    // Links of the new item, per level
+    std::vector<std::vector<int> > newLinks(topLevel + 1);
+
+    // (neighbor, level, links) for neighbors whose links change
+    std::vector<std::tuple<int, int, std::vector<int> > > updatedLinks;
+
+    for (int l = topLevel;  l >= 0;  --l) {
+        entryPoints = searchLevel(entryPoints, efConstruction, l, distToItem,
+                                  numDistances);
+        newLinks[l] = selectNeighbors(entryPoints, M, dist);
+
+        int maxLinks = l == 0 ? M0 : M;
+
+        for (int neighbor: newLinks[l]) {
+            const int * links = getLinks(neighbor, l);
+            int n = numLinks(neighbor, l);
+
+            std::vector<int> updated(links, links + n);
+            updated.push_back(item);
+
+            if (updated.size() > maxLinks) {
+                // Too many; choose the best ones again
+                std::vector<Candidate> candidates;
+                candidates.reserve(updated.size());
+                for (int other: updated)
+                    candidates.emplace_back(dist(neighbor, other), other);
+                std::sort(candidates.begin(), candidates.end());
+                updated = selectNeighbors(candidates, maxLinks, dist);
+            }
+
+            updatedLinks.emplace_back(neighbor, l, std::move(updated));
+        }
+    }
+
+    // Now we can modify the graph
+    levels.push_back(level);
+    links0.resize(levels.size() * (M0 + 1), 0);
+    if (level > 0)
+        upperLinks[item].resize(level);
+
+    for (int l = 0;  l <= topLevel;  ++l)
+        setLinks(item, l, newLinks[l]);
+
+    for (auto & u: updatedLinks)
+        setLinks(std::get<0>(u), std::get<1>(u), std::get<2>(u));
+
+    if (level > maxLevel) {
+        entryPoint = item;
+        maxLevel = level;
+    }
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+search(const std::function<float (int)> & dist,
+       int k, int ef, float maxDistance,
+       size_t * numDistances) const
+{
+    if (maxLevel == -1 || k <= 0)
+        return {};
+
+    size_t distances = 1;
+
+    std::vector<Candidate> entryPoints = { { dist(entryPoint), entryPoint } };
+
+    for (int l = maxLevel;  l > 0;  --l)
+        entryPoints = searchLevel(entryPoints, 1, l, dist, distances);
+
+    auto found = searchLevel(entryPoints, std::max(ef, k), 0, dist, distances);
+
+    if (numDistances)
+        *numDistances += distances;
+
+    std::vector<std::pair<float, int> > result;
+    for (auto & f: found) {
+        if (result.size() == k || f.first > maxDistance)
+            break;
+        result.push_back(f);
+    }
+
+    return result;
+}
+
+size_t
+HnswIndex::
+memusage() const
+{
+    size_t result = sizeof(*this)
+        + levels.capacity()
+        + links0.capacity() * sizeof(int);
+    for (auto & u: upperLinks) {
+        result += sizeof(u);
+        for (auto & l: u.second)
+            result += sizeof(l) + l.capacity() * sizeof(int);
+    }
+    return result;
+}
+
+void
+HnswIndex::
+serialize(DB::Store_Writer & store) const
+{
+    using namespace MLDB::DB;
+    store << compact_size_t(1)  // version
+          << compact_size_t(M) << compact_size_t(efConstruction) << seed
+          << entryPoint << maxLevel << levels << links0;
+
+    // Upper links go in item order, for the items with a level above 0
+    for (size_t i = 0;  i < levels.size();  ++i) {
+        if (levels[i] == 0)
+            continue;
+        store << upperLinks.at(i);
+    }
+}
+
+void
+HnswIndex::
+reconstitute(DB::Store_Reader & store)
+{
+    using namespace MLDB::DB;
+    compact_size_t version(store);
+    ExcAssertEqual(version, 1);
+
+    compact_size_t newM(store), newEfConstruction(store);
+    HnswIndex result(newM, newEfConstruction);
+    store >> result.seed >> result.entryPoint >> result.maxLevel
+          >> result.levels >> result.links0;
+
+    ExcAssertEqual(result.links0.size(),
+                   result.levels.size() * (result.M0 + 1));
+
+    for (size_t i = 0;  i < result.levels.size();  ++i) {
+        if (result.levels[i] == 0)
+            continue;
+        auto & links = result.upperLinks[i];
+        store >> links;
+        ExcAssertEqual(links.size(), result.levels[i]);
+    }
+
+    *this = std::move(result);
+}
+
+} // namespace MLDB
@@ -0,0 +1,156 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    Hierarchical navigable small world graph for approximate nearest
+    neighbour search.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include "mldb/types/db/persistent_fwd.h"
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Approximate nearest neighbour index over items numbered 0 to n - 1,
+    following Malkov and Yashunin, "Efficient and robust approximate
+    nearest neighbor search using Hierarchical Navigable Small World
+    graphs".
+
+    The index doesn't know anything about the items themselves; distances
+    are obtained through a function passed in to each call, which means
+    that it can be used with any metric.  Items are added one at a time,
+    and the index can be searched at any point.
+
+    It is not thread safe to insert into the index while it is being
+    searched; searching from several threads at once is fine.
+*/
+
+struct HnswIndex {
+
+    /** Create an empty index.  M is the number of links each item has to
+        its neighbours on the upper levels (there are twice as many on the
+        bottom level); efConstruction is the number of candidates looked
+        at when finding the neighbours of an inserted item.  Larger values
+        of both give better recall for a slower build.  seed determines
+        which items are put on the upper levels.
+    */
+    HnswIndex(int M = 16, int efConstruction = 200, uint64_t seed = 0);
+
+    /// Number of items in the index
+    size_t size() const
+    {
+        return levels.size();
+    }
+
+    /// Number of levels of the graph, including the bottom one
+    int numLevels() const
+    {
+        return maxLevel + 1;
+    }
+
+    /// Average number of neighbours of each item on the bottom level
+    double meanDegree() const;
+
+    int getM() const { return M; }
+    int getEfConstruction() const { return efConstruction; }
+
+    /** Insert the given item, which must be numbered size().  dist(a, b)
+        returns the distance between items a and b; it will only be called
+        with items that are in the index or the one being inserted.  If
+        dist throws, the index is left unchanged.
+    */
+    void insert(int item, const std::function<float (int, int)> & dist);
+
+    /** Return (up to) the k items nearest to a query point, as (distance,
+        item) pairs in order of increasing distance.  dist(i) returns the
+        distance between the query point and item i.  ef is the number of
+        candidates kept during the search; it's the knob that trades
+        recall for speed, and is always at least k.  Items further than
+        maxDistance from the query point are not returned.
+
+        If numDistances is non-null, the number of calls to dist is
+        added to it.
+    */
+    std::vector<std::pair<float, int> >
+    search(const std::function<float (int)> & dist,
+           int k, int ef, float maxDistance = INFINITY,
+           size_t * numDistances = nullptr) const;
+
+    /// Approximate memory usage of the index, in bytes
+    size_t memusage() const;
+
+    void serialize(DB::Store_Writer & store) const;
+    void reconstitute(DB::Store_Reader & store);
+
+private:
+    int M;                ///< Maximum links per item on upper levels
+    int M0;               ///< Maximum links per item on the bottom level
+    int efConstruction;   ///< Candidates considered when inserting
+    uint64_t seed;        ///< Seed for the choice of levels
+    double levelMult;     ///< 1 / ln(M), scale of the level distribution
+
+    int entryPoint;       ///< Item on the top level that searches start at
+    int maxLevel;         ///< Top level of the graph; -1 if empty
+
+    /// Top level of each item
+    std::vector<uint8_t> levels;
+
+    /** Links on the bottom level, M0 + 1 entries per item: the number of
+        links and then the linked items.
+    */
+    std::vector<int> links0;
+
+    /** Links on the upper levels, for the (few) items that have them.
+        Element l - 1 of an item's entry is its neighbours on level l.
+    */
+    std::unordered_map<int, std::vector<std::vector<int> > > upperLinks;
+
+    typedef std::pair<float, int> Candidate;
+
+    /// Pick the level of an item, which is fixed by the item and the seed
+    int randomLevel(int item) const;
+
+    /// Number of links item has on the given level
+    int numLinks(int item, int level) const;
+
+    /// Pointer to the links that item has on the given level
+    const int * getLinks(int item, int level) const;
+
+    /// Replace the links that item has on the given level
+    void setLinks(int item, int level, const std::vector<int> & links);
+
+    /** Find the ef items closest to the query on the given level, starting
+        from the given entry points.  Returns them sorted by increasing
+        distance.
+    */
+    std::vector<Candidate>
+    searchLevel(const std::vector<Candidate> & entryPoints,
+                int ef, int level,
+                const std::function<float (int)> & dist,
+                size_t & numDistances) const;
+
+    /** Choose up to maxLinks neighbours from candidates (sorted by
+        increasing distance to the item they are being chosen for),
+        preferring candidates that aren't closer to an already chosen
+        neighbour than to the item, so that links go off in different
+        directions.
+    */
+    std::vector<int>
+    selectNeighbors(const std::vector<Candidate> & candidates,
+                    int maxLinks,
+                    const std::function<float (int, int)> & dist) const;
+};
+
+} // namespace MLDB
@@ -9,6 +9,7 @@
 #include <cstring>
 #include "mldb/base/exc_assert.h"
 #include "mldb/compiler/compiler.h"
+#include "mldb/base/scratch_arena.h"
 
 // NOTE TO MLDB DEVELOPERS: This is an API header file.  No includes
 // should be added, especially value_description.h.
@@ -25,9 +26,10 @@ namespace MLDB {
 template<size_t Bytes, typename Char = char>
 struct InternedString {
 
-    // Max Bytes is 255, as otherwise we can't determine the length
-    static_assert(Bytes < 256, "First template parameter for InternedString "
-                  "must be 255 or less");
+    // Max Bytes is 253, as otherwise we can't tell the length from the
+    // markers for external storage
+    static_assert(Bytes < 254, "First template parameter for "
+                  "InternedString must be 253 or less");
 
     // Only POD types can be used so that Reserve can use memcpy and
     // not need to handle exceptions
@@ -59,7 +61,7 @@ struct InternedString {
         if (other.length() > Bytes) {
             // Can't fit internally.  If the other is external, steal it
             if (other.isExt()) {
-                intLength_ = IS_EXT;
+                intLength_ = other.intLength_;
                 extLength_ = other.extLength_;
                 extCapacity_ = other.extCapacity_;
                 extBytes_ = other.extBytes_;
@@ -189,9 +191,15 @@ struct InternedString {
         if (newCapacity < capacity())
             return;
 
-        bool wasExt = isExt();
-
-        char * newBytes = new Char[newCapacity];
+        // Strings built while a query is evaluated come from its scratch
+        // arena, under a scope for values
+        uint8_t newExt = IS_EXT_SCRATCH;
+        Char * newBytes
+            = (Char *)ScratchArena::tryAllocate(newCapacity * sizeof(Char));
+        if (!newBytes) {
+            newBytes = new Char[newCapacity];
+            newExt = IS_EXT;
+        }
 
         // No possibility of exception from here on because Char is a
         // POD type.  So we don't need to use a smart pointer to guarantee
@@ -199,13 +207,13 @@ struct InternedString {
 
         size_t l = size();
         std::memcpy(newBytes, data(), l);
-        intLength_ = IS_EXT;
-        extLength_ = l;
-        extCapacity_ = newCapacity;
 
-        if (wasExt)
-            delete[] extBytes_;
+        if (isExt())
+            deleteExt();
 
+        intLength_ = newExt;
+        extLength_ = l;
+        extCapacity_ = newCapacity;
         extBytes_ = newBytes;
     }
 
@@ -256,15 +264,18 @@ private:
     friend class InternedString;
 
 public:
-    bool isExt() const noexcept { return intLength_ == IS_EXT; }
+    bool isExt() const noexcept { return intLength_ >= IS_EXT_SCRATCH; }
 
 private:
     void deleteExt()
     {
-        delete[] extBytes_;
+        if (intLength_ == IS_EXT_SCRATCH)
+            ScratchArena::deallocate(extBytes_);
+        else delete[] extBytes_;
     }
 
-    static constexpr uint8_t IS_EXT = 255;
+    static constexpr uint8_t IS_EXT = 255;          ///< External, on heap
+    static constexpr uint8_t IS_EXT_SCRATCH = 254;  ///< External, in arena
     static constexpr size_t INTERNAL_BYTES = Bytes;
     static constexpr size_t NUM_WORDS = (Bytes + 9) / 8;
 
@@ -273,7 +284,7 @@ public:
         struct {
             // NOTE: these need to be OUTSIDE of the internal/external union
             // as otherwise clang gets undefined behavior 
-            uint8_t intLength_;  // if -1, it's external.
+            uint8_t intLength_;  // if IS_EXT or IS_EXT_SCRATCH, it's external.
             char intBytes_[3];
             union {
                 struct {
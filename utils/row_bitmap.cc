@@ -0,0 +1,341 @@
+/** row_bitmap.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Compressed bitmap of row numbers.
+*/
+
+#include "row_bitmap.h"
+#include "mldb/base/exc_assert.h"
+#include <algorithm>
+#include <iterator>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ROW BITMAP                                                                */
+/*****************************************************************************/
+
+RowBitmap::
+RowBitmap(const std::vector<uint32_t> & rows)
+{
+    for (uint32_t r: rows)
+        append(r);
+
+    // We won't be appending any more, so don't keep spare capacity
+    for (auto & c: containers)
+        c.array.shrink_to_fit();
+    containers.shrink_to_fit();
+}
+
+size_t
+RowBitmap::
+size() const
+{
+    size_t result = 0;
+    for (auto & c: containers)
+        result += c.count;
+    return result;
+}
+
+bool
+RowBitmap::Container::
+contains(uint16_t low) const
+{
+    if (isBitmap())
+        return bits[low / 64] & (uint64_t(1) << (low % 64));
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void
+RowBitmap::Container::
+normalize()
+{
+    if (isBitmap() && count <= MAX_ARRAY) {
+        std::vector<uint16_t> newArray;
+        newArray.reserve(count);
+        for (uint32_t w = 0;  w < NUM_WORDS;  ++w) {
+            for (uint64_t word = bits[w];  word;  word &= word - 1)
+                newArray.push_back(w * 64 + lowest_bit(word));
+        }
+        array.swap(newArray);
+        std::vector<uint64_t>().swap(bits);
+    }
+    else if (!isBitmap() && count > MAX_ARRAY) {
+        bits.resize(NUM_WORDS, 0);
+        for (uint16_t low: array)
+            bits[low / 64] |= uint64_t(1) << (low % 64);
+        std::vector<uint16_t>().swap(array);
+    }
+}
+
+bool
+RowBitmap::
+contains(uint32_t row) const
+{
+    uint16_t key = row >> 16;
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [] (const Container & c, uint16_t key)
+                               {
+                                   return c.key < key;
+                               });
+    return it != containers.end() && it->key == key
+        && it->contains(row & 0xffff);
+}
+
+void
+RowBitmap::
+append(uint32_t row)
+{
+    uint16_t key = row >> 16;
+    uint16_t low = row & 0xffff;
+
+    if (containers.empty() || containers.back().key != key) {
+        ExcAssert(containers.empty() || containers.back().key < key);
+        containers.emplace_back();
+        containers.back().key = key;
+    }
+
+    Container & c = containers.back();
+    if (c.isBitmap()) {
+        ExcAssert((c.bits[low / 64] >> (low % 64)) == 0);
+        c.bits[low / 64] |= uint64_t(1) << (low % 64);
+    }
+    else {
+        ExcAssert(c.array.empty() || c.array.back() < low);
+        c.array.push_back(low);
+    }
+    c.count += 1;
+    c.normalize();
+}
+
+RowBitmap::Container
+RowBitmap::
+intersect(const Container & c1, const Container & c2)
+{
+    Container result;
+    result.key = c1.key;
+
+    if (c1.isBitmap() && c2.isBitmap()) {
+        result.bits.resize(NUM_WORDS);
+        for (uint32_t w = 0;  w < NUM_WORDS;  ++w) {
+            result.bits[w] = c1.bits[w] & c2.bits[w];
+            result.count += num_bits_set(result.bits[w]);
+        }
+    }
+    else if (c1.isBitmap() || c2.isBitmap()) {
+        const Container & arr = c1.isBitmap() ? c2 : c1;
+        const Container & bm = c1.isBitmap() ? c1 : c2;
+        for (uint16_t low: arr.array) {
+            if (bm.contains(low))
+                result.array.push_back(low);
+        }
+        result.count = result.array.size();
+    }
+    else {
+        std::set_intersection(c1.array.begin(), c1.array.end(),
+                              c2.array.begin(), c2.array.end(),
+                              std::back_inserter(result.array));
+        result.count = result.array.size();
+    }
+
+    result.normalize();
+    return result;
+}
+
+RowBitmap::Container
+RowBitmap::
+unite(const Container & c1, const Container & c2)
+{
+    Container result;
+    result.key = c1.key;
+
+    if (c1.isBitmap() || c2.isBitmap()) {
+        const Container & bm = c1.isBitmap() ? c1 : c2;
+        const Container & other = c1.isBitmap() ? c2 : c1;
+        result.bits = bm.bits;
+        if (other.isBitmap()) {
+            for (uint32_t w = 0;  w < NUM_WORDS;  ++w)
+                result.bits[w] |= other.bits[w];
+        }
+        else {
+            for (uint16_t low: other.array)
+                result.bits[low / 64] |= uint64_t(1) << (low % 64);
+        }
+        for (uint64_t word: result.bits)
+            result.count += num_bits_set(word);
+    }
+    else {
+        result.array.reserve(c1.array.size() + c2.array.size());
+        std::set_union(c1.array.begin(), c1.array.end(),
+                       c2.array.begin(), c2.array.end(),
+                       std::back_inserter(result.array));
+        result.count = result.array.size();
+    }
+
+    result.normalize();
+    return result;
+}
+
+RowBitmap
+RowBitmap::
+operator & (const RowBitmap & other) const
+{
+    RowBitmap result;
+    auto it1 = containers.begin(), end1 = containers.end();
+    auto it2 = other.containers.begin(), end2 = other.containers.end();
+
+    while (it1 != end1 && it2 != end2) {
+        if (it1->key < it2->key)
+            ++it1;
+        else if (it2->key < it1->key)
+            ++it2;
+        else {
+            Container c = intersect(*it1++, *it2++);
+            if (c.count)
+                result.containers.emplace_back(std::move(c));
+        }
+    }
+
+    return result;
+}
+
+RowBitmap
+RowBitmap::
+operator | (const RowBitmap & other) const
+{
+    RowBitmap result;
+    result.containers.reserve(containers.size() + other.containers.size());
+    auto it1 = containers.begin(), end1 = containers.end();
+    auto it2 = other.containers.begin(), end2 = other.containers.end();
+
+    while (it1 != end1 && it2 != end2) {
+        if (it1->key < it2->key)
+            result.containers.push_back(*it1++);
+        else if (it2->key < it1->key)
+            result.containers.push_back(*it2++);
+        else result.containers.emplace_back(unite(*it1++, *it2++));
+    }
+
+    result.containers.insert(result.containers.end(), it1, end1);
+    result.containers.insert(result.containers.end(), it2, end2);
+
+    return result;
+}
+
+RowBitmap
+RowBitmap::
+unionOf(const std::vector<const RowBitmap *> & sets)
+{
+    // Gather the containers for each key across all of the sets, and
+    // merge each group in one pass rather than pairwise
+    std::vector<const Container *> all;
+    for (auto s: sets) {
+        for (auto & c: s->containers)
+            all.push_back(&c);
+    }
+
+    std::stable_sort(all.begin(), all.end(),
+                     [] (const Container * c1, const Container * c2)
+                     {
+                         return c1->key < c2->key;
+                     });
+
+    RowBitmap result;
+
+    for (size_t i = 0;  i < all.size();  /* no inc */) {
+        size_t j = i + 1;
+        size_t total = all[i]->count;
+        for (; j < all.size() && all[j]->key == all[i]->key;  ++j)
+            total += all[j]->count;
+
+        if (j == i + 1) {
+            result.containers.push_back(*all[i]);
+            i = j;
+            continue;
+        }
+
+        Container c;
+        c.key = all[i]->key;
+
+        if (total <= MAX_ARRAY) {
+            // All are arrays, since a bitmap has more than MAX_ARRAY rows
+            c.array.reserve(total);
+            for (size_t k = i;  k < j;  ++k) {
+                c.array.insert(c.array.end(),
+                               all[k]->array.begin(), all[k]->array.end());
+            }
+            std::sort(c.array.begin(), c.array.end());
+            c.array.erase(std::unique(c.array.begin(), c.array.end()),
+                          c.array.end());
+            c.count = c.array.size();
+        }
+        else {
+            c.bits.resize(NUM_WORDS, 0);
+            for (size_t k = i;  k < j;  ++k) {
+                if (all[k]->isBitmap()) {
+                    for (uint32_t w = 0;  w < NUM_WORDS;  ++w)
+                        c.bits[w] |= all[k]->bits[w];
+                }
+                else {
+                    for (uint16_t low: all[k]->array)
+                        c.bits[low / 64] |= uint64_t(1) << (low % 64);
+                }
+            }
+            for (uint64_t word: c.bits)
+                c.count += num_bits_set(word);
+        }
+
+        c.normalize();
+        result.containers.emplace_back(std::move(c));
+        i = j;
+    }
+
+    return result;
+}
+
+std::vector<uint32_t>
+RowBitmap::
+toVector() const
+{
+    std::vector<uint32_t> result;
+    result.reserve(size());
+    forEach([&] (uint32_t row) { result.push_back(row);  return true; });
+    return result;
+}
+
+size_t
+RowBitmap::
+memusage() const
+{
+    size_t result = sizeof(*this)
+        + containers.capacity() * sizeof(Container);
+    for (auto & c: containers) {
+        result += c.array.capacity() * sizeof(uint16_t)
+            + c.bits.capacity() * sizeof(uint64_t);
+    }
+    return result;
+}
+
+bool
+RowBitmap::
+operator == (const RowBitmap & other) const
+{
+    if (containers.size() != other.containers.size())
+        return false;
+    for (size_t i = 0;  i < containers.size();  ++i) {
+        const Container & c1 = containers[i];
+        const Container & c2 = other.containers[i];
+        // Representation is determined by the count, so it's the same
+        if (c1.key != c2.key || c1.count != c2.count
+            || c1.array != c2.array || c1.bits != c2.bits)
+            return false;
+    }
+    return true;
+}
+
+} // namespace MLDB
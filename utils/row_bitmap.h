@@ -0,0 +1,142 @@
+/** row_bitmap.h                                                    -*- C++ -*-
+    Compressed bitmap of row numbers.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include "mldb/arch/bitops.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* ROW BITMAP                                                                */
+/*****************************************************************************/
+
+/** Compressed set of 32 bit row numbers, following Chambi et al, "Better
+    bitmap performance with Roaring bitmaps".
+
+    Row numbers are split into chunks of 65536 by their high 16 bits, and
+    each chunk that has rows in it gets a container holding the low 16
+    bits: a sorted array if it has at most 4096 rows, or a 65536 bit
+    bitmap otherwise.  Neither takes more than 8kb, and intersections and
+    unions work one container at a time, so dense and sparse sets are both
+    cheap to store and to combine.
+
+    Sets are immutable once built, apart from append(), and so can be
+    read from several threads at once.
+*/
+
+struct RowBitmap {
+    RowBitmap() = default;
+
+    /** Construct from a list of row numbers, which must be sorted in
+        increasing order with no duplicates.
+    */
+    explicit RowBitmap(const std::vector<uint32_t> & rows);
+
+    /// Number of rows in the set
+    size_t size() const;
+
+    /// Is the set empty?
+    bool empty() const
+    {
+        return containers.empty();
+    }
+
+    /// Is the given row in the set?
+    bool contains(uint32_t row) const;
+
+    /** Add a row to the set, which must be greater than all of the rows
+        that are already there.
+    */
+    void append(uint32_t row);
+
+    /// Rows that are in both sets
+    RowBitmap operator & (const RowBitmap & other) const;
+
+    /// Rows that are in either set
+    RowBitmap operator | (const RowBitmap & other) const;
+
+    /** Rows that are in any of the given sets.  This is much faster than
+        a chain of | operators when there are many sets.
+    */
+    static RowBitmap unionOf(const std::vector<const RowBitmap *> & sets);
+
+    /** Call onRow for each row in increasing order.  Stops and returns
+        false as soon as onRow returns false.
+    */
+    template<typename Fn>
+    bool forEach(Fn && onRow) const
+    {
+        for (auto & c: containers) {
+            uint32_t high = uint32_t(c.key) << 16;
+            if (c.isBitmap()) {
+                for (uint32_t w = 0;  w < c.bits.size();  ++w) {
+                    for (uint64_t word = c.bits[w];  word;  word &= word - 1) {
+                        if (!onRow(high | (w * 64 + lowest_bit(word))))
+                            return false;
+                    }
+                }
+            }
+            else {
+                for (uint16_t low: c.array) {
+                    if (!onRow(high | low))
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /// Return the rows as a sorted vector
+    std::vector<uint32_t> toVector() const;
+
+    /// Number of bytes of memory used by the containers
+    size_t memusage() const;
+
+    bool operator == (const RowBitmap & other) const;
+
+    bool operator != (const RowBitmap & other) const
+    {
+        return !operator == (other);
+    }
+
+private:
+    /// Maximum number of rows in an array container
+    static constexpr uint32_t MAX_ARRAY = 4096;
+
+    /// Number of 64 bit words in a bitmap container
+    static constexpr uint32_t NUM_WORDS = 65536 / 64;
+
+    struct Container {
+        uint16_t key = 0;              ///< High 16 bits of the rows
+        uint32_t count = 0;            ///< Number of rows
+        std::vector<uint16_t> array;   ///< Sorted low bits, for an array
+        std::vector<uint64_t> bits;    ///< NUM_WORDS words, for a bitmap
+
+        bool isBitmap() const
+        {
+            return !bits.empty();
+        }
+
+        bool contains(uint16_t low) const;
+
+        /// Convert to the representation that suits the count
+        void normalize();
+    };
+
+    static Container intersect(const Container & c1, const Container & c2);
+    static Container unite(const Container & c1, const Container & c2);
+
+    /// Containers with at least one row, sorted by key
+    std::vector<Container> containers;
+};
+
+} // namespace MLDB
@@ -0,0 +1,199 @@
+/* csv_scan_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the block at a time CSV scanning gives the same answers as
+   looking at one character at a time.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/csv_scan.h"
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+// Random text made mostly of the characters the scanner cares about
+string randomText(std::mt19937 & rng, size_t length)
+{
+    static const char chars[] = { 'a', 'b', ',', ',', '"', '"', '\n', '\xc3', '\xa9', ' ' };
+    string result;
+    for (size_t i = 0;  i < length;  ++i)
+        result += chars[rng() % sizeof(chars)];
+    return result;
+}
+
+struct Field {
+    size_t end;
+    bool nonAscii;
+    bool hasQuote;
+
+    bool operator == (const Field & other) const
+    {
+        return end == other.end && nonAscii == other.nonAscii
+            && hasQuote == other.hasQuote;
+    }
+
+    bool operator != (const Field & other) const
+    {
+        return !operator == (other);
+    }
+};
+
+std::ostream & operator << (std::ostream & stream, const Field & field)
+{
+    return stream << "(" << field.end << "," << field.nonAscii << ","
+                  << field.hasQuote << ")";
+}
+
+// Each quote opens or closes a quoted region; separators in quoted regions
+// don't count
+vector<Field> referenceFields(const string & text, char separator, int quote)
+{
+    vector<Field> result;
+    bool inQuote = false;
+    Field current{0, false, false};
+
+    for (size_t i = 0;  i < text.size();  ++i) {
+        char c = text[i];
+        if (quote != -1 && c == (char)quote) {
+            inQuote = !inQuote;
+            current.hasQuote = true;
+        }
+        else if (c == separator && !inQuote) {
+            current.end = i;
+            result.push_back(current);
+            current = Field{0, false, false};
+            continue;
+        }
+        if ((unsigned char)c >= 128)
+            current.nonAscii = true;
+    }
+
+    current.end = text.size();
+    result.push_back(current);
+    return result;
+}
+
+vector<Field> scannedFields(const string & text, char separator, int quote)
+{
+    vector<Field> result;
+    const char * start = text.data();
+    const char * end = start + text.size();
+    CsvFieldScanner scanner(start, end, separator, quote);
+
+    const char * p = start;
+    for (;;) {
+        Field field;
+        const char * fieldEnd = scanner.fieldEnd(p, field.nonAscii,
+                                                 field.hasQuote);
+        field.end = fieldEnd - start;
+        result.push_back(field);
+        if (fieldEnd == end)
+            break;
+        p = fieldEnd + 1;
+    }
+
+    return result;
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_block_masks )
+{
+    std::mt19937 rng(1);
+
+    for (size_t len = 0;  len <= SCAN_BLOCK_SIZE;  ++len) {
+        string text = randomText(rng, SCAN_BLOCK_SIZE);
+        CsvBlockMasks masks(text.data(), len, ',', '"');
+
+        uint64_t separators = 0, quotes = 0, nonAscii = 0;
+        for (size_t i = 0;  i < len;  ++i) {
+            separators |= uint64_t(text[i] == ',') << i;
+            quotes |= uint64_t(text[i] == '"') << i;
+            nonAscii |= uint64_t((unsigned char)text[i] >= 128) << i;
+        }
+
+        BOOST_CHECK_EQUAL(masks.separators, separators);
+        BOOST_CHECK_EQUAL(masks.quotes, quotes);
+        BOOST_CHECK_EQUAL(masks.nonAscii, nonAscii);
+
+        CsvBlockMasks noQuotes(text.data(), len, ',', -1);
+        BOOST_CHECK_EQUAL(noQuotes.quotes, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_prefix_xor )
+{
+    std::mt19937_64 rng(2);
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        uint64_t x = rng();
+        uint64_t expected = 0;
+        bool parity = false;
+        for (unsigned b = 0;  b < 64;  ++b) {
+            parity ^= (x >> b) & 1;
+            expected |= uint64_t(parity) << b;
+        }
+        BOOST_CHECK_EQUAL(prefixXor(x), expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_field_scanner )
+{
+    std::mt19937 rng(3);
+
+    // Lengths chosen so that fields and quoted regions cross block
+    // boundaries, and the last block is both full and partial
+    for (unsigned i = 0;  i < 2000;  ++i) {
+        string text = randomText(rng, rng() % 300);
+        for (int quote: { -1, (int)'"' }) {
+            auto expected = referenceFields(text, ',', quote);
+            auto scanned = scannedFields(text, ',', quote);
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(scanned.begin(), scanned.end(),
+                                            expected.begin(), expected.end());
+        }
+    }
+
+    // Quoted separators that go past the end of a block
+    string text = "\"" + string(100, ',') + "\",x";
+    auto scanned = scannedFields(text, ',', '"');
+    BOOST_REQUIRE_EQUAL(scanned.size(), 2);
+    BOOST_CHECK_EQUAL(scanned[0].end, 102);
+    BOOST_CHECK(scanned[0].hasQuote);
+    BOOST_CHECK(!scanned[1].hasQuote);
+}
+
+BOOST_AUTO_TEST_CASE( test_newlines )
+{
+    std::mt19937 rng(4);
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        string text = randomText(rng, rng() % 500);
+        size_t offset = rng() % (text.size() + 1);
+        const char * start = text.data() + offset;
+        const char * end = text.data() + text.size();
+
+        vector<size_t> expected;
+        for (const char * p = start;  p < end;  ++p)
+            if (*p == '\n')
+                expected.push_back(p - text.data());
+
+        BOOST_CHECK_EQUAL(countNewlines(start, end), expected.size());
+
+        vector<size_t> found = { 12345 };
+        findNewlines(start, end, text.data(), found);
+        BOOST_REQUIRE_EQUAL(found.size(), expected.size() + 1);
+        BOOST_CHECK_EQUAL(found[0], 12345);
+        BOOST_CHECK_EQUAL_COLLECTIONS(found.begin() + 1, found.end(),
+                                      expected.begin(), expected.end());
+    }
+}
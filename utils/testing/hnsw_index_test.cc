@@ -0,0 +1,212 @@
+/* hnsw_index_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test that the HNSW index finds (almost) the same neighbours as a brute
+   force search.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/hnsw_index.h"
+#include "mldb/types/db/persistent.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <vector>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+struct Points {
+    Points(size_t n, size_t dims, uint32_t seed)
+        : dims(dims), coords(n * dims)
+    {
+        std::mt19937 rng(seed);
+        std::normal_distribution<float> normal;
+        for (auto & c: coords)
+            c = normal(rng);
+    }
+
+    size_t size() const
+    {
+        return coords.size() / dims;
+    }
+
+    float dist(const float * p1, const float * p2) const
+    {
+        float result = 0.0;
+        for (size_t i = 0;  i < dims;  ++i)
+            result += (p1[i] - p2[i]) * (p1[i] - p2[i]);
+        return sqrt(result);
+    }
+
+    const float * operator [] (int i) const
+    {
+        return &coords[i * dims];
+    }
+
+    size_t dims;
+    std::vector<float> coords;
+};
+
+vector<pair<float, int> >
+bruteForce(const Points & points, const float * query, int k)
+{
+    vector<pair<float, int> > all;
+    for (size_t i = 0;  i < points.size();  ++i)
+        all.emplace_back(points.dist(points[i], query), i);
+    std::sort(all.begin(), all.end());
+    all.resize(std::min<size_t>(k, all.size()));
+    return all;
+}
+
+HnswIndex buildIndex(const Points & points, int M, int efConstruction,
+                     size_t numItems = -1)
+{
+    HnswIndex index(M, efConstruction);
+    auto dist = [&] (int i, int j) { return points.dist(points[i], points[j]); };
+    for (size_t i = 0;  i < std::min(numItems, points.size());  ++i)
+        index.insert(i, dist);
+    return index;
+}
+
+// Proportion of the true k nearest neighbours found by the index
+double recall(const HnswIndex & index, const Points & points,
+              const Points & queries, int k, int ef)
+{
+    size_t found = 0;
+    for (size_t q = 0;  q < queries.size();  ++q) {
+        auto dist = [&] (int i) { return points.dist(points[i], queries[q]); };
+        auto approx = index.search(dist, k, ef);
+        auto exact = bruteForce(points, queries[q], k);
+        BOOST_REQUIRE_EQUAL(approx.size(), exact.size());
+        BOOST_CHECK(std::is_sorted(approx.begin(), approx.end()));
+
+        vector<int> approxItems, exactItems;
+        for (auto & a: approx)
+            approxItems.push_back(a.second);
+        for (auto & e: exact)
+            exactItems.push_back(e.second);
+        std::sort(approxItems.begin(), approxItems.end());
+        std::sort(exactItems.begin(), exactItems.end());
+
+        vector<int> common;
+        std::set_intersection(approxItems.begin(), approxItems.end(),
+                              exactItems.begin(), exactItems.end(),
+                              std::back_inserter(common));
+        found += common.size();
+    }
+    return 1.0 * found / (queries.size() * k);
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_empty_and_small )
+{
+    HnswIndex index;
+    BOOST_CHECK_EQUAL(index.size(), 0);
+    BOOST_CHECK(index.search([] (int) -> float { return 0; }, 10, 10).empty());
+
+    // Fewer items than k; all are found exactly
+    Points points(5, 3, 1);
+    index = buildIndex(points, 4, 10);
+    BOOST_CHECK_EQUAL(index.size(), 5);
+
+    auto result = index.search([&] (int i) { return points.dist(points[i], points[2]); },
+                               10, 10);
+    BOOST_REQUIRE_EQUAL(result.size(), 5);
+    BOOST_CHECK_EQUAL(result[0].second, 2);
+    BOOST_CHECK_EQUAL(result[0].first, 0.0);
+
+    // maxDistance excludes items that are too far away
+    result = index.search([&] (int i) { return points.dist(points[i], points[2]); },
+                          10, 10, 0.0);
+    BOOST_REQUIRE_EQUAL(result.size(), 1);
+    BOOST_CHECK_EQUAL(result[0].second, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_recall )
+{
+    Points points(5000, 32, 2);
+    Points queries(100, 32, 3);
+
+    HnswIndex index = buildIndex(points, 16, 100);
+    BOOST_CHECK_EQUAL(index.size(), points.size());
+    BOOST_CHECK_GT(index.numLevels(), 1);
+    BOOST_CHECK_GT(index.meanDegree(), 8);
+
+    double lowEf = recall(index, points, queries, 10, 10);
+    double highEf = recall(index, points, queries, 10, 200);
+
+    cerr << "recall at ef 10 = " << lowEf << " at ef 200 = " << highEf
+         << endl;
+
+    BOOST_CHECK_GT(highEf, 0.95);
+    BOOST_CHECK_GE(highEf, lowEf);
+
+    // A search looks at far fewer than all of the items
+    size_t numDistances = 0;
+    index.search([&] (int i) { return points.dist(points[i], queries[0]); },
+                 10, 50, INFINITY, &numDistances);
+    BOOST_CHECK_LT(numDistances, points.size() / 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_exception_safety )
+{
+    Points points(201, 4, 4);
+    HnswIndex index = buildIndex(points, 8, 20, 200);
+
+    auto before = DB::serializeToString(index);
+
+    // Fail part way through, once the insertion has got going
+    int numCalls = 0;
+    auto throwingDist = [&] (int i, int j) -> float
+        {
+            if (++numCalls > 50)
+                throw std::runtime_error("bad distance");
+            return points.dist(points[i], points[j]);
+        };
+
+    BOOST_CHECK_THROW(index.insert(200, throwingDist), std::exception);
+    BOOST_CHECK_EQUAL(index.size(), 200);
+    BOOST_CHECK(DB::serializeToString(index) == before);
+}
+
+BOOST_AUTO_TEST_CASE( test_serialization )
+{
+    Points points(1001, 8, 5);
+    HnswIndex index = buildIndex(points, 8, 50, 1000);
+
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        index.serialize(store);
+    }
+
+    std::istringstream istream(stream.str());
+    DB::Store_Reader store(istream);
+    HnswIndex index2;
+    index2.reconstitute(store);
+
+    BOOST_CHECK_EQUAL(index2.size(), index.size());
+    BOOST_CHECK_EQUAL(index2.numLevels(), index.numLevels());
+    BOOST_CHECK_EQUAL(index2.getM(), 8);
+
+    for (int q = 0;  q < 20;  ++q) {
+        auto dist = [&] (int i) { return points.dist(points[i], points[q]); };
+        BOOST_CHECK(index.search(dist, 10, 20) == index2.search(dist, 10, 20));
+    }
+
+    // Insertion carries on the same way after reconstitution
+    auto dist = [&] (int i, int j) { return points.dist(points[i], points[j]); };
+    index.insert(1000, dist);
+    index2.insert(1000, dist);
+    BOOST_CHECK(DB::serializeToString(index) == DB::serializeToString(index2));
+}
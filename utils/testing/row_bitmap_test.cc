@@ -0,0 +1,152 @@
+/* row_bitmap_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test of the compressed row bitmap against std::set.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/row_bitmap.h"
+#include "mldb/arch/exception_handler.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+/// Random rows up to maxRow, each kept with probability density
+vector<uint32_t> randomRows(uint32_t maxRow, double density, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::bernoulli_distribution keep(density);
+    vector<uint32_t> result;
+    for (uint32_t i = 0;  i < maxRow;  ++i) {
+        if (keep(rng))
+            result.push_back(i);
+    }
+    return result;
+}
+
+vector<uint32_t> intersection(const vector<uint32_t> & v1,
+                              const vector<uint32_t> & v2)
+{
+    vector<uint32_t> result;
+    std::set_intersection(v1.begin(), v1.end(), v2.begin(), v2.end(),
+                          std::back_inserter(result));
+    return result;
+}
+
+vector<uint32_t> setUnion(const vector<uint32_t> & v1,
+                          const vector<uint32_t> & v2)
+{
+    vector<uint32_t> result;
+    std::set_union(v1.begin(), v1.end(), v2.begin(), v2.end(),
+                   std::back_inserter(result));
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_empty )
+{
+    RowBitmap bm;
+    BOOST_CHECK(bm.empty());
+    BOOST_CHECK_EQUAL(bm.size(), 0);
+    BOOST_CHECK(!bm.contains(0));
+    BOOST_CHECK((bm & bm).empty());
+    BOOST_CHECK((bm | bm).empty());
+    BOOST_CHECK(RowBitmap::unionOf({}).empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_append_and_contains )
+{
+    // Dense enough in the first chunk to be a bitmap, sparse in the others
+    vector<uint32_t> rows = randomRows(300000, 0.05, 1);
+    for (uint32_t i = 0;  i < 20000;  ++i)
+        rows.push_back(1000000 + i * 2);
+
+    RowBitmap bm(rows);
+    BOOST_CHECK_EQUAL(bm.size(), rows.size());
+    BOOST_CHECK(bm.toVector() == rows);
+
+    std::set<uint32_t> rowSet(rows.begin(), rows.end());
+    for (uint32_t i = 0;  i < 1100000;  i += 7)
+        BOOST_CHECK_EQUAL(bm.contains(i), rowSet.count(i));
+
+    // Rows must be appended in increasing order
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(bm.append(5), std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_operators )
+{
+    // Combinations of sparse (array) and dense (bitmap) containers,
+    // including results that change representation
+    vector<double> densities = { 0.001, 0.03, 0.07, 0.5, 0.99 };
+
+    uint32_t seed = 1;
+    for (double d1: densities) {
+        for (double d2: densities) {
+            vector<uint32_t> v1 = randomRows(200000, d1, ++seed);
+            vector<uint32_t> v2 = randomRows(250000, d2, ++seed);
+            RowBitmap bm1(v1), bm2(v2);
+
+            RowBitmap both = bm1 & bm2;
+            RowBitmap either = bm1 | bm2;
+
+            BOOST_CHECK(both.toVector() == intersection(v1, v2));
+            BOOST_CHECK(either.toVector() == setUnion(v1, v2));
+            BOOST_CHECK_EQUAL(both.size(), intersection(v1, v2).size());
+
+            // Results are normalized, so compare equal to the same set
+            // built directly
+            BOOST_CHECK(both == RowBitmap(intersection(v1, v2)));
+            BOOST_CHECK(either == RowBitmap(setUnion(v1, v2)));
+            BOOST_CHECK(either == (bm2 | bm1));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_union_of )
+{
+    vector<RowBitmap> sets;
+    vector<uint32_t> expected;
+    for (uint32_t i = 0;  i < 50;  ++i) {
+        vector<uint32_t> v = randomRows(150000, i % 5 == 0 ? 0.05 : 0.001, i);
+        expected = setUnion(expected, v);
+        sets.emplace_back(v);
+    }
+
+    vector<const RowBitmap *> ptrs;
+    RowBitmap pairwise;
+    for (auto & s: sets) {
+        ptrs.push_back(&s);
+        pairwise = pairwise | s;
+    }
+
+    RowBitmap all = RowBitmap::unionOf(ptrs);
+    BOOST_CHECK(all.toVector() == expected);
+    BOOST_CHECK(all == pairwise);
+}
+
+BOOST_AUTO_TEST_CASE( test_compression )
+{
+    // A run of a million rows needs one bit per row, not four bytes
+    vector<uint32_t> rows(1000000);
+    for (uint32_t i = 0;  i < rows.size();  ++i)
+        rows[i] = i;
+    RowBitmap bm(rows);
+    BOOST_CHECK_LT(bm.memusage(), rows.size() / 8 * 1.1);
+
+    // Sparse rows take two bytes each
+    RowBitmap sparse(randomRows(1000000, 0.01, 3));
+    BOOST_CHECK_LT(sparse.memusage(), sparse.size() * 2 * 1.2 + 1000);
+}
@@ -35,3 +35,7 @@ $(eval $(call test,string_functions_test,arch utils,boost))
 $(eval $(call test,csv_parsing_test,arch utils,boost))
 $(eval $(call test,round_test,,boost))
 $(eval $(call test,for_each_line_test,utils,boost))
+$(eval $(call test,csv_scan_test,utils,boost))
+$(eval $(call test,hnsw_index_test,utils,boost))
+$(eval $(call test,vector_quantizer_test,utils,boost))
+$(eval $(call test,row_bitmap_test,utils,boost))
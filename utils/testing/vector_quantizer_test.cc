@@ -0,0 +1,218 @@
+/* vector_quantizer_test.cc
+   This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+   Test the scalar and product quantizers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/utils/vector_quantizer.h"
+#include "mldb/types/db/persistent.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <vector>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+namespace {
+
+vector<float> randomVectors(size_t n, size_t dims, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal;
+    vector<float> result(n * dims);
+    for (auto & v: result)
+        v = normal(rng);
+    return result;
+}
+
+float squaredDistance(const float * x, const float * y, size_t n)
+{
+    float result = 0.0;
+    for (size_t i = 0;  i < n;  ++i)
+        result += (x[i] - y[i]) * (x[i] - y[i]);
+    return result;
+}
+
+// The distances from the codes must be those to the decoded vectors
+void checkDistances(const VectorQuantizer & quantizer,
+                    const vector<float> & data, size_t n)
+{
+    size_t dims = quantizer.numDims();
+    size_t codeSize = quantizer.codeSize();
+
+    vector<uint8_t> codes(n * codeSize);
+    for (size_t i = 0;  i < n;  ++i)
+        quantizer.encode(&data[i * dims], &codes[i * codeSize]);
+
+    auto query = randomVectors(1, dims, 99);
+    vector<float> distances(n);
+    quantizer.squaredDistances(query.data(), codes.data(), n, distances.data());
+
+    vector<float> decoded(dims);
+    for (size_t i = 0;  i < n;  ++i) {
+        quantizer.decode(&codes[i * codeSize], decoded.data());
+        float expected = squaredDistance(query.data(), decoded.data(), dims);
+        BOOST_CHECK_CLOSE(distances[i], expected, 0.01);
+    }
+
+    // A query prepared once gives the same distances, however the codes
+    // are split up
+    auto prepared = quantizer.prepareQuery(query.data());
+    vector<float> split(n);
+    size_t half = n / 2;
+    quantizer.squaredDistances(prepared, codes.data(), half, split.data());
+    quantizer.squaredDistances(prepared, &codes[half * codeSize], n - half,
+                               &split[half]);
+    for (size_t i = 0;  i < n;  ++i)
+        BOOST_CHECK_EQUAL(split[i], distances[i]);
+}
+
+std::shared_ptr<VectorQuantizer>
+roundTrip(const VectorQuantizer & quantizer)
+{
+    std::ostringstream stream;
+    {
+        DB::Store_Writer store(stream);
+        quantizer.serialize(store);
+    }
+    std::istringstream istream(stream.str());
+    DB::Store_Reader store(istream);
+    return VectorQuantizer::reconstitute(store);
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_scalar_quantizer )
+{
+    size_t n = 1000, dims = 24;
+    auto data = randomVectors(n, dims, 1);
+
+    ScalarQuantizer quantizer(data.data(), n, dims);
+    BOOST_CHECK_EQUAL(quantizer.numDims(), dims);
+    BOOST_CHECK_EQUAL(quantizer.codeSize(), dims);
+
+    // Each value is within half a step of where it started
+    vector<uint8_t> code(dims);
+    vector<float> decoded(dims);
+    for (size_t i = 0;  i < n;  ++i) {
+        quantizer.encode(&data[i * dims], code.data());
+        quantizer.decode(code.data(), decoded.data());
+        for (size_t d = 0;  d < dims;  ++d)
+            BOOST_CHECK_SMALL(decoded[d] - data[i * dims + d], 0.05f);
+    }
+
+    // Values outside the training range are clamped
+    vector<float> big(dims, 1000.0);
+    BOOST_CHECK(quantizer.inRange(&data[0]));
+    BOOST_CHECK(!quantizer.inRange(big.data()));
+    quantizer.encode(big.data(), code.data());
+    BOOST_CHECK(std::all_of(code.begin(), code.end(),
+                            [] (uint8_t c) { return c == 255; }));
+
+    // Once widened, they are encoded exactly, and the training data is
+    // still in range
+    ScalarQuantizer widened(quantizer);
+    widened.widen(big.data());
+    BOOST_CHECK(widened.inRange(big.data()));
+    widened.encode(big.data(), code.data());
+    widened.decode(code.data(), decoded.data());
+    for (size_t d = 0;  d < dims;  ++d)
+        BOOST_CHECK_CLOSE(decoded[d], 1000.0f, 0.01);
+    for (size_t i = 0;  i < n;  ++i)
+        BOOST_CHECK(widened.inRange(&data[i * dims]));
+
+    checkDistances(quantizer, data, n);
+    checkDistances(*roundTrip(quantizer), data, n);
+}
+
+BOOST_AUTO_TEST_CASE( test_product_quantizer )
+{
+    size_t n = 2000, dims = 30;
+    auto data = randomVectors(n, dims, 2);
+
+    // 30 dimensions don't split evenly into 8 subspaces
+    ProductQuantizer quantizer(data.data(), n, dims, 8);
+    BOOST_CHECK_EQUAL(quantizer.numDims(), dims);
+    BOOST_CHECK_EQUAL(quantizer.codeSize(), 8);
+    BOOST_CHECK_EQUAL(quantizer.numCentroids(), 256);
+
+    checkDistances(quantizer, data, n);
+
+    auto reconstituted = roundTrip(quantizer);
+    BOOST_CHECK_EQUAL(reconstituted->codeSize(), 8);
+    checkDistances(*reconstituted, data, n);
+
+    // The quantization error is well below the spread of the data
+    vector<uint8_t> code(8);
+    vector<float> decoded(dims);
+    double error = 0.0, spread = 0.0;
+    for (size_t i = 0;  i < n;  ++i) {
+        quantizer.encode(&data[i * dims], code.data());
+        quantizer.decode(code.data(), decoded.data());
+        error += squaredDistance(&data[i * dims], decoded.data(), dims);
+        spread += squaredDistance(&data[i * dims], &data[((i + 1) % n) * dims],
+                                  dims);
+    }
+    BOOST_CHECK_LT(error, spread / 4);
+
+    // Fewer training vectors than centroids
+    ProductQuantizer small(data.data(), 10, dims, 3);
+    BOOST_CHECK_EQUAL(small.numCentroids(), 10);
+    for (size_t i = 0;  i < 10;  ++i) {
+        small.encode(&data[i * dims], code.data());
+        small.decode(code.data(), decoded.data());
+        BOOST_CHECK_SMALL(squaredDistance(&data[i * dims], decoded.data(), dims),
+                          1e-6f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_rerank_recall )
+{
+    // A scan over the codes, re-ranked exactly, finds the true neighbours
+    size_t n = 5000, dims = 32, k = 10, numCandidates = 100;
+    auto data = randomVectors(n, dims, 3);
+    ProductQuantizer quantizer(data.data(), n, dims, 8);
+
+    vector<uint8_t> codes(n * quantizer.codeSize());
+    for (size_t i = 0;  i < n;  ++i)
+        quantizer.encode(&data[i * dims], &codes[i * quantizer.codeSize()]);
+
+    auto queries = randomVectors(20, dims, 4);
+    size_t found = 0;
+    for (size_t q = 0;  q < 20;  ++q) {
+        const float * query = &queries[q * dims];
+
+        vector<float> approx(n);
+        quantizer.squaredDistances(query, codes.data(), n, approx.data());
+        vector<pair<float, int> > candidates;
+        for (size_t i = 0;  i < n;  ++i)
+            candidates.emplace_back(approx[i], i);
+        std::partial_sort(candidates.begin(),
+                          candidates.begin() + numCandidates,
+                          candidates.end());
+        candidates.resize(numCandidates);
+        for (auto & c: candidates)
+            c.first = squaredDistance(query, &data[c.second * dims], dims);
+        std::sort(candidates.begin(), candidates.end());
+
+        vector<pair<float, int> > exact;
+        for (size_t i = 0;  i < n;  ++i)
+            exact.emplace_back(squaredDistance(query, &data[i * dims], dims), i);
+        std::sort(exact.begin(), exact.end());
+
+        for (size_t i = 0;  i < k;  ++i) {
+            if (candidates[i].first <= exact[k - 1].first)
+                ++found;
+        }
+    }
+
+    BOOST_CHECK_GT(found, 0.9 * 20 * k);
+}
@@ -12,6 +12,10 @@ LIBUTILS_SOURCES := \
 	confidence_intervals.cc \
 	quadtree.cc \
 	for_each_line.cc \
+	csv_scan.cc \
+	hnsw_index.cc \
+	vector_quantizer.cc \
+	row_bitmap.cc \
 
 LIBUTILS_LINK := \
 	arch \
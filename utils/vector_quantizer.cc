@@ -0,0 +1,402 @@
+/** vector_quantizer.cc
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Scalar and product quantization of float vectors.
+*/
+
+#include "vector_quantizer.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/base/parallel.h"
+#include "mldb/types/db/persistent.h"
+#include "mldb/arch/exception.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* VECTOR QUANTIZER                                                          */
+/*****************************************************************************/
+
+VectorQuantizer::
+~VectorQuantizer()
+{
+}
+
+std::shared_ptr<VectorQuantizer>
+VectorQuantizer::
+reconstitute(DB::Store_Reader & store)
+{
+    std::string type;
+    store >> type;
+    if (type == "int8") {
+        auto result = std::make_shared<ScalarQuantizer>();
+        result->reconstitute(store);
+        return result;
+    }
+    else if (type == "pq") {
+        auto result = std::make_shared<ProductQuantizer>();
+        result->reconstitute(store);
+        return result;
+    }
+    throw Exception("Unknown vector quantizer type '" + type + "'");
+}
+
+
+/*****************************************************************************/
+/* SCALAR QUANTIZER                                                          */
+/*****************************************************************************/
+
+ScalarQuantizer::
+ScalarQuantizer(const float * data, size_t numVectors, size_t numDims)
+    : offset(numDims, INFINITY), scale(numDims)
+{
+    std::vector<float> maxs(numDims, -INFINITY);
+
+    for (size_t i = 0;  i < numVectors;  ++i) {
+        const float * vec = data + i * numDims;
+        for (size_t d = 0;  d < numDims;  ++d) {
+            offset[d] = std::min(offset[d], vec[d]);
+            maxs[d] = std::max(maxs[d], vec[d]);
+        }
+    }
+
+    for (size_t d = 0;  d < numDims;  ++d) {
+        if (numVectors == 0)
+            offset[d] = maxs[d] = 0;
+        // A constant dimension still needs a non-zero step
+        scale[d] = std::max((maxs[d] - offset[d]) / 255.0f,
+                            std::numeric_limits<float>::min());
+    }
+}
+
+void
+ScalarQuantizer::
+encode(const float * vec, uint8_t * code) const
+{
+    for (size_t d = 0;  d < offset.size();  ++d) {
+        float c = std::round((vec[d] - offset[d]) / scale[d]);
+        code[d] = std::min(std::max(c, 0.0f), 255.0f);
+    }
+}
+
+void
+ScalarQuantizer::
+decode(const uint8_t * code, float * vec) const
+{
+    for (size_t d = 0;  d < offset.size();  ++d)
+        vec[d] = offset[d] + code[d] * scale[d];
+}
+
+bool
+ScalarQuantizer::
+inRange(const float * vec) const
+{
+    for (size_t d = 0;  d < offset.size();  ++d) {
+        float c = (vec[d] - offset[d]) / scale[d];
+        if (c < -0.5f || c > 255.5f)
+            return false;
+    }
+    return true;
+}
+
+void
+ScalarQuantizer::
+widen(const float * vec)
+{
+    for (size_t d = 0;  d < offset.size();  ++d) {
+        float lo = offset[d], hi = offset[d] + 255.0f * scale[d];
+        if (vec[d] >= lo && vec[d] <= hi)
+            continue;
+        lo = std::min(lo, vec[d]);
+        hi = std::max(hi, vec[d]);
+        offset[d] = lo;
+        scale[d] = std::max((hi - lo) / 255.0f,
+                            std::numeric_limits<float>::min());
+    }
+}
+
+std::vector<float>
+ScalarQuantizer::
+prepareQuery(const float * query) const
+{
+    size_t n = offset.size();
+
+    // Put the query in code units, so that the inner loop is just a
+    // weighted sum of squared differences.  The weights follow the query.
+    std::vector<float> result(n * 2);
+    for (size_t d = 0;  d < n;  ++d) {
+        result[d] = (query[d] - offset[d]) / scale[d];
+        result[n + d] = scale[d] * scale[d];
+    }
+    return result;
+}
+
+void
+ScalarQuantizer::
+squaredDistances(const std::vector<float> & prepared,
+                 const uint8_t * codes, size_t numCodes,
+                 float * distances) const
+{
+    size_t n = offset.size();
+    ExcAssertEqual(prepared.size(), n * 2);
+
+    const float * q = prepared.data();
+    const float * w = q + n;
+
+    for (size_t i = 0;  i < numCodes;  ++i) {
+        const uint8_t * code = codes + i * n;
+        float total = 0.0;
+        for (size_t d = 0;  d < n;  ++d) {
+            float diff = q[d] - code[d];
+            total += w[d] * diff * diff;
+        }
+        distances[i] = total;
+    }
+}
+
+void
+ScalarQuantizer::
+serialize(DB::Store_Writer & store) const
+{
+    store << std::string("int8") << DB::compact_size_t(1)  // version
+          << offset << scale;
+}
+
+void
+ScalarQuantizer::
+reconstitute(DB::Store_Reader & store)
+{
+    DB::compact_size_t version(store);
+    ExcAssertEqual(version, 1);
+    store >> offset >> scale;
+    ExcAssertEqual(offset.size(), scale.size());
+}
+
+
+/*****************************************************************************/
+/* PRODUCT QUANTIZER                                                         */
+/*****************************************************************************/
+
+namespace {
+
+float squaredDistance(const float * x, const float * y, int n)
+{
+    float result = 0.0;
+    for (int i = 0;  i < n;  ++i)
+        result += (x[i] - y[i]) * (x[i] - y[i]);
+    return result;
+}
+
+/** Run k-means on the given points (numPoints of width floats, one after
+    the other), writing k centroids to centroids.
+*/
+void kmeans(const std::vector<float> & points, size_t numPoints, int width,
+            int k, int numIterations, uint32_t seed, float * centroids)
+{
+    std::mt19937 rng(seed);
+
+    // Start from k distinct points chosen at random
+    std::vector<size_t> order(numPoints);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (int c = 0;  c < k;  ++c)
+        std::copy_n(&points[order[c] * width], width, centroids + c * width);
+
+    std::vector<int> assignments(numPoints, -1);
+    std::vector<double> sums(k * width);
+    std::vector<size_t> counts(k);
+
+    for (int iter = 0;  iter < numIterations;  ++iter) {
+        bool changed = false;
+
+        for (size_t i = 0;  i < numPoints;  ++i) {
+            const float * p = &points[i * width];
+            int best = 0;
+            float bestDist = INFINITY;
+            for (int c = 0;  c < k;  ++c) {
+                float d = squaredDistance(p, centroids + c * width, width);
+                if (d < bestDist) {
+                    bestDist = d;
+                    best = c;
+                }
+            }
+            if (assignments[i] != best) {
+                assignments[i] = best;
+                changed = true;
+            }
+        }
+
+        if (!changed)
+            break;
+
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (size_t i = 0;  i < numPoints;  ++i) {
+            int c = assignments[i];
+            ++counts[c];
+            for (int j = 0;  j < width;  ++j)
+                sums[c * width + j] += points[i * width + j];
+        }
+
+        for (int c = 0;  c < k;  ++c) {
+            if (counts[c] == 0) {
+                // Empty cluster; move it to a random point so that it can
+                // pick up some of the points of its neighbors
+                size_t i = rng() % numPoints;
+                std::copy_n(&points[i * width], width, centroids + c * width);
+                continue;
+            }
+            for (int j = 0;  j < width;  ++j)
+                centroids[c * width + j] = sums[c * width + j] / counts[c];
+        }
+    }
+}
+
+} // file scope
+
+ProductQuantizer::
+ProductQuantizer(const float * data, size_t numVectors, size_t numDims,
+                 int numSubspaces, int numIterations,
+                 size_t maxTrainingVectors, uint32_t seed)
+    : dims(numDims)
+{
+    ExcAssertGreater(numVectors, 0);
+    ExcAssertGreater(numSubspaces, 0);
+    ExcAssertLessEqual(numSubspaces, numDims);
+
+    // Spread the dimensions as evenly as possible over the subspaces
+    for (int s = 0;  s <= numSubspaces;  ++s)
+        subspaceStart.push_back(s * numDims / numSubspaces);
+
+    // Choose the training vectors
+    std::vector<size_t> training(numVectors);
+    std::iota(training.begin(), training.end(), 0);
+    if (numVectors > maxTrainingVectors) {
+        std::mt19937 rng(seed);
+        std::shuffle(training.begin(), training.end(), rng);
+        training.resize(maxTrainingVectors);
+    }
+
+    k = std::min<size_t>(256, training.size());
+    centroids.resize(k * numDims);
+
+    auto trainSubspace = [&] (size_t s)
+        {
+            int start = subspaceStart[s];
+            int width = subspaceStart[s + 1] - start;
+
+            std::vector<float> points(training.size() * width);
+            for (size_t i = 0;  i < training.size();  ++i)
+                std::copy_n(data + training[i] * numDims + start, width,
+                            &points[i * width]);
+
+            kmeans(points, training.size(), width, k, numIterations,
+                   seed + s, &centroids[k * start]);
+        };
+
+    parallelMap(0, numSubspaces, trainSubspace);
+}
+
+void
+ProductQuantizer::
+encode(const float * vec, uint8_t * code) const
+{
+    for (size_t s = 0;  s < codeSize();  ++s) {
+        int start = subspaceStart[s];
+        int width = subspaceStart[s + 1] - start;
+        int best = 0;
+        float bestDist = INFINITY;
+        for (int c = 0;  c < k;  ++c) {
+            float d = squaredDistance(vec + start, getCentroid(s, c), width);
+            if (d < bestDist) {
+                bestDist = d;
+                best = c;
+            }
+        }
+        code[s] = best;
+    }
+}
+
+void
+ProductQuantizer::
+decode(const uint8_t * code, float * vec) const
+{
+    for (size_t s = 0;  s < codeSize();  ++s) {
+        int start = subspaceStart[s];
+        int width = subspaceStart[s + 1] - start;
+        std::copy_n(getCentroid(s, code[s]), width, vec + start);
+    }
+}
+
+std::vector<float>
+ProductQuantizer::
+prepareQuery(const float * query) const
+{
+    size_t m = codeSize();
+
+    // Distance from the query to each centroid of each subspace
+    std::vector<float> table(m * 256);
+    for (size_t s = 0;  s < m;  ++s) {
+        int start = subspaceStart[s];
+        int width = subspaceStart[s + 1] - start;
+        for (int c = 0;  c < k;  ++c) {
+            table[s * 256 + c]
+                = squaredDistance(query + start, getCentroid(s, c), width);
+        }
+    }
+    return table;
+}
+
+void
+ProductQuantizer::
+squaredDistances(const std::vector<float> & table,
+                 const uint8_t * codes, size_t numCodes,
+                 float * distances) const
+{
+    size_t m = codeSize();
+    ExcAssertEqual(table.size(), m * 256);
+
+    for (size_t i = 0;  i < numCodes;  ++i) {
+        const uint8_t * code = codes + i * m;
+        float total = 0.0;
+        for (size_t s = 0;  s < m;  ++s)
+            total += table[s * 256 + code[s]];
+        distances[i] = total;
+    }
+}
+
+void
+ProductQuantizer::
+serialize(DB::Store_Writer & store) const
+{
+    store << std::string("pq") << DB::compact_size_t(1)  // version
+          << DB::compact_size_t(dims) << DB::compact_size_t(k)
+          << subspaceStart << centroids;
+}
+
+void
+ProductQuantizer::
+reconstitute(DB::Store_Reader & store)
+{
+    DB::compact_size_t version(store);
+    ExcAssertEqual(version, 1);
+    DB::compact_size_t newDims(store), newK(store);
+    dims = newDims;
+    k = newK;
+    store >> subspaceStart >> centroids;
+    ExcAssert(!subspaceStart.empty());
+    ExcAssertEqual(centroids.size(), k * dims);
+    ExcAssertEqual(subspaceStart.back(), dims);
+}
+
+} // namespace MLDB
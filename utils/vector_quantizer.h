@@ -0,0 +1,189 @@
+/** vector_quantizer.h                                             -*- C++ -*-
+    Compact encodings of float vectors, with distances computed directly
+    from the encoded form.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+*/
+
+#pragma once
+
+#include "mldb/types/db/persistent_fwd.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* VECTOR QUANTIZER                                                          */
+/*****************************************************************************/
+
+/** Encodes float vectors of a fixed number of dimensions into a fixed
+    number of bytes.  Distances between a float query vector and encoded
+    vectors are computed without decoding them (asymmetric distance
+    computation), so that a scan only needs to touch the codes.
+
+    Quantizers are trained on a sample of the vectors that they will
+    encode, and are immutable afterwards.
+*/
+
+struct VectorQuantizer {
+    virtual ~VectorQuantizer();
+
+    /// Number of dimensions of the vectors encoded
+    virtual size_t numDims() const = 0;
+
+    /// Number of bytes in the code of each vector
+    virtual size_t codeSize() const = 0;
+
+    /// Encode the vector, writing codeSize() bytes to code
+    virtual void encode(const float * vec, uint8_t * code) const = 0;
+
+    /// Write the (approximate) vector that the code represents to vec
+    virtual void decode(const uint8_t * code, float * vec) const = 0;
+
+    /** Return what squaredDistances() calculates from the query alone
+        (for example, the distance from the query to each centroid), so
+        that a scan calculates it once per query rather than once for each
+        block of codes it looks at.
+    */
+    virtual std::vector<float> prepareQuery(const float * query) const = 0;
+
+    /** Calculate the squared euclidean distance between the query that
+        prepareQuery() returned prepared for and each of the numCodes
+        vectors whose codes are contiguous at codes, writing them to
+        distances.
+    */
+    virtual void squaredDistances(const std::vector<float> & prepared,
+                                  const uint8_t * codes, size_t numCodes,
+                                  float * distances) const = 0;
+
+    /// As above, preparing the query first
+    void squaredDistances(const float * query,
+                          const uint8_t * codes, size_t numCodes,
+                          float * distances) const
+    {
+        squaredDistances(prepareQuery(query), codes, numCodes, distances);
+    }
+
+    virtual void serialize(DB::Store_Writer & store) const = 0;
+
+    /// Reconstitute a quantizer serialized with serialize()
+    static std::shared_ptr<VectorQuantizer>
+    reconstitute(DB::Store_Reader & store);
+};
+
+
+/*****************************************************************************/
+/* SCALAR QUANTIZER                                                          */
+/*****************************************************************************/
+
+/** Encodes each dimension in one byte, spread evenly between the minimum
+    and maximum of that dimension in the training vectors.  Values outside
+    of that range are clamped.  Codes are 4 times smaller than the floats.
+*/
+
+struct ScalarQuantizer: public VectorQuantizer {
+    ScalarQuantizer() = default;
+
+    /// Train on the numVectors vectors of numDims dimensions at data
+    ScalarQuantizer(const float * data, size_t numVectors, size_t numDims);
+
+    virtual size_t numDims() const override { return offset.size(); }
+    virtual size_t codeSize() const override { return offset.size(); }
+
+    virtual void encode(const float * vec, uint8_t * code) const override;
+    virtual void decode(const uint8_t * code, float * vec) const override;
+    virtual std::vector<float> prepareQuery(const float * query) const override;
+    using VectorQuantizer::squaredDistances;
+    virtual void squaredDistances(const std::vector<float> & prepared,
+                                  const uint8_t * codes, size_t numCodes,
+                                  float * distances) const override;
+
+    /** Can the vector be encoded without clamping any of its dimensions
+        to the range seen in training?
+    */
+    bool inRange(const float * vec) const;
+
+    /** Widen the range of each dimension as little as possible so that
+        the vector is in range.  Codes made before need to be made again.
+    */
+    void widen(const float * vec);
+
+    virtual void serialize(DB::Store_Writer & store) const override;
+    void reconstitute(DB::Store_Reader & store);
+
+private:
+    std::vector<float> offset;   ///< Value of code 0, per dimension
+    std::vector<float> scale;    ///< Value of one step of the code
+};
+
+
+/*****************************************************************************/
+/* PRODUCT QUANTIZER                                                         */
+/*****************************************************************************/
+
+/** Splits the dimensions into numSubspaces groups, and encodes the part of
+    the vector in each group as the index of the nearest of (up to) 256
+    centroids found by k-means on the training vectors.  Codes are one
+    byte per subspace.
+
+    Distances are computed by building a table of the distance between
+    the query and each centroid of each subspace, after which the distance
+    to an encoded vector is the sum of numSubspaces table entries.
+*/
+
+struct ProductQuantizer: public VectorQuantizer {
+    ProductQuantizer() = default;
+
+    /** Train on the numVectors vectors of numDims dimensions at data.  At
+        most maxTrainingVectors of them (chosen at random) are used to
+        train the centroids.  Training runs in parallel over the subspaces.
+    */
+    ProductQuantizer(const float * data, size_t numVectors, size_t numDims,
+                     int numSubspaces, int numIterations = 20,
+                     size_t maxTrainingVectors = 16384, uint32_t seed = 1);
+
+    virtual size_t numDims() const override { return dims; }
+    virtual size_t codeSize() const override
+    {
+        return subspaceStart.empty() ? 0 : subspaceStart.size() - 1;
+    }
+
+    int numCentroids() const { return k; }
+
+    virtual void encode(const float * vec, uint8_t * code) const override;
+    virtual void decode(const uint8_t * code, float * vec) const override;
+    virtual std::vector<float> prepareQuery(const float * query) const override;
+    using VectorQuantizer::squaredDistances;
+    virtual void squaredDistances(const std::vector<float> & prepared,
+                                  const uint8_t * codes, size_t numCodes,
+                                  float * distances) const override;
+
+    virtual void serialize(DB::Store_Writer & store) const override;
+    void reconstitute(DB::Store_Reader & store);
+
+private:
+    size_t dims = 0;
+    int k = 0;                          ///< Centroids per subspace
+
+    /// First dimension of each subspace, plus numDims() at the end
+    std::vector<int> subspaceStart;
+
+    /** Centroids of each subspace, one after the other.  Subspace s has
+        k centroids of subspaceStart[s + 1] - subspaceStart[s] floats,
+        starting at k * subspaceStart[s].
+    */
+    std::vector<float> centroids;
+
+    const float * getCentroid(int subspace, int centroid) const
+    {
+        int width = subspaceStart[subspace + 1] - subspaceStart[subspace];
+        return &centroids[k * subspaceStart[subspace] + centroid * width];
+    }
+};
+
+} // namespace MLDB
@@ -8,9 +8,13 @@
 
 #include "compressor.h"
 #include "mldb/base/exc_assert.h"
+#include "mldb/base/thread_pool.h"
 #include <iostream>
 #include <mutex>
 #include <map>
+#include <deque>
+#include <future>
+#include <thread>
 
 using namespace std;
 
@@ -162,6 +166,282 @@ getDecompressorInfo(const std::string & decompressor)
 }
 
 
+int64_t
+Decompressor::
+pieceLength(const char * block, size_t blockLen) const
+{
+    return LENGTH_UNKNOWN;
+}
+
+void
+Decompressor::
+decompressPiece(const char * data, size_t len, const OnData & onData) const
+{
+    throw Exception("decompressor doesn't support decompressing pieces");
+}
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+struct ParallelDecompressor::Itl {
+    Itl(std::shared_ptr<Decompressor> decompressor, int maxParallelism)
+        : decompressor(std::move(decompressor)),
+          maxParallelism(maxParallelism > 0
+                         ? maxParallelism
+                         : std::max<int>(1, std::thread::hardware_concurrency())),
+          threads(ThreadPool::instance(), this->maxParallelism)
+    {
+    }
+
+    ~Itl()
+    {
+        // Don't leave jobs running that refer to the decompressor
+        threads.waitForAll();
+    }
+
+    std::shared_ptr<Decompressor> decompressor;
+    int maxParallelism;
+
+    /// Batches are decompressed by the jobs of this pool
+    ThreadPool threads;
+
+    /// Once we find data that can't be split, everything else is serial
+    bool serial = false;
+
+    /// Have we found any pieces?
+    bool anyPieces = false;
+
+    /// Compressed data we haven't yet made into a batch
+    std::string pending;
+    size_t pendingPos = 0;
+
+    /// Length of each piece in the batch being built up from pending
+    std::vector<size_t> batchPieces;
+    size_t batchLength = 0;
+
+    /// Batches being decompressed, in order
+    std::deque<std::future<std::string> > batches;
+
+    static void write(const std::string & data, const OnData & onData)
+    {
+        size_t done = 0;
+        while (done < data.size())
+            done += onData(data.data() + done, data.size() - done);
+    }
+
+    bool firstBatchReady() const
+    {
+        return !batches.empty()
+            && batches.front().wait_for(std::chrono::seconds(0))
+               == std::future_status::ready;
+    }
+
+    void writeFirstBatch(const OnData & onData)
+    {
+        // Lend this thread to the pool while we wait, so that we can't
+        // be held up by jobs queued behind it
+        while (batches.front().wait_for(std::chrono::milliseconds(1))
+               != std::future_status::ready)
+            threads.work();
+
+        std::string output = batches.front().get();
+        batches.pop_front();
+        write(output, onData);
+    }
+
+    void startBatch()
+    {
+        if (batchPieces.empty())
+            return;
+
+        // Take a copy of the compressed data, as pending will change
+        std::string data(pending, pendingPos, batchLength);
+        pendingPos += batchLength;
+
+        auto run = [decompressor = this->decompressor,
+                    data = std::move(data),
+                    pieces = std::move(batchPieces)] ()
+            {
+                std::string result;
+                auto onData = [&] (const char * p, size_t len)
+                {
+                    result.append(p, len);
+                    return len;
+                };
+
+                size_t offset = 0;
+                for (size_t len: pieces) {
+                    decompressor->decompressPiece(data.data() + offset, len,
+                                                  onData);
+                    offset += len;
+                }
+                return result;
+            };
+
+        // The task catches any exception, which is rethrown when its
+        // output is written
+        auto task = std::make_shared<std::packaged_task<std::string ()> >
+            (std::move(run));
+        batches.emplace_back(task->get_future());
+        threads.add([task] () { (*task)(); });
+
+        batchPieces.clear();
+        batchLength = 0;
+    }
+
+    /** Cut as many pieces as possible from pending into batches.  If it
+        turns out that the data can't be split, everything from there on
+        is passed through to the decompressor once the batches before it
+        are written.
+
+        At most one batch is written per call (unless more are needed to
+        keep within maxParallelism), as whatever the reader hasn't yet
+        asked for of the output is buffered until it does.
+    */
+    void cutPieces(const OnData & onData)
+    {
+        bool written = false;
+
+        while (!serial) {
+            const char * start = pending.data() + pendingPos + batchLength;
+            size_t avail = pending.size() - pendingPos - batchLength;
+            if (avail == 0)
+                break;
+
+            int64_t len = decompressor->pieceLength(start, avail);
+            if (len == LENGTH_INSUFFICIENT_DATA && avail <= BATCH_SIZE)
+                break;
+
+            if (len < 0) {
+                // Either the data can't be split or the pieces are too big
+                // to be worth it (we don't want to buffer up whole files).
+                // Finish the batches in order, then go serial with the
+                // rest.
+                startBatch();
+                serial = true;
+                break;
+            }
+
+            ExcAssertGreater(len, 0);
+            ExcAssertLessEqual(len, (int64_t)avail);
+            anyPieces = true;
+            batchPieces.push_back(len);
+            batchLength += len;
+
+            if (batchLength >= BATCH_SIZE) {
+                startBatch();
+
+                // Limit how far ahead we get
+                while (batches.size() > (size_t)maxParallelism) {
+                    writeFirstBatch(onData);
+                    written = true;
+                }
+            }
+        }
+
+        if (!written) {
+            // Write out a batch that's already done without waiting.  Once
+            // we're serial, the batches have to be out of the way first,
+            // so we wait for them.
+            if (firstBatchReady() || (serial && !batches.empty())) {
+                writeFirstBatch(onData);
+            }
+            else if (serial && batches.empty()) {
+                decompressor->decompress(pending.data() + pendingPos,
+                                         pending.size() - pendingPos,
+                                         onData);
+                pending = std::string();
+                pendingPos = 0;
+                return;
+            }
+        }
+
+        // Don't let what's been used build up
+        if (pendingPos > BATCH_SIZE && pendingPos > pending.size() / 2) {
+            pending.erase(0, pendingPos);
+            pendingPos = 0;
+        }
+    }
+};
+
+ParallelDecompressor::
+ParallelDecompressor(std::shared_ptr<Decompressor> decompressor,
+                     int maxParallelism)
+    : itl(new Itl(std::move(decompressor), maxParallelism))
+{
+}
+
+ParallelDecompressor::
+~ParallelDecompressor()
+{
+}
+
+int64_t
+ParallelDecompressor::
+decompressedSize(const char * block, size_t blockLen, int64_t totalLen) const
+{
+    return itl->decompressor->decompressedSize(block, blockLen, totalLen);
+}
+
+void
+ParallelDecompressor::
+decompress(const char * data, size_t len, const OnData & onData)
+{
+    if (itl->serial && itl->batches.empty()
+        && itl->pendingPos == itl->pending.size()) {
+        itl->decompressor->decompress(data, len, onData);
+        return;
+    }
+
+    itl->pending.append(data, len);
+    itl->cutPieces(onData);
+}
+
+bool
+ParallelDecompressor::
+flushBatch(const OnData & onData)
+{
+    itl->startBatch();
+    if (itl->batches.empty())
+        return false;
+    itl->writeFirstBatch(onData);
+    return true;
+}
+
+void
+ParallelDecompressor::
+finish(const OnData & onData)
+{
+    itl->startBatch();
+    while (!itl->batches.empty())
+        itl->writeFirstBatch(onData);
+
+    if (!itl->serial && itl->anyPieces
+        && itl->pendingPos == itl->pending.size()) {
+        // Everything was in complete pieces
+        itl->pending = std::string();
+        itl->pendingPos = 0;
+        return;
+    }
+
+    // Data that's not in complete pieces goes through the decompressor,
+    // which will tell us what's wrong with it, as does what is left once
+    // we've gone serial
+    itl->serial = true;
+    if (itl->pendingPos < itl->pending.size()) {
+        itl->decompressor->decompress(itl->pending.data() + itl->pendingPos,
+                                      itl->pending.size() - itl->pendingPos,
+                                      onData);
+    }
+    itl->pending = std::string();
+    itl->pendingPos = 0;
+
+    itl->decompressor->finish(onData);
+}
+
+
 /*****************************************************************************/
 /* NULL COMPRESSOR                                                           */
 /*****************************************************************************/
@@ -148,6 +148,29 @@ struct Decompressor {
     */
     virtual void finish(const OnData & onData) = 0;
 
+    /** Some formats are made up of pieces that can each be decompressed
+        on their own (zstd frames, BGZF blocks of gzip, lz4 frames), which
+        allows them to be decompressed in parallel.  Given a block that
+        starts at the start of a piece, return the length of that piece.
+
+        Will return
+
+        - a length > 0 if the piece is entirely within the block;
+        - LENGTH_INSUFFICIENT_DATA if more of the block is needed to know;
+        - LENGTH_UNKNOWN if the data can't be split into pieces here, in
+          which case it needs to go through decompress().
+
+        The default implementation returns LENGTH_UNKNOWN.
+    */
+    virtual int64_t pieceLength(const char * block, size_t blockLen) const;
+
+    /** Decompress a single piece, as returned by pieceLength().  This
+        doesn't touch the state of the decompressor, and may be called from
+        several threads at once.  The default implementation throws.
+    */
+    virtual void decompressPiece(const char * data, size_t len,
+                                 const OnData & onData) const;
+
     /** Create a compressor with the given scheme.  Returns nullptr if
         the given compression scheme isn't found.
     */
@@ -189,4 +212,54 @@ struct Decompressor {
     };
 };
 
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+/** Decompressor that decompresses the pieces of the data (see
+    Decompressor::pieceLength()) in parallel using the given decompressor,
+    and returns the output in order.  Data that can't be split is passed
+    through to the decompressor to be decompressed serially as usual.
+
+    The batches are decompressed by jobs on the thread pool, up to
+    maxParallelism at once, which also limits how far ahead of the reader
+    the decompression gets.  Each call to decompress() writes out at most
+    one batch, so that a reader that buffers the output it hasn't asked
+    for yet doesn't buffer more than that.  Once a piece turns out to be
+    longer than BATCH_SIZE, the rest of the data is decompressed serially
+    so that we don't buffer up the whole input.
+*/
+
+struct ParallelDecompressor: public Decompressor {
+
+    ParallelDecompressor(std::shared_ptr<Decompressor> decompressor,
+                         int maxParallelism = -1);
+
+    virtual ~ParallelDecompressor();
+
+    virtual int64_t decompressedSize(const char * block, size_t blockLen,
+                                     int64_t totalLen) const override;
+
+    virtual void decompress(const char * data, size_t len,
+                            const OnData & onData) override;
+
+    virtual void finish(const OnData & onData) override;
+
+    /** Once all of the input has been passed to decompress(), write out
+        the next batch, waiting for it if needed, so that the output can
+        be read a batch at a time.  Returns false if there are no batches
+        left, in which case finish() is what's left to call.
+    */
+    bool flushBatch(const OnData & onData);
+
+    /// Amount of compressed data decompressed by each task
+    static constexpr size_t BATCH_SIZE = 4 * 1024 * 1024;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
 } // namespace MLDB
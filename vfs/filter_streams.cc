@@ -137,7 +137,9 @@ struct BoostCompressor: public boost::iostreams::multichar_output_filter {
 /* BOOST DECOMPRESSOR                                                        */
 /*****************************************************************************/
 
-/** Adaptor to allow boost::iostreams to be served by a decompressor object. */
+/** Adaptor to allow boost::iostreams to be served by a decompressor object.
+    Formats that can be split into pieces are decompressed in parallel.
+*/
 
 struct BoostDecompressor {
     typedef char char_type;
@@ -149,9 +151,10 @@ struct BoostDecompressor {
     };
 
     BoostDecompressor(Decompressor * decompressor)
-        : decompressor(decompressor)
+        : decompressor(new ParallelDecompressor
+                       (std::shared_ptr<Decompressor>(decompressor)))
     {
-        inbuf.resize(4096);
+        inbuf.resize(65536);
     }
 
     template<typename Source>
@@ -198,6 +201,10 @@ struct BoostDecompressor {
         while (n > 0) {
             ssize_t numRead = boost::iostreams::read(src, inbuf.data(), inbuf.size());
             if (numRead <= 0) {
+                // Output of the batches still being decompressed is
+                // written a batch at a time, so that it's not all buffered
+                if (decompressor->flushBatch(onData))
+                    continue;
                 decompressor->finish(onData);
                 break;
             }
@@ -239,7 +246,7 @@ struct BoostDecompressor {
     size_t outbufPos = 0;   ///< Position in outbuf
     uint64_t streamPos = 0;
     
-    std::shared_ptr<Decompressor> decompressor;
+    std::shared_ptr<ParallelDecompressor> decompressor;
 };
 
 
@@ -35,6 +35,9 @@ struct ZlibStreamCommon: public z_stream {
     }
     
     int (*process) (z_streamp stream, int flush) = nullptr;
+
+    /// Set once process() has returned Z_STREAM_END
+    bool ended = false;
     
     size_t pump(const char * data, size_t len, const OnData & onData,
                 int flushLevel)
@@ -70,6 +73,7 @@ struct ZlibStreamCommon: public z_stream {
                 if (bytesWritten)
                     onData(output, bytesWritten);
                 result += bytesWritten;
+                ended = true;
                 return result;
 
             default:
@@ -199,6 +203,20 @@ struct GzipHeaderReader {
           
     {
     }
+
+    /// Get ready to read the header of the next member
+    void reset()
+    {
+        header = GzipHeaderFields();
+        extraLen = 0;
+        extra.clear();
+        filename.clear();
+        comment.clear();
+        state = HEADER;
+        out = (char *)&header;
+        remaining = sizeof(header);
+        buf = nullptr;
+    }
     
     bool process(char c)
     {
@@ -308,6 +326,18 @@ struct GzipDecompressor: public Decompressor, public ZlibStreamCommon {
 
     GzipHeaderReader header;
 
+    /// Bytes of the trailer (CRC and length) of a member left to skip
+    int trailerRemaining = 0;
+
+    /// Have we seen any of the current member?
+    bool inMember = false;
+
+    /// Number of members we've finished
+    size_t membersDone = 0;
+
+    /// Set if something other than a member follows the last member
+    bool trailingGarbage = false;
+
     typedef Decompressor::OnData OnData;
     
     GzipDecompressor()
@@ -332,24 +362,101 @@ struct GzipDecompressor: public Decompressor, public ZlibStreamCommon {
     virtual void decompress(const char * data, size_t len,
                             const OnData & onData) override
     {
-        size_t headerDone = 0;
-        if (!header.done()) {
-            headerDone = header.process(data, len);
-            //cerr << "header used " << headerDone << " characters" << endl;
-            if (headerDone == len)
+        // A gzip file may be several members one after the other (as
+        // produced by concatenating files, or BGZF); their output is
+        // concatenated.
+        while (len > 0 && !trailingGarbage) {
+            if (trailerRemaining) {
+                size_t skipped = std::min<size_t>(trailerRemaining, len);
+                trailerRemaining -= skipped;
+                data += skipped;
+                len -= skipped;
+                continue;
+            }
+
+            if (!inMember && membersDone > 0 && data[0] != '\x1f') {
+                // Like gzip, ignore padding or garbage after a member
+                trailingGarbage = true;
                 return;
-            ExcAssert(header.done());
-        }
+            }
+
+            inMember = true;
+
+            if (!header.done()) {
+                size_t headerDone = header.process(data, len);
+                //cerr << "header used " << headerDone << " characters" << endl;
+                data += headerDone;
+                len -= headerDone;
+                continue;
+            }
 
-        pump(data + headerDone,
-             len - headerDone, onData,
-             Z_NO_FLUSH);
+            pump(data, len, onData, Z_NO_FLUSH);
+
+            if (!ended)
+                return;
+
+            // Finished this member; the next one starts after the trailer
+            data += len - avail_in;
+            len = avail_in;
+            trailerRemaining = 8;
+            inMember = false;
+            ++membersDone;
+            ended = false;
+            header.reset();
+            int res = inflateReset(this);
+            if (res != Z_OK)
+                throw Exception("inflateReset failed");
+        }
     }
     
     virtual void finish(const OnData & onData) override
     {
+        if (!inMember && !trailerRemaining)
+            return;  // between members
         pump(0, 0, onData, Z_FINISH);
     }
+
+    /* BGZF files are made of gzip members with an extra "BC" field that
+       gives their length, which makes each member a piece.  Other gzip
+       files can't be split without decompressing them.
+    */
+    virtual int64_t pieceLength(const char * block,
+                                size_t blockLen) const override
+    {
+        const unsigned char * p = (const unsigned char *)block;
+
+        if (blockLen < 12)
+            return LENGTH_INSUFFICIENT_DATA;
+        if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8
+            || !(p[3] & GzipHeaderReader::FEXTRA))
+            return LENGTH_UNKNOWN;
+
+        size_t extraLen = p[10] | (p[11] << 8);
+        if (blockLen < 12 + extraLen)
+            return LENGTH_INSUFFICIENT_DATA;
+
+        // Look through the extra subfields for BC
+        for (size_t pos = 12;  pos + 4 <= 12 + extraLen;) {
+            size_t fieldLen = p[pos + 2] | (p[pos + 3] << 8);
+            if (p[pos] == 'B' && p[pos + 1] == 'C' && fieldLen == 2
+                && pos + 6 <= 12 + extraLen) {
+                size_t len = (p[pos + 4] | (p[pos + 5] << 8)) + 1;
+                return len <= blockLen ? (int64_t)len : LENGTH_INSUFFICIENT_DATA;
+            }
+            pos += 4 + fieldLen;
+        }
+
+        return LENGTH_UNKNOWN;
+    }
+
+    virtual void decompressPiece(const char * data, size_t len,
+                                 const OnData & onData) const override
+    {
+        GzipDecompressor decompressor;
+        decompressor.decompress(data, len, onData);
+        if (decompressor.inMember || decompressor.trailerRemaining)
+            throw Exception("truncated gzip member");
+    }
 };
 
 static Decompressor::Register<GzipDecompressor>
@@ -331,12 +331,17 @@ struct Lz4Decompressor: public Decompressor {
     virtual void decompress(const char * data, size_t len,
                               const OnData & onData) override
     {
-        if (!cur) {
-            throw Exception("Extra junk at end of compressed lz4 data");
-        }
-
         size_t done = 0;
         while (done < len) {
+            if (state == FINISHED) {
+                // Frames may be concatenated; this is the next one
+                if (streamChecksumState) {
+                    XXH32_freeState(streamChecksumState);
+                    streamChecksumState = nullptr;
+                }
+                setCur(HEADER, header);
+            }
+
             size_t toRead = std::min<size_t>(limit - cur, len - done);
             std::memcpy(cur, data + done, toRead);
             done += toRead;
@@ -446,6 +451,51 @@ struct Lz4Decompressor: public Decompressor {
             throw Exception("lz4 stream is truncated");
     }
 
+    /* Each frame is a piece.  Its length comes from walking the block
+       headers.
+    */
+    virtual int64_t pieceLength(const char * block,
+                                size_t blockLen) const override
+    {
+        if (blockLen < sizeof(lz4::Header))
+            return LENGTH_INSUFFICIENT_DATA;
+
+        lz4::Header frameHeader;
+        std::memcpy(&frameHeader, block, sizeof(frameHeader));
+        try {
+            frameHeader.validate();
+        } catch (const std::exception & exc) {
+            return LENGTH_UNKNOWN;  // let decompress() report the error
+        }
+
+        size_t pos = sizeof(frameHeader);
+        for (;;) {
+            if (pos + 4 > blockLen)
+                return LENGTH_INSUFFICIENT_DATA;
+            uint32_le blockHeader;
+            std::memcpy(&blockHeader, block + pos, 4);
+            pos += 4;
+            if (blockHeader == 0)
+                break;
+            uint32_t blockSize = blockHeader;
+            pos += (blockSize & ~lz4::NotCompressedMask)
+                + 4 * frameHeader.blockChecksum();
+        }
+
+        if (frameHeader.streamChecksum())
+            pos += 4;
+
+        return pos <= blockLen ? (int64_t)pos : LENGTH_INSUFFICIENT_DATA;
+    }
+
+    virtual void decompressPiece(const char * data, size_t len,
+                                 const OnData & onData) const override
+    {
+        Lz4Decompressor decompressor;
+        decompressor.decompress(data, len, onData);
+        decompressor.finish(onData);
+    }
+
     // write all data
     void write(const OnData & onData, const void * mem, size_t len)
     {
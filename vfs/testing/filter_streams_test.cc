@@ -14,6 +14,7 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/compressor.h"
 #include "mldb/arch/exception.h"
 #include "mldb/arch/exception_handler.h"
 
@@ -26,6 +27,7 @@
 #include <iostream>
 #include <fcntl.h>
 #include <exception>
+#include <random>
 
 #include "mldb/base/scope.h"
 #include "mldb/arch/exception_handler.h"
@@ -672,3 +674,142 @@ BOOST_AUTO_TEST_CASE(test_file_stream_tellg)
         BOOST_CHECK_EQUAL(stream.tellg(), -1);
     }
 }
+
+namespace {
+
+// Compress each chunk of the data separately, and concatenate the output
+string compressPieces(const string & compression, const string & data,
+                      size_t chunkSize, bool bgzf = false)
+{
+    string result;
+    for (size_t i = 0;  i < data.size();  i += chunkSize) {
+        string piece;
+        auto onData = [&] (const char * p, size_t len)
+            {
+                piece.append(p, len);
+                return len;
+            };
+
+        std::unique_ptr<Compressor> compressor
+            (Compressor::create(compression, 1));
+        compressor->compress(data.data() + i,
+                             std::min(chunkSize, data.size() - i),
+                             onData);
+        compressor->finish(onData);
+
+        if (bgzf) {
+            // Add the BC extra field with the member length, which makes
+            // this a BGZF block
+            BOOST_REQUIRE_EQUAL((int)piece[3], 0);
+            piece[3] = 4;  // FEXTRA
+            size_t len = piece.size() + 8;
+            BOOST_REQUIRE_LT(len, 65536);
+            string extra = { 6, 0, 'B', 'C', 2, 0,
+                             char((len - 1) & 0xff), char((len - 1) >> 8) };
+            piece.insert(10, extra);
+        }
+
+        result += piece;
+    }
+    return result;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE(test_parallel_decompression)
+{
+    fs::create_directories("build/x86_64/tmp");
+
+    string data;
+    for (unsigned i = 0;  data.size() < 10000000;  ++i) {
+        data += "line " + std::to_string(i) + " "
+            + std::to_string(i * 2654435761U) + "\n";
+    }
+
+    struct Case {
+        string compression;
+        string extension;
+        size_t chunkSize;
+        bool bgzf;
+    };
+
+    vector<Case> cases = {
+        { "zstd", "zst", 100000, false },
+        { "zstd", "zst", 3000000, false },  // a few pieces to a batch
+        { "lz4", "lz4", 100000, false },
+        { "gzip", "gz", 30000, true },
+        { "gzip", "gz", 1000000, false },   // multi-member, but not BGZF
+    };
+
+    for (auto & c: cases) {
+        cerr << "testing " << c.compression << " chunk size " << c.chunkSize
+             << " bgzf " << c.bgzf << endl;
+        string filename = "build/x86_64/tmp/parallel_decompression."
+            + c.extension;
+        FileCleanup cleanup(filename);
+
+        {
+            ofstream out(filename);
+            out << compressPieces(c.compression, data, c.chunkSize, c.bgzf);
+        }
+
+        filter_istream stream(filename);
+        BOOST_CHECK(stream.readAll() == data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_decompression_oversized_pieces)
+{
+    fs::create_directories("build/x86_64/tmp");
+
+    // Random data doesn't compress, so the 6MB pieces are bigger than a
+    // batch once compressed, which makes the decompression go serial
+    // after the small pieces before them have been decompressed in
+    // parallel
+    std::mt19937 rng(1);
+    string data(20000000, '\0');
+    for (auto & c: data)
+        c = rng();
+
+    size_t split = 8000000;
+    string compressed
+        = compressPieces("zstd", data.substr(0, split), 100000)
+        + compressPieces("zstd", data.substr(split), 6000000);
+    BOOST_REQUIRE_GT(compressed.size(), data.size());
+
+    string filename = "build/x86_64/tmp/parallel_decompression_oversized.zst";
+    FileCleanup cleanup(filename);
+    {
+        ofstream out(filename);
+        out << compressed;
+    }
+
+    filter_istream stream(filename);
+    BOOST_CHECK(stream.readAll() == data);
+}
+
+BOOST_AUTO_TEST_CASE(test_zstd_reserved_block_type)
+{
+    std::unique_ptr<Decompressor> decompressor(Decompressor::create("zstd"));
+
+    // Frame header with no content size, then a block of the reserved
+    // type, which the piece can't be cut around
+    string frame = { '\x28', '\xb5', '\x2f', '\xfd', '\x00', '\x00',
+                     '\x07', '\x00', '\x00' };
+    BOOST_CHECK_EQUAL(decompressor->pieceLength(frame.data(), frame.size()),
+                      Decompressor::LENGTH_UNKNOWN);
+
+    // So it goes through the serial decompressor, which reports the error
+    // once the valid pieces before it are read
+    string data(1000000, 'x');
+    string filename = "build/x86_64/tmp/zstd_reserved_block.zst";
+    FileCleanup cleanup(filename);
+    {
+        ofstream out(filename);
+        out << compressPieces("zstd", data, 100000) << frame;
+    }
+
+    filter_istream stream(filename);
+    MLDB_TRACE_EXCEPTIONS(false);
+    BOOST_CHECK_THROW(stream.readAll(), std::exception);
+}
@@ -17,6 +17,7 @@ LIBVFS_SOURCES := \
 
 LIBVFS_LINK := \
 	arch \
+	base \
 	boost_iostreams \
 	types \
 	$(STD_FILESYSTEM_LIBNAME) \
@@ -151,9 +151,8 @@ struct ZStandardDecompressor: public Decompressor {
                                 ZSTD_getErrorName(res));
             }
             writeAll(onData);
-            if (res == 0 && inBuf.pos < inBuf.size) {
-                throw Exception("Extra bytes at end of decompressed zstandard stream");
-            }
+            // If res == 0 a frame has finished; any more data is the next
+            // frame, which the stream will start on by itself
         }
     }
     
@@ -161,6 +160,86 @@ struct ZStandardDecompressor: public Decompressor {
     {
     }
 
+    /* Each frame is a piece.  We find the end of a frame by walking its
+       block headers, which doesn't need any decompression.  Skippable
+       frames (like the seek table of the seekable format) are pieces that
+       decompress to nothing.
+    */
+    virtual int64_t pieceLength(const char * block,
+                                size_t blockLen) const override
+    {
+        const unsigned char * p = (const unsigned char *)block;
+
+        auto readLE = [&] (size_t offset, int bytes) -> uint64_t
+            {
+                uint64_t result = 0;
+                for (int i = bytes - 1;  i >= 0;  --i)
+                    result = (result << 8) | p[offset + i];
+                return result;
+            };
+
+        if (blockLen < 4)
+            return LENGTH_INSUFFICIENT_DATA;
+        uint32_t magic = readLE(0, 4);
+
+        if ((magic & 0xfffffff0) == 0x184d2a50) {
+            // Skippable frame
+            if (blockLen < 8)
+                return LENGTH_INSUFFICIENT_DATA;
+            uint64_t len = 8 + readLE(4, 4);
+            return len <= blockLen ? (int64_t)len : LENGTH_INSUFFICIENT_DATA;
+        }
+
+        if (magic != 0xfd2fb528)
+            return LENGTH_UNKNOWN;  // legacy format; not splittable
+
+        if (blockLen < 5)
+            return LENGTH_INSUFFICIENT_DATA;
+
+        // Frame header
+        unsigned descriptor = p[4];
+        bool singleSegment = descriptor & 0x20;
+        bool hasChecksum = descriptor & 0x04;
+        static const int dictIdSizes[4] = { 0, 1, 2, 4 };
+        static const int contentSizeSizes[4] = { 0, 2, 4, 8 };
+        int contentSizeSize = contentSizeSizes[descriptor >> 6];
+        if (contentSizeSize == 0 && singleSegment)
+            contentSizeSize = 1;
+
+        uint64_t pos = 5 + !singleSegment + dictIdSizes[descriptor & 3]
+            + contentSizeSize;
+
+        // Blocks
+        for (;;) {
+            if (pos + 3 > blockLen)
+                return LENGTH_INSUFFICIENT_DATA;
+            uint32_t header = readLE(pos, 3);
+            bool lastBlock = header & 1;
+            unsigned type = (header >> 1) & 3;
+            uint32_t size = header >> 3;
+            if (type == 3) {
+                // Reserved block type; the decompressor will say what's
+                // wrong with it
+                return LENGTH_UNKNOWN;
+            }
+            pos += 3 + (type == 1 /* RLE */ ? 1 : size);
+            if (lastBlock)
+                break;
+        }
+
+        if (hasChecksum)
+            pos += 4;
+
+        return pos <= blockLen ? (int64_t)pos : LENGTH_INSUFFICIENT_DATA;
+    }
+
+    virtual void decompressPiece(const char * data, size_t len,
+                                 const OnData & onData) const override
+    {
+        ZStandardDecompressor decompressor;
+        decompressor.decompress(data, len, onData);
+    }
+
     size_t writeAll(const OnData & onData)
     {
         size_t written = 0;